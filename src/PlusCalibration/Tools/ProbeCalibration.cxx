@@ -30,6 +30,7 @@ compares the results to a baseline
 #include "vtksys/CommandLineArguments.hxx"
 #include "vtksys/SystemTools.hxx"
 #include <iostream>
+#include <sstream>
 #include <stdlib.h>
 
 #ifndef _WIN32
@@ -38,6 +39,11 @@ const double ERROR_THRESHOLD = LINUXTOLERANCEPERCENT;
 const double ERROR_THRESHOLD = 0.05;
 #endif
 
+// Levenberg-Marquardt may not be worse than Powell by more than this (relative to the RMS error of Powell)
+const double OPTIMIZER_RMS_ERROR_RELATIVE_TOLERANCE = 0.01;
+// Levenberg-Marquardt is expected to decrease the cost in its first iterations from the linear least squares starting point
+const int LM_MIN_NUMBER_OF_ITERATIONS = 2;
+
 int CompareCalibrationResultsWithBaseline(const char* baselineFileName, const char* currentResultFileName, double translationErrorThreshold, double rotationErrorThreshold);
 
 int main(int argc, char* argv[])
@@ -59,6 +65,9 @@ int main(int argc, char* argv[])
   double inputRotationErrorThreshold(1e-10);
 #endif
 
+  std::string optimizerName;
+  bool compareOptimizers(false);
+
   int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
 
   vtksys::CommandLineArguments args;
@@ -77,6 +86,9 @@ int main(int argc, char* argv[])
 
   args.AddArgument("--output-config-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &resultConfigFileName, "Result configuration file name. Optional.");
 
+  args.AddArgument("--optimizer", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &optimizerName, "Optimizer used for refining the calibration (POWELL or LEVENBERG_MARQUARDT). Optional, overrides the Optimizer attribute of the configuration.");
+  args.AddArgument("--compare-optimizers", vtksys::CommandLineArguments::NO_ARGUMENT, &compareOptimizers, "After calibration, run each optimizer from the same starting point and report their number of iterations, cost function evaluations, and computation time. Fails if Levenberg-Marquardt ends with a higher RMS error than Powell or stops without decreasing the cost. Optional, requires an OptimizationMethod in the configuration.");
+
   args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
 
   if (!args.Parse())
@@ -116,6 +128,29 @@ int main(int argc, char* argv[])
   vtkSmartPointer<vtkPlusProbeCalibrationAlgo> freehandCalibration = vtkSmartPointer<vtkPlusProbeCalibrationAlgo>::New();
   freehandCalibration->ReadConfiguration(configRootElement);
 
+  vtkPlusProbeCalibrationOptimizerAlgo* optimizer = freehandCalibration->GetOptimizer();
+  if (!optimizerName.empty())
+  {
+    if (STRCASECMP(optimizerName.c_str(), vtkPlusProbeCalibrationOptimizerAlgo::GetOptimizerAsString(vtkPlusProbeCalibrationOptimizerAlgo::OPTIMIZER_POWELL)) == 0)
+    {
+      optimizer->SetOptimizer(vtkPlusProbeCalibrationOptimizerAlgo::OPTIMIZER_POWELL);
+    }
+    else if (STRCASECMP(optimizerName.c_str(), vtkPlusProbeCalibrationOptimizerAlgo::GetOptimizerAsString(vtkPlusProbeCalibrationOptimizerAlgo::OPTIMIZER_LEVENBERG_MARQUARDT)) == 0)
+    {
+      optimizer->SetOptimizer(vtkPlusProbeCalibrationOptimizerAlgo::OPTIMIZER_LEVENBERG_MARQUARDT);
+    }
+    else
+    {
+      LOG_ERROR("Invalid optimizer: " << optimizerName);
+      return EXIT_FAILURE;
+    }
+  }
+  if (compareOptimizers && !optimizer->Enabled())
+  {
+    LOG_ERROR("Optimizers cannot be compared, because OptimizationMethod is not specified in the configuration");
+    return EXIT_FAILURE;
+  }
+
   PlusFidPatternRecognition patternRecognition;
   PlusFidPatternRecognition::PatternRecognitionError error;
   patternRecognition.ReadConfiguration(configRootElement);
@@ -180,6 +215,66 @@ int main(int argc, char* argv[])
     }
   }
 
+  if (optimizer->Enabled())
+  {
+    LOG_INFO("Calibration optimizer: " << vtkPlusProbeCalibrationOptimizerAlgo::GetOptimizerAsString(optimizer->GetOptimizer())
+             << ", iterations: " << optimizer->GetNumberOfIterations()
+             << ", cost function evaluations: " << optimizer->GetNumberOfCostFunctionEvaluations()
+             << ", time: " << optimizer->GetOptimizationTimeSec() << " sec");
+  }
+
+  if (compareOptimizers)
+  {
+    // Both optimizers start from the linear least squares solution of the calibration (the calibration result is not changed)
+    vtkPlusProbeCalibrationOptimizerAlgo::OptimizerType calibrationOptimizer = optimizer->GetOptimizer();
+    const vtkPlusProbeCalibrationOptimizerAlgo::OptimizerType optimizerTypes[2] = { vtkPlusProbeCalibrationOptimizerAlgo::OPTIMIZER_POWELL, vtkPlusProbeCalibrationOptimizerAlgo::OPTIMIZER_LEVENBERG_MARQUARDT };
+    std::ostringstream comparison;
+    double errorRmsOfOptimizer[2] = { 0.0, 0.0 };
+    bool comparisonFailed = false;
+    for (int i = 0; i < 2; ++i)
+    {
+      optimizer->SetOptimizer(optimizerTypes[i]);
+      if (optimizer->Update() != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Optimization with " << vtkPlusProbeCalibrationOptimizerAlgo::GetOptimizerAsString(optimizerTypes[i]) << " failed");
+        return EXIT_FAILURE;
+      }
+      double errorMean = 0.0;
+      double errorStDev = 0.0;
+      double errorRms = 0.0;
+      optimizer->ComputeError(optimizer->GetOptimizedImageToProbeTransformMatrix(), errorMean, errorStDev, errorRms);
+      errorRmsOfOptimizer[i] = errorRms;
+      if (optimizerTypes[i] == vtkPlusProbeCalibrationOptimizerAlgo::OPTIMIZER_LEVENBERG_MARQUARDT
+          && optimizer->GetStopConditionDescription() == vtkPlusProbeCalibrationOptimizerAlgo::LM_STOP_CONDITION_NO_DECREASE
+          && optimizer->GetNumberOfIterations() < LM_MIN_NUMBER_OF_ITERATIONS)
+      {
+        // The first steps did not decrease the cost, the derivatives are probably wrong
+        LOG_ERROR("Levenberg-Marquardt optimization stopped after " << optimizer->GetNumberOfIterations() << " iterations: "
+                  << optimizer->GetStopConditionDescription());
+        comparisonFailed = true;
+      }
+      comparison << std::endl << "  " << vtkPlusProbeCalibrationOptimizerAlgo::GetOptimizerAsString(optimizerTypes[i])
+                 << ": iterations: " << optimizer->GetNumberOfIterations()
+                 << ", cost function evaluations: " << optimizer->GetNumberOfCostFunctionEvaluations()
+                 << ", time: " << optimizer->GetOptimizationTimeSec() << " sec"
+                 << ", RMS error: " << errorRms;
+    }
+    optimizer->SetOptimizer(calibrationOptimizer);
+    LOG_INFO("Optimizer comparison (" << vtkPlusProbeCalibrationOptimizerAlgo::GetOptimizationMethodAsString(optimizer->GetOptimizationMethod())
+             << " cost function, " << optimizer->GetNumberOfThreads() << " threads):" << comparison.str());
+    // Both optimizers minimize the same cost function from the same starting point, so they are expected to find the same minimum
+    if (errorRmsOfOptimizer[1] > errorRmsOfOptimizer[0] * (1.0 + OPTIMIZER_RMS_ERROR_RELATIVE_TOLERANCE))
+    {
+      LOG_ERROR("RMS error of the Levenberg-Marquardt optimization (" << errorRmsOfOptimizer[1] << ") is worse than the RMS error of the Powell optimization ("
+                << errorRmsOfOptimizer[0] << ") by more than " << OPTIMIZER_RMS_ERROR_RELATIVE_TOLERANCE * 100.0 << "%");
+      comparisonFailed = true;
+    }
+    if (comparisonFailed)
+    {
+      return EXIT_FAILURE;
+    }
+  }
+
   // Save result to configuration file
   if (!resultConfigFileName.empty())
   {
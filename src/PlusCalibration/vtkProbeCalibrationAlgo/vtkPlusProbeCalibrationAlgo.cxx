@@ -1145,6 +1145,113 @@ void vtkPlusProbeCalibrationAlgo::ComputeError3d(const vnl_matrix_fixed<double,
   igsioMath::ComputeRms(reprojectionErrors, errorRms);
 }
 
+//--------------------------------------------------------------------------------
+int vtkPlusProbeCalibrationAlgo::GetNumberOfNonOutlierCalibrationFrames()
+{
+  return this->PreProcessedWirePositions[CALIBRATION_NOT_OUTLIER].FramePositions.size();
+}
+
+//--------------------------------------------------------------------------------
+void vtkPlusProbeCalibrationAlgo::ComputeResidualsAndJacobian2d(int frameIndex, const vnl_matrix_fixed<double, 4, 4>& imageToProbeMatrix, const std::vector< vnl_matrix_fixed<double, 4, 4> >& imageToProbeMatrixDerivatives,
+    vnl_vector<double>& residuals, vnl_matrix<double>& jacobian)
+{
+  const NWirePositionType& framePosition = this->PreProcessedWirePositions[CALIBRATION_NOT_OUTLIER].FramePositions[frameIndex];
+  const int numberOfNWires = this->NWires.size();
+  const int numberOfParameters = imageToProbeMatrixDerivatives.size();
+  residuals.set_size(numberOfNWires * 3 * 2);
+  jacobian.set_size(numberOfNWires * 3 * 2, numberOfParameters);
+
+  vnl_matrix_fixed<double, 4, 4> probeToImageTransform = vnl_inverse(imageToProbeMatrix);
+  vnl_matrix_fixed<double, 4, 4> phantomToImageTransform = probeToImageTransform * vnl_inverse(framePosition.ProbeToPhantomTransform);
+
+  // The derivative of the probe to image transform is -probeToImage * d(imageToProbe) * probeToImage,
+  // therefore the derivative of a point position in the image is -probeToImage * d(imageToProbe) * pointPositionInImage
+  std::vector< vnl_matrix_fixed<double, 4, 4> > pointDerivativeTransforms(numberOfParameters);
+  for (int parameterIndex = 0; parameterIndex < numberOfParameters; ++parameterIndex)
+  {
+    pointDerivativeTransforms[parameterIndex] = -probeToImageTransform * imageToProbeMatrixDerivatives[parameterIndex];
+  }
+
+  vnl_vector_fixed<double, 4> wireEndPointFront_Phantom;
+  vnl_vector_fixed<double, 4> wireEndPointBack_Phantom;
+  wireEndPointFront_Phantom(3) = 1.0;
+  wireEndPointBack_Phantom(3) = 1.0;
+  for (int nWireIndex = 0; nWireIndex < numberOfNWires; nWireIndex++)
+  {
+    for (int wireIndex = 0; wireIndex < 3; wireIndex++)
+    {
+      const int residualIndex = (nWireIndex * 3 + wireIndex) * 2;
+      const PlusFidWire& wire = this->NWires[nWireIndex].GetWires()[wireIndex];
+      for (int i = 0; i < 3; ++i)
+      {
+        wireEndPointFront_Phantom(i) = wire.EndPointFront[i];
+        wireEndPointBack_Phantom(i) = wire.EndPointBack[i];
+      }
+      vnl_vector_fixed<double, 4> front = phantomToImageTransform * wireEndPointFront_Phantom;
+      vnl_vector_fixed<double, 4> back = phantomToImageTransform * wireEndPointBack_Phantom;
+
+      // Intersection of the wire and the image plane (z=0): front + t * (back - front)
+      double frontBackDistanceZ = front(2) - back(2);
+      if (fabs(frontBackDistanceZ) < 1e-10)
+      {
+        // Image plane and wire are parallel, this wire does not contribute to the error
+        residuals(residualIndex) = 0.0;
+        residuals(residualIndex + 1) = 0.0;
+        for (int parameterIndex = 0; parameterIndex < numberOfParameters; ++parameterIndex)
+        {
+          jacobian(residualIndex, parameterIndex) = 0.0;
+          jacobian(residualIndex + 1, parameterIndex) = 0.0;
+        }
+        continue;
+      }
+      double t = front(2) / frontBackDistanceZ;
+      vnl_vector_fixed<double, 4> frontToBack = back - front;
+
+      const vnl_vector_fixed<double, 4>& segmentedPoint_Image = framePosition.AllWiresIntersectionPointsPos_Image[nWireIndex * 3 + wireIndex];
+      residuals(residualIndex) = segmentedPoint_Image(0) - (front(0) + t * frontToBack(0));
+      residuals(residualIndex + 1) = segmentedPoint_Image(1) - (front(1) + t * frontToBack(1));
+
+      for (int parameterIndex = 0; parameterIndex < numberOfParameters; ++parameterIndex)
+      {
+        vnl_vector_fixed<double, 4> frontDerivative = pointDerivativeTransforms[parameterIndex] * front;
+        vnl_vector_fixed<double, 4> backDerivative = pointDerivativeTransforms[parameterIndex] * back;
+        double tDerivative = (front(2) * backDerivative(2) - back(2) * frontDerivative(2)) / (frontBackDistanceZ * frontBackDistanceZ);
+        jacobian(residualIndex, parameterIndex) = -((1.0 - t) * frontDerivative(0) + t * backDerivative(0) + tDerivative * frontToBack(0));
+        jacobian(residualIndex + 1, parameterIndex) = -((1.0 - t) * frontDerivative(1) + t * backDerivative(1) + tDerivative * frontToBack(1));
+      }
+    }
+  }
+}
+
+//--------------------------------------------------------------------------------
+void vtkPlusProbeCalibrationAlgo::ComputeResidualsAndJacobian3d(int frameIndex, const vnl_matrix_fixed<double, 4, 4>& imageToProbeMatrix, const std::vector< vnl_matrix_fixed<double, 4, 4> >& imageToProbeMatrixDerivatives,
+    vnl_vector<double>& residuals, vnl_matrix<double>& jacobian)
+{
+  const NWirePositionType& framePosition = this->PreProcessedWirePositions[CALIBRATION_NOT_OUTLIER].FramePositions[frameIndex];
+  const int numberOfNWires = this->NWires.size();
+  const int numberOfParameters = imageToProbeMatrixDerivatives.size();
+  residuals.set_size(numberOfNWires * 3);
+  jacobian.set_size(numberOfNWires * 3, numberOfParameters);
+
+  for (int nWireIndex = 0; nWireIndex < numberOfNWires; nWireIndex++)
+  {
+    const vnl_vector_fixed<double, 4>& segmentedPoint_Image = framePosition.AllWiresIntersectionPointsPos_Image[nWireIndex * 3 + 1];
+    vnl_vector_fixed<double, 4> segmentedPoint_Probe = imageToProbeMatrix * segmentedPoint_Image;
+    for (int i = 0; i < 3; ++i)
+    {
+      residuals(nWireIndex * 3 + i) = segmentedPoint_Probe(i) - framePosition.MiddleWireIntersectionPointsPos_Probe[nWireIndex](i);
+    }
+    for (int parameterIndex = 0; parameterIndex < numberOfParameters; ++parameterIndex)
+    {
+      vnl_vector_fixed<double, 4> segmentedPointDerivative = imageToProbeMatrixDerivatives[parameterIndex] * segmentedPoint_Image;
+      for (int i = 0; i < 3; ++i)
+      {
+        jacobian(nWireIndex * 3 + i, parameterIndex) = segmentedPointDerivative(i);
+      }
+    }
+  }
+}
+
 //--------------------------------------------------------------------------------
 double vtkPlusProbeCalibrationAlgo::GetCalibrationReprojectionError3DMean()
 {
@@ -122,6 +122,31 @@ public:
   void ComputeError2d( const vnl_matrix_fixed<double, 4, 4>& imageToProbeMatrix, double& errorMean, double& errorStDev, double& errorRms );
   void ComputeError3d( const vnl_matrix_fixed<double, 4, 4>& imageToProbeMatrix, double& errorMean, double& errorStDev, double& errorRms );
 
+  /*! Get the number of calibration frames that are not outliers (frames that are used by the optimizer) */
+  int GetNumberOfNonOutlierCalibrationFrames();
+
+  /*!
+    Compute the 2D reprojection error vectors of all wires in a non-outlier calibration frame and their derivatives
+    \param frameIndex Index of the frame, between 0 and GetNumberOfNonOutlierCalibrationFrames()-1
+    \param imageToProbeMatrix Image to probe transform at which the errors are computed
+    \param imageToProbeMatrixDerivatives Derivatives of the image to probe transform with respect to each optimized parameter
+    \param residuals Segmented minus computed wire intersection point position in the image (x and y for each wire)
+    \param jacobian Derivatives of the residuals (rows) with respect to each optimized parameter (columns)
+  */
+  void ComputeResidualsAndJacobian2d( int frameIndex, const vnl_matrix_fixed<double, 4, 4>& imageToProbeMatrix, const std::vector< vnl_matrix_fixed<double, 4, 4> >& imageToProbeMatrixDerivatives,
+                                      vnl_vector<double>& residuals, vnl_matrix<double>& jacobian );
+
+  /*!
+    Compute the 3D reprojection error vectors of the middle wires in a non-outlier calibration frame and their derivatives
+    \param frameIndex Index of the frame, between 0 and GetNumberOfNonOutlierCalibrationFrames()-1
+    \param imageToProbeMatrix Image to probe transform at which the errors are computed
+    \param imageToProbeMatrixDerivatives Derivatives of the image to probe transform with respect to each optimized parameter
+    \param residuals Segmented minus computed middle wire intersection point position in the probe frame (x, y, and z for each N-wire)
+    \param jacobian Derivatives of the residuals (rows) with respect to each optimized parameter (columns)
+  */
+  void ComputeResidualsAndJacobian3d( int frameIndex, const vnl_matrix_fixed<double, 4, 4>& imageToProbeMatrix, const std::vector< vnl_matrix_fixed<double, 4, 4> >& imageToProbeMatrixDerivatives,
+                                      vnl_vector<double>& residuals, vnl_matrix<double>& jacobian );
+
 protected:
 
   enum PreProcessedWirePositionIdType
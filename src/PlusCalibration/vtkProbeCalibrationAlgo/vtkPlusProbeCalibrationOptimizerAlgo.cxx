@@ -16,13 +16,27 @@ See License.txt for details.
 #include "vtkIGSIOTransformRepository.h"
 #include "vtkXMLUtilities.h"
 
+#include "vtkMultiThreader.h"
 #include "vtksys/SystemTools.hxx"
 
 #include "itkPowellOptimizer.h"
 #include "itkScaleVersor3DTransform.h"
 #include "itkSimilarity3DTransform.h"
 
-typedef  itk::PowellOptimizer  OptimizerType;
+#include <vnl/vnl_svd.h>
+
+#include <algorithm>
+#include <limits>
+
+typedef  itk::PowellOptimizer  PowellOptimizerType;
+
+// Levenberg-Marquardt parameters
+static const int LM_MAX_ITERATIONS = 200;
+static const double LM_INITIAL_DAMPING = 1e-3;
+static const double LM_MAX_DAMPING = 1e16;
+static const double LM_COST_TOLERANCE = 1e-12; // stop if the relative decrease of the cost is smaller than this
+static const double LM_STEP_TOLERANCE = 1e-10; // stop if the relative size of the parameter update is smaller than this
+static const double LM_MAX_VERSOR_NORM = 1.0 - 1e-6; // rotation parameters are the vector part of a unit quaternion
 
 //-----------------------------------------------------------------------------
 class DistanceToWiresCostFunction : public itk::SingleValuedCostFunction 
@@ -42,10 +56,12 @@ public:
 
   DistanceToWiresCostFunction()
   : m_CalibrationOptimizer(NULL)
+  , m_NumberOfEvaluations(0)
   {
   }
 
   DistanceToWiresCostFunction(vtkPlusProbeCalibrationOptimizerAlgo* calibrationOptimizer) 
+  : m_NumberOfEvaluations(0)
   {
     m_CalibrationOptimizer=calibrationOptimizer;
   }
@@ -85,6 +101,111 @@ public:
     return PLUS_SUCCESS;
   }
 
+  /*! Compute the derivatives of the image to probe matrix with respect to each transform parameter (see GetTransformMatrix) */
+  static PlusStatus GetTransformMatrixDerivatives(std::vector< vnl_matrix_fixed<double,4,4> >& imageToProbeTransformDerivatives, const ParametersType & imageToProbeTransformParameters)
+  {
+    const unsigned int numberOfParameters=imageToProbeTransformParameters.GetSize();
+    if (numberOfParameters!=7 && numberOfParameters!=8)
+    {
+      LOG_ERROR("GetTransformMatrixDerivatives expects 7 or 8 parameters");
+      return PLUS_FAIL;
+    }
+
+    // Versor (unit quaternion): the parameters are the vector part, the scalar part is computed from them
+    const double x=imageToProbeTransformParameters[0];
+    const double y=imageToProbeTransformParameters[1];
+    const double z=imageToProbeTransformParameters[2];
+    const double versorSquaredNorm=x*x+y*y+z*z;
+    if (versorSquaredNorm>LM_MAX_VERSOR_NORM*LM_MAX_VERSOR_NORM)
+    {
+      LOG_ERROR("GetTransformMatrixDerivatives: invalid rotation parameters");
+      return PLUS_FAIL;
+    }
+    const double w=sqrt(1.0-versorSquaredNorm);
+
+    // Rotation matrix, same as itk::Versor::GetMatrix()
+    vnl_matrix_fixed<double,3,3> rotation;
+    rotation(0,0)=1.0-2.0*(y*y+z*z); rotation(0,1)=2.0*(x*y-z*w);     rotation(0,2)=2.0*(x*z+y*w);
+    rotation(1,0)=2.0*(x*y+z*w);     rotation(1,1)=1.0-2.0*(x*x+z*z); rotation(1,2)=2.0*(y*z-x*w);
+    rotation(2,0)=2.0*(x*z-y*w);     rotation(2,1)=2.0*(y*z+x*w);     rotation(2,2)=1.0-2.0*(x*x+y*y);
+
+    double scale[3]={0};
+    bool isotropicPixelSpacing=(numberOfParameters==7);
+    if (isotropicPixelSpacing)
+    {
+      scale[0]=scale[1]=scale[2]=imageToProbeTransformParameters[6];
+    }
+    else
+    {
+      scale[0]=imageToProbeTransformParameters[6];
+      scale[1]=imageToProbeTransformParameters[7];
+      scale[2]=(imageToProbeTransformParameters[6]+imageToProbeTransformParameters[7])/2;
+    }
+
+    imageToProbeTransformDerivatives.resize(numberOfParameters);
+    for (unsigned int parameterIndex=0; parameterIndex<numberOfParameters; ++parameterIndex)
+    {
+      imageToProbeTransformDerivatives[parameterIndex].fill(0.0);
+    }
+
+    // Rotation: derivatives of the versor components with respect to x, y, z (w depends on all of them)
+    const double versorDerivatives[3][4]=
+    {
+      { 1.0, 0.0, 0.0, -x/w },
+      { 0.0, 1.0, 0.0, -y/w },
+      { 0.0, 0.0, 1.0, -z/w }
+    };
+    for (int parameterIndex=0; parameterIndex<3; ++parameterIndex)
+    {
+      const double dx=versorDerivatives[parameterIndex][0];
+      const double dy=versorDerivatives[parameterIndex][1];
+      const double dz=versorDerivatives[parameterIndex][2];
+      const double dw=versorDerivatives[parameterIndex][3];
+      vnl_matrix_fixed<double,3,3> rotationDerivative;
+      rotationDerivative(0,0)=-4.0*(y*dy+z*dz);
+      rotationDerivative(0,1)=2.0*(dx*y+x*dy-dz*w-z*dw);
+      rotationDerivative(0,2)=2.0*(dx*z+x*dz+dy*w+y*dw);
+      rotationDerivative(1,0)=2.0*(dx*y+x*dy+dz*w+z*dw);
+      rotationDerivative(1,1)=-4.0*(x*dx+z*dz);
+      rotationDerivative(1,2)=2.0*(dy*z+y*dz-dx*w-x*dw);
+      rotationDerivative(2,0)=2.0*(dx*z+x*dz-dy*w-y*dw);
+      rotationDerivative(2,1)=2.0*(dy*z+y*dz+dx*w+x*dw);
+      rotationDerivative(2,2)=-4.0*(x*dx+y*dy);
+      for (int row=0; row<3; ++row)
+      {
+        for (int column=0; column<3; ++column)
+        {
+          imageToProbeTransformDerivatives[parameterIndex](row,column)=rotationDerivative(row,column)*scale[column];
+        }
+      }
+    }
+
+    // Translation
+    for (int row=0; row<3; ++row)
+    {
+      imageToProbeTransformDerivatives[3+row](row,3)=1.0;
+    }
+
+    // Scaling
+    for (int row=0; row<3; ++row)
+    {
+      if (isotropicPixelSpacing)
+      {
+        imageToProbeTransformDerivatives[6](row,0)=rotation(row,0);
+        imageToProbeTransformDerivatives[6](row,1)=rotation(row,1);
+        imageToProbeTransformDerivatives[6](row,2)=rotation(row,2);
+      }
+      else
+      {
+        imageToProbeTransformDerivatives[6](row,0)=rotation(row,0);
+        imageToProbeTransformDerivatives[6](row,2)=rotation(row,2)/2;
+        imageToProbeTransformDerivatives[7](row,1)=rotation(row,1);
+        imageToProbeTransformDerivatives[7](row,2)=rotation(row,2)/2;
+      }
+    }
+    return PLUS_SUCCESS;
+  }
+
   static PlusStatus GetTransformParameters(ParametersType& imageToProbeTransformParameters, const vnl_matrix_fixed<double,4,4>& imageToProbeTransform_vnl)
   {
     if (imageToProbeTransformParameters.GetSize()!=7 && imageToProbeTransformParameters.GetSize()!=8)
@@ -135,9 +256,15 @@ public:
     double errorStDev=0.0;
     double errorRms=0.0;
     m_CalibrationOptimizer->ComputeError(imageToProbeTransform_vnl, errorMean, errorStDev, errorRms);
+    ++m_NumberOfEvaluations;
     return errorRms;
   }
 
+  int GetNumberOfEvaluations() const
+  {
+    return m_NumberOfEvaluations;
+  }
+
   void GetDerivative( const ParametersType & parameters, DerivativeType  & derivative ) const
   {
     LOG_ERROR("GetDerivative is not implemented");
@@ -157,14 +284,65 @@ public:
 
 private:
   vtkPlusProbeCalibrationOptimizerAlgo* m_CalibrationOptimizer;
+  mutable int m_NumberOfEvaluations;
 }; 
 
+//-----------------------------------------------------------------------------
+struct NormalEquationsThreadData
+{
+  vtkPlusProbeCalibrationAlgo* ProbeCalibrationAlgo;
+  vtkPlusProbeCalibrationOptimizerAlgo::OptimizationMethodType OptimizationMethod;
+  vnl_matrix_fixed<double,4,4> ImageToProbeTransformMatrix;
+  std::vector< vnl_matrix_fixed<double,4,4> > ImageToProbeTransformDerivatives;
+  int NumberOfFrames;
+  // Results, one for each thread
+  std::vector< vnl_matrix<double> > JacobianTransposeJacobians;
+  std::vector< vnl_vector<double> > JacobianTransposeResiduals;
+  std::vector<double> SumSquaredResiduals;
+};
+
+//-----------------------------------------------------------------------------
+static VTK_THREAD_RETURN_TYPE ComputeNormalEquationsThread(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  NormalEquationsThreadData* data = static_cast<NormalEquationsThreadData*>(threadInfo->UserData);
+  int firstFrameIndex = data->NumberOfFrames * threadInfo->ThreadID / threadInfo->NumberOfThreads;
+  int lastFrameIndex = data->NumberOfFrames * (threadInfo->ThreadID + 1) / threadInfo->NumberOfThreads;
+  vnl_matrix<double>& jacobianTransposeJacobian = data->JacobianTransposeJacobians[threadInfo->ThreadID];
+  vnl_vector<double>& jacobianTransposeResiduals = data->JacobianTransposeResiduals[threadInfo->ThreadID];
+  double& sumSquaredResiduals = data->SumSquaredResiduals[threadInfo->ThreadID];
+  vnl_vector<double> residuals;
+  vnl_matrix<double> jacobian;
+  for (int frameIndex = firstFrameIndex; frameIndex < lastFrameIndex; ++frameIndex)
+  {
+    if (data->OptimizationMethod == vtkPlusProbeCalibrationOptimizerAlgo::MINIMIZE_DISTANCE_OF_ALL_WIRES_IN_2D)
+    {
+      data->ProbeCalibrationAlgo->ComputeResidualsAndJacobian2d(frameIndex, data->ImageToProbeTransformMatrix, data->ImageToProbeTransformDerivatives, residuals, jacobian);
+    }
+    else
+    {
+      data->ProbeCalibrationAlgo->ComputeResidualsAndJacobian3d(frameIndex, data->ImageToProbeTransformMatrix, data->ImageToProbeTransformDerivatives, residuals, jacobian);
+    }
+    jacobianTransposeJacobian += jacobian.transpose() * jacobian;
+    jacobianTransposeResiduals += jacobian.transpose() * residuals;
+    sumSquaredResiduals += residuals.squared_magnitude();
+  }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
 //-----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkPlusProbeCalibrationOptimizerAlgo);
 
+const char* vtkPlusProbeCalibrationOptimizerAlgo::LM_STOP_CONDITION_NO_DECREASE = "Cost function cannot be decreased further";
+
 //-----------------------------------------------------------------------------
 vtkPlusProbeCalibrationOptimizerAlgo::vtkPlusProbeCalibrationOptimizerAlgo()
 : IsotropicPixelSpacing(true)
+, Optimizer(OPTIMIZER_POWELL)
+, NumberOfThreads(vtkMultiThreader::GetGlobalDefaultNumberOfThreads())
+, NumberOfIterations(0)
+, NumberOfCostFunctionEvaluations(0)
+, OptimizationTimeSec(0.0)
 , ProbeCalibrationAlgo(NULL)
 {  
 }
@@ -253,7 +431,75 @@ PlusStatus vtkPlusProbeCalibrationOptimizerAlgo::Update()
     igsioMath::LogVtkMatrix(vtkMatrix);
   }
 
-  OptimizerType::Pointer  optimizer = OptimizerType::New();
+  this->NumberOfIterations=0;
+  this->NumberOfCostFunctionEvaluations=0;
+  this->StopConditionDescription.clear();
+  double startTimeSec=vtkIGSIOAccurateTimer::GetSystemTime();
+  vnl_vector<double> imageToProbeTransformParameters=imageToProbeSeedTransformParameters;
+  PlusStatus optimizationStatus=PLUS_FAIL;
+  switch (this->Optimizer)
+  {
+  case OPTIMIZER_POWELL:
+    optimizationStatus=OptimizeWithPowell(imageToProbeTransformParameters);
+    break;
+  case OPTIMIZER_LEVENBERG_MARQUARDT:
+    optimizationStatus=OptimizeWithLevenbergMarquardt(imageToProbeTransformParameters);
+    break;
+  default:
+    LOG_ERROR("Invalid optimizer");
+  }
+  this->OptimizationTimeSec=vtkIGSIOAccurateTimer::GetSystemTime()-startTimeSec;
+  if (optimizationStatus!=PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+  LOG_INFO("Optimizer = " << GetOptimizerAsString(this->Optimizer) << ": " << this->NumberOfIterations << " iterations, "
+    << this->NumberOfCostFunctionEvaluations << " cost function evaluations, " << this->OptimizationTimeSec << " sec");
+
+  // Store the matrix
+
+  DistanceToWiresCostFunction::ParametersType imageToProbeOptimizedTransformParameters(costFunction->GetNumberOfParameters());
+  for (unsigned int i=0; i<imageToProbeOptimizedTransformParameters.GetSize(); ++i)
+  {
+    imageToProbeOptimizedTransformParameters[i]=imageToProbeTransformParameters[i];
+  }
+  costFunction->GetTransformMatrix(this->ImageToProbeTransformMatrix, imageToProbeOptimizedTransformParameters);
+  {
+    vtkSmartPointer<vtkMatrix4x4> vtkMatrix=vtkSmartPointer<vtkMatrix4x4>::New();
+    PlusMath::ConvertVnlMatrixToVtkMatrix(this->ImageToProbeTransformMatrix, vtkMatrix); 
+    igsioMath::LogVtkMatrix(vtkMatrix);
+  }
+
+  // Store the optimized parameters and show the results
+  LOG_INFO("Cost function = " << GetOptimizationMethodAsString(this->OptimizationMethod));
+
+  LOG_INFO("Without optimization:");
+  ShowTransformation(this->ImageToProbeSeedTransformMatrix);
+
+  LOG_INFO("With optimization:");
+  ShowTransformation(this->ImageToProbeTransformMatrix);
+
+  vtkSmartPointer<vtkMatrix4x4> imageToProbeSeedTransformMatrixVtk = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkMatrix4x4> imageToProbeTransformMatrixVtk = vtkSmartPointer<vtkMatrix4x4>::New();
+  PlusMath::ConvertVnlMatrixToVtkMatrix(this->ImageToProbeSeedTransformMatrix,imageToProbeSeedTransformMatrixVtk);
+  PlusMath::ConvertVnlMatrixToVtkMatrix(this->ImageToProbeTransformMatrix,imageToProbeTransformMatrixVtk);
+  double angleDifference = igsioMath::GetOrientationDifference(imageToProbeSeedTransformMatrixVtk, imageToProbeTransformMatrixVtk);
+  LOG_INFO("Orientation difference between unoptimized and optimized matrices =  " << angleDifference << " deg");
+
+  return PLUS_SUCCESS; 
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusProbeCalibrationOptimizerAlgo::OptimizeWithPowell(vnl_vector<double>& imageToProbeTransformParameters)
+{
+  DistanceToWiresCostFunction::Pointer costFunction = new DistanceToWiresCostFunction(this);
+  DistanceToWiresCostFunction::ParametersType initialParameters(imageToProbeTransformParameters.size());
+  for (unsigned int i=0; i<imageToProbeTransformParameters.size(); ++i)
+  {
+    initialParameters[i]=imageToProbeTransformParameters[i];
+  }
+
+  PowellOptimizerType::Pointer  optimizer = PowellOptimizerType::New();
   try 
   {
     optimizer->SetCostFunction( costFunction.GetPointer() );
@@ -275,7 +521,7 @@ PlusStatus vtkPlusProbeCalibrationOptimizerAlgo::Update()
   const double scalesParametersScale=10.0;
 
   // Scale the translation components of the transform in the Optimizer
-  OptimizerType::ScalesType scales( costFunction->GetNumberOfParameters() );
+  PowellOptimizerType::ScalesType scales( costFunction->GetNumberOfParameters() );
   switch (costFunction->GetNumberOfParameters())
   {
   case 7:
@@ -303,7 +549,7 @@ PlusStatus vtkPlusProbeCalibrationOptimizerAlgo::Update()
   }
   optimizer->SetScales(scales);
 
-  optimizer->SetInitialPosition(imageToProbeSeedTransformParameters);
+  optimizer->SetInitialPosition(initialParameters);
 
   try 
   {
@@ -315,35 +561,151 @@ PlusStatus vtkPlusProbeCalibrationOptimizerAlgo::Update()
     return PLUS_FAIL;
   }
 
-  std::string stopCondition=optimizer->GetStopConditionDescription();
-  LOG_INFO("Optimization stopping condition: "<<stopCondition<<". Number of iterations: " << optimizer->GetCurrentIteration());
+  this->StopConditionDescription=optimizer->GetStopConditionDescription();
+  LOG_INFO("Optimization stopping condition: "<<this->StopConditionDescription<<". Number of iterations: " << optimizer->GetCurrentIteration());
 
-  // Store the matrix
+  this->NumberOfIterations=optimizer->GetCurrentIteration();
+  this->NumberOfCostFunctionEvaluations=costFunction->GetNumberOfEvaluations();
+  for (unsigned int i=0; i<imageToProbeTransformParameters.size(); ++i)
+  {
+    imageToProbeTransformParameters[i]=optimizer->GetCurrentPosition()[i];
+  }
+  return PLUS_SUCCESS;
+}
 
-  costFunction->GetTransformMatrix(this->ImageToProbeTransformMatrix, optimizer->GetCurrentPosition());
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusProbeCalibrationOptimizerAlgo::OptimizeWithLevenbergMarquardt(vnl_vector<double>& imageToProbeTransformParameters)
+{
+  const unsigned int numberOfParameters=imageToProbeTransformParameters.size();
+  vnl_matrix<double> jacobianTransposeJacobian;
+  vnl_vector<double> jacobianTransposeResiduals;
+  double sumSquaredResiduals=0.0;
+  if (ComputeNormalEquations(imageToProbeTransformParameters, jacobianTransposeJacobian, jacobianTransposeResiduals, sumSquaredResiduals)!=PLUS_SUCCESS)
   {
-    vtkSmartPointer<vtkMatrix4x4> vtkMatrix=vtkSmartPointer<vtkMatrix4x4>::New();
-    PlusMath::ConvertVnlMatrixToVtkMatrix(this->ImageToProbeTransformMatrix, vtkMatrix); 
-    igsioMath::LogVtkMatrix(vtkMatrix);
+    LOG_ERROR("Failed to compute the wire reprojection errors at the initial position");
+    return PLUS_FAIL;
   }
 
-  // Store the optimized parameters and show the results
-  LOG_INFO("Cost function = " << GetOptimizationMethodAsString(this->OptimizationMethod));
+  vnl_matrix<double> trialJacobianTransposeJacobian;
+  vnl_vector<double> trialJacobianTransposeResiduals;
+  double damping=LM_INITIAL_DAMPING;
+  std::string stopCondition="Maximum number of iterations has been reached";
+  while (this->NumberOfIterations<LM_MAX_ITERATIONS)
+  {
+    ++this->NumberOfIterations;
+    if (jacobianTransposeResiduals.inf_norm()==0.0)
+    {
+      stopCondition="Gradient is zero";
+      break;
+    }
 
-  LOG_INFO("Without optimization:");
-  ShowTransformation(this->ImageToProbeSeedTransformMatrix);
+    // Solve (J^T*J + damping*diag(J^T*J)) * step = -J^T*r
+    vnl_matrix<double> dampedJacobianTransposeJacobian=jacobianTransposeJacobian;
+    for (unsigned int i=0; i<numberOfParameters; ++i)
+    {
+      dampedJacobianTransposeJacobian(i,i)+=damping*std::max(jacobianTransposeJacobian(i,i), std::numeric_limits<double>::epsilon());
+    }
+    vnl_vector<double> step=vnl_svd<double>(dampedJacobianTransposeJacobian).solve(-jacobianTransposeResiduals);
+    vnl_vector<double> trialParameters=imageToProbeTransformParameters+step;
+
+    // Steps that would leave the valid range of the rotation parameters are rejected
+    double trialSumSquaredResiduals=std::numeric_limits<double>::max();
+    double versorSquaredNorm=trialParameters[0]*trialParameters[0]+trialParameters[1]*trialParameters[1]+trialParameters[2]*trialParameters[2];
+    if (versorSquaredNorm>LM_MAX_VERSOR_NORM*LM_MAX_VERSOR_NORM
+      || ComputeNormalEquations(trialParameters, trialJacobianTransposeJacobian, trialJacobianTransposeResiduals, trialSumSquaredResiduals)!=PLUS_SUCCESS)
+    {
+      trialSumSquaredResiduals=std::numeric_limits<double>::max();
+    }
 
-  LOG_INFO("With optimization:");
-  ShowTransformation(this->ImageToProbeTransformMatrix);
+    if (trialSumSquaredResiduals<sumSquaredResiduals)
+    {
+      double relativeCostDecrease=(sumSquaredResiduals-trialSumSquaredResiduals)/sumSquaredResiduals;
+      imageToProbeTransformParameters=trialParameters;
+      jacobianTransposeJacobian=trialJacobianTransposeJacobian;
+      jacobianTransposeResiduals=trialJacobianTransposeResiduals;
+      sumSquaredResiduals=trialSumSquaredResiduals;
+      damping=std::max(damping/10.0, std::numeric_limits<double>::epsilon());
+      if (relativeCostDecrease<LM_COST_TOLERANCE)
+      {
+        stopCondition="Relative decrease of the cost function is below tolerance";
+        break;
+      }
+      if (step.two_norm()<LM_STEP_TOLERANCE*(imageToProbeTransformParameters.two_norm()+LM_STEP_TOLERANCE))
+      {
+        stopCondition="Parameter change is below tolerance";
+        break;
+      }
+    }
+    else
+    {
+      damping*=10.0;
+      if (damping>LM_MAX_DAMPING)
+      {
+        stopCondition=LM_STOP_CONDITION_NO_DECREASE;
+        break;
+      }
+    }
+  }
 
-  vtkSmartPointer<vtkMatrix4x4> imageToProbeSeedTransformMatrixVtk = vtkSmartPointer<vtkMatrix4x4>::New();
-  vtkSmartPointer<vtkMatrix4x4> imageToProbeTransformMatrixVtk = vtkSmartPointer<vtkMatrix4x4>::New();
-  PlusMath::ConvertVnlMatrixToVtkMatrix(this->ImageToProbeSeedTransformMatrix,imageToProbeSeedTransformMatrixVtk);
-  PlusMath::ConvertVnlMatrixToVtkMatrix(this->ImageToProbeTransformMatrix,imageToProbeTransformMatrixVtk);
-  double angleDifference = igsioMath::GetOrientationDifference(imageToProbeSeedTransformMatrixVtk, imageToProbeTransformMatrixVtk);
-  LOG_INFO("Orientation difference between unoptimized and optimized matrices =  " << angleDifference << " deg");
+  this->StopConditionDescription=stopCondition;
+  LOG_INFO("Optimization stopping condition: "<<stopCondition<<". Number of iterations: " << this->NumberOfIterations);
+  return PLUS_SUCCESS;
+}
 
-  return PLUS_SUCCESS; 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusProbeCalibrationOptimizerAlgo::ComputeNormalEquations(const vnl_vector<double>& imageToProbeTransformParameters, vnl_matrix<double>& jacobianTransposeJacobian, vnl_vector<double>& jacobianTransposeResiduals, double& sumSquaredResiduals)
+{
+  const unsigned int numberOfParameters=imageToProbeTransformParameters.size();
+  DistanceToWiresCostFunction::ParametersType parameters(numberOfParameters);
+  for (unsigned int i=0; i<numberOfParameters; ++i)
+  {
+    parameters[i]=imageToProbeTransformParameters[i];
+  }
+
+  NormalEquationsThreadData data;
+  data.ProbeCalibrationAlgo=this->ProbeCalibrationAlgo;
+  data.OptimizationMethod=this->OptimizationMethod;
+  if (DistanceToWiresCostFunction::GetTransformMatrix(data.ImageToProbeTransformMatrix, parameters)!=PLUS_SUCCESS
+    || DistanceToWiresCostFunction::GetTransformMatrixDerivatives(data.ImageToProbeTransformDerivatives, parameters)!=PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+  data.NumberOfFrames=this->ProbeCalibrationAlgo->GetNumberOfNonOutlierCalibrationFrames();
+
+  // Each thread sums up the contribution of a range of frames
+  int numberOfThreads=std::max(1, std::min(this->NumberOfThreads, data.NumberOfFrames));
+  data.JacobianTransposeJacobians.assign(numberOfThreads, vnl_matrix<double>(numberOfParameters, numberOfParameters, 0.0));
+  data.JacobianTransposeResiduals.assign(numberOfThreads, vnl_vector<double>(numberOfParameters, 0.0));
+  data.SumSquaredResiduals.assign(numberOfThreads, 0.0);
+  if (numberOfThreads==1)
+  {
+    vtkMultiThreader::ThreadInfo threadInfo;
+    threadInfo.ThreadID=0;
+    threadInfo.NumberOfThreads=1;
+    threadInfo.UserData=&data;
+    ComputeNormalEquationsThread(&threadInfo);
+  }
+  else
+  {
+    vtkSmartPointer<vtkMultiThreader> threader=vtkSmartPointer<vtkMultiThreader>::New();
+    threader->SetNumberOfThreads(numberOfThreads);
+    threader->SetSingleMethod(&ComputeNormalEquationsThread, &data);
+    threader->SingleMethodExecute();
+  }
+
+  jacobianTransposeJacobian.set_size(numberOfParameters, numberOfParameters);
+  jacobianTransposeJacobian.fill(0.0);
+  jacobianTransposeResiduals.set_size(numberOfParameters);
+  jacobianTransposeResiduals.fill(0.0);
+  sumSquaredResiduals=0.0;
+  for (int threadIndex=0; threadIndex<numberOfThreads; ++threadIndex)
+  {
+    jacobianTransposeJacobian+=data.JacobianTransposeJacobians[threadIndex];
+    jacobianTransposeResiduals+=data.JacobianTransposeResiduals[threadIndex];
+    sumSquaredResiduals+=data.SumSquaredResiduals[threadIndex];
+  }
+  ++this->NumberOfCostFunctionEvaluations;
+  return PLUS_SUCCESS;
 }
 
 //----------------------------------------------------------------------------
@@ -383,6 +745,19 @@ const char* vtkPlusProbeCalibrationOptimizerAlgo::GetOptimizationMethodAsString(
   }
 }
 
+//----------------------------------------------------------------------------
+const char* vtkPlusProbeCalibrationOptimizerAlgo::GetOptimizerAsString(OptimizerType type)
+{
+  switch (type)
+  {
+  case OPTIMIZER_POWELL: return "POWELL";
+  case OPTIMIZER_LEVENBERG_MARQUARDT: return "LEVENBERG_MARQUARDT";
+  default:
+    LOG_ERROR("Unknown optimizer: "<<type);
+    return "unknown";
+  }
+}
+
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusProbeCalibrationOptimizerAlgo::ReadConfiguration( vtkXMLDataElement* aConfig )
 {
@@ -415,5 +790,22 @@ PlusStatus vtkPlusProbeCalibrationOptimizerAlgo::ReadConfiguration( vtkXMLDataEl
 
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(IsotropicPixelSpacing, aConfig);
 
+  const char* optimizer=aConfig->GetAttribute("Optimizer");
+  if (optimizer==NULL || STRCASECMP(optimizer, GetOptimizerAsString(OPTIMIZER_POWELL)) == 0)
+  {
+    this->Optimizer=OPTIMIZER_POWELL;
+  }
+  else if (STRCASECMP(optimizer, GetOptimizerAsString(OPTIMIZER_LEVENBERG_MARQUARDT)) == 0)
+  {
+    this->Optimizer=OPTIMIZER_LEVENBERG_MARQUARDT;
+  }
+  else
+  {
+    LOG_ERROR("Invalid Optimizer: " << optimizer << ". Valid values: " << GetOptimizerAsString(OPTIMIZER_POWELL) << ", " << GetOptimizerAsString(OPTIMIZER_LEVENBERG_MARQUARDT));
+    return PLUS_FAIL;
+  }
+
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, NumberOfThreads, aConfig);
+
   return PLUS_SUCCESS;
 }
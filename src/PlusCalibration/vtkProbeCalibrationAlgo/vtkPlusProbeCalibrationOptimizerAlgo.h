@@ -8,6 +8,7 @@ See License.txt for details.
 #define __vtkPlusProbeCalibrationOptimizerAlgo_h
 
 #include "PlusConfigure.h"
+#include "vtkPlusCalibrationExport.h"
 
 #include "vtkObject.h"
 
@@ -31,9 +32,13 @@ class vtkPlusProbeCalibrationAlgo;
   it is more accurate to optimize the in-plane (2D) error. Also this optimizer enforces orthogonality of the image to
   probe matrix and optionally it can enforce isotropic image pixel spacing.
 
+  The minimum can be found by the derivative-free Powell method or by the Levenberg-Marquardt method, which uses
+  the analytic derivatives of the wire reprojection errors. The Levenberg-Marquardt method computes the errors and their
+  derivatives for the calibration frames in parallel.
+
   \ingroup PlusLibCalibrationAlgo
 */
-class vtkPlusProbeCalibrationOptimizerAlgo : public vtkObject
+class vtkPlusCalibrationExport vtkPlusProbeCalibrationOptimizerAlgo : public vtkObject
 {
 
 public:
@@ -46,6 +51,13 @@ public:
     MINIMIZE_DISTANCE_OF_ALL_WIRES_IN_2D
   };  
 
+  /* Choose one of the possible minimizers */
+  enum OptimizerType
+  {
+    OPTIMIZER_POWELL,
+    OPTIMIZER_LEVENBERG_MARQUARDT
+  };
+
   vtkTypeMacro(vtkPlusProbeCalibrationOptimizerAlgo,vtkObject);
   static vtkPlusProbeCalibrationOptimizerAlgo *New();
 
@@ -75,6 +87,26 @@ public:
   void SetOptimizationMethod(OptimizationMethodType optimizationMethod) { this->OptimizationMethod=optimizationMethod; }
   static const char* GetOptimizationMethodAsString(OptimizationMethodType type);
 
+  OptimizerType GetOptimizer() { return this->Optimizer; }
+  void SetOptimizer(OptimizerType optimizer) { this->Optimizer=optimizer; }
+  static const char* GetOptimizerAsString(OptimizerType type);
+
+  /*! Number of threads that compute the errors and derivatives in the Levenberg-Marquardt method */
+  int GetNumberOfThreads() { return this->NumberOfThreads; }
+  void SetNumberOfThreads(int numberOfThreads) { this->NumberOfThreads=numberOfThreads; }
+
+  /*! Number of iterations of the last optimization */
+  int GetNumberOfIterations() { return this->NumberOfIterations; }
+  /*! Number of times the cost function (or residuals and derivatives) was computed in the last optimization */
+  int GetNumberOfCostFunctionEvaluations() { return this->NumberOfCostFunctionEvaluations; }
+  /*! Duration of the last optimization in seconds */
+  double GetOptimizationTimeSec() { return this->OptimizationTimeSec; }
+  /*! Description of the condition that stopped the last optimization */
+  std::string GetStopConditionDescription() { return this->StopConditionDescription; }
+
+  /*! Stop condition of the Levenberg-Marquardt method when the cost function could not be decreased by any step */
+  static const char* LM_STOP_CONDITION_NO_DECREASE;
+
   void SetImageToProbeSeedTransform(const vnl_matrix_fixed<double,4,4> &imageToProbeTransformMatrix);
 
   void SetProbeCalibrationAlgo(vtkPlusProbeCalibrationAlgo* probeCalibrationAlgo);
@@ -82,6 +114,18 @@ public:
 protected:
 
   PlusStatus ShowTransformation(const vnl_matrix_fixed<double,4,4> &transformationMatrix);
+
+  /*! Minimize the cost function with the Powell method, starting from the seed parameters */
+  PlusStatus OptimizeWithPowell(vnl_vector<double>& imageToProbeTransformParameters);
+
+  /*! Minimize the sum of squared wire reprojection errors with the Levenberg-Marquardt method, starting from the seed parameters */
+  PlusStatus OptimizeWithLevenbergMarquardt(vnl_vector<double>& imageToProbeTransformParameters);
+
+  /*!
+    Compute the sum of squared residuals, the J^T*J matrix, and the J^T*r vector (J: derivatives of the residuals r
+    with respect to the transform parameters) over all the calibration frames
+  */
+  PlusStatus ComputeNormalEquations(const vnl_vector<double>& imageToProbeTransformParameters, vnl_matrix<double>& jacobianTransposeJacobian, vnl_vector<double>& jacobianTransposeResiduals, double& sumSquaredResiduals);
   
   vtkPlusProbeCalibrationOptimizerAlgo();
   virtual  ~vtkPlusProbeCalibrationOptimizerAlgo();
@@ -93,6 +137,18 @@ protected:
   /*! Cost function to minimize during the optimization */
   OptimizationMethodType OptimizationMethod;
 
+  /*! Minimizer algorithm */
+  OptimizerType Optimizer;
+
+  /*! Number of threads used for computing the errors and derivatives */
+  int NumberOfThreads;
+
+  /*! Statistics of the last optimization */
+  int NumberOfIterations;
+  int NumberOfCostFunctionEvaluations;
+  double OptimizationTimeSec;
+  std::string StopConditionDescription;
+
   /*! Store the seed for the optimization process */
   vnl_matrix_fixed<double,4,4> ImageToProbeSeedTransformMatrix;
 
@@ -0,0 +1,222 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusLatencyHistogram.h"
+
+// STL includes
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+namespace
+{
+  const unsigned long long NO_MINIMUM = std::numeric_limits<unsigned long long>::max();
+}
+
+//----------------------------------------------------------------------------
+PlusLatencyHistogram::PlusLatencyHistogram()
+{
+  this->Reset();
+}
+
+//----------------------------------------------------------------------------
+void PlusLatencyHistogram::Reset()
+{
+  for (int i = 0; i < BUCKET_COUNT; ++i)
+  {
+    this->Buckets[i].store(0, std::memory_order_relaxed);
+  }
+  this->Count.store(0, std::memory_order_relaxed);
+  this->SumUs.store(0, std::memory_order_relaxed);
+  this->MinUs.store(NO_MINIMUM, std::memory_order_relaxed);
+  this->MaxUs.store(0, std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+int PlusLatencyHistogram::GetBucketIndex(unsigned long long valueUs)
+{
+  if (valueUs < SUB_BUCKET_COUNT)
+  {
+    return static_cast<int>(valueUs);
+  }
+
+  int magnitude = 0;
+  for (unsigned long long v = valueUs; v > 1; v >>= 1)
+  {
+    ++magnitude;
+  }
+  if (magnitude > MAX_MAGNITUDE)
+  {
+    return BUCKET_COUNT - 1;
+  }
+
+  int shift = magnitude - SUB_BUCKET_BITS;
+  int subBucket = static_cast<int>(valueUs >> shift) - SUB_BUCKET_COUNT;
+  return SUB_BUCKET_COUNT + shift * SUB_BUCKET_COUNT + subBucket;
+}
+
+//----------------------------------------------------------------------------
+int PlusLatencyHistogram::GetNumberOfBuckets()
+{
+  return BUCKET_COUNT;
+}
+
+//----------------------------------------------------------------------------
+unsigned long long PlusLatencyHistogram::GetBucketLowerBoundUs(int bucketIndex)
+{
+  if (bucketIndex < SUB_BUCKET_COUNT)
+  {
+    return static_cast<unsigned long long>(bucketIndex < 0 ? 0 : bucketIndex);
+  }
+  int shift = (bucketIndex - SUB_BUCKET_COUNT) / SUB_BUCKET_COUNT;
+  int subBucket = (bucketIndex - SUB_BUCKET_COUNT) % SUB_BUCKET_COUNT;
+  return static_cast<unsigned long long>(SUB_BUCKET_COUNT + subBucket) << shift;
+}
+
+//----------------------------------------------------------------------------
+unsigned long long PlusLatencyHistogram::GetBucketUpperBoundUs(int bucketIndex)
+{
+  if (bucketIndex < SUB_BUCKET_COUNT)
+  {
+    return GetBucketLowerBoundUs(bucketIndex);
+  }
+  int shift = (bucketIndex - SUB_BUCKET_COUNT) / SUB_BUCKET_COUNT;
+  int subBucket = (bucketIndex - SUB_BUCKET_COUNT) % SUB_BUCKET_COUNT;
+  return (static_cast<unsigned long long>(SUB_BUCKET_COUNT + subBucket + 1) << shift) - 1;
+}
+
+//----------------------------------------------------------------------------
+unsigned long long PlusLatencyHistogram::GetBucketCount(int bucketIndex) const
+{
+  if (bucketIndex < 0 || bucketIndex >= BUCKET_COUNT)
+  {
+    return 0;
+  }
+  return this->Buckets[bucketIndex].load(std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+void PlusLatencyHistogram::RecordValue(double valueSec)
+{
+  unsigned long long valueUs = valueSec > 0 ? static_cast<unsigned long long>(valueSec * 1e6 + 0.5) : 0;
+
+  this->Buckets[GetBucketIndex(valueUs)].fetch_add(1, std::memory_order_relaxed);
+  this->SumUs.fetch_add(valueUs, std::memory_order_relaxed);
+
+  unsigned long long currentMin = this->MinUs.load(std::memory_order_relaxed);
+  while (valueUs < currentMin && !this->MinUs.compare_exchange_weak(currentMin, valueUs, std::memory_order_relaxed))
+  {
+  }
+  unsigned long long currentMax = this->MaxUs.load(std::memory_order_relaxed);
+  while (valueUs > currentMax && !this->MaxUs.compare_exchange_weak(currentMax, valueUs, std::memory_order_relaxed))
+  {
+  }
+
+  // Count is incremented last so that readers never see more samples than bucket entries
+  this->Count.fetch_add(1, std::memory_order_release);
+}
+
+//----------------------------------------------------------------------------
+unsigned long long PlusLatencyHistogram::GetCount() const
+{
+  return this->Count.load(std::memory_order_acquire);
+}
+
+//----------------------------------------------------------------------------
+double PlusLatencyHistogram::GetMinimum() const
+{
+  unsigned long long minUs = this->MinUs.load(std::memory_order_relaxed);
+  return minUs == NO_MINIMUM ? 0.0 : minUs * 1e-6;
+}
+
+//----------------------------------------------------------------------------
+double PlusLatencyHistogram::GetMaximum() const
+{
+  return this->MaxUs.load(std::memory_order_relaxed) * 1e-6;
+}
+
+//----------------------------------------------------------------------------
+double PlusLatencyHistogram::GetMean() const
+{
+  unsigned long long count = this->GetCount();
+  if (count == 0)
+  {
+    return 0.0;
+  }
+  return this->SumUs.load(std::memory_order_relaxed) * 1e-6 / count;
+}
+
+//----------------------------------------------------------------------------
+double PlusLatencyHistogram::GetPercentile(double percentile) const
+{
+  unsigned long long count = this->GetCount();
+  if (count == 0)
+  {
+    return 0.0;
+  }
+  if (percentile < 0)
+  {
+    percentile = 0;
+  }
+  else if (percentile > 100)
+  {
+    percentile = 100;
+  }
+
+  unsigned long long rank = static_cast<unsigned long long>(percentile / 100.0 * count + 0.5);
+  if (rank < 1)
+  {
+    rank = 1;
+  }
+
+  unsigned long long cumulative = 0;
+  for (int i = 0; i < BUCKET_COUNT; ++i)
+  {
+    cumulative += this->Buckets[i].load(std::memory_order_relaxed);
+    if (cumulative >= rank)
+    {
+      // Report the middle of the bucket, clamped to the observed range
+      double valueUs = 0.5 * (GetBucketLowerBoundUs(i) + GetBucketUpperBoundUs(i));
+      double value = valueUs * 1e-6;
+      if (value < this->GetMinimum())
+      {
+        value = this->GetMinimum();
+      }
+      if (value > this->GetMaximum())
+      {
+        value = this->GetMaximum();
+      }
+      return value;
+    }
+  }
+  return this->GetMaximum();
+}
+
+//----------------------------------------------------------------------------
+void PlusLatencyHistogram::PrintSummary(std::ostream& os) const
+{
+  // Formatting of the caller's stream is restored
+  std::ios::fmtflags flags = os.flags();
+  std::streamsize precision = os.precision();
+  os << std::fixed << std::setprecision(3)
+     << "count=" << this->GetCount()
+     << " min=" << this->GetMinimum() * 1000.0 << "ms"
+     << " mean=" << this->GetMean() * 1000.0 << "ms"
+     << " p50=" << this->GetPercentile(50) * 1000.0 << "ms"
+     << " p99=" << this->GetPercentile(99) * 1000.0 << "ms"
+     << " p99.9=" << this->GetPercentile(99.9) * 1000.0 << "ms"
+     << " max=" << this->GetMaximum() * 1000.0 << "ms";
+  os.flags(flags);
+  os.precision(precision);
+}
+
+//----------------------------------------------------------------------------
+std::string PlusLatencyHistogram::GetSummary() const
+{
+  std::ostringstream os;
+  this->PrintSummary(os);
+  return os.str();
+}
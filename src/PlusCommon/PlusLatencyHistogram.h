@@ -0,0 +1,87 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __PlusLatencyHistogram_h
+#define __PlusLatencyHistogram_h
+
+#include "vtkPlusCommonExport.h"
+
+// STL includes
+#include <atomic>
+#include <ostream>
+#include <string>
+
+/*!
+  \class PlusLatencyHistogram
+  \brief Lock-free histogram of durations with a bounded relative error
+
+  Values are recorded in seconds and stored with microsecond resolution in log-linear buckets
+  (each power of two is split into 16 linear sub-buckets, similar to an HDR histogram), so
+  the relative error of reported percentiles is below 7% over the whole range (1us .. ~12 days).
+
+  RecordValue() may be called concurrently from any number of threads, statistics can be
+  queried at any time without stopping the writers. Reset() is not synchronized with
+  concurrent writers; a few samples recorded during a reset may be lost.
+
+  \ingroup PlusLibCommon
+*/
+class vtkPlusCommonExport PlusLatencyHistogram
+{
+public:
+  PlusLatencyHistogram();
+
+  /*! Add a duration (in seconds) to the histogram. Negative values are recorded as 0. */
+  void RecordValue(double valueSec);
+
+  /*! Remove all recorded values */
+  void Reset();
+
+  /*! Number of recorded values */
+  unsigned long long GetCount() const;
+
+  /*! Smallest recorded value in seconds (0 if there are no values) */
+  double GetMinimum() const;
+  /*! Largest recorded value in seconds (0 if there are no values) */
+  double GetMaximum() const;
+  /*! Mean of the recorded values in seconds (0 if there are no values) */
+  double GetMean() const;
+  /*! Approximate percentile (0-100) of the recorded values in seconds (0 if there are no values) */
+  double GetPercentile(double percentile) const;
+
+  /*! Write a one-line summary (count, min, mean, percentiles, max in milliseconds) */
+  void PrintSummary(std::ostream& os) const;
+  std::string GetSummary() const;
+
+  /*! Number of buckets, bucket boundaries are in microseconds */
+  static int GetNumberOfBuckets();
+  static unsigned long long GetBucketLowerBoundUs(int bucketIndex);
+  static unsigned long long GetBucketUpperBoundUs(int bucketIndex);
+  /*! Number of values that fell in the specified bucket */
+  unsigned long long GetBucketCount(int bucketIndex) const;
+
+protected:
+  static int GetBucketIndex(unsigned long long valueUs);
+
+  enum
+  {
+    SUB_BUCKET_BITS = 4,
+    SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS,
+    MAX_MAGNITUDE = 40, // 2^40us ~ 12.7 days
+    BUCKET_COUNT = SUB_BUCKET_COUNT + (MAX_MAGNITUDE - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT
+  };
+
+  std::atomic<unsigned long long> Buckets[BUCKET_COUNT];
+  std::atomic<unsigned long long> Count;
+  std::atomic<unsigned long long> SumUs;
+  std::atomic<unsigned long long> MinUs;
+  std::atomic<unsigned long long> MaxUs;
+
+private:
+  PlusLatencyHistogram(const PlusLatencyHistogram&);  // Not implemented.
+  void operator=(const PlusLatencyHistogram&);  // Not implemented.
+};
+
+#endif //__PlusLatencyHistogram_h
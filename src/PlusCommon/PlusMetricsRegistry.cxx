@@ -0,0 +1,518 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "PlusMetricsRegistry.h"
+
+// VTK includes
+#include <vtksys/SystemTools.hxx>
+
+// STL includes
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+  const int NUMBER_OF_EXPORTED_QUANTILES = 3;
+  const double EXPORTED_QUANTILES[NUMBER_OF_EXPORTED_QUANTILES] = { 0.5, 0.99, 0.999 };
+
+  //----------------------------------------------------------------------------
+  void WriteNumber(std::ostream& os, double value)
+  {
+    std::ostringstream ss;
+    ss << std::setprecision(12) << value;
+    os << ss.str();
+  }
+}
+
+//----------------------------------------------------------------------------
+PlusMetricsRegistry::Counter::Counter()
+  : Value(0)
+{
+}
+
+//----------------------------------------------------------------------------
+void PlusMetricsRegistry::Counter::Increment(unsigned long long value/*=1*/)
+{
+  this->Value.fetch_add(value, std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+unsigned long long PlusMetricsRegistry::Counter::GetValue() const
+{
+  return this->Value.load(std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+PlusMetricsRegistry::Gauge::Gauge()
+  : Value(0.0)
+{
+}
+
+//----------------------------------------------------------------------------
+void PlusMetricsRegistry::Gauge::SetValue(double value)
+{
+  this->Value.store(value, std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+void PlusMetricsRegistry::Gauge::Add(double value)
+{
+  double current = this->Value.load(std::memory_order_relaxed);
+  while (!this->Value.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+  {
+  }
+}
+
+//----------------------------------------------------------------------------
+double PlusMetricsRegistry::Gauge::GetValue() const
+{
+  return this->Value.load(std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+PlusMetricsRegistry::ScopedTimer::ScopedTimer(PlusLatencyHistogram* histogram)
+  : Histogram(histogram)
+  , StartTime(histogram != NULL ? PlusMetricsRegistry::GetMonotonicTime() : 0.0)
+{
+}
+
+//----------------------------------------------------------------------------
+PlusMetricsRegistry::ScopedTimer::~ScopedTimer()
+{
+  if (this->Histogram != NULL)
+  {
+    this->Histogram->RecordValue(PlusMetricsRegistry::GetMonotonicTime() - this->StartTime);
+  }
+}
+
+//----------------------------------------------------------------------------
+PlusMetricsRegistry::Metric::Metric()
+  : Type(METRIC_COUNTER)
+  , CounterValue(NULL)
+  , GaugeValue(NULL)
+  , OwnedHistogram(NULL)
+  , Histogram(NULL)
+{
+}
+
+//----------------------------------------------------------------------------
+PlusMetricsRegistry::Metric::~Metric()
+{
+  delete this->CounterValue;
+  delete this->GaugeValue;
+  delete this->OwnedHistogram;
+}
+
+//----------------------------------------------------------------------------
+PlusMetricsRegistry* PlusMetricsRegistry::GetInstance()
+{
+  // Initialization of function-local statics is thread-safe
+  static PlusMetricsRegistry instance;
+  return &instance;
+}
+
+//----------------------------------------------------------------------------
+double PlusMetricsRegistry::GetMonotonicTime()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//----------------------------------------------------------------------------
+PlusMetricsRegistry::PlusMetricsRegistry()
+{
+}
+
+//----------------------------------------------------------------------------
+PlusMetricsRegistry::~PlusMetricsRegistry()
+{
+  for (MetricMap::iterator it = this->Metrics.begin(); it != this->Metrics.end(); ++it)
+  {
+    delete it->second;
+  }
+  this->Metrics.clear();
+}
+
+//----------------------------------------------------------------------------
+PlusMetricsRegistry::MetricKey PlusMetricsRegistry::GetMetricKey(const std::string& name, const LabelMap& labels)
+{
+  // Comparing the name separately keeps metrics of one family together even if another
+  // metric name starts with this name (e.g., "plus_latency" and "plus_latency_max")
+  return MetricKey(name, GetLabelsAsPrometheusString(labels));
+}
+
+//----------------------------------------------------------------------------
+std::string PlusMetricsRegistry::GetMetricId(const std::string& name, const LabelMap& labels)
+{
+  return name + GetLabelsAsPrometheusString(labels);
+}
+
+//----------------------------------------------------------------------------
+PlusMetricsRegistry::Metric* PlusMetricsRegistry::GetMetric(const std::string& name, const LabelMap& labels, const std::string& help, MetricType type)
+{
+  MetricKey key = GetMetricKey(name, labels);
+  MetricMap::iterator it = this->Metrics.find(key);
+  if (it != this->Metrics.end())
+  {
+    if (it->second->Type != type)
+    {
+      LOG_ERROR("Metric " << GetMetricId(name, labels) << " is already registered as a " << GetMetricTypeAsString(it->second->Type)
+                << ", it cannot be used as a " << GetMetricTypeAsString(type));
+      return NULL;
+    }
+    return it->second;
+  }
+
+  // All metrics of a family (same name) must have the same type, otherwise the Prometheus output would be invalid
+  MetricMap::iterator familyIt = this->Metrics.lower_bound(MetricKey(name, ""));
+  if (familyIt != this->Metrics.end() && familyIt->second->Name == name && familyIt->second->Type != type)
+  {
+    LOG_ERROR("Metric " << name << " is already registered as a " << GetMetricTypeAsString(familyIt->second->Type)
+              << ", it cannot be used as a " << GetMetricTypeAsString(type));
+    return NULL;
+  }
+
+  Metric* metric = new Metric;
+  metric->Name = name;
+  metric->Labels = labels;
+  metric->Help = help;
+  metric->Type = type;
+  this->Metrics[key] = metric;
+  return metric;
+}
+
+//----------------------------------------------------------------------------
+PlusMetricsRegistry::Counter* PlusMetricsRegistry::GetCounter(const std::string& name, const LabelMap& labels/*=LabelMap()*/, const std::string& help/*=""*/)
+{
+  igsioLockGuard<vtkIGSIOSimpleRecursiveCriticalSection> guard(&this->Mutex);
+  Metric* metric = this->GetMetric(name, labels, help, METRIC_COUNTER);
+  if (metric == NULL)
+  {
+    return NULL;
+  }
+  if (metric->CounterValue == NULL)
+  {
+    metric->CounterValue = new Counter;
+  }
+  return metric->CounterValue;
+}
+
+//----------------------------------------------------------------------------
+PlusMetricsRegistry::Gauge* PlusMetricsRegistry::GetGauge(const std::string& name, const LabelMap& labels/*=LabelMap()*/, const std::string& help/*=""*/)
+{
+  igsioLockGuard<vtkIGSIOSimpleRecursiveCriticalSection> guard(&this->Mutex);
+  Metric* metric = this->GetMetric(name, labels, help, METRIC_GAUGE);
+  if (metric == NULL)
+  {
+    return NULL;
+  }
+  if (metric->GaugeValue == NULL)
+  {
+    metric->GaugeValue = new Gauge;
+  }
+  return metric->GaugeValue;
+}
+
+//----------------------------------------------------------------------------
+PlusLatencyHistogram* PlusMetricsRegistry::GetHistogram(const std::string& name, const LabelMap& labels/*=LabelMap()*/, const std::string& help/*=""*/)
+{
+  igsioLockGuard<vtkIGSIOSimpleRecursiveCriticalSection> guard(&this->Mutex);
+  Metric* metric = this->GetMetric(name, labels, help, METRIC_HISTOGRAM);
+  if (metric == NULL)
+  {
+    return NULL;
+  }
+  if (metric->Histogram == NULL)
+  {
+    metric->OwnedHistogram = new PlusLatencyHistogram;
+    metric->Histogram = metric->OwnedHistogram;
+  }
+  else if (metric->OwnedHistogram == NULL)
+  {
+    LOG_ERROR("Metric " << GetMetricId(name, labels) << " refers to an externally owned histogram, it cannot be modified through the registry");
+    return NULL;
+  }
+  return metric->OwnedHistogram;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusMetricsRegistry::RegisterHistogram(const std::string& name, const LabelMap& labels, const std::string& help, const PlusLatencyHistogram* histogram)
+{
+  if (histogram == NULL)
+  {
+    LOG_ERROR("PlusMetricsRegistry::RegisterHistogram failed: invalid histogram");
+    return PLUS_FAIL;
+  }
+  igsioLockGuard<vtkIGSIOSimpleRecursiveCriticalSection> guard(&this->Mutex);
+  Metric* metric = this->GetMetric(name, labels, help, METRIC_HISTOGRAM);
+  if (metric == NULL)
+  {
+    return PLUS_FAIL;
+  }
+  if (metric->Histogram != NULL && metric->Histogram != histogram)
+  {
+    LOG_ERROR("Metric " << GetMetricId(name, labels) << " is already registered with a different histogram");
+    return PLUS_FAIL;
+  }
+  metric->Histogram = histogram;
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void PlusMetricsRegistry::UnregisterHistogram(const PlusLatencyHistogram* histogram)
+{
+  igsioLockGuard<vtkIGSIOSimpleRecursiveCriticalSection> guard(&this->Mutex);
+  for (MetricMap::iterator it = this->Metrics.begin(); it != this->Metrics.end();)
+  {
+    if (it->second->Histogram == histogram && it->second->OwnedHistogram == NULL)
+    {
+      delete it->second;
+      this->Metrics.erase(it++);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void PlusMetricsRegistry::RemoveMetrics(const std::string& labelName, const std::string& labelValue)
+{
+  igsioLockGuard<vtkIGSIOSimpleRecursiveCriticalSection> guard(&this->Mutex);
+  for (MetricMap::iterator it = this->Metrics.begin(); it != this->Metrics.end();)
+  {
+    LabelMap::const_iterator labelIt = it->second->Labels.find(labelName);
+    if (labelIt != it->second->Labels.end() && labelIt->second == labelValue)
+    {
+      delete it->second;
+      this->Metrics.erase(it++);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+std::string PlusMetricsRegistry::EscapeString(const std::string& str)
+{
+  std::string escaped;
+  escaped.reserve(str.size());
+  for (std::string::const_iterator it = str.begin(); it != str.end(); ++it)
+  {
+    switch (*it)
+    {
+      case '\\':
+        escaped += "\\\\";
+        break;
+      case '"':
+        escaped += "\\\"";
+        break;
+      case '\n':
+        escaped += "\\n";
+        break;
+      default:
+        escaped += *it;
+    }
+  }
+  return escaped;
+}
+
+//----------------------------------------------------------------------------
+std::string PlusMetricsRegistry::GetLabelsAsPrometheusString(const LabelMap& labels, const std::string& extraLabelName/*=""*/, const std::string& extraLabelValue/*=""*/)
+{
+  if (labels.empty() && extraLabelName.empty())
+  {
+    return "";
+  }
+  std::ostringstream os;
+  os << "{";
+  bool first = true;
+  for (LabelMap::const_iterator it = labels.begin(); it != labels.end(); ++it)
+  {
+    os << (first ? "" : ",") << it->first << "=\"" << EscapeString(it->second) << "\"";
+    first = false;
+  }
+  if (!extraLabelName.empty())
+  {
+    os << (first ? "" : ",") << extraLabelName << "=\"" << EscapeString(extraLabelValue) << "\"";
+  }
+  os << "}";
+  return os.str();
+}
+
+//----------------------------------------------------------------------------
+const char* PlusMetricsRegistry::GetMetricTypeAsString(MetricType type)
+{
+  switch (type)
+  {
+    case METRIC_COUNTER:
+      return "counter";
+    case METRIC_GAUGE:
+      return "gauge";
+    case METRIC_HISTOGRAM:
+      // Percentiles are computed on the server side, which corresponds to the Prometheus summary type
+      return "summary";
+  }
+  return "untyped";
+}
+
+//----------------------------------------------------------------------------
+std::string PlusMetricsRegistry::GetMetricsAsText()
+{
+  igsioLockGuard<vtkIGSIOSimpleRecursiveCriticalSection> guard(&this->Mutex);
+  std::ostringstream os;
+  for (MetricMap::iterator it = this->Metrics.begin(); it != this->Metrics.end(); ++it)
+  {
+    Metric* metric = it->second;
+    os << GetMetricId(metric->Name, metric->Labels) << " ";
+    switch (metric->Type)
+    {
+      case METRIC_COUNTER:
+        os << metric->CounterValue->GetValue();
+        break;
+      case METRIC_GAUGE:
+        WriteNumber(os, metric->GaugeValue->GetValue());
+        break;
+      case METRIC_HISTOGRAM:
+        metric->Histogram->PrintSummary(os);
+        break;
+    }
+    os << std::endl;
+  }
+  return os.str();
+}
+
+//----------------------------------------------------------------------------
+std::string PlusMetricsRegistry::GetMetricsAsJson()
+{
+  igsioLockGuard<vtkIGSIOSimpleRecursiveCriticalSection> guard(&this->Mutex);
+  std::ostringstream os;
+  os << "[";
+  for (MetricMap::iterator it = this->Metrics.begin(); it != this->Metrics.end(); ++it)
+  {
+    Metric* metric = it->second;
+    os << (it == this->Metrics.begin() ? "" : ",") << std::endl;
+    os << "  {\"name\": \"" << EscapeString(metric->Name) << "\", \"type\": \"" << GetMetricTypeAsString(metric->Type) << "\", \"labels\": {";
+    for (LabelMap::const_iterator labelIt = metric->Labels.begin(); labelIt != metric->Labels.end(); ++labelIt)
+    {
+      os << (labelIt == metric->Labels.begin() ? "" : ", ") << "\"" << EscapeString(labelIt->first) << "\": \"" << EscapeString(labelIt->second) << "\"";
+    }
+    os << "}, ";
+    switch (metric->Type)
+    {
+      case METRIC_COUNTER:
+        os << "\"value\": " << metric->CounterValue->GetValue();
+        break;
+      case METRIC_GAUGE:
+        os << "\"value\": ";
+        WriteNumber(os, metric->GaugeValue->GetValue());
+        break;
+      case METRIC_HISTOGRAM:
+        os << "\"count\": " << metric->Histogram->GetCount();
+        os << ", \"min\": ";
+        WriteNumber(os, metric->Histogram->GetMinimum());
+        os << ", \"mean\": ";
+        WriteNumber(os, metric->Histogram->GetMean());
+        for (int i = 0; i < NUMBER_OF_EXPORTED_QUANTILES; ++i)
+        {
+          os << ", \"p" << EXPORTED_QUANTILES[i] * 100.0 << "\": ";
+          WriteNumber(os, metric->Histogram->GetPercentile(EXPORTED_QUANTILES[i] * 100.0));
+        }
+        os << ", \"max\": ";
+        WriteNumber(os, metric->Histogram->GetMaximum());
+        break;
+    }
+    os << "}";
+  }
+  os << std::endl << "]" << std::endl;
+  return os.str();
+}
+
+//----------------------------------------------------------------------------
+std::string PlusMetricsRegistry::GetMetricsAsPrometheus()
+{
+  igsioLockGuard<vtkIGSIOSimpleRecursiveCriticalSection> guard(&this->Mutex);
+  std::ostringstream os;
+  std::string previousName;
+  for (MetricMap::iterator it = this->Metrics.begin(); it != this->Metrics.end(); ++it)
+  {
+    Metric* metric = it->second;
+    if (metric->Name != previousName)
+    {
+      // HELP and TYPE lines are written once per metric family
+      if (!metric->Help.empty())
+      {
+        os << "# HELP " << metric->Name << " " << metric->Help << std::endl;
+      }
+      os << "# TYPE " << metric->Name << " " << GetMetricTypeAsString(metric->Type) << std::endl;
+      previousName = metric->Name;
+    }
+    switch (metric->Type)
+    {
+      case METRIC_COUNTER:
+        os << GetMetricId(metric->Name, metric->Labels) << " " << metric->CounterValue->GetValue() << std::endl;
+        break;
+      case METRIC_GAUGE:
+        os << GetMetricId(metric->Name, metric->Labels) << " ";
+        WriteNumber(os, metric->GaugeValue->GetValue());
+        os << std::endl;
+        break;
+      case METRIC_HISTOGRAM:
+      {
+        unsigned long long count = metric->Histogram->GetCount();
+        for (int i = 0; i < NUMBER_OF_EXPORTED_QUANTILES; ++i)
+        {
+          std::ostringstream quantile;
+          quantile << EXPORTED_QUANTILES[i];
+          os << metric->Name << GetLabelsAsPrometheusString(metric->Labels, "quantile", quantile.str()) << " ";
+          WriteNumber(os, metric->Histogram->GetPercentile(EXPORTED_QUANTILES[i] * 100.0));
+          os << std::endl;
+        }
+        os << metric->Name << "_sum" << GetLabelsAsPrometheusString(metric->Labels) << " ";
+        WriteNumber(os, metric->Histogram->GetMean() * count);
+        os << std::endl;
+        os << metric->Name << "_count" << GetLabelsAsPrometheusString(metric->Labels) << " " << count << std::endl;
+        break;
+      }
+    }
+  }
+  return os.str();
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusMetricsRegistry::WritePrometheusFile(const std::string& filename)
+{
+  std::string content = this->GetMetricsAsPrometheus();
+
+  // Write to a temporary file then rename, so that readers never see a partially written file
+  std::string tempFilename = filename + ".tmp";
+  {
+    std::ofstream file(tempFilename.c_str(), std::ios::out | std::ios::trunc);
+    if (!file.is_open())
+    {
+      LOG_ERROR("Failed to open metrics file for writing: " << tempFilename);
+      return PLUS_FAIL;
+    }
+    file << content;
+    if (!file.good())
+    {
+      LOG_ERROR("Failed to write metrics file: " << tempFilename);
+      return PLUS_FAIL;
+    }
+  }
+
+  if (!vtksys::SystemTools::RenameFile(tempFilename.c_str(), filename.c_str()))
+  {
+    LOG_ERROR("Failed to rename metrics file " << tempFilename << " to " << filename);
+    return PLUS_FAIL;
+  }
+  return PLUS_SUCCESS;
+}
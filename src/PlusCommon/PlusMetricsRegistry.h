@@ -0,0 +1,175 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __PlusMetricsRegistry_h
+#define __PlusMetricsRegistry_h
+
+#include "vtkPlusCommonExport.h"
+
+// Local includes
+#include "PlusCommon.h"
+#include "PlusLatencyHistogram.h"
+
+// STL includes
+#include <atomic>
+#include <map>
+#include <string>
+#include <utility>
+
+/*!
+  \class PlusMetricsRegistry
+  \brief Process-wide registry of runtime performance metrics (counters, gauges, latency histograms)
+
+  Components publish metrics by requesting a metric object once (typically when they are
+  configured) and updating it from their processing threads. Only the lookup/creation of a
+  metric takes a lock, updating counters, gauges and histograms is lock-free. Returned metric
+  pointers remain valid until the metric is explicitly removed (RemoveMetrics) or the process exits.
+
+  A metric is identified by its name and a set of labels (e.g., name="plus_buffer_items_added_total",
+  labels={buffer="Video"}), following the Prometheus data model. Metric names should use the
+  "plus_" prefix, lowercase letters and underscores. Histogram values are in seconds.
+
+  The collected metrics can be exported as human-readable text, JSON, or Prometheus text format
+  (the latter can be written atomically to a file for the node exporter textfile collector).
+
+  \ingroup PlusLibCommon
+*/
+class vtkPlusCommonExport PlusMetricsRegistry
+{
+public:
+  typedef std::map<std::string, std::string> LabelMap;
+
+  /*! Monotonically increasing integer value */
+  class vtkPlusCommonExport Counter
+  {
+  public:
+    Counter();
+    void Increment(unsigned long long value = 1);
+    unsigned long long GetValue() const;
+  protected:
+    std::atomic<unsigned long long> Value;
+  private:
+    Counter(const Counter&);  // Not implemented.
+    void operator=(const Counter&);  // Not implemented.
+  };
+
+  /*! Floating-point value that can go up and down */
+  class vtkPlusCommonExport Gauge
+  {
+  public:
+    Gauge();
+    void SetValue(double value);
+    void Add(double value);
+    double GetValue() const;
+  protected:
+    std::atomic<double> Value;
+  private:
+    Gauge(const Gauge&);  // Not implemented.
+    void operator=(const Gauge&);  // Not implemented.
+  };
+
+  /*! Records the time elapsed between construction and destruction into a histogram. NULL histogram is allowed (nothing is recorded). */
+  class vtkPlusCommonExport ScopedTimer
+  {
+  public:
+    explicit ScopedTimer(PlusLatencyHistogram* histogram);
+    ~ScopedTimer();
+  protected:
+    PlusLatencyHistogram* Histogram;
+    double StartTime;
+  private:
+    ScopedTimer(const ScopedTimer&);  // Not implemented.
+    void operator=(const ScopedTimer&);  // Not implemented.
+  };
+
+  static PlusMetricsRegistry* GetInstance();
+
+  /*! Current value of a monotonic clock in seconds, for measuring durations */
+  static double GetMonotonicTime();
+
+  /*!
+    Get a counter, create it if it does not exist yet.
+    \param help Short description of the metric, only used when the metric is created
+  */
+  Counter* GetCounter(const std::string& name, const LabelMap& labels = LabelMap(), const std::string& help = "");
+  /*! Get a gauge, create it if it does not exist yet */
+  Gauge* GetGauge(const std::string& name, const LabelMap& labels = LabelMap(), const std::string& help = "");
+  /*! Get a latency histogram (values in seconds), create it if it does not exist yet */
+  PlusLatencyHistogram* GetHistogram(const std::string& name, const LabelMap& labels = LabelMap(), const std::string& help = "");
+
+  /*!
+    Publish a histogram that is owned by the caller (e.g., capture thread timing of a device).
+    The histogram must be unregistered by calling UnregisterHistogram before it is deleted.
+  */
+  PlusStatus RegisterHistogram(const std::string& name, const LabelMap& labels, const std::string& help, const PlusLatencyHistogram* histogram);
+  /*! Remove all metrics that refer to a caller-owned histogram */
+  void UnregisterHistogram(const PlusLatencyHistogram* histogram);
+
+  /*!
+    Remove all metrics that have the specified label value (e.g., all metrics of a disconnected client).
+    Pointers to the removed metrics must not be used anymore.
+  */
+  void RemoveMetrics(const std::string& labelName, const std::string& labelValue);
+
+  /*! Human-readable list of all metrics, one metric per line */
+  std::string GetMetricsAsText();
+  /*! All metrics as a JSON array */
+  std::string GetMetricsAsJson();
+  /*! All metrics in Prometheus text exposition format (histograms are exported as summaries) */
+  std::string GetMetricsAsPrometheus();
+
+  /*! Write metrics in Prometheus text format. The file is replaced atomically so that scrapers never see a partial file. */
+  PlusStatus WritePrometheusFile(const std::string& filename);
+
+protected:
+  PlusMetricsRegistry();
+  virtual ~PlusMetricsRegistry();
+
+  enum MetricType
+  {
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+  };
+
+  struct Metric
+  {
+    Metric();
+    ~Metric();
+    std::string Name;
+    LabelMap Labels;
+    std::string Help;
+    MetricType Type;
+    Counter* CounterValue;
+    Gauge* GaugeValue;
+    PlusLatencyHistogram* OwnedHistogram;
+    const PlusLatencyHistogram* Histogram;
+  };
+
+  /*! Find or create a metric. Must be called with the registry locked. */
+  Metric* GetMetric(const std::string& name, const LabelMap& labels, const std::string& help, MetricType type);
+
+  /*! Metric name and labels in Prometheus format. The name is a separate key component so that all metrics with the same name are adjacent. */
+  typedef std::pair<std::string, std::string> MetricKey;
+  static MetricKey GetMetricKey(const std::string& name, const LabelMap& labels);
+  /*! Metric name followed by its labels, as it appears in the text and Prometheus outputs */
+  static std::string GetMetricId(const std::string& name, const LabelMap& labels);
+  static std::string GetLabelsAsPrometheusString(const LabelMap& labels, const std::string& extraLabelName = "", const std::string& extraLabelValue = "");
+  static std::string EscapeString(const std::string& str);
+  static const char* GetMetricTypeAsString(MetricType type);
+
+  /*! Metrics sorted by name then labels, so that all metrics with the same name are adjacent */
+  typedef std::map<MetricKey, Metric*> MetricMap;
+  MetricMap Metrics;
+
+  vtkIGSIOSimpleRecursiveCriticalSection Mutex;
+
+private:
+  PlusMetricsRegistry(const PlusMetricsRegistry&);  // Not implemented.
+  void operator=(const PlusMetricsRegistry&);  // Not implemented.
+};
+
+#endif //__PlusMetricsRegistry_h
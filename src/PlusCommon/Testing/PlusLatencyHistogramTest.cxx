@@ -0,0 +1,212 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file PlusLatencyHistogramTest.cxx
+  \brief Checks the statistics and percentile accuracy of PlusLatencyHistogram, also with concurrent writers
+
+  Printing the summary must not change the formatting of the caller's stream.
+*/
+
+#include "PlusConfigure.h"
+#include "PlusLatencyHistogram.h"
+
+// VTK includes
+#include <vtkMultiThreader.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <cmath>
+#include <sstream>
+
+namespace
+{
+  const double MAX_PERCENTILE_RELATIVE_ERROR = 0.07;
+  const int NUMBER_OF_WRITER_THREADS = 4;
+  const int NUMBER_OF_VALUES_PER_WRITER_THREAD = 10000;
+
+  //----------------------------------------------------------------------------
+  VTK_THREAD_RETURN_TYPE RecordValuesThread(void* arg)
+  {
+    vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+    PlusLatencyHistogram* histogram = static_cast<PlusLatencyHistogram*>(threadInfo->UserData);
+    for (int i = 0; i < NUMBER_OF_VALUES_PER_WRITER_THREAD; ++i)
+    {
+      histogram->RecordValue(0.001);
+    }
+    return VTK_THREAD_RETURN_VALUE;
+  }
+
+  //----------------------------------------------------------------------------
+  bool IsClose(double actual, double expected, double tolerance)
+  {
+    return fabs(actual - expected) <= tolerance;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestBuckets()
+  {
+    int numberOfFailures = 0;
+    for (int i = 1; i < PlusLatencyHistogram::GetNumberOfBuckets(); ++i)
+    {
+      if (PlusLatencyHistogram::GetBucketLowerBoundUs(i) != PlusLatencyHistogram::GetBucketUpperBoundUs(i - 1) + 1)
+      {
+        LOG_ERROR("Bucket " << i << " does not follow the previous bucket: lower bound " << PlusLatencyHistogram::GetBucketLowerBoundUs(i)
+                  << "us, previous upper bound " << PlusLatencyHistogram::GetBucketUpperBoundUs(i - 1) << "us");
+        ++numberOfFailures;
+      }
+    }
+    return numberOfFailures;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestStatistics()
+  {
+    int numberOfFailures = 0;
+    PlusLatencyHistogram histogram;
+    if (histogram.GetCount() != 0 || histogram.GetPercentile(50) != 0.0 || histogram.GetMinimum() != 0.0 || histogram.GetMaximum() != 0.0)
+    {
+      LOG_ERROR("Empty histogram statistics are not zero");
+      ++numberOfFailures;
+    }
+
+    // Values 1us, 2us, ..., 10ms
+    const int numberOfValues = 10000;
+    for (int i = 1; i <= numberOfValues; ++i)
+    {
+      histogram.RecordValue(i * 1e-6);
+    }
+
+    if (histogram.GetCount() != numberOfValues)
+    {
+      LOG_ERROR("Count mismatch: " << histogram.GetCount() << " (expected " << numberOfValues << ")");
+      ++numberOfFailures;
+    }
+    if (!IsClose(histogram.GetMinimum(), 1e-6, 1e-9) || !IsClose(histogram.GetMaximum(), numberOfValues * 1e-6, 1e-9))
+    {
+      LOG_ERROR("Range mismatch: " << histogram.GetMinimum() << " - " << histogram.GetMaximum() << " sec");
+      ++numberOfFailures;
+    }
+    if (!IsClose(histogram.GetMean(), (numberOfValues + 1) / 2.0 * 1e-6, 1e-9))
+    {
+      LOG_ERROR("Mean mismatch: " << histogram.GetMean() << " sec");
+      ++numberOfFailures;
+    }
+
+    unsigned long long totalBucketCount = 0;
+    for (int i = 0; i < PlusLatencyHistogram::GetNumberOfBuckets(); ++i)
+    {
+      totalBucketCount += histogram.GetBucketCount(i);
+    }
+    if (totalBucketCount != histogram.GetCount())
+    {
+      LOG_ERROR("Sum of bucket counts (" << totalBucketCount << ") is different from the count (" << histogram.GetCount() << ")");
+      ++numberOfFailures;
+    }
+
+    const double percentiles[] = { 1.0, 10.0, 25.0, 50.0, 75.0, 90.0, 99.0, 99.9 };
+    for (unsigned int i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); ++i)
+    {
+      double expected = percentiles[i] / 100.0 * numberOfValues * 1e-6;
+      double actual = histogram.GetPercentile(percentiles[i]);
+      if (fabs(actual - expected) > MAX_PERCENTILE_RELATIVE_ERROR * expected)
+      {
+        LOG_ERROR("Percentile " << percentiles[i] << " is inaccurate: " << actual << " sec (expected " << expected << " sec)");
+        ++numberOfFailures;
+      }
+    }
+
+    // Negative values are recorded as zero
+    histogram.RecordValue(-1.0);
+    if (histogram.GetMinimum() != 0.0 || histogram.GetCount() != numberOfValues + 1)
+    {
+      LOG_ERROR("Negative value is not recorded as zero");
+      ++numberOfFailures;
+    }
+
+    histogram.Reset();
+    if (histogram.GetCount() != 0 || histogram.GetPercentile(99) != 0.0 || histogram.GetMean() != 0.0)
+    {
+      LOG_ERROR("Histogram is not empty after reset");
+      ++numberOfFailures;
+    }
+    return numberOfFailures;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestConcurrentWriters()
+  {
+    int numberOfFailures = 0;
+    PlusLatencyHistogram histogram;
+    vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+    threader->SetNumberOfThreads(NUMBER_OF_WRITER_THREADS);
+    threader->SetSingleMethod(&RecordValuesThread, &histogram);
+    threader->SingleMethodExecute();
+
+    const unsigned long long expectedCount = NUMBER_OF_WRITER_THREADS * NUMBER_OF_VALUES_PER_WRITER_THREAD;
+    if (histogram.GetCount() != expectedCount)
+    {
+      LOG_ERROR("Values were lost by concurrent writers: " << histogram.GetCount() << " recorded (expected " << expectedCount << ")");
+      ++numberOfFailures;
+    }
+    if (!IsClose(histogram.GetMean(), 0.001, 1e-9) || fabs(histogram.GetPercentile(50) - 0.001) > MAX_PERCENTILE_RELATIVE_ERROR * 0.001)
+    {
+      LOG_ERROR("Statistics of concurrently recorded values are wrong: " << histogram.GetSummary());
+      ++numberOfFailures;
+    }
+    return numberOfFailures;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestSummaryFormatting()
+  {
+    PlusLatencyHistogram histogram;
+    histogram.RecordValue(0.001);
+
+    std::ostringstream os;
+    os.precision(8);
+    histogram.PrintSummary(os);
+    os << " " << 1.0 / 3.0;
+    if (os.str().find(" 0.33333333") == std::string::npos)
+    {
+      LOG_ERROR("Stream formatting is changed by printing the summary: " << os.str());
+      return 1;
+    }
+    return 0;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfFailures = 0;
+  numberOfFailures += TestBuckets();
+  numberOfFailures += TestStatistics();
+  numberOfFailures += TestConcurrentWriters();
+  numberOfFailures += TestSummaryFormatting();
+
+  if (numberOfFailures > 0)
+  {
+    LOG_ERROR("PlusLatencyHistogramTest failed with " << numberOfFailures << " errors");
+    return EXIT_FAILURE;
+  }
+  LOG_INFO("PlusLatencyHistogramTest completed successfully");
+  return EXIT_SUCCESS;
+}
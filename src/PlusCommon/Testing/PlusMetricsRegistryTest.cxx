@@ -0,0 +1,205 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file PlusMetricsRegistryTest.cxx
+  \brief Checks metric creation, removal and the Prometheus export of PlusMetricsRegistry
+
+  Metric names that share a prefix (e.g., "plus_test_latency" and "plus_test_latency_max") are used
+  to verify that each metric family gets exactly one HELP and TYPE line, followed by all of its samples.
+*/
+
+#include "PlusConfigure.h"
+#include "PlusMetricsRegistry.h"
+
+// VTK includes
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <set>
+#include <sstream>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  PlusMetricsRegistry::LabelMap MakeLabels(const std::string& name, const std::string& value)
+  {
+    PlusMetricsRegistry::LabelMap labels;
+    labels[name] = value;
+    return labels;
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Name of the metric family that a sample line belongs to (summary suffixes are removed) */
+  std::string GetSampleFamilyName(const std::string& line, const std::string& currentFamily)
+  {
+    std::string name = line.substr(0, line.find_first_of("{ "));
+    const char* suffixes[] = { "_sum", "_count" };
+    for (unsigned int i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i)
+    {
+      std::string suffix = suffixes[i];
+      if (name == currentFamily + suffix)
+      {
+        return currentFamily;
+      }
+    }
+    return name;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestMetrics(PlusMetricsRegistry* registry)
+  {
+    int numberOfFailures = 0;
+
+    PlusMetricsRegistry::Counter* counter = registry->GetCounter("plus_test_items_total", MakeLabels("buffer", "Video"), "Test counter");
+    if (counter == NULL)
+    {
+      LOG_ERROR("Failed to create counter");
+      return 1;
+    }
+    counter->Increment();
+    counter->Increment(4);
+    if (registry->GetCounter("plus_test_items_total", MakeLabels("buffer", "Video")) != counter || counter->GetValue() != 5)
+    {
+      LOG_ERROR("Counter lookup or value mismatch");
+      ++numberOfFailures;
+    }
+
+    PlusMetricsRegistry::Gauge* gauge = registry->GetGauge("plus_test_level", PlusMetricsRegistry::LabelMap(), "Test gauge");
+    if (gauge == NULL)
+    {
+      LOG_ERROR("Failed to create gauge");
+      return numberOfFailures + 1;
+    }
+    gauge->SetValue(2.5);
+    gauge->Add(-1.0);
+    if (gauge->GetValue() != 1.5)
+    {
+      LOG_ERROR("Gauge value mismatch: " << gauge->GetValue() << " (expected 1.5)");
+      ++numberOfFailures;
+    }
+
+    // A metric cannot change type (an error is logged)
+    if (registry->GetGauge("plus_test_items_total", MakeLabels("buffer", "Video")) != NULL
+        || registry->GetGauge("plus_test_items_total", MakeLabels("buffer", "Tracker")) != NULL)
+    {
+      LOG_ERROR("A counter metric could be used as a gauge");
+      ++numberOfFailures;
+    }
+
+    // Remove all metrics of a client
+    registry->GetCounter("plus_test_commands_total", MakeLabels("client", "1"))->Increment();
+    registry->GetCounter("plus_test_commands_total", MakeLabels("client", "2"))->Increment();
+    registry->RemoveMetrics("client", "1");
+    std::string text = registry->GetMetricsAsText();
+    if (text.find("plus_test_commands_total{client=\"1\"}") != std::string::npos
+        || text.find("plus_test_commands_total{client=\"2\"} 1") == std::string::npos)
+    {
+      LOG_ERROR("Metrics were not removed correctly:\n" << text);
+      ++numberOfFailures;
+    }
+
+    return numberOfFailures;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestPrometheusExport(PlusMetricsRegistry* registry)
+  {
+    int numberOfFailures = 0;
+
+    // Names that are prefixes of other names, with and without labels, created in mixed order
+    registry->GetHistogram("plus_test_latency", MakeLabels("device", "B"), "Test latency")->RecordValue(0.002);
+    registry->GetGauge("plus_test_latency_max", PlusMetricsRegistry::LabelMap(), "Test maximum latency")->SetValue(0.003);
+    registry->GetHistogram("plus_test_latency", PlusMetricsRegistry::LabelMap(), "Test latency")->RecordValue(0.001);
+    registry->GetGauge("plus_test_latency_max", MakeLabels("device", "B"), "Test maximum latency")->SetValue(0.004);
+    registry->GetHistogram("plus_test_latency", MakeLabels("device", "A"), "Test latency")->RecordValue(0.001);
+    registry->GetCounter("plus_test_latency0", PlusMetricsRegistry::LabelMap(), "Test counter")->Increment();
+
+    std::string prometheus = registry->GetMetricsAsPrometheus();
+    LOG_DEBUG("Prometheus output:\n" << prometheus);
+
+    std::set<std::string> familiesWithType;
+    std::set<std::string> familiesWithHelp;
+    std::string currentFamily;
+    std::istringstream lines(prometheus);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+      if (line.empty())
+      {
+        continue;
+      }
+      if (line.compare(0, 7, "# HELP ") == 0 || line.compare(0, 7, "# TYPE ") == 0)
+      {
+        std::string family = line.substr(7, line.find(' ', 7) - 7);
+        std::set<std::string>& families = (line[2] == 'H' ? familiesWithHelp : familiesWithType);
+        if (!families.insert(family).second)
+        {
+          LOG_ERROR("Duplicate line for metric family " << family << ": " << line);
+          ++numberOfFailures;
+        }
+        currentFamily = family;
+        continue;
+      }
+      std::string family = GetSampleFamilyName(line, currentFamily);
+      if (family != currentFamily)
+      {
+        LOG_ERROR("Sample of metric family " << family << " is not in the block of its family: " << line);
+        ++numberOfFailures;
+      }
+    }
+
+    const char* expectedFamilies[] = { "plus_test_latency", "plus_test_latency_max", "plus_test_latency0", "plus_test_items_total" };
+    for (unsigned int i = 0; i < sizeof(expectedFamilies) / sizeof(expectedFamilies[0]); ++i)
+    {
+      if (familiesWithType.find(expectedFamilies[i]) == familiesWithType.end())
+      {
+        LOG_ERROR("Missing TYPE line for metric family " << expectedFamilies[i]);
+        ++numberOfFailures;
+      }
+    }
+
+    if (prometheus.find("plus_test_latency_count{device=\"A\"} 1") == std::string::npos
+        || prometheus.find("plus_test_latency_count 1") == std::string::npos
+        || prometheus.find("plus_test_latency{device=\"B\",quantile=\"0.5\"} ") == std::string::npos)
+    {
+      LOG_ERROR("Histogram samples are missing from the Prometheus output:\n" << prometheus);
+      ++numberOfFailures;
+    }
+
+    return numberOfFailures;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  PlusMetricsRegistry* registry = PlusMetricsRegistry::GetInstance();
+  int numberOfFailures = 0;
+  numberOfFailures += TestMetrics(registry);
+  numberOfFailures += TestPrometheusExport(registry);
+
+  if (numberOfFailures > 0)
+  {
+    LOG_ERROR("PlusMetricsRegistryTest failed with " << numberOfFailures << " errors");
+    return EXIT_FAILURE;
+  }
+  LOG_INFO("PlusMetricsRegistryTest completed successfully");
+  return EXIT_SUCCESS;
+}
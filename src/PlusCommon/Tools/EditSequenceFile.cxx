@@ -9,18 +9,27 @@ See License.txt for details.
 #include "PlusMath.h"
 #include "igsioTrackedFrame.h"
 #include "vtkPlusSequenceIO.h"
+#include "vtkPlusSequenceStreamReader.h"
+#include "vtkPlusSequenceStreamWriter.h"
 #include "vtkIGSIOTrackedFrameList.h"
 #include "vtkIGSIOTransformRepository.h"
 
 // VTK includes
 #include <vtkImageData.h>
 #include <vtkMatrix4x4.h>
+#include <vtkMultiThreader.h>
 #include <vtkSmartPointer.h>
 #include <vtkTransform.h>
 #include <vtkXMLDataElement.h>
 #include <vtkXMLUtilities.h>
 #include <vtksys/CommandLineArguments.hxx>
 #include <vtksys/RegularExpression.hxx>
+#include <vtksys/SystemTools.hxx>
+
+// STL includes
+#include <array>
+#include <fstream>
+#include <iomanip>
 
 enum OperationType
 {
@@ -66,21 +75,249 @@ public:
   std::string               FrameTransformIndexFieldName;
 };
 
-PlusStatus TrimSequenceFile(vtkIGSIOTrackedFrameList* trackedFrameList, unsigned int firstFrameIndex, unsigned int lastFrameIndex);
-PlusStatus DecimateSequenceFile(vtkIGSIOTrackedFrameList* trackedFrameList, unsigned int decimationFactor);
+// All parameters of the editing operation that is applied on the frames
+class SequenceEditParameters
+{
+public:
+  SequenceEditParameters()
+  {
+    Operation = NO_OPERATION;
+    FirstFrameIndex = 0;
+    LastFrameIndex = 0;
+    DecimationFactor = 2;
+    FillGrayLevel = 0;
+    NumberOfThreads = 1;
+  }
+
+  OperationType             Operation;
+  unsigned int              FirstFrameIndex;
+  unsigned int              LastFrameIndex;
+  unsigned int              DecimationFactor;
+  FrameFieldUpdate          FieldUpdate;
+  std::vector<std::string>  TransformNamesToAdd;
+  std::string               DeviceSetConfigurationFileName;
+  std::vector<int>          RectOriginPix;
+  std::vector<int>          RectSizePix;
+  int                       FillGrayLevel;
+  igsioVideoFrame::FlipInfoType FlipInfo;
+  std::string               UpdatedReferenceTransformName;
+  int                       NumberOfThreads;
+};
+
+PlusStatus EditTrackedFrameList(vtkIGSIOTrackedFrameList* trackedFrameList, SequenceEditParameters& params, unsigned int firstFrameIndexInSequence);
+PlusStatus EditSequenceFileStreaming(const std::vector<std::string>& inputFileNames, const std::string& outputFileName, SequenceEditParameters& params, bool incrementTimestamps, bool useCompression, unsigned int maxNumberOfFramesInMemory);
+PlusStatus EditMetaImageHeader(const std::string& inputFileName, const std::string& outputFileName, const SequenceEditParameters& params, bool useCompression, bool& headerEdited);
+bool IsHeaderOnlyOperation(const SequenceEditParameters& params);
+PlusStatus ValidateTrimRange(unsigned int firstFrameIndex, unsigned int lastFrameIndex, unsigned int numberOfFrames);
+PlusStatus TrimSequenceFile(vtkIGSIOTrackedFrameList* trackedFrameList, unsigned int firstFrameIndex, unsigned int lastFrameIndex, unsigned int firstFrameIndexInSequence);
+PlusStatus DecimateSequenceFile(vtkIGSIOTrackedFrameList* trackedFrameList, unsigned int decimationFactor, unsigned int firstFrameIndexInSequence);
 PlusStatus UpdateFrameFieldValue(FrameFieldUpdate& fieldUpdate);
 PlusStatus DeleteFrameField(vtkIGSIOTrackedFrameList* trackedFrameList, std::string fieldName);
 PlusStatus ConvertStringToMatrix(std::string& strMatrix, vtkMatrix4x4* matrix);
 PlusStatus AddTransform(vtkIGSIOTrackedFrameList* trackedFrameList, std::vector<std::string> transformNamesToAdd, std::string deviceSetConfigurationFileName);
-PlusStatus FillRectangle(vtkIGSIOTrackedFrameList* trackedFrameList, const std::vector<unsigned int>& fillRectOrigin, const std::vector<unsigned int>& fillRectSize, int fillGrayLevel);
-PlusStatus CropRectangle(vtkIGSIOTrackedFrameList* trackedFrameList, igsioVideoFrame::FlipInfoType& flipInfo, const std::vector<int>& cropRectOrigin, const std::vector<int>& cropRectSize);
+PlusStatus FillRectangle(vtkIGSIOTrackedFrameList* trackedFrameList, const std::vector<unsigned int>& fillRectOrigin, const std::vector<unsigned int>& fillRectSize, int fillGrayLevel, int numberOfThreads);
+PlusStatus CropRectangle(vtkIGSIOTrackedFrameList* trackedFrameList, igsioVideoFrame::FlipInfoType& flipInfo, const std::vector<int>& cropRectOrigin, const std::vector<int>& cropRectSize, int numberOfThreads);
+PlusStatus UpdateReferenceTransform(vtkIGSIOTrackedFrameList* trackedFrameList, const std::string& strUpdatedReferenceTransformName);
 
 namespace
 {
   const std::string FIELD_VALUE_FRAME_SCALAR = "{frame-scalar}";
   const std::string FIELD_VALUE_FRAME_TRANSFORM = "{frame-transform}";
+
+  const char SEQUENCE_FIELD_FRAME_PREFIX[] = "Seq_Frame";
+  const size_t COPY_BUFFER_SIZE = 1024 * 1024;
+
+  // Fields that describe the pixel data, these cannot be edited without processing the frames
+  const char* const IMAGE_HEADER_FIELD_NAMES[] =
+  {
+    "ObjectType", "NDims", "AnatomicalOrientation", "BinaryData", "BinaryDataByteOrderMSB", "CenterOfRotation",
+    "CompressedData", "CompressedDataSize", "DimSize", "ElementNumberOfChannels", "ElementSpacing", "ElementType",
+    "Kinds", "Offset", "TransformMatrix", "UltrasoundImageOrientation", "UltrasoundImageType", "ElementDataFile"
+  };
+
+  typedef std::vector<std::pair<std::string, std::string> > HeaderFieldList;
+
+  //----------------------------------------------------------------------------
+  // Function that is called for each frame by ProcessFramesInParallel
+  typedef void (*FrameFunctionType)(igsioTrackedFrame* trackedFrame, unsigned int frameIndex, void* clientData);
+
+  struct FrameFunctionThreadData
+  {
+    vtkIGSIOTrackedFrameList* TrackedFrameList;
+    FrameFunctionType Function;
+    void* ClientData;
+  };
+
+  //----------------------------------------------------------------------------
+  VTK_THREAD_RETURN_TYPE ProcessFramesThread(void* arg)
+  {
+    vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+    FrameFunctionThreadData* data = static_cast<FrameFunctionThreadData*>(threadInfo->UserData);
+    unsigned int numberOfFrames = data->TrackedFrameList->GetNumberOfTrackedFrames();
+    unsigned int firstFrameIndex = numberOfFrames * threadInfo->ThreadID / threadInfo->NumberOfThreads;
+    unsigned int lastFrameIndex = numberOfFrames * (threadInfo->ThreadID + 1) / threadInfo->NumberOfThreads;
+    for (unsigned int i = firstFrameIndex; i < lastFrameIndex; ++i)
+    {
+      data->Function(data->TrackedFrameList->GetTrackedFrame(i), i, data->ClientData);
+    }
+    return VTK_THREAD_RETURN_VALUE;
+  }
+
+  //----------------------------------------------------------------------------
+  // Call the function for each frame. Frames are distributed evenly between the threads.
+  void ProcessFramesInParallel(vtkIGSIOTrackedFrameList* trackedFrameList, FrameFunctionType function, void* clientData, int numberOfThreads)
+  {
+    unsigned int numberOfFrames = trackedFrameList->GetNumberOfTrackedFrames();
+    numberOfThreads = std::min<int>(numberOfThreads, numberOfFrames);
+    if (numberOfThreads <= 1)
+    {
+      for (unsigned int i = 0; i < numberOfFrames; ++i)
+      {
+        function(trackedFrameList->GetTrackedFrame(i), i, clientData);
+      }
+      return;
+    }
+
+    FrameFunctionThreadData data;
+    data.TrackedFrameList = trackedFrameList;
+    data.Function = function;
+    data.ClientData = clientData;
+
+    vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+    threader->SetNumberOfThreads(numberOfThreads);
+    threader->SetSingleMethod(&ProcessFramesThread, &data);
+    threader->SingleMethodExecute();
+  }
+
+  //----------------------------------------------------------------------------
+  // Copy the fields of a frame to a frame of the master sequence (used for mixing sequences)
+  void CopyFrameFieldsForMix(igsioTrackedFrame* additionalFrame, igsioTrackedFrame* masterTrackedFrame)
+  {
+    auto customFrameFields = additionalFrame->GetCustomFields();
+    for (auto fieldIter = customFrameFields.begin(); fieldIter != customFrameFields.end(); ++fieldIter)
+    {
+      if (!fieldIter->first.compare("FrameNumber") ||
+          !fieldIter->first.compare("Timestamp") ||
+          !fieldIter->first.compare("UnfilteredTimestamp") ||
+          !fieldIter->first.compare("ImageStatus"))
+      {
+        // Timing and image information is taken from the first sequence
+        continue;
+      }
+      masterTrackedFrame->SetFrameField(fieldIter->first, fieldIter->second.second, fieldIter->second.first);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus CopyStreamContent(std::istream& source, std::ostream& target)
+  {
+    std::vector<char> buffer(COPY_BUFFER_SIZE);
+    while (source.good())
+    {
+      source.read(&buffer[0], buffer.size());
+      std::streamsize numberOfBytesRead = source.gcount();
+      if (numberOfBytesRead > 0)
+      {
+        target.write(&buffer[0], numberOfBytesRead);
+      }
+    }
+    return (source.eof() && target.good()) ? PLUS_SUCCESS : PLUS_FAIL;
+  }
 }
 
+//----------------------------------------------------------------------------
+/*!
+  Provides frames of an additional sequence for mixing, with keeping only a few frames in memory.
+  Frames must be requested with non-decreasing timestamps.
+*/
+class StreamedMixSequence
+{
+public:
+  StreamedMixSequence()
+    : Reader(vtkSmartPointer<vtkPlusSequenceStreamReader>::New())
+    , Frames(vtkSmartPointer<vtkIGSIOTrackedFrameList>::New())
+    , CurrentFrameIndex(0)
+    , MaxNumberOfFramesInMemory(1)
+  {
+  }
+
+  PlusStatus Open(const std::string& fileName, unsigned int maxNumberOfFramesInMemory)
+  {
+    this->FileName = fileName;
+    this->MaxNumberOfFramesInMemory = std::max<unsigned int>(maxNumberOfFramesInMemory, 1);
+    this->CurrentFrameIndex = 0;
+    this->Frames->Clear();
+    if (this->Reader->Open(fileName) != PLUS_SUCCESS)
+    {
+      return PLUS_FAIL;
+    }
+    return this->Reader->ReadNextFrames(this->Frames, this->MaxNumberOfFramesInMemory);
+  }
+
+  /*! Get the frame that has the closest timestamp. Frame is NULL if the sequence is empty. */
+  PlusStatus GetClosestFrame(double timestamp, igsioTrackedFrame*& frame)
+  {
+    frame = NULL;
+    if (this->Frames->GetNumberOfTrackedFrames() == 0)
+    {
+      return PLUS_SUCCESS;
+    }
+    bool nextFrameAvailable = false;
+    while (true)
+    {
+      if (this->ReadNextFrameIfNeeded(nextFrameAvailable) != PLUS_SUCCESS)
+      {
+        return PLUS_FAIL;
+      }
+      if (!nextFrameAvailable)
+      {
+        // last frame, all remaining frames are assigned to it
+        break;
+      }
+      // use this frame index until timestamp is closest to this frame's timestamp
+      double maxTimestampValueForCurrentFrame = (this->Frames->GetTrackedFrame(this->CurrentFrameIndex)->GetTimestamp() +
+          this->Frames->GetTrackedFrame(this->CurrentFrameIndex + 1)->GetTimestamp()) / 2.0;
+      if (timestamp <= maxTimestampValueForCurrentFrame)
+      {
+        break;
+      }
+      this->CurrentFrameIndex++;
+    }
+    frame = this->Frames->GetTrackedFrame(this->CurrentFrameIndex);
+    return PLUS_SUCCESS;
+  }
+
+protected:
+  /*! Make sure that the frame after the current frame is in memory (if there is any) */
+  PlusStatus ReadNextFrameIfNeeded(bool& nextFrameAvailable)
+  {
+    nextFrameAvailable = (this->CurrentFrameIndex + 1 < this->Frames->GetNumberOfTrackedFrames());
+    if (nextFrameAvailable || this->Reader->IsEndOfSequence())
+    {
+      return PLUS_SUCCESS;
+    }
+    // Frames before the current frame are not needed anymore
+    if (this->CurrentFrameIndex > 0)
+    {
+      this->Frames->RemoveTrackedFrameRange(0, this->CurrentFrameIndex - 1);
+      this->CurrentFrameIndex = 0;
+    }
+    if (this->Reader->ReadNextFrames(this->Frames, this->MaxNumberOfFramesInMemory) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to read frames from " << this->FileName << " (after frame " << this->Reader->GetNumberOfFramesRead() << ")");
+      return PLUS_FAIL;
+    }
+    nextFrameAvailable = (this->CurrentFrameIndex + 1 < this->Frames->GetNumberOfTrackedFrames());
+    return PLUS_SUCCESS;
+  }
+
+  std::string FileName;
+  vtkSmartPointer<vtkPlusSequenceStreamReader> Reader;
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> Frames;
+  unsigned int CurrentFrameIndex;
+  unsigned int MaxNumberOfFramesInMemory;
+};
+
 // Fuse all fields in sequence files into the first sequence
 //----------------------------------------------------------------------------
 PlusStatus MixTrackedFrameLists(vtkIGSIOTrackedFrameList* trackedFrameList, std::vector<std::string> inputFileNames)
@@ -143,20 +380,7 @@ PlusStatus MixTrackedFrameLists(vtkIGSIOTrackedFrameList* trackedFrameList, std:
       }
 
       // Copy frame fields
-      igsioTrackedFrame* additionalFrame = additionalTrackedFrameList->GetTrackedFrame(additionalFrameIndex);
-      auto customFrameFields = additionalFrame->GetCustomFields();
-      for (auto fieldIter = customFrameFields.begin(); fieldIter != customFrameFields.end(); ++fieldIter)
-      {
-        if (!fieldIter->first.compare("FrameNumber") ||
-            !fieldIter->first.compare("Timestamp") ||
-            !fieldIter->first.compare("UnfilteredTimestamp") ||
-            !fieldIter->first.compare("ImageStatus"))
-        {
-          // Timing and image information is taken from the first sequence
-          continue;
-        }
-        masterTrackedFrame->SetFrameField(fieldIter->first, fieldIter->second.second, fieldIter->second.first);
-      }
+      CopyFrameFieldsForMix(additionalTrackedFrameList->GetTrackedFrame(additionalFrameIndex), masterTrackedFrame);
     }
   }
   return PLUS_SUCCESS;
@@ -249,6 +473,10 @@ int main(int argc, char** argv)
   bool                            flipY(false);
   bool                            flipZ(false);
 
+  bool                            streaming(false); // Process the frames in chunks instead of reading the whole sequence into memory
+  int                             maxNumberOfFramesInMemory = 50; // Number of frames that are processed at once in streaming mode
+  int                             numberOfThreads = 0; // Number of threads for per-frame image operations (0 = number of processors)
+
   args.Initialize(argc, argv);
   args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
   args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
@@ -294,6 +522,11 @@ int main(int argc, char** argv)
   args.AddArgument("--flipZ", vtksys::CommandLineArguments::NO_ARGUMENT, &flipZ, "Flip image along Z axis.");
   args.AddArgument("--fill-gray-level", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &fillGrayLevel, "Rectangle fill gray level. 0 = black, 255 = white. (Default: 0)");
 
+  // Processing parameters
+  args.AddArgument("--streaming", vtksys::CommandLineArguments::NO_ARGUMENT, &streaming, "Read, edit, and write frames in chunks, so that memory usage does not depend on the sequence length. Field edits of a single MetaImage file only rewrite the header.");
+  args.AddArgument("--max-frames-in-memory", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &maxNumberOfFramesInMemory, "Number of frames that are processed at once in streaming mode (Default: 50)");
+  args.AddArgument("--threads", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfThreads, "Number of threads used for per-frame image operations (FILL_IMAGE_RECTANGLE, CROP). (Default: number of processors)");
+
   if (!args.Parse())
   {
     std::cerr << "Problem parsing arguments" << std::endl;
@@ -341,6 +574,9 @@ int main(int argc, char** argv)
 
     std::cout << "- REMOVE_IMAGE_DATA: Remove image data from a meta file that has both image and tracker data, and keep only the tracker data." << std::endl;
 
+    std::cout << std::endl << "All operations except REMOVE_IMAGE_DATA can be performed with --streaming." << std::endl;
+    std::cout << "Compressed MetaImage output (--use-compression with .mha or .mhd output file) cannot be written with --streaming." << std::endl;
+
     return EXIT_SUCCESS;
   }
 
@@ -452,9 +688,7 @@ int main(int argc, char** argv)
   }
 
   ///////////////////////////////////////////////////////////////////
-  // Read input files
-
-  vtkSmartPointer<vtkIGSIOTrackedFrameList> trackedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  // Set up the operation
 
   if (!inputFileName.empty())
   {
@@ -462,6 +696,88 @@ int main(int argc, char** argv)
     inputFileNames.insert(inputFileNames.begin(), inputFileName);
   }
 
+  SequenceEditParameters params;
+  params.Operation = operation;
+  params.FirstFrameIndex = static_cast<unsigned int>(std::max(firstFrameIndex, 0));
+  params.LastFrameIndex = static_cast<unsigned int>(std::max(lastFrameIndex, 0));
+  params.DecimationFactor = static_cast<unsigned int>(std::max(decimationFactor, 0));
+  params.FieldUpdate.FieldName = fieldName;
+  params.FieldUpdate.UpdatedFieldName = updatedFieldName;
+  params.FieldUpdate.UpdatedFieldValue = updatedFieldValue;
+  params.FieldUpdate.FrameScalarDecimalDigits = frameScalarDecimalDigits;
+  params.FieldUpdate.FrameScalarIncrement = frameScalarIncrement;
+  params.FieldUpdate.FrameScalarStart = frameScalarStart;
+  params.FieldUpdate.FrameTransformStart = frameTransformStart;
+  params.FieldUpdate.FrameTransformIncrement = frameTransformIncrement;
+  params.FieldUpdate.FrameTransformIndexFieldName = strFrameTransformIndexFieldName;
+  igsioCommon::SplitStringIntoTokens(transformNamesToAdd, ',', params.TransformNamesToAdd);
+  params.DeviceSetConfigurationFileName = deviceSetConfigurationFileName;
+  params.RectOriginPix = rectOriginPix;
+  params.RectSizePix = rectSizePix;
+  params.FillGrayLevel = fillGrayLevel;
+  params.FlipInfo.hFlip = flipX;
+  params.FlipInfo.vFlip = flipY;
+  params.FlipInfo.eFlip = flipZ;
+  params.UpdatedReferenceTransformName = strUpdatedReferenceTransformName;
+  params.NumberOfThreads = (numberOfThreads > 0 ? numberOfThreads : vtkMultiThreader::GetGlobalDefaultNumberOfThreads());
+
+  if (operation == TRIM && params.FirstFrameIndex > params.LastFrameIndex)
+  {
+    LOG_ERROR("Invalid input range: (" << params.FirstFrameIndex << ", " << params.LastFrameIndex << ")");
+    return EXIT_FAILURE;
+  }
+
+  if (streaming && operation == REMOVE_IMAGE_DATA)
+  {
+    LOG_WARNING("REMOVE_IMAGE_DATA operation cannot be performed in streaming mode. All frames are read into memory.");
+    streaming = false;
+  }
+
+  ///////////////////////////////////////////////////////////////////
+  // Edit the sequence in chunks
+
+  if (streaming)
+  {
+    // Output is written while the input is read, therefore they must be different files
+    std::string outputFilePath = vtkPlusConfig::GetInstance()->GetOutputPath(outputFileName);
+    for (std::vector<std::string>::iterator inputFileNameIt = inputFileNames.begin(); inputFileNameIt != inputFileNames.end(); ++inputFileNameIt)
+    {
+      if (vtksys::SystemTools::SameFile(*inputFileNameIt, outputFilePath))
+      {
+        LOG_ERROR("In streaming mode the output file must be different from the input files: " << outputFileName);
+        return EXIT_FAILURE;
+      }
+    }
+
+    if (inputFileNames.size() == 1 && IsHeaderOnlyOperation(params))
+    {
+      bool headerEdited = false;
+      if (EditMetaImageHeader(inputFileNames[0], outputFileName, params, useCompression, headerEdited) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to edit sequence file header: " << inputFileNames[0]);
+        return EXIT_FAILURE;
+      }
+      if (headerEdited)
+      {
+        LOG_INFO("Sequence file editing was successful!");
+        return EXIT_SUCCESS;
+      }
+    }
+
+    if (EditSequenceFileStreaming(inputFileNames, outputFileName, params, incrementTimestamps, useCompression, std::max(maxNumberOfFramesInMemory, 1)) != PLUS_SUCCESS)
+    {
+      return EXIT_FAILURE;
+    }
+
+    LOG_INFO("Sequence file editing was successful!");
+    return EXIT_SUCCESS;
+  }
+
+  ///////////////////////////////////////////////////////////////////
+  // Read input files
+
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> trackedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+
   // Multiple input files are appended unless sequences are mixed
   PlusStatus status = PLUS_SUCCESS;
   if (operation == MIX)
@@ -480,7 +796,40 @@ int main(int argc, char** argv)
   ///////////////////////////////////////////////////////////////////
   // Make the operation
 
-  switch (operation)
+  if (operation == TRIM && ValidateTrimRange(params.FirstFrameIndex, params.LastFrameIndex, trackedFrameList->GetNumberOfTrackedFrames()) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to trim sequence file");
+    return EXIT_FAILURE;
+  }
+
+  if (EditTrackedFrameList(trackedFrameList, params, 0) != PLUS_SUCCESS)
+  {
+    return EXIT_FAILURE;
+  }
+
+  ///////////////////////////////////////////////////////////////////
+  // Save output file to file
+
+  LOG_INFO("Save output sequence file to: " << outputFileName);
+  if (vtkPlusSequenceIO::Write(outputFileName, trackedFrameList, trackedFrameList->GetImageOrientation(), useCompression, operation != REMOVE_IMAGE_DATA) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Couldn't write sequence file: " << outputFileName);
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Sequence file editing was successful!");
+  return EXIT_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+// Apply the operation on the frames. The list may contain only a part of the sequence, starting at
+// firstFrameIndexInSequence (when the sequence is edited in chunks).
+PlusStatus EditTrackedFrameList(vtkIGSIOTrackedFrameList* trackedFrameList, SequenceEditParameters& params, unsigned int firstFrameIndexInSequence)
+{
+  // Operations are logged only once, when the first frames of the sequence are processed
+  bool logOperation = (firstFrameIndexInSequence == 0);
+
+  switch (params.Operation)
   {
     case NO_OPERATION:
     case APPEND:
@@ -491,106 +840,120 @@ int main(int argc, char** argv)
       break;
     case TRIM:
       {
-        if (firstFrameIndex < 0)
+        if (logOperation)
         {
-          firstFrameIndex = 0;
+          LOG_INFO("Trim sequence file from frame #: " << params.FirstFrameIndex << " to frame #" << params.LastFrameIndex);
         }
-        if (lastFrameIndex < 0)
-        {
-          lastFrameIndex = 0;
-        }
-        unsigned int firstFrameIndexUint = static_cast<unsigned int>(firstFrameIndex);
-        unsigned int lastFrameIndexUint = static_cast<unsigned int>(lastFrameIndex);
-        if (TrimSequenceFile(trackedFrameList, firstFrameIndexUint, lastFrameIndexUint) != PLUS_SUCCESS)
+        if (TrimSequenceFile(trackedFrameList, params.FirstFrameIndex, params.LastFrameIndex, firstFrameIndexInSequence) != PLUS_SUCCESS)
         {
           LOG_ERROR("Failed to trim sequence file");
-          return EXIT_FAILURE;
+          return PLUS_FAIL;
         }
       }
       break;
     case DECIMATE:
       {
-        if (DecimateSequenceFile(trackedFrameList, decimationFactor) != PLUS_SUCCESS)
+        if (logOperation)
+        {
+          LOG_INFO("Decimate sequence file: keep 1 frame out of every " << params.DecimationFactor << " frames");
+        }
+        if (DecimateSequenceFile(trackedFrameList, params.DecimationFactor, firstFrameIndexInSequence) != PLUS_SUCCESS)
         {
           LOG_ERROR("Failed to decimate sequence file");
-          return EXIT_FAILURE;
+          return PLUS_FAIL;
         }
       }
       break;
     case UPDATE_FRAME_FIELD_NAME:
       {
+        if (logOperation)
+        {
+          LOG_INFO("Update frame field name '" << params.FieldUpdate.FieldName << "' to '" << params.FieldUpdate.UpdatedFieldName << "'");
+        }
         FrameFieldUpdate fieldUpdate;
         fieldUpdate.TrackedFrameList = trackedFrameList;
-        fieldUpdate.FieldName = fieldName;
-        fieldUpdate.UpdatedFieldName = updatedFieldName;
+        fieldUpdate.FieldName = params.FieldUpdate.FieldName;
+        fieldUpdate.UpdatedFieldName = params.FieldUpdate.UpdatedFieldName;
 
         if (UpdateFrameFieldValue(fieldUpdate) != PLUS_SUCCESS)
         {
-          LOG_ERROR("Failed to update frame field name '" << fieldName << "' to '" << updatedFieldName << "'");
-          return EXIT_FAILURE;
+          LOG_ERROR("Failed to update frame field name '" << fieldUpdate.FieldName << "' to '" << fieldUpdate.UpdatedFieldName << "'");
+          return PLUS_FAIL;
         }
       }
       break;
     case UPDATE_FRAME_FIELD_VALUE:
       {
-        FrameFieldUpdate fieldUpdate;
-        fieldUpdate.TrackedFrameList = trackedFrameList;
-        fieldUpdate.FieldName = fieldName;
-        fieldUpdate.UpdatedFieldName = updatedFieldName;
-        fieldUpdate.UpdatedFieldValue = updatedFieldValue;
-        fieldUpdate.FrameScalarDecimalDigits = frameScalarDecimalDigits;
-        fieldUpdate.FrameScalarIncrement = frameScalarIncrement;
-        fieldUpdate.FrameScalarStart = frameScalarStart;
-        fieldUpdate.FrameTransformStart = frameTransformStart;
-        fieldUpdate.FrameTransformIncrement = frameTransformIncrement;
-        fieldUpdate.FrameTransformIndexFieldName = strFrameTransformIndexFieldName;
-
-        if (UpdateFrameFieldValue(fieldUpdate) != PLUS_SUCCESS)
+        if (logOperation)
+        {
+          LOG_INFO("Update frame field");
+        }
+        // The scalar and transform values are continued from the previous call
+        params.FieldUpdate.TrackedFrameList = trackedFrameList;
+        PlusStatus status = UpdateFrameFieldValue(params.FieldUpdate);
+        params.FieldUpdate.TrackedFrameList = NULL;
+        if (status != PLUS_SUCCESS)
         {
           LOG_ERROR("Failed to update frame field value");
-          return EXIT_FAILURE;
+          return PLUS_FAIL;
         }
       }
       break;
     case DELETE_FRAME_FIELD:
       {
-        if (DeleteFrameField(trackedFrameList, fieldName) != PLUS_SUCCESS)
+        if (logOperation)
+        {
+          LOG_INFO("Delete frame field: " << params.FieldUpdate.FieldName);
+        }
+        if (DeleteFrameField(trackedFrameList, params.FieldUpdate.FieldName) != PLUS_SUCCESS)
         {
           LOG_ERROR("Failed to delete frame field");
-          return EXIT_FAILURE;
+          return PLUS_FAIL;
         }
       }
       break;
     case DELETE_FIELD:
       {
         // Delete field
-        LOG_INFO("Delete field: " << fieldName);
+        const std::string& fieldName = params.FieldUpdate.FieldName;
+        if (logOperation)
+        {
+          LOG_INFO("Delete field: " << fieldName);
+        }
         if (trackedFrameList->SetCustomString(fieldName.c_str(), NULL) != PLUS_SUCCESS)
         {
           LOG_ERROR("Failed to delete field: " << fieldName);
-          return EXIT_FAILURE;
+          return PLUS_FAIL;
         }
       }
       break;
     case UPDATE_FIELD_NAME:
       {
         // Update field name
-        LOG_INFO("Update field name '" << fieldName << "' to  '" << updatedFieldName << "'");
+        const std::string& fieldName = params.FieldUpdate.FieldName;
+        const std::string& updatedFieldName = params.FieldUpdate.UpdatedFieldName;
+        if (logOperation)
+        {
+          LOG_INFO("Update field name '" << fieldName << "' to  '" << updatedFieldName << "'");
+        }
         const char* fieldValue = trackedFrameList->GetCustomString(fieldName.c_str());
         if (fieldValue != NULL)
         {
+          // Copy the value, as the original field is deleted
+          std::string fieldValueCopy(fieldValue);
+
           // Delete field
           if (trackedFrameList->SetCustomString(fieldName.c_str(), NULL) != PLUS_SUCCESS)
           {
             LOG_ERROR("Failed to delete field: " << fieldName);
-            return EXIT_FAILURE;
+            return PLUS_FAIL;
           }
 
           // Add new field
-          if (trackedFrameList->SetCustomString(updatedFieldName.c_str(), fieldValue) != PLUS_SUCCESS)
+          if (trackedFrameList->SetCustomString(updatedFieldName.c_str(), fieldValueCopy.c_str()) != PLUS_SUCCESS)
           {
-            LOG_ERROR("Failed to update field '" << updatedFieldName << "' with value '" << fieldValue << "'");
-            return EXIT_FAILURE;
+            LOG_ERROR("Failed to update field '" << updatedFieldName << "' with value '" << fieldValueCopy << "'");
+            return PLUS_FAIL;
           }
         }
       }
@@ -598,60 +961,62 @@ int main(int argc, char** argv)
     case UPDATE_FIELD_VALUE:
       {
         // Update field value
-        LOG_INFO("Update field '" << fieldName << "' with value '" << updatedFieldValue << "'");
+        const std::string& fieldName = params.FieldUpdate.FieldName;
+        const std::string& updatedFieldValue = params.FieldUpdate.UpdatedFieldValue;
+        if (logOperation)
+        {
+          LOG_INFO("Update field '" << fieldName << "' with value '" << updatedFieldValue << "'");
+        }
         if (trackedFrameList->SetCustomString(fieldName.c_str(), updatedFieldValue.c_str()) != PLUS_SUCCESS)
         {
           LOG_ERROR("Failed to update field '" << fieldName << "' with value '" << updatedFieldValue << "'");
-          return EXIT_FAILURE;
+          return PLUS_FAIL;
         }
       }
       break;
     case ADD_TRANSFORM:
       {
         // Add transform
-        LOG_INFO("Add transform '" << transformNamesToAdd << "' using device set configuration file '" << deviceSetConfigurationFileName << "'");
-        std::vector<std::string> transformNamesList;
-        igsioCommon::SplitStringIntoTokens(transformNamesToAdd, ',', transformNamesList);
-        if (AddTransform(trackedFrameList, transformNamesList, deviceSetConfigurationFileName) != PLUS_SUCCESS)
+        if (logOperation)
         {
-          LOG_ERROR("Failed to add transform '" << transformNamesToAdd << "' using device set configuration file '" << deviceSetConfigurationFileName << "'");
-          return EXIT_FAILURE;
+          LOG_INFO("Add transform(s) using device set configuration file '" << params.DeviceSetConfigurationFileName << "'");
+        }
+        if (AddTransform(trackedFrameList, params.TransformNamesToAdd, params.DeviceSetConfigurationFileName) != PLUS_SUCCESS)
+        {
+          LOG_ERROR("Failed to add transform(s) using device set configuration file '" << params.DeviceSetConfigurationFileName << "'");
+          return PLUS_FAIL;
         }
       }
       break;
     case FILL_IMAGE_RECTANGLE:
       {
-        if (rectOriginPix.size() != 2 || rectSizePix.size() != 2)
+        if (params.RectOriginPix.size() != 2 || params.RectSizePix.size() != 2)
         {
           LOG_ERROR("Incorrect size of vector for rectangle origin or size. Aborting.");
           return PLUS_FAIL;
         }
-        if (rectOriginPix[0] < 0 || rectOriginPix[1] < 0 || rectSizePix[0] < 0 || rectSizePix[1] < 0)
+        if (params.RectOriginPix[0] < 0 || params.RectOriginPix[1] < 0 || params.RectSizePix[0] < 0 || params.RectSizePix[1] < 0)
         {
           LOG_ERROR("Negative value for rectangle origin or size entered. Aborting.");
           return PLUS_FAIL;
         }
-        std::vector<unsigned int> rectOriginPixUint(rectOriginPix.begin(), rectOriginPix.end());
-        std::vector<unsigned int> rectSizePixUint(rectSizePix.begin(), rectSizePix.end());
+        std::vector<unsigned int> rectOriginPixUint(params.RectOriginPix.begin(), params.RectOriginPix.end());
+        std::vector<unsigned int> rectSizePixUint(params.RectSizePix.begin(), params.RectSizePix.end());
         // Fill a rectangular region in the image with a solid color
-        if (FillRectangle(trackedFrameList, rectOriginPixUint, rectSizePixUint, fillGrayLevel) != PLUS_SUCCESS)
+        if (FillRectangle(trackedFrameList, rectOriginPixUint, rectSizePixUint, params.FillGrayLevel, params.NumberOfThreads) != PLUS_SUCCESS)
         {
           LOG_ERROR("Failed to fill rectangle");
-          return EXIT_FAILURE;
+          return PLUS_FAIL;
         }
       }
       break;
     case CROP:
       {
         // Crop a rectangular region from the image
-        igsioVideoFrame::FlipInfoType flipInfo;
-        flipInfo.hFlip = flipX;
-        flipInfo.vFlip = flipY;
-        flipInfo.eFlip = flipZ;
-        if (CropRectangle(trackedFrameList, flipInfo, rectOriginPix, rectSizePix) != PLUS_SUCCESS)
+        if (CropRectangle(trackedFrameList, params.FlipInfo, params.RectOriginPix, params.RectSizePix, params.NumberOfThreads) != PLUS_SUCCESS)
         {
           LOG_ERROR("Failed to fill rectangle");
-          return EXIT_FAILURE;
+          return PLUS_FAIL;
         }
       }
       break;
@@ -660,172 +1025,633 @@ int main(int argc, char** argv)
       break;
     default:
       {
-        LOG_WARNING("Unknown operation is specified: " << strOperation);
-        return EXIT_FAILURE;
+        LOG_WARNING("Unknown operation is specified: " << params.Operation);
+        return PLUS_FAIL;
       }
   }
 
-
-  //////////////////////////////////////////////////////////////////
   // Convert files to the new file format
-
-  if (!strUpdatedReferenceTransformName.empty())
+  if (!params.UpdatedReferenceTransformName.empty())
   {
-    igsioTransformName referenceTransformName;
-    if (referenceTransformName.SetTransformName(strUpdatedReferenceTransformName.c_str()) != PLUS_SUCCESS)
-    {
-      LOG_ERROR("Reference transform name is invalid: " << strUpdatedReferenceTransformName);
-      return EXIT_FAILURE;
-    }
-
-    for (unsigned int i = 0; i < trackedFrameList->GetNumberOfTrackedFrames(); ++i)
+    if (UpdateReferenceTransform(trackedFrameList, params.UpdatedReferenceTransformName) != PLUS_SUCCESS)
     {
-      igsioTrackedFrame* trackedFrame = trackedFrameList->GetTrackedFrame(i);
-
-      vtkSmartPointer<vtkMatrix4x4> referenceToTrackerMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-      if (trackedFrame->GetFrameTransform(referenceTransformName, referenceToTrackerMatrix) != PLUS_SUCCESS)
-      {
-        LOG_WARNING("Couldn't get reference transform with name: " << strUpdatedReferenceTransformName);
-        continue;
-      }
-
-      std::vector<igsioTransformName> transformNameList;
-      trackedFrame->GetFrameTransformNameList(transformNameList);
-
-      vtkSmartPointer<vtkTransform> toolToTrackerTransform = vtkSmartPointer<vtkTransform>::New();
-      vtkSmartPointer<vtkMatrix4x4> toolToReferenceMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-      for (unsigned int n = 0; n < transformNameList.size(); ++n)
-      {
-        // No need to change the reference transform
-        if (transformNameList[n] == referenceTransformName)
-        {
-          continue;
-        }
-
-        ToolStatus status = TOOL_INVALID;
-        if (trackedFrame->GetFrameTransform(transformNameList[n], toolToReferenceMatrix) != PLUS_SUCCESS)
-        {
-          std::string strTransformName;
-          transformNameList[i].GetTransformName(strTransformName);
-          LOG_ERROR("Failed to get frame transform: " << strTransformName);
-          continue;
-        }
-
-        if (trackedFrame->GetFrameTransformStatus(transformNameList[n], status) != PLUS_SUCCESS)
-        {
-          std::string strTransformName;
-          transformNameList[i].GetTransformName(strTransformName);
-          LOG_ERROR("Failed to get frame transform status: " << strTransformName);
-          continue;
-        }
-
-        // Compute ToolToTracker transform from ToolToReference
-        toolToTrackerTransform->Identity();
-        toolToTrackerTransform->Concatenate(referenceToTrackerMatrix);
-        toolToTrackerTransform->Concatenate(toolToReferenceMatrix);
-
-        // Update the name to ToolToTracker
-        igsioTransformName toolToTracker(transformNameList[n].From().c_str(), "Tracker");
-        // Set the new custom transform
-        if (trackedFrame->SetFrameTransform(toolToTracker, toolToTrackerTransform->GetMatrix()) != PLUS_SUCCESS)
-        {
-          std::string strTransformName;
-          transformNameList[i].GetTransformName(strTransformName);
-          LOG_ERROR("Failed to set frame transform: " << strTransformName);
-          continue;
-        }
-
-        // Use the same status as it was before
-        if (trackedFrame->SetFrameTransformStatus(toolToTracker, status) != PLUS_SUCCESS)
-        {
-          std::string strTransformName;
-          transformNameList[i].GetTransformName(strTransformName);
-          LOG_ERROR("Failed to set frame transform status: " << strTransformName);
-          continue;
-        }
-
-        // Delete old transform and status fields
-        std::string oldTransformName, oldTransformStatus;
-        transformNameList[n].GetTransformName(oldTransformName);
-        // Append Transform to the end of the transform name
-        vtksys::RegularExpression isTransform("Transform$");
-        if (!isTransform.find(oldTransformName))
-        {
-          oldTransformName.append("Transform");
-        }
-        oldTransformStatus = oldTransformName;
-        oldTransformStatus.append("Status");
-        trackedFrame->DeleteFrameField(oldTransformName.c_str());
-        trackedFrame->DeleteFrameField(oldTransformStatus.c_str());
-
-      }
+      return PLUS_FAIL;
     }
   }
 
-  ///////////////////////////////////////////////////////////////////
-  // Save output file to file
-
-  LOG_INFO("Save output sequence file to: " << outputFileName);
-  if (vtkPlusSequenceIO::Write(outputFileName, trackedFrameList, trackedFrameList->GetImageOrientation(), useCompression, operation != REMOVE_IMAGE_DATA) != PLUS_SUCCESS)
-  {
-    LOG_ERROR("Couldn't write sequence file: " << outputFileName);
-    return EXIT_FAILURE;
-  }
-
-  LOG_INFO("Sequence file editing was successful!");
-  return EXIT_SUCCESS;
+  return PLUS_SUCCESS;
 }
 
-//-------------------------------------------------------
-PlusStatus TrimSequenceFile(vtkIGSIOTrackedFrameList* aTrackedFrameList, unsigned int aFirstFrameIndex, unsigned int aLastFrameIndex)
+//----------------------------------------------------------------------------
+// Read, edit, and write the frames in chunks, so that only maxNumberOfFramesInMemory input frames are kept in memory
+PlusStatus EditSequenceFileStreaming(const std::vector<std::string>& inputFileNames, const std::string& outputFileName, SequenceEditParameters& params, bool incrementTimestamps, bool useCompression, unsigned int maxNumberOfFramesInMemory)
 {
-  LOG_INFO("Trim sequence file from frame #: " << aFirstFrameIndex << " to frame #" << aLastFrameIndex);
-  if (aLastFrameIndex >= aTrackedFrameList->GetNumberOfTrackedFrames() || aFirstFrameIndex > aLastFrameIndex)
+  if (inputFileNames.empty())
   {
-    LOG_ERROR("Invalid input range: (" << aFirstFrameIndex << ", " << aLastFrameIndex << ")" << " Permitted range within (0, " << aTrackedFrameList->GetNumberOfTrackedFrames() - 1 << ")");
+    LOG_ERROR("No input sequence file is specified");
     return PLUS_FAIL;
   }
 
-  if (aLastFrameIndex != aTrackedFrameList->GetNumberOfTrackedFrames() - 1)
-  {
-    aTrackedFrameList->RemoveTrackedFrameRange(aLastFrameIndex + 1, aTrackedFrameList->GetNumberOfTrackedFrames() - 1);
-  }
-
-  if (aFirstFrameIndex != 0)
+  // When sequences are mixed then only the first sequence is edited, other sequences just provide fields
+  std::vector<std::string> editedFileNames(inputFileNames);
+  std::vector<StreamedMixSequence> mixedSequences;
+  if (params.Operation == MIX)
   {
-    aTrackedFrameList->RemoveTrackedFrameRange(0, aFirstFrameIndex - 1);
+    editedFileNames.resize(1);
+    mixedSequences.resize(inputFileNames.size() - 1);
+    for (unsigned int i = 1; i < inputFileNames.size(); ++i)
+    {
+      LOG_INFO("Open input sequence file: " << inputFileNames[i]);
+      if (mixedSequences[i - 1].Open(inputFileNames[i], maxNumberOfFramesInMemory) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Couldn't read sequence file: " << inputFileNames[i]);
+        return PLUS_FAIL;
+      }
+    }
   }
 
-  return PLUS_SUCCESS;
-}
-
-//-------------------------------------------------------
-PlusStatus DecimateSequenceFile(vtkIGSIOTrackedFrameList* aTrackedFrameList, unsigned int decimationFactor)
-{
-  LOG_INFO("Decimate sequence file: keep 1 frame out of every " << decimationFactor << " frames");
-  if (decimationFactor < 2)
+  // Compressed MetaImage files cannot be written in chunks (the compressed data size must be known before the pixel data is written)
+  std::string outputExtension = vtksys::SystemTools::LowerCase(vtksys::SystemTools::GetFilenameLastExtension(outputFileName));
+  if (useCompression && (outputExtension == ".mha" || outputExtension == ".mhd"))
   {
-    LOG_ERROR("Invalid decimation factor: " << decimationFactor << ". It must be an integer larger or equal than 2.");
+    LOG_ERROR("Compressed MetaImage output cannot be written in streaming mode: " << outputFileName << ". Remove --use-compression, or --streaming to edit the sequence in memory.");
     return PLUS_FAIL;
   }
-  for (unsigned int i = 0; i < aTrackedFrameList->GetNumberOfTrackedFrames() - 1; i++)
+
+  // Check the trim range before anything is written, the number of frames is available in the file headers
+  if (params.Operation == TRIM)
   {
-    unsigned int removeFirstFrameIndex = i + 1;
-    unsigned int removeLastFrameIndex = i + decimationFactor - 1;
-    if (removeLastFrameIndex >= aTrackedFrameList->GetNumberOfTrackedFrames())
+    unsigned int numberOfFrames = 0;
+    for (std::vector<std::string>::iterator fileNameIt = editedFileNames.begin(); fileNameIt != editedFileNames.end(); ++fileNameIt)
     {
-      removeLastFrameIndex = aTrackedFrameList->GetNumberOfTrackedFrames() - 1;
-      if (removeLastFrameIndex < removeFirstFrameIndex)
+      vtkSmartPointer<vtkPlusSequenceStreamReader> headerReader = vtkSmartPointer<vtkPlusSequenceStreamReader>::New();
+      if (headerReader->Open(*fileNameIt) != PLUS_SUCCESS)
       {
-        removeLastFrameIndex = removeFirstFrameIndex;
+        LOG_ERROR("Couldn't read sequence file: " << (*fileNameIt));
+        return PLUS_FAIL;
       }
+      numberOfFrames += headerReader->GetNumberOfFrames();
+    }
+    if (ValidateTrimRange(params.FirstFrameIndex, params.LastFrameIndex, numberOfFrames) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to trim sequence file");
+      return PLUS_FAIL;
     }
-    aTrackedFrameList->RemoveTrackedFrameRange(removeFirstFrameIndex, removeLastFrameIndex);
   }
-  return PLUS_SUCCESS;
-}
 
-//-------------------------------------------------------
+  LOG_INFO("Save output sequence file to: " << outputFileName);
+  vtkSmartPointer<vtkPlusSequenceStreamWriter> writer = vtkSmartPointer<vtkPlusSequenceStreamWriter>::New();
+  if (writer->Open(outputFileName, useCompression) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Couldn't write sequence file: " << outputFileName);
+    return PLUS_FAIL;
+  }
+
+  vtkSmartPointer<vtkPlusSequenceStreamReader> reader = vtkSmartPointer<vtkPlusSequenceStreamReader>::New();
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> trackedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  unsigned int frameIndexInSequence = 0;
+  double lastTimestamp = 0;
+  for (std::vector<std::string>::iterator fileNameIt = editedFileNames.begin(); fileNameIt != editedFileNames.end(); ++fileNameIt)
+  {
+    LOG_INFO("Read input sequence file: " << (*fileNameIt));
+    if (reader->Open(*fileNameIt) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Couldn't read sequence file: " << (*fileNameIt));
+      return PLUS_FAIL;
+    }
+    if (params.Operation == MIX && reader->GetNumberOfFrames() == 0)
+    {
+      LOG_ERROR("No frames in sequence file: " << (*fileNameIt));
+      return PLUS_FAIL;
+    }
+
+    double lastTimestampInFile = lastTimestamp;
+    while (!reader->IsEndOfSequence())
+    {
+      trackedFrameList->Clear();
+      if (reader->ReadNextFrames(trackedFrameList, maxNumberOfFramesInMemory) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to read frames from " << (*fileNameIt) << " (after frame " << reader->GetNumberOfFramesRead() << ")");
+        return PLUS_FAIL;
+      }
+      unsigned int numberOfFramesRead = trackedFrameList->GetNumberOfTrackedFrames();
+
+      if (incrementTimestamps && params.Operation != MIX)
+      {
+        for (unsigned int f = 0; f < numberOfFramesRead; ++f)
+        {
+          igsioTrackedFrame* tf = trackedFrameList->GetTrackedFrame(f);
+          tf->SetTimestamp(lastTimestamp + tf->GetTimestamp());
+          lastTimestampInFile = tf->GetTimestamp();
+        }
+      }
+
+      for (std::vector<StreamedMixSequence>::iterator mixedSequenceIt = mixedSequences.begin(); mixedSequenceIt != mixedSequences.end(); ++mixedSequenceIt)
+      {
+        for (unsigned int f = 0; f < numberOfFramesRead; ++f)
+        {
+          igsioTrackedFrame* masterTrackedFrame = trackedFrameList->GetTrackedFrame(f);
+          igsioTrackedFrame* additionalFrame = NULL;
+          if (mixedSequenceIt->GetClosestFrame(masterTrackedFrame->GetTimestamp(), additionalFrame) != PLUS_SUCCESS)
+          {
+            return PLUS_FAIL;
+          }
+          if (additionalFrame == NULL)
+          {
+            // Empty sequence
+            break;
+          }
+          CopyFrameFieldsForMix(additionalFrame, masterTrackedFrame);
+        }
+      }
+
+      if (EditTrackedFrameList(trackedFrameList, params, frameIndexInSequence) != PLUS_SUCCESS)
+      {
+        return PLUS_FAIL;
+      }
+      if (writer->WriteFrames(trackedFrameList) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Couldn't write sequence file: " << outputFileName);
+        return PLUS_FAIL;
+      }
+      frameIndexInSequence += numberOfFramesRead;
+      LOG_DEBUG("Processed " << reader->GetNumberOfFramesRead() << " / " << reader->GetNumberOfFrames() << " frames of " << (*fileNameIt));
+    }
+    lastTimestamp = lastTimestampInFile;
+  }
+  trackedFrameList->Clear();
+
+  if (writer->Close() != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Couldn't write sequence file: " << outputFileName);
+    return PLUS_FAIL;
+  }
+  LOG_INFO("Frames read: " << frameIndexInSequence << ", frames written: " << writer->GetNumberOfFramesWritten());
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+// Returns true if the operation only changes fields that are stored in the header of a MetaImage file
+bool IsHeaderOnlyOperation(const SequenceEditParameters& params)
+{
+  if (!params.UpdatedReferenceTransformName.empty() || params.FieldUpdate.FieldName.empty())
+  {
+    return false;
+  }
+  switch (params.Operation)
+  {
+    case UPDATE_FRAME_FIELD_NAME:
+    case DELETE_FRAME_FIELD:
+    case UPDATE_FIELD_NAME:
+    case UPDATE_FIELD_VALUE:
+    case DELETE_FIELD:
+      return true;
+    case UPDATE_FRAME_FIELD_VALUE:
+      // Generated values depend on the frame content
+      return !igsioCommon::IsEqualInsensitive(params.FieldUpdate.UpdatedFieldValue, FIELD_VALUE_FRAME_SCALAR)
+             && !igsioCommon::IsEqualInsensitive(params.FieldUpdate.UpdatedFieldValue, FIELD_VALUE_FRAME_TRANSFORM);
+    default:
+      return false;
+  }
+}
+
+//----------------------------------------------------------------------------
+namespace
+{
+  // Get the frame index and frame field name from a header field name (Seq_Frame0000_FieldName)
+  bool ParseFrameFieldName(const std::string& headerFieldName, int& frameIndex, std::string& frameFieldName)
+  {
+    const size_t prefixLength = strlen(SEQUENCE_FIELD_FRAME_PREFIX);
+    if (headerFieldName.compare(0, prefixLength, SEQUENCE_FIELD_FRAME_PREFIX) != 0)
+    {
+      return false;
+    }
+    size_t frameIndexEnd = headerFieldName.find('_', prefixLength);
+    if (frameIndexEnd == std::string::npos)
+    {
+      return false;
+    }
+    frameIndex = atoi(headerFieldName.substr(prefixLength, frameIndexEnd - prefixLength).c_str());
+    frameFieldName = headerFieldName.substr(frameIndexEnd + 1);
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  std::string GetFrameFieldHeaderName(int frameIndex, const std::string& frameFieldName)
+  {
+    std::ostringstream headerFieldName;
+    headerFieldName << SEQUENCE_FIELD_FRAME_PREFIX << std::setfill('0') << std::setw(4) << frameIndex << "_" << frameFieldName;
+    return headerFieldName.str();
+  }
+
+  //----------------------------------------------------------------------------
+  HeaderFieldList::iterator FindHeaderField(HeaderFieldList& fields, const std::string& name)
+  {
+    for (HeaderFieldList::iterator fieldIt = fields.begin(); fieldIt != fields.end(); ++fieldIt)
+    {
+      if (fieldIt->first == name)
+      {
+        return fieldIt;
+      }
+    }
+    return fields.end();
+  }
+
+  //----------------------------------------------------------------------------
+  bool IsImageHeaderField(const std::string& name)
+  {
+    for (size_t i = 0; i < sizeof(IMAGE_HEADER_FIELD_NAMES) / sizeof(IMAGE_HEADER_FIELD_NAMES[0]); ++i)
+    {
+      if (name == IMAGE_HEADER_FIELD_NAMES[i])
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  //----------------------------------------------------------------------------
+  // Apply the field edit on the header fields. Returns false if the operation cannot be performed on the header only.
+  bool EditHeaderFields(HeaderFieldList& fields, const SequenceEditParameters& params)
+  {
+    const std::string& fieldName = params.FieldUpdate.FieldName;
+    const std::string& updatedFieldName = params.FieldUpdate.UpdatedFieldName;
+    const std::string& updatedFieldValue = params.FieldUpdate.UpdatedFieldValue;
+
+    switch (params.Operation)
+    {
+      case DELETE_FIELD:
+      case UPDATE_FIELD_NAME:
+      case UPDATE_FIELD_VALUE:
+        {
+          if (IsImageHeaderField(fieldName) || IsImageHeaderField(updatedFieldName))
+          {
+            return false;
+          }
+          HeaderFieldList::iterator fieldIt = FindHeaderField(fields, fieldName);
+          if (params.Operation == DELETE_FIELD)
+          {
+            if (fieldIt != fields.end())
+            {
+              fields.erase(fieldIt);
+            }
+          }
+          else if (params.Operation == UPDATE_FIELD_VALUE)
+          {
+            if (fieldIt != fields.end())
+            {
+              fieldIt->second = updatedFieldValue;
+            }
+            else
+            {
+              fields.push_back(std::make_pair(fieldName, updatedFieldValue));
+            }
+          }
+          else if (fieldIt != fields.end())
+          {
+            std::string fieldValue = fieldIt->second;
+            fields.erase(fieldIt);
+            HeaderFieldList::iterator updatedFieldIt = FindHeaderField(fields, updatedFieldName);
+            if (updatedFieldIt != fields.end())
+            {
+              updatedFieldIt->second = fieldValue;
+            }
+            else
+            {
+              fields.push_back(std::make_pair(updatedFieldName, fieldValue));
+            }
+          }
+          return true;
+        }
+      case DELETE_FRAME_FIELD:
+        {
+          HeaderFieldList editedFields;
+          for (HeaderFieldList::iterator fieldIt = fields.begin(); fieldIt != fields.end(); ++fieldIt)
+          {
+            int frameIndex = 0;
+            std::string frameFieldName;
+            if (ParseFrameFieldName(fieldIt->first, frameIndex, frameFieldName) && frameFieldName == fieldName && !fieldIt->second.empty())
+            {
+              continue;
+            }
+            editedFields.push_back(*fieldIt);
+          }
+          fields.swap(editedFields);
+          return true;
+        }
+      case UPDATE_FRAME_FIELD_NAME:
+      case UPDATE_FRAME_FIELD_VALUE:
+        {
+          // Rename the field in all frames
+          if (!updatedFieldName.empty())
+          {
+            for (HeaderFieldList::iterator fieldIt = fields.begin(); fieldIt != fields.end(); ++fieldIt)
+            {
+              int frameIndex = 0;
+              std::string frameFieldName;
+              if (ParseFrameFieldName(fieldIt->first, frameIndex, frameFieldName) && frameFieldName == updatedFieldName)
+              {
+                // Renamed fields would be duplicated
+                return false;
+              }
+            }
+            for (HeaderFieldList::iterator fieldIt = fields.begin(); fieldIt != fields.end(); ++fieldIt)
+            {
+              int frameIndex = 0;
+              std::string frameFieldName;
+              if (ParseFrameFieldName(fieldIt->first, frameIndex, frameFieldName) && frameFieldName == fieldName && !fieldIt->second.empty())
+              {
+                fieldIt->first = GetFrameFieldHeaderName(frameIndex, updatedFieldName);
+              }
+            }
+          }
+          if (params.Operation == UPDATE_FRAME_FIELD_NAME || updatedFieldValue.empty())
+          {
+            return true;
+          }
+
+          // Set the value in all frames
+          const std::string& valueFieldName = updatedFieldName.empty() ? fieldName : updatedFieldName;
+          HeaderFieldList::iterator ndimsIt = FindHeaderField(fields, "NDims");
+          HeaderFieldList::iterator dimSizeIt = FindHeaderField(fields, "DimSize");
+          if (ndimsIt == fields.end() || dimSizeIt == fields.end())
+          {
+            return false;
+          }
+          int numberOfDimensions = atoi(ndimsIt->second.c_str());
+          std::vector<int> dimSize;
+          std::istringstream dimSizeStream(dimSizeIt->second);
+          int size = 0;
+          while (dimSizeStream >> size)
+          {
+            dimSize.push_back(size);
+          }
+          if (numberOfDimensions < 2 || static_cast<int>(dimSize.size()) != numberOfDimensions)
+          {
+            return false;
+          }
+          int numberOfFrames = (numberOfDimensions == 2) ? 1 : dimSize[numberOfDimensions - 1];
+
+          // Position after the last field of each frame, new fields are inserted there
+          std::vector<bool> valueSet(numberOfFrames, false);
+          std::vector<int> frameFieldsEnd(numberOfFrames, -1);
+          for (size_t i = 0; i < fields.size(); ++i)
+          {
+            int frameIndex = 0;
+            std::string frameFieldName;
+            if (!ParseFrameFieldName(fields[i].first, frameIndex, frameFieldName) || frameIndex < 0 || frameIndex >= numberOfFrames)
+            {
+              continue;
+            }
+            frameFieldsEnd[frameIndex] = static_cast<int>(i) + 1;
+            if (frameFieldName == valueFieldName)
+            {
+              fields[i].second = updatedFieldValue;
+              valueSet[frameIndex] = true;
+            }
+          }
+          // Insert from the end, so that the stored positions remain valid
+          for (int frameIndex = numberOfFrames - 1; frameIndex >= 0; --frameIndex)
+          {
+            if (valueSet[frameIndex])
+            {
+              continue;
+            }
+            std::pair<std::string, std::string> field(GetFrameFieldHeaderName(frameIndex, valueFieldName), updatedFieldValue);
+            if (frameFieldsEnd[frameIndex] < 0)
+            {
+              fields.push_back(field);
+            }
+            else
+            {
+              fields.insert(fields.begin() + frameFieldsEnd[frameIndex], field);
+            }
+          }
+          return true;
+        }
+      default:
+        return false;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+// Edit fields of a MetaImage sequence file by rewriting only the header, pixel data is copied without decoding.
+// If the edit requires processing of the frames then headerEdited is set to false and the output is not written.
+PlusStatus EditMetaImageHeader(const std::string& inputFileName, const std::string& outputFileName, const SequenceEditParameters& params, bool useCompression, bool& headerEdited)
+{
+  headerEdited = false;
+
+  std::string outputFilePath = vtkPlusConfig::GetInstance()->GetOutputPath(outputFileName);
+  std::string inputExtension = vtksys::SystemTools::LowerCase(vtksys::SystemTools::GetFilenameLastExtension(inputFileName));
+  std::string outputExtension = vtksys::SystemTools::LowerCase(vtksys::SystemTools::GetFilenameLastExtension(outputFilePath));
+  if ((inputExtension != ".mha" && inputExtension != ".mhd") || (outputExtension != ".mha" && outputExtension != ".mhd"))
+  {
+    return PLUS_SUCCESS;
+  }
+
+  std::string inputFilePath = inputFileName;
+  // If file is not found in the current directory then try to find it in the image directory, too
+  if (!vtksys::SystemTools::FileExists(inputFilePath.c_str(), true) && vtkPlusConfig::GetInstance()->FindImagePath(inputFileName, inputFilePath) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Cannot find sequence file: " << inputFileName);
+    return PLUS_FAIL;
+  }
+  std::ifstream inputFile(inputFilePath.c_str(), std::ios::in | std::ios::binary);
+  if (!inputFile.is_open())
+  {
+    LOG_ERROR("Failed to open sequence file: " << inputFilePath);
+    return PLUS_FAIL;
+  }
+
+  // Read the header, ElementDataFile is the last field, pixel data follows it
+  HeaderFieldList fields;
+  std::string elementDataFile;
+  std::string line;
+  while (std::getline(inputFile, line))
+  {
+    size_t separatorPos = line.find('=');
+    if (separatorPos == std::string::npos)
+    {
+      continue;
+    }
+    std::string name = igsioCommon::Trim(line.substr(0, separatorPos));
+    std::string value = igsioCommon::Trim(line.substr(separatorPos + 1));
+    if (name == "ElementDataFile")
+    {
+      elementDataFile = value;
+      break;
+    }
+    fields.push_back(std::make_pair(name, value));
+  }
+  if (elementDataFile.empty() || elementDataFile == "LIST" || elementDataFile.find('%') != std::string::npos)
+  {
+    LOG_DEBUG("Pixel data location is not supported for header editing in " << inputFilePath << ", frames are processed");
+    return PLUS_SUCCESS;
+  }
+
+  HeaderFieldList::iterator compressedDataIt = FindHeaderField(fields, "CompressedData");
+  bool compressed = (compressedDataIt != fields.end() && STRCASECMP(compressedDataIt->second.c_str(), "True") == 0);
+  if (compressed != useCompression)
+  {
+    LOG_DEBUG("Compression of the output differs from the input, frames are processed");
+    return PLUS_SUCCESS;
+  }
+
+  if (!EditHeaderFields(fields, params))
+  {
+    LOG_DEBUG("Operation cannot be performed by editing the header only, frames are processed");
+    return PLUS_SUCCESS;
+  }
+
+  // Pixel data source
+  std::ifstream inputPixelDataFile;
+  std::istream* inputPixelData = &inputFile;
+  std::string inputPixelDataFilePath;
+  if (elementDataFile != "LOCAL")
+  {
+    inputPixelDataFilePath = elementDataFile;
+    if (!vtksys::SystemTools::FileIsFullPath(inputPixelDataFilePath))
+    {
+      inputPixelDataFilePath = vtksys::SystemTools::GetFilenamePath(inputFilePath) + "/" + elementDataFile;
+    }
+    inputPixelDataFile.open(inputPixelDataFilePath.c_str(), std::ios::in | std::ios::binary);
+    if (!inputPixelDataFile.is_open())
+    {
+      LOG_ERROR("Failed to open pixel data of sequence file: " << inputPixelDataFilePath);
+      return PLUS_FAIL;
+    }
+    inputPixelData = &inputPixelDataFile;
+  }
+
+  // Pixel data destination
+  std::string outputPixelDataFileName = "LOCAL";
+  std::string outputPixelDataFilePath;
+  if (outputExtension == ".mhd")
+  {
+    outputPixelDataFileName = vtksys::SystemTools::GetFilenameWithoutLastExtension(outputFilePath) + (compressed ? ".zraw" : ".raw");
+    outputPixelDataFilePath = vtksys::SystemTools::GetFilenamePath(outputFilePath) + "/" + outputPixelDataFileName;
+    if (!inputPixelDataFilePath.empty() && vtksys::SystemTools::SameFile(inputPixelDataFilePath, outputPixelDataFilePath))
+    {
+      LOG_ERROR("Output pixel data file would overwrite the input pixel data file: " << outputPixelDataFilePath);
+      return PLUS_FAIL;
+    }
+  }
+
+  LOG_INFO("Save output sequence file to: " << outputFileName << " (only the header is edited)");
+  std::ofstream outputFile(outputFilePath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!outputFile.is_open())
+  {
+    LOG_ERROR("Couldn't write sequence file: " << outputFilePath);
+    return PLUS_FAIL;
+  }
+  for (HeaderFieldList::iterator fieldIt = fields.begin(); fieldIt != fields.end(); ++fieldIt)
+  {
+    outputFile << fieldIt->first << " = " << fieldIt->second << "\n";
+  }
+  outputFile << "ElementDataFile = " << outputPixelDataFileName << "\n";
+
+  PlusStatus status = PLUS_SUCCESS;
+  if (outputPixelDataFilePath.empty())
+  {
+    status = CopyStreamContent(*inputPixelData, outputFile);
+  }
+  else
+  {
+    std::ofstream outputPixelDataFile(outputPixelDataFilePath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!outputPixelDataFile.is_open())
+    {
+      LOG_ERROR("Couldn't write pixel data file: " << outputPixelDataFilePath);
+      return PLUS_FAIL;
+    }
+    status = CopyStreamContent(*inputPixelData, outputPixelDataFile);
+  }
+  if (status != PLUS_SUCCESS || !outputFile.good())
+  {
+    LOG_ERROR("Failed to copy pixel data to " << outputFilePath);
+    return PLUS_FAIL;
+  }
+
+  headerEdited = true;
+  return PLUS_SUCCESS;
+}
+
+//-------------------------------------------------------
+PlusStatus ValidateTrimRange(unsigned int aFirstFrameIndex, unsigned int aLastFrameIndex, unsigned int numberOfFrames)
+{
+  if (aLastFrameIndex >= numberOfFrames || aFirstFrameIndex > aLastFrameIndex)
+  {
+    LOG_ERROR("Invalid input range: (" << aFirstFrameIndex << ", " << aLastFrameIndex << ")" << " Permitted range within (0, " << numberOfFrames - 1 << ")");
+    return PLUS_FAIL;
+  }
+  return PLUS_SUCCESS;
+}
+
+//-------------------------------------------------------
+PlusStatus TrimSequenceFile(vtkIGSIOTrackedFrameList* aTrackedFrameList, unsigned int aFirstFrameIndex, unsigned int aLastFrameIndex, unsigned int firstFrameIndexInSequence)
+{
+  unsigned int numberOfFrames = aTrackedFrameList->GetNumberOfTrackedFrames();
+  if (numberOfFrames == 0)
+  {
+    return PLUS_SUCCESS;
+  }
+  if (aFirstFrameIndex > aLastFrameIndex)
+  {
+    LOG_ERROR("Invalid input range: (" << aFirstFrameIndex << ", " << aLastFrameIndex << ")");
+    return PLUS_FAIL;
+  }
+
+  // Frame indices are relative to the whole sequence
+  unsigned int lastFrameIndexInSequence = firstFrameIndexInSequence + numberOfFrames - 1;
+  if (aLastFrameIndex < firstFrameIndexInSequence || aFirstFrameIndex > lastFrameIndexInSequence)
+  {
+    // No frames are kept from this part of the sequence
+    aTrackedFrameList->RemoveTrackedFrameRange(0, numberOfFrames - 1);
+    return PLUS_SUCCESS;
+  }
+
+  if (aLastFrameIndex < lastFrameIndexInSequence)
+  {
+    aTrackedFrameList->RemoveTrackedFrameRange(aLastFrameIndex - firstFrameIndexInSequence + 1, numberOfFrames - 1);
+  }
+
+  if (aFirstFrameIndex > firstFrameIndexInSequence)
+  {
+    aTrackedFrameList->RemoveTrackedFrameRange(0, aFirstFrameIndex - firstFrameIndexInSequence - 1);
+  }
+
+  return PLUS_SUCCESS;
+}
+
+//-------------------------------------------------------
+PlusStatus DecimateSequenceFile(vtkIGSIOTrackedFrameList* aTrackedFrameList, unsigned int decimationFactor, unsigned int firstFrameIndexInSequence)
+{
+  if (decimationFactor < 2)
+  {
+    LOG_ERROR("Invalid decimation factor: " << decimationFactor << ". It must be an integer larger or equal than 2.");
+    return PLUS_FAIL;
+  }
+  // Every N-th frame of the whole sequence is kept. Frames are removed starting from the end of the list,
+  // so that the indices of frames that are not processed yet do not change.
+  int frameIndex = static_cast<int>(aTrackedFrameList->GetNumberOfTrackedFrames()) - 1;
+  while (frameIndex >= 0)
+  {
+    if ((firstFrameIndexInSequence + frameIndex) % decimationFactor == 0)
+    {
+      frameIndex--;
+      continue;
+    }
+    int removeLastFrameIndex = frameIndex;
+    while (frameIndex >= 0 && (firstFrameIndexInSequence + frameIndex) % decimationFactor != 0)
+    {
+      frameIndex--;
+    }
+    aTrackedFrameList->RemoveTrackedFrameRange(frameIndex + 1, removeLastFrameIndex);
+  }
+  return PLUS_SUCCESS;
+}
+
+//-------------------------------------------------------
 PlusStatus DeleteFrameField(vtkIGSIOTrackedFrameList* trackedFrameList, std::string fieldName)
 {
   if (trackedFrameList == NULL)
@@ -840,7 +1666,6 @@ PlusStatus DeleteFrameField(vtkIGSIOTrackedFrameList* trackedFrameList, std::str
     return PLUS_FAIL;
   }
 
-  LOG_INFO("Delete frame field: " << fieldName);
   int numberOfErrors(0);
   for (unsigned int i = 0; i < trackedFrameList->GetNumberOfTrackedFrames(); ++i)
   {
@@ -863,7 +1688,6 @@ PlusStatus DeleteFrameField(vtkIGSIOTrackedFrameList* trackedFrameList, std::str
 //-------------------------------------------------------
 PlusStatus UpdateFrameFieldValue(FrameFieldUpdate& fieldUpdate)
 {
-  LOG_INFO("Update frame field");
   int numberOfErrors(0);
 
   // Set the start scalar value
@@ -963,6 +1787,13 @@ PlusStatus UpdateFrameFieldValue(FrameFieldUpdate& fieldUpdate)
 
   }
 
+  // Store the current values, so that the update can be continued on the next frames of the sequence
+  fieldUpdate.FrameScalarStart = scalarVariable;
+  if (fieldUpdate.FrameTransformStart != NULL && fieldUpdate.FrameTransformIndexFieldName.empty())
+  {
+    fieldUpdate.FrameTransformStart->DeepCopy(frameTransform->GetMatrix());
+  }
+
   return (numberOfErrors == 0 ? PLUS_SUCCESS : PLUS_FAIL);
 }
 
@@ -1061,105 +1892,238 @@ PlusStatus AddTransform(vtkIGSIOTrackedFrameList* trackedFrameList, std::vector<
 }
 
 //-------------------------------------------------------
-PlusStatus FillRectangle(vtkIGSIOTrackedFrameList* trackedFrameList, const std::vector<unsigned int>& fillRectOrigin, const std::vector<unsigned int>& fillRectSize, int fillGrayLevel)
+namespace
 {
-  if (trackedFrameList == NULL)
+  struct FillRectangleParameters
   {
-    LOG_ERROR("Tracked frame list is NULL!");
-    return PLUS_FAIL;
-  }
-  if (fillRectOrigin.size() != 2 || fillRectSize.size() != 2)
-  {
-    LOG_ERROR("Fill rectangle origin or size is not specified correctly");
-    return PLUS_FAIL;
-  }
+    unsigned int Origin[2];
+    unsigned int Size[2];
+    unsigned char FillData;
+  };
 
-  for (unsigned int i = 0; i < trackedFrameList->GetNumberOfTrackedFrames(); ++i)
+  //-------------------------------------------------------
+  void FillRectangleInFrame(igsioTrackedFrame* trackedFrame, unsigned int frameIndex, void* clientData)
   {
-    igsioTrackedFrame* trackedFrame = trackedFrameList->GetTrackedFrame(i);
+    FillRectangleParameters* fill = static_cast<FillRectangleParameters*>(clientData);
     igsioVideoFrame* videoFrame = trackedFrame->GetImageData();
     FrameSizeType frameSize = { 0, 0, 0 };
     if (videoFrame == NULL || videoFrame->GetFrameSize(frameSize) != PLUS_SUCCESS)
     {
-      LOG_ERROR("Failed to retrieve pixel data from frame " << i << ". Fill rectangle failed.");
-      continue;
+      LOG_ERROR("Failed to retrieve pixel data from frame " << frameIndex << ". Fill rectangle failed.");
+      return;
     }
-    if (fillRectOrigin[0] >= frameSize[0] ||
-        fillRectOrigin[1] >= frameSize[1])
+    if (fill->Origin[0] >= frameSize[0] ||
+        fill->Origin[1] >= frameSize[1])
     {
-      LOG_ERROR("Invalid fill rectangle origin is specified (" << fillRectOrigin[0] << ", " << fillRectOrigin[1] << "). The image size is ("
+      LOG_ERROR("Invalid fill rectangle origin is specified (" << fill->Origin[0] << ", " << fill->Origin[1] << "). The image size is ("
                 << frameSize[0] << ", " << frameSize[1] << ").");
-      continue;
+      return;
     }
-    if (fillRectSize[0] <= 0 || fillRectOrigin[0] + fillRectSize[0] > frameSize[0] ||
-        fillRectSize[1] <= 0 || fillRectOrigin[1] + fillRectSize[1] > frameSize[1])
+    if (fill->Size[0] <= 0 || fill->Origin[0] + fill->Size[0] > frameSize[0] ||
+        fill->Size[1] <= 0 || fill->Origin[1] + fill->Size[1] > frameSize[1])
     {
-      LOG_ERROR("Invalid fill rectangle size is specified (" << fillRectSize[0] << ", " << fillRectSize[1] << "). The specified fill rectangle origin is ("
-                << fillRectOrigin[0] << ", " << fillRectOrigin[1] << ") and the image size is (" << frameSize[0] << ", " << frameSize[1] << ").");
-      continue;
+      LOG_ERROR("Invalid fill rectangle size is specified (" << fill->Size[0] << ", " << fill->Size[1] << "). The specified fill rectangle origin is ("
+                << fill->Origin[0] << ", " << fill->Origin[1] << ") and the image size is (" << frameSize[0] << ", " << frameSize[1] << ").");
+      return;
     }
     if (videoFrame->GetVTKScalarPixelType() != VTK_UNSIGNED_CHAR)
     {
       LOG_ERROR("Fill rectangle is supported only for B-mode images (unsigned char type)");
-      continue;
+      return;
     }
-    unsigned char fillData = 0;
-    if (fillGrayLevel < 0)
+    for (unsigned int y = 0; y < fill->Size[1]; y++)
     {
-      fillData = 0;
+      memset(static_cast<unsigned char*>(videoFrame->GetScalarPointer()) + (fill->Origin[1] + y)*frameSize[0] + fill->Origin[0], fill->FillData, fill->Size[0]);
     }
-    else if (fillGrayLevel > 255)
-    {
-      fillData = 255;
-    }
-    else
-    {
-      fillData = fillGrayLevel;
-    }
-    for (unsigned int y = 0; y < fillRectSize[1]; y++)
+  }
+
+  //-------------------------------------------------------
+  struct CropRectangleParameters
+  {
+    igsioVideoFrame::FlipInfoType FlipInfo;
+    std::array<int, 3> Origin;
+    std::array<int, 3> Size;
+    vtkMatrix4x4* ImageToCroppedImageMatrix;
+  };
+
+  //-------------------------------------------------------
+  void CropRectangleInFrame(igsioTrackedFrame* trackedFrame, unsigned int frameIndex, void* clientData)
+  {
+    CropRectangleParameters* crop = static_cast<CropRectangleParameters*>(clientData);
+    igsioVideoFrame* videoFrame = trackedFrame->GetImageData();
+
+    FrameSizeType frameSize = { 0, 0, 0 };
+    if (videoFrame == NULL || videoFrame->GetFrameSize(frameSize) != PLUS_SUCCESS)
     {
-      memset(static_cast<unsigned char*>(videoFrame->GetScalarPointer()) + (fillRectOrigin[1] + y)*frameSize[0] + fillRectOrigin[0], fillData, fillRectSize[0]);
+      LOG_ERROR("Failed to retrieve pixel data from frame " << frameIndex << ". Crop rectangle failed.");
+      return;
     }
+
+    vtkSmartPointer<vtkImageData> croppedImage = vtkSmartPointer<vtkImageData>::New();
+
+    igsioVideoFrame::FlipClipImage(videoFrame->GetImage(), crop->FlipInfo, crop->Origin, crop->Size, croppedImage);
+    videoFrame->DeepCopyFrom(croppedImage);
+    igsioTransformName imageToCroppedImage("Image", "CroppedImage");
+    trackedFrame->SetFrameTransform(imageToCroppedImage, crop->ImageToCroppedImageMatrix);
+    trackedFrame->SetFrameTransformStatus(imageToCroppedImage, TOOL_OK);
   }
+}
+
+//-------------------------------------------------------
+PlusStatus FillRectangle(vtkIGSIOTrackedFrameList* trackedFrameList, const std::vector<unsigned int>& fillRectOrigin, const std::vector<unsigned int>& fillRectSize, int fillGrayLevel, int numberOfThreads)
+{
+  if (trackedFrameList == NULL)
+  {
+    LOG_ERROR("Tracked frame list is NULL!");
+    return PLUS_FAIL;
+  }
+  if (fillRectOrigin.size() != 2 || fillRectSize.size() != 2)
+  {
+    LOG_ERROR("Fill rectangle origin or size is not specified correctly");
+    return PLUS_FAIL;
+  }
+
+  FillRectangleParameters fill;
+  fill.Origin[0] = fillRectOrigin[0];
+  fill.Origin[1] = fillRectOrigin[1];
+  fill.Size[0] = fillRectSize[0];
+  fill.Size[1] = fillRectSize[1];
+  if (fillGrayLevel < 0)
+  {
+    fill.FillData = 0;
+  }
+  else if (fillGrayLevel > 255)
+  {
+    fill.FillData = 255;
+  }
+  else
+  {
+    fill.FillData = fillGrayLevel;
+  }
+
+  // Frames are independent, so they can be processed in parallel
+  ProcessFramesInParallel(trackedFrameList, &FillRectangleInFrame, &fill, numberOfThreads);
   return PLUS_SUCCESS;
 }
 
 //-------------------------------------------------------
-PlusStatus CropRectangle(vtkIGSIOTrackedFrameList* trackedFrameList, igsioVideoFrame::FlipInfoType& flipInfo, const std::vector<int>& cropRectOrigin, const std::vector<int>& cropRectSize)
+PlusStatus CropRectangle(vtkIGSIOTrackedFrameList* trackedFrameList, igsioVideoFrame::FlipInfoType& flipInfo, const std::vector<int>& cropRectOrigin, const std::vector<int>& cropRectSize, int numberOfThreads)
 {
   if (trackedFrameList == NULL)
   {
     LOG_ERROR("Tracked frame list is NULL!");
     return PLUS_FAIL;
   }
-  std::array<int, 3> rectOrigin = { cropRectOrigin[0], cropRectOrigin[1], cropRectOrigin.size() == 3 ? cropRectOrigin[2] : 0 };
-  std::array<int, 3> rectSize = { cropRectSize[0], cropRectSize[1], cropRectSize.size() == 3 ? cropRectSize[2] : 1 };
+
+  CropRectangleParameters crop;
+  crop.FlipInfo = flipInfo;
+  crop.Origin = { cropRectOrigin[0], cropRectOrigin[1], cropRectOrigin.size() == 3 ? cropRectOrigin[2] : 0 };
+  crop.Size = { cropRectSize[0], cropRectSize[1], cropRectSize.size() == 3 ? cropRectSize[2] : 1 };
 
   vtkSmartPointer<vtkMatrix4x4> tfmMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
   tfmMatrix->Identity();
-  tfmMatrix->SetElement(0, 3, -rectOrigin[0]);
-  tfmMatrix->SetElement(1, 3, -rectOrigin[1]);
-  tfmMatrix->SetElement(2, 3, -rectOrigin[2]);
-  igsioTransformName imageToCroppedImage("Image", "CroppedImage");
+  tfmMatrix->SetElement(0, 3, -crop.Origin[0]);
+  tfmMatrix->SetElement(1, 3, -crop.Origin[1]);
+  tfmMatrix->SetElement(2, 3, -crop.Origin[2]);
+  crop.ImageToCroppedImageMatrix = tfmMatrix;
+
+  // Frames are independent, so they can be processed in parallel
+  ProcessFramesInParallel(trackedFrameList, &CropRectangleInFrame, &crop, numberOfThreads);
+  return PLUS_SUCCESS;
+}
+
+//-------------------------------------------------------
+// Update old files by changing all ToolToReference transforms to ToolToTracker transform
+PlusStatus UpdateReferenceTransform(vtkIGSIOTrackedFrameList* trackedFrameList, const std::string& strUpdatedReferenceTransformName)
+{
+  igsioTransformName referenceTransformName;
+  if (referenceTransformName.SetTransformName(strUpdatedReferenceTransformName.c_str()) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Reference transform name is invalid: " << strUpdatedReferenceTransformName);
+    return PLUS_FAIL;
+  }
 
   for (unsigned int i = 0; i < trackedFrameList->GetNumberOfTrackedFrames(); ++i)
   {
     igsioTrackedFrame* trackedFrame = trackedFrameList->GetTrackedFrame(i);
-    igsioVideoFrame* videoFrame = trackedFrame->GetImageData();
 
-    FrameSizeType frameSize = { 0, 0, 0 };
-    if (videoFrame == NULL || videoFrame->GetFrameSize(frameSize) != PLUS_SUCCESS)
+    vtkSmartPointer<vtkMatrix4x4> referenceToTrackerMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    if (trackedFrame->GetFrameTransform(referenceTransformName, referenceToTrackerMatrix) != PLUS_SUCCESS)
     {
-      LOG_ERROR("Failed to retrieve pixel data from frame " << i << ". Crop rectangle failed.");
+      LOG_WARNING("Couldn't get reference transform with name: " << strUpdatedReferenceTransformName);
       continue;
     }
 
-    vtkSmartPointer<vtkImageData> croppedImage = vtkSmartPointer<vtkImageData>::New();
+    std::vector<igsioTransformName> transformNameList;
+    trackedFrame->GetFrameTransformNameList(transformNameList);
 
-    igsioVideoFrame::FlipClipImage(videoFrame->GetImage(), flipInfo, rectOrigin, rectSize, croppedImage);
-    videoFrame->DeepCopyFrom(croppedImage);
-    trackedFrame->SetFrameTransform(imageToCroppedImage, tfmMatrix);
-    trackedFrame->SetFrameTransformStatus(imageToCroppedImage, TOOL_OK);
+    vtkSmartPointer<vtkTransform> toolToTrackerTransform = vtkSmartPointer<vtkTransform>::New();
+    vtkSmartPointer<vtkMatrix4x4> toolToReferenceMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    for (unsigned int n = 0; n < transformNameList.size(); ++n)
+    {
+      // No need to change the reference transform
+      if (transformNameList[n] == referenceTransformName)
+      {
+        continue;
+      }
+
+      ToolStatus status = TOOL_INVALID;
+      if (trackedFrame->GetFrameTransform(transformNameList[n], toolToReferenceMatrix) != PLUS_SUCCESS)
+      {
+        std::string strTransformName;
+        transformNameList[i].GetTransformName(strTransformName);
+        LOG_ERROR("Failed to get frame transform: " << strTransformName);
+        continue;
+      }
+
+      if (trackedFrame->GetFrameTransformStatus(transformNameList[n], status) != PLUS_SUCCESS)
+      {
+        std::string strTransformName;
+        transformNameList[i].GetTransformName(strTransformName);
+        LOG_ERROR("Failed to get frame transform status: " << strTransformName);
+        continue;
+      }
+
+      // Compute ToolToTracker transform from ToolToReference
+      toolToTrackerTransform->Identity();
+      toolToTrackerTransform->Concatenate(referenceToTrackerMatrix);
+      toolToTrackerTransform->Concatenate(toolToReferenceMatrix);
+
+      // Update the name to ToolToTracker
+      igsioTransformName toolToTracker(transformNameList[n].From().c_str(), "Tracker");
+      // Set the new custom transform
+      if (trackedFrame->SetFrameTransform(toolToTracker, toolToTrackerTransform->GetMatrix()) != PLUS_SUCCESS)
+      {
+        std::string strTransformName;
+        transformNameList[i].GetTransformName(strTransformName);
+        LOG_ERROR("Failed to set frame transform: " << strTransformName);
+        continue;
+      }
+
+      // Use the same status as it was before
+      if (trackedFrame->SetFrameTransformStatus(toolToTracker, status) != PLUS_SUCCESS)
+      {
+        std::string strTransformName;
+        transformNameList[i].GetTransformName(strTransformName);
+        LOG_ERROR("Failed to set frame transform status: " << strTransformName);
+        continue;
+      }
+
+      // Delete old transform and status fields
+      std::string oldTransformName, oldTransformStatus;
+      transformNameList[n].GetTransformName(oldTransformName);
+      // Append Transform to the end of the transform name
+      vtksys::RegularExpression isTransform("Transform$");
+      if (!isTransform.find(oldTransformName))
+      {
+        oldTransformName.append("Transform");
+      }
+      oldTransformStatus = oldTransformName;
+      oldTransformStatus.append("Status");
+      trackedFrame->DeleteFrameField(oldTransformName.c_str());
+      trackedFrame->DeleteFrameField(oldTransformStatus.c_str());
+
+    }
   }
 
   return PLUS_SUCCESS;
@@ -0,0 +1,535 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusSequenceIO.h"
+#include "vtkPlusSequenceStreamReader.h"
+
+// IGSIO includes
+#include <igsioTrackedFrame.h>
+#include <igsioVideoFrame.h>
+#include <vtkIGSIOTrackedFrameList.h>
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkObjectFactory.h>
+#include <vtk_zlib.h>
+#include <vtksys/SystemTools.hxx>
+
+// STL includes
+#include <array>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkPlusSequenceStreamReader);
+
+namespace
+{
+  const char SEQUENCE_FIELD_FRAME_PREFIX[] = "Seq_Frame";
+  const size_t COMPRESSED_READ_BUFFER_SIZE = 1024 * 1024;
+
+  //----------------------------------------------------------------------------
+  int GetVtkScalarTypeFromMetaElementType(const std::string& elementType)
+  {
+    if (elementType == "MET_CHAR") { return VTK_CHAR; }
+    if (elementType == "MET_UCHAR") { return VTK_UNSIGNED_CHAR; }
+    if (elementType == "MET_SHORT") { return VTK_SHORT; }
+    if (elementType == "MET_USHORT") { return VTK_UNSIGNED_SHORT; }
+    if (elementType == "MET_INT") { return VTK_INT; }
+    if (elementType == "MET_UINT") { return VTK_UNSIGNED_INT; }
+    if (elementType == "MET_LONG") { return VTK_LONG; }
+    if (elementType == "MET_ULONG") { return VTK_UNSIGNED_LONG; }
+    if (elementType == "MET_FLOAT") { return VTK_FLOAT; }
+    if (elementType == "MET_DOUBLE") { return VTK_DOUBLE; }
+    return VTK_VOID;
+  }
+}
+
+//----------------------------------------------------------------------------
+class vtkPlusSequenceStreamReader::vtkInternal
+{
+public:
+  vtkInternal()
+    : Streaming(false)
+    , NumberOfFrames(0)
+    , NumberOfFramesRead(0)
+    , PixelType(VTK_VOID)
+    , NumberOfScalarComponents(1)
+    , ImageOrientationInFile(US_IMG_ORIENT_MF)
+    , ImageType(US_IMG_BRIGHTNESS)
+    , Compressed(false)
+    , CompressedDataSize(0)
+    , CompressedBytesRead(0)
+    , ZStreamInitialized(false)
+  {
+    this->FrameSize[0] = this->FrameSize[1] = this->FrameSize[2] = 0;
+  }
+
+  void Reset()
+  {
+    if (this->ZStreamInitialized)
+    {
+      inflateEnd(&this->ZStream);
+      this->ZStreamInitialized = false;
+    }
+    if (this->PixelDataFile.is_open())
+    {
+      this->PixelDataFile.close();
+    }
+    this->PixelDataFile.clear();
+    this->Streaming = false;
+    this->NumberOfFrames = 0;
+    this->NumberOfFramesRead = 0;
+    this->CustomFields.clear();
+    this->FrameFields.clear();
+    this->AllFrames = NULL;
+    this->Compressed = false;
+    this->CompressedDataSize = 0;
+    this->CompressedBytesRead = 0;
+  }
+
+  bool Streaming;
+  unsigned int NumberOfFrames;
+  unsigned int NumberOfFramesRead;
+
+  /*! Sequence level fields, in the order they appear in the header */
+  std::vector<std::pair<std::string, std::string> > CustomFields;
+  /*! Frame fields for each frame */
+  std::vector<std::vector<std::pair<std::string, std::string> > > FrameFields;
+
+  FrameSizeType FrameSize;
+  int PixelType;
+  int NumberOfScalarComponents;
+  US_IMAGE_ORIENTATION ImageOrientationInFile;
+  US_IMAGE_TYPE ImageType;
+
+  std::ifstream PixelDataFile;
+  bool Compressed;
+  unsigned long long CompressedDataSize;
+  unsigned long long CompressedBytesRead;
+  z_stream ZStream;
+  bool ZStreamInitialized;
+  std::vector<unsigned char> CompressedReadBuffer;
+
+  /*! Image in file orientation, used if the image has to be reoriented */
+  vtkSmartPointer<vtkImageData> FileOrientedImage;
+
+  /*! Used if the file format does not support reading frames one by one */
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> AllFrames;
+};
+
+//----------------------------------------------------------------------------
+vtkPlusSequenceStreamReader::vtkPlusSequenceStreamReader()
+  : Internal(new vtkInternal)
+{
+}
+
+//----------------------------------------------------------------------------
+vtkPlusSequenceStreamReader::~vtkPlusSequenceStreamReader()
+{
+  this->Close();
+  delete this->Internal;
+  this->Internal = NULL;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusSequenceStreamReader::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "Streaming: " << (this->Internal->Streaming ? "true" : "false") << std::endl;
+  os << indent << "NumberOfFrames: " << this->Internal->NumberOfFrames << std::endl;
+  os << indent << "NumberOfFramesRead: " << this->Internal->NumberOfFramesRead << std::endl;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSequenceStreamReader::Open(const std::string& filename)
+{
+  this->Close();
+
+  std::string filePath = filename;
+  // If file is not found in the current directory then try to find it in the image directory, too
+  if (!vtksys::SystemTools::FileExists(filePath.c_str(), true))
+  {
+    if (vtkPlusConfig::GetInstance()->FindImagePath(filename, filePath) == PLUS_FAIL)
+    {
+      LOG_ERROR("Cannot find sequence file: " << filename);
+      return PLUS_FAIL;
+    }
+  }
+
+  std::string extension = vtksys::SystemTools::LowerCase(vtksys::SystemTools::GetFilenameLastExtension(filePath));
+  if ((extension == ".mha" || extension == ".mhd") && this->ReadMetaImageHeader(filePath) == PLUS_SUCCESS)
+  {
+    this->Internal->Streaming = true;
+    return PLUS_SUCCESS;
+  }
+
+  // Frames cannot be read one by one, read the whole sequence into memory
+  LOG_DEBUG("Sequence file " << filePath << " cannot be read frame by frame, all frames are read into memory");
+  this->Internal->Reset();
+  this->Internal->AllFrames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  if (vtkPlusSequenceIO::Read(filePath, this->Internal->AllFrames) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to read sequence file: " << filePath);
+    this->Internal->AllFrames = NULL;
+    return PLUS_FAIL;
+  }
+  this->Internal->NumberOfFrames = this->Internal->AllFrames->GetNumberOfTrackedFrames();
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusSequenceStreamReader::Close()
+{
+  this->Internal->Reset();
+}
+
+//----------------------------------------------------------------------------
+unsigned int vtkPlusSequenceStreamReader::GetNumberOfFrames()
+{
+  return this->Internal->NumberOfFrames;
+}
+
+//----------------------------------------------------------------------------
+unsigned int vtkPlusSequenceStreamReader::GetNumberOfFramesRead()
+{
+  return this->Internal->NumberOfFramesRead;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusSequenceStreamReader::IsEndOfSequence()
+{
+  return this->Internal->NumberOfFramesRead >= this->Internal->NumberOfFrames;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusSequenceStreamReader::IsStreaming()
+{
+  return this->Internal->Streaming;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSequenceStreamReader::ReadMetaImageHeader(const std::string& filePath)
+{
+  this->Internal->Reset();
+
+  std::ifstream headerFile(filePath.c_str(), std::ios::in | std::ios::binary);
+  if (!headerFile.is_open())
+  {
+    LOG_ERROR("Failed to open sequence file: " << filePath);
+    return PLUS_FAIL;
+  }
+
+  std::map<std::string, std::string> imageFields;
+  std::string elementDataFile;
+  std::string line;
+  while (std::getline(headerFile, line))
+  {
+    size_t separatorPos = line.find('=');
+    if (separatorPos == std::string::npos)
+    {
+      continue;
+    }
+    std::string name = igsioCommon::Trim(line.substr(0, separatorPos));
+    std::string value = igsioCommon::Trim(line.substr(separatorPos + 1));
+
+    if (name.compare(0, strlen(SEQUENCE_FIELD_FRAME_PREFIX), SEQUENCE_FIELD_FRAME_PREFIX) == 0)
+    {
+      // Frame field: Seq_Frame0000_FieldName
+      size_t frameNumberEnd = name.find('_', strlen(SEQUENCE_FIELD_FRAME_PREFIX));
+      if (frameNumberEnd == std::string::npos)
+      {
+        LOG_WARNING("Invalid frame field name in sequence file: " << name);
+        continue;
+      }
+      int frameNumber = atoi(name.substr(strlen(SEQUENCE_FIELD_FRAME_PREFIX), frameNumberEnd - strlen(SEQUENCE_FIELD_FRAME_PREFIX)).c_str());
+      if (frameNumber < 0)
+      {
+        LOG_WARNING("Invalid frame number in sequence file field: " << name);
+        continue;
+      }
+      if (static_cast<size_t>(frameNumber) >= this->Internal->FrameFields.size())
+      {
+        this->Internal->FrameFields.resize(frameNumber + 1);
+      }
+      this->Internal->FrameFields[frameNumber].push_back(std::make_pair(name.substr(frameNumberEnd + 1), value));
+      continue;
+    }
+
+    if (name == "ElementDataFile")
+    {
+      // This is the last field of the header, pixel data follows
+      elementDataFile = value;
+      break;
+    }
+
+    imageFields[name] = value;
+    this->Internal->CustomFields.push_back(std::make_pair(name, value));
+  }
+  if (elementDataFile.empty())
+  {
+    LOG_ERROR("ElementDataFile field is missing in sequence file: " << filePath);
+    return PLUS_FAIL;
+  }
+
+  // Image geometry
+  int numberOfDimensions = atoi(imageFields["NDims"].c_str());
+  std::vector<unsigned int> dimSize;
+  std::istringstream dimSizeStream(imageFields["DimSize"]);
+  unsigned int size = 0;
+  while (dimSizeStream >> size)
+  {
+    dimSize.push_back(size);
+  }
+  if (numberOfDimensions < 2 || numberOfDimensions > 4 || static_cast<int>(dimSize.size()) != numberOfDimensions)
+  {
+    LOG_DEBUG("Unsupported image dimensions in sequence file: NDims=" << imageFields["NDims"] << ", DimSize=" << imageFields["DimSize"]);
+    return PLUS_FAIL;
+  }
+  this->Internal->FrameSize[0] = dimSize[0];
+  this->Internal->FrameSize[1] = dimSize[1];
+  this->Internal->FrameSize[2] = (numberOfDimensions == 4) ? dimSize[2] : 1;
+  this->Internal->NumberOfFrames = (numberOfDimensions == 2) ? 1 : dimSize[numberOfDimensions - 1];
+
+  this->Internal->PixelType = GetVtkScalarTypeFromMetaElementType(imageFields["ElementType"]);
+  if (this->Internal->PixelType == VTK_VOID)
+  {
+    LOG_DEBUG("Unsupported element type in sequence file: " << imageFields["ElementType"]);
+    return PLUS_FAIL;
+  }
+  if (!imageFields["ElementNumberOfChannels"].empty())
+  {
+    this->Internal->NumberOfScalarComponents = atoi(imageFields["ElementNumberOfChannels"].c_str());
+  }
+  if (STRCASECMP(imageFields["BinaryDataByteOrderMSB"].c_str(), "True") == 0)
+  {
+    LOG_DEBUG("Big endian pixel data is not supported by the stream reader");
+    return PLUS_FAIL;
+  }
+
+  if (!imageFields["UltrasoundImageOrientation"].empty())
+  {
+    this->Internal->ImageOrientationInFile = igsioVideoFrame::GetUsImageOrientationFromString(imageFields["UltrasoundImageOrientation"].c_str());
+    if (this->Internal->ImageOrientationInFile == US_IMG_ORIENT_XX)
+    {
+      LOG_DEBUG("Unknown image orientation in sequence file: " << imageFields["UltrasoundImageOrientation"]);
+      return PLUS_FAIL;
+    }
+  }
+  if (!imageFields["UltrasoundImageType"].empty())
+  {
+    this->Internal->ImageType = igsioVideoFrame::GetUsImageTypeFromString(imageFields["UltrasoundImageType"].c_str());
+  }
+
+  // Pixel data
+  this->Internal->Compressed = (STRCASECMP(imageFields["CompressedData"].c_str(), "True") == 0);
+  if (this->Internal->Compressed)
+  {
+    std::istringstream compressedDataSizeStream(imageFields["CompressedDataSize"]);
+    compressedDataSizeStream >> this->Internal->CompressedDataSize;
+  }
+
+  if (elementDataFile == "LOCAL")
+  {
+    std::streamoff pixelDataOffset = headerFile.tellg();
+    headerFile.close();
+    this->Internal->PixelDataFile.open(filePath.c_str(), std::ios::in | std::ios::binary);
+    this->Internal->PixelDataFile.seekg(pixelDataOffset);
+  }
+  else if (elementDataFile == "LIST" || elementDataFile.find('%') != std::string::npos)
+  {
+    LOG_DEBUG("Pixel data file list is not supported by the stream reader");
+    return PLUS_FAIL;
+  }
+  else
+  {
+    std::string pixelDataFilePath = elementDataFile;
+    if (!vtksys::SystemTools::FileIsFullPath(pixelDataFilePath))
+    {
+      pixelDataFilePath = vtksys::SystemTools::GetFilenamePath(filePath) + "/" + elementDataFile;
+    }
+    this->Internal->PixelDataFile.open(pixelDataFilePath.c_str(), std::ios::in | std::ios::binary);
+  }
+  if (!this->Internal->PixelDataFile.is_open() || !this->Internal->PixelDataFile.good())
+  {
+    LOG_ERROR("Failed to open pixel data of sequence file: " << filePath);
+    return PLUS_FAIL;
+  }
+
+  if (this->Internal->Compressed)
+  {
+    memset(&this->Internal->ZStream, 0, sizeof(z_stream));
+    if (inflateInit(&this->Internal->ZStream) != Z_OK)
+    {
+      LOG_ERROR("Failed to initialize decompression of sequence file: " << filePath);
+      return PLUS_FAIL;
+    }
+    this->Internal->ZStreamInitialized = true;
+    this->Internal->CompressedReadBuffer.resize(COMPRESSED_READ_BUFFER_SIZE);
+  }
+
+  this->Internal->FrameFields.resize(this->Internal->NumberOfFrames);
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSequenceStreamReader::ReadFramePixels(unsigned char* buffer, size_t numberOfBytes)
+{
+  if (!this->Internal->Compressed)
+  {
+    this->Internal->PixelDataFile.read(reinterpret_cast<char*>(buffer), numberOfBytes);
+    if (static_cast<size_t>(this->Internal->PixelDataFile.gcount()) != numberOfBytes)
+    {
+      LOG_ERROR("Failed to read pixel data from sequence file (unexpected end of file)");
+      return PLUS_FAIL;
+    }
+    return PLUS_SUCCESS;
+  }
+
+  z_stream& zStream = this->Internal->ZStream;
+  zStream.next_out = buffer;
+  zStream.avail_out = static_cast<uInt>(numberOfBytes);
+  while (zStream.avail_out > 0)
+  {
+    if (zStream.avail_in == 0)
+    {
+      size_t bytesToRead = COMPRESSED_READ_BUFFER_SIZE;
+      if (this->Internal->CompressedDataSize > 0)
+      {
+        bytesToRead = static_cast<size_t>(std::min<unsigned long long>(bytesToRead, this->Internal->CompressedDataSize - this->Internal->CompressedBytesRead));
+      }
+      this->Internal->PixelDataFile.read(reinterpret_cast<char*>(&this->Internal->CompressedReadBuffer[0]), bytesToRead);
+      std::streamsize bytesRead = this->Internal->PixelDataFile.gcount();
+      if (bytesRead <= 0)
+      {
+        LOG_ERROR("Failed to read compressed pixel data from sequence file (unexpected end of file)");
+        return PLUS_FAIL;
+      }
+      this->Internal->CompressedBytesRead += bytesRead;
+      zStream.next_in = &this->Internal->CompressedReadBuffer[0];
+      zStream.avail_in = static_cast<uInt>(bytesRead);
+    }
+    int result = inflate(&zStream, Z_NO_FLUSH);
+    if (result == Z_STREAM_END && zStream.avail_out > 0)
+    {
+      LOG_ERROR("Failed to read compressed pixel data from sequence file (unexpected end of data)");
+      return PLUS_FAIL;
+    }
+    if (result != Z_OK && result != Z_STREAM_END)
+    {
+      LOG_ERROR("Failed to decompress pixel data from sequence file (error code: " << result << ")");
+      return PLUS_FAIL;
+    }
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSequenceStreamReader::ReadNextFrames(vtkIGSIOTrackedFrameList* frameList, unsigned int maxNumberOfFrames)
+{
+  if (frameList == NULL)
+  {
+    LOG_ERROR("vtkPlusSequenceStreamReader::ReadNextFrames failed: invalid frame list");
+    return PLUS_FAIL;
+  }
+  unsigned int firstFrameIndex = this->Internal->NumberOfFramesRead;
+  unsigned int lastFrameIndex = std::min(firstFrameIndex + maxNumberOfFrames, this->Internal->NumberOfFrames);
+
+  if (!this->Internal->Streaming)
+  {
+    if (this->Internal->AllFrames == NULL)
+    {
+      LOG_ERROR("vtkPlusSequenceStreamReader::ReadNextFrames failed: no sequence file is opened");
+      return PLUS_FAIL;
+    }
+    for (unsigned int frameIndex = firstFrameIndex; frameIndex < lastFrameIndex; ++frameIndex)
+    {
+      frameList->AddTrackedFrame(this->Internal->AllFrames->GetTrackedFrame(frameIndex));
+    }
+    std::vector<std::string> fieldNames;
+    this->Internal->AllFrames->GetCustomFieldNameList(fieldNames);
+    for (std::vector<std::string>::iterator it = fieldNames.begin(); it != fieldNames.end(); ++it)
+    {
+      frameList->SetCustomString(it->c_str(), this->Internal->AllFrames->GetCustomString(it->c_str()));
+    }
+    this->Internal->NumberOfFramesRead = lastFrameIndex;
+    return PLUS_SUCCESS;
+  }
+
+  for (std::vector<std::pair<std::string, std::string> >::iterator it = this->Internal->CustomFields.begin(); it != this->Internal->CustomFields.end(); ++it)
+  {
+    frameList->SetCustomString(it->first.c_str(), it->second.c_str());
+  }
+
+  igsioVideoFrame::FlipInfoType flipInfo;
+  if (igsioVideoFrame::GetFlipAxes(this->Internal->ImageOrientationInFile, this->Internal->ImageType, US_IMG_ORIENT_MF, flipInfo) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to convert image data from " << igsioVideoFrame::GetStringFromUsImageOrientation(this->Internal->ImageOrientationInFile) << " to MF orientation");
+    return PLUS_FAIL;
+  }
+  bool reorientationRequired = flipInfo.hFlip || flipInfo.vFlip || flipInfo.eFlip || flipInfo.tranpose != igsioVideoFrame::TRANSPOSE_NONE;
+  size_t frameSizeInBytes = static_cast<size_t>(this->Internal->FrameSize[0]) * this->Internal->FrameSize[1] * this->Internal->FrameSize[2]
+                            * vtkDataArray::GetDataTypeSize(this->Internal->PixelType) * this->Internal->NumberOfScalarComponents;
+  if (reorientationRequired && this->Internal->FileOrientedImage == NULL)
+  {
+    this->Internal->FileOrientedImage = vtkSmartPointer<vtkImageData>::New();
+    this->Internal->FileOrientedImage->SetExtent(0, this->Internal->FrameSize[0] - 1, 0, this->Internal->FrameSize[1] - 1, 0, this->Internal->FrameSize[2] - 1);
+    this->Internal->FileOrientedImage->AllocateScalars(this->Internal->PixelType, this->Internal->NumberOfScalarComponents);
+  }
+  std::array<int, 3> noClipOrigin = { igsioCommon::NO_CLIP, igsioCommon::NO_CLIP, igsioCommon::NO_CLIP };
+  std::array<int, 3> noClipSize = { igsioCommon::NO_CLIP, igsioCommon::NO_CLIP, igsioCommon::NO_CLIP };
+
+  for (unsigned int frameIndex = firstFrameIndex; frameIndex < lastFrameIndex; ++frameIndex)
+  {
+    // Add an empty frame and read the pixel data directly into the frame in the list
+    igsioTrackedFrame emptyFrame;
+    frameList->AddTrackedFrame(&emptyFrame);
+    igsioTrackedFrame* trackedFrame = frameList->GetTrackedFrame(frameList->GetNumberOfTrackedFrames() - 1);
+
+    std::vector<std::pair<std::string, std::string> >& frameFields = this->Internal->FrameFields[frameIndex];
+    for (std::vector<std::pair<std::string, std::string> >::iterator it = frameFields.begin(); it != frameFields.end(); ++it)
+    {
+      trackedFrame->SetFrameField(it->first, it->second);
+      if (it->first == "Timestamp")
+      {
+        trackedFrame->SetTimestamp(atof(it->second.c_str()));
+      }
+    }
+    // Frame fields are not needed anymore
+    std::vector<std::pair<std::string, std::string> >().swap(frameFields);
+
+    igsioVideoFrame* videoFrame = trackedFrame->GetImageData();
+    if (reorientationRequired)
+    {
+      if (this->ReadFramePixels(static_cast<unsigned char*>(this->Internal->FileOrientedImage->GetScalarPointer()), frameSizeInBytes) != PLUS_SUCCESS)
+      {
+        return PLUS_FAIL;
+      }
+      igsioVideoFrame::FlipClipImage(this->Internal->FileOrientedImage, flipInfo, noClipOrigin, noClipSize, videoFrame->GetImage());
+    }
+    else
+    {
+      if (videoFrame->AllocateFrame(this->Internal->FrameSize, this->Internal->PixelType, this->Internal->NumberOfScalarComponents) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to allocate image for frame " << frameIndex);
+        return PLUS_FAIL;
+      }
+      if (this->ReadFramePixels(static_cast<unsigned char*>(videoFrame->GetScalarPointer()), frameSizeInBytes) != PLUS_SUCCESS)
+      {
+        return PLUS_FAIL;
+      }
+    }
+    videoFrame->SetImageOrientation(US_IMG_ORIENT_MF);
+    videoFrame->SetImageType(this->Internal->ImageType);
+    this->Internal->NumberOfFramesRead = frameIndex + 1;
+  }
+
+  return PLUS_SUCCESS;
+}
@@ -0,0 +1,73 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __vtkPlusSequenceStreamReader_h
+#define __vtkPlusSequenceStreamReader_h
+
+#include "vtkPlusCommonExport.h"
+
+#include "PlusCommon.h"
+
+/*!
+  \class vtkPlusSequenceStreamReader
+  \brief Reads a sequence file in chunks of frames
+
+  MetaImage sequence files (uncompressed or compressed, with local or separate pixel data file) are read
+  frame by frame, so only the frames that are currently processed have to be kept in memory. The header
+  (including all frame fields) is read when the file is opened, pixel data is read by ReadNextFrames.
+  Other file formats are read into memory at once by vtkPlusSequenceIO and then returned in chunks.
+
+  Images are returned in MF orientation, as by vtkPlusSequenceIO::Read.
+
+  \ingroup PlusLibCommon
+*/
+class vtkPlusCommonExport vtkPlusSequenceStreamReader : public vtkObject
+{
+public:
+  static vtkPlusSequenceStreamReader* New();
+  vtkTypeMacro(vtkPlusSequenceStreamReader, vtkObject);
+  virtual void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /*! Open a sequence file and read its header */
+  PlusStatus Open(const std::string& filename);
+
+  /*! Close the file. Called automatically when a new file is opened or the reader is deleted. */
+  void Close();
+
+  /*!
+    Read the next frames and append them to the frame list. Custom fields of the sequence are set in the frame list.
+    At most maxNumberOfFrames frames are read (fewer at the end of the sequence).
+  */
+  PlusStatus ReadNextFrames(vtkIGSIOTrackedFrameList* frameList, unsigned int maxNumberOfFrames);
+
+  /*! Total number of frames in the sequence */
+  unsigned int GetNumberOfFrames();
+
+  /*! Number of frames that have been already returned by ReadNextFrames */
+  unsigned int GetNumberOfFramesRead();
+
+  /*! Returns true if all frames have been read */
+  bool IsEndOfSequence();
+
+  /*! Returns true if the file is read frame by frame (false if all frames had to be read into memory at once) */
+  bool IsStreaming();
+
+protected:
+  vtkPlusSequenceStreamReader();
+  virtual ~vtkPlusSequenceStreamReader();
+
+  PlusStatus ReadMetaImageHeader(const std::string& filePath);
+  PlusStatus ReadFramePixels(unsigned char* buffer, size_t numberOfBytes);
+
+  class vtkInternal;
+  vtkInternal* Internal;
+
+private:
+  vtkPlusSequenceStreamReader(const vtkPlusSequenceStreamReader&);  // Not implemented.
+  void operator=(const vtkPlusSequenceStreamReader&);  // Not implemented.
+};
+
+#endif // __vtkPlusSequenceStreamReader_h
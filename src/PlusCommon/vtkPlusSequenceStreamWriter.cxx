@@ -0,0 +1,315 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusSequenceIO.h"
+#include "vtkPlusSequenceStreamWriter.h"
+
+// IGSIO includes
+#include <igsioTrackedFrame.h>
+#include <vtkIGSIOMetaImageSequenceIO.h>
+#include <vtkIGSIOSequenceIO.h>
+#include <vtkIGSIOTrackedFrameList.h>
+
+// VTK includes
+#include <vtkObjectFactory.h>
+
+namespace
+{
+  const int DEFAULT_CHUNK_SIZE = 16;
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkPlusSequenceStreamWriter);
+
+//----------------------------------------------------------------------------
+vtkPlusSequenceStreamWriter::vtkPlusSequenceStreamWriter()
+  : Writer(NULL)
+  , FramesToWrite(vtkSmartPointer<vtkIGSIOTrackedFrameList>::New())
+  , ChunkSize(DEFAULT_CHUNK_SIZE)
+  , UseCompression(false)
+  , WriteOnClose(false)
+  , IsHeaderPrepared(false)
+  , IsData3D(false)
+  , NumberOfFramesToWrite(0)
+  , NumberOfFramesWritten(0)
+  , NumberOfLostFrames(0)
+  , NumberOfBytesWritten(0)
+{
+}
+
+//----------------------------------------------------------------------------
+vtkPlusSequenceStreamWriter::~vtkPlusSequenceStreamWriter()
+{
+  this->Close();
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusSequenceStreamWriter::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "FileName: " << (this->FileName.empty() ? "(none)" : this->FileName) << std::endl;
+  os << indent << "ChunkSize: " << this->ChunkSize << std::endl;
+  os << indent << "UseCompression: " << (this->UseCompression ? "true" : "false") << std::endl;
+  os << indent << "NumberOfFramesToWrite: " << this->NumberOfFramesToWrite << std::endl;
+  os << indent << "NumberOfFramesWritten: " << this->NumberOfFramesWritten << std::endl;
+  os << indent << "NumberOfLostFrames: " << this->NumberOfLostFrames << std::endl;
+  os << indent << "NumberOfBytesWritten: " << this->NumberOfBytesWritten << std::endl;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSequenceStreamWriter::Open(const std::string& filename, bool useCompression /*=false*/)
+{
+  this->Close();
+
+  this->FileName = vtkPlusConfig::GetInstance()->GetOutputPath(filename);
+  this->UseCompression = useCompression;
+  this->NumberOfFramesToWrite = 0;
+  this->NumberOfFramesWritten = 0;
+  this->NumberOfLostFrames = 0;
+  this->NumberOfBytesWritten = 0;
+
+  this->Writer = vtkIGSIOSequenceIO::CreateSequenceHandlerForFile(this->FileName);
+  if (this->Writer == NULL)
+  {
+    LOG_ERROR("Could not create writer for file: " << this->FileName);
+    return PLUS_FAIL;
+  }
+
+  // MetaImage files can only be compressed as a whole
+  this->WriteOnClose = useCompression && vtkIGSIOMetaImageSequenceIO::CanWriteFile(this->FileName);
+  if (this->WriteOnClose)
+  {
+    return PLUS_SUCCESS;
+  }
+
+  this->Writer->SetUseCompression(useCompression);
+  this->Writer->SetTrackedFrameList(this->FramesToWrite);
+  // Need to set the filename before preparing the header, because the pixel data file name depends on the file extension
+  this->Writer->SetFileName(this->FileName);
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSequenceStreamWriter::WriteFrames(vtkIGSIOTrackedFrameList* frameList)
+{
+  if (this->Writer == NULL)
+  {
+    LOG_ERROR("vtkPlusSequenceStreamWriter::WriteFrames failed: no file is opened");
+    return PLUS_FAIL;
+  }
+  if (frameList == NULL || frameList->GetNumberOfTrackedFrames() == 0)
+  {
+    return PLUS_SUCCESS;
+  }
+
+  if (this->NumberOfFramesWritten == 0)
+  {
+    // Custom fields of the sequence are taken from the first frame list
+    std::vector<std::string> fieldNames;
+    frameList->GetCustomFieldNameList(fieldNames);
+    for (std::vector<std::string>::iterator it = fieldNames.begin(); it != fieldNames.end(); ++it)
+    {
+      this->FramesToWrite->SetCustomString(it->c_str(), frameList->GetCustomString(it->c_str()));
+    }
+  }
+
+  if (this->FramesToWrite->AddTrackedFrameList(frameList) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("vtkPlusSequenceStreamWriter::WriteFrames failed: cannot copy frames");
+    return PLUS_FAIL;
+  }
+  for (unsigned int frameIndex = 0; frameIndex < frameList->GetNumberOfTrackedFrames(); ++frameIndex)
+  {
+    this->CountFrame(frameList->GetTrackedFrame(frameIndex));
+  }
+
+  if (this->WriteOnClose)
+  {
+    return PLUS_SUCCESS;
+  }
+  return this->AppendFramesToFile();
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSequenceStreamWriter::TakeTrackedFrame(igsioTrackedFrame* frame)
+{
+  if (this->Writer == NULL)
+  {
+    LOG_ERROR("vtkPlusSequenceStreamWriter::TakeTrackedFrame failed: no file is opened");
+    delete frame;
+    return PLUS_FAIL;
+  }
+
+  this->CountFrame(frame);
+  this->FramesToWrite->TakeTrackedFrame(frame);
+
+  if (this->WriteOnClose || static_cast<int>(this->FramesToWrite->GetNumberOfTrackedFrames()) < this->ChunkSize)
+  {
+    return PLUS_SUCCESS;
+  }
+  return this->AppendFramesToFile();
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusSequenceStreamWriter::AddLostFrame()
+{
+  ++this->NumberOfLostFrames;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusSequenceStreamWriter::CountFrame(igsioTrackedFrame* frame)
+{
+  if (frame->GetImageData()->IsImageValid())
+  {
+    this->NumberOfBytesWritten += frame->GetImageData()->GetFrameSizeInBytes();
+  }
+  ++this->NumberOfFramesWritten;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSequenceStreamWriter::AppendFramesToFile()
+{
+  if (this->FramesToWrite->GetNumberOfTrackedFrames() == 0)
+  {
+    return PLUS_SUCCESS;
+  }
+
+  PlusStatus status = PLUS_SUCCESS;
+  if (!this->IsHeaderPrepared)
+  {
+    if (this->Writer->PrepareHeader() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to prepare header of " << this->FileName);
+      status = PLUS_FAIL;
+    }
+    else
+    {
+      this->IsHeaderPrepared = true;
+      this->IsData3D = (this->FramesToWrite->GetTrackedFrame(0)->GetFrameSize()[2] > 1);
+    }
+  }
+
+  if (status == PLUS_SUCCESS && this->Writer->AppendImagesToHeader() != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to append image data to header of " << this->FileName);
+    status = PLUS_FAIL;
+  }
+  if (status == PLUS_SUCCESS && this->Writer->WriteImages() != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to append images to " << this->FileName);
+    status = PLUS_FAIL;
+  }
+
+  // Only the pixel data of the frames is released, custom fields are kept for the header
+  this->FramesToWrite->RemoveTrackedFrameRange(0, this->FramesToWrite->GetNumberOfTrackedFrames() - 1);
+  return status;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSequenceStreamWriter::Close()
+{
+  if (this->Writer == NULL)
+  {
+    return PLUS_SUCCESS;
+  }
+
+  PlusStatus status = PLUS_SUCCESS;
+  if (this->WriteOnClose)
+  {
+    if (this->FramesToWrite->GetNumberOfTrackedFrames() > 0
+        && vtkPlusSequenceIO::Write(this->FileName, this->FramesToWrite, this->FramesToWrite->GetImageOrientation(), this->UseCompression) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to write " << this->FileName);
+      status = PLUS_FAIL;
+    }
+  }
+  else
+  {
+    if (this->AppendFramesToFile() != PLUS_SUCCESS)
+    {
+      status = PLUS_FAIL;
+    }
+    if (this->IsHeaderPrepared)
+    {
+      // Fix the header to write the correct number of frames
+      this->Writer->UpdateDimensionsCustomStrings(static_cast<int>(this->NumberOfFramesWritten), this->IsData3D);
+      this->Writer->UpdateFieldInImageHeader(this->Writer->GetDimensionSizeString());
+      this->Writer->UpdateFieldInImageHeader(this->Writer->GetDimensionKindsString());
+      if (this->Writer->FinalizeHeader() != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to finalize header of " << this->FileName);
+        status = PLUS_FAIL;
+      }
+    }
+    this->Writer->Close();
+  }
+  this->Writer->Delete();
+  this->Writer = NULL;
+
+  this->FramesToWrite->Clear();
+  this->WriteOnClose = false;
+  this->IsHeaderPrepared = false;
+  this->IsData3D = false;
+  return status;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusSequenceStreamWriter::Discard()
+{
+  if (this->Writer == NULL)
+  {
+    return;
+  }
+
+  if (!this->WriteOnClose && this->IsHeaderPrepared)
+  {
+    this->Writer->Discard();
+  }
+  this->Writer->Delete();
+  this->Writer = NULL;
+
+  this->FramesToWrite->Clear();
+  this->WriteOnClose = false;
+  this->IsHeaderPrepared = false;
+  this->IsData3D = false;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkPlusSequenceStreamWriter::GetFileName() const
+{
+  return this->FileName;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusSequenceStreamWriter::SetNumberOfFramesToWrite(unsigned long long numberOfFrames)
+{
+  this->NumberOfFramesToWrite = numberOfFrames;
+}
+
+//----------------------------------------------------------------------------
+unsigned long long vtkPlusSequenceStreamWriter::GetNumberOfFramesToWrite() const
+{
+  return this->NumberOfFramesToWrite;
+}
+
+//----------------------------------------------------------------------------
+unsigned long long vtkPlusSequenceStreamWriter::GetNumberOfFramesWritten() const
+{
+  return this->NumberOfFramesWritten;
+}
+
+//----------------------------------------------------------------------------
+unsigned long long vtkPlusSequenceStreamWriter::GetNumberOfLostFrames() const
+{
+  return this->NumberOfLostFrames;
+}
+
+//----------------------------------------------------------------------------
+unsigned long long vtkPlusSequenceStreamWriter::GetNumberOfBytesWritten() const
+{
+  return this->NumberOfBytesWritten;
+}
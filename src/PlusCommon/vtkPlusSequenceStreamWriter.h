@@ -0,0 +1,119 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __vtkPlusSequenceStreamWriter_h
+#define __vtkPlusSequenceStreamWriter_h
+
+#include "vtkPlusCommonExport.h"
+
+#include "PlusCommon.h"
+
+// STL includes
+#include <atomic>
+
+class igsioTrackedFrame;
+class vtkIGSIOSequenceIOBase;
+
+/*!
+  \class vtkPlusSequenceStreamWriter
+  \brief Writes a sequence file in chunks of frames
+
+  Frames are appended to the file by WriteFrames, or one by one by TakeTrackedFrame, so the complete sequence never has to be kept in memory.
+  The header is finalized (number of frames updated) when the file is closed.
+  Relative file paths are interpreted relative to the output directory, as by vtkPlusSequenceIO::Write.
+
+  MetaImage files cannot be compressed incrementally. If compression is requested for a MetaImage file then the frames
+  are kept in memory and the file is written by vtkPlusSequenceIO::Write when it is closed.
+
+  Frames are added and the file is closed by a single thread, but the progress counters can be read from any thread
+  while the file is being written.
+
+  \ingroup PlusLibCommon
+*/
+class vtkPlusCommonExport vtkPlusSequenceStreamWriter : public vtkObject
+{
+public:
+  static vtkPlusSequenceStreamWriter* New();
+  vtkTypeMacro(vtkPlusSequenceStreamWriter, vtkObject);
+  virtual void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /*!
+    Create the sequence file. The progress counters of the previous file are reset.
+  */
+  PlusStatus Open(const std::string& filename, bool useCompression = false);
+
+  /*!
+    Append frames to the file. Custom fields of the sequence are taken from the frame list that is written first.
+    The frame list is not modified.
+  */
+  PlusStatus WriteFrames(vtkIGSIOTrackedFrameList* frameList);
+
+  /*!
+    Add a frame to the file. The writer takes ownership of the frame.
+    Frames are collected and appended to the file when ChunkSize frames are collected.
+  */
+  PlusStatus TakeTrackedFrame(igsioTrackedFrame* frame);
+
+  /*! Report a frame that was expected but could not be written (e.g., overwritten in a buffer before it could be read) */
+  void AddLostFrame();
+
+  /*! Finalize the header and close the file. Called automatically when the writer is deleted. */
+  PlusStatus Close();
+
+  /*! Close the file without finalizing it and delete the partially written file */
+  void Discard();
+
+  /*! Full path of the currently open file (or of the last file if it is closed already) */
+  std::string GetFileName() const;
+
+  /*! Number of frames collected by TakeTrackedFrame before they are appended to the file */
+  vtkSetClampMacro(ChunkSize, int, 1, VTK_INT_MAX);
+  vtkGetMacro(ChunkSize, int);
+
+  /*! Number of frames that are expected to be written into the current file, only used for progress reporting */
+  void SetNumberOfFramesToWrite(unsigned long long numberOfFrames);
+  unsigned long long GetNumberOfFramesToWrite() const;
+
+  /*! Number of frames added to the current file (including the frames that are not appended to the file yet) */
+  unsigned long long GetNumberOfFramesWritten() const;
+
+  /*! Number of frames that were reported lost by AddLostFrame */
+  unsigned long long GetNumberOfLostFrames() const;
+
+  /*! Uncompressed size of the image data of the frames added to the current file */
+  unsigned long long GetNumberOfBytesWritten() const;
+
+protected:
+  vtkPlusSequenceStreamWriter();
+  virtual ~vtkPlusSequenceStreamWriter();
+
+  /*! Update the progress counters with a frame that is added to the file */
+  void CountFrame(igsioTrackedFrame* frame);
+
+  /*! Append the collected frames to the file */
+  PlusStatus AppendFramesToFile();
+
+  vtkIGSIOSequenceIOBase* Writer;
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> FramesToWrite;
+  std::string FileName;
+  int ChunkSize;
+  bool UseCompression;
+  /*! If true then the frames are kept in memory and the whole file is written when it is closed */
+  bool WriteOnClose;
+  bool IsHeaderPrepared;
+  bool IsData3D;
+
+  std::atomic<unsigned long long> NumberOfFramesToWrite;
+  std::atomic<unsigned long long> NumberOfFramesWritten;
+  std::atomic<unsigned long long> NumberOfLostFrames;
+  std::atomic<unsigned long long> NumberOfBytesWritten;
+
+private:
+  vtkPlusSequenceStreamWriter(const vtkPlusSequenceStreamWriter&);  // Not implemented.
+  void operator=(const vtkPlusSequenceStreamWriter&);  // Not implemented.
+};
+
+#endif // __vtkPlusSequenceStreamWriter_h
@@ -7,14 +7,40 @@ See License.txt for details.
 #include "PlusConfigure.h"
 
 #include "vtkPlusFakeTracker.h"
+#include "vtkMath.h"
 #include "vtkMatrix4x4.h"
 #include "vtkMinimalStandardRandomSequence.h"
 #include "vtkObjectFactory.h"
+#include "vtkPlusChannel.h"
 #include "vtkPlusDataSource.h"
 #include "vtkTransform.h"
 
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
 vtkStandardNewMacro(vtkPlusFakeTracker);
 
+namespace
+{
+  /*!
+    Deterministic pseudo-random number in [0, 1) for a trajectory parameter of a Stress mode tool.
+    A hash (splitmix64 finalizer) is used instead of a random sequence so that any parameter
+    can be computed directly, without storing per-tool state.
+  */
+  double GetStressParameter(int seed, int toolIndex, int parameterIndex)
+  {
+    vtkTypeUInt64 x = (static_cast<vtkTypeUInt64>(static_cast<vtkTypeUInt32>(seed)) << 32)
+                      ^ (static_cast<vtkTypeUInt64>(static_cast<vtkTypeUInt32>(toolIndex)) << 8)
+                      ^ static_cast<vtkTypeUInt64>(parameterIndex);
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    x = x ^ (x >> 31);
+    return static_cast<double>(x >> 11) / 9007199254740992.0; // 53 bits to [0, 1)
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkPlusFakeTracker::vtkPlusFakeTracker()
   : Frame(0)
@@ -23,7 +49,17 @@ vtkPlusFakeTracker::vtkPlusFakeTracker()
   , TransformRepository(NULL)
   , RandomSeed(0)
   , Counter(-1)
+  , ConnectDelaySec(0.0)
   , PhantomLandmarks(NULL)
+  , NumberOfStressTools(0)
+  , StressRandomSeed(1)
+  , StressToolMatrix(vtkMatrix4x4::New())
+  , StressStartTime(0.0)
+  , StressSampleRate(0.0)
+  , LastStressSampleIndex(-1)
+  , NumberOfStressSamples(0)
+  , NumberOfDroppedStressSamples(0)
+  , NumberOfRejectedStressItems(0)
 {
   vtkSmartPointer<vtkPoints> phantomLandmarks = vtkSmartPointer<vtkPoints>::New();
   this->SetPhantomLandmarks(phantomLandmarks);
@@ -39,6 +75,7 @@ vtkPlusFakeTracker::vtkPlusFakeTracker()
 vtkPlusFakeTracker::~vtkPlusFakeTracker()
 {
   this->InternalTransform->Delete();
+  this->StressToolMatrix->Delete();
 
   // Remove reference from the transform repository
   this->SetTransformRepository(NULL);
@@ -59,6 +96,11 @@ PlusStatus vtkPlusFakeTracker::InternalConnect()
 {
   LOG_TRACE("vtkPlusFakeTracker::InternalConnect");
 
+  if (this->ConnectDelaySec > 0)
+  {
+    vtkIGSIOAccurateTimer::Delay(this->ConnectDelaySec);
+  }
+
   vtkPlusDataSource* tool = NULL;
   switch (this->Mode)
   {
@@ -214,6 +256,22 @@ PlusStatus vtkPlusFakeTracker::InternalConnect()
 
   this->Counter = 0;
 
+  break;
+  case (FakeTrackerMode_Stress):
+  {
+    // The tool container is ordered by ID, which makes the tool indices (and so the trajectories) reproducible
+    this->StressTools.clear();
+    for (DataSourceContainerConstIterator it = this->GetToolIteratorBegin(); it != this->GetToolIteratorEnd(); ++it)
+    {
+      this->StressTools.push_back(it->second);
+    }
+    if (this->StressTools.empty())
+    {
+      LOG_ERROR("No tools are defined for FakeTracker in Stress mode, please add tools or set NumberOfStressTools in config file: " << vtkPlusConfig::GetInstance()->GetDeviceSetConfigurationFileName());
+      return PLUS_FAIL;
+    }
+    LOG_INFO("FakeTracker Stress mode: " << this->StressTools.size() << " tools at " << this->GetAcquisitionRate() << " Hz (seed: " << this->StressRandomSeed << ")");
+  }
   break;
   default:
     break;
@@ -228,7 +286,9 @@ PlusStatus vtkPlusFakeTracker::InternalDisconnect()
 {
   LOG_TRACE("vtkPlusFakeTracker::InternalDisconnect");
 
-  return this->StopRecording();
+  PlusStatus status = this->StopRecording();
+  this->StressTools.clear();
+  return status;
 }
 
 //----------------------------------------------------------------------------
@@ -246,6 +306,15 @@ PlusStatus vtkPlusFakeTracker::InternalStartRecording()
 
   this->RandomSeed = 0;
 
+  // The Stress mode sample clock starts at the first update
+  this->StressStartTime = 0.0;
+  this->StressSampleRate = 0.0;
+  this->LastStressSampleIndex = -1;
+  this->NumberOfStressSamples = 0;
+  this->NumberOfDroppedStressSamples = 0;
+  this->NumberOfRejectedStressItems = 0;
+  this->StressLatencyHistogram.Reset();
+
   return PLUS_SUCCESS;
 }
 
@@ -254,6 +323,12 @@ PlusStatus vtkPlusFakeTracker::InternalStopRecording()
 {
   LOG_TRACE("vtkPlusFakeTracker::InternalStopRecording");
 
+  if (this->Mode == FakeTrackerMode_Stress)
+  {
+    LOG_INFO(this->GetStressReport());
+    LOG_INFO("FakeTracker capture timing: " << this->GetCaptureTimingReport());
+  }
+
   return PLUS_SUCCESS;
 }
 
@@ -268,6 +343,12 @@ PlusStatus vtkPlusFakeTracker::InternalUpdate()
     return PLUS_SUCCESS;
   }
 
+  if (this->Mode == FakeTrackerMode_Stress)
+  {
+    // Stress mode has its own sample clock, it does not use the frame counter
+    return this->InternalUpdateStress();
+  }
+
   if (this->Frame++ > 355559)
   {
     this->Frame = 0;
@@ -596,12 +677,27 @@ PlusStatus vtkPlusFakeTracker::ReadConfiguration(vtkXMLDataElement* rootConfigEl
       {
         this->SetMode(FakeTrackerMode_ToolState);
       }
+      else if (STRCASECMP(mode, "Stress") == 0)
+      {
+        this->SetMode(FakeTrackerMode_Stress);
+      }
       else
       {
         this->SetMode(FakeTrackerMode_Undefined);
       }
     }
 
+    XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(double, ConnectDelaySec, deviceConfig);
+
+    // Stress mode
+    XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, NumberOfStressTools, deviceConfig);
+    XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, StressRandomSeed, deviceConfig);
+    if (this->Mode == FakeTrackerMode_Stress && this->CreateStressTools() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to create tools for FakeTracker in Stress mode");
+      return PLUS_FAIL;
+    }
+
     // Read landmarks for RecordPhantomLandmarks mode
     bool phantomLandmarksFound = true;
     vtkXMLDataElement* landmarks = NULL;
@@ -667,3 +763,166 @@ PlusStatus vtkPlusFakeTracker::ReadConfiguration(vtkXMLDataElement* rootConfigEl
 
   return PLUS_SUCCESS;
 }
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusFakeTracker::CreateStressTools()
+{
+  if (this->NumberOfStressTools < 0)
+  {
+    LOG_ERROR("Invalid NumberOfStressTools: " << this->NumberOfStressTools << ". It must not be negative.");
+    return PLUS_FAIL;
+  }
+
+  // Generated tools use the buffer size of the configured tools, so that the memory usage can be set in the config file
+  int bufferSize = -1;
+  if (this->GetToolIteratorBegin() != this->GetToolIteratorEnd())
+  {
+    bufferSize = this->GetToolIteratorBegin()->second->GetBufferSize();
+  }
+
+  for (int toolIndex = 0; toolIndex < this->NumberOfStressTools; ++toolIndex)
+  {
+    std::ostringstream toolName;
+    toolName << "Stress" << std::setw(3) << std::setfill('0') << toolIndex;
+    igsioTransformName toolToReferenceName(toolName.str(), this->GetToolReferenceFrameName());
+    vtkPlusDataSource* existingTool = NULL;
+    if (this->GetTool(toolToReferenceName.GetTransformName(), existingTool) == PLUS_SUCCESS)
+    {
+      // already created (configuration is read again) or defined in the config file
+      continue;
+    }
+
+    vtkSmartPointer<vtkPlusDataSource> tool = vtkSmartPointer<vtkPlusDataSource>::New();
+    tool->SetReferenceCoordinateFrameName(this->GetToolReferenceFrameName());
+    tool->SetId(toolToReferenceName.GetTransformName());
+    tool->SetType(DATA_SOURCE_TYPE_TOOL);
+    tool->SetPortName(toolName.str());
+    if (bufferSize > 0)
+    {
+      tool->SetBufferSize(bufferSize);
+    }
+    if (this->AddTool(tool) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to add generated tool " << toolToReferenceName.GetTransformName() << " to FakeTracker");
+      return PLUS_FAIL;
+    }
+    for (ChannelContainerIterator channelIt = this->GetOutputChannelsStart(); channelIt != this->GetOutputChannelsEnd(); ++channelIt)
+    {
+      (*channelIt)->AddTool(tool);
+    }
+  }
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusFakeTracker::InternalUpdateStress()
+{
+  const double sampleRate = this->GetAcquisitionRate();
+  if (sampleRate <= 0)
+  {
+    LOG_ERROR("Invalid acquisition rate for FakeTracker in Stress mode: " << sampleRate);
+    return PLUS_FAIL;
+  }
+
+  const double currentTime = vtkIGSIOAccurateTimer::GetSystemTime();
+  if (sampleRate != this->StressSampleRate)
+  {
+    if (this->LastStressSampleIndex < 0)
+    {
+      this->StressStartTime = currentTime;
+    }
+    else
+    {
+      // Acquisition rate has been changed: restart the clock so that the last sample keeps its time and index
+      double lastSampleTime = this->StressStartTime + this->LastStressSampleIndex / this->StressSampleRate;
+      this->StressStartTime = lastSampleTime - this->LastStressSampleIndex / sampleRate;
+    }
+    this->StressSampleRate = sampleRate;
+  }
+
+  long long sampleIndex = static_cast<long long>(std::floor((currentTime - this->StressStartTime) * sampleRate));
+  if (sampleIndex <= this->LastStressSampleIndex)
+  {
+    // the next sample is not due yet
+    return PLUS_SUCCESS;
+  }
+  if (sampleIndex > this->LastStressSampleIndex + 1)
+  {
+    // only the latest sample is generated, the missed ones are reported as dropped
+    this->NumberOfDroppedStressSamples += static_cast<unsigned long long>(sampleIndex - this->LastStressSampleIndex - 1);
+  }
+  this->LastStressSampleIndex = sampleIndex;
+
+  const double sampleTime = this->StressStartTime + sampleIndex / sampleRate;
+  const double trajectoryTime = sampleIndex / sampleRate;
+  const unsigned long frameNumber = static_cast<unsigned long>(sampleIndex);
+  for (int toolIndex = 0; toolIndex < static_cast<int>(this->StressTools.size()); ++toolIndex)
+  {
+    vtkPlusDataSource* tool = this->StressTools[toolIndex];
+    GetStressToolToTrackerMatrix(this->StressRandomSeed, toolIndex, trajectoryTime, this->StressToolMatrix);
+    // Sample time is exact, so timestamp filtering is not needed
+    if (tool->AddTimeStampedItem(this->StressToolMatrix, TOOL_OK, frameNumber, sampleTime, sampleTime) != PLUS_SUCCESS)
+    {
+      this->NumberOfRejectedStressItems++;
+    }
+    tool->SetFrameNumber(frameNumber);
+  }
+
+  this->NumberOfStressSamples++;
+  this->StressLatencyHistogram.RecordValue(vtkIGSIOAccurateTimer::GetSystemTime() - sampleTime);
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusFakeTracker::GetStressToolToTrackerMatrix(int seed, int toolIndex, double timeSec, vtkMatrix4x4* toolToTrackerMatrix)
+{
+  // Each tool oscillates around a center in a 400mm cube (5-50mm amplitude, 0.1-2Hz on each axis)
+  // and rotates about two axes at up to 90 deg/s
+  double position[3] = { 0 };
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    double center = -200.0 + 400.0 * GetStressParameter(seed, toolIndex, axis);
+    double amplitude = 5.0 + 45.0 * GetStressParameter(seed, toolIndex, 3 + axis);
+    double frequencyHz = 0.1 + 1.9 * GetStressParameter(seed, toolIndex, 6 + axis);
+    double phase = 2.0 * vtkMath::Pi() * GetStressParameter(seed, toolIndex, 9 + axis);
+    position[axis] = center + amplitude * sin(2.0 * vtkMath::Pi() * frequencyHz * timeSec + phase);
+  }
+  double angleZ = vtkMath::RadiansFromDegrees(-90.0 + 180.0 * GetStressParameter(seed, toolIndex, 12)) * timeSec;
+  double angleX = vtkMath::RadiansFromDegrees(-90.0 + 180.0 * GetStressParameter(seed, toolIndex, 13)) * timeSec;
+  double cz = cos(angleZ);
+  double sz = sin(angleZ);
+  double cx = cos(angleX);
+  double sx = sin(angleX);
+
+  // Rotation = RotZ * RotX
+  toolToTrackerMatrix->SetElement(0, 0, cz);
+  toolToTrackerMatrix->SetElement(0, 1, -sz * cx);
+  toolToTrackerMatrix->SetElement(0, 2, sz * sx);
+  toolToTrackerMatrix->SetElement(1, 0, sz);
+  toolToTrackerMatrix->SetElement(1, 1, cz * cx);
+  toolToTrackerMatrix->SetElement(1, 2, -cz * sx);
+  toolToTrackerMatrix->SetElement(2, 0, 0.0);
+  toolToTrackerMatrix->SetElement(2, 1, sx);
+  toolToTrackerMatrix->SetElement(2, 2, cx);
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    toolToTrackerMatrix->SetElement(axis, 3, position[axis]);
+    toolToTrackerMatrix->SetElement(3, axis, 0.0);
+  }
+  toolToTrackerMatrix->SetElement(3, 3, 1.0);
+}
+
+//----------------------------------------------------------------------------
+std::string vtkPlusFakeTracker::GetStressReport() const
+{
+  unsigned long long numberOfSamplePeriods = this->NumberOfStressSamples + this->NumberOfDroppedStressSamples;
+  std::ostringstream report;
+  report << "FakeTracker stress statistics: " << this->StressTools.size() << " tools at " << this->StressSampleRate << " Hz, "
+         << this->NumberOfStressSamples << " samples generated, "
+         << this->NumberOfDroppedStressSamples << " sample periods dropped ("
+         << std::fixed << std::setprecision(2) << (numberOfSamplePeriods > 0 ? 100.0 * this->NumberOfDroppedStressSamples / numberOfSamplePeriods : 0.0) << "%), "
+         << this->NumberOfRejectedStressItems << " tool items rejected by the buffers. Sample latency: "
+         << this->StressLatencyHistogram.GetSummary();
+  return report.str();
+}
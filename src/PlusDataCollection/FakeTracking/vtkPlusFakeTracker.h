@@ -13,6 +13,9 @@ See License.txt for details.
 #include "vtkIGSIOTransformRepository.h"
 #include "vtkIGSIOTrackedFrameList.h"
 #include "vtkPoints.h"
+#include "PlusLatencyHistogram.h"
+
+#include <vector>
 
 /*! Fake tracker modes */
 enum FakeTrackerMode
@@ -23,9 +26,12 @@ enum FakeTrackerMode
   FakeTrackerMode_SmoothTranslation,
   FakeTrackerMode_PivotCalibration,
   FakeTrackerMode_RecordPhantomLandmarks,
-  FakeTrackerMode_ToolState
+  FakeTrackerMode_ToolState,
+  FakeTrackerMode_Stress
 };
 
+class vtkMatrix4x4;
+class vtkPlusDataSource;
 class vtkTransform;
 
 /*!
@@ -36,6 +42,16 @@ This class represents a fake tracking system with tools that have
 predetermined behavior. This allows someone who doesn't have access to
 a tracking system to test code that relies on having one active.
 
+In Stress mode the tracker is a load generator: all tools (the configured ones plus
+NumberOfStressTools generated "StressNNN" tools) move along smooth, seeded pseudo-random
+trajectories at AcquisitionRate (up to several kHz). Samples are scheduled on a fixed clock
+started at StartRecording: the pose and the timestamp of a sample only depend on StressRandomSeed,
+the tool index and the sample index, so the generated data is reproducible. Sample periods that
+the capture thread could not serve are counted as dropped (the frame number of each item is its
+sample index, so gaps are visible downstream as well), and the delay between the nominal sample
+time and the time the sample is in the buffers is recorded. The statistics are logged when
+recording is stopped.
+
 \ingroup PlusLibDataCollection
 */
 class vtkPlusDataCollectionExport vtkPlusFakeTracker : public vtkPlusDevice
@@ -61,6 +77,11 @@ public:
 
   virtual bool IsTracker() const { return true; }
 
+  /*! Set delay of connection (in seconds), for simulating devices that are slow to connect */
+  vtkSetMacro(ConnectDelaySec, double);
+  /*! Get delay of connection (in seconds) */
+  vtkGetMacro(ConnectDelaySec, double);
+
   /*! Set counter value used for translating landmark points */
   vtkSetMacro(Counter, int);
 
@@ -72,6 +93,35 @@ public:
   /*! Get the phantom landmark points positions */
   vtkGetObjectMacro(PhantomLandmarks, vtkPoints);
 
+  /*! Set the number of tools that are generated in Stress mode in addition to the configured ones */
+  vtkSetMacro(NumberOfStressTools, int);
+  /*! Get the number of tools that are generated in Stress mode in addition to the configured ones */
+  vtkGetMacro(NumberOfStressTools, int);
+
+  /*! Set the seed of the tool trajectories in Stress mode */
+  vtkSetMacro(StressRandomSeed, int);
+  /*! Get the seed of the tool trajectories in Stress mode */
+  vtkGetMacro(StressRandomSeed, int);
+
+  /*! Number of samples generated in Stress mode since recording started */
+  unsigned long long GetNumberOfStressSamples() const { return this->NumberOfStressSamples; }
+  /*! Number of sample periods skipped in Stress mode because the capture thread could not keep up */
+  unsigned long long GetNumberOfDroppedStressSamples() const { return this->NumberOfDroppedStressSamples; }
+  /*! Number of tool items that the buffers rejected in Stress mode */
+  unsigned long long GetNumberOfRejectedStressItems() const { return this->NumberOfRejectedStressItems; }
+  /*! Delay between the nominal time of the Stress mode samples and the time they were added to the buffers */
+  const PlusLatencyHistogram& GetStressLatencyHistogram() const { return this->StressLatencyHistogram; }
+  /*! Human-readable summary of the Stress mode statistics */
+  std::string GetStressReport() const;
+
+  /*!
+    Compute the deterministic pose of a tool in Stress mode
+    \param seed Seed of the trajectories (StressRandomSeed)
+    \param toolIndex Index of the tool (tools are ordered by their ID)
+    \param timeSec Time elapsed since the start of recording (sample index divided by the acquisition rate)
+  */
+  static void GetStressToolToTrackerMatrix(int seed, int toolIndex, double timeSec, vtkMatrix4x4* toolToTrackerMatrix);
+
 protected:
   /*! Set the phantom landmark points positions */
   vtkSetObjectMacro(PhantomLandmarks, vtkPoints);
@@ -86,6 +136,12 @@ protected:
   /*! Get an update from the tracking system and push the new transforms to the tools. */
   PlusStatus InternalUpdate();
 
+  /*! Generate the samples of Stress mode that are due */
+  PlusStatus InternalUpdateStress();
+
+  /*! Add the generated tools of Stress mode to the device and to all its output channels */
+  PlusStatus CreateStressTools();
+
   vtkPlusFakeTracker();
   ~vtkPlusFakeTracker();
 
@@ -108,11 +164,38 @@ protected:
   /*! Stores counter value used for translating landmark points */
   int Counter;
 
+  /*! Time spent in InternalConnect, for simulating slow hardware initialization */
+  double ConnectDelaySec;
+
   /*!
     Point array holding the defined phantom landmarks from the configuration file.
     Need for setting up RecordPhantomLandmarks mode
   */
   vtkPoints* PhantomLandmarks;
+
+  /*! Number of tools that are generated in Stress mode in addition to the configured ones */
+  int NumberOfStressTools;
+
+  /*! Seed of the tool trajectories in Stress mode */
+  int StressRandomSeed;
+
+  /*! Tools that are updated in Stress mode, ordered by ID. The index in this list is the tool index of the trajectory. */
+  std::vector<vtkPlusDataSource*> StressTools;
+
+  /*! Pose of the current Stress mode sample, reused between updates */
+  vtkMatrix4x4* StressToolMatrix;
+
+  /*! System time of sample 0 in Stress mode */
+  double StressStartTime;
+  /*! Rate of the Stress mode sample clock, the clock is restarted if the acquisition rate changes */
+  double StressSampleRate;
+  /*! Index of the last generated sample in Stress mode (-1 if none yet) */
+  long long LastStressSampleIndex;
+
+  unsigned long long NumberOfStressSamples;
+  unsigned long long NumberOfDroppedStressSamples;
+  unsigned long long NumberOfRejectedStressItems;
+  PlusLatencyHistogram StressLatencyHistogram;
 };
 
 
@@ -0,0 +1,438 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+
+#include "vtkObjectFactory.h"
+#include "vtkPlusDataSource.h"
+#include "vtkPlusFakeVideoSource.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+vtkStandardNewMacro(vtkPlusFakeVideoSource);
+
+namespace
+{
+  /*! Number of frames after which the scrolling pattern repeats */
+  const int PATTERN_SCROLL_ROWS = 64;
+
+  /*! Number of bytes of the frame that hold the sequence number */
+  const size_t SEQUENCE_NUMBER_SIZE = 8;
+
+  struct PixelTypeName
+  {
+    igsioCommon::VTKScalarPixelType PixelType;
+    const char* Name;
+  };
+
+  const PixelTypeName PIXEL_TYPE_NAMES[] =
+  {
+    { VTK_UNSIGNED_CHAR, "UNSIGNED_CHAR" },
+    { VTK_CHAR, "CHAR" },
+    { VTK_UNSIGNED_SHORT, "UNSIGNED_SHORT" },
+    { VTK_SHORT, "SHORT" },
+    { VTK_UNSIGNED_INT, "UNSIGNED_INT" },
+    { VTK_INT, "INT" },
+    { VTK_FLOAT, "FLOAT" },
+    { VTK_DOUBLE, "DOUBLE" }
+  };
+
+  //----------------------------------------------------------------------------
+  /*! Fill the pattern with seeded noise (values between 0 and 255 for all pixel types, so floating-point frames contain valid numbers) */
+  template<class ScalarType>
+  void FillNoisePattern(ScalarType* pattern, size_t numberOfScalars, int seed)
+  {
+    vtkTypeUInt32 state = static_cast<vtkTypeUInt32>(seed) * 2654435761u + 1;
+    if (state == 0)
+    {
+      // xorshift state must not be 0
+      state = 1;
+    }
+    for (size_t i = 0; i < numberOfScalars; ++i)
+    {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      pattern[i] = static_cast<ScalarType>(state & 0xFF);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkPlusFakeVideoSource::vtkPlusFakeVideoSource()
+  : PixelType(VTK_UNSIGNED_CHAR)
+  , NumberOfScalarComponents(1)
+  , RandomSeed(1)
+  , VideoSource(NULL)
+  , FrameSizeInBytes(0)
+  , RowSizeInBytes(0)
+  , StartTime(0.0)
+  , FrameRate(0.0)
+  , LastFrameIndex(-1)
+  , NumberOfGeneratedFrames(0)
+  , NumberOfDroppedFrames(0)
+  , NumberOfRejectedFrames(0)
+{
+  this->FrameSize[0] = 640;
+  this->FrameSize[1] = 480;
+  this->FrameSize[2] = 1;
+
+  this->RequireImageOrientationInConfiguration = true;
+
+  // No callback function provided by the device, so the data capture thread will be used to poll the hardware and add new items to the buffer
+  this->StartThreadForInternalUpdates = true;
+  this->AcquisitionRate = 30;
+}
+
+//----------------------------------------------------------------------------
+vtkPlusFakeVideoSource::~vtkPlusFakeVideoSource()
+{
+  if (this->Connected)
+  {
+    this->Disconnect();
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusFakeVideoSource::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "FrameSize: " << this->FrameSize[0] << " " << this->FrameSize[1] << " " << this->FrameSize[2] << std::endl;
+  os << indent << "PixelType: " << GetPixelTypeAsString(this->PixelType) << std::endl;
+  os << indent << "NumberOfScalarComponents: " << this->NumberOfScalarComponents << std::endl;
+  os << indent << "RandomSeed: " << this->RandomSeed << std::endl;
+  os << indent << "NumberOfGeneratedFrames: " << this->NumberOfGeneratedFrames << std::endl;
+  os << indent << "NumberOfDroppedFrames: " << this->NumberOfDroppedFrames << std::endl;
+  os << indent << "NumberOfRejectedFrames: " << this->NumberOfRejectedFrames << std::endl;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusFakeVideoSource::SetFrameSize(const FrameSizeType& frameSize)
+{
+  this->FrameSize = frameSize;
+}
+
+//----------------------------------------------------------------------------
+FrameSizeType vtkPlusFakeVideoSource::GetFrameSize() const
+{
+  return this->FrameSize;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusFakeVideoSource::InternalConnect()
+{
+  LOG_TRACE("vtkPlusFakeVideoSource::InternalConnect");
+
+  this->VideoSource = NULL;
+  if (this->GetFirstVideoSource(this->VideoSource) != PLUS_SUCCESS || this->VideoSource == NULL)
+  {
+    LOG_ERROR("Unable to retrieve the video source in the FakeVideo device: " << this->GetDeviceId());
+    return PLUS_FAIL;
+  }
+  if (this->FrameSize[0] == 0 || this->FrameSize[1] == 0 || this->FrameSize[2] == 0)
+  {
+    LOG_ERROR("Invalid FakeVideo frame size: " << this->FrameSize[0] << " " << this->FrameSize[1] << " " << this->FrameSize[2] << ". All components must be positive.");
+    return PLUS_FAIL;
+  }
+  int bytesPerScalar = igsioVideoFrame::GetNumberOfBytesPerScalar(this->PixelType);
+  if (bytesPerScalar <= 0 || this->NumberOfScalarComponents < 1)
+  {
+    LOG_ERROR("Invalid FakeVideo pixel format (pixel type: " << this->PixelType << ", number of scalar components: " << this->NumberOfScalarComponents << ")");
+    return PLUS_FAIL;
+  }
+
+  this->VideoSource->Clear();
+  this->VideoSource->SetInputFrameSize(this->FrameSize);
+  this->VideoSource->SetPixelType(this->PixelType);
+  this->VideoSource->SetNumberOfScalarComponents(this->NumberOfScalarComponents);
+
+  this->RowSizeInBytes = static_cast<size_t>(this->FrameSize[0]) * this->NumberOfScalarComponents * bytesPerScalar;
+  this->FrameSizeInBytes = this->RowSizeInBytes * this->FrameSize[1] * this->FrameSize[2];
+
+  // The pattern is generated once, frames are copied from it at a scroll position that depends on the frame index
+  this->Pattern.resize(this->FrameSizeInBytes + PATTERN_SCROLL_ROWS * this->RowSizeInBytes);
+  size_t numberOfPatternScalars = this->Pattern.size() / bytesPerScalar;
+  void* patternPtr = &this->Pattern[0];
+  switch (this->PixelType)
+  {
+    vtkTemplateMacro(FillNoisePattern(static_cast<VTK_TT*>(patternPtr), numberOfPatternScalars, this->RandomSeed));
+  default:
+    LOG_ERROR("Unsupported FakeVideo pixel type: " << this->PixelType);
+    return PLUS_FAIL;
+  }
+  this->StagingFrame.resize(this->FrameSizeInBytes);
+
+  LOG_INFO("FakeVideo device " << this->GetDeviceId() << ": " << this->FrameSize[0] << "x" << this->FrameSize[1] << "x" << this->FrameSize[2]
+           << " " << GetPixelTypeAsString(this->PixelType) << " x" << this->NumberOfScalarComponents << " frames ("
+           << this->FrameSizeInBytes << " bytes) at " << this->GetAcquisitionRate() << " Hz");
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusFakeVideoSource::InternalDisconnect()
+{
+  LOG_TRACE("vtkPlusFakeVideoSource::InternalDisconnect");
+  this->VideoSource = NULL;
+  std::vector<unsigned char>().swap(this->Pattern);
+  std::vector<unsigned char>().swap(this->StagingFrame);
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusFakeVideoSource::InternalStartRecording()
+{
+  // The frame clock starts at the first update
+  this->StartTime = 0.0;
+  this->FrameRate = 0.0;
+  this->LastFrameIndex = -1;
+  this->NumberOfGeneratedFrames = 0;
+  this->NumberOfDroppedFrames = 0;
+  this->NumberOfRejectedFrames = 0;
+  this->FrameLatencyHistogram.Reset();
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusFakeVideoSource::InternalStopRecording()
+{
+  LOG_INFO(this->GetFrameGenerationReport());
+  LOG_INFO("FakeVideo capture timing: " << this->GetCaptureTimingReport());
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusFakeVideoSource::InternalUpdate()
+{
+  if (!this->IsRecording() || this->VideoSource == NULL)
+  {
+    return PLUS_SUCCESS;
+  }
+
+  const double frameRate = this->GetAcquisitionRate();
+  if (frameRate <= 0)
+  {
+    LOG_ERROR("Invalid acquisition rate for FakeVideo device: " << frameRate);
+    return PLUS_FAIL;
+  }
+
+  const double currentTime = vtkIGSIOAccurateTimer::GetSystemTime();
+  if (frameRate != this->FrameRate)
+  {
+    if (this->LastFrameIndex < 0)
+    {
+      this->StartTime = currentTime;
+    }
+    else
+    {
+      // Acquisition rate has been changed: restart the clock so that the last frame keeps its time and index
+      double lastFrameTime = this->StartTime + this->LastFrameIndex / this->FrameRate;
+      this->StartTime = lastFrameTime - this->LastFrameIndex / frameRate;
+    }
+    this->FrameRate = frameRate;
+  }
+
+  long long frameIndex = static_cast<long long>(std::floor((currentTime - this->StartTime) * frameRate));
+  if (frameIndex <= this->LastFrameIndex)
+  {
+    // the next frame is not due yet
+    return PLUS_SUCCESS;
+  }
+  if (frameIndex > this->LastFrameIndex + 1)
+  {
+    // only the latest frame is generated, the missed ones are reported as dropped
+    this->NumberOfDroppedFrames += static_cast<unsigned long long>(frameIndex - this->LastFrameIndex - 1);
+  }
+  this->LastFrameIndex = frameIndex;
+  const double frameTime = this->StartTime + frameIndex / frameRate;
+  this->FrameNumber = static_cast<unsigned long>(frameIndex);
+
+  // Write the frame directly into the buffer if possible, frame time is exact so timestamp filtering is not needed
+  PlusStatus status = PLUS_FAIL;
+  void* frameData = NULL;
+  US_IMAGE_ORIENTATION orientation = this->VideoSource->GetInputImageOrientation();
+  US_IMAGE_TYPE imageType = this->VideoSource->GetImageType();
+  if (this->VideoSource->ReserveItem(orientation, this->FrameSize, this->PixelType, this->NumberOfScalarComponents, imageType, frameData) == PLUS_SUCCESS)
+  {
+    this->GenerateFrame(frameIndex, frameData);
+    status = this->VideoSource->CommitReservedItem(this->FrameNumber, frameTime, frameTime);
+  }
+  else
+  {
+    this->GenerateFrame(frameIndex, &this->StagingFrame[0]);
+    status = this->VideoSource->AddItem(&this->StagingFrame[0], orientation, this->FrameSize, this->PixelType, this->NumberOfScalarComponents,
+                                        imageType, 0, this->FrameNumber, frameTime, frameTime);
+  }
+  if (status != PLUS_SUCCESS)
+  {
+    this->NumberOfRejectedFrames++;
+  }
+
+  this->NumberOfGeneratedFrames++;
+  this->FrameLatencyHistogram.RecordValue(vtkIGSIOAccurateTimer::GetSystemTime() - frameTime);
+  this->Modified();
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusFakeVideoSource::GenerateFrame(long long frameIndex, void* frameData) const
+{
+  size_t scrollOffset = static_cast<size_t>(frameIndex % PATTERN_SCROLL_ROWS) * this->RowSizeInBytes;
+  memcpy(frameData, &this->Pattern[scrollOffset], this->FrameSizeInBytes);
+  EmbedSequenceNumber(static_cast<vtkTypeUInt64>(frameIndex), frameData, this->FrameSizeInBytes);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusFakeVideoSource::EmbedSequenceNumber(vtkTypeUInt64 sequenceNumber, void* frameData, size_t frameSizeInBytes)
+{
+  unsigned char* bytes = static_cast<unsigned char*>(frameData);
+  size_t numberOfBytes = std::min(frameSizeInBytes, SEQUENCE_NUMBER_SIZE);
+  for (size_t i = 0; i < numberOfBytes; ++i)
+  {
+    bytes[i] = static_cast<unsigned char>((sequenceNumber >> (8 * i)) & 0xFF);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkTypeUInt64 vtkPlusFakeVideoSource::GetEmbeddedSequenceNumber(const void* frameData, size_t frameSizeInBytes)
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>(frameData);
+  size_t numberOfBytes = std::min(frameSizeInBytes, SEQUENCE_NUMBER_SIZE);
+  vtkTypeUInt64 sequenceNumber = 0;
+  for (size_t i = 0; i < numberOfBytes; ++i)
+  {
+    sequenceNumber |= static_cast<vtkTypeUInt64>(bytes[i]) << (8 * i);
+  }
+  return sequenceNumber;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkPlusFakeVideoSource::GetFrameGenerationReport() const
+{
+  unsigned long long numberOfFramePeriods = this->NumberOfGeneratedFrames + this->NumberOfDroppedFrames;
+  std::ostringstream report;
+  report << "FakeVideo statistics (" << this->GetDeviceId() << "): " << this->FrameSizeInBytes << " byte frames at " << this->FrameRate << " Hz, "
+         << this->NumberOfGeneratedFrames << " frames generated, "
+         << this->NumberOfDroppedFrames << " frame periods dropped ("
+         << std::fixed << std::setprecision(2) << (numberOfFramePeriods > 0 ? 100.0 * this->NumberOfDroppedFrames / numberOfFramePeriods : 0.0) << "%), "
+         << this->NumberOfRejectedFrames << " frames rejected by the buffer. Frame latency: "
+         << this->FrameLatencyHistogram.GetSummary();
+  return report.str();
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusFakeVideoSource::GetPixelTypeFromString(const char* pixelTypeStr, igsioCommon::VTKScalarPixelType& pixelType)
+{
+  if (pixelTypeStr == NULL)
+  {
+    return PLUS_FAIL;
+  }
+  for (size_t i = 0; i < sizeof(PIXEL_TYPE_NAMES) / sizeof(PIXEL_TYPE_NAMES[0]); ++i)
+  {
+    if (STRCASECMP(pixelTypeStr, PIXEL_TYPE_NAMES[i].Name) == 0)
+    {
+      pixelType = PIXEL_TYPE_NAMES[i].PixelType;
+      return PLUS_SUCCESS;
+    }
+  }
+  return PLUS_FAIL;
+}
+
+//----------------------------------------------------------------------------
+const char* vtkPlusFakeVideoSource::GetPixelTypeAsString(igsioCommon::VTKScalarPixelType pixelType)
+{
+  for (size_t i = 0; i < sizeof(PIXEL_TYPE_NAMES) / sizeof(PIXEL_TYPE_NAMES[0]); ++i)
+  {
+    if (PIXEL_TYPE_NAMES[i].PixelType == pixelType)
+    {
+      return PIXEL_TYPE_NAMES[i].Name;
+    }
+  }
+  return "UNKNOWN";
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusFakeVideoSource::ReadConfiguration(vtkXMLDataElement* rootConfigElement)
+{
+  LOG_TRACE("vtkPlusFakeVideoSource::ReadConfiguration");
+  XML_FIND_DEVICE_ELEMENT_REQUIRED_FOR_READING(deviceConfig, rootConfigElement);
+
+  int frameSize[3] = { static_cast<int>(this->FrameSize[0]), static_cast<int>(this->FrameSize[1]), static_cast<int>(this->FrameSize[2]) };
+  int numberOfFrameSizeComponents = deviceConfig->GetVectorAttribute("FrameSize", 3, frameSize);
+  if (numberOfFrameSizeComponents > 0)
+  {
+    if (numberOfFrameSizeComponents == 2)
+    {
+      // 2D frame size is specified
+      frameSize[2] = 1;
+    }
+    if (numberOfFrameSizeComponents < 2 || frameSize[0] <= 0 || frameSize[1] <= 0 || frameSize[2] <= 0)
+    {
+      LOG_ERROR("Invalid FrameSize attribute in FakeVideo device configuration. Expected 2 or 3 positive values.");
+      return PLUS_FAIL;
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+      this->FrameSize[i] = static_cast<unsigned int>(frameSize[i]);
+    }
+  }
+
+  const char* pixelTypeStr = deviceConfig->GetAttribute("PixelType");
+  if (pixelTypeStr != NULL && GetPixelTypeFromString(pixelTypeStr, this->PixelType) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Invalid PixelType attribute in FakeVideo device configuration: " << pixelTypeStr
+              << ". Valid values: UNSIGNED_CHAR, CHAR, UNSIGNED_SHORT, SHORT, UNSIGNED_INT, INT, FLOAT, DOUBLE.");
+    return PLUS_FAIL;
+  }
+
+  int numberOfScalarComponents = 0;
+  if (deviceConfig->GetScalarAttribute("NumberOfScalarComponents", numberOfScalarComponents))
+  {
+    if (numberOfScalarComponents < 1)
+    {
+      LOG_ERROR("Invalid NumberOfScalarComponents attribute in FakeVideo device configuration: " << numberOfScalarComponents);
+      return PLUS_FAIL;
+    }
+    this->NumberOfScalarComponents = static_cast<unsigned int>(numberOfScalarComponents);
+  }
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, RandomSeed, deviceConfig);
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusFakeVideoSource::WriteConfiguration(vtkXMLDataElement* rootConfigElement)
+{
+  XML_FIND_DEVICE_ELEMENT_REQUIRED_FOR_WRITING(deviceConfig, rootConfigElement);
+
+  int frameSize[3] = { static_cast<int>(this->FrameSize[0]), static_cast<int>(this->FrameSize[1]), static_cast<int>(this->FrameSize[2]) };
+  deviceConfig->SetVectorAttribute("FrameSize", 3, frameSize);
+  deviceConfig->SetAttribute("PixelType", GetPixelTypeAsString(this->PixelType));
+  deviceConfig->SetIntAttribute("NumberOfScalarComponents", static_cast<int>(this->NumberOfScalarComponents));
+  deviceConfig->SetIntAttribute("RandomSeed", this->RandomSeed);
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusFakeVideoSource::NotifyConfigured()
+{
+  if (this->GetNumberOfVideoSources() < 1)
+  {
+    LOG_ERROR("FakeVideo device " << this->GetDeviceId() << " requires a video data source. Cannot proceed.");
+    this->SetCorrectlyConfigured(false);
+    return PLUS_FAIL;
+  }
+  if (this->OutputChannels.empty())
+  {
+    LOG_ERROR("No output channels defined for FakeVideo device " << this->GetDeviceId() << ". Cannot proceed.");
+    this->SetCorrectlyConfigured(false);
+    return PLUS_FAIL;
+  }
+  return PLUS_SUCCESS;
+}
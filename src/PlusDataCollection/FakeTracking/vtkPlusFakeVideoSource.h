@@ -0,0 +1,167 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __vtkPlusFakeVideoSource_h
+#define __vtkPlusFakeVideoSource_h
+
+#include "vtkPlusDataCollectionExport.h"
+
+#include "vtkPlusDevice.h"
+#include "PlusLatencyHistogram.h"
+
+#include <vector>
+
+class vtkPlusDataSource;
+
+/*!
+\class vtkPlusFakeVideoSource
+\brief Synthetic video source for load testing
+
+Generates frames of configurable size (2D images or 3D volumes), pixel type and number of
+scalar components at AcquisitionRate, without any hardware. It is the video counterpart of
+vtkPlusFakeTracker in Stress mode, for benchmarking buffers, channels, recording and the
+OpenIGTLink server.
+
+The image content is a seeded noise pattern that scrolls by one row per frame (so encoders
+and change detectors see moving content). The sample index of each frame is written into the
+first 8 bytes of the frame (little-endian, see GetEmbeddedSequenceNumber) and is also used as
+the frame number, so receivers can detect lost frames. The embedded number can only be found at
+the beginning of the frame if the data source does not clip or reorient the images.
+
+Frames are scheduled on a fixed clock started at StartRecording. Frame periods that the capture
+thread could not serve are counted as dropped, and the delay between the nominal frame time and
+the time the frame is in the buffer is recorded. The statistics are logged when recording is stopped.
+
+Example configuration:
+\code
+<Device Id="VideoDevice" Type="FakeVideo" AcquisitionRate="100" FrameSize="256 256 64" PixelType="UNSIGNED_CHAR" NumberOfScalarComponents="1" RandomSeed="1">
+  <DataSources>
+    <DataSource Type="Video" Id="Video" PortUsImageOrientation="MF" BufferSize="50" />
+  </DataSources>
+  <OutputChannels>
+    <OutputChannel Id="VideoStream" VideoDataSourceId="Video" />
+  </OutputChannels>
+</Device>
+\endcode
+
+\ingroup PlusLibDataCollection
+*/
+class vtkPlusDataCollectionExport vtkPlusFakeVideoSource : public vtkPlusDevice
+{
+public:
+  static vtkPlusFakeVideoSource* New();
+  vtkTypeMacro(vtkPlusFakeVideoSource, vtkPlusDevice);
+  virtual void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /*! Read configuration from xml data */
+  virtual PlusStatus ReadConfiguration(vtkXMLDataElement* config);
+  /*! Write configuration to xml data */
+  virtual PlusStatus WriteConfiguration(vtkXMLDataElement* config);
+
+  /*! Verify the device is correctly configured */
+  virtual PlusStatus NotifyConfigured();
+
+  virtual bool IsTracker() const { return false; }
+
+  /*! Set the size of the generated frames in pixels (the third component is the number of slices) */
+  void SetFrameSize(const FrameSizeType& frameSize);
+  /*! Get the size of the generated frames in pixels */
+  FrameSizeType GetFrameSize() const;
+
+  /*! Set the pixel type of the generated frames (VTK scalar type) */
+  vtkSetMacro(PixelType, igsioCommon::VTKScalarPixelType);
+  /*! Get the pixel type of the generated frames (VTK scalar type) */
+  vtkGetMacro(PixelType, igsioCommon::VTKScalarPixelType);
+
+  /*! Set the number of scalar components of the generated frames */
+  vtkSetMacro(NumberOfScalarComponents, unsigned int);
+  /*! Get the number of scalar components of the generated frames */
+  vtkGetMacro(NumberOfScalarComponents, unsigned int);
+
+  /*! Set the seed of the image content */
+  vtkSetMacro(RandomSeed, int);
+  /*! Get the seed of the image content */
+  vtkGetMacro(RandomSeed, int);
+
+  /*! Number of frames generated since recording started */
+  unsigned long long GetNumberOfGeneratedFrames() const { return this->NumberOfGeneratedFrames; }
+  /*! Number of frame periods skipped because the capture thread could not keep up */
+  unsigned long long GetNumberOfDroppedFrames() const { return this->NumberOfDroppedFrames; }
+  /*! Number of frames that the buffer rejected */
+  unsigned long long GetNumberOfRejectedFrames() const { return this->NumberOfRejectedFrames; }
+  /*! Delay between the nominal time of the frames and the time they were added to the buffer */
+  const PlusLatencyHistogram& GetFrameLatencyHistogram() const { return this->FrameLatencyHistogram; }
+  /*! Human-readable summary of the frame generation statistics */
+  std::string GetFrameGenerationReport() const;
+
+  /*! Write the sequence number into the first (at most 8) bytes of the frame, in little-endian byte order */
+  static void EmbedSequenceNumber(vtkTypeUInt64 sequenceNumber, void* frameData, size_t frameSizeInBytes);
+  /*! Read the sequence number that EmbedSequenceNumber wrote into the frame */
+  static vtkTypeUInt64 GetEmbeddedSequenceNumber(const void* frameData, size_t frameSizeInBytes);
+
+  /*! Get pixel type from its name (UNSIGNED_CHAR, CHAR, UNSIGNED_SHORT, SHORT, UNSIGNED_INT, INT, FLOAT, DOUBLE) */
+  static PlusStatus GetPixelTypeFromString(const char* pixelTypeStr, igsioCommon::VTKScalarPixelType& pixelType);
+  /*! Get the name of a pixel type, as it can be specified in the configuration */
+  static const char* GetPixelTypeAsString(igsioCommon::VTKScalarPixelType pixelType);
+
+protected:
+  vtkPlusFakeVideoSource();
+  virtual ~vtkPlusFakeVideoSource();
+
+  /*! Connect to device */
+  virtual PlusStatus InternalConnect();
+
+  /*! Disconnect from device */
+  virtual PlusStatus InternalDisconnect();
+
+  /*! Start the frame clock */
+  virtual PlusStatus InternalStartRecording();
+
+  /*! Report the frame generation statistics */
+  virtual PlusStatus InternalStopRecording();
+
+  /*! Generate the frame that is due */
+  virtual PlusStatus InternalUpdate();
+
+  /*! Write the content of a frame (without the sequence number) */
+  void GenerateFrame(long long frameIndex, void* frameData) const;
+
+protected:
+  FrameSizeType FrameSize;
+  igsioCommon::VTKScalarPixelType PixelType;
+  unsigned int NumberOfScalarComponents;
+  int RandomSeed;
+
+  /*! Video source that the frames are added to */
+  vtkPlusDataSource* VideoSource;
+
+  /*! Size of a frame in bytes */
+  size_t FrameSizeInBytes;
+  /*! Size of a row of a frame in bytes, the pattern is scrolled by this amount per frame */
+  size_t RowSizeInBytes;
+  /*! Noise pattern, long enough to copy a frame starting at any of the scroll positions */
+  std::vector<unsigned char> Pattern;
+  /*! Frame is generated here if it cannot be written directly into the buffer (clipping or reorientation is needed) */
+  std::vector<unsigned char> StagingFrame;
+
+  /*! System time of frame 0 */
+  double StartTime;
+  /*! Rate of the frame clock, the clock is restarted if the acquisition rate changes */
+  double FrameRate;
+  /*! Index of the last generated frame (-1 if none yet) */
+  long long LastFrameIndex;
+
+  unsigned long long NumberOfGeneratedFrames;
+  unsigned long long NumberOfDroppedFrames;
+  unsigned long long NumberOfRejectedFrames;
+  PlusLatencyHistogram FrameLatencyHistogram;
+
+private:
+  vtkPlusFakeVideoSource(const vtkPlusFakeVideoSource&);  // Not implemented.
+  void operator=(const vtkPlusFakeVideoSource&);  // Not implemented.
+};
+
+#endif
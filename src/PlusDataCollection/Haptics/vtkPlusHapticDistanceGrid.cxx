@@ -0,0 +1,430 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================================*/
+
+#include "PlusConfigure.h"
+
+#include "vtkPlusHapticDistanceGrid.h"
+#include "vtkObjectFactory.h"
+#include "vtkSmartPointer.h"
+
+#include <vtksys/MD5.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+  const char GRID_FILE_SIGNATURE[] = "PlusHapticDistanceGrid";
+  const int GRID_FILE_VERSION = 1;
+  const int BRICK_POINTS_PER_AXIS = vtkPlusHapticDistanceGrid::BRICK_SIZE + 1;
+  const int BRICK_NUMBER_OF_VALUES = BRICK_POINTS_PER_AXIS * BRICK_POINTS_PER_AXIS * BRICK_POINTS_PER_AXIS * vtkPlusHapticDistanceGrid::NUMBER_OF_COMPONENTS;
+}
+
+//----------------------------------------------------------------------------
+
+vtkStandardNewMacro(vtkPlusHapticDistanceGrid)
+
+//----------------------------------------------------------------------------
+vtkPlusHapticDistanceGrid::vtkPlusHapticDistanceGrid()
+  : Spacing(1.0)
+  , NarrowBandWidth(0.0)
+  , NumberOfThreads(vtkMultiThreader::GetGlobalDefaultNumberOfThreads())
+  , SampleFunction(NULL)
+  , SampleFunctionClientData(NULL)
+{
+  for (int i = 0; i < 3; i++)
+  {
+    this->Bounds[2 * i] = 0.0;
+    this->Bounds[2 * i + 1] = 0.0;
+    this->Dimensions[i] = 0;
+    this->BrickDimensions[i] = 0;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkPlusHapticDistanceGrid::~vtkPlusHapticDistanceGrid()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusHapticDistanceGrid::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "Bounds: " << this->Bounds[0] << " " << this->Bounds[1] << " " << this->Bounds[2] << " "
+     << this->Bounds[3] << " " << this->Bounds[4] << " " << this->Bounds[5] << endl;
+  os << indent << "Spacing: " << this->Spacing << endl;
+  os << indent << "NarrowBandWidth: " << this->NarrowBandWidth << endl;
+  os << indent << "Dimensions: " << this->Dimensions[0] << " " << this->Dimensions[1] << " " << this->Dimensions[2] << endl;
+  os << indent << "Stored bricks: " << this->GetNumberOfStoredBricks() << " of " << this->GetNumberOfBricks() << endl;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusHapticDistanceGrid::Clear()
+{
+  this->Bricks.clear();
+}
+
+//----------------------------------------------------------------------------
+int vtkPlusHapticDistanceGrid::GetNumberOfStoredBricks() const
+{
+  int numberOfStoredBricks = 0;
+  for (std::vector< std::vector<float> >::const_iterator it = this->Bricks.begin(); it != this->Bricks.end(); ++it)
+  {
+    if (!it->empty())
+    {
+      numberOfStoredBricks++;
+    }
+  }
+  return numberOfStoredBricks;
+}
+
+//----------------------------------------------------------------------------
+int vtkPlusHapticDistanceGrid::UpdateDimensions()
+{
+  if (this->Spacing <= 0)
+  {
+    vtkErrorMacro("Invalid distance grid spacing: " << this->Spacing);
+    return -1;
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    double size = this->Bounds[2 * i + 1] - this->Bounds[2 * i];
+    if (size <= 0)
+    {
+      vtkErrorMacro("Invalid distance grid bounds");
+      return -1;
+    }
+    // at least one cell along each axis
+    this->Dimensions[i] = std::max(2, static_cast<int>(ceil(size / this->Spacing)) + 1);
+    this->BrickDimensions[i] = (this->Dimensions[i] - 2) / BRICK_SIZE + 1;
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+int vtkPlusHapticDistanceGrid::Compute(SampleFunctionType sampleFunction, void* clientData)
+{
+  this->Clear();
+  if (sampleFunction == NULL || this->UpdateDimensions() != 0)
+  {
+    return -1;
+  }
+
+  this->SampleFunction = sampleFunction;
+  this->SampleFunctionClientData = clientData;
+  this->Bricks.resize(this->BrickDimensions[0] * this->BrickDimensions[1] * this->BrickDimensions[2]);
+
+  int numberOfThreads = std::min<int>(this->NumberOfThreads, this->Bricks.size());
+  if (numberOfThreads <= 1)
+  {
+    this->ComputeBricks(0, this->Bricks.size());
+  }
+  else
+  {
+    vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+    threader->SetNumberOfThreads(numberOfThreads);
+    threader->SetSingleMethod(&vtkPlusHapticDistanceGrid::ComputeBricksThread, this);
+    threader->SingleMethodExecute();
+  }
+
+  this->SampleFunction = NULL;
+  this->SampleFunctionClientData = NULL;
+  this->Modified();
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkPlusHapticDistanceGrid::ComputeBricksThread(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  vtkPlusHapticDistanceGrid* self = static_cast<vtkPlusHapticDistanceGrid*>(threadInfo->UserData);
+  int numberOfBricks = static_cast<int>(self->Bricks.size());
+  int firstBrick = numberOfBricks * threadInfo->ThreadID / threadInfo->NumberOfThreads;
+  int lastBrick = numberOfBricks * (threadInfo->ThreadID + 1) / threadInfo->NumberOfThreads;
+  self->ComputeBricks(firstBrick, lastBrick);
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusHapticDistanceGrid::ComputeBricks(int firstBrick, int lastBrick)
+{
+  std::vector<float> brickValues(BRICK_NUMBER_OF_VALUES);
+  double values[NUMBER_OF_COMPONENTS] = {0};
+  for (int brickIndex = firstBrick; brickIndex < lastBrick; brickIndex++)
+  {
+    int brick[3] =
+    {
+      brickIndex % this->BrickDimensions[0],
+      (brickIndex / this->BrickDimensions[0]) % this->BrickDimensions[1],
+      brickIndex / (this->BrickDimensions[0] * this->BrickDimensions[1])
+    };
+    bool inNarrowBand = (this->NarrowBandWidth <= 0);
+    std::vector<float>::iterator valueIt = brickValues.begin();
+    for (int k = 0; k < BRICK_POINTS_PER_AXIS; k++)
+    {
+      for (int j = 0; j < BRICK_POINTS_PER_AXIS; j++)
+      {
+        for (int i = 0; i < BRICK_POINTS_PER_AXIS; i++)
+        {
+          // Points outside the grid are never used for interpolation, but computing them keeps the brick layout uniform
+          double position[3] =
+          {
+            this->Bounds[0] + (brick[0] * BRICK_SIZE + i) * this->Spacing,
+            this->Bounds[2] + (brick[1] * BRICK_SIZE + j) * this->Spacing,
+            this->Bounds[4] + (brick[2] * BRICK_SIZE + k) * this->Spacing
+          };
+          this->SampleFunction(this->SampleFunctionClientData, position, values);
+          if (fabs(values[0]) <= this->NarrowBandWidth)
+          {
+            inNarrowBand = true;
+          }
+          for (int c = 0; c < NUMBER_OF_COMPONENTS; c++)
+          {
+            *(valueIt++) = static_cast<float>(values[c]);
+          }
+        }
+      }
+    }
+    if (inNarrowBand)
+    {
+      this->Bricks[brickIndex] = brickValues;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+const float* vtkPlusHapticDistanceGrid::FindCell(const double position[3], double t[3]) const
+{
+  if (this->Bricks.empty())
+  {
+    return NULL;
+  }
+
+  int cell[3] = {0, 0, 0};
+  int brick[3] = {0, 0, 0};
+  for (int i = 0; i < 3; i++)
+  {
+    double index = (position[i] - this->Bounds[2 * i]) / this->Spacing;
+    if (!(index >= 0 && index <= this->Dimensions[i] - 1))
+    {
+      return NULL;
+    }
+    cell[i] = std::min(static_cast<int>(index), this->Dimensions[i] - 2);
+    t[i] = index - cell[i];
+    brick[i] = cell[i] / BRICK_SIZE;
+    cell[i] -= brick[i] * BRICK_SIZE;
+  }
+
+  const std::vector<float>& brickValues = this->Bricks[brick[0] + this->BrickDimensions[0] * (brick[1] + this->BrickDimensions[1] * brick[2])];
+  if (brickValues.empty())
+  {
+    return NULL;
+  }
+  return &brickValues[NUMBER_OF_COMPONENTS * (cell[0] + BRICK_POINTS_PER_AXIS * (cell[1] + BRICK_POINTS_PER_AXIS * cell[2]))];
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusHapticDistanceGrid::Interpolate(const double position[3], double values[NUMBER_OF_COMPONENTS]) const
+{
+  double t[3] = {0, 0, 0};
+  const float* p = this->FindCell(position, t);
+  if (p == NULL)
+  {
+    return false;
+  }
+
+  const int incX = NUMBER_OF_COMPONENTS;
+  const int incY = incX * BRICK_POINTS_PER_AXIS;
+  const int incZ = incY * BRICK_POINTS_PER_AXIS;
+  double w[8] =
+  {
+    (1 - t[0]) * (1 - t[1]) * (1 - t[2]),
+    t[0] * (1 - t[1]) * (1 - t[2]),
+    (1 - t[0]) * t[1] * (1 - t[2]),
+    t[0] * t[1] * (1 - t[2]),
+    (1 - t[0]) * (1 - t[1]) * t[2],
+    t[0] * (1 - t[1]) * t[2],
+    (1 - t[0]) * t[1] * t[2],
+    t[0] * t[1] * t[2]
+  };
+  for (int c = 0; c < NUMBER_OF_COMPONENTS; c++)
+  {
+    values[c] = w[0] * p[c] + w[1] * p[c + incX] + w[2] * p[c + incY] + w[3] * p[c + incX + incY]
+                + w[4] * p[c + incZ] + w[5] * p[c + incX + incZ] + w[6] * p[c + incY + incZ] + w[7] * p[c + incX + incY + incZ];
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusHapticDistanceGrid::GetCellCornerValues(const double position[3], double cornerValues[8][NUMBER_OF_COMPONENTS]) const
+{
+  double t[3] = {0, 0, 0};
+  const float* p = this->FindCell(position, t);
+  if (p == NULL)
+  {
+    return false;
+  }
+
+  const int incX = NUMBER_OF_COMPONENTS;
+  const int incY = incX * BRICK_POINTS_PER_AXIS;
+  const int incZ = incY * BRICK_POINTS_PER_AXIS;
+  for (int corner = 0; corner < 8; corner++)
+  {
+    const float* cornerPointer = p + (corner & 1) * incX + ((corner >> 1) & 1) * incY + ((corner >> 2) & 1) * incZ;
+    for (int c = 0; c < NUMBER_OF_COMPONENTS; c++)
+    {
+      cornerValues[corner][c] = cornerPointer[c];
+    }
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+int vtkPlusHapticDistanceGrid::WriteToFile(const std::string& fileName, const std::string& key)
+{
+  if (this->Bricks.empty())
+  {
+    vtkErrorMacro("Distance grid is not computed, cannot write it to " << fileName);
+    return -1;
+  }
+  std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary);
+  if (!file.is_open())
+  {
+    vtkErrorMacro("Failed to open distance grid file for writing: " << fileName);
+    return -1;
+  }
+
+  int version = GRID_FILE_VERSION;
+  int keyLength = static_cast<int>(key.size());
+  int numberOfComponents = NUMBER_OF_COMPONENTS;
+  int brickSize = BRICK_SIZE;
+  file.write(GRID_FILE_SIGNATURE, sizeof(GRID_FILE_SIGNATURE));
+  file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+  file.write(reinterpret_cast<const char*>(&keyLength), sizeof(keyLength));
+  file.write(key.c_str(), keyLength);
+  file.write(reinterpret_cast<const char*>(&numberOfComponents), sizeof(numberOfComponents));
+  file.write(reinterpret_cast<const char*>(&brickSize), sizeof(brickSize));
+  file.write(reinterpret_cast<const char*>(this->Bounds), sizeof(this->Bounds));
+  file.write(reinterpret_cast<const char*>(&this->Spacing), sizeof(this->Spacing));
+  file.write(reinterpret_cast<const char*>(&this->NarrowBandWidth), sizeof(this->NarrowBandWidth));
+  for (std::vector< std::vector<float> >::const_iterator it = this->Bricks.begin(); it != this->Bricks.end(); ++it)
+  {
+    char stored = it->empty() ? 0 : 1;
+    file.write(&stored, sizeof(stored));
+    if (stored)
+    {
+      file.write(reinterpret_cast<const char*>(&(*it)[0]), BRICK_NUMBER_OF_VALUES * sizeof(float));
+    }
+  }
+
+  if (!file.good())
+  {
+    vtkErrorMacro("Failed to write distance grid file: " << fileName);
+    return -1;
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+int vtkPlusHapticDistanceGrid::ReadFromFile(const std::string& fileName, const std::string& key)
+{
+  this->Clear();
+  std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+  if (!file.is_open())
+  {
+    return -1;
+  }
+
+  char signature[sizeof(GRID_FILE_SIGNATURE)] = {0};
+  int version = 0;
+  int keyLength = 0;
+  file.read(signature, sizeof(signature));
+  file.read(reinterpret_cast<char*>(&version), sizeof(version));
+  file.read(reinterpret_cast<char*>(&keyLength), sizeof(keyLength));
+  if (!file.good() || std::string(signature) != GRID_FILE_SIGNATURE || version != GRID_FILE_VERSION || keyLength != static_cast<int>(key.size()))
+  {
+    vtkWarningMacro("Distance grid file " << fileName << " is invalid or was computed for a different model");
+    return -1;
+  }
+  std::string fileKey(keyLength, ' ');
+  if (keyLength > 0)
+  {
+    file.read(&fileKey[0], keyLength);
+  }
+  int numberOfComponents = 0;
+  int brickSize = 0;
+  file.read(reinterpret_cast<char*>(&numberOfComponents), sizeof(numberOfComponents));
+  file.read(reinterpret_cast<char*>(&brickSize), sizeof(brickSize));
+  if (!file.good() || fileKey != key || numberOfComponents != NUMBER_OF_COMPONENTS || brickSize != BRICK_SIZE)
+  {
+    vtkWarningMacro("Distance grid file " << fileName << " is invalid or was computed for a different model");
+    return -1;
+  }
+  file.read(reinterpret_cast<char*>(this->Bounds), sizeof(this->Bounds));
+  file.read(reinterpret_cast<char*>(&this->Spacing), sizeof(this->Spacing));
+  file.read(reinterpret_cast<char*>(&this->NarrowBandWidth), sizeof(this->NarrowBandWidth));
+  if (!file.good() || this->UpdateDimensions() != 0)
+  {
+    vtkWarningMacro("Distance grid file " << fileName << " is invalid");
+    return -1;
+  }
+
+  std::vector< std::vector<float> > bricks(this->BrickDimensions[0] * this->BrickDimensions[1] * this->BrickDimensions[2]);
+  for (std::vector< std::vector<float> >::iterator it = bricks.begin(); it != bricks.end(); ++it)
+  {
+    char stored = 0;
+    file.read(&stored, sizeof(stored));
+    if (stored)
+    {
+      it->resize(BRICK_NUMBER_OF_VALUES);
+      file.read(reinterpret_cast<char*>(&(*it)[0]), BRICK_NUMBER_OF_VALUES * sizeof(float));
+    }
+  }
+  if (!file.good())
+  {
+    vtkWarningMacro("Distance grid file " << fileName << " is truncated");
+    return -1;
+  }
+
+  this->Bricks.swap(bricks);
+  this->Modified();
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkPlusHapticDistanceGrid::ComputeChecksum(const void* data, size_t size)
+{
+  vtksysMD5* md5 = vtksysMD5_New();
+  vtksysMD5_Initialize(md5);
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  // Append takes int length, feed large blocks in parts
+  const size_t maxBlockSize = 1 << 30;
+  while (size > 0)
+  {
+    size_t blockSize = std::min(size, maxBlockSize);
+    vtksysMD5_Append(md5, bytes, static_cast<int>(blockSize));
+    bytes += blockSize;
+    size -= blockSize;
+  }
+  char hex[33] = {0};
+  vtksysMD5_FinalizeHex(md5, hex);
+  vtksysMD5_Delete(md5);
+  return std::string(hex);
+}
+
+//----------------------------------------------------------------------------
+std::string vtkPlusHapticDistanceGrid::ComputeFileChecksum(const std::string& fileName)
+{
+  std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+  if (!file.is_open())
+  {
+    return "";
+  }
+  std::vector<char> content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  return ComputeChecksum(content.empty() ? NULL : &content[0], content.size());
+}
@@ -0,0 +1,148 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================================*/
+
+#ifndef __vtkPlusHapticDistanceGrid_h
+#define __vtkPlusHapticDistanceGrid_h
+
+#include "PlusConfigure.h"
+#include "vtkPlusHapticsExport.h"
+
+#include "vtkMultiThreader.h"
+#include "vtkObject.h"
+
+#include <string>
+#include <vector>
+
+/*!
+  \class vtkPlusHapticDistanceGrid
+  \brief Precomputed samples of a distance field on a regular grid, for fast force evaluation in haptic loops
+
+  Each grid point stores NUMBER_OF_COMPONENTS values (typically the distance and the gradient or closest point),
+  computed by a sampling function. Values are returned by trilinear interpolation, or without interpolation
+  as the values at the corners of the grid cell that contains the position.
+
+  The grid is stored in bricks of BRICK_SIZE^3 cells. If NarrowBandWidth is positive then bricks in which the
+  absolute value of the first component is larger than NarrowBandWidth at all grid points are not stored,
+  and Interpolate returns false for positions in these bricks (the caller has to compute the value directly).
+
+  The grid can be saved to and loaded from a file, so that it does not have to be recomputed each time
+  the same model is loaded. The file stores a key string that identifies the model and the grid parameters,
+  and loading fails if the key does not match. The file is written in native byte order.
+*/
+class vtkPlusHapticsExport vtkPlusHapticDistanceGrid : public vtkObject
+{
+public:
+  static vtkPlusHapticDistanceGrid* New();
+  vtkTypeMacro(vtkPlusHapticDistanceGrid, vtkObject);
+  virtual void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  enum
+  {
+    NUMBER_OF_COMPONENTS = 4,
+    BRICK_SIZE = 8
+  };
+
+  /*! Computes the values at a position. Must be thread-safe, as it is called from multiple threads. */
+  typedef void (*SampleFunctionType)(void* clientData, const double position[3], double values[NUMBER_OF_COMPONENTS]);
+
+  /*! Region covered by the grid (xmin, xmax, ymin, ymax, zmin, zmax) */
+  vtkSetVector6Macro(Bounds, double);
+  vtkGetVector6Macro(Bounds, double);
+
+  /*! Distance between grid points */
+  vtkSetMacro(Spacing, double);
+  vtkGetMacro(Spacing, double);
+
+  /*! Bricks that are farther than this from the surface are not stored. Zero or negative value means that all bricks are stored. */
+  vtkSetMacro(NarrowBandWidth, double);
+  vtkGetMacro(NarrowBandWidth, double);
+
+  /*! Number of threads used for computing the grid. Default is the number of processors. */
+  vtkSetClampMacro(NumberOfThreads, int, 1, VTK_MAX_THREADS);
+  vtkGetMacro(NumberOfThreads, int);
+
+  /*! Compute the grid values using the sampling function. Returns 0 on success. */
+  int Compute(SampleFunctionType sampleFunction, void* clientData);
+
+  /*!
+    Get interpolated values at the specified position.
+    Returns false if the position is outside the grid or in a brick that is not stored.
+  */
+  bool Interpolate(const double position[3], double values[NUMBER_OF_COMPONENTS]) const;
+
+  /*!
+    Get the values at the 8 corners of the grid cell that contains the specified position, without interpolation.
+    It is useful for values that cannot be interpolated (e.g., closest surface point, which changes abruptly between neighbor grid points).
+    Corner index is x + 2*y + 4*z, where x, y, z are 0 for the lower and 1 for the upper corner along the axis.
+    Returns false if the position is outside the grid or in a brick that is not stored.
+  */
+  bool GetCellCornerValues(const double position[3], double cornerValues[8][NUMBER_OF_COMPONENTS]) const;
+
+  /*! Returns true if the grid has been computed or loaded */
+  bool IsValid() const { return !this->Bricks.empty(); }
+
+  /*! Remove all grid values */
+  void Clear();
+
+  /*! Save the grid to file. Returns 0 on success. */
+  int WriteToFile(const std::string& fileName, const std::string& key);
+
+  /*! Load the grid from file. Bounds, spacing, and narrow band width are set from the file. Returns 0 on success. */
+  int ReadFromFile(const std::string& fileName, const std::string& key);
+
+  /*! Compute a checksum (MD5 hex string) of a memory block, for building the key of a grid file */
+  static std::string ComputeChecksum(const void* data, size_t size);
+
+  /*! Compute a checksum (MD5 hex string) of a file content. Returns empty string if the file cannot be read. */
+  static std::string ComputeFileChecksum(const std::string& fileName);
+
+  /*! Number of stored bricks / total number of bricks, for diagnostics */
+  int GetNumberOfStoredBricks() const;
+  int GetNumberOfBricks() const { return static_cast<int>(this->Bricks.size()); }
+
+protected:
+  vtkPlusHapticDistanceGrid();
+  virtual ~vtkPlusHapticDistanceGrid();
+
+  /*! Compute grid and brick dimensions from Bounds and Spacing */
+  int UpdateDimensions();
+
+  /*!
+    Find the grid cell that contains the position. Returns pointer to the values of the lower corner of the cell
+    and the position within the cell (0..1 along each axis), or NULL if the cell is not available.
+  */
+  const float* FindCell(const double position[3], double t[3]) const;
+
+  /*! Compute bricks [first, last) */
+  void ComputeBricks(int firstBrick, int lastBrick);
+
+  static VTK_THREAD_RETURN_TYPE ComputeBricksThread(void* arg);
+
+  double Bounds[6];
+  double Spacing;
+  double NarrowBandWidth;
+  int NumberOfThreads;
+
+  /*! Number of grid points along each axis */
+  int Dimensions[3];
+  /*! Number of bricks along each axis */
+  int BrickDimensions[3];
+
+  /*!
+    Values of each brick, (BRICK_SIZE+1)^3 points (neighbor bricks share their boundary points so that
+    interpolation never needs values from multiple bricks). Empty if the brick is not stored.
+  */
+  std::vector< std::vector<float> > Bricks;
+
+  SampleFunctionType SampleFunction;
+  void* SampleFunctionClientData;
+
+private:
+  vtkPlusHapticDistanceGrid(const vtkPlusHapticDistanceGrid&);  // Not implemented.
+  void operator=(const vtkPlusHapticDistanceGrid&);  // Not implemented.
+};
+
+#endif
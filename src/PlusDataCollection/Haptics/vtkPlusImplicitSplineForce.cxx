@@ -9,7 +9,9 @@ See License.txt for details.
 #include "vtkPlusImplicitSplineForce.h"
 #include "vtkMatrix4x4.h"
 #include "vtkObjectFactory.h"
+#include <vtksys/SystemTools.hxx>
 #include <iostream>
+#include <sstream>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,6 +30,10 @@ vtkPlusImplicitSplineForce::vtkPlusImplicitSplineForce()
   this->SplineKnots = "knot3DHeart.txt";
   this->ControlPoints = " ";
 
+  this->UseDistanceGrid = false;
+  this->DistanceGridSpacing = 1.0;
+  this->DistanceGridNarrowBandWidth = 0.0;
+  this->DistanceGrid = vtkSmartPointer<vtkPlusHapticDistanceGrid>::New();
 }
 
 //----------------------------------------------------------------------------
@@ -35,6 +41,11 @@ void vtkPlusImplicitSplineForce::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent.GetNextIndent());
   os << indent.GetNextIndent() << "Gamma Sigmoid: " << this->gammaSigmoid << endl;
+  os << indent.GetNextIndent() << "Use Distance Grid: " << (this->UseDistanceGrid ? "true" : "false") << endl;
+  if (this->UseDistanceGrid)
+  {
+    this->DistanceGrid->PrintSelf(os, indent.GetNextIndent());
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -46,8 +57,22 @@ vtkPlusImplicitSplineForce::~vtkPlusImplicitSplineForce()
 //----------------------------------------------------------------------------
 void vtkPlusImplicitSplineForce::SetInput(char * controlPnt)
 {
-  this->ControlPoints = controlPnt;
   ReadFileControlPoints(controlPnt);
+  if (this->UseDistanceGrid)
+  {
+    UpdateDistanceGrid();
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusImplicitSplineForce::SetInput(const std::string& knotsFileName, const std::string& controlPointsFileName)
+{
+  ReadFile3DBSplineKnots(knotsFileName);
+  ReadFileControlPoints(controlPointsFileName);
+  if (this->UseDistanceGrid)
+  {
+    UpdateDistanceGrid();
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -124,6 +149,63 @@ void vtkPlusImplicitSplineForce::SetInput(int splineId)
     ReadFileControlPoints("control3DLSHeart20.txt");
     break;
   }
+
+  if (this->UseDistanceGrid)
+  {
+    UpdateDistanceGrid();
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusImplicitSplineForce::SampleDistanceAndGradient(void* clientData, const double position[3], double values[vtkPlusHapticDistanceGrid::NUMBER_OF_COMPONENTS])
+{
+  vtkPlusImplicitSplineForce* self = static_cast<vtkPlusImplicitSplineForce*>(clientData);
+  int n=3; //Cubic spline
+  values[0] = self->CalculateDistanceBasis(position[0], position[1], position[2], n, 3);
+  self->CalculateDistanceDerivativeBasis(position[0], position[1], position[2], n, 3, values+1);
+}
+
+//----------------------------------------------------------------------------
+int vtkPlusImplicitSplineForce::UpdateDistanceGrid()
+{
+  this->DistanceGrid->Clear();
+
+  // The spline is only defined within the knot range
+  this->DistanceGrid->SetBounds(knot1b[0], knot1b[DimKnot_U-1], knot2b[0], knot2b[DimKnot_V-1], knot3b[0], knot3b[DimKnot_W-1]);
+  this->DistanceGrid->SetSpacing(this->DistanceGridSpacing);
+  this->DistanceGrid->SetNarrowBandWidth(this->DistanceGridNarrowBandWidth);
+
+  std::string cacheFileName;
+  std::string key;
+  if (!this->DistanceGridCacheDirectory.empty())
+  {
+    std::string knotsChecksum = vtkPlusHapticDistanceGrid::ComputeFileChecksum(this->SplineKnots);
+    std::string controlPointsChecksum = vtkPlusHapticDistanceGrid::ComputeFileChecksum(this->ControlPoints);
+    if (!knotsChecksum.empty() && !controlPointsChecksum.empty())
+    {
+      std::ostringstream keyStream;
+      keyStream << "ImplicitSpline " << knotsChecksum << " " << controlPointsChecksum << " " << this->DistanceGridSpacing << " " << this->DistanceGridNarrowBandWidth;
+      key = keyStream.str();
+      cacheFileName = this->DistanceGridCacheDirectory + "/ImplicitSplineDistanceGrid_" + vtkPlusHapticDistanceGrid::ComputeChecksum(key.c_str(), key.size()) + ".bin";
+      if (vtksys::SystemTools::FileExists(cacheFileName.c_str(), true) && this->DistanceGrid->ReadFromFile(cacheFileName, key) == 0)
+      {
+        return 0;
+      }
+    }
+  }
+
+  if (this->DistanceGrid->Compute(&vtkPlusImplicitSplineForce::SampleDistanceAndGradient, this) != 0)
+  {
+    vtkErrorMacro("Failed to compute implicit spline distance grid");
+    return -1;
+  }
+
+  if (!cacheFileName.empty())
+  {
+    // The computed grid can be used even if it could not be saved, it will be recomputed next time
+    this->DistanceGrid->WriteToFile(cacheFileName, key);
+  }
+  return 0;
 }
 
 //----------------------------------------------------------------------------
@@ -134,16 +216,27 @@ int vtkPlusImplicitSplineForce::GenerateForce(vtkMatrix4x4 * transformMatrix, do
   int flag = 0;
   double dSpline, value, deriv, gradient[3];
 
-  // Calculate distance (dSpline) to B-spline surface
-  dSpline = CalculateDistanceBasis(transformMatrix->GetElement(0,3), transformMatrix->GetElement(1,3), transformMatrix->GetElement(2,3), n, 3);
+  double position[3] = { transformMatrix->GetElement(0,3), transformMatrix->GetElement(1,3), transformMatrix->GetElement(2,3) };
+  double gridValues[vtkPlusHapticDistanceGrid::NUMBER_OF_COMPONENTS];
+  if (this->UseDistanceGrid && this->DistanceGrid->Interpolate(position, gridValues))
+  {
+    dSpline = gridValues[0];
+    gradient[0] = gridValues[1];
+    gradient[1] = gridValues[2];
+    gradient[2] = gridValues[3];
+  }
+  else
+  {
+    // Calculate distance (dSpline) to B-spline surface
+    dSpline = CalculateDistanceBasis(position[0], position[1], position[2], n, 3);
+    CalculateDistanceDerivativeBasis(position[0], position[1], position[2], n, 3, gradient);
+  }
 
   if(dSpline > -1.0)
   {
     flag = 1;
   }
 
-  CalculateDistanceDerivativeBasis(transformMatrix->GetElement(0,3), transformMatrix->GetElement(1,3), transformMatrix->GetElement(2,3), n, 3, gradient);
-
   fnGaussValueDeriv(gammaSigmoid, dSpline, value, deriv);
 
   for(i=0; i<3; i++)
@@ -622,6 +715,7 @@ int vtkPlusImplicitSplineForce::ReadFile3DBSplineKnots(const std::string& fname)
   {
     return -1;
   }
+  this->SplineKnots = fname;
   ifstream fpInKnot;
   fpInKnot.open(fname.c_str());
 
@@ -672,6 +766,7 @@ int vtkPlusImplicitSplineForce::ReadFileControlPoints(const std::string& fname)
   {
     return -1;
   }
+  this->ControlPoints = fname;
   ifstream fpInKnot;
   fpInKnot.open(fname.c_str());
 
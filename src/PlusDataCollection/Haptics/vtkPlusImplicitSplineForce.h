@@ -11,6 +11,8 @@ See License.txt for details.
 #include "vtkPlusHapticsExport.h"
 
 #include "vtkPlusForceFeedback.h"
+#include "vtkPlusHapticDistanceGrid.h"
+#include "vtkSmartPointer.h"
 
 class vtkMatrix4x4;
 
@@ -34,9 +36,38 @@ public:
 
   void SetInput(int splineId);
   void SetInput(char * controlPnt);
+  /*! Read spline knots and control points from the specified files */
+  void SetInput(const std::string& knotsFileName, const std::string& controlPointsFileName);
   int GenerateForce(vtkMatrix4x4 * transformMatrix, double force[3]);
   int SetGamma(double gamma);
 
+  /*!
+    If enabled then distance and gradient are interpolated from a precomputed grid instead of evaluating the spline
+    for each force computation. The grid is computed (or loaded from DistanceGridCacheDirectory) when the input is set.
+    Positions where the grid is not available are evaluated directly.
+  */
+  vtkSetMacro(UseDistanceGrid, bool);
+  vtkGetMacro(UseDistanceGrid, bool);
+  vtkBooleanMacro(UseDistanceGrid, bool);
+
+  /*! Distance between distance grid points */
+  vtkSetMacro(DistanceGridSpacing, double);
+  vtkGetMacro(DistanceGridSpacing, double);
+
+  /*! Grid values are only stored near the surface (see vtkPlusHapticDistanceGrid::NarrowBandWidth). Default: 0 (store all). */
+  vtkSetMacro(DistanceGridNarrowBandWidth, double);
+  vtkGetMacro(DistanceGridNarrowBandWidth, double);
+
+  /*! If not empty then computed grids are saved in this directory and reused if the same knot and control point files are loaded again */
+  vtkSetStdStringMacro(DistanceGridCacheDirectory);
+  vtkGetStdStringMacro(DistanceGridCacheDirectory);
+
+  /*! Precomputed distance grid (valid only if UseDistanceGrid is enabled and an input is set) */
+  vtkPlusHapticDistanceGrid* GetDistanceGrid() { return this->DistanceGrid; }
+
+  /*! Compute or load the distance grid for the current knots and control points. Returns 0 on success. */
+  int UpdateDistanceGrid();
+
 protected:
   vtkPlusImplicitSplineForce();
   virtual ~vtkPlusImplicitSplineForce();
@@ -51,6 +82,9 @@ protected:
   int ReadFile3DBSplineKnots(const std::string& fname);
   int ReadFileControlPoints(const std::string& fname);
 
+  /*! Compute distance and gradient at a position, for filling the distance grid */
+  static void SampleDistanceAndGradient(void* clientData, const double position[3], double values[vtkPlusHapticDistanceGrid::NUMBER_OF_COMPONENTS]);
+
   double controlQ3D[DimCPoint_W][DimCPoint_V][DimCPoint_U];
   double knot1[NUM_INTERVALU_S+1];
   double knot2[NUM_INTERVALV_S+1];
@@ -64,6 +98,12 @@ protected:
   double scaleForce;
   std::string SplineKnots;
   std::string ControlPoints;
+
+  bool UseDistanceGrid;
+  double DistanceGridSpacing;
+  double DistanceGridNarrowBandWidth;
+  std::string DistanceGridCacheDirectory;
+  vtkSmartPointer<vtkPlusHapticDistanceGrid> DistanceGrid;
 };
 
 #endif
@@ -10,6 +10,19 @@ See License.txt for details.
 #include "vtkPolyData.h"
 #include "vtkPlusPolydataForce.h"
 #include "vtkMatrix4x4.h"
+#include "vtkDataArray.h"
+#include "vtkCellArray.h"
+#include "vtkIdTypeArray.h"
+#include "vtkMath.h"
+#include "vtkPoints.h"
+#include <vtksys/SystemTools.hxx>
+#include <sstream>
+
+namespace
+{
+  /*! Force is only applied closer than this distance from the closest polydata point */
+  const double FORCE_DISTANCE_THRESHOLD = 5.0;
+}
 
 //----------------------------------------------------------------------------
 
@@ -24,6 +37,10 @@ vtkPlusPolydataForce::vtkPlusPolydataForce()
   lastPos[0] = 0;
   lastPos[1] = 0;
   lastPos[2] = 0;
+  this->poly = NULL;
+  this->UseDistanceGrid = false;
+  this->DistanceGridSpacing = 1.0;
+  this->DistanceGrid = vtkSmartPointer<vtkPlusHapticDistanceGrid>::New();
 }
 
 //----------------------------------------------------------------------------
@@ -31,6 +48,11 @@ void vtkPlusPolydataForce::PrintSelf( ostream& os, vtkIndent indent )
 {
   this->Superclass::PrintSelf( os, indent.GetNextIndent() );
   os << indent.GetNextIndent() << "Gamma Sigmoid: " << this->gammaSigmoid << endl;
+  os << indent.GetNextIndent() << "Use Distance Grid: " << ( this->UseDistanceGrid ? "true" : "false" ) << endl;
+  if ( this->UseDistanceGrid )
+  {
+    this->DistanceGrid->PrintSelf( os, indent.GetNextIndent() );
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -43,15 +65,122 @@ vtkPlusPolydataForce::~vtkPlusPolydataForce()
 void vtkPlusPolydataForce::SetInput( vtkPolyData* poly )
 {
   this->poly = poly;
+  if ( this->UseDistanceGrid )
+  {
+    UpdateDistanceGrid();
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusPolydataForce::SampleDistanceAndClosestPoint( void* clientData, const double position[3], double values[vtkPlusHapticDistanceGrid::NUMBER_OF_COMPONENTS] )
+{
+  vtkPlusPolydataForce* self = static_cast<vtkPlusPolydataForce*>( clientData );
+  double closestPoint[3] = {0, 0, 0};
+  self->poly->GetPoint( self->poly->FindPoint( position[0], position[1], position[2] ), closestPoint );
+  values[0] = sqrt( vtkMath::Distance2BetweenPoints( position, closestPoint ) );
+  values[1] = closestPoint[0];
+  values[2] = closestPoint[1];
+  values[3] = closestPoint[2];
+}
+
+//----------------------------------------------------------------------------
+int vtkPlusPolydataForce::UpdateDistanceGrid()
+{
+  this->DistanceGrid->Clear();
+  if ( this->poly == NULL || this->poly->GetNumberOfPoints() < 1 )
+  {
+    vtkErrorMacro( "Cannot compute polydata distance grid, polydata has no points" );
+    return -1;
+  }
+
+  // Force is zero farther than FORCE_DISTANCE_THRESHOLD from all points, so the grid does not have to extend further
+  double bounds[6] = {0};
+  this->poly->GetBounds( bounds );
+  for ( int i = 0; i < 3; i++ )
+  {
+    bounds[2 * i] -= FORCE_DISTANCE_THRESHOLD + this->DistanceGridSpacing;
+    bounds[2 * i + 1] += FORCE_DISTANCE_THRESHOLD + this->DistanceGridSpacing;
+  }
+  this->DistanceGrid->SetBounds( bounds );
+  this->DistanceGrid->SetSpacing( this->DistanceGridSpacing );
+  // Bricks where all grid points are farther than the threshold plus a brick diagonal cannot contain any point where force is applied
+  this->DistanceGrid->SetNarrowBandWidth( FORCE_DISTANCE_THRESHOLD + sqrt( 3.0 ) * vtkPlusHapticDistanceGrid::BRICK_SIZE * this->DistanceGridSpacing );
+
+  std::string cacheFileName;
+  std::string key;
+  if ( !this->DistanceGridCacheDirectory.empty() )
+  {
+    // Identify the polydata by its points and polygons
+    vtkDataArray* points = this->poly->GetPoints()->GetData();
+    std::string pointsChecksum = vtkPlusHapticDistanceGrid::ComputeChecksum( points->GetVoidPointer( 0 ), points->GetNumberOfTuples() * points->GetNumberOfComponents() * points->GetDataTypeSize() );
+    vtkIdTypeArray* polys = this->poly->GetPolys()->GetData();
+    std::string polysChecksum = vtkPlusHapticDistanceGrid::ComputeChecksum( polys->GetVoidPointer( 0 ), polys->GetNumberOfTuples() * polys->GetDataTypeSize() );
+    std::ostringstream keyStream;
+    keyStream << "Polydata " << pointsChecksum << " " << polysChecksum << " " << this->DistanceGridSpacing;
+    key = keyStream.str();
+    cacheFileName = this->DistanceGridCacheDirectory + "/PolydataDistanceGrid_" + vtkPlusHapticDistanceGrid::ComputeChecksum( key.c_str(), key.size() ) + ".bin";
+    if ( vtksys::SystemTools::FileExists( cacheFileName.c_str(), true ) && this->DistanceGrid->ReadFromFile( cacheFileName, key ) == 0 )
+    {
+      return 0;
+    }
+  }
+
+  // FindPoint builds the point locator at the first call, build it before the grid is computed by multiple threads
+  this->poly->FindPoint( this->poly->GetPoint( 0 ) );
+
+  if ( this->DistanceGrid->Compute( &vtkPlusPolydataForce::SampleDistanceAndClosestPoint, this ) != 0 )
+  {
+    vtkErrorMacro( "Failed to compute polydata distance grid" );
+    return -1;
+  }
+
+  if ( !cacheFileName.empty() )
+  {
+    // The computed grid can be used even if it could not be saved, it will be recomputed next time
+    this->DistanceGrid->WriteToFile( cacheFileName, key );
+  }
+  return 0;
 }
 
 //----------------------------------------------------------------------------
 int vtkPlusPolydataForce::GenerateForce( vtkMatrix4x4* transformMatrix, double force[3] )
 {
   double distance;
-  distance = CalculateDistance( transformMatrix->GetElement( 0, 3 ), transformMatrix->GetElement( 1, 3 ), transformMatrix->GetElement( 2, 3 ) );
+  double position[3] = { transformMatrix->GetElement( 0, 3 ), transformMatrix->GetElement( 1, 3 ), transformMatrix->GetElement( 2, 3 ) };
+  double cornerValues[8][vtkPlusHapticDistanceGrid::NUMBER_OF_COMPONENTS];
+  if ( this->UseDistanceGrid && this->DistanceGrid->IsValid() )
+  {
+    if ( this->DistanceGrid->GetCellCornerValues( position, cornerValues ) )
+    {
+      // The closest point changes abruptly where the closest polydata point changes, so it is not interpolated:
+      // the closest point of the cell corners that is closest to the position is used (it is the exact closest point
+      // unless none of the corners have the same closest point as the position)
+      double minDistance2 = VTK_DOUBLE_MAX;
+      for ( int corner = 0; corner < 8; corner++ )
+      {
+        double distance2 = vtkMath::Distance2BetweenPoints( position, &cornerValues[corner][1] );
+        if ( distance2 < minDistance2 )
+        {
+          minDistance2 = distance2;
+          this->lastPos[0] = cornerValues[corner][1];
+          this->lastPos[1] = cornerValues[corner][2];
+          this->lastPos[2] = cornerValues[corner][3];
+        }
+      }
+      distance = sqrt( minDistance2 );
+    }
+    else
+    {
+      // Outside the grid or in a brick that is not stored because it is far from all points: no force
+      distance = FORCE_DISTANCE_THRESHOLD + 1.0;
+    }
+  }
+  else
+  {
+    distance = CalculateDistance( position[0], position[1], position[2] );
+  }
 
-  if ( distance <= 5 )
+  if ( distance <= FORCE_DISTANCE_THRESHOLD )
   {
     CalculateForce( transformMatrix->GetElement( 0, 3 ), transformMatrix->GetElement( 1, 3 ), transformMatrix->GetElement( 2, 3 ), force );
   }
@@ -61,7 +190,7 @@ int vtkPlusPolydataForce::GenerateForce( vtkMatrix4x4* transformMatrix, double f
     force[1] = ( 0 );
     force[2] = ( 0 );
   }
-  cout <<  " FORCE: " << force[0] << ",  " << force[1] << ",  " << force[2] << endl;
+  vtkDebugMacro( " FORCE: " << force[0] << ",  " << force[1] << ",  " << force[2] );
   return 1;
 }
 
@@ -95,9 +224,7 @@ void vtkPlusPolydataForce::CalculateForce( double x, double y, double z, double
   vector[1] = fabs( y - this->lastPos[1] );
   vector[2] = fabs( z - this->lastPos[2] );
 
-  cout << "vector[0]: " << vector[0] << endl;
-  cout << "vector[1]: " << vector[1] << endl;
-  cout << "vector[2]: " << vector[2] << endl;
+  vtkDebugMacro( "vector: " << vector[0] << ", " << vector[1] << ", " << vector[2] );
 
   for ( int i = 0; i < 3; i++ )
   {
@@ -106,9 +233,7 @@ void vtkPlusPolydataForce::CalculateForce( double x, double y, double z, double
       force[i] = ( 0.1 / ( vector[i] * vector[i] ) ) * .6;
     }
   }
-  cout << "X: " << force[0] << endl;
-  cout << "Y: " << force[1] << endl;
-  cout << "Z: " << force[2] << endl;
+  vtkDebugMacro( "X: " << force[0] << " Y: " << force[1] << " Z: " << force[2] );
 
   if ( force[0] > 1 )
   {
@@ -11,6 +11,8 @@ See License.txt for details.
 #include "vtkPlusHapticsExport.h"
 
 #include "vtkPlusForceFeedback.h"
+#include "vtkPlusHapticDistanceGrid.h"
+#include "vtkSmartPointer.h"
 
 class vtkPolyData;
 
@@ -25,17 +27,50 @@ public:
   int SetGamma(double gamma);
   void SetInput(vtkPolyData * poly);
 
+  /*!
+    If enabled then the closest polydata point is looked up in a precomputed grid instead of searching it among all
+    the polydata points for each force computation. The closest points stored at the corners of the grid cell are the
+    candidates, the one that is closest to the position is used (closest points are not interpolated, as a blend of
+    two surface points is not on the surface). The grid is computed (or loaded from DistanceGridCacheDirectory)
+    when the input is set. No force is applied at positions where the grid is not available (far from the surface).
+  */
+  vtkSetMacro(UseDistanceGrid, bool);
+  vtkGetMacro(UseDistanceGrid, bool);
+  vtkBooleanMacro(UseDistanceGrid, bool);
+
+  /*! Distance between distance grid points */
+  vtkSetMacro(DistanceGridSpacing, double);
+  vtkGetMacro(DistanceGridSpacing, double);
+
+  /*! If not empty then computed grids are saved in this directory and reused if the same polydata is set again */
+  vtkSetStdStringMacro(DistanceGridCacheDirectory);
+  vtkGetStdStringMacro(DistanceGridCacheDirectory);
+
+  /*! Precomputed distance grid (valid only if UseDistanceGrid is enabled and an input is set) */
+  vtkPlusHapticDistanceGrid* GetDistanceGrid() { return this->DistanceGrid; }
+
+  /*! Compute or load the distance grid for the current polydata. Returns 0 on success. */
+  int UpdateDistanceGrid();
+
 protected:
   vtkPlusPolydataForce();
   virtual ~vtkPlusPolydataForce();
   double CalculateDistance(double x, double y, double z);
   void CalculateForce(double x, double y, double z, double force[3]);
 
+  /*! Compute distance and closest point at a position, for filling the distance grid */
+  static void SampleDistanceAndClosestPoint(void* clientData, const double position[3], double values[vtkPlusHapticDistanceGrid::NUMBER_OF_COMPONENTS]);
+
 private:
   vtkPolyData * poly;
   double gammaSigmoid;
   double scaleForce;
   double lastPos[3];
+
+  bool UseDistanceGrid;
+  double DistanceGridSpacing;
+  std::string DistanceGridCacheDirectory;
+  vtkSmartPointer<vtkPlusHapticDistanceGrid> DistanceGrid;
 };
 
 #endif
@@ -12,6 +12,7 @@ See License.txt for details.
 
 // VTK includes
 #include <vtkImageData.h>
+#include <vtkIGSIOAccurateTimer.h>
 #include <vtkObjectFactory.h>
 
 // OpenCV includes
@@ -21,6 +22,10 @@ See License.txt for details.
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 
+// STL includes
+#include <iomanip>
+#include <sstream>
+
 //----------------------------------------------------------------------------
 
 vtkStandardNewMacro(vtkPlusOpenCVCaptureVideoSource);
@@ -33,11 +38,20 @@ vtkPlusOpenCVCaptureVideoSource::vtkPlusOpenCVCaptureVideoSource()
   , DeviceIndex(-1)
   , Capture(nullptr)
   , Frame(nullptr)
-  , UndistortedFrame(nullptr)
+  , ColorConvertedFrame(nullptr)
+  , StagingFrame(nullptr)
   , CameraMatrix(nullptr)
   , DistortionCoefficients(nullptr)
+  , UndistortMap1(nullptr)
+  , UndistortMap2(nullptr)
   , AutofocusEnabled(false)
   , AutoexposureEnabled(false)
+  , ProcessingQueueSize(2)
+  , ProcessingThreadId(-1)
+  , ProcessingActive(false)
+  , NumberOfCapturedFrames(0)
+  , NumberOfDroppedFrames(0)
+  , NumberOfRejectedFrames(0)
 {
   this->FrameSize = { 0, 0, 0 };
   this->RequireImageOrientationInConfiguration = true;
@@ -47,6 +61,7 @@ vtkPlusOpenCVCaptureVideoSource::vtkPlusOpenCVCaptureVideoSource()
 //----------------------------------------------------------------------------
 vtkPlusOpenCVCaptureVideoSource::~vtkPlusOpenCVCaptureVideoSource()
 {
+  this->StopProcessingThread();
 }
 
 //----------------------------------------------------------------------------
@@ -57,6 +72,7 @@ void vtkPlusOpenCVCaptureVideoSource::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "VideoURL: " << this->VideoURL << std::endl;
   os << indent << "DeviceIndex: " << this->DeviceIndex << std::endl;
   os << indent << "RequestedCaptureAPI: " << vtkPlusOpenCVCaptureVideoSource::StringFromCaptureAPI(this->RequestedCaptureAPI) << std::endl;
+  os << indent << "ProcessingQueueSize: " << this->ProcessingQueueSize << std::endl;
 
   if (this->CameraMatrix != nullptr)
   {
@@ -122,6 +138,13 @@ PlusStatus vtkPlusOpenCVCaptureVideoSource::ReadConfiguration(vtkXMLDataElement*
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(AutofocusEnabled, deviceConfig);
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(AutoexposureEnabled, deviceConfig);
 
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, ProcessingQueueSize, deviceConfig);
+  if (this->ProcessingQueueSize < 0)
+  {
+    LOG_WARNING("Invalid ProcessingQueueSize: " << this->ProcessingQueueSize << ". Frames will be processed in the capture thread.");
+    this->ProcessingQueueSize = 0;
+  }
+
   return PLUS_SUCCESS;
 }
 
@@ -154,6 +177,8 @@ PlusStatus vtkPlusOpenCVCaptureVideoSource::WriteConfiguration(vtkXMLDataElement
   XML_WRITE_BOOL_ATTRIBUTE(AutofocusEnabled, deviceConfig);
   XML_WRITE_BOOL_ATTRIBUTE(AutoexposureEnabled, deviceConfig);
 
+  deviceConfig->SetIntAttribute("ProcessingQueueSize", this->ProcessingQueueSize);
+
   return PLUS_SUCCESS;
 }
 
@@ -233,15 +258,9 @@ PlusStatus vtkPlusOpenCVCaptureVideoSource::InternalConnect()
   this->AcquisitionRate = cvRound(this->Capture->get(cv::CAP_PROP_FPS));
 
   this->Frame = std::make_shared<cv::Mat>(this->FrameSize[1], this->FrameSize[0], CV_8UC3);
-
-  if (this->CameraMatrix != nullptr && this->DistortionCoefficients != nullptr)
-  {
-    this->UndistortedFrame = std::make_shared<cv::Mat>(this->FrameSize[1], this->FrameSize[0], CV_8UC3);
-  }
-  else
-  {
-    this->UndistortedFrame = this->Frame;
-  }
+  this->ColorConvertedFrame = std::make_shared<cv::Mat>();
+  this->StagingFrame = std::make_shared<cv::Mat>();
+  this->ComputeUndistortionMaps(this->FrameSize[0], this->FrameSize[1]);
 
   if (!this->Capture->isOpened())
   {
@@ -262,13 +281,125 @@ PlusStatus vtkPlusOpenCVCaptureVideoSource::InternalConnect()
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusOpenCVCaptureVideoSource::InternalDisconnect()
 {
+  this->StopProcessingThread();
+
   this->Capture = nullptr; // automatically closes resources/connections
   this->Frame = nullptr;
-  this->UndistortedFrame = nullptr;
+  this->ColorConvertedFrame = nullptr;
+  this->StagingFrame = nullptr;
+  this->UndistortMap1 = nullptr;
+  this->UndistortMap2 = nullptr;
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusOpenCVCaptureVideoSource::InternalStartRecording()
+{
+  this->NumberOfCapturedFrames = 0;
+  this->NumberOfDroppedFrames = 0;
+  this->NumberOfRejectedFrames = 0;
+  this->FrameLatencyHistogram.Reset();
+
+  if (this->ProcessingQueueSize <= 0 || this->ProcessingThreadId >= 0)
+  {
+    return PLUS_SUCCESS;
+  }
+
+  {
+    std::lock_guard<std::mutex> processingLock(this->ProcessingMutex);
+    this->ProcessingActive = true;
+  }
+  this->ProcessingThreadId = this->Threader->SpawnThread((vtkThreadFunctionType)&ProcessingThread, this);
+  if (this->ProcessingThreadId < 0)
+  {
+    LOG_WARNING("Failed to start OpenCV frame processing thread. Frames will be processed in the capture thread.");
+    std::lock_guard<std::mutex> processingLock(this->ProcessingMutex);
+    this->ProcessingActive = false;
+  }
+  return PLUS_SUCCESS;
+}
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusOpenCVCaptureVideoSource::InternalStopRecording()
+{
+  // The capture thread is already stopped, frames that are still in the queue are processed before the thread exits
+  this->StopProcessingThread();
+  LOG_DEBUG(this->GetProcessingReport());
   return PLUS_SUCCESS;
 }
 
+//----------------------------------------------------------------------------
+void vtkPlusOpenCVCaptureVideoSource::StopProcessingThread()
+{
+  if (this->ProcessingThreadId < 0)
+  {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> processingLock(this->ProcessingMutex);
+    this->ProcessingActive = false;
+  }
+  this->ProcessingCondition.notify_all();
+  this->Threader->TerminateThread(this->ProcessingThreadId);
+  this->ProcessingThreadId = -1;
+}
+
+//----------------------------------------------------------------------------
+void* vtkPlusOpenCVCaptureVideoSource::ProcessingThread(vtkMultiThreader::ThreadInfo* data)
+{
+  vtkPlusOpenCVCaptureVideoSource* self = (vtkPlusOpenCVCaptureVideoSource*)(data->UserData);
+  self->RunProcessingLoop();
+  return NULL;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusOpenCVCaptureVideoSource::RunProcessingLoop()
+{
+  while (true)
+  {
+    CapturedFrame frame;
+    {
+      std::unique_lock<std::mutex> processingLock(this->ProcessingMutex);
+      while (this->ProcessingActive && this->ProcessingQueue.empty())
+      {
+        this->ProcessingCondition.wait(processingLock);
+      }
+      if (this->ProcessingQueue.empty())
+      {
+        // stop requested and all frames are processed
+        return;
+      }
+      frame = std::move(this->ProcessingQueue.front());
+      this->ProcessingQueue.pop_front();
+    }
+
+    this->ProcessFrame(frame.Image, frame.FrameNumber, frame.Timestamp);
+
+    {
+      std::lock_guard<std::mutex> processingLock(this->ProcessingMutex);
+      this->FreeImages.push_back(std::move(frame.Image));
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusOpenCVCaptureVideoSource::ComputeUndistortionMaps(int width, int height)
+{
+  this->UndistortMap1 = nullptr;
+  this->UndistortMap2 = nullptr;
+  if (this->CameraMatrix == nullptr || this->DistortionCoefficients == nullptr || width <= 0 || height <= 0)
+  {
+    return;
+  }
+
+  // Same mapping as cv::undistort, but computed only once. Fixed-point maps make cv::remap faster.
+  this->UndistortMap1 = std::make_shared<cv::Mat>();
+  this->UndistortMap2 = std::make_shared<cv::Mat>();
+  cv::initUndistortRectifyMap(*this->CameraMatrix, *this->DistortionCoefficients, cv::Mat(), *this->CameraMatrix,
+                              cv::Size(width, height), CV_16SC2, *this->UndistortMap1, *this->UndistortMap2);
+}
+
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusOpenCVCaptureVideoSource::InternalUpdate()
 {
@@ -280,21 +411,71 @@ PlusStatus vtkPlusOpenCVCaptureVideoSource::InternalUpdate()
     return PLUS_SUCCESS;
   }
 
-  // Capture one frame from the OpenCV capture device
-  if (!this->Capture->read(*this->Frame))
+  // Grab the frame first and decode it later, so that the timestamp is as close to the capture time as possible
+  if (!this->Capture->grab())
   {
     LOG_ERROR("Unable to receive frame");
     return PLUS_FAIL;
   }
+  const double timestamp = vtkIGSIOAccurateTimer::GetSystemTime();
+  const long frameNumber = this->FrameNumber++;
+  this->NumberOfCapturedFrames++;
+
+  if (this->ProcessingThreadId < 0)
+  {
+    if (!this->Capture->retrieve(*this->Frame))
+    {
+      LOG_ERROR("Unable to decode frame");
+      return PLUS_FAIL;
+    }
+    return this->ProcessFrame(*this->Frame, frameNumber, timestamp);
+  }
+
+  CapturedFrame frame;
+  frame.FrameNumber = frameNumber;
+  frame.Timestamp = timestamp;
+  {
+    std::lock_guard<std::mutex> processingLock(this->ProcessingMutex);
+    if (static_cast<int>(this->ProcessingQueue.size()) >= this->ProcessingQueueSize)
+    {
+      // Processing cannot keep up: drop the oldest frame to keep the latency low and reuse its image
+      frame.Image = std::move(this->ProcessingQueue.front().Image);
+      this->ProcessingQueue.pop_front();
+      this->NumberOfDroppedFrames++;
+    }
+    else if (!this->FreeImages.empty())
+    {
+      frame.Image = std::move(this->FreeImages.back());
+      this->FreeImages.pop_back();
+    }
+  }
 
-  if (this->CameraMatrix != nullptr && this->DistortionCoefficients != nullptr)
+  // retrieve() reuses the memory of the image if the frame size has not changed
+  bool retrieved = this->Capture->retrieve(frame.Image);
+  {
+    std::lock_guard<std::mutex> processingLock(this->ProcessingMutex);
+    if (retrieved)
+    {
+      this->ProcessingQueue.push_back(std::move(frame));
+    }
+    else
+    {
+      this->FreeImages.push_back(std::move(frame.Image));
+    }
+  }
+  if (!retrieved)
   {
-    cv::undistort(*this->Frame, *this->UndistortedFrame, *this->CameraMatrix, *this->DistortionCoefficients);
+    LOG_ERROR("Unable to decode frame");
+    return PLUS_FAIL;
   }
+  this->ProcessingCondition.notify_one();
 
-  // BGR -> RGB color
-  cv::cvtColor(*this->UndistortedFrame, *this->UndistortedFrame, cv::COLOR_BGR2RGB);
+  return PLUS_SUCCESS;
+}
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusOpenCVCaptureVideoSource::ProcessFrame(const cv::Mat& capturedFrame, long frameNumber, double timestamp)
+{
   vtkPlusDataSource* aSource(nullptr);
   if (this->GetFirstActiveOutputVideoSource(aSource) == PLUS_FAIL || aSource == nullptr)
   {
@@ -308,21 +489,75 @@ PlusStatus vtkPlusOpenCVCaptureVideoSource::InternalUpdate()
     aSource->SetImageType(US_IMG_RGB_COLOR);
     aSource->SetPixelType(VTK_UNSIGNED_CHAR);
     aSource->SetNumberOfScalarComponents(3);
-    aSource->SetInputFrameSize(this->UndistortedFrame->cols, this->UndistortedFrame->rows, 1);
+    aSource->SetInputFrameSize(capturedFrame.cols, capturedFrame.rows, 1);
+  }
+
+  bool undistort = this->CameraMatrix != nullptr && this->DistortionCoefficients != nullptr;
+  if (undistort && (this->UndistortMap1 == nullptr || this->UndistortMap1->cols != capturedFrame.cols || this->UndistortMap1->rows != capturedFrame.rows))
+  {
+    // the device delivers a different frame size than it reported at connect
+    this->ComputeUndistortionMaps(capturedFrame.cols, capturedFrame.rows);
+  }
+
+  // Write the result directly into the buffer if possible
+  FrameSizeType frameSize = { static_cast<unsigned int>(capturedFrame.cols), static_cast<unsigned int>(capturedFrame.rows), 1 };
+  void* frameData = nullptr;
+  bool reserved = (aSource->ReserveItem(aSource->GetInputImageOrientation(), frameSize, VTK_UNSIGNED_CHAR, 3, US_IMG_RGB_COLOR, frameData) == PLUS_SUCCESS);
+  cv::Mat outputFrame;
+  if (reserved)
+  {
+    outputFrame = cv::Mat(capturedFrame.rows, capturedFrame.cols, CV_8UC3, frameData);
+  }
+  else
+  {
+    this->StagingFrame->create(capturedFrame.rows, capturedFrame.cols, CV_8UC3);
+    outputFrame = *this->StagingFrame;
+  }
+
+  // BGR -> RGB color, undistortion
+  if (undistort)
+  {
+    cv::cvtColor(capturedFrame, *this->ColorConvertedFrame, cv::COLOR_BGR2RGB);
+    cv::remap(*this->ColorConvertedFrame, outputFrame, *this->UndistortMap1, *this->UndistortMap2, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+  }
+  else
+  {
+    cv::cvtColor(capturedFrame, outputFrame, cv::COLOR_BGR2RGB);
   }
 
   // Add the frame to the stream buffer
-  FrameSizeType frameSize = { static_cast<unsigned int>(this->UndistortedFrame->cols), static_cast<unsigned int>(this->UndistortedFrame->rows), 1 };
-  if (aSource->AddItem(this->UndistortedFrame->data, aSource->GetInputImageOrientation(), frameSize, VTK_UNSIGNED_CHAR, 3, US_IMG_RGB_COLOR, 0, this->FrameNumber) == PLUS_FAIL)
+  PlusStatus status = PLUS_FAIL;
+  if (reserved)
   {
+    status = aSource->CommitReservedItem(frameNumber, timestamp);
+  }
+  else
+  {
+    status = aSource->AddItem(this->StagingFrame->data, aSource->GetInputImageOrientation(), frameSize, VTK_UNSIGNED_CHAR, 3, US_IMG_RGB_COLOR, 0, frameNumber, timestamp);
+  }
+  if (status != PLUS_SUCCESS)
+  {
+    this->NumberOfRejectedFrames++;
     return PLUS_FAIL;
   }
 
-  this->FrameNumber++;
-
+  this->FrameLatencyHistogram.RecordValue(vtkIGSIOAccurateTimer::GetSystemTime() - timestamp);
   return PLUS_SUCCESS;
 }
 
+//----------------------------------------------------------------------------
+std::string vtkPlusOpenCVCaptureVideoSource::GetProcessingReport() const
+{
+  std::ostringstream report;
+  report << "OpenCV capture statistics (" << this->GetDeviceId() << "): "
+         << this->NumberOfCapturedFrames << " frames captured, "
+         << this->NumberOfDroppedFrames << " frames dropped before processing ("
+         << std::fixed << std::setprecision(2) << (this->NumberOfCapturedFrames > 0 ? 100.0 * this->NumberOfDroppedFrames / this->NumberOfCapturedFrames : 0.0) << "%), "
+         << this->NumberOfRejectedFrames << " frames rejected by the buffer. Grab to buffer latency: "
+         << this->FrameLatencyHistogram.GetSummary();
+  return report.str();
+}
+
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusOpenCVCaptureVideoSource::NotifyConfigured()
 {
@@ -9,10 +9,17 @@ See License.txt for details.
 
 #include "vtkPlusDataCollectionExport.h"
 #include "vtkPlusDevice.h"
+#include "PlusLatencyHistogram.h"
 
 // OpenCV includes
 #include <opencv2/videoio.hpp>
 
+// STL includes
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
 /*!
 \class vtkPlusOpenCVCaptureVideoSource
 \brief Class for interfacing an OpenCVC capture device and recording frames into a Plus buffer
@@ -20,6 +27,12 @@ See License.txt for details.
 Requires the PLUS_USE_OpenCVCapture_VIDEO option in CMake.
 Requires OpenCV with FFMPEG built (for RTSP support)
 
+The capture thread only grabs the frames (the timestamp is taken right after the grab, before any
+decoding or processing) and passes them to a processing thread, which converts the colors, undistorts
+the image and writes the result directly into the buffer. The undistortion maps are computed once at
+connect. If the processing thread cannot keep up, the oldest waiting frames are dropped (see
+ProcessingQueueSize). With ProcessingQueueSize="0" the frames are processed in the capture thread.
+
 \ingroup PlusLibDataCollection
 */
 
@@ -68,6 +81,19 @@ public:
   vtkGetMacro(FourCC, std::string);
   vtkSetMacro(FourCC, std::string);
 
+  /*! Maximum number of captured frames waiting for processing, 0 means frames are processed in the capture thread */
+  vtkGetMacro(ProcessingQueueSize, int);
+  vtkSetMacro(ProcessingQueueSize, int);
+
+  /*! Number of frames that were grabbed since recording started */
+  unsigned long long GetNumberOfCapturedFrames() const { return this->NumberOfCapturedFrames; }
+  /*! Number of grabbed frames that were dropped because the processing thread could not keep up */
+  unsigned long long GetNumberOfDroppedFrames() const { return this->NumberOfDroppedFrames; }
+  /*! Delay between grabbing the frames and having them in the buffer */
+  const PlusLatencyHistogram& GetFrameLatencyHistogram() const { return this->FrameLatencyHistogram; }
+  /*! Human-readable summary of the capture and processing statistics */
+  std::string GetProcessingReport() const;
+
   static cv::VideoCaptureAPIs CaptureAPIFromString(const std::string& apiString);
   static std::string StringFromCaptureAPI(cv::VideoCaptureAPIs api);
 
@@ -78,12 +104,40 @@ protected:
   virtual PlusStatus InternalConnect();
   virtual PlusStatus InternalDisconnect();
 
+  /*! Start the processing thread */
+  virtual PlusStatus InternalStartRecording();
+  /*! Process the frames that are still waiting and stop the processing thread */
+  virtual PlusStatus InternalStopRecording();
+
+  /*! Compute the undistortion maps for the given frame size (if undistortion is enabled) */
+  void ComputeUndistortionMaps(int width, int height);
+
+  /*! Convert a captured BGR frame to RGB, undistort it and add it to the buffer */
+  PlusStatus ProcessFrame(const cv::Mat& capturedFrame, long frameNumber, double timestamp);
+
+  /*! Take the next frame from the processing queue and process it, until StopProcessingThread is called and the queue is empty */
+  static void* ProcessingThread(vtkMultiThreader::ThreadInfo* data);
+  void RunProcessingLoop();
+  void StopProcessingThread();
+
+  /*! A grabbed frame waiting for processing */
+  struct CapturedFrame
+  {
+    CapturedFrame() : FrameNumber(0), Timestamp(0.0) {}
+    cv::Mat Image;
+    long FrameNumber;
+    double Timestamp;
+  };
+
 protected:
   std::string                       VideoURL;
   int                               DeviceIndex;
   std::shared_ptr<cv::VideoCapture> Capture;
   std::shared_ptr<cv::Mat>          Frame;
-  std::shared_ptr<cv::Mat>          UndistortedFrame;
+  /*! RGB frame before undistortion */
+  std::shared_ptr<cv::Mat>          ColorConvertedFrame;
+  /*! Frame is processed into this image if it cannot be written directly into the buffer */
+  std::shared_ptr<cv::Mat>          StagingFrame;
   cv::VideoCaptureAPIs              RequestedCaptureAPI;
   bool                              AutofocusEnabled;
   bool                              AutoexposureEnabled;
@@ -93,6 +147,26 @@ protected:
 
   std::shared_ptr<cv::Mat>          CameraMatrix;
   std::shared_ptr<cv::Mat>          DistortionCoefficients;
+  /*! Fixed-point undistortion maps for cv::remap, computed by ComputeUndistortionMaps */
+  std::shared_ptr<cv::Mat>          UndistortMap1;
+  std::shared_ptr<cv::Mat>          UndistortMap2;
+
+  int                               ProcessingQueueSize;
+  /*! Identifier of the processing thread, -1 if frames are processed in the capture thread */
+  int                               ProcessingThreadId;
+  /*! Set to false to request the processing thread to stop. Protected by ProcessingMutex. */
+  bool                              ProcessingActive;
+  /*! Frames waiting for processing, oldest first. Protected by ProcessingMutex. */
+  std::deque<CapturedFrame>         ProcessingQueue;
+  /*! Images that have been processed, reused for grabbing the next frames. Protected by ProcessingMutex. */
+  std::vector<cv::Mat>              FreeImages;
+  std::mutex                        ProcessingMutex;
+  std::condition_variable           ProcessingCondition;
+
+  unsigned long long                NumberOfCapturedFrames;
+  unsigned long long                NumberOfDroppedFrames;
+  unsigned long long                NumberOfRejectedFrames;
+  PlusLatencyHistogram              FrameLatencyHistogram;
 };
 
 #endif // __vtkPlusOpenCVCaptureVideoSource_h
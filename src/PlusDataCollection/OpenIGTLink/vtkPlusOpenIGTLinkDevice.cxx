@@ -179,6 +179,9 @@ PlusStatus vtkPlusOpenIGTLinkDevice::SendRequestedMessageTypes()
   // Set message type
   clientInfo.IgtlMessageTypes.push_back(this->MessageType);
 
+  // Plus can decode binary TRACKEDFRAME fields, which are much faster to pack and unpack than XML
+  clientInfo.SetTrackedFrameBinaryFields(true);
+
   // Set any requested image streams
   if (this->ImageMessageEmbeddedTransformName.IsValid())
   {
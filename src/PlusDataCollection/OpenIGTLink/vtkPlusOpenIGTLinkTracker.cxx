@@ -5,6 +5,7 @@ See License.txt for details.
 =========================================================Plus=header=end*/
 
 #include "PlusConfigure.h"
+#include "PlusIgtlBodyReader.h"
 #include "vtkPlusOpenIGTLinkTracker.h"
 
 #include "igtlPositionMessage.h"
@@ -16,12 +17,14 @@ See License.txt for details.
 #include "vtkPlusIgtlMessageCommon.h"
 
 #include <set>
+#include <string.h>
 
 vtkStandardNewMacro(vtkPlusOpenIGTLinkTracker);
 
 //----------------------------------------------------------------------------
 vtkPlusOpenIGTLinkTracker::vtkPlusOpenIGTLinkTracker()
   : UseLastTransformsOnReceiveTimeout(false)
+  , TrackingDataElementMatrix(vtkSmartPointer<vtkMatrix4x4>::New())
 {
   SetToolReferenceFrameName("Reference");
 }
@@ -65,6 +68,7 @@ PlusStatus vtkPlusOpenIGTLinkTracker::InternalDisconnect()
     }
   }
 
+  this->TrackingDataElementTools.clear();
   return Superclass::InternalDisconnect();
 }
 
@@ -96,6 +100,7 @@ PlusStatus vtkPlusOpenIGTLinkTracker::InternalUpdateTData()
 
   igtl::MessageBase::Pointer bodyMsg;
   igtl::MessageHeader::Pointer headerMsg;
+  igtl_header packedHeader;
 
   while (true)
   {
@@ -128,6 +133,8 @@ PlusStatus vtkPlusOpenIGTLinkTracker::InternalUpdateTData()
     }
 
     // We've received valid header data
+    // Keep a copy of the header as received, the body reader needs the body size and CRC in network byte order
+    memcpy(&packedHeader, headerMsg->GetBufferPointer(), IGTL_HEADER_SIZE);
     headerMsg->Unpack(this->IgtlMessageCrcCheckEnabled);
 
     bodyMsg = this->MessageFactory->CreateReceiveMessage(headerMsg);
@@ -142,20 +149,17 @@ PlusStatus vtkPlusOpenIGTLinkTracker::InternalUpdateTData()
     this->ClientSocket->Skip(headerMsg->GetBodySizeToRead(), 0);
   }
 
-  // TDATA message
-  igtl::TrackingDataMessage::Pointer tdataMsg = dynamic_cast<igtl::TrackingDataMessage*>(bodyMsg.GetPointer());
-  tdataMsg->SetMessageHeader(headerMsg);
-  tdataMsg->AllocateBuffer();
-
+  // TDATA message: receive all the elements at once, without unpacking them into element objects
   {
     igsioLockGuard<vtkIGSIORecursiveCriticalSection> socketGuard(this->SocketMutex);
-    this->ClientSocket->Receive(tdataMsg->GetBufferBodyPointer(), tdataMsg->GetBufferBodySize());
-  }
-  int c = tdataMsg->Unpack(this->IgtlMessageCrcCheckEnabled);
-  if (!(c & igtl::MessageHeader::UNPACK_BODY))
-  {
-    LOG_ERROR("Couldn't receive TDATA message from server!");
-    return PLUS_FAIL;
+    PlusIgtlBodyReader bodyReader(this->ClientSocket, packedHeader, headerMsg->GetHeaderVersion(), this->IgtlMessageCrcCheckEnabled != 0);
+    if (bodyReader.Start() != PLUS_SUCCESS
+        || bodyReader.ReadTrackingDataElements(this->TrackingDataElements) != PLUS_SUCCESS
+        || bodyReader.Finish() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Couldn't receive TDATA message from server!");
+      return PLUS_FAIL;
+    }
   }
 
   // for now just use system time, all coordinates will be sequential.
@@ -163,60 +167,50 @@ PlusStatus vtkPlusOpenIGTLinkTracker::InternalUpdateTData()
   double filteredTimestamp = unfilteredTimestamp; // No need to filter already filtered timestamped items received over OpenIGTLink
   // We store the list of identified tools (tools we get information about from the tracker).
   // The tools that are missing from the tracker message are assumed to be out of view.
-  std::set<std::string> identifiedToolSourceIds;
-  for (int i = 0; i < tdataMsg->GetNumberOfTrackingDataElements(); ++ i)
+  std::set<vtkPlusDataSource*> identifiedTools;
+  for (std::vector<igtl_tdata_element>::const_iterator elementIt = this->TrackingDataElements.begin(); elementIt != this->TrackingDataElements.end(); ++elementIt)
   {
-    igtl::TrackingDataElement::Pointer tdataElem = igtl::TrackingDataElement::New();
-    tdataMsg->GetTrackingDataElement(i, tdataElem);
-
-    igtl::Matrix4x4 igtlMatrix;
-    tdataElem->GetMatrix(igtlMatrix);
-    vtkSmartPointer<vtkMatrix4x4> toolMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-    // convert igtl matrix to vtk matrix
-    for (int r = 0; r < 4; r++)
+    // convert igtl matrix to vtk matrix (same element order as in igtl::TrackingDataMessage)
+    for (int r = 0; r < 3; r++)
     {
-      for (int c = 0; c < 4; c++)
-      {
-        toolMatrix->SetElement(r, c, igtlMatrix[r][c]);
-      }
+      this->TrackingDataElementMatrix->SetElement(r, 0, elementIt->transform[r]);
+      this->TrackingDataElementMatrix->SetElement(r, 1, elementIt->transform[r + 3]);
+      this->TrackingDataElementMatrix->SetElement(r, 2, elementIt->transform[r + 6]);
+      this->TrackingDataElementMatrix->SetElement(r, 3, elementIt->transform[r + 9]);
     }
-
-    // Get timestamp
-    igtl::TimeStamp::Pointer igtlTimestamp = igtl::TimeStamp::New();
-    tdataMsg->GetTimeStamp(igtlTimestamp);
-
-    // Get igtl transform name
-    std::string igtlTransformName = tdataElem->GetName();
-
-    // Set internal transform name
-    igsioTransformName transformName;
-    if (igtlTransformName.find("To") != std::string::npos)
+    this->TrackingDataElementMatrix->SetElement(3, 0, 0.0);
+    this->TrackingDataElementMatrix->SetElement(3, 1, 0.0);
+    this->TrackingDataElementMatrix->SetElement(3, 2, 0.0);
+    this->TrackingDataElementMatrix->SetElement(3, 3, 1.0);
+
+    // The element name is not null-terminated if it is IGTL_TDATA_LEN characters long
+    std::string igtlTransformName(elementIt->name, strnlen(elementIt->name, IGTL_TDATA_LEN));
+    vtkPlusDataSource* tool = this->GetTrackingDataElementTool(igtlTransformName);
+    if (tool == NULL)
     {
-      // Plus style transform name sent
-      transformName = igtlTransformName;
-    }
-    else
-    {
-      // Brainlab style transform name sent
-      transformName = igsioTransformName(igtlTransformName.c_str(), this->ToolReferenceFrameName);
+      // unknown tool, already reported
+      continue;
     }
 
-    if (this->ToolTimeStampedUpdateWithoutFiltering(transformName.GetTransformName().c_str(), toolMatrix, TOOL_OK, unfilteredTimestamp, filteredTimestamp) == PLUS_SUCCESS)
+    // This device has no frame numbering, just auto increment tool frame number if new frame received
+    unsigned long frameNumber = tool->GetFrameNumber() + 1;
+    if (tool->AddTimeStampedItem(this->TrackingDataElementMatrix, TOOL_OK, frameNumber, unfilteredTimestamp, filteredTimestamp) == PLUS_SUCCESS)
     {
-      identifiedToolSourceIds.insert(transformName.GetTransformName());
+      identifiedTools.insert(tool);
     }
     else
     {
-      LOG_INFO("ToolTimeStampedUpdate failed for tool: " << transformName.From() << " with timestamp: " << std::fixed << unfilteredTimestamp);
+      LOG_INFO("ToolTimeStampedUpdate failed for tool: " << tool->GetId() << " with timestamp: " << std::fixed << unfilteredTimestamp);
       // DO NOT return here: we want to update the other tools.
     }
+    tool->SetFrameNumber(frameNumber);
   }
   // Set status for non-detected tools
   vtkSmartPointer<vtkMatrix4x4> toolMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
   toolMatrix->Identity();
   for (DataSourceContainerConstIterator it = this->GetToolIteratorBegin(); it != this->GetToolIteratorEnd(); ++it)
   {
-    if (identifiedToolSourceIds.find(it->second->GetId()) != identifiedToolSourceIds.end())
+    if (identifiedTools.find(it->second) != identifiedTools.end())
     {
       // this tool has been found and update has been already called with the correct transform
       LOG_TRACE("Tool " << it->second->GetId() << ": found");
@@ -228,6 +222,43 @@ PlusStatus vtkPlusOpenIGTLinkTracker::InternalUpdateTData()
   return PLUS_SUCCESS;
 }
 
+//----------------------------------------------------------------------------
+vtkPlusDataSource* vtkPlusOpenIGTLinkTracker::GetTrackingDataElementTool(const std::string& elementName)
+{
+  std::map<std::string, vtkPlusDataSource*>::const_iterator toolIt = this->TrackingDataElementTools.find(elementName);
+  if (toolIt != this->TrackingDataElementTools.end())
+  {
+    return toolIt->second;
+  }
+
+  // Set internal transform name
+  igsioTransformName transformName;
+  if (elementName.find("To") != std::string::npos)
+  {
+    // Plus style transform name sent
+    transformName = elementName;
+  }
+  else
+  {
+    // Brainlab style transform name sent
+    transformName = igsioTransformName(elementName.c_str(), this->ToolReferenceFrameName);
+  }
+
+  vtkPlusDataSource* tool = NULL;
+  if (this->GetTool(transformName.GetTransformName(), tool) != PLUS_SUCCESS)
+  {
+    if (this->ReportedUnknownTools.find(transformName.GetTransformName()) == this->ReportedUnknownTools.end())
+    {
+      // We have not reported yet that this tool is unknown
+      LOG_ERROR("Failed to update tool - unable to find tool: " << transformName.GetTransformName());
+      this->ReportedUnknownTools.insert(transformName.GetTransformName());
+    }
+    return NULL;
+  }
+  this->TrackingDataElementTools[elementName] = tool;
+  return tool;
+}
+
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusOpenIGTLinkTracker::InternalUpdateGeneral()
 {
@@ -12,6 +12,15 @@
 #include "vtkPlusOpenIGTLinkDevice.h"
 #include "vtkPlusIgtlMessageFactory.h"
 
+// IGTL includes
+#include <igtl_tdata.h>
+
+// STL includes
+#include <map>
+#include <vector>
+
+class vtkMatrix4x4;
+
 /*!
 \class vtkPlusOpenIGTLinkTracker
 \brief OpenIGTLink tracker client
@@ -56,9 +65,15 @@ protected:
   /*! Process a single TRANSFORM or POSITION message */
   PlusStatus ProcessTransformMessageGeneral(bool& moreMessagesPossible);
 
-  /*! Process a TDATA message (add all the received transforms to the buffers) */
+  /*!
+    Process a TDATA message (add all the received transforms to the buffers).
+    The elements of the message are received in one piece and added to the tool buffers directly, without creating message objects.
+  */
   PlusStatus InternalUpdateTData();
 
+  /*! Get the tool that corresponds to a TDATA element name. Returns NULL if there is no such tool. */
+  vtkPlusDataSource* GetTrackingDataElementTool(const std::string& elementName);
+
   /*!
     Store the latest transforms again in the buffers with the provided timestamp.
     If no transforms are defined then identity transform will be stored.
@@ -78,6 +93,15 @@ protected:
   /*! Use the last known transform value if not received a new value. Useful for servers that only notify about changes in the transforms. */
   bool UseLastTransformsOnReceiveTimeout;
 
+  /*! Elements of the last received TDATA message (in host byte order), kept to avoid reallocation for each message */
+  std::vector<igtl_tdata_element> TrackingDataElements;
+
+  /*! Tools of the received TDATA element names. Cleared when disconnected. */
+  std::map<std::string, vtkPlusDataSource*> TrackingDataElementTools;
+
+  /*! Matrix of the TDATA element that is being added to the tool buffer */
+  vtkSmartPointer<vtkMatrix4x4> TrackingDataElementMatrix;
+
 private:
   vtkPlusOpenIGTLinkTracker(const vtkPlusOpenIGTLinkTracker&);
   void operator=(const vtkPlusOpenIGTLinkTracker&);
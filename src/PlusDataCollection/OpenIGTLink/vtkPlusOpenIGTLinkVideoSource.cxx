@@ -6,6 +6,7 @@ See License.txt for details.
 
 // Plus includes
 #include "PlusConfigure.h"
+#include "PlusIgtlBodyReader.h"
 #include "vtkPlusChannel.h"
 #include "vtkPlusDataSource.h"
 #include "vtkPlusIgtlMessageCommon.h"
@@ -16,12 +17,14 @@ See License.txt for details.
 
 // VTK includes
 #include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
 #include <vtkObjectFactory.h>
 
 vtkStandardNewMacro(vtkPlusOpenIGTLinkVideoSource);
 
 //----------------------------------------------------------------------------
 vtkPlusOpenIGTLinkVideoSource::vtkPlusOpenIGTLinkVideoSource()
+  : DirectImageReceive(true)
 {
   this->RequireImageOrientationInConfiguration = true;
 }
@@ -35,6 +38,7 @@ vtkPlusOpenIGTLinkVideoSource::~vtkPlusOpenIGTLinkVideoSource()
 void vtkPlusOpenIGTLinkVideoSource::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "DirectImageReceive: " << (this->DirectImageReceive ? "TRUE" : "FALSE") << std::endl;
 }
 
 //----------------------------------------------------------------------------
@@ -66,11 +70,19 @@ PlusStatus vtkPlusOpenIGTLinkVideoSource::InternalUpdate()
   }
 
   // We've received valid header data
+  // Keep a copy of the header as received, the direct receive path needs the body size and CRC in network byte order
+  igtl_header packedHeader;
+  memcpy(&packedHeader, headerMsg->GetBufferPointer(), IGTL_HEADER_SIZE);
   headerMsg->Unpack(this->IgtlMessageCrcCheckEnabled);
 
   // Set unfiltered and filtered timestamp by converting UTC to system timestamp
   double unfilteredTimestamp = vtkIGSIOAccurateTimer::GetSystemTime();
 
+  if (this->DirectImageReceive && strcmp(headerMsg->GetDeviceType(), "IMAGE") == 0)
+  {
+    return this->ReceiveImageMessageDirect(packedHeader, headerMsg, unfilteredTimestamp);
+  }
+
   igsioTrackedFrame trackedFrame;
   igtl::MessageBase::Pointer bodyMsg = this->MessageFactory->CreateReceiveMessage(headerMsg);
 
@@ -147,11 +159,133 @@ PlusStatus vtkPlusOpenIGTLinkVideoSource::InternalUpdate()
   return status;
 }
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusOpenIGTLinkVideoSource::ReceiveImageMessageDirect(const igtl_header& packedHeader, igtl::MessageHeader* headerMsg, double unfilteredTimestamp)
+{
+  vtkPlusDataSource* aSource = NULL;
+  if (this->GetFirstActiveOutputVideoSource(aSource) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to retrieve the video source in the OpenIGTLinkVideo device.");
+    igsioLockGuard<vtkIGSIORecursiveCriticalSection> socketGuard(this->SocketMutex);
+    this->ClientSocket->Skip(headerMsg->GetBodySizeToRead(), 0);
+    return PLUS_FAIL;
+  }
+
+  // If the frame can be stored in the buffer as is then the pixel data is received into the buffer,
+  // otherwise into a temporary frame that is added to the buffer the same way as unpacked image messages
+  bool frameReserved = false;
+  igsioVideoFrame receivedFrame;
+  igtl_image_header imageHeader;
+  {
+    igsioLockGuard<vtkIGSIORecursiveCriticalSection> socketGuard(this->SocketMutex);
+    PlusIgtlBodyReader bodyReader(this->ClientSocket, packedHeader, headerMsg->GetHeaderVersion(), this->IgtlMessageCrcCheckEnabled != 0);
+    if (bodyReader.Start() != PLUS_SUCCESS || bodyReader.ReadImageHeader(imageHeader) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Couldn't get image from OpenIGTLink server!");
+      return PLUS_FAIL;
+    }
+
+    FrameSizeType frameSize = { imageHeader.size[0], imageHeader.size[1], imageHeader.size[2] };
+    if (imageHeader.subvol_size[0] != imageHeader.size[0] || imageHeader.subvol_size[1] != imageHeader.size[1] || imageHeader.subvol_size[2] != imageHeader.size[2]
+        || imageHeader.subvol_offset[0] != 0 || imageHeader.subvol_offset[1] != 0 || imageHeader.subvol_offset[2] != 0)
+    {
+      LOG_ERROR("Couldn't get image from OpenIGTLink server - receiving partial image volumes is not supported");
+      bodyReader.Finish();
+      return PLUS_FAIL;
+    }
+    igsioCommon::VTKScalarPixelType pixelType = PlusCommon::GetVTKScalarPixelTypeFromIGTL(imageHeader.scalar_type);
+    unsigned int numberOfScalarComponents = imageHeader.num_components;
+    // Set the image type to support color images (same as in vtkPlusIgtlMessageCommon::UnpackImageMessage)
+    US_IMAGE_TYPE imageType = US_IMG_BRIGHTNESS;
+    if (imageHeader.scalar_type == igtl::ImageMessage::TYPE_INT8 && imageHeader.num_components == igtl::ImageMessage::DTYPE_VECTOR)
+    {
+      imageType = US_IMG_RGB_COLOR;
+    }
+    igtlUint64 frameSizeInBytes = igtl_image_get_data_size(&imageHeader);
+    if (frameSizeInBytes > bodyReader.GetRemainingContentSize())
+    {
+      LOG_ERROR("Couldn't get image from OpenIGTLink server - message is too short for a " << frameSize[0] << "x" << frameSize[1] << "x" << frameSize[2] << " image");
+      bodyReader.Finish();
+      return PLUS_FAIL;
+    }
+
+    // If the buffer is empty, set the pixel type and frame size to the first received properties
+    if (aSource->GetNumberOfItems() == 0)
+    {
+      aSource->SetPixelType(pixelType);
+      aSource->SetNumberOfScalarComponents(numberOfScalarComponents);
+      aSource->SetImageType(imageType);
+      aSource->SetInputFrameSize(frameSize);
+    }
+
+    // Received images have the same orientation as frames unpacked from image messages
+    void* frameDataPtr = NULL;
+    frameReserved = (aSource->ReserveItem(US_IMG_ORIENT_MF, frameSize, pixelType, numberOfScalarComponents, imageType, frameDataPtr) == PLUS_SUCCESS);
+    if (!frameReserved)
+    {
+      if (receivedFrame.AllocateFrame(frameSize, pixelType, numberOfScalarComponents) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to allocate image data for received frame!");
+        bodyReader.Finish();
+        return PLUS_FAIL;
+      }
+      receivedFrame.SetImageType(imageType);
+      frameDataPtr = receivedFrame.GetScalarPointer();
+    }
+
+    if (bodyReader.Read(frameDataPtr, frameSizeInBytes) != PLUS_SUCCESS || bodyReader.Finish() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Couldn't get image from OpenIGTLink server!");
+      if (frameReserved)
+      {
+        aSource->CancelReservedItem();
+      }
+      return PLUS_FAIL;
+    }
+  }
+
+  igsioFieldMapType customFields;
+  if (this->ImageMessageEmbeddedTransformName.IsValid())
+  {
+    vtkSmartPointer<vtkMatrix4x4> imageToReferenceMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    if (PlusIgtlBodyReader::GetImageToReferenceMatrix(imageHeader, imageToReferenceMatrix) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to unpack image message - unable to extract IJKToRAS transform");
+      if (frameReserved)
+      {
+        aSource->CancelReservedItem();
+      }
+      return PLUS_FAIL;
+    }
+    igsioTrackedFrame transformFrame;
+    transformFrame.SetFrameTransform(this->ImageMessageEmbeddedTransformName, imageToReferenceMatrix);
+    customFields = transformFrame.GetCustomFields();
+  }
+
+  // No need to filter already filtered timestamped items received over OpenIGTLink
+  double filteredTimestamp = unfilteredTimestamp;
+  this->FrameNumber++;
+
+  PlusStatus status = PLUS_SUCCESS;
+  if (frameReserved)
+  {
+    status = aSource->CommitReservedItem(this->FrameNumber, unfilteredTimestamp, filteredTimestamp, &customFields);
+  }
+  else
+  {
+    status = aSource->AddItem(&receivedFrame, this->FrameNumber, unfilteredTimestamp, filteredTimestamp, &customFields);
+  }
+  this->Modified();
+
+  return status;
+}
+
 //-----------------------------------------------------------------------------
 PlusStatus vtkPlusOpenIGTLinkVideoSource::ReadConfiguration(vtkXMLDataElement* rootConfigElement)
 {
   XML_FIND_DEVICE_ELEMENT_REQUIRED_FOR_READING(deviceConfig, rootConfigElement);
   XML_READ_STRING_ATTRIBUTE_OPTIONAL(ImageMessageEmbeddedTransformName, deviceConfig);
+  XML_READ_BOOL_ATTRIBUTE_OPTIONAL(DirectImageReceive, deviceConfig);
   return PLUS_SUCCESS;
 }
 
@@ -160,6 +294,7 @@ PlusStatus vtkPlusOpenIGTLinkVideoSource::WriteConfiguration(vtkXMLDataElement*
 {
   XML_FIND_DEVICE_ELEMENT_REQUIRED_FOR_WRITING(deviceConfig, rootConfigElement);
   deviceConfig->SetAttribute("ImageMessageEmbeddedTransformName", this->ImageMessageEmbeddedTransformName.GetTransformName().c_str());
+  XML_WRITE_BOOL_ATTRIBUTE(DirectImageReceive, deviceConfig);
   return PLUS_SUCCESS;
 }
 
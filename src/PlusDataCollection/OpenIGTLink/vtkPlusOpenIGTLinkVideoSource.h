@@ -12,6 +12,9 @@
 #include "vtkPlusOpenIGTLinkDevice.h"
 #include "vtkPlusIgtlMessageFactory.h"
 
+// IGTL includes
+#include <igtl_header.h>
+
 /*!
   \class vtkPlusOpenIGTLinkVideoSource
   \brief VTK interface for video input from OpenIGTLink image message
@@ -44,10 +47,28 @@ public:
   /*! Verify the device is correctly configured */
   virtual PlusStatus NotifyConfigured();
 
+  /*!
+    If enabled then the pixel data of IMAGE messages is received directly into the video buffer,
+    without unpacking the message and copying the frame. Frames that need clipping or reorientation
+    are still received into a temporary frame. Enabled by default.
+  */
+  vtkSetMacro(DirectImageReceive, bool);
+  vtkGetMacro(DirectImageReceive, bool);
+  vtkBooleanMacro(DirectImageReceive, bool);
+
 protected:
   vtkPlusOpenIGTLinkVideoSource();
   virtual ~vtkPlusOpenIGTLinkVideoSource();
 
+  /*!
+    Receive the body of an IMAGE message and add the image to the video buffer.
+    \param packedHeader Message header in network byte order (as received)
+  */
+  PlusStatus ReceiveImageMessageDirect(const igtl_header& packedHeader, igtl::MessageHeader* headerMsg, double unfilteredTimestamp);
+
+  /*! Receive IMAGE message pixel data directly into the video buffer */
+  bool DirectImageReceive;
+
 private:
   vtkPlusOpenIGTLinkVideoSource(const vtkPlusOpenIGTLinkVideoSource&);   // Not implemented.
   void operator=(const vtkPlusOpenIGTLinkVideoSource&);   // Not implemented.
@@ -0,0 +1,341 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+// Local includes
+#include "PlusConfigure.h"
+#include "PlusCaptureScheduler.h"
+
+// IGSIO includes
+#include <vtkIGSIOAccurateTimer.h>
+
+// STL includes
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+
+// System includes
+#if defined(_WIN32)
+  #include <windows.h>
+#elif defined(__linux__)
+  #include <errno.h>
+  #include <pthread.h>
+  #include <sched.h>
+  #include <string.h>
+  #include <time.h>
+#elif defined(__APPLE__)
+  #include <pthread.h>
+  #include <sched.h>
+  #include <string.h>
+#endif
+
+//----------------------------------------------------------------------------
+PlusCaptureScheduler::PlusCaptureScheduler()
+  : RealTimePriority(0)
+  , PeriodSec(1.0 / 30.0)
+  , NextDeadline(0.0)
+  , NumberOfOverruns(0)
+{
+}
+
+//----------------------------------------------------------------------------
+PlusCaptureScheduler::~PlusCaptureScheduler()
+{
+}
+
+//----------------------------------------------------------------------------
+void PlusCaptureScheduler::SetCpuAffinity(const std::vector<int>& cpuIndices)
+{
+  this->CpuAffinity = cpuIndices;
+}
+
+//----------------------------------------------------------------------------
+const std::vector<int>& PlusCaptureScheduler::GetCpuAffinity() const
+{
+  return this->CpuAffinity;
+}
+
+//----------------------------------------------------------------------------
+void PlusCaptureScheduler::SetRealTimePriority(int priority)
+{
+  this->RealTimePriority = priority;
+}
+
+//----------------------------------------------------------------------------
+int PlusCaptureScheduler::GetRealTimePriority() const
+{
+  return this->RealTimePriority;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusCaptureScheduler::ConfigureCurrentThread(const std::string& ownerName)
+{
+  PlusStatus status = PLUS_SUCCESS;
+
+  if (!this->CpuAffinity.empty())
+  {
+#if defined(__linux__)
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (std::vector<int>::const_iterator it = this->CpuAffinity.begin(); it != this->CpuAffinity.end(); ++it)
+    {
+      if (*it >= 0 && *it < CPU_SETSIZE)
+      {
+        CPU_SET(*it, &cpuSet);
+      }
+    }
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet);
+    if (err != 0)
+    {
+      LOG_WARNING(ownerName << ": Failed to set capture thread CPU affinity to " << CpuListToString(this->CpuAffinity) << ": " << strerror(err));
+      status = PLUS_FAIL;
+    }
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (std::vector<int>::const_iterator it = this->CpuAffinity.begin(); it != this->CpuAffinity.end(); ++it)
+    {
+      if (*it >= 0 && *it < static_cast<int>(sizeof(DWORD_PTR) * 8))
+      {
+        mask |= (static_cast<DWORD_PTR>(1) << *it);
+      }
+    }
+    if (mask == 0 || SetThreadAffinityMask(GetCurrentThread(), mask) == 0)
+    {
+      LOG_WARNING(ownerName << ": Failed to set capture thread CPU affinity to " << CpuListToString(this->CpuAffinity));
+      status = PLUS_FAIL;
+    }
+#else
+    LOG_WARNING(ownerName << ": Capture thread CPU affinity is not supported on this platform. Ignoring CPU list " << CpuListToString(this->CpuAffinity));
+    status = PLUS_FAIL;
+#endif
+  }
+
+  if (this->RealTimePriority > 0)
+  {
+#if defined(__linux__) || defined(__APPLE__)
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = std::max(sched_get_priority_min(SCHED_FIFO), std::min(this->RealTimePriority, sched_get_priority_max(SCHED_FIFO)));
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0)
+    {
+      LOG_WARNING(ownerName << ": Failed to set SCHED_FIFO priority " << param.sched_priority << " for capture thread (" << strerror(err) << "). Real-time scheduling typically requires CAP_SYS_NICE or an rtprio limit.");
+      status = PLUS_FAIL;
+    }
+#elif defined(_WIN32)
+    if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) == 0)
+    {
+      LOG_WARNING(ownerName << ": Failed to set time-critical priority for capture thread");
+      status = PLUS_FAIL;
+    }
+#else
+    LOG_WARNING(ownerName << ": Real-time capture thread priority is not supported on this platform");
+    status = PLUS_FAIL;
+#endif
+  }
+
+  if (status == PLUS_SUCCESS && (!this->CpuAffinity.empty() || this->RealTimePriority > 0))
+  {
+    LOG_INFO(ownerName << ": Capture thread configured (CPU affinity: " << (this->CpuAffinity.empty() ? std::string("any") : CpuListToString(this->CpuAffinity))
+             << ", real-time priority: " << this->RealTimePriority << ")");
+  }
+
+  return status;
+}
+
+//----------------------------------------------------------------------------
+void PlusCaptureScheduler::Start(double periodSec)
+{
+  this->SetPeriodSec(periodSec);
+  this->NextDeadline = GetMonotonicTime() + this->PeriodSec.load();
+}
+
+//----------------------------------------------------------------------------
+void PlusCaptureScheduler::SetPeriodSec(double periodSec)
+{
+  if (!(periodSec > 0) || !std::isfinite(periodSec))
+  {
+    LOG_ERROR("Invalid capture period: " << periodSec << " sec. Period must be positive and finite.");
+    return;
+  }
+  this->PeriodSec.store(periodSec);
+}
+
+//----------------------------------------------------------------------------
+double PlusCaptureScheduler::GetPeriodSec() const
+{
+  return this->PeriodSec.load();
+}
+
+//----------------------------------------------------------------------------
+void PlusCaptureScheduler::WaitForNextDeadline()
+{
+  double now = GetMonotonicTime();
+  if (now < this->NextDeadline)
+  {
+    SleepUntil(this->NextDeadline);
+    now = GetMonotonicTime();
+  }
+  this->WakeUpLatenessHistogram.RecordValue(now - this->NextDeadline);
+
+  const double periodSec = this->PeriodSec.load();
+  this->NextDeadline += periodSec;
+  if (this->NextDeadline < now)
+  {
+    // A full period was missed (update took too long or the thread was preempted).
+    // Do not try to catch up with a burst of updates, just restart the schedule.
+    this->NumberOfOverruns.fetch_add(1, std::memory_order_relaxed);
+    this->NextDeadline = now + periodSec;
+  }
+}
+
+//----------------------------------------------------------------------------
+void PlusCaptureScheduler::RecordUpdateDuration(double durationSec)
+{
+  this->UpdateDurationHistogram.RecordValue(durationSec);
+}
+
+//----------------------------------------------------------------------------
+unsigned long long PlusCaptureScheduler::GetNumberOfOverruns() const
+{
+  return this->NumberOfOverruns.load(std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+const PlusLatencyHistogram& PlusCaptureScheduler::GetUpdateDurationHistogram() const
+{
+  return this->UpdateDurationHistogram;
+}
+
+//----------------------------------------------------------------------------
+const PlusLatencyHistogram& PlusCaptureScheduler::GetWakeUpLatenessHistogram() const
+{
+  return this->WakeUpLatenessHistogram;
+}
+
+//----------------------------------------------------------------------------
+void PlusCaptureScheduler::ResetStatistics()
+{
+  this->UpdateDurationHistogram.Reset();
+  this->WakeUpLatenessHistogram.Reset();
+  this->NumberOfOverruns.store(0, std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+std::string PlusCaptureScheduler::GetStatisticsReport() const
+{
+  std::ostringstream report;
+  report << "Period: " << this->GetPeriodSec() * 1000.0 << "ms, overruns: " << this->GetNumberOfOverruns() << std::endl;
+  report << "InternalUpdate duration: " << this->UpdateDurationHistogram.GetSummary() << std::endl;
+  report << "Wake-up lateness: " << this->WakeUpLatenessHistogram.GetSummary() << std::endl;
+  return report.str();
+}
+
+//----------------------------------------------------------------------------
+double PlusCaptureScheduler::GetMonotonicTime()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//----------------------------------------------------------------------------
+void PlusCaptureScheduler::SleepUntil(double monotonicTimeSec)
+{
+#if defined(__linux__)
+  // steady_clock is CLOCK_MONOTONIC in both libstdc++ and libc++ on Linux
+  struct timespec deadline;
+  deadline.tv_sec = static_cast<time_t>(monotonicTimeSec);
+  deadline.tv_nsec = static_cast<long>((monotonicTimeSec - deadline.tv_sec) * 1e9);
+  if (deadline.tv_nsec >= 1000000000L)
+  {
+    deadline.tv_sec += 1;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+  {
+    // Interrupted by a signal, the deadline is absolute so just sleep again
+  }
+#else
+  // No absolute-deadline sleep available, use the accurate timer for the remaining time
+  double remainingSec = monotonicTimeSec - GetMonotonicTime();
+  if (remainingSec > 0)
+  {
+    vtkIGSIOAccurateTimer::Delay(remainingSec);
+  }
+#endif
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusCaptureScheduler::ParseCpuList(const std::string& cpuListStr, std::vector<int>& cpuIndices)
+{
+  cpuIndices.clear();
+  std::vector<std::string> items = igsioCommon::SplitStringIntoTokens(cpuListStr, ',', false);
+  for (std::vector<std::string>::iterator it = items.begin(); it != items.end(); ++it)
+  {
+    std::string item = igsioCommon::Trim(*it);
+    size_t dashPos = item.find('-');
+    int first = -1;
+    int last = -1;
+    if (dashPos == std::string::npos)
+    {
+      if (igsioCommon::StringToInt<int>(item.c_str(), first) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Invalid CPU index '" << item << "' in CPU list '" << cpuListStr << "'");
+        return PLUS_FAIL;
+      }
+      last = first;
+    }
+    else
+    {
+      if (igsioCommon::StringToInt<int>(item.substr(0, dashPos).c_str(), first) != PLUS_SUCCESS
+          || igsioCommon::StringToInt<int>(item.substr(dashPos + 1).c_str(), last) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Invalid CPU range '" << item << "' in CPU list '" << cpuListStr << "'");
+        return PLUS_FAIL;
+      }
+    }
+    if (first < 0 || last < first)
+    {
+      LOG_ERROR("Invalid CPU range '" << item << "' in CPU list '" << cpuListStr << "'");
+      return PLUS_FAIL;
+    }
+    for (int cpu = first; cpu <= last; ++cpu)
+    {
+      if (std::find(cpuIndices.begin(), cpuIndices.end(), cpu) == cpuIndices.end())
+      {
+        cpuIndices.push_back(cpu);
+      }
+    }
+  }
+  std::sort(cpuIndices.begin(), cpuIndices.end());
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+std::string PlusCaptureScheduler::CpuListToString(const std::vector<int>& cpuIndices)
+{
+  std::vector<int> sorted(cpuIndices);
+  std::sort(sorted.begin(), sorted.end());
+  std::ostringstream os;
+  for (size_t i = 0; i < sorted.size();)
+  {
+    size_t j = i;
+    while (j + 1 < sorted.size() && sorted[j + 1] == sorted[j] + 1)
+    {
+      ++j;
+    }
+    if (i > 0)
+    {
+      os << ",";
+    }
+    os << sorted[i];
+    if (j > i)
+    {
+      os << "-" << sorted[j];
+    }
+    i = j + 1;
+  }
+  return os.str();
+}
@@ -0,0 +1,119 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __PlusCaptureScheduler_h
+#define __PlusCaptureScheduler_h
+
+#include "vtkPlusDataCollectionExport.h"
+
+// Local includes
+#include "PlusCommon.h"
+#include "PlusLatencyHistogram.h"
+
+// STL includes
+#include <atomic>
+#include <string>
+#include <vector>
+
+/*!
+  \class PlusCaptureScheduler
+  \brief Absolute-deadline pacing of a device data capture thread
+
+  The data capture thread of vtkPlusDevice calls InternalUpdate() periodically. Instead of
+  sleeping for a relative delay after each update (which lets wake-up latency accumulate),
+  the scheduler keeps an absolute deadline on a monotonic clock and sleeps until it
+  (clock_nanosleep with TIMER_ABSTIME on Linux). If the thread falls behind by more than a
+  full period, the schedule is re-synchronized instead of trying to catch up with a burst of
+  updates.
+
+  Optionally the capture thread can be pinned to a set of CPUs and run with real-time
+  (SCHED_FIFO) priority. Failure to apply these settings (e.g., missing privileges) is
+  reported as a warning and acquisition continues with default scheduling.
+
+  InternalUpdate() duration and wake-up lateness are recorded in lock-free histograms that
+  can be queried while acquisition is running.
+
+  \ingroup PlusLibDataCollection
+*/
+class vtkPlusDataCollectionExport PlusCaptureScheduler
+{
+public:
+  PlusCaptureScheduler();
+  virtual ~PlusCaptureScheduler();
+
+  /*! Set CPU indices that the capture thread is allowed to run on. Empty list means no restriction. */
+  void SetCpuAffinity(const std::vector<int>& cpuIndices);
+  const std::vector<int>& GetCpuAffinity() const;
+
+  /*! Set real-time (SCHED_FIFO) priority of the capture thread. 0 means default (non-real-time) scheduling. */
+  void SetRealTimePriority(int priority);
+  int GetRealTimePriority() const;
+
+  /*!
+    Apply CPU affinity and real-time priority to the calling thread.
+    \param ownerName Name used in log messages (typically the device id)
+  */
+  PlusStatus ConfigureCurrentThread(const std::string& ownerName);
+
+  /*! Start a new schedule. The first deadline is one period from now. */
+  void Start(double periodSec);
+
+  /*! Change the period of a running schedule. Takes effect from the next deadline. */
+  void SetPeriodSec(double periodSec);
+  double GetPeriodSec() const;
+
+  /*!
+    Sleep until the current deadline then advance the deadline by one period.
+    Wake-up lateness is recorded in the lateness histogram.
+  */
+  void WaitForNextDeadline();
+
+  /*! Record the duration of one InternalUpdate() call */
+  void RecordUpdateDuration(double durationSec);
+
+  /*! Number of times the schedule had to be re-synchronized because a whole period was missed */
+  unsigned long long GetNumberOfOverruns() const;
+
+  /*! Histogram of InternalUpdate() durations */
+  const PlusLatencyHistogram& GetUpdateDurationHistogram() const;
+  /*! Histogram of the difference between actual wake-up time and the deadline */
+  const PlusLatencyHistogram& GetWakeUpLatenessHistogram() const;
+
+  /*! Clear all collected statistics */
+  void ResetStatistics();
+
+  /*! Multi-line human-readable summary of the collected statistics */
+  std::string GetStatisticsReport() const;
+
+  /*! Current value of a monotonic clock, in seconds. Not related to system time. */
+  static double GetMonotonicTime();
+
+  /*! Parse a CPU list such as "2,3" or "0-3,6" */
+  static PlusStatus ParseCpuList(const std::string& cpuListStr, std::vector<int>& cpuIndices);
+  /*! Create a compact string representation of a CPU list (inverse of ParseCpuList) */
+  static std::string CpuListToString(const std::vector<int>& cpuIndices);
+
+protected:
+  static void SleepUntil(double monotonicTimeSec);
+
+  std::vector<int> CpuAffinity;
+  int RealTimePriority;
+
+  /*! Written by the capture thread, read by other threads for reporting */
+  std::atomic<double> PeriodSec;
+  /*! Only accessed by the capture thread */
+  double NextDeadline;
+
+  std::atomic<unsigned long long> NumberOfOverruns;
+  PlusLatencyHistogram UpdateDurationHistogram;
+  PlusLatencyHistogram WakeUpLatenessHistogram;
+
+private:
+  PlusCaptureScheduler(const PlusCaptureScheduler&);  // Not implemented.
+  void operator=(const PlusCaptureScheduler&);  // Not implemented.
+};
+
+#endif //__PlusCaptureScheduler_h
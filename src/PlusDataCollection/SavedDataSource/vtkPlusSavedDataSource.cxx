@@ -16,6 +16,8 @@ See License.txt for details.
 #include "vtkIGSIOTrackedFrameList.h"
 #include "vtksys/SystemTools.hxx"
 
+#include <algorithm>
+
 vtkStandardNewMacro(vtkPlusSavedDataSource);
 
 //----------------------------------------------------------------------------
@@ -28,6 +30,7 @@ vtkPlusSavedDataSource::vtkPlusSavedDataSource()
   , LocalVideoBuffer(NULL)
   , UseAllFrameFields(false)
   , UseOriginalTimestamps(false)
+  , FreeRunEnabled(false)
   , LastAddedFrameUid(0)
   , LastAddedLoopIndex(0)
   , SimulatedStream(VIDEO_STREAM)
@@ -149,107 +152,219 @@ PlusStatus vtkPlusSavedDataSource::InternalUpdateOriginalTimestamp(BufferItemUid
   PlusStatus status(PLUS_SUCCESS);
   for (int addedFrames = 0; addedFrames < numberOfFramesToBeAdded; addedFrames++)
   {
-
-    // The sampling rate is constant, so to have a constant frame rate we have to increase the FrameNumber by a constant.
-    // For simplicity, we increase it always by 1.
-    // TODO: use the UID difference as increment
-    this->FrameNumber++;
-
-    StreamBufferItem dataBufferItemToBeAdded;
-    if (GetLocalBuffer()->GetStreamBufferItem(frameToBeAddedUid, &dataBufferItemToBeAdded) != ITEM_OK)
+    if (this->AddFrameWithOriginalTimestamp(frameToBeAddedUid, frameToBeAddedLoopIndex) != PLUS_SUCCESS)
     {
-      LOG_ERROR("vtkPlusSavedDataSource: Failed to retrieve item from the buffer, UID=" << frameToBeAddedUid);
       status = PLUS_FAIL;
-      continue;
     }
 
-    // Compute the system time corresponding to this frame
-    // Get the filtered timestamp from the buffer without any local time offset. Offset will be applied when it is copied to the output stream's buffer.
-    double filteredTimestamp = dataBufferItemToBeAdded.GetFilteredTimestamp(0.0) + frameToBeAddedLoopIndex * loopTime -
-                               this->LoopStartTime_Local + this->GetOutputDataSource()->GetStartTime();
-    double unfilteredTimestamp = filteredTimestamp; // we ignore unfiltered timestamps
-
-    switch (this->SimulatedStream)
+    frameToBeAddedUid++;
+    if (frameToBeAddedUid > this->LoopLastFrameUid)
     {
-      case VIDEO_STREAM:
+      frameToBeAddedLoopIndex++;
+      frameToBeAddedUid -= numberOfFramesInTheLoop;
+    }
+  }
+
+  this->Modified();
+  return status;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSavedDataSource::AddFrameWithOriginalTimestamp(BufferItemUidType frameToBeAddedUid, int frameToBeAddedLoopIndex)
+{
+  double loopTime = this->LoopStopTime_Local - this->LoopStartTime_Local;
+  PlusStatus status(PLUS_SUCCESS);
+
+  // The sampling rate is constant, so to have a constant frame rate we have to increase the FrameNumber by a constant.
+  // For simplicity, we increase it always by 1.
+  // TODO: use the UID difference as increment
+  this->FrameNumber++;
+
+  StreamBufferItem dataBufferItemToBeAdded;
+  if (GetLocalBuffer()->GetStreamBufferItem(frameToBeAddedUid, &dataBufferItemToBeAdded) != ITEM_OK)
+  {
+    LOG_ERROR("vtkPlusSavedDataSource: Failed to retrieve item from the buffer, UID=" << frameToBeAddedUid);
+    // skip the frame, so that it is not retried in every update
+    this->LastAddedFrameUid = frameToBeAddedUid;
+    this->LastAddedLoopIndex = frameToBeAddedLoopIndex;
+    return PLUS_FAIL;
+  }
+
+  // Compute the system time corresponding to this frame
+  // Get the filtered timestamp from the buffer without any local time offset. Offset will be applied when it is copied to the output stream's buffer.
+  double filteredTimestamp = dataBufferItemToBeAdded.GetFilteredTimestamp(0.0) + frameToBeAddedLoopIndex * loopTime -
+                             this->LoopStartTime_Local + this->GetOutputDataSource()->GetStartTime();
+  double unfilteredTimestamp = filteredTimestamp; // we ignore unfiltered timestamps
+
+  switch (this->SimulatedStream)
+  {
+    case VIDEO_STREAM:
+      {
+        igsioFieldMapType fieldMap;
+        if (this->UseAllFrameFields)
         {
-          igsioFieldMapType fieldMap;
-          if (this->UseAllFrameFields)
-          {
-            fieldMap = dataBufferItemToBeAdded.GetFrameFieldMap();
-          }
-          if (this->AddVideoItemToVideoSources(this->GetVideoSources(), dataBufferItemToBeAdded.GetFrame(), this->FrameNumber, unfilteredTimestamp, filteredTimestamp, &fieldMap) != PLUS_SUCCESS)
-          {
-            status = PLUS_FAIL;
-          }
-          break;
+          fieldMap = dataBufferItemToBeAdded.GetFrameFieldMap();
         }
-      case TRACKER_STREAM:
+        if (this->AddVideoItemToVideoSources(this->GetVideoSources(), dataBufferItemToBeAdded.GetFrame(), this->FrameNumber, unfilteredTimestamp, filteredTimestamp, &fieldMap) != PLUS_SUCCESS)
         {
-          // retrieve timestamp from the first active tool and add all the tool matrices corresponding to that timestamp
-          double nextFrameTimestamp = dataBufferItemToBeAdded.GetFilteredTimestamp(0.0);
+          status = PLUS_FAIL;
+        }
+        break;
+      }
+    case TRACKER_STREAM:
+      {
+        // retrieve timestamp from the first active tool and add all the tool matrices corresponding to that timestamp
+        double nextFrameTimestamp = dataBufferItemToBeAdded.GetFilteredTimestamp(0.0);
 
-          for (DataSourceContainerConstIterator it = this->GetToolIteratorBegin(); it != this->GetToolIteratorEnd(); ++it)
+        for (DataSourceContainerConstIterator it = this->GetToolIteratorBegin(); it != this->GetToolIteratorEnd(); ++it)
+        {
+          vtkPlusDataSource* tool = it->second;
+          StreamBufferItem bufferItem;
+          ItemStatus itemStatus = this->LocalTrackerBuffers[tool->GetId()]->GetStreamBufferItemFromTime(nextFrameTimestamp, &bufferItem, vtkPlusBuffer::INTERPOLATED);
+          if (itemStatus != ITEM_OK)
           {
-            vtkPlusDataSource* tool = it->second;
-            StreamBufferItem bufferItem;
-            ItemStatus itemStatus = this->LocalTrackerBuffers[tool->GetId()]->GetStreamBufferItemFromTime(nextFrameTimestamp, &bufferItem, vtkPlusBuffer::INTERPOLATED);
-            if (itemStatus != ITEM_OK)
+            if (itemStatus == ITEM_NOT_AVAILABLE_YET)
             {
-              if (itemStatus == ITEM_NOT_AVAILABLE_YET)
-              {
-                LOG_ERROR("vtkPlusSavedDataSource: Unable to get next item from local buffer from time for tool " << tool->GetId() << " - frame not available yet!");
-              }
-              else if (itemStatus == ITEM_NOT_AVAILABLE_ANYMORE)
-              {
-                LOG_ERROR("vtkPlusSavedDataSource: Unable to get next item from local buffer from time for tool " << tool->GetId() << " - frame not available anymore!");
-              }
-              else
-              {
-                LOG_ERROR("vtkPlusSavedDataSource: Unable to get next item from local buffer from time for tool " << tool->GetId() << "!");
-              }
-              status = PLUS_FAIL;
-              continue;
+              LOG_ERROR("vtkPlusSavedDataSource: Unable to get next item from local buffer from time for tool " << tool->GetId() << " - frame not available yet!");
             }
-            // Get default transform
-            vtkSmartPointer<vtkMatrix4x4> toolTransMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-            if (bufferItem.GetMatrix(toolTransMatrix) != PLUS_SUCCESS)
+            else if (itemStatus == ITEM_NOT_AVAILABLE_ANYMORE)
             {
-              LOG_ERROR("Failed to get toolTransMatrix for tool " << tool->GetId());
-              status = PLUS_FAIL;
-              continue;
+              LOG_ERROR("vtkPlusSavedDataSource: Unable to get next item from local buffer from time for tool " << tool->GetId() << " - frame not available anymore!");
             }
-            // Get flags
-            ToolStatus toolStatus = bufferItem.GetStatus();
-            // This device has no frame numbering, just auto increment tool frame number if new frame received
-            // send the transformation matrix and flags to the tool
-            if (this->ToolTimeStampedUpdateWithoutFiltering(tool->GetId(), toolTransMatrix, toolStatus, unfilteredTimestamp, filteredTimestamp) != PLUS_SUCCESS)
+            else
             {
-              status = PLUS_FAIL;
+              LOG_ERROR("vtkPlusSavedDataSource: Unable to get next item from local buffer from time for tool " << tool->GetId() << "!");
             }
+            status = PLUS_FAIL;
+            continue;
+          }
+          // Get default transform
+          vtkSmartPointer<vtkMatrix4x4> toolTransMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+          if (bufferItem.GetMatrix(toolTransMatrix) != PLUS_SUCCESS)
+          {
+            LOG_ERROR("Failed to get toolTransMatrix for tool " << tool->GetId());
+            status = PLUS_FAIL;
+            continue;
+          }
+          // Get flags
+          ToolStatus toolStatus = bufferItem.GetStatus();
+          // This device has no frame numbering, just auto increment tool frame number if new frame received
+          // send the transformation matrix and flags to the tool
+          if (this->ToolTimeStampedUpdateWithoutFiltering(tool->GetId(), toolTransMatrix, toolStatus, unfilteredTimestamp, filteredTimestamp) != PLUS_SUCCESS)
+          {
+            status = PLUS_FAIL;
           }
         }
+      }
+      break;
+    default:
+      LOG_ERROR("Unknown stream type: " << this->SimulatedStream);
+      return PLUS_FAIL;
+  }
+
+  this->LastAddedFrameUid = frameToBeAddedUid;
+  this->LastAddedLoopIndex = frameToBeAddedLoopIndex;
+
+  return status;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusSavedDataSource::GetFreeRunFrameTime(int offset, double& replayTime)
+{
+  vtkPlusBuffer* localBuffer = this->GetLocalBuffer();
+  if (localBuffer == NULL)
+  {
+    return false;
+  }
+  const long long numberOfFramesInTheLoop = this->LoopLastFrameUid - this->LoopFirstFrameUid + 1;
+  if (numberOfFramesInTheLoop < 1)
+  {
+    return false;
+  }
+
+  // Position of the frame counted from the first frame of the first loop
+  long long framePosition = static_cast<long long>(this->LastAddedLoopIndex) * numberOfFramesInTheLoop
+                            + (this->LastAddedFrameUid - this->LoopFirstFrameUid) + 1 + offset;
+  if (framePosition < 0)
+  {
+    // no frame has been added yet
+    return false;
+  }
+  int loopIndex = static_cast<int>(framePosition / numberOfFramesInTheLoop);
+  if (loopIndex > 0 && !this->RepeatEnabled)
+  {
+    return false;
+  }
+  BufferItemUidType frameUid = this->LoopFirstFrameUid + framePosition % numberOfFramesInTheLoop;
+
+  double frameTime_Local = 0;
+  if (localBuffer->GetTimeStamp(frameUid, frameTime_Local) != ITEM_OK)
+  {
+    return false;
+  }
+  double loopTime = this->LoopStopTime_Local - this->LoopStartTime_Local;
+  replayTime = frameTime_Local - this->LoopStartTime_Local + loopIndex * loopTime;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSavedDataSource::AddFreeRunFrames(double replayTime, int maxNumberOfFrames, bool addFrameAfter, int& numberOfAddedFrames)
+{
+  numberOfAddedFrames = 0;
+  const int numberOfFramesInTheLoop = this->LoopLastFrameUid - this->LoopFirstFrameUid + 1;
+  PlusStatus status = PLUS_SUCCESS;
+  double nextFrameTime = 0;
+  while (numberOfAddedFrames < maxNumberOfFrames && this->GetFreeRunFrameTime(0, nextFrameTime))
+  {
+    if (nextFrameTime > replayTime)
+    {
+      // Only one frame is added after the replay time, and only if the previous frame is not already after it
+      double lastAddedFrameTime = 0;
+      if (!addFrameAfter || (this->GetFreeRunFrameTime(-1, lastAddedFrameTime) && lastAddedFrameTime > replayTime))
+      {
         break;
-      default:
-        LOG_ERROR("Unknown stream type: " << this->SimulatedStream);
-        return PLUS_FAIL;
+      }
     }
 
-    this->LastAddedFrameUid = frameToBeAddedUid;
-    this->LastAddedLoopIndex = frameToBeAddedLoopIndex;
-
-    frameToBeAddedUid++;
+    BufferItemUidType frameToBeAddedUid = this->LastAddedFrameUid + 1;
+    int frameToBeAddedLoopIndex = this->LastAddedLoopIndex;
     if (frameToBeAddedUid > this->LoopLastFrameUid)
     {
       frameToBeAddedLoopIndex++;
       frameToBeAddedUid -= numberOfFramesInTheLoop;
     }
+    if (this->AddFrameWithOriginalTimestamp(frameToBeAddedUid, frameToBeAddedLoopIndex) != PLUS_SUCCESS)
+    {
+      status = PLUS_FAIL;
+    }
+    numberOfAddedFrames++;
   }
 
-  this->Modified();
+  if (numberOfAddedFrames > 0)
+  {
+    this->Modified();
+  }
   return status;
 }
 
+//----------------------------------------------------------------------------
+int vtkPlusSavedDataSource::GetFreeRunBatchSize()
+{
+  // Consumers must be able to get all frames of a batch from the output buffers, even if they
+  // have not processed the previous batch completely yet
+  int smallestBufferSize = -1;
+  const DataSourceContainer& outputSources = (this->SimulatedStream == TRACKER_STREAM ? this->Tools : this->VideoSources);
+  for (DataSourceContainerConstIterator it = outputSources.begin(); it != outputSources.end(); ++it)
+  {
+    int bufferSize = it->second->GetBufferSize();
+    if (smallestBufferSize < 0 || bufferSize < smallestBufferSize)
+    {
+      smallestBufferSize = bufferSize;
+    }
+  }
+  return std::max(1, smallestBufferSize / 2);
+}
+
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusSavedDataSource::InternalUpdateCurrentTimestamp(BufferItemUidType frameToBeAddedUid, int frameToBeAddedLoopIndex)
 {
@@ -670,6 +785,13 @@ PlusStatus vtkPlusSavedDataSource::ReadConfiguration(vtkXMLDataElement* rootConf
 
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(RepeatEnabled, deviceConfig);
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(UseOriginalTimestamps, deviceConfig);
+  XML_READ_BOOL_ATTRIBUTE_OPTIONAL(FreeRunEnabled, deviceConfig);
+  if (this->FreeRunEnabled)
+  {
+    // Frames are added by the data collector
+    this->StartThreadForInternalUpdates = false;
+    this->UseOriginalTimestamps = true;
+  }
 
   const char* useData = deviceConfig->GetAttribute("UseData");
   if (useData != NULL)
@@ -707,6 +829,7 @@ PlusStatus vtkPlusSavedDataSource::WriteConfiguration(vtkXMLDataElement* rootCon
   XML_WRITE_CSTRING_ATTRIBUTE_IF_NOT_NULL(SequenceFile, imageAcquisitionConfig);
   XML_WRITE_BOOL_ATTRIBUTE(RepeatEnabled, imageAcquisitionConfig);
   XML_WRITE_BOOL_ATTRIBUTE(UseOriginalTimestamps, imageAcquisitionConfig);
+  XML_WRITE_BOOL_ATTRIBUTE(FreeRunEnabled, imageAcquisitionConfig);
 
   if (this->UseAllFrameFields)
   {
@@ -27,6 +27,10 @@ Attributes:
 \li UseOriginalTimestamps: if true then the original timestamps (recorded originally in the source file)
   will be replayed exactly, otherwise only the timestamp difference will be replayed exactly,
   starting from the current time (TRUE|FALSE)
+\li FreeRunEnabled: if true then the replay is not paced by the wall clock. The data collector replays the frames
+  of all free-run saved data sources in the order of their original timestamps, as fast as the devices that use
+  their output can process them, without skipping frames (see vtkPlusDataCollector). Original timestamps
+  are used (TRUE|FALSE)
 
 */
 class vtkPlusDataCollectionExport vtkPlusSavedDataSource : public vtkPlusDevice
@@ -73,6 +77,33 @@ public:
   /*! Read the timestamps from the file and use provide them in the output (instead of the current time) */
   vtkBooleanMacro( UseOriginalTimestamps, bool );
 
+  /*! Replay as fast as the consumers of the output can process the frames, driven by the data collector */
+  vtkGetMacro( FreeRunEnabled, bool );
+  /*! Replay as fast as the consumers of the output can process the frames, driven by the data collector */
+  vtkSetMacro( FreeRunEnabled, bool );
+  /*! Replay as fast as the consumers of the output can process the frames, driven by the data collector */
+  vtkBooleanMacro( FreeRunEnabled, bool );
+
+  /*!
+    Get the replay time of a frame relative to the next frame to be added (offset=0 is the next frame, -1 is the last added frame).
+    Replay time is the original timestamp relative to the loop start time (increased by the loop time in each repeat).
+    Returns false if there is no such frame (the end of the data is reached and repeat is disabled).
+  */
+  bool GetFreeRunFrameTime( int offset, double& replayTime );
+
+  /*!
+    Add the next frames in free-run mode: all frames up to the given replay time, but at most maxNumberOfFrames.
+    If addFrameAfter is true then the first frame after the replay time is added, too (so that the data can be
+    interpolated at any time up to the replay time).
+  */
+  PlusStatus AddFreeRunFrames( double replayTime, int maxNumberOfFrames, bool addFrameAfter, int& numberOfAddedFrames );
+
+  /*! Maximum number of frames that can be added in free-run mode before the consumers process them (half of the smallest output buffer) */
+  int GetFreeRunBatchSize();
+
+  /*! Returns true if the device provides a tracker stream (transforms read from the file), false if it provides a video stream */
+  bool IsTrackerStream() const { return this->SimulatedStream == TRACKER_STREAM; }
+
   /*! Get local video buffer */
   vtkGetObjectMacro( LocalVideoBuffer, vtkPlusBuffer );
 
@@ -113,6 +144,9 @@ protected:
   /*! Internal update, called when the original timestamps are used */
   PlusStatus InternalUpdateOriginalTimestamp( BufferItemUidType frameToBeAddedUid, int frameToBeAddedLoopIndex );
 
+  /*! Add a frame from the local buffer to the output, with its original timestamp */
+  PlusStatus AddFrameWithOriginalTimestamp( BufferItemUidType frameToBeAddedUid, int frameToBeAddedLoopIndex );
+
   BufferItemUidType GetClosestFrameUidWithinTimeRange( double time_Local, double startTime_Local, double stopTime_Local );
 
   /*! Get local tracker buffer */
@@ -161,6 +195,9 @@ protected:
   /*! Read the timestamps from the file and use provide them in the output (instead of the current time) */
   bool UseOriginalTimestamps;
 
+  /*! Frames are added by the data collector as fast as the consumers can process them, not by the capture thread */
+  bool FreeRunEnabled;
+
   /*! Buffer item UID of the last added frame in the local buffer */
   BufferItemUidType LastAddedFrameUid;
 
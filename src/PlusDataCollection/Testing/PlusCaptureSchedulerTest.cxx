@@ -0,0 +1,202 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file PlusCaptureSchedulerTest.cxx
+  \brief Checks the deadline pacing, overrun accounting and CPU list parsing of PlusCaptureScheduler
+
+  Only lower bounds of elapsed times are checked (sleeping until an absolute deadline never returns
+  early), so the test does not depend on the load of the machine it runs on.
+*/
+
+#include "PlusConfigure.h"
+#include "PlusCaptureScheduler.h"
+
+// IGSIO includes
+#include <vtkIGSIOAccurateTimer.h>
+
+// VTK includes
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <limits>
+
+namespace
+{
+  const double PERIOD_SEC = 0.01;
+  // Tolerance for the rounding of the deadline to the clock resolution
+  const double TIMING_TOLERANCE_SEC = 0.0005;
+
+  //----------------------------------------------------------------------------
+  int TestPeriod()
+  {
+    int numberOfFailures = 0;
+    PlusCaptureScheduler scheduler;
+    scheduler.SetPeriodSec(0.02);
+    if (scheduler.GetPeriodSec() != 0.02)
+    {
+      LOG_ERROR("Period mismatch: " << scheduler.GetPeriodSec() << " sec (expected 0.02 sec)");
+      ++numberOfFailures;
+    }
+    // Invalid periods are rejected and the previous value is kept (errors are logged).
+    // An infinite period is the result of an acquisition rate of 0.
+    const double invalidPeriodsSec[] = { -1.0, 0.0, std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN() };
+    for (unsigned int i = 0; i < sizeof(invalidPeriodsSec) / sizeof(invalidPeriodsSec[0]); ++i)
+    {
+      scheduler.SetPeriodSec(invalidPeriodsSec[i]);
+      if (scheduler.GetPeriodSec() != 0.02)
+      {
+        LOG_ERROR("Invalid period " << invalidPeriodsSec[i] << " was accepted: " << scheduler.GetPeriodSec() << " sec");
+        ++numberOfFailures;
+        scheduler.SetPeriodSec(0.02);
+      }
+    }
+    return numberOfFailures;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestPacing()
+  {
+    int numberOfFailures = 0;
+    PlusCaptureScheduler scheduler;
+    const int numberOfWaits = 20;
+
+    double startTime = PlusCaptureScheduler::GetMonotonicTime();
+    scheduler.Start(PERIOD_SEC);
+    for (int i = 0; i < numberOfWaits; ++i)
+    {
+      scheduler.WaitForNextDeadline();
+    }
+    double elapsedSec = PlusCaptureScheduler::GetMonotonicTime() - startTime;
+
+    // Without overruns the last deadline is numberOfWaits periods after start. Each overrun
+    // restarts the schedule from the wake-up time, which can only make the total longer.
+    if (elapsedSec < numberOfWaits * PERIOD_SEC - TIMING_TOLERANCE_SEC)
+    {
+      LOG_ERROR("Scheduler woke up before the deadlines: " << numberOfWaits << " periods of " << PERIOD_SEC << " sec took " << elapsedSec << " sec");
+      ++numberOfFailures;
+    }
+    if (scheduler.GetWakeUpLatenessHistogram().GetCount() != numberOfWaits)
+    {
+      LOG_ERROR("Wake-up lateness was recorded " << scheduler.GetWakeUpLatenessHistogram().GetCount() << " times (expected " << numberOfWaits << ")");
+      ++numberOfFailures;
+    }
+    return numberOfFailures;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestOverrun()
+  {
+    int numberOfFailures = 0;
+    PlusCaptureScheduler scheduler;
+    scheduler.Start(PERIOD_SEC);
+    scheduler.WaitForNextDeadline();
+    if (scheduler.GetNumberOfOverruns() != 0)
+    {
+      // The first deadline is a full period away, so this could only happen if the thread
+      // was suspended for a whole period. Not an error, but the rest of the test needs a clean start.
+      scheduler.ResetStatistics();
+    }
+
+    // Simulate an update that takes several periods
+    const double stallSec = 5 * PERIOD_SEC;
+    scheduler.RecordUpdateDuration(stallSec);
+    vtkIGSIOAccurateTimer::Delay(stallSec);
+    scheduler.WaitForNextDeadline();
+    if (scheduler.GetNumberOfOverruns() != 1)
+    {
+      LOG_ERROR("Overrun count after a stall of " << stallSec << " sec is " << scheduler.GetNumberOfOverruns() << " (expected 1)");
+      ++numberOfFailures;
+    }
+
+    // After an overrun the schedule restarts: the next update must not follow immediately to catch up
+    double resyncTime = PlusCaptureScheduler::GetMonotonicTime();
+    scheduler.WaitForNextDeadline();
+    double waitSec = PlusCaptureScheduler::GetMonotonicTime() - resyncTime;
+    if (waitSec < PERIOD_SEC - TIMING_TOLERANCE_SEC)
+    {
+      LOG_ERROR("Scheduler tried to catch up after an overrun: waited only " << waitSec << " sec (period is " << PERIOD_SEC << " sec)");
+      ++numberOfFailures;
+    }
+
+    if (scheduler.GetUpdateDurationHistogram().GetCount() != 1
+        || scheduler.GetUpdateDurationHistogram().GetMaximum() < stallSec * 0.93)
+    {
+      LOG_ERROR("Update duration was not recorded: " << scheduler.GetUpdateDurationHistogram().GetSummary());
+      ++numberOfFailures;
+    }
+
+    scheduler.ResetStatistics();
+    if (scheduler.GetNumberOfOverruns() != 0
+        || scheduler.GetUpdateDurationHistogram().GetCount() != 0
+        || scheduler.GetWakeUpLatenessHistogram().GetCount() != 0)
+    {
+      LOG_ERROR("Statistics are not cleared by reset: " << scheduler.GetStatisticsReport());
+      ++numberOfFailures;
+    }
+    return numberOfFailures;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestCpuList()
+  {
+    int numberOfFailures = 0;
+    std::vector<int> cpuIndices;
+    if (PlusCaptureScheduler::ParseCpuList("6, 0-3,2", cpuIndices) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to parse a valid CPU list");
+      ++numberOfFailures;
+    }
+    else if (PlusCaptureScheduler::CpuListToString(cpuIndices) != "0-3,6")
+    {
+      LOG_ERROR("CPU list mismatch: " << PlusCaptureScheduler::CpuListToString(cpuIndices) << " (expected 0-3,6)");
+      ++numberOfFailures;
+    }
+
+    // Invalid lists are rejected (errors are logged)
+    const char* invalidCpuLists[] = { "a", "3-1", "-1", "1-x" };
+    for (unsigned int i = 0; i < sizeof(invalidCpuLists) / sizeof(invalidCpuLists[0]); ++i)
+    {
+      if (PlusCaptureScheduler::ParseCpuList(invalidCpuLists[i], cpuIndices) == PLUS_SUCCESS)
+      {
+        LOG_ERROR("Invalid CPU list was accepted: " << invalidCpuLists[i]);
+        ++numberOfFailures;
+      }
+    }
+    return numberOfFailures;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  int numberOfFailures = 0;
+  numberOfFailures += TestPeriod();
+  numberOfFailures += TestPacing();
+  numberOfFailures += TestOverrun();
+  numberOfFailures += TestCpuList();
+
+  if (numberOfFailures > 0)
+  {
+    LOG_ERROR("PlusCaptureSchedulerTest failed with " << numberOfFailures << " errors");
+    return EXIT_FAILURE;
+  }
+  LOG_INFO("PlusCaptureSchedulerTest completed successfully");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,189 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkDataCollectorParallelConnectTest.cxx
+  \brief Measures the startup time of a device set with slow devices, connected serially and in parallel
+
+  The device set consists of fake trackers that simulate slow hardware initialization (ConnectDelaySec)
+  and a virtual mixer that uses all of them as input. In parallel mode the mixer must not be connected
+  before all of its input devices are connected.
+*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusDataCollector.h"
+
+// VTK includes
+#include <vtkSmartPointer.h>
+#include <vtkXMLDataElement.h>
+#include <vtkXMLUtilities.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <sstream>
+
+namespace
+{
+  const char* MIXER_DEVICE_ID = "TrackerMixer";
+
+  //----------------------------------------------------------------------------
+  std::string CreateDeviceSetConfiguration(int numberOfTrackers, double connectDelaySec, bool parallelConnect)
+  {
+    std::ostringstream config;
+    config << "<PlusConfiguration version=\"2.1\">"
+           << "<DataCollection StartupDelaySec=\"0.0\" ParallelDeviceConnect=\"" << (parallelConnect ? "TRUE" : "FALSE") << "\">";
+    for (int i = 0; i < numberOfTrackers; ++i)
+    {
+      config << "<Device Id=\"Tracker" << i << "\" Type=\"FakeTracker\" Mode=\"PivotCalibration\" AcquisitionRate=\"20\""
+             << " ToolReferenceFrame=\"Tracker" << i << "\" ConnectDelaySec=\"" << connectDelaySec << "\">"
+             << "<DataSources>"
+             << "<DataSource Type=\"Tool\" Id=\"Reference\" PortName=\"0\" />"
+             << "<DataSource Type=\"Tool\" Id=\"Stylus\" PortName=\"1\" />"
+             << "</DataSources>"
+             << "<OutputChannels>"
+             << "<OutputChannel Id=\"Tracker" << i << "Stream\"><DataSource Id=\"Reference\" /><DataSource Id=\"Stylus\" /></OutputChannel>"
+             << "</OutputChannels>"
+             << "</Device>";
+    }
+    config << "<Device Id=\"" << MIXER_DEVICE_ID << "\" Type=\"VirtualMixer\">"
+           << "<InputChannels>";
+    for (int i = 0; i < numberOfTrackers; ++i)
+    {
+      config << "<InputChannel Id=\"Tracker" << i << "Stream\" />";
+    }
+    config << "</InputChannels>"
+           << "<OutputChannels><OutputChannel Id=\"TrackerMixerStream\" /></OutputChannels>"
+           << "</Device>"
+           << "</DataCollection>"
+           << "</PlusConfiguration>";
+    return config.str();
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus RunStartup(int numberOfTrackers, double connectDelaySec, bool parallelConnect, double& connectDurationSec)
+  {
+    std::string description = parallelConnect ? "Parallel connect" : "Serial connect";
+    vtkSmartPointer<vtkXMLDataElement> configRootElement = vtkSmartPointer<vtkXMLDataElement>::Take(
+          vtkXMLUtilities::ReadElementFromString(CreateDeviceSetConfiguration(numberOfTrackers, connectDelaySec, parallelConnect).c_str()));
+    if (configRootElement == NULL)
+    {
+      LOG_ERROR(description << ": unable to parse device set configuration");
+      return PLUS_FAIL;
+    }
+
+    vtkSmartPointer<vtkPlusDataCollector> dataCollector = vtkSmartPointer<vtkPlusDataCollector>::New();
+    if (dataCollector->ReadConfiguration(configRootElement) != PLUS_SUCCESS)
+    {
+      LOG_ERROR(description << ": unable to read device set configuration");
+      return PLUS_FAIL;
+    }
+
+    double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    if (dataCollector->Connect() != PLUS_SUCCESS)
+    {
+      LOG_ERROR(description << ": unable to connect to devices");
+      return PLUS_FAIL;
+    }
+    connectDurationSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTime;
+
+    // The mixer must only be connected after all of its inputs
+    PlusStatus status = PLUS_SUCCESS;
+    double mixerStartTime = 0.0;
+    double mixerDurationSec = 0.0;
+    if (dataCollector->GetDeviceConnectTiming(MIXER_DEVICE_ID, mixerStartTime, mixerDurationSec) != PLUS_SUCCESS)
+    {
+      LOG_ERROR(description << ": connect timing is not available for " << MIXER_DEVICE_ID);
+      status = PLUS_FAIL;
+    }
+    for (int i = 0; i < numberOfTrackers && status == PLUS_SUCCESS; ++i)
+    {
+      std::string trackerId = std::string("Tracker") + igsioCommon::ToString<int>(i);
+      double trackerStartTime = 0.0;
+      double trackerDurationSec = 0.0;
+      if (dataCollector->GetDeviceConnectTiming(trackerId, trackerStartTime, trackerDurationSec) != PLUS_SUCCESS)
+      {
+        LOG_ERROR(description << ": connect timing is not available for " << trackerId);
+        status = PLUS_FAIL;
+      }
+      else if (trackerStartTime + trackerDurationSec > mixerStartTime)
+      {
+        LOG_ERROR(description << ": " << MIXER_DEVICE_ID << " was connected before its input device " << trackerId);
+        status = PLUS_FAIL;
+      }
+    }
+
+    if (status == PLUS_SUCCESS && dataCollector->Start() != PLUS_SUCCESS)
+    {
+      LOG_ERROR(description << ": unable to start data collection");
+      status = PLUS_FAIL;
+    }
+    dataCollector->Stop();
+    dataCollector->Disconnect();
+
+    LOG_INFO(description << ": " << numberOfTrackers << " devices with " << connectDelaySec << " sec connect delay connected in " << connectDurationSec << " sec");
+    return status;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  bool printHelp(false);
+  int numberOfTrackers(4);
+  double connectDelaySec(0.5);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--trackers", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfTrackers, "Number of fake trackers in the device set (default: 4)");
+  args.AddArgument("--connect-delay-sec", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &connectDelaySec, "Simulated connection time of each tracker (default: 0.5)");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (printHelp)
+  {
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  if (numberOfTrackers < 2 || connectDelaySec <= 0)
+  {
+    LOG_ERROR("At least two trackers and a positive connect delay are needed for the test");
+    exit(EXIT_FAILURE);
+  }
+
+  double serialConnectDurationSec = 0.0;
+  if (RunStartup(numberOfTrackers, connectDelaySec, false, serialConnectDurationSec) != PLUS_SUCCESS)
+  {
+    return EXIT_FAILURE;
+  }
+  double parallelConnectDurationSec = 0.0;
+  if (RunStartup(numberOfTrackers, connectDelaySec, true, parallelConnectDurationSec) != PLUS_SUCCESS)
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Trackers are independent, so the parallel startup should take about the time of connecting a single tracker
+  if (parallelConnectDurationSec > 2.0 * connectDelaySec || parallelConnectDurationSec >= serialConnectDurationSec)
+  {
+    LOG_ERROR("Parallel connect took " << parallelConnectDurationSec << " sec, expected less than " << 2.0 * connectDelaySec
+              << " sec (serial connect: " << serialConnectDurationSec << " sec)");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully. Speedup: " << serialConnectDurationSec / parallelConnectDurationSec);
+  return EXIT_SUCCESS;
+}
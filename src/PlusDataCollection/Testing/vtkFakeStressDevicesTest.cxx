@@ -0,0 +1,329 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkFakeStressDevicesTest.cxx
+  \brief Runs the synthetic load generators (FakeTracker in Stress mode and FakeVideo) and verifies the generated data
+
+  The tool poses in the buffers must match the deterministic trajectories (computed from the frame number
+  of the item, which is the sample index) and the sequence number embedded in the frames must match
+  the frame number. Drop and latency statistics are printed, they are not checked, as they depend on the
+  load of the machine.
+
+  The buffers are also dumped to files while acquisition is running, and the sequence numbers embedded in
+  the frames of the dumped video file are verified, too.
+*/
+
+#include "PlusConfigure.h"
+#include "PlusStreamBufferItem.h"
+#include "vtkPlusDataCollector.h"
+#include "vtkPlusDataSource.h"
+#include "vtkPlusFakeTracker.h"
+#include "vtkPlusFakeVideoSource.h"
+#include "vtkPlusSequenceIO.h"
+
+// IGSIO includes
+#include <igsioTrackedFrame.h>
+#include <vtkIGSIOTrackedFrameList.h>
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+#include <vtkXMLDataElement.h>
+#include <vtkXMLUtilities.h>
+#include <vtksys/CommandLineArguments.hxx>
+#include <vtksys/Glob.hxx>
+#include <vtksys/SystemTools.hxx>
+
+// STL includes
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+  const char* TRACKER_DEVICE_ID = "StressTracker";
+  const char* VIDEO_DEVICE_ID = "StressVideo";
+  const int RANDOM_SEED = 7;
+
+  //----------------------------------------------------------------------------
+  std::string CreateDeviceSetConfiguration(int numberOfTools, int trackerRate, int videoRate, const int frameSize[3])
+  {
+    std::ostringstream config;
+    config << "<PlusConfiguration version=\"2.1\">"
+           << "<DataCollection StartupDelaySec=\"0.0\">"
+           << "<Device Id=\"" << TRACKER_DEVICE_ID << "\" Type=\"FakeTracker\" Mode=\"Stress\" AcquisitionRate=\"" << trackerRate << "\""
+           << " ToolReferenceFrame=\"Tracker\" NumberOfStressTools=\"" << numberOfTools << "\" StressRandomSeed=\"" << RANDOM_SEED << "\">"
+           << "<DataSources />"
+           << "<OutputChannels><OutputChannel Id=\"TrackerStream\" /></OutputChannels>"
+           << "</Device>"
+           << "<Device Id=\"" << VIDEO_DEVICE_ID << "\" Type=\"FakeVideo\" AcquisitionRate=\"" << videoRate << "\""
+           << " FrameSize=\"" << frameSize[0] << " " << frameSize[1] << " " << frameSize[2] << "\" PixelType=\"UNSIGNED_SHORT\" RandomSeed=\"" << RANDOM_SEED << "\">"
+           << "<DataSources><DataSource Type=\"Video\" Id=\"Video\" PortUsImageOrientation=\"MF\" BufferSize=\"20\" /></DataSources>"
+           << "<OutputChannels><OutputChannel Id=\"VideoStream\" VideoDataSourceId=\"Video\" /></OutputChannels>"
+           << "</Device>"
+           << "</DataCollection>"
+           << "</PlusConfiguration>";
+    return config.str();
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus CheckTrackerData(vtkPlusFakeTracker* tracker, int numberOfTools)
+  {
+    if (tracker->GetNumberOfStressSamples() == 0)
+    {
+      LOG_ERROR("No samples were generated by the stress tracker");
+      return PLUS_FAIL;
+    }
+    if (tracker->GetNumberOfRejectedStressItems() > 0)
+    {
+      LOG_ERROR(tracker->GetNumberOfRejectedStressItems() << " tool items were rejected by the buffers");
+      return PLUS_FAIL;
+    }
+
+    vtkSmartPointer<vtkMatrix4x4> actualMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkSmartPointer<vtkMatrix4x4> expectedMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    for (int toolIndex = 0; toolIndex < numberOfTools; ++toolIndex)
+    {
+      std::ostringstream toolName;
+      toolName << "Stress" << std::setw(3) << std::setfill('0') << toolIndex << "ToTracker";
+      vtkPlusDataSource* tool = NULL;
+      if (tracker->GetTool(toolName.str(), tool) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Generated tool " << toolName.str() << " is not found");
+        return PLUS_FAIL;
+      }
+      StreamBufferItem item;
+      if (tool->GetLatestStreamBufferItem(&item) != ITEM_OK || item.GetMatrix(actualMatrix) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Unable to get the latest item of tool " << toolName.str());
+        return PLUS_FAIL;
+      }
+      vtkPlusFakeTracker::GetStressToolToTrackerMatrix(RANDOM_SEED, toolIndex, item.GetIndex() / tracker->GetAcquisitionRate(), expectedMatrix);
+      for (int row = 0; row < 4; ++row)
+      {
+        for (int column = 0; column < 4; ++column)
+        {
+          if (fabs(actualMatrix->GetElement(row, column) - expectedMatrix->GetElement(row, column)) > 1e-6)
+          {
+            LOG_ERROR("Pose of tool " << toolName.str() << " in sample " << item.GetIndex() << " does not match the expected trajectory");
+            return PLUS_FAIL;
+          }
+        }
+      }
+    }
+
+    LOG_INFO(tracker->GetStressReport());
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus CheckVideoData(vtkPlusFakeVideoSource* videoDevice)
+  {
+    if (videoDevice->GetNumberOfGeneratedFrames() == 0)
+    {
+      LOG_ERROR("No frames were generated by the fake video source");
+      return PLUS_FAIL;
+    }
+    if (videoDevice->GetNumberOfRejectedFrames() > 0)
+    {
+      LOG_ERROR(videoDevice->GetNumberOfRejectedFrames() << " frames were rejected by the buffer");
+      return PLUS_FAIL;
+    }
+
+    vtkPlusDataSource* videoSource = NULL;
+    if (videoDevice->GetFirstVideoSource(videoSource) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Video source of the fake video device is not found");
+      return PLUS_FAIL;
+    }
+    BufferItemUidType oldestUid = videoSource->GetOldestItemUidInBuffer();
+    BufferItemUidType latestUid = videoSource->GetLatestItemUidInBuffer();
+    for (BufferItemUidType uid = oldestUid; uid <= latestUid; ++uid)
+    {
+      StreamBufferItem item;
+      if (videoSource->GetStreamBufferItem(uid, &item) != ITEM_OK)
+      {
+        LOG_ERROR("Unable to get frame " << uid << " from the video buffer");
+        return PLUS_FAIL;
+      }
+      vtkTypeUInt64 sequenceNumber = vtkPlusFakeVideoSource::GetEmbeddedSequenceNumber(item.GetFrame().GetScalarPointer(), item.GetFrame().GetFrameSizeInBytes());
+      if (sequenceNumber != item.GetIndex())
+      {
+        LOG_ERROR("Sequence number embedded in frame " << uid << " is " << sequenceNumber << ", expected " << item.GetIndex());
+        return PLUS_FAIL;
+      }
+    }
+
+    LOG_INFO(videoDevice->GetFrameGenerationReport());
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus CheckBufferDump(const std::string& dumpDirectory)
+  {
+    vtksys::Glob glob;
+    glob.FindFiles(dumpDirectory + "/BufferDump_*.nrrd");
+    // one file for the video buffer and one for the tool buffers
+    if (glob.GetFiles().size() != 2)
+    {
+      LOG_ERROR("Expected 2 buffer dump files in " << dumpDirectory << ", found " << glob.GetFiles().size());
+      return PLUS_FAIL;
+    }
+
+    glob.FindFiles(dumpDirectory + "/BufferDump_" + VIDEO_DEVICE_ID + "_*.nrrd");
+    if (glob.GetFiles().size() != 1)
+    {
+      LOG_ERROR("Video buffer dump file is not found in " << dumpDirectory);
+      return PLUS_FAIL;
+    }
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> trackedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+    if (vtkPlusSequenceIO::Read(glob.GetFiles()[0], trackedFrameList) != PLUS_SUCCESS || trackedFrameList->GetNumberOfTrackedFrames() == 0)
+    {
+      LOG_ERROR("Unable to read frames from the video buffer dump file " << glob.GetFiles()[0]);
+      return PLUS_FAIL;
+    }
+    for (unsigned int i = 0; i < trackedFrameList->GetNumberOfTrackedFrames(); ++i)
+    {
+      igsioTrackedFrame* frame = trackedFrameList->GetTrackedFrame(i);
+      std::istringstream frameNumberStr(frame->GetFrameField("FrameNumber"));
+      vtkTypeUInt64 frameNumber = 0;
+      frameNumberStr >> frameNumber;
+      vtkTypeUInt64 sequenceNumber = vtkPlusFakeVideoSource::GetEmbeddedSequenceNumber(frame->GetImageData()->GetScalarPointer(), frame->GetImageData()->GetFrameSizeInBytes());
+      if (sequenceNumber != frameNumber)
+      {
+        LOG_ERROR("Sequence number embedded in dumped frame " << i << " is " << sequenceNumber << ", expected " << frameNumber);
+        return PLUS_FAIL;
+      }
+    }
+
+    LOG_INFO("Buffer dump contains " << trackedFrameList->GetNumberOfTrackedFrames() << " valid video frames");
+    return PLUS_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  bool printHelp(false);
+  int numberOfTools(20);
+  int trackerRate(1000);
+  int videoRate(50);
+  std::vector<int> frameSize;
+  double durationSec(2.0);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--tools", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfTools, "Number of tools generated by the stress tracker (default: 20)");
+  args.AddArgument("--tracker-rate", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &trackerRate, "Sample rate of the stress tracker in Hz (default: 1000)");
+  args.AddArgument("--video-rate", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &videoRate, "Frame rate of the fake video source in Hz (default: 50)");
+  args.AddArgument("--frame-size", vtksys::CommandLineArguments::MULTI_ARGUMENT, &frameSize, "Size of the generated frames, 2 or 3 values (default: 128 128 16)");
+  args.AddArgument("--duration-sec", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &durationSec, "Duration of data generation (default: 2)");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (printHelp)
+  {
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  int frameSizeArray[3] = { 128, 128, 16 };
+  if (!frameSize.empty())
+  {
+    if (frameSize.size() < 2 || frameSize.size() > 3)
+    {
+      LOG_ERROR("Frame size must be specified by 2 or 3 values");
+      exit(EXIT_FAILURE);
+    }
+    frameSizeArray[0] = frameSize[0];
+    frameSizeArray[1] = frameSize[1];
+    frameSizeArray[2] = (frameSize.size() == 3 ? frameSize[2] : 1);
+  }
+  if (numberOfTools < 1 || trackerRate <= 0 || videoRate <= 0 || durationSec <= 0)
+  {
+    LOG_ERROR("Number of tools, rates and duration must be positive");
+    exit(EXIT_FAILURE);
+  }
+
+  vtkSmartPointer<vtkXMLDataElement> configRootElement = vtkSmartPointer<vtkXMLDataElement>::Take(
+        vtkXMLUtilities::ReadElementFromString(CreateDeviceSetConfiguration(numberOfTools, trackerRate, videoRate, frameSizeArray).c_str()));
+  if (configRootElement == NULL)
+  {
+    LOG_ERROR("Unable to parse device set configuration");
+    exit(EXIT_FAILURE);
+  }
+
+  vtkSmartPointer<vtkPlusDataCollector> dataCollector = vtkSmartPointer<vtkPlusDataCollector>::New();
+  if (dataCollector->ReadConfiguration(configRootElement) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to read device set configuration");
+    exit(EXIT_FAILURE);
+  }
+  vtkPlusDevice* device = NULL;
+  vtkPlusFakeTracker* tracker = NULL;
+  if (dataCollector->GetDevice(device, TRACKER_DEVICE_ID) == PLUS_SUCCESS)
+  {
+    tracker = vtkPlusFakeTracker::SafeDownCast(device);
+  }
+  vtkPlusFakeVideoSource* videoDevice = NULL;
+  if (dataCollector->GetDevice(device, VIDEO_DEVICE_ID) == PLUS_SUCCESS)
+  {
+    videoDevice = vtkPlusFakeVideoSource::SafeDownCast(device);
+  }
+  if (tracker == NULL || videoDevice == NULL)
+  {
+    LOG_ERROR("Fake devices are not found in the device set");
+    exit(EXIT_FAILURE);
+  }
+
+  if (dataCollector->Connect() != PLUS_SUCCESS || dataCollector->Start() != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to start data collection");
+    dataCollector->Disconnect();
+    exit(EXIT_FAILURE);
+  }
+  vtkIGSIOAccurateTimer::Delay(durationSec);
+
+  // Dump the buffers while acquisition is still running
+  int exitCode = EXIT_SUCCESS;
+  std::string dumpDirectory = vtkPlusConfig::GetInstance()->GetOutputPath("vtkFakeStressDevicesTestBufferDump");
+  vtksys::SystemTools::RemoveADirectory(dumpDirectory);
+  vtksys::SystemTools::MakeDirectory(dumpDirectory);
+  if (dataCollector->DumpBuffersToDirectory(dumpDirectory.c_str(), true) != PLUS_SUCCESS || CheckBufferDump(dumpDirectory) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Buffer dump failed");
+    exitCode = EXIT_FAILURE;
+  }
+  dataCollector->Stop();
+
+  if (CheckTrackerData(tracker, numberOfTools) != PLUS_SUCCESS)
+  {
+    exitCode = EXIT_FAILURE;
+  }
+  if (CheckVideoData(videoDevice) != PLUS_SUCCESS)
+  {
+    exitCode = EXIT_FAILURE;
+  }
+  dataCollector->Disconnect();
+
+  if (exitCode == EXIT_SUCCESS)
+  {
+    LOG_INFO("Test completed successfully");
+  }
+  return exitCode;
+}
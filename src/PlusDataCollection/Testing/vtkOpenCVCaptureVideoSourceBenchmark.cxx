@@ -0,0 +1,344 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkOpenCVCaptureVideoSourceBenchmark.cxx
+  \brief Benchmarks frame processing of the OpenCV capture video source, using a video file as VideoURL
+
+  A synthetic video file is written first. Then:
+  - the per-frame cost of the original processing (cv::undistort, in-place color conversion, copy into the buffer)
+    is compared to the cost of the current processing (color conversion and cv::remap with precomputed maps,
+    directly into the buffer frame), and the results of the two are checked to be nearly identical;
+  - the device is run with the video file in the capture thread only (ProcessingQueueSize=0) and with
+    the processing thread, and the number of captured and dropped frames and the latency are printed.
+  Timings are printed, they are not checked, as they depend on the load of the machine.
+*/
+
+#include "PlusConfigure.h"
+#include "PlusStreamBufferItem.h"
+#include "vtkPlusDataCollector.h"
+#include "vtkPlusDataSource.h"
+#include "vtkPlusOpenCVCaptureVideoSource.h"
+
+// VTK includes
+#include <vtkIGSIOAccurateTimer.h>
+#include <vtkSmartPointer.h>
+#include <vtkXMLDataElement.h>
+#include <vtkXMLUtilities.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// OpenCV includes
+#if CV_MAJOR_VERSION > 3
+  #include <opencv2/calib3d.hpp>
+#endif
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+  const char* VIDEO_DEVICE_ID = "OpenCVVideo";
+  const double DISTORTION_COEFFICIENTS[5] = { -0.2, 0.05, 0.001, 0.001, 0.0 };
+
+  //----------------------------------------------------------------------------
+  cv::Mat CreateCameraMatrix(int width, int height)
+  {
+    cv::Mat cameraMatrix = cv::Mat::eye(3, 3, CV_64F);
+    cameraMatrix.at<double>(0, 0) = width;
+    cameraMatrix.at<double>(1, 1) = width;
+    cameraMatrix.at<double>(0, 2) = width / 2.0;
+    cameraMatrix.at<double>(1, 2) = height / 2.0;
+    return cameraMatrix;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus WriteVideoFile(const std::string& fileName, int width, int height, int frameRate, int numberOfFrames)
+  {
+    cv::VideoWriter writer(fileName, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), frameRate, cv::Size(width, height));
+    if (!writer.isOpened())
+    {
+      LOG_ERROR("Unable to create video file: " << fileName);
+      return PLUS_FAIL;
+    }
+    cv::Mat frame(height, width, CV_8UC3);
+    for (int frameIndex = 0; frameIndex < numberOfFrames; ++frameIndex)
+    {
+      // color gradient with a moving grid, so that undistortion has visible effect
+      for (int y = 0; y < height; ++y)
+      {
+        cv::Vec3b* row = frame.ptr<cv::Vec3b>(y);
+        for (int x = 0; x < width; ++x)
+        {
+          bool gridLine = ((x + frameIndex) % 32 == 0) || ((y + frameIndex) % 32 == 0);
+          row[x] = gridLine ? cv::Vec3b(255, 255, 255) : cv::Vec3b(static_cast<uchar>(x * 255 / width), static_cast<uchar>(y * 255 / height), 128);
+        }
+      }
+      writer.write(frame);
+    }
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus CompareProcessing(const std::string& fileName, int numberOfFrames)
+  {
+    cv::VideoCapture capture(fileName);
+    if (!capture.isOpened())
+    {
+      LOG_ERROR("Unable to open video file: " << fileName);
+      return PLUS_FAIL;
+    }
+    std::vector<cv::Mat> frames;
+    cv::Mat frame;
+    while (static_cast<int>(frames.size()) < numberOfFrames && capture.read(frame))
+    {
+      frames.push_back(frame.clone());
+    }
+    if (frames.empty())
+    {
+      LOG_ERROR("Unable to read frames from video file: " << fileName);
+      return PLUS_FAIL;
+    }
+    const int width = frames[0].cols;
+    const int height = frames[0].rows;
+    cv::Mat cameraMatrix = CreateCameraMatrix(width, height);
+    cv::Mat distortionCoefficients(5, 1, CV_64F, const_cast<double*>(DISTORTION_COEFFICIENTS));
+    std::vector<unsigned char> bufferFrame(width * height * 3);
+
+    // Original processing
+    cv::Mat undistortedFrame(height, width, CV_8UC3);
+    double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    for (std::vector<cv::Mat>::iterator it = frames.begin(); it != frames.end(); ++it)
+    {
+      cv::undistort(*it, undistortedFrame, cameraMatrix, distortionCoefficients);
+      cv::cvtColor(undistortedFrame, undistortedFrame, cv::COLOR_BGR2RGB);
+      memcpy(&bufferFrame[0], undistortedFrame.data, bufferFrame.size());
+    }
+    double originalTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTime;
+
+    // Current processing
+    cv::Mat map1;
+    cv::Mat map2;
+    startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    cv::initUndistortRectifyMap(cameraMatrix, distortionCoefficients, cv::Mat(), cameraMatrix, cv::Size(width, height), CV_16SC2, map1, map2);
+    double mapComputationTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTime;
+    cv::Mat colorConvertedFrame;
+    cv::Mat outputFrame(height, width, CV_8UC3, &bufferFrame[0]);
+    startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    for (std::vector<cv::Mat>::iterator it = frames.begin(); it != frames.end(); ++it)
+    {
+      cv::cvtColor(*it, colorConvertedFrame, cv::COLOR_BGR2RGB);
+      cv::remap(colorConvertedFrame, outputFrame, map1, map2, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+    }
+    double currentTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTime;
+
+    // Fixed-point maps only differ in interpolation rounding
+    double meanDifference = cv::norm(undistortedFrame, outputFrame, cv::NORM_L1) / undistortedFrame.total() / undistortedFrame.channels();
+    LOG_INFO("Frame processing (" << width << "x" << height << ", " << frames.size() << " frames): original "
+             << 1000.0 * originalTimeSec / frames.size() << " ms/frame, current "
+             << 1000.0 * currentTimeSec / frames.size() << " ms/frame (+ " << 1000.0 * mapComputationTimeSec << " ms map computation at connect), "
+             << "mean absolute difference: " << meanDifference);
+    if (meanDifference > 1.0)
+    {
+      LOG_ERROR("Undistorted images differ too much: mean absolute difference is " << meanDifference);
+      return PLUS_FAIL;
+    }
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  std::string CreateDeviceSetConfiguration(const std::string& fileName, int width, int height, int processingQueueSize)
+  {
+    cv::Mat cameraMatrix = CreateCameraMatrix(width, height);
+    std::ostringstream config;
+    config << "<PlusConfiguration version=\"2.1\">"
+           << "<DataCollection StartupDelaySec=\"0.0\">"
+           << "<Device Id=\"" << VIDEO_DEVICE_ID << "\" Type=\"OpenCVVideo\" VideoURL=\"" << fileName << "\" ProcessingQueueSize=\"" << processingQueueSize << "\""
+           << " CameraMatrix=\"";
+    for (int i = 0; i < 9; ++i)
+    {
+      config << (i > 0 ? " " : "") << cameraMatrix.at<double>(i / 3, i % 3);
+    }
+    config << "\" DistortionCoefficients=\"";
+    for (int i = 0; i < 5; ++i)
+    {
+      config << (i > 0 ? " " : "") << DISTORTION_COEFFICIENTS[i];
+    }
+    config << "\">"
+           << "<DataSources><DataSource Type=\"Video\" Id=\"Video\" PortUsImageOrientation=\"MF\" BufferSize=\"50\" /></DataSources>"
+           << "<OutputChannels><OutputChannel Id=\"VideoStream\" VideoDataSourceId=\"Video\" /></OutputChannels>"
+           << "</Device>"
+           << "</DataCollection>"
+           << "</PlusConfiguration>";
+    return config.str();
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus RunDevice(const std::string& fileName, int width, int height, int processingQueueSize, double durationSec)
+  {
+    vtkSmartPointer<vtkXMLDataElement> configRootElement = vtkSmartPointer<vtkXMLDataElement>::Take(
+          vtkXMLUtilities::ReadElementFromString(CreateDeviceSetConfiguration(fileName, width, height, processingQueueSize).c_str()));
+    if (configRootElement == NULL)
+    {
+      LOG_ERROR("Unable to parse device set configuration");
+      return PLUS_FAIL;
+    }
+
+    vtkSmartPointer<vtkPlusDataCollector> dataCollector = vtkSmartPointer<vtkPlusDataCollector>::New();
+    if (dataCollector->ReadConfiguration(configRootElement) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to read device set configuration");
+      return PLUS_FAIL;
+    }
+    vtkPlusDevice* device = NULL;
+    vtkPlusOpenCVCaptureVideoSource* videoDevice = NULL;
+    if (dataCollector->GetDevice(device, VIDEO_DEVICE_ID) == PLUS_SUCCESS)
+    {
+      videoDevice = vtkPlusOpenCVCaptureVideoSource::SafeDownCast(device);
+    }
+    if (videoDevice == NULL)
+    {
+      LOG_ERROR("OpenCV video device is not found in the device set");
+      return PLUS_FAIL;
+    }
+
+    if (dataCollector->Connect() != PLUS_SUCCESS || dataCollector->Start() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to start data collection");
+      dataCollector->Disconnect();
+      return PLUS_FAIL;
+    }
+    vtkIGSIOAccurateTimer::Delay(durationSec);
+    dataCollector->Stop();
+
+    PlusStatus status = PLUS_SUCCESS;
+    vtkPlusDataSource* videoSource = NULL;
+    if (videoDevice->GetFirstVideoSource(videoSource) != PLUS_SUCCESS || videoSource->GetNumberOfItems() == 0)
+    {
+      LOG_ERROR("No frames were recorded from the video file");
+      status = PLUS_FAIL;
+    }
+    else
+    {
+      // Timestamps are taken at grab, they must follow the frame order
+      double previousTimestamp = -1.0;
+      for (BufferItemUidType uid = videoSource->GetOldestItemUidInBuffer(); uid <= videoSource->GetLatestItemUidInBuffer(); ++uid)
+      {
+        StreamBufferItem item;
+        if (videoSource->GetStreamBufferItem(uid, &item) != ITEM_OK)
+        {
+          LOG_ERROR("Unable to get frame " << uid << " from the video buffer");
+          status = PLUS_FAIL;
+          break;
+        }
+        double timestamp = item.GetUnfilteredTimestamp(0.0);
+        if (timestamp <= previousTimestamp)
+        {
+          LOG_ERROR("Timestamp of frame " << uid << " is not after the timestamp of the previous frame");
+          status = PLUS_FAIL;
+          break;
+        }
+        previousTimestamp = timestamp;
+      }
+    }
+
+    LOG_INFO("ProcessingQueueSize=" << processingQueueSize << ": " << videoDevice->GetProcessingReport()
+             << ". Captured frame rate: " << videoDevice->GetNumberOfCapturedFrames() / durationSec << " Hz");
+    dataCollector->Disconnect();
+    return status;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  bool printHelp(false);
+  std::string outputDir;
+  std::vector<int> frameSize;
+  int frameRate(200);
+  double durationSec(2.0);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--output-dir", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &outputDir, "Directory where the test video file is written");
+  args.AddArgument("--frame-size", vtksys::CommandLineArguments::MULTI_ARGUMENT, &frameSize, "Size of the video frames (default: 640 480)");
+  args.AddArgument("--frame-rate", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &frameRate, "Frame rate of the video file, the device captures at this rate (default: 200)");
+  args.AddArgument("--duration-sec", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &durationSec, "Duration of capture with each processing mode (default: 2)");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (printHelp)
+  {
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  if (outputDir.empty())
+  {
+    LOG_ERROR("--output-dir argument is required");
+    exit(EXIT_FAILURE);
+  }
+  int width = 640;
+  int height = 480;
+  if (!frameSize.empty())
+  {
+    if (frameSize.size() != 2)
+    {
+      LOG_ERROR("Frame size must be specified by 2 values");
+      exit(EXIT_FAILURE);
+    }
+    width = frameSize[0];
+    height = frameSize[1];
+  }
+  if (width <= 0 || height <= 0 || frameRate <= 0 || durationSec <= 0)
+  {
+    LOG_ERROR("Frame size, frame rate and duration must be positive");
+    exit(EXIT_FAILURE);
+  }
+
+  // The file must not run out of frames while the device is capturing
+  const int numberOfFrames = static_cast<int>(std::ceil(2 * durationSec * frameRate));
+  const std::string fileName = outputDir + "/OpenCVCaptureVideoSourceBenchmark.avi";
+  if (WriteVideoFile(fileName, width, height, frameRate, numberOfFrames) != PLUS_SUCCESS)
+  {
+    exit(EXIT_FAILURE);
+  }
+
+  int exitCode = EXIT_SUCCESS;
+  if (CompareProcessing(fileName, std::min(numberOfFrames, 100)) != PLUS_SUCCESS)
+  {
+    exitCode = EXIT_FAILURE;
+  }
+  if (RunDevice(fileName, width, height, 0, durationSec) != PLUS_SUCCESS)
+  {
+    exitCode = EXIT_FAILURE;
+  }
+  if (RunDevice(fileName, width, height, 2, durationSec) != PLUS_SUCCESS)
+  {
+    exitCode = EXIT_FAILURE;
+  }
+
+  if (exitCode == EXIT_SUCCESS)
+  {
+    LOG_INFO("Test completed successfully");
+  }
+  return exitCode;
+}
@@ -0,0 +1,429 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkOpenIGTLinkDirectReceiveTest.cxx
+  \brief Loopback throughput test of receiving IMAGE and TDATA messages in vtkPlusOpenIGTLinkVideoSource and vtkPlusOpenIGTLinkTracker
+
+  A sender thread streams IMAGE or TDATA messages through a loopback socket to an OpenIGTLink device.
+  Images are received with and without direct receive into the video buffer, with header version 1 and 2 messages,
+  and the content of the latest buffer item is verified against the sent data.
+*/
+
+// Local includes
+#include "PlusConfigure.h"
+#include "PlusStreamBufferItem.h"
+#include "vtkPlusDataSource.h"
+#include "vtkPlusOpenIGTLinkTracker.h"
+#include "vtkPlusOpenIGTLinkVideoSource.h"
+
+// IGSIO includes
+#include <vtkIGSIOAccurateTimer.h>
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkMultiThreader.h>
+#include <vtkSmartPointer.h>
+#include <vtkXMLDataElement.h>
+#include <vtkXMLUtilities.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// OpenIGTLink includes
+#include <igtlImageMessage.h>
+#include <igtlServerSocket.h>
+#include <igtlTrackingDataMessage.h>
+
+// STL includes
+#include <cmath>
+#include <sstream>
+
+namespace
+{
+  const int SOCKET_TIMEOUT_MSEC = 5000;
+  const double RECEIVE_TIMEOUT_SEC = 20.0;
+  const int NUMBER_OF_TOOLS = 4;
+
+  struct SenderData
+  {
+    igtl::ServerSocket::Pointer ServerSocket;
+    std::string MessageType;
+    int HeaderVersion;
+    int NumberOfMessages;
+    int ImageSize;
+    igtlUint64 NumberOfSentBytes;
+    int NumberOfErrors;
+  };
+
+  //----------------------------------------------------------------------------
+  unsigned char GetExpectedPixel(size_t pixelIndex, unsigned long messageIndex)
+  {
+    return static_cast<unsigned char>((pixelIndex + messageIndex) % 251);
+  }
+
+  //----------------------------------------------------------------------------
+  igtl::MessageBase::Pointer CreateMessage(SenderData* data, int messageIndex)
+  {
+    if (data->MessageType == "IMAGE")
+    {
+      igtl::ImageMessage::Pointer imageMessage = igtl::ImageMessage::New();
+      imageMessage->SetHeaderVersion(data->HeaderVersion);
+      imageMessage->SetDeviceName("Image");
+      imageMessage->SetDimensions(data->ImageSize, data->ImageSize, 1);
+      imageMessage->SetSpacing(0.2f, 0.3f, 1.0f);
+      imageMessage->SetOrigin(10.0f, 20.0f, 30.0f);
+      imageMessage->SetScalarType(igtl::ImageMessage::TYPE_UINT8);
+      imageMessage->SetNumComponents(1);
+      if (data->HeaderVersion >= IGTL_HEADER_VERSION_2)
+      {
+        imageMessage->SetMetaDataElement("Sender", IANA_TYPE_US_ASCII, "vtkOpenIGTLinkDirectReceiveTest");
+      }
+      imageMessage->AllocateScalars();
+      unsigned char* pixels = static_cast<unsigned char*>(imageMessage->GetScalarPointer());
+      for (int i = 0; i < imageMessage->GetImageSize(); ++i)
+      {
+        pixels[i] = GetExpectedPixel(i, messageIndex);
+      }
+      imageMessage->Pack();
+      return imageMessage.GetPointer();
+    }
+
+    igtl::TrackingDataMessage::Pointer trackingDataMessage = igtl::TrackingDataMessage::New();
+    trackingDataMessage->SetHeaderVersion(data->HeaderVersion);
+    trackingDataMessage->SetDeviceName("Tracker");
+    for (int toolIndex = 0; toolIndex < NUMBER_OF_TOOLS; ++toolIndex)
+    {
+      igtl::TrackingDataElement::Pointer element = igtl::TrackingDataElement::New();
+      std::ostringstream toolName;
+      toolName << "Tool" << toolIndex;
+      element->SetName(toolName.str().c_str());
+      element->SetType(igtl::TrackingDataElement::TYPE_6D);
+      igtl::Matrix4x4 matrix;
+      igtl::IdentityMatrix(matrix);
+      matrix[0][3] = static_cast<float>(messageIndex);
+      matrix[1][3] = static_cast<float>(toolIndex);
+      element->SetMatrix(matrix);
+      trackingDataMessage->AddTrackingDataElement(element);
+    }
+    trackingDataMessage->Pack();
+    return trackingDataMessage.GetPointer();
+  }
+
+  //----------------------------------------------------------------------------
+  void* SenderThread(vtkMultiThreader::ThreadInfo* threadInfo)
+  {
+    SenderData* data = static_cast<SenderData*>(threadInfo->UserData);
+    igtl::ClientSocket::Pointer socket = data->ServerSocket->WaitForConnection(SOCKET_TIMEOUT_MSEC);
+    if (socket.IsNull())
+    {
+      LOG_ERROR(data->MessageType << ": device did not connect to the sender");
+      data->NumberOfErrors++;
+      return NULL;
+    }
+    // Messages sent by the device (e.g., STT_TDATA) are not read, they are small enough to stay in the socket buffer
+    for (int messageIndex = 0; messageIndex < data->NumberOfMessages; ++messageIndex)
+    {
+      igtl::MessageBase::Pointer message = CreateMessage(data, messageIndex);
+      if (socket->Send(message->GetBufferPointer(), message->GetBufferSize()) == 0)
+      {
+        LOG_ERROR(data->MessageType << ": failed to send message " << messageIndex);
+        data->NumberOfErrors++;
+        break;
+      }
+      data->NumberOfSentBytes += message->GetBufferSize();
+    }
+    // Keep the connection open until the device disconnects, so that all the sent data can be received
+    unsigned char dummy;
+    socket->SetReceiveTimeout(SOCKET_TIMEOUT_MSEC);
+    while (socket->GetConnected() && socket->Receive(&dummy, 1) > 0)
+    {
+    }
+    socket->CloseSocket();
+    return NULL;
+  }
+
+  //----------------------------------------------------------------------------
+  vtkSmartPointer<vtkXMLDataElement> CreateDeviceConfiguration(const std::string& messageType, int port, bool directImageReceive)
+  {
+    std::ostringstream config;
+    config << "<PlusConfiguration version=\"2.1\"><DataCollection StartupDelaySec=\"0\">";
+    if (messageType == "IMAGE")
+    {
+      config << "<Device Id=\"TestDevice\" Type=\"OpenIGTLinkVideo\" MessageType=\"IMAGE\" ServerAddress=\"127.0.0.1\" ServerPort=\"" << port << "\""
+             << " AcquisitionRate=\"2000\" IgtlMessageCrcCheckEnabled=\"TRUE\" ImageMessageEmbeddedTransformName=\"ImageToReference\""
+             << " DirectImageReceive=\"" << (directImageReceive ? "TRUE" : "FALSE") << "\">"
+             << "<DataSources><DataSource Type=\"Video\" Id=\"Video\" PortUsImageOrientation=\"MF\" BufferSize=\"50\" /></DataSources>"
+             << "<OutputChannels><OutputChannel Id=\"VideoStream\" VideoDataSourceId=\"Video\" /></OutputChannels>"
+             << "</Device>";
+    }
+    else
+    {
+      config << "<Device Id=\"TestDevice\" Type=\"OpenIGTLinkTracker\" MessageType=\"TDATA\" ServerAddress=\"127.0.0.1\" ServerPort=\"" << port << "\""
+             << " AcquisitionRate=\"2000\" IgtlMessageCrcCheckEnabled=\"TRUE\" ToolReferenceFrame=\"Reference\">"
+             << "<DataSources>";
+      for (int toolIndex = 0; toolIndex < NUMBER_OF_TOOLS; ++toolIndex)
+      {
+        config << "<DataSource Type=\"Tool\" Id=\"Tool" << toolIndex << "\" BufferSize=\"50\" />";
+      }
+      config << "</DataSources><OutputChannels><OutputChannel Id=\"TrackerStream\">";
+      for (int toolIndex = 0; toolIndex < NUMBER_OF_TOOLS; ++toolIndex)
+      {
+        config << "<DataSource Id=\"Tool" << toolIndex << "\" />";
+      }
+      config << "</OutputChannel></OutputChannels></Device>";
+    }
+    config << "</DataCollection></PlusConfiguration>";
+    return vtkSmartPointer<vtkXMLDataElement>::Take(vtkXMLUtilities::ReadElementFromString(config.str().c_str()));
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus VerifyLatestImage(vtkPlusDataSource* source, int imageSize, std::string& embeddedTransform)
+  {
+    StreamBufferItem item;
+    if (source->GetLatestStreamBufferItem(&item) != ITEM_OK)
+    {
+      LOG_ERROR("Unable to get the latest image from the video buffer");
+      return PLUS_FAIL;
+    }
+    // Frame numbers start from 1
+    unsigned long messageIndex = item.GetIndex() - 1;
+    FrameSizeType frameSize = { 0, 0, 0 };
+    item.GetFrame().GetFrameSize(frameSize);
+    if (frameSize[0] != static_cast<unsigned int>(imageSize) || frameSize[1] != static_cast<unsigned int>(imageSize) || frameSize[2] != 1)
+    {
+      LOG_ERROR("Received image size is " << frameSize[0] << "x" << frameSize[1] << "x" << frameSize[2] << ", expected " << imageSize << "x" << imageSize << "x1");
+      return PLUS_FAIL;
+    }
+    const unsigned char* pixels = static_cast<const unsigned char*>(item.GetFrame().GetScalarPointer());
+    size_t numberOfPixels = static_cast<size_t>(imageSize) * imageSize;
+    for (size_t i = 0; i < numberOfPixels; ++i)
+    {
+      if (pixels[i] != GetExpectedPixel(i, messageIndex))
+      {
+        LOG_ERROR("Received pixel data of message " << messageIndex << " does not match the sent data at pixel " << i);
+        return PLUS_FAIL;
+      }
+    }
+    embeddedTransform = item.GetFrameField("ImageToReferenceTransform");
+    if (embeddedTransform.empty())
+    {
+      LOG_ERROR("Embedded image transform is missing from the received image");
+      return PLUS_FAIL;
+    }
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus VerifyLatestTransforms(vtkPlusDevice* device, int numberOfMessages)
+  {
+    for (int toolIndex = 0; toolIndex < NUMBER_OF_TOOLS; ++toolIndex)
+    {
+      std::ostringstream toolName;
+      toolName << "Tool" << toolIndex << "ToReference";
+      vtkPlusDataSource* tool = NULL;
+      StreamBufferItem item;
+      if (device->GetTool(toolName.str(), tool) != PLUS_SUCCESS || tool->GetLatestStreamBufferItem(&item) != ITEM_OK)
+      {
+        LOG_ERROR("Unable to get the latest transform of " << toolName.str());
+        return PLUS_FAIL;
+      }
+      vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+      item.GetMatrix(matrix);
+      if (item.GetStatus() != TOOL_OK || item.GetIndex() != static_cast<unsigned long>(numberOfMessages)
+          || std::abs(matrix->GetElement(0, 3) - (numberOfMessages - 1)) > 1e-6 || std::abs(matrix->GetElement(1, 3) - toolIndex) > 1e-6)
+      {
+        LOG_ERROR("Latest transform of " << toolName.str() << " (frame " << item.GetIndex() << ", translation " << matrix->GetElement(0, 3) << ", " << matrix->GetElement(1, 3)
+                  << ") does not match the last sent transform (frame " << numberOfMessages << ", translation " << numberOfMessages - 1 << ", " << toolIndex << ")");
+        return PLUS_FAIL;
+      }
+    }
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus RunTest(const std::string& messageType, int headerVersion, bool directImageReceive, int numberOfMessages, int imageSize, int port, std::string& embeddedTransform)
+  {
+    std::ostringstream description;
+    description << messageType << ", header version " << headerVersion;
+    if (messageType == "IMAGE")
+    {
+      description << (directImageReceive ? ", direct receive" : ", receive and copy");
+    }
+
+    SenderData senderData;
+    senderData.ServerSocket = igtl::ServerSocket::New();
+    senderData.MessageType = messageType;
+    senderData.HeaderVersion = headerVersion;
+    senderData.NumberOfMessages = numberOfMessages;
+    senderData.ImageSize = imageSize;
+    senderData.NumberOfSentBytes = 0;
+    senderData.NumberOfErrors = 0;
+    if (senderData.ServerSocket->CreateServer(port) < 0)
+    {
+      LOG_ERROR(description.str() << ": cannot create server socket on port " << port);
+      return PLUS_FAIL;
+    }
+
+    vtkSmartPointer<vtkPlusOpenIGTLinkDevice> device;
+    if (messageType == "IMAGE")
+    {
+      device = vtkSmartPointer<vtkPlusOpenIGTLinkVideoSource>::New();
+    }
+    else
+    {
+      device = vtkSmartPointer<vtkPlusOpenIGTLinkTracker>::New();
+    }
+    device->SetDeviceId("TestDevice");
+    vtkSmartPointer<vtkXMLDataElement> configRootElement = CreateDeviceConfiguration(messageType, port, directImageReceive);
+    if (configRootElement == NULL || device->ReadConfiguration(configRootElement) != PLUS_SUCCESS)
+    {
+      LOG_ERROR(description.str() << ": unable to configure device");
+      senderData.ServerSocket->CloseSocket();
+      return PLUS_FAIL;
+    }
+
+    vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+    int senderThreadId = threader->SpawnThread((vtkThreadFunctionType)&SenderThread, &senderData);
+
+    int numberOfErrors = 0;
+    if (device->Connect() != PLUS_SUCCESS || device->StartRecording() != PLUS_SUCCESS)
+    {
+      LOG_ERROR(description.str() << ": unable to connect device to the sender");
+      numberOfErrors++;
+    }
+
+    // Wait until the last message is added to the buffer
+    vtkPlusDataSource* source = NULL;
+    if (messageType == "IMAGE")
+    {
+      device->GetFirstVideoSource(source);
+    }
+    else
+    {
+      device->GetTool("Tool0ToReference", source);
+    }
+    double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    double elapsedTimeSec = 0.0;
+    while (numberOfErrors == 0 && source != NULL && source->GetLatestItemUidInBuffer() < static_cast<BufferItemUidType>(numberOfMessages))
+    {
+      elapsedTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTime;
+      if (elapsedTimeSec > RECEIVE_TIMEOUT_SEC)
+      {
+        LOG_ERROR(description.str() << ": only " << source->GetLatestItemUidInBuffer() << " of " << numberOfMessages << " messages were received");
+        numberOfErrors++;
+        break;
+      }
+      vtkIGSIOAccurateTimer::Delay(0.001);
+    }
+    elapsedTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTime;
+
+    if (numberOfErrors == 0)
+    {
+      if (source == NULL)
+      {
+        LOG_ERROR(description.str() << ": device has no data source");
+        numberOfErrors++;
+      }
+      else if (messageType == "IMAGE" && VerifyLatestImage(source, imageSize, embeddedTransform) != PLUS_SUCCESS)
+      {
+        numberOfErrors++;
+      }
+      else if (messageType != "IMAGE" && VerifyLatestTransforms(device, numberOfMessages) != PLUS_SUCCESS)
+      {
+        numberOfErrors++;
+      }
+    }
+
+    device->StopRecording();
+    device->Disconnect();
+    threader->TerminateThread(senderThreadId);
+    senderData.ServerSocket->CloseSocket();
+
+    numberOfErrors += senderData.NumberOfErrors;
+    if (numberOfErrors > 0)
+    {
+      return PLUS_FAIL;
+    }
+
+    LOG_INFO(description.str() << ": " << numberOfMessages << " messages, " << senderData.NumberOfSentBytes / numberOfMessages << " bytes/message"
+             << ", " << numberOfMessages / elapsedTimeSec << " messages/s"
+             << ", " << senderData.NumberOfSentBytes / elapsedTimeSec / (1024.0 * 1024.0) << " MB/s");
+    return PLUS_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  bool printHelp(false);
+  int numberOfMessages(200);
+  int imageSize(512);
+  int port(18951);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--messages", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfMessages, "Number of messages to send in each run (default: 200)");
+  args.AddArgument("--image-size", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &imageSize, "Width and height of the sent images, in pixels (default: 512)");
+  args.AddArgument("--port", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &port, "Loopback port used for the test (default: 18951)");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (printHelp)
+  {
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  if (numberOfMessages < 1 || imageSize < 1)
+  {
+    LOG_ERROR("Number of messages and image size must be positive");
+    exit(EXIT_FAILURE);
+  }
+
+  int numberOfErrors = 0;
+  const int headerVersions[] = { IGTL_HEADER_VERSION_1, IGTL_HEADER_VERSION_2 };
+  for (int versionIndex = 0; versionIndex < 2; ++versionIndex)
+  {
+    // The direct receive path must produce the same buffer content as receiving into a message and copying
+    std::string copiedEmbeddedTransform;
+    std::string directEmbeddedTransform;
+    if (RunTest("IMAGE", headerVersions[versionIndex], false, numberOfMessages, imageSize, port, copiedEmbeddedTransform) != PLUS_SUCCESS
+        || RunTest("IMAGE", headerVersions[versionIndex], true, numberOfMessages, imageSize, port, directEmbeddedTransform) != PLUS_SUCCESS)
+    {
+      numberOfErrors++;
+    }
+    else if (copiedEmbeddedTransform != directEmbeddedTransform)
+    {
+      LOG_ERROR("Embedded image transform is different when received directly (" << directEmbeddedTransform << ") and copied (" << copiedEmbeddedTransform << ")");
+      numberOfErrors++;
+    }
+
+    std::string unused;
+    if (RunTest("TDATA", headerVersions[versionIndex], false, numberOfMessages, imageSize, port, unused) != PLUS_SUCCESS)
+    {
+      numberOfErrors++;
+    }
+  }
+
+  if (numberOfErrors > 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully");
+  return EXIT_SUCCESS;
+}
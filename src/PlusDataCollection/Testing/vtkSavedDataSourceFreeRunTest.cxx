@@ -0,0 +1,303 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkSavedDataSourceFreeRunTest.cxx
+  \brief Replays a sequence file with two free-run saved data sources and verifies that no frames are skipped
+
+  The output buffers of the saved data sources are much smaller than the sequence, so frames are only kept
+  if the replay waits for the consumer device. The consumer reads every new item of both sources in each
+  update and checks that the latest timestamps of the two sources are the same, as they replay the same file.
+
+  With --no-consumer no device reads the output buffers, so the replay must be paced by the recording timestamps:
+  the test checks that the replay does not complete faster than the duration of the recording.
+*/
+
+#include "PlusConfigure.h"
+#include "PlusStreamBufferItem.h"
+#include "vtkPlusBuffer.h"
+#include "vtkPlusChannel.h"
+#include "vtkPlusDataCollector.h"
+#include "vtkPlusDataSource.h"
+#include "vtkPlusSavedDataSource.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkXMLDataElement.h>
+#include <vtkXMLUtilities.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace
+{
+  const char* SOURCE_DEVICE_IDS[2] = { "ReplayA", "ReplayB" };
+  const char* SOURCE_CHANNEL_IDS[2] = { "ReplayStreamA", "ReplayStreamB" };
+
+  //----------------------------------------------------------------------------
+  std::string CreateDeviceSetConfiguration(const std::string& sequenceFile, int bufferSize)
+  {
+    std::ostringstream config;
+    config << "<PlusConfiguration version=\"2.1\">"
+           << "<DataCollection StartupDelaySec=\"0.0\">";
+    for (int i = 0; i < 2; ++i)
+    {
+      config << "<Device Id=\"" << SOURCE_DEVICE_IDS[i] << "\" Type=\"SavedDataSource\" SequenceFile=\"" << sequenceFile << "\""
+             << " UseData=\"IMAGE\" RepeatEnabled=\"FALSE\" FreeRunEnabled=\"TRUE\">"
+             << "<DataSources><DataSource Type=\"Video\" Id=\"Video\" PortUsImageOrientation=\"MF\" BufferSize=\"" << bufferSize << "\" /></DataSources>"
+             << "<OutputChannels><OutputChannel Id=\"" << SOURCE_CHANNEL_IDS[i] << "\" VideoDataSourceId=\"Video\" /></OutputChannels>"
+             << "</Device>";
+    }
+    config << "</DataCollection>"
+           << "</PlusConfiguration>";
+    return config.str();
+  }
+}
+
+//----------------------------------------------------------------------------
+/*! Consumer device that reads all new items of its input channels in each update */
+class vtkFreeRunTestConsumer : public vtkPlusDevice
+{
+public:
+  static vtkFreeRunTestConsumer* New();
+  vtkTypeMacro(vtkFreeRunTestConsumer, vtkPlusDevice);
+
+  virtual bool IsTracker() const { return false; }
+  virtual bool IsVirtual() const { return true; }
+
+  /*! Time spent in each update, to make the consumer slower than the replay */
+  double ProcessingTimeSec;
+
+  unsigned long long NumberOfReceivedFrames;
+  unsigned long long NumberOfSkippedFrames;
+  double MaxTimestampDifferenceSec;
+
+protected:
+  vtkFreeRunTestConsumer()
+    : ProcessingTimeSec(0.002)
+    , NumberOfReceivedFrames(0)
+    , NumberOfSkippedFrames(0)
+    , MaxTimestampDifferenceSec(0)
+  {
+    this->StartThreadForInternalUpdates = true;
+    this->AcquisitionRate = 200;
+    this->LastReceivedUids[0] = 0;
+    this->LastReceivedUids[1] = 0;
+  }
+
+  virtual PlusStatus InternalUpdate()
+  {
+    double latestTimestamps[2] = { 0, 0 };
+    for (int i = 0; i < 2 && i < static_cast<int>(this->InputChannels.size()); ++i)
+    {
+      vtkPlusDataSource* videoSource = NULL;
+      if (this->InputChannels[i]->GetVideoSource(videoSource) != PLUS_SUCCESS || videoSource->GetNumberOfItems() < 1)
+      {
+        return PLUS_SUCCESS;
+      }
+      BufferItemUidType latestUid = videoSource->GetLatestItemUidInBuffer();
+      for (BufferItemUidType uid = this->LastReceivedUids[i] + 1; uid <= latestUid; ++uid)
+      {
+        StreamBufferItem item;
+        if (videoSource->GetStreamBufferItem(uid, &item) == ITEM_OK)
+        {
+          ++this->NumberOfReceivedFrames;
+        }
+        else
+        {
+          ++this->NumberOfSkippedFrames;
+        }
+      }
+      this->LastReceivedUids[i] = latestUid;
+      videoSource->GetTimeStamp(latestUid, latestTimestamps[i]);
+    }
+    // Both sources replay the same file, so they must be at the same frame after each batch
+    this->MaxTimestampDifferenceSec = std::max(this->MaxTimestampDifferenceSec, fabs(latestTimestamps[0] - latestTimestamps[1]));
+
+    vtkIGSIOAccurateTimer::Delay(this->ProcessingTimeSec);
+    return PLUS_SUCCESS;
+  }
+
+  BufferItemUidType LastReceivedUids[2];
+
+private:
+  vtkFreeRunTestConsumer(const vtkFreeRunTestConsumer&);  // Not implemented.
+  void operator=(const vtkFreeRunTestConsumer&);  // Not implemented.
+};
+
+vtkStandardNewMacro(vtkFreeRunTestConsumer);
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  bool printHelp(false);
+  std::string inputVideoSeqFile;
+  int bufferSize(10);
+  double timeoutSec(60.0);
+  bool noConsumer(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--video-seq-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &inputVideoSeqFile, "Sequence file that is replayed by the saved data sources");
+  args.AddArgument("--buffer-size", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &bufferSize, "Size of the output buffers of the saved data sources (default: 10)");
+  args.AddArgument("--timeout-sec", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &timeoutSec, "Maximum duration of the replay (default: 60)");
+  args.AddArgument("--no-consumer", vtksys::CommandLineArguments::NO_ARGUMENT, &noConsumer, "Replay without a consumer device and check that the replay is paced by the recording timestamps");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (printHelp)
+  {
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  if (inputVideoSeqFile.empty())
+  {
+    LOG_ERROR("--video-seq-file argument is required");
+    exit(EXIT_FAILURE);
+  }
+
+  vtkSmartPointer<vtkXMLDataElement> configRootElement = vtkSmartPointer<vtkXMLDataElement>::Take(
+        vtkXMLUtilities::ReadElementFromString(CreateDeviceSetConfiguration(inputVideoSeqFile, bufferSize).c_str()));
+  if (configRootElement == NULL)
+  {
+    LOG_ERROR("Unable to parse device set configuration");
+    exit(EXIT_FAILURE);
+  }
+
+  vtkSmartPointer<vtkPlusDataCollector> dataCollector = vtkSmartPointer<vtkPlusDataCollector>::New();
+  if (dataCollector->ReadConfiguration(configRootElement) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to read device set configuration");
+    exit(EXIT_FAILURE);
+  }
+
+  // The data collector deletes the devices that are added to it
+  vtkFreeRunTestConsumer* consumer = NULL;
+  if (!noConsumer)
+  {
+    consumer = vtkFreeRunTestConsumer::New();
+    consumer->SetDeviceId("FreeRunConsumer");
+    for (int i = 0; i < 2; ++i)
+    {
+      vtkPlusChannel* channel = NULL;
+      if (dataCollector->GetChannel(channel, SOURCE_CHANNEL_IDS[i]) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Output channel " << SOURCE_CHANNEL_IDS[i] << " is not found");
+        consumer->Delete();
+        exit(EXIT_FAILURE);
+      }
+      consumer->AddInputChannel(channel);
+    }
+    if (dataCollector->AddDevice(consumer) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to add the consumer device");
+      consumer->Delete();
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (dataCollector->Connect() != PLUS_SUCCESS || dataCollector->Start() != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to start data collection");
+    dataCollector->Disconnect();
+    exit(EXIT_FAILURE);
+  }
+
+  int expectedNumberOfFrames = 0;
+  double recordingDurationSec = 0;
+  for (int i = 0; i < 2; ++i)
+  {
+    vtkPlusDevice* device = NULL;
+    vtkPlusSavedDataSource* savedDataSource = NULL;
+    if (dataCollector->GetDevice(device, SOURCE_DEVICE_IDS[i]) == PLUS_SUCCESS)
+    {
+      savedDataSource = vtkPlusSavedDataSource::SafeDownCast(device);
+    }
+    if (savedDataSource == NULL || savedDataSource->GetLocalVideoBuffer() == NULL)
+    {
+      LOG_ERROR("Saved data source " << SOURCE_DEVICE_IDS[i] << " is not found");
+      dataCollector->Disconnect();
+      exit(EXIT_FAILURE);
+    }
+    expectedNumberOfFrames += savedDataSource->GetLocalVideoBuffer()->GetNumberOfItems();
+    double oldestTimestamp = 0;
+    double latestTimestamp = 0;
+    if (savedDataSource->GetLocalVideoBuffer()->GetOldestTimeStamp(oldestTimestamp) == ITEM_OK
+        && savedDataSource->GetLocalVideoBuffer()->GetLatestTimeStamp(latestTimestamp) == ITEM_OK)
+    {
+      recordingDurationSec = std::max(recordingDurationSec, latestTimestamp - oldestTimestamp);
+    }
+  }
+
+  double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+  while (dataCollector->IsFreeRunReplayActive() && vtkIGSIOAccurateTimer::GetSystemTime() - startTime < timeoutSec)
+  {
+    vtkIGSIOAccurateTimer::Delay(0.01);
+  }
+  // The replay is only completed after the consumer processed the last batch
+  bool replayCompleted = !dataCollector->IsFreeRunReplayActive();
+  double replayDurationSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTime;
+  dataCollector->Stop();
+  dataCollector->Disconnect();
+
+  int exitCode = EXIT_SUCCESS;
+  if (!replayCompleted)
+  {
+    LOG_ERROR("Free-run replay did not complete in " << timeoutSec << " sec");
+    exitCode = EXIT_FAILURE;
+  }
+  if (consumer == NULL)
+  {
+    // After each batch the replay waits until the recording time of the batch has elapsed, so it cannot be faster than the recording.
+    // The replay starts a bit before the time measurement of the test, this is allowed by the tolerance.
+    const double toleranceSec = 0.1;
+    if (replayCompleted && replayDurationSec < recordingDurationSec - toleranceSec)
+    {
+      LOG_ERROR("Free-run replay without consumers is not paced by the recording: " << recordingDurationSec << " sec of data replayed in " << replayDurationSec << " sec");
+      exitCode = EXIT_FAILURE;
+    }
+    if (exitCode == EXIT_SUCCESS)
+    {
+      LOG_INFO("Test completed successfully: " << recordingDurationSec << " sec of data replayed in " << replayDurationSec << " sec");
+    }
+    return exitCode;
+  }
+
+  if (consumer->NumberOfSkippedFrames > 0 || consumer->NumberOfReceivedFrames != static_cast<unsigned long long>(expectedNumberOfFrames))
+  {
+    LOG_ERROR("Consumer received " << consumer->NumberOfReceivedFrames << " of " << expectedNumberOfFrames << " frames, "
+              << consumer->NumberOfSkippedFrames << " frames were skipped");
+    exitCode = EXIT_FAILURE;
+  }
+  if (consumer->MaxTimestampDifferenceSec > 1e-6)
+  {
+    LOG_ERROR("Saved data sources are not synchronized, timestamp difference: " << consumer->MaxTimestampDifferenceSec << " sec");
+    exitCode = EXIT_FAILURE;
+  }
+
+  if (exitCode == EXIT_SUCCESS)
+  {
+    LOG_INFO("Test completed successfully: " << consumer->NumberOfReceivedFrames << " frames replayed in "
+             << replayDurationSec << " sec");
+  }
+  return exitCode;
+}
@@ -118,6 +118,63 @@ int main(int argc, char** argv)
     return EXIT_FAILURE;
   }
 
+  // Stop acquisition, so that recognition can be driven from this thread with the last input frame
+  dataCollector->Stop();
+
+  // All fields must be recognized in one update, even if there is only one recognition thread
+  int numberOfFields = 0;
+  for (vtkPlusVirtualTextRecognizer::ChannelFieldListMapIterator channelIt = map.begin(); channelIt != map.end(); ++channelIt)
+  {
+    for (vtkPlusVirtualTextRecognizer::FieldListIterator fieldIt = channelIt->second.begin(); fieldIt != channelIt->second.end(); ++fieldIt)
+    {
+      (*fieldIt)->LatestParameterValue.clear();
+      (*fieldIt)->PreviousScreenRegionValid = false;
+      (*fieldIt)->NumberOfRecognitions = 0;
+      (*fieldIt)->NumberOfSkippedRecognitions = 0;
+      numberOfFields++;
+    }
+  }
+  LOG_INFO("Testing recognition of " << numberOfFields << " fields with " << textRecognizer->GetNumberOfRecognitionThreads() << " recognition threads");
+
+  // First update: all fields are recognized. Second update: same input, all fields are skipped.
+  // Third update: skipping is disabled, all fields are recognized again.
+  const unsigned long expectedRecognitions[3] = { 1, 1, 2 };
+  const unsigned long expectedSkippedRecognitions[3] = { 0, 1, 1 };
+  int numberOfErrors = 0;
+  for (int updateIndex = 0; updateIndex < 3; ++updateIndex)
+  {
+    if (updateIndex == 2)
+    {
+      textRecognizer->SetPixelChangeThreshold(-1);
+    }
+    if (textRecognizer->RecognizeFieldsOnce() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Text recognition update failed");
+      return EXIT_FAILURE;
+    }
+    for (vtkPlusVirtualTextRecognizer::ChannelFieldListMapIterator channelIt = map.begin(); channelIt != map.end(); ++channelIt)
+    {
+      for (vtkPlusVirtualTextRecognizer::FieldListIterator fieldIt = channelIt->second.begin(); fieldIt != channelIt->second.end(); ++fieldIt)
+      {
+        if ((*fieldIt)->NumberOfRecognitions != expectedRecognitions[updateIndex] || (*fieldIt)->NumberOfSkippedRecognitions != expectedSkippedRecognitions[updateIndex])
+        {
+          LOG_ERROR("Update " << updateIndex << ": field \"" << (*fieldIt)->ParameterName << "\" was recognized " << (*fieldIt)->NumberOfRecognitions << " times and skipped "
+                    << (*fieldIt)->NumberOfSkippedRecognitions << " times (expected " << expectedRecognitions[updateIndex] << " and " << expectedSkippedRecognitions[updateIndex] << ")");
+          numberOfErrors++;
+        }
+      }
+    }
+    if ((*it)->LatestParameterValue != fieldValue)
+    {
+      LOG_ERROR("Update " << updateIndex << ": parameter \"" << (*it)->ParameterName << "\" value=\"" << (*it)->LatestParameterValue << "\" does not match expected value=\"" << fieldValue << "\"");
+      numberOfErrors++;
+    }
+  }
+  if (numberOfErrors > 0)
+  {
+    return EXIT_FAILURE;
+  }
+
   LOG_INFO("Exit successfully");
   return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,466 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkVirtualVolumeReconstructorReplayTest.cxx
+  \brief Replays a synthetic tracked sweep into a live volume reconstruction and verifies that all frames are pasted
+
+  A linear sweep of tracked frames is generated and queued in batches for the reconstruction thread of a virtual
+  volume reconstructor device, as the data capture thread of the device does during a live reconstruction. The test
+  takes a volume snapshot after every few batches, as a client of a live reconstruction would do. When all the
+  queued frames are pasted, each frame of the sweep must have been pasted into the volume exactly once.
+  Then the sweep is queued again and the volume is reset immediately: none of the frames that were queued (or
+  were being pasted) before the reset may appear in the cleared volume.
+  Frames are queued directly, without a data collector, so the results do not depend on the speed of the machine.
+
+  With --replay the sweep is written to a sequence file instead, which is replayed at the original frame rate by a
+  saved data source, and the reconstructor samples the frames from its input channel. Volume snapshots are taken
+  periodically during the replay. The reconstruction must not skip any data and all the sampled frames must be pasted.
+  The replay is given --replay-margin-sec time in addition to the sweep duration, so that a slow machine can keep up.
+
+  Timing of the frame pasting and of the snapshots is reported, so the test can be used as a benchmark, too.
+*/
+
+#include "PlusConfigure.h"
+#include "PlusMetricsRegistry.h"
+#include "vtkPlusDataCollector.h"
+#include "vtkPlusSequenceIO.h"
+#include "vtkPlusVirtualVolumeReconstructor.h"
+
+// IGSIO includes
+#include <igsioTrackedFrame.h>
+#include <vtkIGSIOTrackedFrameList.h>
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkXMLDataElement.h>
+#include <vtkXMLUtilities.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace
+{
+  const char* RECONSTRUCTOR_DEVICE_ID = "VolumeReconstructorDevice";
+  const double PIXEL_SPACING_MM = 0.2;
+  // Generous limit, it is only reached if frames are lost
+  const double QUEUED_FRAMES_TIMEOUT_SEC = 60.0;
+
+  //----------------------------------------------------------------------------
+  /*! Frames [firstFrameIndex, firstFrameIndex+numberOfFrames) of a linear sweep along the Z axis of the Reference coordinate system */
+  void CreateSweep(vtkIGSIOTrackedFrameList* frameList, int firstFrameIndex, int numberOfFrames, int frameSizePixels, double frameRate, double sweepStepMm)
+  {
+    FrameSizeType frameSize = { static_cast<unsigned int>(frameSizePixels), static_cast<unsigned int>(frameSizePixels), 1 };
+    igsioTransformName imageToReferenceName("Image", "Reference");
+    for (int frameIndex = firstFrameIndex; frameIndex < firstFrameIndex + numberOfFrames; ++frameIndex)
+    {
+      igsioTrackedFrame frame;
+      frame.GetImageData()->AllocateFrame(frameSize, VTK_UNSIGNED_CHAR, 1);
+      frame.GetImageData()->SetImageOrientation(US_IMG_ORIENT_MF);
+      frame.GetImageData()->SetImageType(US_IMG_BRIGHTNESS);
+      unsigned char* pixels = static_cast<unsigned char*>(frame.GetImageData()->GetScalarPointer());
+      for (int y = 0; y < frameSizePixels; ++y)
+      {
+        for (int x = 0; x < frameSizePixels; ++x)
+        {
+          pixels[x + y * frameSizePixels] = static_cast<unsigned char>((x + y + frameIndex) % 256);
+        }
+      }
+      frame.SetTimestamp(frameIndex / frameRate);
+
+      vtkSmartPointer<vtkMatrix4x4> imageToReference = vtkSmartPointer<vtkMatrix4x4>::New();
+      imageToReference->SetElement(0, 0, PIXEL_SPACING_MM);
+      imageToReference->SetElement(1, 1, PIXEL_SPACING_MM);
+      imageToReference->SetElement(2, 2, PIXEL_SPACING_MM);
+      imageToReference->SetElement(2, 3, frameIndex * sweepStepMm);
+      frame.SetFrameTransform(imageToReferenceName, imageToReference);
+      frame.SetFrameTransformStatus(imageToReferenceName, TOOL_OK);
+
+      frameList->AddTrackedFrame(&frame);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /*!
+    Device set configuration of the volume reconstructor. If sequenceFile is not empty then the reconstructor
+    samples its frames from a saved data source that replays the sequence file.
+  */
+  std::string CreateDeviceSetConfiguration(const int outputExtent[6], double outputSpacingMm, const std::string& sequenceFile = "", double acquisitionRate = 0)
+  {
+    std::ostringstream config;
+    config << "<PlusConfiguration version=\"2.1\">"
+           << "<DataCollection StartupDelaySec=\"0.0\">";
+    if (!sequenceFile.empty())
+    {
+      config << "<Device Id=\"SweepReplay\" Type=\"SavedDataSource\" SequenceFile=\"" << sequenceFile << "\""
+             << " UseData=\"IMAGE_AND_TRANSFORM\" RepeatEnabled=\"FALSE\" AcquisitionRate=\"" << acquisitionRate << "\">"
+             << "<DataSources><DataSource Type=\"Video\" Id=\"Video\" PortUsImageOrientation=\"MF\" BufferSize=\"1000\" /></DataSources>"
+             << "<OutputChannels><OutputChannel Id=\"SweepStream\" VideoDataSourceId=\"Video\" /></OutputChannels>"
+             << "</Device>";
+    }
+    config << "<Device Id=\"" << RECONSTRUCTOR_DEVICE_ID << "\" Type=\"VirtualVolumeReconstructor\" EnableReconstruction=\"TRUE\">";
+    if (!sequenceFile.empty())
+    {
+      config << "<InputChannels><InputChannel Id=\"SweepStream\" /></InputChannels>";
+    }
+    config << "<VolumeReconstruction ImageCoordinateFrame=\"Image\" ReferenceCoordinateFrame=\"Reference\""
+           << " Interpolation=\"LINEAR\" CompoundingMode=\"MEAN\" FillHoles=\"OFF\""
+           << " OutputSpacing=\"" << outputSpacingMm << " " << outputSpacingMm << " " << outputSpacingMm << "\""
+           << " OutputOrigin=\"0 0 0\""
+           << " OutputExtent=\"" << outputExtent[0] << " " << outputExtent[1] << " " << outputExtent[2] << " "
+           << outputExtent[3] << " " << outputExtent[4] << " " << outputExtent[5] << "\" />"
+           << "</Device>"
+           << "</DataCollection>"
+           << "</PlusConfiguration>";
+    return config.str();
+  }
+
+  //----------------------------------------------------------------------------
+  unsigned long long GetNumberOfPastedFrames()
+  {
+    PlusMetricsRegistry::LabelMap labels;
+    labels["device"] = RECONSTRUCTOR_DEVICE_ID;
+    PlusMetricsRegistry::Counter* counter = PlusMetricsRegistry::GetInstance()->GetCounter("plus_reconstructor_frames_added_total", labels);
+    return (counter != NULL ? counter->GetValue() : 0);
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Maximum voxel value of a snapshot of the reconstructed volume, -1 if the snapshot failed */
+  double GetMaximumVoxelValue(vtkPlusVirtualVolumeReconstructor* reconstructor)
+  {
+    vtkSmartPointer<vtkImageData> snapshot = vtkSmartPointer<vtkImageData>::New();
+    std::string errorMessage;
+    if (reconstructor->GetReconstructedVolume(snapshot, errorMessage) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to take a snapshot of the reconstructed volume: " << errorMessage);
+      return -1;
+    }
+    return snapshot->GetScalarRange()[1];
+  }
+
+  //----------------------------------------------------------------------------
+  /*!
+    Replay the sweep from a sequence file by a saved data source while taking volume snapshots periodically.
+    Returns the number of failures.
+  */
+  int TestSavedDataSourceReplay(int numberOfFrames, int frameSizePixels, double frameRate, double sweepStepMm, double outputSpacingMm,
+                                const int outputExtent[6], double snapshotPeriodSec, double replayMarginSec)
+  {
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> sweepFrames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+    CreateSweep(sweepFrames, 0, numberOfFrames, frameSizePixels, frameRate, sweepStepMm);
+    std::string sequenceFilePath = vtkPlusConfig::GetInstance()->GetOutputPath("vtkVirtualVolumeReconstructorReplayTestSweep.igs.mha");
+    if (vtkPlusSequenceIO::Write(sequenceFilePath, sweepFrames, US_IMG_ORIENT_MF, false) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to write the sweep sequence: " << sequenceFilePath);
+      return 1;
+    }
+    sweepFrames->Clear();
+
+    // The saved data source is updated more frequently than the frame rate of the sweep, so that all the frames are replayed
+    vtkSmartPointer<vtkXMLDataElement> configRootElement = vtkSmartPointer<vtkXMLDataElement>::Take(
+          vtkXMLUtilities::ReadElementFromString(CreateDeviceSetConfiguration(outputExtent, outputSpacingMm, sequenceFilePath, 2 * frameRate).c_str()));
+    vtkSmartPointer<vtkPlusDataCollector> dataCollector = vtkSmartPointer<vtkPlusDataCollector>::New();
+    if (configRootElement == NULL || dataCollector->ReadConfiguration(configRootElement) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to read replay device set configuration");
+      return 1;
+    }
+
+    vtkPlusDevice* device = NULL;
+    vtkPlusVirtualVolumeReconstructor* reconstructor = NULL;
+    if (dataCollector->GetDevice(device, RECONSTRUCTOR_DEVICE_ID) == PLUS_SUCCESS)
+    {
+      reconstructor = vtkPlusVirtualVolumeReconstructor::SafeDownCast(device);
+    }
+    if (reconstructor == NULL)
+    {
+      LOG_ERROR("Volume reconstructor device " << RECONSTRUCTOR_DEVICE_ID << " is not found");
+      return 1;
+    }
+
+    unsigned long long numberOfPastedFramesAtStart = GetNumberOfPastedFrames();
+    if (dataCollector->Connect() != PLUS_SUCCESS || dataCollector->Start() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to start data collection");
+      dataCollector->Disconnect();
+      return 1;
+    }
+
+    // Take snapshots while the sweep is replayed, they must not make the reconstruction skip any data
+    int numberOfFailures = 0;
+    PlusLatencyHistogram snapshotHistogram;
+    int maxNumberOfQueuedFrames = 0;
+    double replayDurationSec = (numberOfFrames - 1) / frameRate + replayMarginSec;
+    double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    double nextSnapshotTime = startTime + snapshotPeriodSec;
+    while (vtkIGSIOAccurateTimer::GetSystemTime() - startTime < replayDurationSec)
+    {
+      maxNumberOfQueuedFrames = std::max(maxNumberOfQueuedFrames, reconstructor->GetNumberOfQueuedFrames());
+      // The volume is allocated when the first frames are pasted, snapshots are only taken after that
+      if (snapshotPeriodSec > 0 && vtkIGSIOAccurateTimer::GetSystemTime() >= nextSnapshotTime && GetNumberOfPastedFrames() > numberOfPastedFramesAtStart)
+      {
+        double snapshotStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
+        if (GetMaximumVoxelValue(reconstructor) < 0)
+        {
+          numberOfFailures++;
+        }
+        snapshotHistogram.RecordValue(vtkIGSIOAccurateTimer::GetSystemTime() - snapshotStartTime);
+        nextSnapshotTime += snapshotPeriodSec;
+      }
+      vtkIGSIOAccurateTimer::Delay(0.005);
+    }
+
+    reconstructor->SetEnableReconstruction(false);
+    double waitStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    if (reconstructor->WaitForQueuedFrames(QUEUED_FRAMES_TIMEOUT_SEC) != PLUS_SUCCESS)
+    {
+      numberOfFailures++;
+    }
+    double waitDurationSec = vtkIGSIOAccurateTimer::GetSystemTime() - waitStartTime;
+    unsigned long long numberOfPastedFrames = GetNumberOfPastedFrames() - numberOfPastedFramesAtStart;
+    long int numberOfSampledFrames = reconstructor->GetTotalFramesRecorded();
+    int numberOfQueuedFrames = reconstructor->GetNumberOfQueuedFrames();
+    double skippedDataSec = reconstructor->GetSkippedDataSec();
+
+    dataCollector->Stop();
+    dataCollector->Disconnect();
+
+    LOG_INFO("Replay: " << numberOfFrames << " frames in sweep, " << numberOfSampledFrames << " sampled, " << numberOfPastedFrames << " pasted into the volume");
+    LOG_INFO("Replay: maximum number of queued frames: " << maxNumberOfQueuedFrames << ", time to paste the remaining frames at stop: " << waitDurationSec << " sec");
+    LOG_INFO("Replay volume snapshots: " << snapshotHistogram.GetSummary());
+
+    if (skippedDataSec != 0)
+    {
+      LOG_ERROR("Volume reconstruction skipped " << skippedDataSec << " sec of data during the replay");
+      numberOfFailures++;
+    }
+    if (numberOfQueuedFrames != 0 || numberOfPastedFrames != static_cast<unsigned long long>(numberOfSampledFrames))
+    {
+      LOG_ERROR("Not all the sampled frames are pasted into the volume: " << numberOfPastedFrames << " of " << numberOfSampledFrames
+                << ", " << numberOfQueuedFrames << " frames are still queued");
+      numberOfFailures++;
+    }
+    // Frames that are acquired before the reconstruction starts sampling are not reconstructed, only a complete failure of the replay is detected
+    if (numberOfSampledFrames < numberOfFrames / 2)
+    {
+      LOG_ERROR("Only " << numberOfSampledFrames << " of the " << numberOfFrames << " replayed frames were sampled for reconstruction");
+      numberOfFailures++;
+    }
+    return numberOfFailures;
+  }
+}
+
+//----------------------------------------------------------------------------
+/*! Volume reconstructor that receives its frames from the test instead of an input channel */
+class vtkReplayTestVolumeReconstructor : public vtkPlusVirtualVolumeReconstructor
+{
+public:
+  static vtkReplayTestVolumeReconstructor* New();
+  vtkTypeMacro(vtkReplayTestVolumeReconstructor, vtkPlusVirtualVolumeReconstructor);
+
+  virtual PlusStatus ReadConfiguration(vtkXMLDataElement* rootConfigElement) { return this->Superclass::ReadConfiguration(rootConfigElement); }
+  PlusStatus QueueFrames(vtkIGSIOTrackedFrameList* trackedFrameList) { return this->Superclass::QueueFrames(trackedFrameList); }
+  void StartReconstructionThread() { this->Superclass::StartReconstructionThread(); }
+  void StopReconstructionThread() { this->Superclass::StopReconstructionThread(); }
+
+protected:
+  vtkReplayTestVolumeReconstructor() {}
+
+private:
+  vtkReplayTestVolumeReconstructor(const vtkReplayTestVolumeReconstructor&);  // Not implemented.
+  void operator=(const vtkReplayTestVolumeReconstructor&);  // Not implemented.
+};
+
+vtkStandardNewMacro(vtkReplayTestVolumeReconstructor);
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  bool printHelp(false);
+  int numberOfFrames(300);
+  int frameSizePixels(256);
+  double frameRate(60.0);
+  double sweepStepMm(0.2);
+  double outputSpacingMm(1.0);
+  int batchSize(10);
+  int snapshotInterval(3);
+  bool replay(false);
+  double snapshotPeriodSec(0.2);
+  double replayMarginSec(3.0);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--frames", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfFrames, "Number of frames in the sweep (default: 300)");
+  args.AddArgument("--frame-size", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &frameSizePixels, "Width and height of the frames in pixels (default: 256)");
+  args.AddArgument("--frame-rate", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &frameRate, "Frame rate of the sweep in FPS, used for the frame timestamps and the replay (default: 60)");
+  args.AddArgument("--sweep-step-mm", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &sweepStepMm, "Distance between consecutive frames in mm (default: 0.2)");
+  args.AddArgument("--output-spacing-mm", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &outputSpacingMm, "Spacing of the reconstructed volume in mm (default: 1.0)");
+  args.AddArgument("--batch-size", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &batchSize, "Number of frames queued for the reconstruction thread at once (default: 10)");
+  args.AddArgument("--snapshot-interval", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &snapshotInterval, "Number of batches between volume snapshots, 0 to disable snapshots (default: 3)");
+  args.AddArgument("--replay", vtksys::CommandLineArguments::NO_ARGUMENT, &replay, "Replay the sweep from a sequence file by a saved data source instead of queuing the frames directly");
+  args.AddArgument("--snapshot-period-sec", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &snapshotPeriodSec, "Time between volume snapshots during the replay, 0 to disable snapshots (default: 0.2)");
+  args.AddArgument("--replay-margin-sec", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &replayMarginSec, "Time given to the replay in addition to the sweep duration (default: 3.0)");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (printHelp)
+  {
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  if (numberOfFrames < 2 || frameSizePixels < 1 || frameRate <= 0 || sweepStepMm <= 0 || outputSpacingMm <= 0 || batchSize < 1 || snapshotInterval < 0 || snapshotPeriodSec < 0 || replayMarginSec < 0)
+  {
+    LOG_ERROR("Invalid sweep parameters");
+    exit(EXIT_FAILURE);
+  }
+
+  // The volume covers the whole sweep
+  int outputExtent[6] = { 0, 0, 0, 0, 0, 0 };
+  outputExtent[1] = static_cast<int>(ceil(frameSizePixels * PIXEL_SPACING_MM / outputSpacingMm));
+  outputExtent[3] = outputExtent[1];
+  outputExtent[5] = static_cast<int>(ceil((numberOfFrames - 1) * sweepStepMm / outputSpacingMm)) + 1;
+
+  if (replay)
+  {
+    if (TestSavedDataSourceReplay(numberOfFrames, frameSizePixels, frameRate, sweepStepMm, outputSpacingMm, outputExtent, snapshotPeriodSec, replayMarginSec) != 0)
+    {
+      LOG_ERROR("Saved data source replay test failed");
+      return EXIT_FAILURE;
+    }
+    LOG_INFO("Test completed successfully");
+    return EXIT_SUCCESS;
+  }
+
+  vtkSmartPointer<vtkXMLDataElement> configRootElement = vtkSmartPointer<vtkXMLDataElement>::Take(
+        vtkXMLUtilities::ReadElementFromString(CreateDeviceSetConfiguration(outputExtent, outputSpacingMm).c_str()));
+  if (configRootElement == NULL)
+  {
+    LOG_ERROR("Unable to parse device set configuration");
+    exit(EXIT_FAILURE);
+  }
+
+  vtkSmartPointer<vtkReplayTestVolumeReconstructor> reconstructor = vtkSmartPointer<vtkReplayTestVolumeReconstructor>::New();
+  reconstructor->SetDeviceId(RECONSTRUCTOR_DEVICE_ID);
+  if (reconstructor->ReadConfiguration(configRootElement) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to read volume reconstructor configuration");
+    exit(EXIT_FAILURE);
+  }
+  reconstructor->StartReconstructionThread();
+
+  int exitCode = EXIT_SUCCESS;
+
+  // Queue the sweep and take snapshots meanwhile, they must not prevent any frame from being pasted
+  PlusLatencyHistogram snapshotHistogram;
+  int maxNumberOfQueuedFrames = 0;
+  unsigned long long numberOfPastedFramesAtStart = GetNumberOfPastedFrames();
+  int batchIndex = 0;
+  for (int firstFrameIndex = 0; firstFrameIndex < numberOfFrames; firstFrameIndex += batchSize, ++batchIndex)
+  {
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> batch = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+    CreateSweep(batch, firstFrameIndex, std::min(batchSize, numberOfFrames - firstFrameIndex), frameSizePixels, frameRate, sweepStepMm);
+    if (reconstructor->QueueFrames(batch) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to queue frames " << firstFrameIndex << "-" << firstFrameIndex + batch->GetNumberOfTrackedFrames() - 1);
+      exitCode = EXIT_FAILURE;
+    }
+    maxNumberOfQueuedFrames = std::max(maxNumberOfQueuedFrames, reconstructor->GetNumberOfQueuedFrames());
+    if (batchIndex == 0 && reconstructor->WaitForQueuedFrames(QUEUED_FRAMES_TIMEOUT_SEC) != PLUS_SUCCESS)
+    {
+      // The volume is allocated when the first frames are pasted, snapshots are only taken after that
+      exitCode = EXIT_FAILURE;
+    }
+    if (snapshotInterval > 0 && (batchIndex + 1) % snapshotInterval == 0)
+    {
+      double snapshotStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
+      if (GetMaximumVoxelValue(reconstructor) < 0)
+      {
+        exitCode = EXIT_FAILURE;
+      }
+      snapshotHistogram.RecordValue(vtkIGSIOAccurateTimer::GetSystemTime() - snapshotStartTime);
+    }
+  }
+
+  double waitStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
+  if (reconstructor->WaitForQueuedFrames(QUEUED_FRAMES_TIMEOUT_SEC) != PLUS_SUCCESS)
+  {
+    exitCode = EXIT_FAILURE;
+  }
+  double waitDurationSec = vtkIGSIOAccurateTimer::GetSystemTime() - waitStartTime;
+  unsigned long long numberOfPastedFrames = GetNumberOfPastedFrames() - numberOfPastedFramesAtStart;
+  if (numberOfPastedFrames != static_cast<unsigned long long>(numberOfFrames) || reconstructor->GetNumberOfQueuedFrames() != 0)
+  {
+    LOG_ERROR("Not all the queued frames are pasted into the volume: " << numberOfPastedFrames << " of " << numberOfFrames
+              << ", " << reconstructor->GetNumberOfQueuedFrames() << " frames are still queued");
+    exitCode = EXIT_FAILURE;
+  }
+  if (GetMaximumVoxelValue(reconstructor) <= 0)
+  {
+    LOG_ERROR("The reconstructed volume is empty after pasting the sweep");
+    exitCode = EXIT_FAILURE;
+  }
+
+  PlusMetricsRegistry::LabelMap labels;
+  labels["device"] = RECONSTRUCTOR_DEVICE_ID;
+  PlusLatencyHistogram* frameInsertionHistogram = PlusMetricsRegistry::GetInstance()->GetHistogram("plus_reconstructor_frame_insertion_seconds", labels);
+  LOG_INFO("Frames: " << numberOfFrames << " in sweep, " << numberOfPastedFrames << " pasted into the volume in batches of " << batchSize);
+  LOG_INFO("Maximum number of queued frames: " << maxNumberOfQueuedFrames << ", time to paste the remaining frames after queuing: " << waitDurationSec << " sec");
+  if (frameInsertionHistogram != NULL)
+  {
+    LOG_INFO("Frame pasting: " << frameInsertionHistogram->GetSummary());
+  }
+  LOG_INFO("Volume snapshots: " << snapshotHistogram.GetSummary());
+
+  // Queue the sweep again and reset the volume while the frames are queued or being pasted
+  for (int firstFrameIndex = 0; firstFrameIndex < numberOfFrames; firstFrameIndex += batchSize)
+  {
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> batch = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+    CreateSweep(batch, firstFrameIndex, std::min(batchSize, numberOfFrames - firstFrameIndex), frameSizePixels, frameRate, sweepStepMm);
+    if (reconstructor->QueueFrames(batch) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to queue frames " << firstFrameIndex << "-" << firstFrameIndex + batch->GetNumberOfTrackedFrames() - 1);
+      exitCode = EXIT_FAILURE;
+    }
+  }
+  reconstructor->Reset();
+  if (reconstructor->WaitForQueuedFrames(QUEUED_FRAMES_TIMEOUT_SEC) != PLUS_SUCCESS)
+  {
+    exitCode = EXIT_FAILURE;
+  }
+  double maxVoxelValueAfterReset = GetMaximumVoxelValue(reconstructor);
+  if (maxVoxelValueAfterReset != 0 || reconstructor->GetNumberOfQueuedFrames() != 0)
+  {
+    LOG_ERROR("Frames that were queued before the reset are pasted into the cleared volume: maximum voxel value is " << maxVoxelValueAfterReset
+              << ", " << reconstructor->GetNumberOfQueuedFrames() << " frames are still queued");
+    exitCode = EXIT_FAILURE;
+  }
+
+  reconstructor->StopReconstructionThread();
+
+  if (exitCode == EXIT_SUCCESS)
+  {
+    LOG_INFO("Test completed successfully");
+  }
+  return exitCode;
+}
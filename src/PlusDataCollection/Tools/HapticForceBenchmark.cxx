@@ -0,0 +1,403 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file HapticForceBenchmark.cxx
+  \brief Measures the number of force evaluations per second of haptic force models with and without precomputed distance grid
+
+  Forces are computed at random positions within the distance grid and the difference between the directly
+  computed and the grid based forces is reported.
+
+  With --verify the distance grid is checked and the program fails if the check does not pass:
+  - polydata models: the interpolated distance must not differ from the directly computed distance to the
+    closest surface point by more than --max-distance-error (default: grid cell diagonal, which is an upper bound
+    of the trilinear interpolation error of the point distance function)
+  - polydata models: the force computed using the grid must be the same as the directly computed force, except where
+    the closest point of the position is not the closest point of any of the grid cell corners. The forces are compared at
+    positions where any of them is non-zero: the ratio of positions where they differ must not be larger than
+    --max-force-mismatch-ratio and the mean force difference must not be larger than --max-mean-force-error.
+    The force of the model changes abruptly where the closest surface point changes, so the maximum difference is not bounded.
+  - all models: if --max-force-error is specified then the force difference must not be larger than that
+  - all models: the grid must be identical after it is written to a cache file and read back
+  With --sphere a sphere surface is generated, so no input files are needed.
+*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusForceFeedback.h"
+#include "vtkPlusHapticDistanceGrid.h"
+#include "vtkPlusImplicitSplineForce.h"
+#include "vtkPlusPolydataForce.h"
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataReader.h>
+#include <vtkSmartPointer.h>
+#include <vtkSphereSource.h>
+#include <vtksys/CommandLineArguments.hxx>
+#include <vtksys/SystemTools.hxx>
+
+// STL includes
+#include <vector>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  double MeasureForces(vtkPlusForceFeedback* forceModel, const std::vector<double>& positions, std::vector<double>& forces)
+  {
+    vtkSmartPointer<vtkMatrix4x4> transform = vtkSmartPointer<vtkMatrix4x4>::New();
+    int numberOfEvaluations = positions.size() / 3;
+    forces.assign(positions.size(), 0.0);
+    double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+    for (int i = 0; i < numberOfEvaluations; i++)
+    {
+      transform->SetElement(0, 3, positions[3 * i]);
+      transform->SetElement(1, 3, positions[3 * i + 1]);
+      transform->SetElement(2, 3, positions[3 * i + 2]);
+      forceModel->GenerateForce(transform, &forces[3 * i]);
+    }
+    return vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Compare interpolated distances to the distance to the closest polydata point. Returns the number of failures. */
+  int VerifyPolydataDistances(vtkPolyData* polydata, vtkPlusHapticDistanceGrid* distanceGrid, const std::vector<double>& positions, double maxDistanceError)
+  {
+    int numberOfPositions = positions.size() / 3;
+    int numberOfInterpolatedPositions = 0;
+    double maxError = 0.0;
+    for (int i = 0; i < numberOfPositions; i++)
+    {
+      const double* position = &positions[3 * i];
+      double gridValues[vtkPlusHapticDistanceGrid::NUMBER_OF_COMPONENTS];
+      if (!distanceGrid->Interpolate(position, gridValues))
+      {
+        // outside the narrow band
+        continue;
+      }
+      numberOfInterpolatedPositions++;
+      double closestPoint[3] = {0, 0, 0};
+      polydata->GetPoint(polydata->FindPoint(position[0], position[1], position[2]), closestPoint);
+      double distance = sqrt(vtkMath::Distance2BetweenPoints(position, closestPoint));
+      maxError = std::max(maxError, fabs(gridValues[0] - distance));
+    }
+
+    LOG_INFO("Distance error: max " << maxError << " at " << numberOfInterpolatedPositions << " interpolated positions (allowed: " << maxDistanceError << ")");
+    if (numberOfInterpolatedPositions == 0)
+    {
+      LOG_ERROR("Distance grid could not be interpolated at any of the " << numberOfPositions << " positions");
+      return 1;
+    }
+    if (maxError > maxDistanceError)
+    {
+      LOG_ERROR("Distance grid error " << maxError << " is larger than the allowed " << maxDistanceError);
+      return 1;
+    }
+    return 0;
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Compare forces computed using the distance grid to directly computed forces. Returns the number of failures. */
+  int VerifyPolydataForces(const std::vector<double>& directForces, const std::vector<double>& gridForces, double maxForceMismatchRatio, double maxMeanForceError)
+  {
+    // Difference that is certainly not caused by the single precision storage of the closest points in the grid
+    const double FORCE_MISMATCH_THRESHOLD = 1e-3;
+    int numberOfPositions = directForces.size() / 3;
+    int numberOfForcePositions = 0;
+    int numberOfMismatches = 0;
+    double sumForceDifference = 0.0;
+    const double zero[3] = {0, 0, 0};
+    for (int i = 0; i < numberOfPositions; i++)
+    {
+      if (vtkMath::Distance2BetweenPoints(&directForces[3 * i], zero) == 0 && vtkMath::Distance2BetweenPoints(&gridForces[3 * i], zero) == 0)
+      {
+        // far from the surface
+        continue;
+      }
+      numberOfForcePositions++;
+      double forceDifference = sqrt(vtkMath::Distance2BetweenPoints(&directForces[3 * i], &gridForces[3 * i]));
+      sumForceDifference += forceDifference;
+      if (forceDifference > FORCE_MISMATCH_THRESHOLD)
+      {
+        numberOfMismatches++;
+      }
+    }
+    if (numberOfForcePositions == 0)
+    {
+      LOG_ERROR("Force is zero at all the " << numberOfPositions << " positions, forces cannot be verified");
+      return 1;
+    }
+
+    double mismatchRatio = static_cast<double>(numberOfMismatches) / numberOfForcePositions;
+    double meanForceDifference = sumForceDifference / numberOfForcePositions;
+    LOG_INFO("Force mismatch: " << numberOfMismatches << " of " << numberOfForcePositions << " positions with non-zero force (ratio: " << mismatchRatio
+             << ", allowed: " << maxForceMismatchRatio << "), mean force difference: " << meanForceDifference << " (allowed: " << maxMeanForceError << ")");
+    int numberOfFailures = 0;
+    if (mismatchRatio > maxForceMismatchRatio)
+    {
+      LOG_ERROR("Forces computed using the distance grid differ from the direct computation at " << numberOfMismatches << " of " << numberOfForcePositions << " positions");
+      numberOfFailures++;
+    }
+    if (meanForceDifference > maxMeanForceError)
+    {
+      LOG_ERROR("Mean force difference " << meanForceDifference << " is larger than the allowed " << maxMeanForceError);
+      numberOfFailures++;
+    }
+    return numberOfFailures;
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Write the distance grid to file, read it back, and compare interpolated values. Returns the number of failures. */
+  int VerifyCacheFile(vtkPlusHapticDistanceGrid* distanceGrid, const std::string& cacheFileName, const std::vector<double>& positions)
+  {
+    const std::string key = "HapticForceBenchmark";
+    if (distanceGrid->WriteToFile(cacheFileName, key) != 0)
+    {
+      LOG_ERROR("Failed to write distance grid to " << cacheFileName);
+      return 1;
+    }
+
+    vtkSmartPointer<vtkPlusHapticDistanceGrid> readGrid = vtkSmartPointer<vtkPlusHapticDistanceGrid>::New();
+    int readResult = readGrid->ReadFromFile(cacheFileName, key);
+    vtksys::SystemTools::RemoveFile(cacheFileName.c_str());
+    if (readResult != 0 || !readGrid->IsValid())
+    {
+      LOG_ERROR("Failed to read distance grid from " << cacheFileName);
+      return 1;
+    }
+
+    double* writtenBounds = distanceGrid->GetBounds();
+    double* readBounds = readGrid->GetBounds();
+    for (int i = 0; i < 6; i++)
+    {
+      if (writtenBounds[i] != readBounds[i])
+      {
+        LOG_ERROR("Distance grid bounds changed after reading from file");
+        return 1;
+      }
+    }
+    if (distanceGrid->GetSpacing() != readGrid->GetSpacing() || distanceGrid->GetNumberOfStoredBricks() != readGrid->GetNumberOfStoredBricks())
+    {
+      LOG_ERROR("Distance grid spacing or number of stored bricks changed after reading from file");
+      return 1;
+    }
+
+    int numberOfPositions = positions.size() / 3;
+    for (int i = 0; i < numberOfPositions; i++)
+    {
+      double writtenValues[vtkPlusHapticDistanceGrid::NUMBER_OF_COMPONENTS];
+      double readValues[vtkPlusHapticDistanceGrid::NUMBER_OF_COMPONENTS];
+      bool writtenValid = distanceGrid->Interpolate(&positions[3 * i], writtenValues);
+      bool readValid = readGrid->Interpolate(&positions[3 * i], readValues);
+      if (writtenValid != readValid)
+      {
+        LOG_ERROR("Distance grid availability changed after reading from file at position " << i);
+        return 1;
+      }
+      if (!writtenValid)
+      {
+        continue;
+      }
+      for (int component = 0; component < vtkPlusHapticDistanceGrid::NUMBER_OF_COMPONENTS; component++)
+      {
+        if (writtenValues[component] != readValues[component])
+        {
+          LOG_ERROR("Distance grid value changed after reading from file at position " << i << ": " << writtenValues[component] << " != " << readValues[component]);
+          return 1;
+        }
+      }
+    }
+    LOG_INFO("Distance grid cache file round trip succeeded");
+    return 0;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp = false;
+  std::string knotsFileName;
+  std::string controlPointsFileName;
+  std::string polydataFileName;
+  double sphereRadius = 0.0;
+  std::string cacheDirectory;
+  double gridSpacing = 1.0;
+  double narrowBandWidth = 0.0;
+  int numberOfEvaluations = 100000;
+  bool verify = false;
+  double maxDistanceError = -1.0;
+  double maxForceError = -1.0;
+  double maxForceMismatchRatio = 0.1;
+  double maxMeanForceError = 0.05;
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help");
+  args.AddArgument("--knot-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &knotsFileName, "Implicit spline knots file");
+  args.AddArgument("--control-point-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &controlPointsFileName, "Implicit spline control points file");
+  args.AddArgument("--polydata-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &polydataFileName, "Surface model file (.vtk) for polydata force benchmark");
+  args.AddArgument("--sphere", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &sphereRadius, "Radius of a generated sphere surface for polydata force benchmark (no input file is needed)");
+  args.AddArgument("--grid-spacing", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &gridSpacing, "Distance grid spacing (default: 1.0)");
+  args.AddArgument("--narrow-band", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &narrowBandWidth, "Narrow band width of the implicit spline distance grid (default: 0, store all)");
+  args.AddArgument("--cache-dir", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &cacheDirectory, "Directory for saving and loading distance grids");
+  args.AddArgument("--evaluations", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfEvaluations, "Number of force evaluations (default: 100000)");
+  args.AddArgument("--verify", vtksys::CommandLineArguments::NO_ARGUMENT, &verify, "Verify distance grid accuracy and cache file round trip, fail if the verification does not pass");
+  args.AddArgument("--max-distance-error", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &maxDistanceError, "Maximum allowed difference of interpolated and direct polydata distance with --verify (default: grid cell diagonal)");
+  args.AddArgument("--max-force-error", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &maxForceError, "Maximum allowed difference of interpolated and direct force with --verify (default: not checked)");
+  args.AddArgument("--max-force-mismatch-ratio", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &maxForceMismatchRatio, "Maximum allowed ratio of positions where the polydata force computed using the grid differs from the direct computation with --verify (default: 0.1)");
+  args.AddArgument("--max-mean-force-error", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &maxMeanForceError, "Maximum allowed mean difference of polydata forces computed using the grid and directly, at positions with non-zero force, with --verify (default: 0.05)");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  // Force model with direct evaluation and the same model with distance grid
+  vtkSmartPointer<vtkPlusForceFeedback> directForceModel;
+  vtkSmartPointer<vtkPlusForceFeedback> gridForceModel;
+  vtkPlusHapticDistanceGrid* distanceGrid = NULL;
+  vtkSmartPointer<vtkPolyData> polydata;
+  double gridStartTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+  if (!knotsFileName.empty() && !controlPointsFileName.empty())
+  {
+    vtkSmartPointer<vtkPlusImplicitSplineForce> directSplineForce = vtkSmartPointer<vtkPlusImplicitSplineForce>::New();
+    directSplineForce->SetInput(knotsFileName, controlPointsFileName);
+    directForceModel = directSplineForce;
+
+    vtkSmartPointer<vtkPlusImplicitSplineForce> gridSplineForce = vtkSmartPointer<vtkPlusImplicitSplineForce>::New();
+    gridSplineForce->UseDistanceGridOn();
+    gridSplineForce->SetDistanceGridSpacing(gridSpacing);
+    gridSplineForce->SetDistanceGridNarrowBandWidth(narrowBandWidth);
+    gridSplineForce->SetDistanceGridCacheDirectory(cacheDirectory);
+    gridSplineForce->SetInput(knotsFileName, controlPointsFileName);
+    gridForceModel = gridSplineForce;
+    distanceGrid = gridSplineForce->GetDistanceGrid();
+  }
+  else if (!polydataFileName.empty() || sphereRadius > 0)
+  {
+    if (!polydataFileName.empty())
+    {
+      vtkSmartPointer<vtkPolyDataReader> reader = vtkSmartPointer<vtkPolyDataReader>::New();
+      reader->SetFileName(polydataFileName.c_str());
+      reader->Update();
+      polydata = reader->GetOutput();
+    }
+    else
+    {
+      vtkSmartPointer<vtkSphereSource> sphereSource = vtkSmartPointer<vtkSphereSource>::New();
+      sphereSource->SetRadius(sphereRadius);
+      sphereSource->SetThetaResolution(64);
+      sphereSource->SetPhiResolution(64);
+      sphereSource->Update();
+      polydata = sphereSource->GetOutput();
+    }
+    if (polydata == NULL || polydata->GetNumberOfPoints() < 1)
+    {
+      LOG_ERROR("Failed to read polydata from " << polydataFileName);
+      exit(EXIT_FAILURE);
+    }
+
+    vtkSmartPointer<vtkPlusPolydataForce> directPolydataForce = vtkSmartPointer<vtkPlusPolydataForce>::New();
+    directPolydataForce->SetInput(polydata);
+    directForceModel = directPolydataForce;
+
+    vtkSmartPointer<vtkPlusPolydataForce> gridPolydataForce = vtkSmartPointer<vtkPlusPolydataForce>::New();
+    gridPolydataForce->UseDistanceGridOn();
+    gridPolydataForce->SetDistanceGridSpacing(gridSpacing);
+    gridPolydataForce->SetDistanceGridCacheDirectory(cacheDirectory);
+    gridPolydataForce->SetInput(polydata);
+    gridForceModel = gridPolydataForce;
+    distanceGrid = gridPolydataForce->GetDistanceGrid();
+  }
+  else
+  {
+    LOG_ERROR("Either --knot-file and --control-point-file, --polydata-file, or --sphere is required");
+    exit(EXIT_FAILURE);
+  }
+  double gridTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - gridStartTimeSec;
+
+  if (!distanceGrid->IsValid())
+  {
+    LOG_ERROR("Failed to compute distance grid");
+    exit(EXIT_FAILURE);
+  }
+  LOG_INFO("Distance grid preparation time: " << gridTimeSec << " sec, stored bricks: " << distanceGrid->GetNumberOfStoredBricks() << " of " << distanceGrid->GetNumberOfBricks());
+
+  // Random positions within the grid
+  double* bounds = distanceGrid->GetBounds();
+  std::vector<double> positions(3 * numberOfEvaluations);
+  vtkMath::RandomSeed(1234);
+  for (int i = 0; i < numberOfEvaluations; i++)
+  {
+    for (int axis = 0; axis < 3; axis++)
+    {
+      positions[3 * i + axis] = vtkMath::Random(bounds[2 * axis], bounds[2 * axis + 1]);
+    }
+  }
+
+  std::vector<double> directForces;
+  std::vector<double> gridForces;
+  double directTimeSec = MeasureForces(directForceModel, positions, directForces);
+  double gridEvaluationTimeSec = MeasureForces(gridForceModel, positions, gridForces);
+
+  double maxForceDifference = 0.0;
+  double sumForceDifference = 0.0;
+  for (int i = 0; i < numberOfEvaluations; i++)
+  {
+    double forceDifference = sqrt(vtkMath::Distance2BetweenPoints(&directForces[3 * i], &gridForces[3 * i]));
+    maxForceDifference = std::max(maxForceDifference, forceDifference);
+    sumForceDifference += forceDifference;
+  }
+
+  LOG_INFO("Direct evaluation: " << numberOfEvaluations / directTimeSec << " evaluations/sec");
+  LOG_INFO("Distance grid: " << numberOfEvaluations / gridEvaluationTimeSec << " evaluations/sec (speedup: " << directTimeSec / gridEvaluationTimeSec << ")");
+  LOG_INFO("Force difference: mean " << (numberOfEvaluations > 0 ? sumForceDifference / numberOfEvaluations : 0.0) << ", max " << maxForceDifference);
+
+  if (!verify)
+  {
+    return EXIT_SUCCESS;
+  }
+
+  int numberOfFailures = 0;
+  if (polydata != NULL)
+  {
+    if (maxDistanceError < 0)
+    {
+      // The distance to the closest point changes at most by the displacement, so trilinear interpolation
+      // cannot be off by more than the cell diagonal
+      maxDistanceError = sqrt(3.0) * distanceGrid->GetSpacing();
+    }
+    numberOfFailures += VerifyPolydataDistances(polydata, distanceGrid, positions, maxDistanceError);
+    numberOfFailures += VerifyPolydataForces(directForces, gridForces, maxForceMismatchRatio, maxMeanForceError);
+  }
+  if (maxForceError >= 0 && maxForceDifference > maxForceError)
+  {
+    LOG_ERROR("Force difference " << maxForceDifference << " is larger than the allowed " << maxForceError);
+    numberOfFailures++;
+  }
+  std::string cacheFileName = (cacheDirectory.empty() ? std::string(".") : cacheDirectory) + "/HapticForceBenchmarkDistanceGrid.bin";
+  numberOfFailures += VerifyCacheFile(distanceGrid, cacheFileName, positions);
+
+  if (numberOfFailures > 0)
+  {
+    LOG_ERROR("Distance grid verification failed");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
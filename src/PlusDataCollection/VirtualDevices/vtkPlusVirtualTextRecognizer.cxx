@@ -19,6 +19,10 @@ See License.txt for details.
 #include <tesseract/strngs.h>
 #include <allheaders.h>
 
+// STL includes
+#include <algorithm>
+#include <cstdlib>
+
 // Configuration includes
 #include "tesseractDataDir.h"
 
@@ -39,6 +43,7 @@ namespace
   static const int PARAMETER_DEPTH_BITS = 8;
   static const char* DEFAULT_LANGUAGE = "eng";
   static const int TEXT_RECOGNIZER_MISSING_INPUT_DEFAULT = 1;
+  static const int DEFAULT_PIXEL_CHANGE_THRESHOLD = 0;
 }
 
 //----------------------------------------------------------------------------
@@ -46,6 +51,9 @@ vtkPlusVirtualTextRecognizer::vtkPlusVirtualTextRecognizer()
   : vtkPlusDevice()
   , Language()
   , TrackedFrames(vtkIGSIOTrackedFrameList::New())
+  , PixelChangeThreshold(DEFAULT_PIXEL_CHANGE_THRESHOLD)
+  , NumberOfRecognitionThreads(1)
+  , Threader(vtkSmartPointer<vtkMultiThreader>::New())
   , OutputChannel(NULL)
 {
   // The data capture thread will be used to regularly check the input devices and generate and update the output
@@ -56,6 +64,7 @@ vtkPlusVirtualTextRecognizer::vtkPlusVirtualTextRecognizer()
 //----------------------------------------------------------------------------
 void vtkPlusVirtualTextRecognizer::ClearConfiguration()
 {
+  this->RecognitionRequiredFields.clear();
   for (ChannelFieldListMapIterator it = this->RecognitionFields.begin(); it != this->RecognitionFields.end(); ++it)
   {
     for (FieldListIterator fieldIt = it->second.begin(); fieldIt != it->second.end(); ++fieldIt)
@@ -79,6 +88,17 @@ vtkPlusVirtualTextRecognizer::~vtkPlusVirtualTextRecognizer()
 void vtkPlusVirtualTextRecognizer::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "PixelChangeThreshold: " << this->PixelChangeThreshold << std::endl;
+  os << indent << "NumberOfRecognitionThreads: " << this->NumberOfRecognitionThreads << std::endl;
+  for (ChannelFieldListMapIterator it = this->RecognitionFields.begin(); it != this->RecognitionFields.end(); ++it)
+  {
+    for (FieldListIterator fieldIt = it->second.begin(); fieldIt != it->second.end(); ++fieldIt)
+    {
+      TextFieldParameter* parameter = *fieldIt;
+      os << indent << "Field " << parameter->ParameterName << ": value=\"" << parameter->LatestParameterValue << "\", recognitions: " << parameter->NumberOfRecognitions
+         << ", skipped recognitions: " << parameter->NumberOfSkippedRecognitions << std::endl;
+    }
+  }
 }
 
 #ifdef PLUS_TEST_TextRecognizer
@@ -87,6 +107,12 @@ vtkPlusVirtualTextRecognizer::ChannelFieldListMap& vtkPlusVirtualTextRecognizer:
 {
   return this->RecognitionFields;
 }
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusVirtualTextRecognizer::RecognizeFieldsOnce()
+{
+  return this->InternalUpdate();
+}
 #endif
 
 //----------------------------------------------------------------------------
@@ -100,6 +126,8 @@ PlusStatus vtkPlusVirtualTextRecognizer::InternalUpdate()
     return PLUS_SUCCESS;
   }
 
+  this->RecognitionRequiredFields.clear();
+
   for (ChannelFieldListMapIterator it = this->RecognitionFields.begin(); it != this->RecognitionFields.end(); ++it)
   {
     for (FieldListIterator fieldIt = it->second.begin(); fieldIt != it->second.end(); ++fieldIt)
@@ -118,15 +146,31 @@ PlusStatus vtkPlusVirtualTextRecognizer::InternalUpdate()
       // We have a frame, let's parse it
       vtkImageDataToPix(frame, parameter);
 
-      this->TesseractAPI->SetImage(parameter->ReceivedFrame);
-      char* text_out = this->TesseractAPI->GetUTF8Text();
-      std::string textStr(text_out);
-      parameter->LatestParameterValue = igsioCommon::Trim(textStr);
-      delete [] text_out;
+      if (!this->IsScreenRegionChanged(parameter))
+      {
+        // Text cannot have changed, keep the latest recognized value
+        parameter->NumberOfSkippedRecognitions++;
+        continue;
+      }
+      this->RecognitionRequiredFields.push_back(parameter);
+    }
+  }
 
-      frame.SetFrameField(parameter->ParameterName, parameter->LatestParameterValue);
+  int numberOfThreads = std::min<int>(this->TesseractAPIs.size(), this->RecognitionRequiredFields.size());
+  if (numberOfThreads == 1)
+  {
+    // No need for extra threads, recognize all the changed fields in this thread
+    for (FieldListIterator fieldIt = this->RecognitionRequiredFields.begin(); fieldIt != this->RecognitionRequiredFields.end(); ++fieldIt)
+    {
+      this->RecognizeText(*fieldIt, this->TesseractAPIs[0]);
     }
   }
+  else if (numberOfThreads > 1)
+  {
+    this->Threader->SetNumberOfThreads(numberOfThreads);
+    this->Threader->SetSingleMethod(&vtkPlusVirtualTextRecognizer::RecognizeTextThread, this);
+    this->Threader->SingleMethodExecute();
+  }
 
   // Build the field map to send to the data sources
   igsioFieldMapType fieldMap;
@@ -148,6 +192,99 @@ PlusStatus vtkPlusVirtualTextRecognizer::InternalUpdate()
   return PLUS_SUCCESS;
 }
 
+//----------------------------------------------------------------------------
+bool vtkPlusVirtualTextRecognizer::IsScreenRegionChanged(TextFieldParameter* parameter)
+{
+  const unsigned char* pixels = static_cast<const unsigned char*>(parameter->ScreenRegion->GetScalarPointer());
+  size_t numberOfBytes = parameter->ScreenRegion->GetNumberOfPoints() * parameter->ScreenRegion->GetNumberOfScalarComponents() * parameter->ScreenRegion->GetScalarSize();
+  if (pixels == NULL)
+  {
+    return true;
+  }
+
+  bool changed = true;
+  if (this->PixelChangeThreshold >= 0 && parameter->PreviousScreenRegionValid && parameter->PreviousScreenRegion.size() == numberOfBytes)
+  {
+    changed = false;
+    const unsigned char* previousPixels = parameter->PreviousScreenRegion.empty() ? NULL : &parameter->PreviousScreenRegion[0];
+    if (this->PixelChangeThreshold == 0)
+    {
+      changed = (numberOfBytes > 0 && memcmp(pixels, previousPixels, numberOfBytes) != 0);
+    }
+    else
+    {
+      for (size_t i = 0; i < numberOfBytes; ++i)
+      {
+        if (abs(static_cast<int>(pixels[i]) - static_cast<int>(previousPixels[i])) > this->PixelChangeThreshold)
+        {
+          changed = true;
+          break;
+        }
+      }
+    }
+  }
+
+  if (changed)
+  {
+    // Compare to the pixels of the last recognition, so slow drifts are detected as well
+    parameter->PreviousScreenRegion.assign(pixels, pixels + numberOfBytes);
+    parameter->PreviousScreenRegionValid = true;
+  }
+  return changed;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusVirtualTextRecognizer::RecognizeText(TextFieldParameter* parameter, tesseract::TessBaseAPI* tesseractAPI)
+{
+  double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+
+  tesseractAPI->SetImage(parameter->ReceivedFrame);
+  char* text_out = tesseractAPI->GetUTF8Text();
+  std::string textStr(text_out);
+  parameter->LatestParameterValue = igsioCommon::Trim(textStr);
+  delete [] text_out;
+
+  double recognitionTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
+  parameter->NumberOfRecognitions++;
+  parameter->TotalRecognitionTimeSec += recognitionTimeSec;
+  parameter->MaxRecognitionTimeSec = std::max(parameter->MaxRecognitionTimeSec, recognitionTimeSec);
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkPlusVirtualTextRecognizer::RecognizeTextThread(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  vtkPlusVirtualTextRecognizer* self = static_cast<vtkPlusVirtualTextRecognizer*>(threadInfo->UserData);
+  // Each field is processed by exactly one thread, so the field parameters can be updated without locking
+  for (unsigned int i = threadInfo->ThreadID; i < self->RecognitionRequiredFields.size(); i += threadInfo->NumberOfThreads)
+  {
+    self->RecognizeText(self->RecognitionRequiredFields[i], self->TesseractAPIs[threadInfo->ThreadID]);
+  }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusVirtualTextRecognizer::LogRecognitionStatistics()
+{
+  for (ChannelFieldListMapIterator it = this->RecognitionFields.begin(); it != this->RecognitionFields.end(); ++it)
+  {
+    for (FieldListIterator fieldIt = it->second.begin(); fieldIt != it->second.end(); ++fieldIt)
+    {
+      TextFieldParameter* parameter = *fieldIt;
+      unsigned long numberOfUpdates = parameter->NumberOfRecognitions + parameter->NumberOfSkippedRecognitions;
+      if (numberOfUpdates == 0)
+      {
+        continue;
+      }
+      double averageRecognitionTimeMs = (parameter->NumberOfRecognitions > 0 ? parameter->TotalRecognitionTimeSec / parameter->NumberOfRecognitions * 1000.0 : 0.0);
+      LOG_INFO("Text recognition statistics of field " << parameter->ParameterName << ": "
+               << parameter->NumberOfRecognitions << " recognitions, " << parameter->NumberOfSkippedRecognitions << " skipped (unchanged region, "
+               << 100.0 * parameter->NumberOfSkippedRecognitions / numberOfUpdates << "%), recognition time: average " << averageRecognitionTimeMs
+               << " ms, max " << parameter->MaxRecognitionTimeSec * 1000.0 << " ms");
+    }
+  }
+}
+
 //----------------------------------------------------------------------------
 void vtkPlusVirtualTextRecognizer::vtkImageDataToPix(igsioTrackedFrame& frame, TextFieldParameter* parameter)
 {
@@ -236,13 +373,27 @@ PlusStatus vtkPlusVirtualTextRecognizer::InternalConnect()
   ss << "TESSDATA_PREFIX=" << tesseract_data_dir;
   vtksys::SystemTools::PutEnv(ss.str());
 
-  this->TesseractAPI = new tesseract::TessBaseAPI();
-  if (this->TesseractAPI->Init(NULL, Language.c_str(), tesseract::OEM_TESSERACT_CUBE_COMBINED) != 0)
+  // Tesseract instances cannot be used from multiple threads at the same time, create one for each thread
+  for (int i = 0; i < this->NumberOfRecognitionThreads; ++i)
   {
-    LOG_ERROR("Unable to init tesseract library. Cannot perform text recognition.");
-    return PLUS_FAIL;
+    tesseract::TessBaseAPI* tesseractAPI = new tesseract::TessBaseAPI();
+    this->TesseractAPIs.push_back(tesseractAPI);
+    if (tesseractAPI->Init(NULL, Language.c_str(), tesseract::OEM_TESSERACT_CUBE_COMBINED) != 0)
+    {
+      LOG_ERROR("Unable to init tesseract library. Cannot perform text recognition.");
+      return PLUS_FAIL;
+    }
+    tesseractAPI->SetPageSegMode(tesseract::PSM_SINGLE_LINE);
+  }
+
+  // Make sure the first frame is recognized
+  for (ChannelFieldListMapIterator it = this->RecognitionFields.begin(); it != this->RecognitionFields.end(); ++it)
+  {
+    for (FieldListIterator fieldIt = it->second.begin(); fieldIt != it->second.end(); ++fieldIt)
+    {
+      (*fieldIt)->PreviousScreenRegionValid = false;
+    }
   }
-  this->TesseractAPI->SetPageSegMode(tesseract::PSM_SINGLE_LINE);
 
   return PLUS_SUCCESS;
 }
@@ -250,8 +401,13 @@ PlusStatus vtkPlusVirtualTextRecognizer::InternalConnect()
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusVirtualTextRecognizer::InternalDisconnect()
 {
-  delete this->TesseractAPI;
-  this->TesseractAPI = NULL;
+  this->LogRecognitionStatistics();
+
+  for (std::vector<tesseract::TessBaseAPI*>::iterator it = this->TesseractAPIs.begin(); it != this->TesseractAPIs.end(); ++it)
+  {
+    delete *it;
+  }
+  this->TesseractAPIs.clear();
 
   ClearConfiguration();
 
@@ -280,6 +436,8 @@ PlusStatus vtkPlusVirtualTextRecognizer::ReadConfiguration(vtkXMLDataElement* ro
 
   this->SetLanguage(DEFAULT_LANGUAGE);
   XML_READ_CSTRING_ATTRIBUTE_OPTIONAL(Language, deviceConfig);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, PixelChangeThreshold, deviceConfig);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, NumberOfRecognitionThreads, deviceConfig);
 
   XML_FIND_NESTED_ELEMENT_OPTIONAL(screenFields, deviceConfig, PARAMETER_LIST_TAG_NAME);
 
@@ -343,6 +501,14 @@ PlusStatus vtkPlusVirtualTextRecognizer::WriteConfiguration(vtkXMLDataElement* r
   {
     XML_WRITE_STRING_ATTRIBUTE_IF_NOT_EMPTY(Language, deviceConfig);
   }
+  if (this->PixelChangeThreshold != DEFAULT_PIXEL_CHANGE_THRESHOLD)
+  {
+    deviceConfig->SetIntAttribute("PixelChangeThreshold", this->PixelChangeThreshold);
+  }
+  if (this->NumberOfRecognitionThreads != 1)
+  {
+    deviceConfig->SetIntAttribute("NumberOfRecognitionThreads", this->NumberOfRecognitionThreads);
+  }
 
   XML_FIND_NESTED_ELEMENT_CREATE_IF_MISSING(screenFields, deviceConfig, PARAMETER_LIST_TAG_NAME);
 
@@ -12,6 +12,8 @@ See License.txt for details.
 #include "vtkPlusChannel.h"
 #include "vtkPlusDevice.h"
 
+#include <vtkMultiThreader.h>
+
 namespace tesseract
 {
   class TessBaseAPI;
@@ -21,7 +23,13 @@ typedef struct Pix PIX;
 
 /*!
 \class vtkPlusVirtualTextRecognizer
-\brief
+\brief Recognizes text in rectangular regions of video frames and sends it in an output channel as field data
+
+Text recognition is expensive (tens of milliseconds per field), while the on-screen text of an ultrasound system
+display typically changes only when the operator changes an imaging parameter. Therefore the pixels of each
+field region are compared to the region at the last recognition and recognition is skipped if no pixel value changed
+more than PixelChangeThreshold; the previously recognized value is reused instead. Changed fields are recognized
+in parallel if NumberOfRecognitionThreads is larger than one (each thread uses its own recognition engine).
 
 \ingroup PlusLibDataCollection
 */
@@ -41,6 +49,11 @@ public:
       this->Size[0] = 0;
       this->Size[1] = 0;
       this->Size[2] = 1;
+      this->PreviousScreenRegionValid = false;
+      this->NumberOfRecognitions = 0;
+      this->NumberOfSkippedRecognitions = 0;
+      this->TotalRecognitionTimeSec = 0.0;
+      this->MaxRecognitionTimeSec = 0.0;
     }
 
   public:
@@ -53,6 +66,16 @@ public:
     std::array<int, 3> Origin;
     /// This is only 3d for simplicity in passing to clipping function, OCR is 2d only
     std::array<int, 3> Size;
+
+    /// Pixels of the screen region at the last text recognition
+    std::vector<unsigned char> PreviousScreenRegion;
+    bool PreviousScreenRegionValid;
+
+    /// Statistics
+    unsigned long NumberOfRecognitions;
+    unsigned long NumberOfSkippedRecognitions;
+    double TotalRecognitionTimeSec;
+    double MaxRecognitionTimeSec;
   };
 
 public:
@@ -87,11 +110,25 @@ public:
   vtkSetStdStringMacro(Language);
   vtkGetStdStringMacro(Language);
 
+  /*!
+    Text recognition of a field is skipped (and the previously recognized value is used) if none of the pixels of the field
+    region changed more than this value since the last recognition. Negative value means that text recognition is performed
+    for each frame. Default: 0 (recognize if any pixel value changed).
+  */
+  vtkSetMacro(PixelChangeThreshold, int);
+  vtkGetMacro(PixelChangeThreshold, int);
+
+  /*! Number of threads used for recognizing text in multiple fields. Each thread uses its own tesseract instance. Default: 1. */
+  vtkSetClampMacro(NumberOfRecognitionThreads, int, 1, VTK_MAX_THREADS);
+  vtkGetMacro(NumberOfRecognitionThreads, int);
+
   vtkSetObjectMacro(OutputChannel, vtkPlusChannel);
   vtkGetObjectMacro(OutputChannel, vtkPlusChannel);
 
 #ifdef PLUS_TEST_TextRecognizer
   ChannelFieldListMap& GetRecognitionFields();
+  /*! Perform one update of the recognized fields from the most recent input frames. Must not be called while the device is acquiring. */
+  PlusStatus RecognizeFieldsOnce();
 #endif
 
 protected:
@@ -100,6 +137,18 @@ protected:
   /// Remove any configuration data
   void ClearConfiguration();
 
+  /// Returns true if the screen region pixels changed since the last recognition (and stores the current pixels)
+  bool IsScreenRegionChanged(TextFieldParameter* parameter);
+
+  /// Recognize text in the specified field, using the specified tesseract instance
+  void RecognizeText(TextFieldParameter* parameter, tesseract::TessBaseAPI* tesseractAPI);
+
+  /// Thread function that recognizes text in a subset of RecognitionRequiredFields
+  static VTK_THREAD_RETURN_TYPE RecognizeTextThread(void* arg);
+
+  /// Log recognition statistics of all fields
+  void LogRecognitionStatistics();
+
   /// Convert a vtkImage data to leptonica pix format
   void vtkImageDataToPix(igsioTrackedFrame& frame, TextFieldParameter* parameter);
 
@@ -110,8 +159,15 @@ protected:
   /// Language used for detection
   std::string                 Language;
 
-  /// Main entry point for the tesseract API
-  tesseract::TessBaseAPI*     TesseractAPI;
+  /// Main entry point for the tesseract API, one instance for each recognition thread
+  std::vector<tesseract::TessBaseAPI*> TesseractAPIs;
+
+  int                         PixelChangeThreshold;
+  int                         NumberOfRecognitionThreads;
+  vtkSmartPointer<vtkMultiThreader> Threader;
+
+  /// Fields that have to be recognized in the current update
+  std::vector<TextFieldParameter*> RecognitionRequiredFields;
 
   vtkIGSIOTrackedFrameList*    TrackedFrames;
 
@@ -5,6 +5,7 @@ See License.txt for details.
 =========================================================Plus=header=end*/
 
 #include "PlusConfigure.h"
+#include "PlusMetricsRegistry.h"
 #include "igsioTrackedFrame.h"
 #include "vtkObjectFactory.h"
 #include "vtkPlusChannel.h"
@@ -14,13 +15,20 @@ See License.txt for details.
 #include "vtkIGSIOTransformRepository.h"
 #include "vtkPlusVirtualVolumeReconstructor.h"
 #include "vtkPlusVolumeReconstructor.h"
+#include "vtkImageData.h"
 #include "vtksys/SystemTools.hxx"
 
+// STL includes
+#include <chrono>
+
 //----------------------------------------------------------------------------
 
 vtkStandardNewMacro(vtkPlusVirtualVolumeReconstructor);
 
 static const int MAX_ALLOWED_RECONSTRUCTION_LAG_SEC = 3.0; // if the reconstruction lags more than this then it'll skip frames to catch up
+static const int DEFAULT_MAX_NUMBER_OF_QUEUED_FRAMES = 500;
+static const double DEFAULT_LIVE_UPDATE_KEYFRAME_PERIOD_SEC = 10.0;
+static const double MAX_LIVE_UPDATE_MODIFIED_VOLUME_FRACTION = 0.5; // if more of the volume is modified then the whole volume is sent
 
 //----------------------------------------------------------------------------
 vtkPlusVirtualVolumeReconstructor::vtkPlusVirtualVolumeReconstructor()
@@ -33,6 +41,15 @@ vtkPlusVirtualVolumeReconstructor::vtkPlusVirtualVolumeReconstructor()
   , m_LastUpdateTime(0.0)
   , TotalFramesRecorded(0)
   , EnableReconstruction(false)
+  , LiveUpdateKeyframePeriodSec(DEFAULT_LIVE_UPDATE_KEYFRAME_PERIOD_SEC)
+  , LastLiveUpdateKeyframeTime(0.0)
+  , LiveUpdateKeyframeRequested(true)
+  , NumberOfQueuedFrames(0)
+  , MaxNumberOfQueuedFrames(DEFAULT_MAX_NUMBER_OF_QUEUED_FRAMES)
+  , ReconstructionThreadActive(false)
+  , ReconstructionThreadId(-1)
+  , SkippedDataSec(0.0)
+  , ResetGeneration(0)
   , VolumeReconstructorAccessMutex(vtkSmartPointer<vtkIGSIORecursiveCriticalSection>::New())
 {
   // The data capture thread will be used to regularly read the frames and write to disk
@@ -40,11 +57,20 @@ vtkPlusVirtualVolumeReconstructor::vtkPlusVirtualVolumeReconstructor()
 
   this->VolumeReconstructor = vtkSmartPointer<vtkPlusVolumeReconstructor>::New();
   this->TransformRepository = vtkSmartPointer<vtkIGSIOTransformRepository>::New();
+
+  for (int i = 0; i < 3; ++i)
+  {
+    this->LiveUpdateVolumeExtent[i * 2] = 0;
+    this->LiveUpdateVolumeExtent[i * 2 + 1] = -1;
+    this->LiveUpdateVolumeOrigin[i] = 0.0;
+    this->LiveUpdateVolumeSpacing[i] = 0.0;
+  }
 }
 
 //----------------------------------------------------------------------------
 vtkPlusVirtualVolumeReconstructor::~vtkPlusVirtualVolumeReconstructor()
 {
+  this->StopReconstructionThread();
 }
 
 //----------------------------------------------------------------------------
@@ -61,9 +87,12 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::ReadConfiguration(vtkXMLDataElemen
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(EnableReconstruction, deviceConfig);
   XML_READ_CSTRING_ATTRIBUTE_OPTIONAL(OutputVolFilename, deviceConfig);
   XML_READ_CSTRING_ATTRIBUTE_OPTIONAL(OutputVolDeviceName, deviceConfig);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(double, LiveUpdateKeyframePeriodSec, deviceConfig);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, MaxNumberOfQueuedFrames, deviceConfig);
 
   igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
   this->VolumeReconstructor->ReadConfiguration(deviceConfig);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, LiveUpdateBrickSize, deviceConfig);
 
   return PLUS_SUCCESS;
 }
@@ -77,9 +106,12 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::WriteConfiguration(vtkXMLDataEleme
 
   deviceElement->SetAttribute("OutputVolFilename", this->OutputVolFilename.c_str());
   deviceElement->SetAttribute("OutputVolDeviceName", this->OutputVolDeviceName.c_str());
+  deviceElement->SetDoubleAttribute("LiveUpdateKeyframePeriodSec", this->LiveUpdateKeyframePeriodSec);
+  deviceElement->SetIntAttribute("MaxNumberOfQueuedFrames", this->MaxNumberOfQueuedFrames);
 
   igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
   this->VolumeReconstructor->WriteConfiguration(deviceElement);
+  deviceElement->SetIntAttribute("LiveUpdateBrickSize", this->VolumeReconstructor->GetModifiedBrickSize());
 
   return PLUS_SUCCESS;
 }
@@ -109,6 +141,8 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::InternalConnect()
 
   m_LastUpdateTime = vtkIGSIOAccurateTimer::GetSystemTime();
 
+  this->StartReconstructionThread();
+
   return PLUS_SUCCESS;
 }
 
@@ -116,9 +150,129 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::InternalConnect()
 PlusStatus vtkPlusVirtualVolumeReconstructor::InternalDisconnect()
 {
   SetEnableReconstruction(false);
+  this->StopReconstructionThread();
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusVirtualVolumeReconstructor::StartReconstructionThread()
+{
+  if (this->ReconstructionThreadId >= 0)
+  {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> queueLock(this->FrameQueueMutex);
+    this->ReconstructionThreadActive = true;
+  }
+  this->ReconstructionThreadId = this->Threader->SpawnThread((vtkThreadFunctionType)&ReconstructionThread, this);
+  if (this->ReconstructionThreadId < 0)
+  {
+    LOG_WARNING("Failed to start volume reconstruction thread. Frames will be pasted into the volume in the data capture thread.");
+    std::lock_guard<std::mutex> queueLock(this->FrameQueueMutex);
+    this->ReconstructionThreadActive = false;
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusVirtualVolumeReconstructor::StopReconstructionThread()
+{
+  if (this->ReconstructionThreadId < 0)
+  {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> queueLock(this->FrameQueueMutex);
+    this->ReconstructionThreadActive = false;
+  }
+  this->FrameQueueCondition.notify_all();
+  this->Threader->TerminateThread(this->ReconstructionThreadId);
+  this->ReconstructionThreadId = -1;
+}
+
+//----------------------------------------------------------------------------
+void* vtkPlusVirtualVolumeReconstructor::ReconstructionThread(vtkMultiThreader::ThreadInfo* data)
+{
+  vtkPlusVirtualVolumeReconstructor* self = (vtkPlusVirtualVolumeReconstructor*)(data->UserData);
+  self->RunReconstructionLoop();
+  return NULL;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusVirtualVolumeReconstructor::RunReconstructionLoop()
+{
+  PlusMetricsRegistry::LabelMap labels;
+  labels["device"] = this->GetDeviceId();
+  PlusMetricsRegistry::Gauge* queuedFramesGauge = PlusMetricsRegistry::GetInstance()->GetGauge("plus_reconstructor_queued_frames", labels, "Number of sampled frames that are not yet pasted into the reconstructed volume");
+
+  while (true)
+  {
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> frames;
+    unsigned int resetGeneration = 0;
+    {
+      std::unique_lock<std::mutex> queueLock(this->FrameQueueMutex);
+      while (this->ReconstructionThreadActive && this->FrameQueue.empty())
+      {
+        this->FrameQueueCondition.wait(queueLock);
+      }
+      if (this->FrameQueue.empty())
+      {
+        // stop requested and all frames are pasted
+        return;
+      }
+      frames = this->FrameQueue.front();
+      this->FrameQueue.pop_front();
+      resetGeneration = this->ResetGeneration;
+    }
+
+    // The volume is only locked while this batch is pasted, so snapshots can be taken between batches
+    int numberOfFrames = frames->GetNumberOfTrackedFrames();
+    {
+      igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
+      if (resetGeneration != this->ResetGeneration)
+      {
+        // The volume has been reset since the batch was taken from the queue, the frames belong to the cleared volume
+        LOG_DEBUG(this->GetDeviceId() << ": " << numberOfFrames << " frames are not pasted, the volume has been reset");
+        frames->Clear();
+      }
+      else if (this->AddFrames(frames) != PLUS_SUCCESS)
+      {
+        LOG_ERROR(this->GetDeviceId() << ": Unable to add " << numberOfFrames << " frames for volume reconstruction");
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> queueLock(this->FrameQueueMutex);
+      this->NumberOfQueuedFrames -= numberOfFrames;
+      if (queuedFramesGauge != NULL)
+      {
+        queuedFramesGauge->SetValue(this->NumberOfQueuedFrames);
+      }
+    }
+    // Wake up the threads that wait for the queued frames
+    this->FrameQueueCondition.notify_all();
+  }
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusVirtualVolumeReconstructor::WaitForQueuedFrames(double timeoutSec)
+{
+  std::unique_lock<std::mutex> queueLock(this->FrameQueueMutex);
+  if (!this->FrameQueueCondition.wait_for(queueLock, std::chrono::duration<double>(timeoutSec), [this] { return this->NumberOfQueuedFrames <= 0; }))
+  {
+    LOG_ERROR(this->GetDeviceId() << ": " << this->NumberOfQueuedFrames << " frames are still not pasted into the volume after " << timeoutSec << " sec");
+    return PLUS_FAIL;
+  }
   return PLUS_SUCCESS;
 }
 
+//----------------------------------------------------------------------------
+int vtkPlusVirtualVolumeReconstructor::GetNumberOfQueuedFrames()
+{
+  std::lock_guard<std::mutex> queueLock(this->FrameQueueMutex);
+  return this->NumberOfQueuedFrames;
+}
+
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusVirtualVolumeReconstructor::InternalUpdate()
 {
@@ -165,7 +319,7 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::InternalUpdate()
     LOG_WARNING("RequestedFrameRate is invalid, use default: " << 1 / requestedFramePeriodSec);
   }
 
-  igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
+  std::lock_guard<std::mutex> samplingLock(this->SamplingMutex);
   if (!this->EnableReconstruction)
   {
     // While this thread was waiting for the unlock, capturing was disabled, so cancel the update now
@@ -179,26 +333,45 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::InternalUpdate()
   }
   vtkPlusChannel* outputChannel = this->OutputChannels[0];
 
-  vtkSmartPointer<vtkIGSIOTrackedFrameList> recordedFrames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
-  if (outputChannel->GetTrackedFrameListSampled(m_LastAlreadyRecordedFrameTimestamp, m_NextFrameToBeRecordedTimestamp, recordedFrames, requestedFramePeriodSec, maxProcessingTimeSec) != PLUS_SUCCESS)
+  PlusMetricsRegistry* metrics = PlusMetricsRegistry::GetInstance();
+  PlusMetricsRegistry::LabelMap labels;
+  labels["device"] = this->GetDeviceId();
+
+  bool queueFull = false;
   {
-    LOG_ERROR("Error while getting tracked frame list from data collector during volume reconstruction. Last recorded timestamp: " << std::fixed << m_NextFrameToBeRecordedTimestamp);
+    std::lock_guard<std::mutex> queueLock(this->FrameQueueMutex);
+    queueFull = (this->NumberOfQueuedFrames >= this->MaxNumberOfQueuedFrames);
   }
-  int nbFramesRecorded = recordedFrames->GetNumberOfTrackedFrames();
 
-  if (this->AddFrames(recordedFrames) != PLUS_SUCCESS)
+  int nbFramesRecorded = 0;
+  if (queueFull)
   {
-    LOG_ERROR(this->GetDeviceId() << ": Unable to add " << nbFramesRecorded << " frames for volume reconstruction");
-    return PLUS_FAIL;
+    // The frames remain in the input buffers, they are sampled when the reconstruction thread has caught up
+    LOG_DEBUG(this->GetDeviceId() << ": volume reconstruction queue is full, sampling is postponed");
   }
+  else
+  {
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> recordedFrames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+    if (outputChannel->GetTrackedFrameListSampled(m_LastAlreadyRecordedFrameTimestamp, m_NextFrameToBeRecordedTimestamp, recordedFrames, requestedFramePeriodSec, maxProcessingTimeSec) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Error while getting tracked frame list from data collector during volume reconstruction. Last recorded timestamp: " << std::fixed << m_NextFrameToBeRecordedTimestamp);
+    }
+    nbFramesRecorded = recordedFrames->GetNumberOfTrackedFrames();
 
-  this->TotalFramesRecorded += nbFramesRecorded;
+    if (nbFramesRecorded > 0 && this->QueueFrames(recordedFrames) != PLUS_SUCCESS)
+    {
+      LOG_ERROR(this->GetDeviceId() << ": Unable to add " << nbFramesRecorded << " frames for volume reconstruction");
+      return PLUS_FAIL;
+    }
+
+    this->TotalFramesRecorded += nbFramesRecorded;
+  }
 
-  // Check whether the reconstruction needed more time than the sampling interval
+  // Check whether the sampling needed more time than the sampling interval
   double recordingTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
   if (recordingTimeSec > GetSamplingPeriodSec())
   {
-    LOG_WARNING("Volume reconstruction of the acquired " << nbFramesRecorded << " frames takes too long time (" << recordingTimeSec << "sec instead of the allocated " << GetSamplingPeriodSec() << "sec). This can cause slow-down of the application and non-uniform sampling. Reduce the image acquisition rate, output size, or image clip rectangle size to resolve the problem.");
+    LOG_WARNING("Sampling of the acquired " << nbFramesRecorded << " frames for volume reconstruction takes too long time (" << recordingTimeSec << "sec instead of the allocated " << GetSamplingPeriodSec() << "sec). This can cause slow-down of the application and non-uniform sampling. Reduce the image acquisition rate, output size, or image clip rectangle size to resolve the problem.");
   }
   double recordingLagSec = vtkIGSIOAccurateTimer::GetSystemTime() - m_NextFrameToBeRecordedTimestamp;
 
@@ -206,6 +379,12 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::InternalUpdate()
   {
     LOG_ERROR("Volume reconstruction cannot keep up with the acquisition. Skip " << recordingLagSec << " seconds of the data stream to catch up.");
     m_NextFrameToBeRecordedTimestamp = vtkIGSIOAccurateTimer::GetSystemTime();
+    this->SkippedDataSec = this->SkippedDataSec + recordingLagSec;
+    PlusMetricsRegistry::Gauge* skippedDataGauge = metrics->GetGauge("plus_reconstructor_skipped_data_seconds", labels, "Duration of the input data that was not reconstructed because the reconstruction could not keep up with the acquisition");
+    if (skippedDataGauge != NULL)
+    {
+      skippedDataGauge->Add(recordingLagSec);
+    }
   }
 
   m_LastUpdateTime = vtkIGSIOAccurateTimer::GetSystemTime();
@@ -247,6 +426,7 @@ void vtkPlusVirtualVolumeReconstructor::SetEnableReconstruction(bool aValue)
     return;
   }
 
+  std::lock_guard<std::mutex> samplingLock(this->SamplingMutex);
   if (aValue)
   {
     // starting/resuming...
@@ -260,6 +440,7 @@ void vtkPlusVirtualVolumeReconstructor::SetEnableReconstruction(bool aValue)
   else
   {
     // stopping/suspending...
+    // The frames that have been sampled before stopping are still part of the recording, the reconstruction thread pastes them
     this->EnableReconstruction = aValue;
   }
 }
@@ -267,8 +448,24 @@ void vtkPlusVirtualVolumeReconstructor::SetEnableReconstruction(bool aValue)
 //-----------------------------------------------------------------------------
 PlusStatus vtkPlusVirtualVolumeReconstructor::Reset()
 {
+  {
+    // Frames that have been sampled but not yet pasted belong to the cleared volume
+    std::lock_guard<std::mutex> queueLock(this->FrameQueueMutex);
+    for (std::deque< vtkSmartPointer<vtkIGSIOTrackedFrameList> >::const_iterator it = this->FrameQueue.begin(); it != this->FrameQueue.end(); ++it)
+    {
+      this->NumberOfQueuedFrames -= (*it)->GetNumberOfTrackedFrames();
+    }
+    this->FrameQueue.clear();
+    // A batch that the reconstruction thread has already taken from the queue is not pasted either
+    ++this->ResetGeneration;
+  }
+  this->FrameQueueCondition.notify_all();
+  this->SkippedDataSec = 0.0;
+
   igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
   this->VolumeReconstructor->Reset();
+  this->VolumeReconstructor->ClearModifiedRegions();
+  this->LiveUpdateKeyframeRequested = true;
   return PLUS_SUCCESS;
 }
 
@@ -368,11 +565,148 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::GetReconstructedVolume(vtkImageDat
   return PLUS_SUCCESS;
 }
 
+//-----------------------------------------------------------------------------
+PlusStatus vtkPlusVirtualVolumeReconstructor::GetReconstructedVolumeUpdate(std::vector< vtkSmartPointer<vtkImageData> >& volumeBricks, int volumeExtent[6], bool& isKeyframe, std::string& outErrorMessage, bool applyHoleFilling/*=true*/)
+{
+  volumeBricks.clear();
+  isKeyframe = false;
+
+  PlusMetricsRegistry* metrics = PlusMetricsRegistry::GetInstance();
+  PlusMetricsRegistry::LabelMap labels;
+  labels["device"] = this->GetDeviceId();
+  PlusMetricsRegistry::ScopedTimer updateTimer(metrics->GetHistogram("plus_reconstructor_live_update_seconds", labels, "Time needed to prepare a live update of the reconstructed volume"));
+
+  vtkSmartPointer<vtkImageData> volume = vtkSmartPointer<vtkImageData>::New();
+  std::vector< std::array<int, 6> > modifiedBrickExtents;
+  double oldestModificationTimestamp = UNDEFINED_TIMESTAMP;
+  {
+    igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
+    if (this->GetReconstructedVolume(volume, outErrorMessage, applyHoleFilling) != PLUS_SUCCESS)
+    {
+      return PLUS_FAIL;
+    }
+    isKeyframe = !this->VolumeReconstructor->GetModifiedBrickExtents(volume, modifiedBrickExtents, oldestModificationTimestamp);
+
+    volume->GetExtent(volumeExtent);
+    double* origin = volume->GetOrigin();
+    double* spacing = volume->GetSpacing();
+    for (int i = 0; i < 3; ++i)
+    {
+      if (volumeExtent[i * 2] != this->LiveUpdateVolumeExtent[i * 2] || volumeExtent[i * 2 + 1] != this->LiveUpdateVolumeExtent[i * 2 + 1]
+          || origin[i] != this->LiveUpdateVolumeOrigin[i] || spacing[i] != this->LiveUpdateVolumeSpacing[i])
+      {
+        isKeyframe = true;
+      }
+      this->LiveUpdateVolumeExtent[i * 2] = volumeExtent[i * 2];
+      this->LiveUpdateVolumeExtent[i * 2 + 1] = volumeExtent[i * 2 + 1];
+      this->LiveUpdateVolumeOrigin[i] = origin[i];
+      this->LiveUpdateVolumeSpacing[i] = spacing[i];
+    }
+
+    double now = vtkIGSIOAccurateTimer::GetSystemTime();
+    if (this->LiveUpdateKeyframeRequested || now - this->LastLiveUpdateKeyframeTime >= this->LiveUpdateKeyframePeriodSec)
+    {
+      isKeyframe = true;
+    }
+    if (isKeyframe)
+    {
+      this->LiveUpdateKeyframeRequested = false;
+      this->LastLiveUpdateKeyframeTime = now;
+    }
+  }
+
+  if (!isKeyframe)
+  {
+    long long numberOfModifiedVoxels = 0;
+    for (std::vector< std::array<int, 6> >::const_iterator brickIt = modifiedBrickExtents.begin(); brickIt != modifiedBrickExtents.end(); ++brickIt)
+    {
+      numberOfModifiedVoxels += static_cast<long long>((*brickIt)[1] - (*brickIt)[0] + 1) * ((*brickIt)[3] - (*brickIt)[2] + 1) * ((*brickIt)[5] - (*brickIt)[4] + 1);
+    }
+    int* dimensions = volume->GetDimensions();
+    long long numberOfVoxels = static_cast<long long>(dimensions[0]) * dimensions[1] * dimensions[2];
+    if (numberOfModifiedVoxels > MAX_LIVE_UPDATE_MODIFIED_VOLUME_FRACTION * numberOfVoxels)
+    {
+      // Sending the whole volume is simpler for the client and not much larger
+      isKeyframe = true;
+    }
+  }
+
+  if (isKeyframe)
+  {
+    volumeBricks.push_back(volume);
+  }
+  else
+  {
+    for (std::vector< std::array<int, 6> >::const_iterator brickIt = modifiedBrickExtents.begin(); brickIt != modifiedBrickExtents.end(); ++brickIt)
+    {
+      vtkSmartPointer<vtkImageData> brick = vtkSmartPointer<vtkImageData>::New();
+      if (vtkPlusVolumeReconstructor::ExtractBrick(volume, brickIt->data(), brick) != PLUS_SUCCESS)
+      {
+        outErrorMessage = "Extracting modified part of the volume failed";
+        LOG_ERROR(outErrorMessage);
+        volumeBricks.clear();
+        return PLUS_FAIL;
+      }
+      volumeBricks.push_back(brick);
+    }
+  }
+  unsigned long long numberOfBytes = 0;
+  for (std::vector< vtkSmartPointer<vtkImageData> >::const_iterator brickIt = volumeBricks.begin(); brickIt != volumeBricks.end(); ++brickIt)
+  {
+    numberOfBytes += static_cast<unsigned long long>((*brickIt)->GetNumberOfPoints()) * (*brickIt)->GetScalarSize() * (*brickIt)->GetNumberOfScalarComponents();
+  }
+
+  PlusMetricsRegistry::Counter* bytesCounter = metrics->GetCounter("plus_reconstructor_live_update_bytes_total", labels, "Number of voxel data bytes in live updates of the reconstructed volume");
+  if (bytesCounter != NULL)
+  {
+    bytesCounter->Increment(numberOfBytes);
+  }
+  PlusMetricsRegistry::Counter* bricksCounter = metrics->GetCounter("plus_reconstructor_live_update_bricks_total", labels, "Number of modified bricks in live updates of the reconstructed volume");
+  if (bricksCounter != NULL)
+  {
+    bricksCounter->Increment(isKeyframe ? 0 : volumeBricks.size());
+  }
+  PlusMetricsRegistry::Counter* keyframesCounter = metrics->GetCounter("plus_reconstructor_live_update_keyframes_total", labels, "Number of live updates that contained the whole reconstructed volume");
+  if (isKeyframe && keyframesCounter != NULL)
+  {
+    keyframesCounter->Increment();
+  }
+  PlusLatencyHistogram* latencyHistogram = metrics->GetHistogram("plus_reconstructor_live_update_latency_seconds", labels, "Time from the acquisition of the oldest frame in a live update until the update is ready to be sent");
+  if (oldestModificationTimestamp != UNDEFINED_TIMESTAMP && latencyHistogram != NULL)
+  {
+    latencyHistogram->RecordValue(vtkIGSIOAccurateTimer::GetSystemTime() - oldestModificationTimestamp);
+  }
+  LOG_DEBUG("Live update of the reconstructed volume: " << (isKeyframe ? "keyframe" : "modified bricks") << ", " << volumeBricks.size() << " image(s), " << numberOfBytes << " bytes");
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusVirtualVolumeReconstructor::SetLiveUpdateBrickSize(int brickSize)
+{
+  igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
+  this->VolumeReconstructor->SetModifiedBrickSize(brickSize);
+}
+
+//----------------------------------------------------------------------------
+int vtkPlusVirtualVolumeReconstructor::GetLiveUpdateBrickSize()
+{
+  igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
+  return this->VolumeReconstructor->GetModifiedBrickSize();
+}
+
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusVirtualVolumeReconstructor::AddFrames(vtkIGSIOTrackedFrameList* trackedFrameList)
 {
   igsioLockGuard<vtkIGSIORecursiveCriticalSection> writerLock(this->VolumeReconstructorAccessMutex);
 
+  // Metric lookup takes a lock, therefore it is done once per batch, not per frame
+  PlusMetricsRegistry* metrics = PlusMetricsRegistry::GetInstance();
+  PlusMetricsRegistry::LabelMap labels;
+  labels["device"] = this->GetDeviceId();
+  PlusLatencyHistogram* frameInsertionHistogram = metrics->GetHistogram("plus_reconstructor_frame_insertion_seconds", labels, "Time needed to paste a frame into the reconstructed volume");
+  PlusMetricsRegistry::Counter* framesAddedCounter = metrics->GetCounter("plus_reconstructor_frames_added_total", labels, "Number of frames pasted into the reconstructed volume");
+
   PlusStatus status = PLUS_SUCCESS;
   const int numberOfFrames = trackedFrameList->GetNumberOfTrackedFrames();
   int numberOfFramesAddedToVolume = 0;
@@ -388,7 +722,12 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::AddFrames(vtkIGSIOTrackedFrameList
     }
     // Insert slice for reconstruction
     bool insertedIntoVolume = false;
-    if (this->VolumeReconstructor->AddTrackedFrame(frame, this->TransformRepository, &insertedIntoVolume) != PLUS_SUCCESS)
+    PlusStatus addStatus = PLUS_FAIL;
+    {
+      PlusMetricsRegistry::ScopedTimer insertionTimer(frameInsertionHistogram);
+      addStatus = this->VolumeReconstructor->AddTrackedFrame(frame, this->TransformRepository, &insertedIntoVolume);
+    }
+    if (addStatus != PLUS_SUCCESS)
     {
       LOG_ERROR("Failed to add tracked frame to volume with frame #" << frameIndex);
       status = PLUS_FAIL;
@@ -397,15 +736,56 @@ PlusStatus vtkPlusVirtualVolumeReconstructor::AddFrames(vtkIGSIOTrackedFrameList
     if (insertedIntoVolume)
     {
       numberOfFramesAddedToVolume++;
+      // Errors are logged, the next live update will be incomplete but the periodic keyframe fixes it
+      this->VolumeReconstructor->AddModifiedRegion(frame, this->TransformRepository);
     }
   }
   trackedFrameList->Clear();
 
+  if (framesAddedCounter != NULL)
+  {
+    framesAddedCounter->Increment(numberOfFramesAddedToVolume);
+  }
   LOG_DEBUG("Number of frames added to the volume: " << numberOfFramesAddedToVolume << " out of " << numberOfFrames);
 
   return status;
 }
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusVirtualVolumeReconstructor::QueueFrames(vtkIGSIOTrackedFrameList* trackedFrameList)
+{
+  if (trackedFrameList == NULL)
+  {
+    LOG_ERROR(this->GetDeviceId() << ": Unable to queue frames for volume reconstruction, frame list is invalid");
+    return PLUS_FAIL;
+  }
+
+  PlusMetricsRegistry::LabelMap labels;
+  labels["device"] = this->GetDeviceId();
+  PlusMetricsRegistry::Gauge* queuedFramesGauge = PlusMetricsRegistry::GetInstance()->GetGauge("plus_reconstructor_queued_frames", labels, "Number of sampled frames that are not yet pasted into the reconstructed volume");
+
+  bool reconstructionThreadRunning = false;
+  {
+    std::lock_guard<std::mutex> queueLock(this->FrameQueueMutex);
+    reconstructionThreadRunning = this->ReconstructionThreadActive;
+    if (reconstructionThreadRunning)
+    {
+      this->FrameQueue.push_back(trackedFrameList);
+      this->NumberOfQueuedFrames += trackedFrameList->GetNumberOfTrackedFrames();
+      if (queuedFramesGauge != NULL)
+      {
+        queuedFramesGauge->SetValue(this->NumberOfQueuedFrames);
+      }
+    }
+  }
+  if (!reconstructionThreadRunning)
+  {
+    return this->AddFrames(trackedFrameList);
+  }
+  this->FrameQueueCondition.notify_all();
+  return PLUS_SUCCESS;
+}
+
 //-----------------------------------------------------------------------------
 double vtkPlusVirtualVolumeReconstructor::GetSamplingPeriodSec()
 {
@@ -10,7 +10,14 @@ See License.txt for details.
 #include "vtkPlusDataCollectionExport.h"
 
 #include "vtkPlusDevice.h"
+
+// STL includes
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <vector>
 
 class vtkPlusVolumeReconstructor;
 
@@ -18,6 +25,25 @@ class vtkPlusVolumeReconstructor;
 \class vtkPlusVirtualVolumeReconstructor
 \brief
 
+Frames are sampled from the input channel by the data capture thread and queued for a separate
+reconstruction thread that pastes them into the volume. Sampling therefore does not wait for pasting
+or for volume snapshots (GetReconstructedVolume). Snapshots wait for the batch of frames that is being pasted,
+and pasting of the next batch waits for the snapshot, as the gray levels (and hole filling) are computed from
+the volume itself, not from a copy. Frames that are sampled meanwhile stay in the queue.
+If the queue is full then sampling is postponed and the frames remain in the input buffers. Data is skipped
+only if the sampling lags behind the acquisition by more than a few seconds (see GetSkippedDataSec).
+Frames that are queued (or being pasted) when the volume is reset are not pasted into the cleared volume.
+
+Clients of a live reconstruction can retrieve only the parts of the volume that have changed since
+their previous request (see GetReconstructedVolumeUpdate). The changed parts are returned as bricks
+of the volume, with a complete volume (keyframe) sent periodically.
+
+Attributes:
+\li LiveUpdateBrickSize: size of the bricks (in voxels along each axis) that are sent in live updates (default: 32)
+\li LiveUpdateKeyframePeriodSec: the whole volume is sent in a live update if the previous keyframe was sent
+  earlier than this (default: 10). If 0 then all live updates are keyframes.
+\li MaxNumberOfQueuedFrames: maximum number of sampled frames that wait for being pasted into the volume (default: 500)
+
 \ingroup PlusLibDataCollection
 */
 class vtkPlusDataCollectionExport vtkPlusVirtualVolumeReconstructor : public vtkPlusDevice
@@ -34,10 +60,34 @@ public:
 
   /*!
     This method is safe to be called from any thread.
+    The volume is locked while the snapshot is computed (including hole filling), pasting of queued frames waits until it is done.
     \param applyHoleFilling If true (default) then hole filling will be applied (if enabled and fully specified), otherwise hole filling will be skipped
   */
   PlusStatus GetReconstructedVolume(vtkImageData* reconstructedVolume, std::string& outErrorMessage, bool applyHoleFilling = true);
 
+  /*!
+    Get the parts of the reconstructed volume that have been modified since the previous live update.
+    The whole volume (keyframe) is returned in the first update after the volume is reset, if the volume geometry
+    has changed, if the previous keyframe is older than LiveUpdateKeyframePeriodSec, or if the modified parts
+    cannot be tracked or cover most of the volume.
+    This method is safe to be called from any thread.
+    \param volumeBricks Modified parts of the volume. Each brick has the origin and spacing of the volume and an extent inside the volume extent.
+    \param volumeExtent Extent of the reconstructed volume
+    \param isKeyframe True if the whole volume is returned (as a single brick)
+    \param applyHoleFilling If true (default) then hole filling will be applied (if enabled and fully specified), otherwise hole filling will be skipped
+  */
+  PlusStatus GetReconstructedVolumeUpdate(std::vector< vtkSmartPointer<vtkImageData> >& volumeBricks, int volumeExtent[6], bool& isKeyframe, std::string& outErrorMessage, bool applyHoleFilling = true);
+
+  /*! Size of the bricks (in voxels along each axis) that are sent in live updates */
+  void SetLiveUpdateBrickSize(int brickSize);
+  /*! Size of the bricks (in voxels along each axis) that are sent in live updates */
+  int GetLiveUpdateBrickSize();
+
+  /*! The whole volume is sent in a live update if the previous keyframe was sent earlier than this */
+  vtkSetMacro(LiveUpdateKeyframePeriodSec, double);
+  /*! The whole volume is sent in a live update if the previous keyframe was sent earlier than this */
+  vtkGetMacro(LiveUpdateKeyframePeriodSec, double);
+
   /*!
     Updated the transform repository contents within the volume reconstructor.
     It is advisable to call this before each volume reconstruction starting.
@@ -52,10 +102,29 @@ public:
   vtkGetMacro(EnableReconstruction, bool);
   /*!
     Enables adding frames to the volume. It can be used for pausing the recording.
+    Disabling does not wait for the frames that are already sampled, they are pasted into the volume in the background.
     This method is safe to be called from any thread.
   */
   void SetEnableReconstruction(bool aValue);
 
+  /*!
+    Wait until all the sampled frames are pasted into the volume.
+    Call it after disabling the reconstruction if the volume has to contain all the recorded frames.
+    This method is safe to be called from any thread.
+  */
+  PlusStatus WaitForQueuedFrames(double timeoutSec);
+
+  /*! Number of sampled frames that are not yet pasted into the volume */
+  int GetNumberOfQueuedFrames();
+
+  /*! Maximum number of sampled frames that wait for being pasted into the volume */
+  vtkSetMacro(MaxNumberOfQueuedFrames, int);
+  /*! Maximum number of sampled frames that wait for being pasted into the volume */
+  vtkGetMacro(MaxNumberOfQueuedFrames, int);
+
+  /*! Total duration of the input data that was skipped (not reconstructed) because the reconstruction could not keep up with the acquisition */
+  double GetSkippedDataSec() const { return this->SkippedDataSec; }
+
   /*!
     Clear the volume.
     This method is safe to be called from any thread.
@@ -115,6 +184,20 @@ protected:
 
   PlusStatus AddFrames(vtkIGSIOTrackedFrameList* trackedFrameList);
 
+  /*!
+    Queue frames for the reconstruction thread, or paste them immediately if the thread is not running.
+    The queue keeps a reference to the frame list until it is pasted, the caller must not modify it afterwards.
+  */
+  PlusStatus QueueFrames(vtkIGSIOTrackedFrameList* trackedFrameList);
+
+  /*! Start the thread that pastes the queued frames into the volume */
+  void StartReconstructionThread();
+  /*! Stop the reconstruction thread after all the queued frames are pasted */
+  void StopReconstructionThread();
+  /*! Take the next batch of frames from the queue and paste it into the volume, until StopReconstructionThread is called and the queue is empty */
+  static void* ReconstructionThread(vtkMultiThreader::ThreadInfo* data);
+  void RunReconstructionLoop();
+
   /*! Get the sampling period length (in seconds). Frames are copied from the devices to the data collection buffer once in every sampling period. */
   double GetSamplingPeriodSec();
 
@@ -152,6 +235,42 @@ protected:
   std::string OutputVolFilename;
   std::string OutputVolDeviceName;
 
+  /*! Maximum time between live updates that contain the whole volume */
+  double LiveUpdateKeyframePeriodSec;
+
+  /*! Time when the last live update that contained the whole volume was prepared */
+  double LastLiveUpdateKeyframeTime;
+
+  /*! The next live update has to contain the whole volume (e.g., because the volume has been reset) */
+  bool LiveUpdateKeyframeRequested;
+
+  /*! Geometry of the volume in the last live update, if it changes then the whole volume has to be sent */
+  int LiveUpdateVolumeExtent[6];
+  double LiveUpdateVolumeOrigin[3];
+  double LiveUpdateVolumeSpacing[3];
+
+  /*! Sampled frames that wait for being pasted into the volume, oldest first. Protected by FrameQueueMutex. */
+  std::deque< vtkSmartPointer<vtkIGSIOTrackedFrameList> > FrameQueue;
+  /*! Number of frames in the queue and in the batch that is being pasted. Protected by FrameQueueMutex. */
+  int NumberOfQueuedFrames;
+  int MaxNumberOfQueuedFrames;
+  /*! Set to false to request the reconstruction thread to stop. Protected by FrameQueueMutex. */
+  bool ReconstructionThreadActive;
+  int ReconstructionThreadId;
+  std::mutex FrameQueueMutex;
+  std::condition_variable FrameQueueCondition;
+
+  /*! Sampling and enabling/disabling the reconstruction are mutually exclusive, so no frames are queued after the reconstruction is disabled */
+  std::mutex SamplingMutex;
+
+  std::atomic<double> SkippedDataSec;
+
+  /*!
+    Incremented by Reset while FrameQueueMutex is locked. The reconstruction thread only pastes a batch
+    if no reset happened since the batch was taken from the queue (checked while the volume is locked).
+  */
+  std::atomic<unsigned int> ResetGeneration;
+
   /*! Mutex instance simultaneous access of writer (writer may be accessed from command processing thread and also the internal update thread) */
   vtkSmartPointer<vtkIGSIORecursiveCriticalSection> VolumeReconstructorAccessMutex;
 
@@ -10,7 +10,7 @@ See License.txt for details.
 #include "igsioTrackedFrame.h"
 #include "vtkPlusBuffer.h"
 #include "vtkPlusDevice.h"
-#include "vtkPlusSequenceIO.h"
+#include "vtkPlusSequenceStreamWriter.h"
 #include "vtkIGSIOTrackedFrameList.h"
 
 // VTK includes
@@ -83,7 +83,16 @@ vtkPlusBuffer::vtkPlusBuffer()
   , ImageOrientation(US_IMG_ORIENT_MF)
   , StreamBuffer(vtkPlusTimestampedCircularBuffer::New())
   , MaxAllowedTimeDifference(0.5)
+  , ReservedBufferIndex(-1)
+  , ReservedImageType(US_IMG_BRIGHTNESS)
   , DescriptiveName(NULL)
+  , ItemsAddedCounter(NULL)
+  , ItemsDroppedCounter(NULL)
+  , OccupancyGauge(NULL)
+  , LookupOkCounter(NULL)
+  , LookupNotAvailableYetCounter(NULL)
+  , LookupNotAvailableAnymoreCounter(NULL)
+  , LookupFailedCounter(NULL)
 {
   this->FrameSize[0] = 0;
   this->FrameSize[1] = 0;
@@ -103,6 +112,81 @@ vtkPlusBuffer::~vtkPlusBuffer()
     this->StreamBuffer->Delete();
     this->StreamBuffer = NULL;
   }
+  this->SetDescriptiveName(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusBuffer::SetDescriptiveName(const char* descriptiveName)
+{
+  if (this->DescriptiveName != NULL && descriptiveName != NULL && strcmp(this->DescriptiveName, descriptiveName) == 0)
+  {
+    return;
+  }
+  if (this->DescriptiveName != NULL)
+  {
+    // Metrics are published under the descriptive name, remove the series of the old name (also called from the destructor)
+    PlusMetricsRegistry::GetInstance()->RemoveMetrics("buffer", this->DescriptiveName);
+  }
+  delete[] this->DescriptiveName;
+  this->DescriptiveName = NULL;
+  if (descriptiveName != NULL)
+  {
+    this->DescriptiveName = new char[strlen(descriptiveName) + 1];
+    strcpy(this->DescriptiveName, descriptiveName);
+  }
+  this->Modified();
+
+  if (this->DescriptiveName == NULL)
+  {
+    this->ItemsAddedCounter = NULL;
+    this->ItemsDroppedCounter = NULL;
+    this->OccupancyGauge = NULL;
+    this->LookupOkCounter = NULL;
+    this->LookupNotAvailableYetCounter = NULL;
+    this->LookupNotAvailableAnymoreCounter = NULL;
+    this->LookupFailedCounter = NULL;
+    return;
+  }
+
+  PlusMetricsRegistry* metrics = PlusMetricsRegistry::GetInstance();
+  PlusMetricsRegistry::LabelMap labels;
+  labels["buffer"] = this->DescriptiveName;
+  this->ItemsAddedCounter = metrics->GetCounter("plus_buffer_items_added_total", labels, "Number of items added to the buffer");
+  this->ItemsDroppedCounter = metrics->GetCounter("plus_buffer_items_dropped_total", labels, "Number of items that could not be added to the buffer");
+  this->OccupancyGauge = metrics->GetGauge("plus_buffer_occupancy_ratio", labels, "Number of items in the buffer divided by the buffer size");
+  labels["result"] = "ok";
+  this->LookupOkCounter = metrics->GetCounter("plus_buffer_lookups_total", labels, "Number of buffer item lookups by time");
+  labels["result"] = "not_available_yet";
+  this->LookupNotAvailableYetCounter = metrics->GetCounter("plus_buffer_lookups_total", labels);
+  labels["result"] = "not_available_anymore";
+  this->LookupNotAvailableAnymoreCounter = metrics->GetCounter("plus_buffer_lookups_total", labels);
+  labels["result"] = "error";
+  this->LookupFailedCounter = metrics->GetCounter("plus_buffer_lookups_total", labels);
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusBuffer::PrepareForNewItem(double filteredTimestamp, BufferItemUidType& itemUid, int& bufferIndex)
+{
+  if (this->StreamBuffer->PrepareForNewItem(filteredTimestamp, itemUid, bufferIndex) != PLUS_SUCCESS)
+  {
+    this->RecordDroppedItem();
+    return PLUS_FAIL;
+  }
+  if (this->ItemsAddedCounter != NULL)
+  {
+    this->ItemsAddedCounter->Increment();
+    this->OccupancyGauge->SetValue(static_cast<double>(this->StreamBuffer->GetNumberOfItems()) / std::max(this->StreamBuffer->GetBufferSize(), 1));
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusBuffer::RecordDroppedItem()
+{
+  if (this->ItemsDroppedCounter != NULL)
+  {
+    this->ItemsDroppedCounter->Increment();
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -315,6 +399,156 @@ PlusStatus vtkPlusBuffer::AddItem(const igsioVideoFrame* frame,
   }
 }
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusBuffer::ReserveItem(US_IMAGE_ORIENTATION usImageOrientation,
+                                      const FrameSizeType& inputFrameSizeInPx,
+                                      igsioCommon::VTKScalarPixelType pixelType,
+                                      unsigned int numberOfScalarComponents,
+                                      US_IMAGE_TYPE imageType,
+                                      const std::array<int, 3>& clipRectangleOrigin,
+                                      const std::array<int, 3>& clipRectangleSize,
+                                      void*& frameDataPtr)
+{
+  frameDataPtr = NULL;
+  if (this->ReservedBufferIndex >= 0)
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Unable to reserve item - an item is already reserved!");
+    return PLUS_FAIL;
+  }
+
+  // Only frames that are stored without any modification can be written into the buffer directly
+  if (igsioCommon::IsClippingRequested(clipRectangleOrigin, clipRectangleSize))
+  {
+    return PLUS_FAIL;
+  }
+  igsioVideoFrame::FlipInfoType flipInfo;
+  if (igsioVideoFrame::GetFlipAxes(usImageOrientation, imageType, this->ImageOrientation, flipInfo) != PLUS_SUCCESS
+      || flipInfo.hFlip || flipInfo.vFlip || flipInfo.eFlip || flipInfo.tranpose != igsioVideoFrame::TRANSPOSE_NONE)
+  {
+    return PLUS_FAIL;
+  }
+  if (!this->CheckFrameFormat(inputFrameSizeInPx, pixelType, imageType, numberOfScalarComponents))
+  {
+    return PLUS_FAIL;
+  }
+
+  igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
+  int bufferIndex(0);
+  if (this->StreamBuffer->ReserveNextItem(bufferIndex) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+  StreamBufferItem* reservedObjectInBuffer = this->StreamBuffer->GetBufferItemPointerFromBufferIndex(bufferIndex);
+  if (reservedObjectInBuffer == NULL || !reservedObjectInBuffer->GetFrame().IsImageValid())
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to get pointer to video buffer object from the video buffer for the reserved frame!");
+    return PLUS_FAIL;
+  }
+  FrameSizeType bufferFrameSize = { 0, 0, 0 };
+  reservedObjectInBuffer->GetFrame().GetFrameSize(bufferFrameSize);
+  if (inputFrameSizeInPx[0] != bufferFrameSize[0] || inputFrameSizeInPx[1] != bufferFrameSize[1] || inputFrameSizeInPx[2] != bufferFrameSize[2])
+  {
+    return PLUS_FAIL;
+  }
+
+  this->ReservedBufferIndex = bufferIndex;
+  this->ReservedImageType = imageType;
+  frameDataPtr = reservedObjectInBuffer->GetFrame().GetScalarPointer();
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusBuffer::CommitReservedItem(long frameNumber,
+    double unfilteredTimestamp /*= UNDEFINED_TIMESTAMP*/,
+    double filteredTimestamp /*= UNDEFINED_TIMESTAMP*/,
+    const igsioFieldMapType* customFields /*= NULL*/)
+{
+  if (this->ReservedBufferIndex < 0)
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Unable to commit item - no item is reserved!");
+    return PLUS_FAIL;
+  }
+  int reservedBufferIndex = this->ReservedBufferIndex;
+  this->ReservedBufferIndex = -1;
+
+  if (unfilteredTimestamp == UNDEFINED_TIMESTAMP)
+  {
+    unfilteredTimestamp = vtkIGSIOAccurateTimer::GetSystemTime();
+  }
+
+  if (filteredTimestamp == UNDEFINED_TIMESTAMP)
+  {
+    bool filteredTimestampProbablyValid = true;
+    if (this->StreamBuffer->CreateFilteredTimeStampForItem(frameNumber, unfilteredTimestamp, filteredTimestamp, filteredTimestampProbablyValid) != PLUS_SUCCESS)
+    {
+      LOCAL_LOG_WARNING("Failed to create filtered timestamp for video buffer item with item index: " << frameNumber);
+      return PLUS_FAIL;
+    }
+    if (!filteredTimestampProbablyValid)
+    {
+      LOG_INFO("Filtered timestamp is probably invalid for video buffer item with item index=" << frameNumber << ", time=" <<
+               unfilteredTimestamp << ". The item may have been tagged with an inaccurate timestamp, therefore it will not be recorded.");
+      this->RecordDroppedItem();
+      return PLUS_SUCCESS;
+    }
+  }
+  else
+  {
+    this->StreamBuffer->AddToTimeStampReport(frameNumber, unfilteredTimestamp, filteredTimestamp);
+  }
+
+  int bufferIndex(0);
+  BufferItemUidType itemUid;
+  igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
+  if (this->PrepareForNewItem(filteredTimestamp, itemUid, bufferIndex) != PLUS_SUCCESS)
+  {
+    // Just a debug message, because we want to avoid unnecessary warning messages if the timestamp is the same as last one
+    LOCAL_LOG_DEBUG("vtkPlusBuffer: Failed to prepare for adding new frame to video buffer!");
+    return PLUS_FAIL;
+  }
+  if (bufferIndex != reservedBufferIndex)
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Reserved frame is no longer the next item of the buffer, items must not be added while a frame is reserved!");
+    return PLUS_FAIL;
+  }
+
+  StreamBufferItem* newObjectInBuffer = this->StreamBuffer->GetBufferItemPointerFromBufferIndex(bufferIndex);
+  if (newObjectInBuffer == NULL)
+  {
+    LOCAL_LOG_ERROR("vtkPlusBuffer: Failed to get pointer to video buffer object from the video buffer for the new frame!");
+    return PLUS_FAIL;
+  }
+
+  newObjectInBuffer->SetFilteredTimestamp(filteredTimestamp);
+  newObjectInBuffer->SetUnfilteredTimestamp(unfilteredTimestamp);
+  newObjectInBuffer->SetIndex(frameNumber);
+  newObjectInBuffer->SetUid(itemUid);
+  newObjectInBuffer->GetFrame().SetImageType(this->ReservedImageType);
+
+  // Add custom fields
+  if (customFields != NULL)
+  {
+    for (igsioFieldMapType::const_iterator it = customFields->begin(); it != customFields->end(); ++it)
+    {
+      newObjectInBuffer->SetFrameField(it->first, it->second.second, it->second.first);
+      std::string name(it->first);
+      if (name.find("Transform") != std::string::npos)
+      {
+        newObjectInBuffer->SetValidTransformData(true);
+      }
+    }
+  }
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusBuffer::CancelReservedItem()
+{
+  // The reserved item has already been made inaccessible for readers, so it is enough to forget about it
+  this->ReservedBufferIndex = -1;
+}
+
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusBuffer::AddItem(const igsioFieldMapType& fields,
                                   long frameNumber,
@@ -341,6 +575,7 @@ PlusStatus vtkPlusBuffer::AddItem(const igsioFieldMapType& fields,
     if (!filteredTimestampProbablyValid)
     {
       LOG_INFO("Filtered timestamp is probably invalid for tracker buffer item with item index=" << frameNumber << ", time=" << unfilteredTimestamp << ". The item may have been tagged with an inaccurate timestamp, therefore it will not be recorded.");
+      this->RecordDroppedItem();
       return PLUS_SUCCESS;
     }
   }
@@ -353,7 +588,7 @@ PlusStatus vtkPlusBuffer::AddItem(const igsioFieldMapType& fields,
   BufferItemUidType itemUid;
 
   igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
-  if (this->StreamBuffer->PrepareForNewItem(filteredTimestamp, itemUid, bufferIndex) != PLUS_SUCCESS)
+  if (this->PrepareForNewItem(filteredTimestamp, itemUid, bufferIndex) != PLUS_SUCCESS)
   {
     // Just a debug message, because we want to avoid unnecessary warning messages if the timestamp is the same as last one
     LOCAL_LOG_DEBUG("vtkPlusBuffer: Failed to prepare for adding new frame to tracker buffer!");
@@ -416,6 +651,7 @@ PlusStatus vtkPlusBuffer::AddItem(void* imageDataPtr,
     {
       LOG_INFO("Filtered timestamp is probably invalid for video buffer item with item index=" << frameNumber << ", time=" <<
                unfilteredTimestamp << ". The item may have been tagged with an inaccurate timestamp, therefore it will not be recorded.");
+      this->RecordDroppedItem();
       return PLUS_SUCCESS;
     }
   }
@@ -464,7 +700,7 @@ PlusStatus vtkPlusBuffer::AddItem(void* imageDataPtr,
   int bufferIndex(0);
   BufferItemUidType itemUid;
   igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
-  if (this->StreamBuffer->PrepareForNewItem(filteredTimestamp, itemUid, bufferIndex) != PLUS_SUCCESS)
+  if (this->PrepareForNewItem(filteredTimestamp, itemUid, bufferIndex) != PLUS_SUCCESS)
   {
     // Just a debug message, because we want to avoid unnecessary warning messages if the timestamp is the same as last one
     LOCAL_LOG_DEBUG("vtkPlusBuffer: Failed to prepare for adding new frame to video buffer!");
@@ -554,6 +790,7 @@ PlusStatus vtkPlusBuffer::AddItem(void* imageDataPtr, const FrameSizeType& frame
     {
       LOG_INFO("Filtered timestamp is probably invalid for video buffer item with item index=" << frameNumber << ", time=" <<
                unfilteredTimestamp << ". The item may have been tagged with an inaccurate timestamp, therefore it will not be recorded.");
+      this->RecordDroppedItem();
       return PLUS_SUCCESS;
     }
   }
@@ -577,7 +814,7 @@ PlusStatus vtkPlusBuffer::AddItem(void* imageDataPtr, const FrameSizeType& frame
   int bufferIndex(0);
   BufferItemUidType itemUid;
   igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
-  if (this->StreamBuffer->PrepareForNewItem(filteredTimestamp, itemUid, bufferIndex) != PLUS_SUCCESS)
+  if (this->PrepareForNewItem(filteredTimestamp, itemUid, bufferIndex) != PLUS_SUCCESS)
   {
     // Just a debug message, because we want to avoid unnecessary warning messages if the timestamp is the same as last one
     LOCAL_LOG_DEBUG("vtkPlusBuffer: Failed to prepare for adding new frame to video buffer!");
@@ -648,6 +885,7 @@ PlusStatus vtkPlusBuffer::AddTimeStampedItem(vtkMatrix4x4* matrix, ToolStatus st
     if (!filteredTimestampProbablyValid)
     {
       LOG_INFO("Filtered timestamp is probably invalid for tracker buffer item with item index=" << frameNumber << ", time=" << unfilteredTimestamp << ". The item may have been tagged with an inaccurate timestamp, therefore it will not be recorded.");
+      this->RecordDroppedItem();
       return PLUS_SUCCESS;
     }
   }
@@ -660,7 +898,7 @@ PlusStatus vtkPlusBuffer::AddTimeStampedItem(vtkMatrix4x4* matrix, ToolStatus st
   BufferItemUidType itemUid;
 
   igsioLockGuard<StreamItemCircularBuffer> dataBufferGuardedLock(this->StreamBuffer);
-  if (this->StreamBuffer->PrepareForNewItem(filteredTimestamp, itemUid, bufferIndex) != PLUS_SUCCESS)
+  if (this->PrepareForNewItem(filteredTimestamp, itemUid, bufferIndex) != PLUS_SUCCESS)
   {
     // Just a debug message, because we want to avoid unnecessary warning messages if the timestamp is the same as last one
     LOCAL_LOG_DEBUG("vtkPlusBuffer: Failed to prepare for adding new frame to tracker buffer!");
@@ -1076,14 +1314,49 @@ PlusStatus vtkPlusBuffer::WriteToSequenceFile(const char* filename, bool useComp
 {
   LOG_TRACE("vtkPlusBuffer::WriteToSequenceFile");
 
-  vtkSmartPointer<vtkIGSIOTrackedFrameList> trackedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  vtkSmartPointer<vtkPlusSequenceStreamWriter> writer = vtkSmartPointer<vtkPlusSequenceStreamWriter>::New();
+  if (writer->Open(filename, useCompression) != PLUS_SUCCESS)
+  {
+    LOCAL_LOG_ERROR("Failed to save tracked frames to sequence metafile!");
+    return PLUS_FAIL;
+  }
+  PlusStatus status = this->WriteToSequenceFile(writer);
+  if (writer->Close() != PLUS_SUCCESS)
+  {
+    LOCAL_LOG_ERROR("Failed to save tracked frames to sequence metafile!");
+    return PLUS_FAIL;
+  }
+  return status;
+}
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusBuffer::WriteToSequenceFile(vtkPlusSequenceStreamWriter* writer)
+{
   PlusStatus status = PLUS_SUCCESS;
 
-  for (BufferItemUidType frameUid = this->GetOldestItemUidInBuffer(); frameUid <= this->GetLatestItemUidInBuffer(); ++frameUid)
+  // Only the items that are in the buffer now are written, items that are added meanwhile are ignored
+  if (this->GetNumberOfItems() < 1)
+  {
+    return PLUS_SUCCESS;
+  }
+  BufferItemUidType oldestUid = this->GetOldestItemUidInBuffer();
+  BufferItemUidType latestUid = this->GetLatestItemUidInBuffer();
+  writer->SetNumberOfFramesToWrite(writer->GetNumberOfFramesToWrite() + (latestUid - oldestUid + 1));
+
+  unsigned long long numberOfLostFrames = 0;
+  vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  for (BufferItemUidType frameUid = oldestUid; frameUid <= latestUid; ++frameUid)
   {
     StreamBufferItem bufferItem;
-    if (this->GetStreamBufferItem(frameUid, &bufferItem) != ITEM_OK)
+    ItemStatus itemStatus = this->GetStreamBufferItem(frameUid, &bufferItem);
+    if (itemStatus == ITEM_NOT_AVAILABLE_ANYMORE)
+    {
+      // acquisition is still running and the item has been overwritten since the write started
+      writer->AddLostFrame();
+      ++numberOfLostFrames;
+      continue;
+    }
+    if (itemStatus != ITEM_OK)
     {
       LOCAL_LOG_ERROR("Unable to get frame from buffer with UID: " << frameUid);
       status = PLUS_FAIL;
@@ -1096,7 +1369,6 @@ PlusStatus vtkPlusBuffer::WriteToSequenceFile(const char* filename, bool useComp
     trackedFrame->SetImageData(bufferItem.GetFrame());
 
     // Add tracking data
-    vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
     bufferItem.GetMatrix(matrix);
     trackedFrame->SetFrameTransform(igsioTransformName("Tool", "Tracker"), matrix);
     trackedFrame->SetFrameTransformStatus(igsioTransformName("Tool", "Tracker"), bufferItem.GetStatus());
@@ -1126,15 +1398,17 @@ PlusStatus vtkPlusBuffer::WriteToSequenceFile(const char* filename, bool useComp
       trackedFrame->SetFrameField(cf->first, cf->second.second, cf->second.first);
     }
 
-    // Add tracked frame to the list
-    trackedFrameList->TakeTrackedFrame(trackedFrame);
+    // Add tracked frame to the file
+    if (writer->TakeTrackedFrame(trackedFrame) != PLUS_SUCCESS)
+    {
+      LOCAL_LOG_ERROR("Failed to write frame with UID " << frameUid << " to sequence file " << writer->GetFileName());
+      return PLUS_FAIL;
+    }
   }
 
-  // Save tracked frames to metafile
-  if (vtkPlusSequenceIO::Write(filename, trackedFrameList, trackedFrameList->GetImageOrientation(), useCompression) != PLUS_SUCCESS)
+  if (numberOfLostFrames > 0)
   {
-    LOCAL_LOG_ERROR("Failed to save tracked frames to sequence metafile!");
-    return PLUS_FAIL;
+    LOCAL_LOG_WARNING(numberOfLostFrames << " frames were overwritten in the buffer before they could be written to " << writer->GetFileName());
   }
 
   return status;
@@ -1274,18 +1548,41 @@ PlusStatus vtkPlusBuffer::GetPrevNextBufferItemFromTime(double time, StreamBuffe
 //----------------------------------------------------------------------------
 ItemStatus vtkPlusBuffer::GetStreamBufferItemFromTime(double time, StreamBufferItem* bufferItem, DataItemTemporalInterpolationType interpolation)
 {
+  ItemStatus status = ITEM_UNKNOWN_ERROR;
   switch (interpolation)
   {
     case EXACT_TIME:
-      return GetStreamBufferItemFromExactTime(time, bufferItem);
+      status = GetStreamBufferItemFromExactTime(time, bufferItem);
+      break;
     case INTERPOLATED:
-      return GetInterpolatedStreamBufferItemFromTime(time, bufferItem);
+      status = GetInterpolatedStreamBufferItemFromTime(time, bufferItem);
+      break;
     case CLOSEST_TIME:
-      return GetStreamBufferItemFromClosestTime(time, bufferItem);
+      status = GetStreamBufferItemFromClosestTime(time, bufferItem);
+      break;
     default:
       LOCAL_LOG_WARNING("Unknown interpolation type: " << interpolation << ". Defaulting to exact time request.");
-      return GetStreamBufferItemFromExactTime(time, bufferItem);
+      status = GetStreamBufferItemFromExactTime(time, bufferItem);
   }
+
+  if (this->LookupOkCounter != NULL)
+  {
+    switch (status)
+    {
+      case ITEM_OK:
+        this->LookupOkCounter->Increment();
+        break;
+      case ITEM_NOT_AVAILABLE_YET:
+        this->LookupNotAvailableYetCounter->Increment();
+        break;
+      case ITEM_NOT_AVAILABLE_ANYMORE:
+        this->LookupNotAvailableAnymoreCounter->Increment();
+        break;
+      default:
+        this->LookupFailedCounter->Increment();
+    }
+  }
+  return status;
 }
 
 //----------------------------------------------------------------------------
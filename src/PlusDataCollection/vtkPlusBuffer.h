@@ -18,6 +18,7 @@ See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
 #include "igsioCommon.h"
 #include "PlusConfigure.h"
 #include "vtkPlusDataCollectionExport.h"
+#include "PlusMetricsRegistry.h"
 #include "PlusStreamBufferItem.h"
 #include "vtkPlusTimestampedCircularBuffer.h"
 
@@ -27,6 +28,7 @@ See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
 #include <vtkObject.h>
 
 class vtkPlusDevice;
+class vtkPlusSequenceStreamWriter;
 enum ToolStatus;
 
 //class vtkIGSIOTrackedFrameList;
@@ -133,6 +135,35 @@ public:
                              double filteredTimestamp = UNDEFINED_TIMESTAMP,
                              const igsioFieldMapType* customFields = NULL);
 
+  /*!
+    Reserve the next frame of the buffer so that the image data can be written directly into it (e.g., received from a socket),
+    without an intermediate copy. The reserved frame is not accessible for readers until CommitReservedItem is called.
+    Only images that can be stored as is (no clipping or reorientation needed and the frame format matches the buffer) can be reserved,
+    otherwise PLUS_FAIL is returned and the frame has to be added with AddItem.
+    Only one item can be reserved at a time and items must not be added by other means until the reservation is committed or cancelled.
+    \param frameDataPtr Output, pointer to the scalar data of the reserved frame
+  */
+  virtual PlusStatus ReserveItem(US_IMAGE_ORIENTATION usImageOrientation,
+                                 const FrameSizeType& inputFrameSizeInPx,
+                                 igsioCommon::VTKScalarPixelType pixelType,
+                                 unsigned int numberOfScalarComponents,
+                                 US_IMAGE_TYPE imageType,
+                                 const std::array<int, 3>& clipRectangleOrigin,
+                                 const std::array<int, 3>& clipRectangleSize,
+                                 void*& frameDataPtr);
+
+  /*!
+    Make the reserved frame accessible in the buffer with the specified timestamp and custom fields.
+    If the timestamp is less than or equal to the previous timestamp then the frame is not added.
+  */
+  virtual PlusStatus CommitReservedItem(long frameNumber,
+                                        double unfilteredTimestamp = UNDEFINED_TIMESTAMP,
+                                        double filteredTimestamp = UNDEFINED_TIMESTAMP,
+                                        const igsioFieldMapType* customFields = NULL);
+
+  /*! Release the reserved frame without adding it to the buffer (e.g., because the image data could not be received) */
+  virtual void CancelReservedItem();
+
   /*!
     Add custom fields to the new item
     If the timestamp is less than or equal to the previous timestamp,
@@ -311,11 +342,25 @@ public:
   /*! Copy images from a tracked frame buffer. It is useful when data is stored in a metafile and the data is needed as a vtkPlusDataBuffer. */
   PlusStatus CopyImagesFromTrackedFrameList(vtkIGSIOTrackedFrameList* sourceTrackedFrameList, TIMESTAMP_FILTERING_OPTION timestampFiltering, bool copyFrameFields);
 
-  /*! Dump the current state of the video buffer to metafile */
+  /*!
+    Dump the current state of the video buffer to metafile.
+    The file is streamed, except compressed MetaImage files, which are written at once (see vtkPlusSequenceStreamWriter).
+  */
   virtual PlusStatus WriteToSequenceFile(const char* filename, bool useCompression = false);
 
+  /*!
+    Write the items that are in the buffer when the method is called to an opened sequence file writer.
+    Items are copied from the buffer one at a time, so acquisition can continue while the file is written.
+    Items that are overwritten in the buffer before they are copied are reported to the writer as lost.
+  */
+  virtual PlusStatus WriteToSequenceFile(vtkPlusSequenceStreamWriter* writer);
+
   vtkGetStringMacro(DescriptiveName);
-  vtkSetStringMacro(DescriptiveName);
+  /*!
+    Set the name used in log messages. Runtime metrics of the buffer are published with this name in the "buffer" label.
+    The metrics of the previous name are removed (also when the buffer is deleted), so the name must be unique among the existing buffers.
+  */
+  virtual void SetDescriptiveName(const char* descriptiveName);
 
 protected:
   vtkPlusBuffer();
@@ -346,6 +391,12 @@ protected:
   /*! Get tracker buffer item from the closest timestamp */
   virtual ItemStatus GetStreamBufferItemFromClosestTime(double time, StreamBufferItem* bufferItem);
 
+  /*! Reserve space for a new item in the stream buffer and update the item counters and occupancy metrics. The stream buffer must be locked. */
+  PlusStatus PrepareForNewItem(double filteredTimestamp, BufferItemUidType& itemUid, int& bufferIndex);
+
+  /*! Update the counter of items that were not recorded because of an invalid timestamp */
+  void RecordDroppedItem();
+
 protected:
   /*! Image frame size in pixel */
   FrameSizeType FrameSize;
@@ -369,8 +420,22 @@ protected:
   /*! Maximum allowed time difference in seconds between the desired and the closest valid timestamp */
   double MaxAllowedTimeDifference;
 
+  /*! Index of the stream buffer item that is reserved by ReserveItem (-1 if no item is reserved) */
+  int ReservedBufferIndex;
+  /*! Image type of the reserved item */
+  US_IMAGE_TYPE ReservedImageType;
+
   char* DescriptiveName;
 
+  /*! Runtime metrics, published once the descriptive name is set (NULL until then) */
+  PlusMetricsRegistry::Counter* ItemsAddedCounter;
+  PlusMetricsRegistry::Counter* ItemsDroppedCounter;
+  PlusMetricsRegistry::Gauge* OccupancyGauge;
+  PlusMetricsRegistry::Counter* LookupOkCounter;
+  PlusMetricsRegistry::Counter* LookupNotAvailableYetCounter;
+  PlusMetricsRegistry::Counter* LookupNotAvailableAnymoreCounter;
+  PlusMetricsRegistry::Counter* LookupFailedCounter;
+
 private:
   vtkPlusBuffer(const vtkPlusBuffer&);
   void operator=(const vtkPlusBuffer&);
@@ -36,6 +36,7 @@ vtkPlusChannel::vtkPlusChannel(void)
   : VideoSource(NULL)
   , OwnerDevice(NULL)
   , ChannelId(NULL)
+  , TrackedFrameRetrievalHistogram(NULL)
   , RfProcessor(NULL)
   , BlankImage(vtkImageData::New())
   , SaveRfProcessingParameters(false)
@@ -67,6 +68,31 @@ vtkPlusChannel::~vtkPlusChannel(void)
   DELETE_IF_NOT_NULL(this->BlankImage);
 
   DELETE_IF_NOT_NULL(this->RfProcessor);
+
+  this->SetChannelId(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusChannel::SetChannelId(const char* channelId)
+{
+  if (this->ChannelId != NULL && channelId != NULL && strcmp(this->ChannelId, channelId) == 0)
+  {
+    return;
+  }
+  delete[] this->ChannelId;
+  this->ChannelId = NULL;
+  this->TrackedFrameRetrievalHistogram = NULL;
+  if (channelId != NULL)
+  {
+    this->ChannelId = new char[strlen(channelId) + 1];
+    strcpy(this->ChannelId, channelId);
+
+    PlusMetricsRegistry::LabelMap labels;
+    labels["channel"] = this->ChannelId;
+    this->TrackedFrameRetrievalHistogram = PlusMetricsRegistry::GetInstance()->GetHistogram("plus_channel_tracked_frame_retrieval_seconds", labels,
+                                           "Time needed to assemble a tracked frame from the channel data sources");
+  }
+  this->Modified();
 }
 
 //----------------------------------------------------------------------------
@@ -529,6 +555,7 @@ void vtkPlusChannel::SetVideoSource(vtkPlusDataSource* aSource)
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusChannel::GetTrackedFrame(double timestamp, igsioTrackedFrame& aTrackedFrame, bool enableImageData/*=true*/)
 {
+  PlusMetricsRegistry::ScopedTimer retrievalTimer(this->TrackedFrameRetrievalHistogram);
   int numberOfErrors(0);
   double synchronizedTimestamp(0);
 
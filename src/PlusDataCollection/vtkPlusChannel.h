@@ -9,6 +9,7 @@
 
 #include "PlusConfigure.h"
 #include "vtkPlusDataCollectionExport.h"
+#include "PlusMetricsRegistry.h"
 
 #include "PlusStreamBufferItem.h"
 #include "vtkDataObject.h"
@@ -156,7 +157,8 @@ public:
   PlusStatus GetCustomAttribute(const std::string& attributeId, std::string& output) const;
   PlusStatus GetCustomAttributeMap(CustomAttributeMap& output) const;
 
-  vtkSetStringMacro(ChannelId);
+  /*! Set channel identifier. Runtime metrics of the channel are published with this id in the "channel" label. */
+  virtual void SetChannelId(const char* channelId);
   vtkGetStringMacro(ChannelId);
 
   vtkGetObjectMacro(RfProcessor, vtkPlusRfProcessor);
@@ -181,6 +183,9 @@ protected:
   vtkPlusDevice*            OwnerDevice;
   char*                     ChannelId;
 
+  /*! Duration of tracked frame retrieval (NULL until the channel id is set) */
+  PlusLatencyHistogram* TrackedFrameRetrievalHistogram;
+
   /*! RF to brightness conversion */
   vtkPlusRfProcessor* RfProcessor;
   vtkImageData* BlankImage;
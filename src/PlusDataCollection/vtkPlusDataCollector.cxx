@@ -13,21 +13,30 @@ See License.txt for details.
 #include "vtkPlusDevice.h"
 #include "vtkPlusDeviceFactory.h"
 #include "vtkPlusSavedDataSource.h"
+#include "vtkPlusSequenceStreamWriter.h"
 
 // vtkAddon includes
 #include <vtkStreamingVolumeCodecFactory.h>
 
 // IGSIO includes
 #include <igsioTrackedFrame.h>
+#include <vtkIGSIORecursiveCriticalSection.h>
 #include <vtkIGSIOTrackedFrameList.h>
 #if defined PLUS_USE_VP9
   #include <vtkVP9VolumeCodec.h>
 #endif
 
 // STD includes
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <iomanip>
+#include <limits>
 #include <set>
+#include <sstream>
 
 // VTK includes
+#include <vtkMultiThreader.h>
 #include <vtkObjectFactory.h>
 #include <vtkXMLDataElement.h>
 #include <vtksys/SystemTools.hxx>
@@ -36,13 +45,152 @@ See License.txt for details.
 
 vtkStandardNewMacro(vtkPlusDataCollector);
 
+namespace
+{
+  enum DeviceTaskState
+  {
+    DEVICE_TASK_PENDING,
+    DEVICE_TASK_SUCCEEDED,
+    DEVICE_TASK_FAILED
+  };
+
+  struct DeviceTaskList;
+
+  /*! Connect or start recording of a single device, executed in its own thread */
+  struct DeviceTask
+  {
+    DeviceTaskList* TaskList;
+    vtkPlusDevice* Device;
+    std::vector<int> Dependencies;
+    double StartTime;
+    double DurationSec;
+  };
+
+  struct DeviceTaskList
+  {
+    bool StartRecording;
+    std::vector<DeviceTask> Tasks;
+    /*! State of each task (DeviceTaskState), protected by Mutex */
+    std::vector<int> States;
+    vtkIGSIOSimpleRecursiveCriticalSection Mutex;
+  };
+
+  //----------------------------------------------------------------------------
+  void* DeviceTaskThread(vtkMultiThreader::ThreadInfo* threadInfo)
+  {
+    DeviceTask* task = static_cast<DeviceTask*>(threadInfo->UserData);
+    DeviceTaskList* taskList = task->TaskList;
+    int taskIndex = static_cast<int>(task - &taskList->Tasks[0]);
+
+    // Wait for the devices that provide the input channels
+    const vtkPlusDevice* failedInputDevice = NULL;
+    for (;;)
+    {
+      bool inputsReady = true;
+      {
+        igsioLockGuard<vtkIGSIOSimpleRecursiveCriticalSection> guard(&taskList->Mutex);
+        for (std::vector<int>::const_iterator it = task->Dependencies.begin(); it != task->Dependencies.end(); ++it)
+        {
+          if (taskList->States[*it] == DEVICE_TASK_FAILED)
+          {
+            failedInputDevice = taskList->Tasks[*it].Device;
+            break;
+          }
+          if (taskList->States[*it] != DEVICE_TASK_SUCCEEDED)
+          {
+            inputsReady = false;
+          }
+        }
+      }
+      if (failedInputDevice != NULL || inputsReady)
+      {
+        break;
+      }
+      vtkIGSIOAccurateTimer::Delay(0.001);
+    }
+
+    PlusStatus status = PLUS_FAIL;
+    task->StartTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    if (failedInputDevice != NULL)
+    {
+      LOG_ERROR("Device " << task->Device->GetDeviceId() << " is skipped, because its input device " << failedInputDevice->GetDeviceId() << " failed.");
+    }
+    else
+    {
+      status = taskList->StartRecording ? task->Device->StartRecording() : task->Device->Connect();
+    }
+    task->DurationSec = vtkIGSIOAccurateTimer::GetSystemTime() - task->StartTime;
+
+    igsioLockGuard<vtkIGSIOSimpleRecursiveCriticalSection> guard(&taskList->Mutex);
+    taskList->States[taskIndex] = (status == PLUS_SUCCESS ? DEVICE_TASK_SUCCEEDED : DEVICE_TASK_FAILED);
+    return NULL;
+  }
+
+  /*! Write a video buffer or the tool buffers of a device to a sequence file */
+  struct BufferDumpTask
+  {
+    BufferDumpTask()
+      : Device(NULL)
+      , VideoSource(NULL)
+      , Writer(vtkSmartPointer<vtkPlusSequenceStreamWriter>::New())
+      , Status(PLUS_SUCCESS)
+    {
+    }
+    vtkPlusDevice* Device;
+    /*! If NULL then the tool buffers of the device are written */
+    vtkPlusDataSource* VideoSource;
+    std::string FileName;
+    vtkSmartPointer<vtkPlusSequenceStreamWriter> Writer;
+    PlusStatus Status;
+  };
+
+  struct BufferDumpTaskList
+  {
+    /*! Elements of a deque are not moved when new tasks are added */
+    std::deque<BufferDumpTask> Tasks;
+    bool UseCompression;
+    std::atomic<size_t> NextTaskIndex;
+    std::atomic<size_t> NumberOfFinishedTasks;
+  };
+
+  //----------------------------------------------------------------------------
+  void* BufferDumpThread(vtkMultiThreader::ThreadInfo* threadInfo)
+  {
+    BufferDumpTaskList* taskList = static_cast<BufferDumpTaskList*>(threadInfo->UserData);
+    for (size_t taskIndex = taskList->NextTaskIndex++; taskIndex < taskList->Tasks.size(); taskIndex = taskList->NextTaskIndex++)
+    {
+      BufferDumpTask& task = taskList->Tasks[taskIndex];
+      task.Status = task.Writer->Open(task.FileName, taskList->UseCompression);
+      if (task.Status == PLUS_SUCCESS)
+      {
+        task.Status = (task.VideoSource != NULL ? task.VideoSource->WriteToSequenceFile(task.Writer) : task.Device->WriteToolsToSequenceFile(task.Writer));
+        if (task.Writer->Close() != PLUS_SUCCESS)
+        {
+          task.Status = PLUS_FAIL;
+        }
+      }
+      if (task.Status != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to write buffer to " << task.FileName);
+      }
+      ++taskList->NumberOfFinishedTasks;
+    }
+    return NULL;
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkPlusDataCollector::vtkPlusDataCollector()
   : vtkObject()
   , StartupDelaySec(0.0)
+  , ParallelDeviceConnect(false)
   , DeviceFactory(vtkSmartPointer<vtkPlusDeviceFactory>::New())
   , Connected(false)
   , Started(false)
+  , FreeRunThreader(vtkSmartPointer<vtkMultiThreader>::New())
+  , FreeRunThreadId(-1)
+  , FreeRunStopRequested(false)
+  , FreeRunReplayActive(false)
 {
   vtkStreamingVolumeCodecFactory* factory = vtkStreamingVolumeCodecFactory::GetInstance();
 #if defined PLUS_USE_VP9
@@ -105,6 +253,8 @@ PlusStatus vtkPlusDataCollector::ReadConfiguration(vtkXMLDataElement* aConfig)
     LOG_DEBUG("StartupDelaySec: " << std::fixed << startupDelaySec);
   }
 
+  XML_READ_BOOL_ATTRIBUTE_OPTIONAL(ParallelDeviceConnect, dataCollectionElement);
+
   std::set<std::string> existingDeviceIds;
 
   for (int i = 0; i < dataCollectionElement->GetNumberOfNestedElements(); ++i)
@@ -281,6 +431,7 @@ PlusStatus vtkPlusDataCollector::WriteConfiguration(vtkXMLDataElement* aConfig)
   }
 
   dataCollectionConfig->SetDoubleAttribute("StartupDelaySec", GetStartupDelaySec());
+  XML_WRITE_BOOL_ATTRIBUTE(ParallelDeviceConnect, dataCollectionConfig);
 
   PlusStatus status = PLUS_SUCCESS;
 
@@ -322,22 +473,26 @@ PlusStatus vtkPlusDataCollector::Start()
 
   const double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
 
+  DeviceTimingMap startTimings;
+  if (this->ExecuteDeviceOperation(DEVICE_OPERATION_START_RECORDING, startTimings) != PLUS_SUCCESS)
+  {
+    status = PLUS_FAIL;
+  }
   for (DeviceCollectionIterator it = Devices.begin(); it != Devices.end(); ++ it)
   {
-    vtkPlusDevice* device = *it;
-
-    if (device->StartRecording() != PLUS_SUCCESS)
-    {
-      LOG_ERROR("Failed to start data acquisition for device " << device->GetDeviceId() << ".");
-      status = PLUS_FAIL;
-    }
-    device->SetStartTime(startTime);
+    (*it)->SetStartTime(startTime);
   }
+  this->LogDeviceTimings("Start recording", startTimings, vtkIGSIOAccurateTimer::GetSystemTime() - startTime);
 
   LOG_DEBUG("vtkPlusDataCollector::Start -- wait " << std::fixed << this->StartupDelaySec << " sec for buffer init...");
 
   vtkIGSIOAccurateTimer::DelayWithEventProcessing(this->StartupDelaySec);
 
+  if (this->StartFreeRunReplay() != PLUS_SUCCESS)
+  {
+    status = PLUS_FAIL;
+  }
+
   this->Started = true;
 
   return status;
@@ -348,6 +503,7 @@ PlusStatus vtkPlusDataCollector::Stop()
 {
   LOG_TRACE("vtkPlusDataCollector::Stop()");
 
+  this->StopFreeRunReplay();
   this->Started = false;
 
   return PLUS_SUCCESS;
@@ -360,16 +516,13 @@ PlusStatus vtkPlusDataCollector::Connect()
 
   PlusStatus status = PLUS_SUCCESS;
 
-  for (DeviceCollectionIterator it = Devices.begin(); it != Devices.end(); ++ it)
+  const double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+  this->DeviceConnectTimings.clear();
+  if (this->ExecuteDeviceOperation(DEVICE_OPERATION_CONNECT, this->DeviceConnectTimings) != PLUS_SUCCESS)
   {
-    vtkPlusDevice* device = *it;
-
-    if (device->Connect() != PLUS_SUCCESS)
-    {
-      LOG_ERROR("Unable to connect device: " << device->GetDeviceId() << ".");
-      status = PLUS_FAIL;
-    }
+    status = PLUS_FAIL;
   }
+  this->LogDeviceTimings("Connect", this->DeviceConnectTimings, vtkIGSIOAccurateTimer::GetSystemTime() - startTime);
 
   if (status != PLUS_SUCCESS)
   {
@@ -387,11 +540,458 @@ PlusStatus vtkPlusDataCollector::Connect()
   return status;
 }
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusDataCollector::ExecuteDeviceOperation(DeviceOperationType operation, DeviceTimingMap& timings)
+{
+  const bool startRecording = (operation == DEVICE_OPERATION_START_RECORDING);
+  PlusStatus status = PLUS_SUCCESS;
+
+  if (!this->ParallelDeviceConnect || this->Devices.size() < 2)
+  {
+    for (DeviceCollectionIterator it = Devices.begin(); it != Devices.end(); ++ it)
+    {
+      vtkPlusDevice* device = *it;
+      DeviceTiming& timing = timings[device->GetDeviceId()];
+      timing.StartTime = vtkIGSIOAccurateTimer::GetSystemTime();
+      PlusStatus deviceStatus = startRecording ? device->StartRecording() : device->Connect();
+      timing.DurationSec = vtkIGSIOAccurateTimer::GetSystemTime() - timing.StartTime;
+      if (deviceStatus != PLUS_SUCCESS)
+      {
+        if (startRecording)
+        {
+          LOG_ERROR("Failed to start data acquisition for device " << device->GetDeviceId() << ".");
+        }
+        else
+        {
+          LOG_ERROR("Unable to connect device: " << device->GetDeviceId() << ".");
+        }
+        status = PLUS_FAIL;
+      }
+    }
+    return status;
+  }
+
+  DeviceTaskList taskList;
+  taskList.StartRecording = startRecording;
+  std::vector< std::vector<int> > dependencies;
+  if (this->GetDeviceDependencies(dependencies) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+  taskList.Tasks.resize(this->Devices.size());
+  taskList.States.resize(this->Devices.size(), DEVICE_TASK_PENDING);
+  for (size_t i = 0; i < this->Devices.size(); ++i)
+  {
+    DeviceTask& task = taskList.Tasks[i];
+    task.TaskList = &taskList;
+    task.Device = this->Devices[i];
+    task.Dependencies = dependencies[i];
+    task.StartTime = 0.0;
+    task.DurationSec = 0.0;
+  }
+
+  // The task list is not modified while the threads are running, so the tasks can be referenced by the threads
+  vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+  std::vector<int> threadIds;
+  for (size_t i = 0; i < taskList.Tasks.size(); ++i)
+  {
+    int threadId = threader->SpawnThread((vtkThreadFunctionType)&DeviceTaskThread, &taskList.Tasks[i]);
+    if (threadId < 0)
+    {
+      LOG_ERROR("Failed to create thread for device " << taskList.Tasks[i].Device->GetDeviceId() << ".");
+      igsioLockGuard<vtkIGSIOSimpleRecursiveCriticalSection> guard(&taskList.Mutex);
+      taskList.States[i] = DEVICE_TASK_FAILED;
+      continue;
+    }
+    threadIds.push_back(threadId);
+  }
+  for (std::vector<int>::iterator it = threadIds.begin(); it != threadIds.end(); ++it)
+  {
+    threader->TerminateThread(*it);
+  }
+
+  for (size_t i = 0; i < taskList.Tasks.size(); ++i)
+  {
+    const DeviceTask& task = taskList.Tasks[i];
+    DeviceTiming& timing = timings[task.Device->GetDeviceId()];
+    timing.StartTime = task.StartTime;
+    timing.DurationSec = task.DurationSec;
+    if (taskList.States[i] != DEVICE_TASK_SUCCEEDED)
+    {
+      if (startRecording)
+      {
+        LOG_ERROR("Failed to start data acquisition for device " << task.Device->GetDeviceId() << ".");
+      }
+      else
+      {
+        LOG_ERROR("Unable to connect device: " << task.Device->GetDeviceId() << ".");
+      }
+      status = PLUS_FAIL;
+    }
+  }
+  return status;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusDataCollector::GetDeviceDependencies(std::vector< std::vector<int> >& dependencies) const
+{
+  dependencies.clear();
+  dependencies.resize(this->Devices.size());
+  for (size_t i = 0; i < this->Devices.size(); ++i)
+  {
+    std::vector<vtkPlusDevice*> inputDevices;
+    this->Devices[i]->GetInputDevices(inputDevices);
+    for (std::vector<vtkPlusDevice*>::iterator inputIt = inputDevices.begin(); inputIt != inputDevices.end(); ++inputIt)
+    {
+      DeviceCollectionConstIterator deviceIt = std::find(this->Devices.begin(), this->Devices.end(), *inputIt);
+      if (deviceIt == this->Devices.end() || *inputIt == this->Devices[i])
+      {
+        continue;
+      }
+      int dependencyIndex = static_cast<int>(deviceIt - this->Devices.begin());
+      if (std::find(dependencies[i].begin(), dependencies[i].end(), dependencyIndex) == dependencies[i].end())
+      {
+        dependencies[i].push_back(dependencyIndex);
+      }
+    }
+  }
+
+  // Check for circular dependencies: repeatedly remove the devices whose inputs are all removed
+  std::vector<bool> resolved(this->Devices.size(), false);
+  size_t numberOfResolvedDevices = 0;
+  bool progress = true;
+  while (progress && numberOfResolvedDevices < this->Devices.size())
+  {
+    progress = false;
+    for (size_t i = 0; i < this->Devices.size(); ++i)
+    {
+      if (resolved[i])
+      {
+        continue;
+      }
+      bool inputsResolved = true;
+      for (std::vector<int>::const_iterator it = dependencies[i].begin(); it != dependencies[i].end(); ++it)
+      {
+        inputsResolved &= resolved[*it];
+      }
+      if (inputsResolved)
+      {
+        resolved[i] = true;
+        ++numberOfResolvedDevices;
+        progress = true;
+      }
+    }
+  }
+  if (numberOfResolvedDevices < this->Devices.size())
+  {
+    for (size_t i = 0; i < this->Devices.size(); ++i)
+    {
+      if (!resolved[i])
+      {
+        LOG_ERROR("Device " << this->Devices[i]->GetDeviceId() << " has a circular input channel dependency.");
+      }
+    }
+    return PLUS_FAIL;
+  }
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusDataCollector::StartFreeRunReplay()
+{
+  this->StopFreeRunReplay();
+  this->FreeRunSources.clear();
+  this->FreeRunConsumers.clear();
+
+  for (DeviceCollectionIterator it = this->Devices.begin(); it != this->Devices.end(); ++it)
+  {
+    vtkPlusSavedDataSource* savedDataSource = dynamic_cast<vtkPlusSavedDataSource*>(*it);
+    if (savedDataSource != NULL && savedDataSource->GetFreeRunEnabled())
+    {
+      this->FreeRunSources.push_back(savedDataSource);
+    }
+  }
+  if (this->FreeRunSources.empty())
+  {
+    return PLUS_SUCCESS;
+  }
+
+  // Collect the devices that process the output of the free-run sources, each of them after its input devices
+  std::vector< std::vector<int> > dependencies;
+  if (this->GetDeviceDependencies(dependencies) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to start free-run replay, device dependencies cannot be determined.");
+    return PLUS_FAIL;
+  }
+  std::ostringstream consumerIds;
+  std::vector<bool> ordered(this->Devices.size(), false);
+  bool progress = true;
+  while (progress)
+  {
+    progress = false;
+    for (size_t i = 0; i < this->Devices.size(); ++i)
+    {
+      if (ordered[i])
+      {
+        continue;
+      }
+      bool inputsOrdered = true;
+      for (std::vector<int>::const_iterator it = dependencies[i].begin(); it != dependencies[i].end(); ++it)
+      {
+        inputsOrdered &= ordered[*it];
+      }
+      if (!inputsOrdered)
+      {
+        continue;
+      }
+      ordered[i] = true;
+      progress = true;
+
+      vtkPlusDevice* device = this->Devices[i];
+      if (!device->GetStartThreadForInternalUpdates() || !device->IsRecording())
+      {
+        // the device does not process its input periodically
+        continue;
+      }
+      std::vector<vtkPlusDevice*> inputDevices;
+      device->GetInputDevicesRecursive(inputDevices);
+      for (std::vector<vtkPlusSavedDataSource*>::iterator sourceIt = this->FreeRunSources.begin(); sourceIt != this->FreeRunSources.end(); ++sourceIt)
+      {
+        if (std::find(inputDevices.begin(), inputDevices.end(), *sourceIt) != inputDevices.end())
+        {
+          this->FreeRunConsumers.push_back(device);
+          consumerIds << " " << device->GetDeviceId();
+          break;
+        }
+      }
+    }
+  }
+
+  this->FreeRunStopRequested = false;
+  this->FreeRunReplayActive = true;
+  this->FreeRunThreadId = this->FreeRunThreader->SpawnThread((vtkThreadFunctionType)&FreeRunReplayThread, this);
+  if (this->FreeRunThreadId < 0)
+  {
+    LOG_ERROR("Failed to start free-run replay thread");
+    this->FreeRunReplayActive = false;
+    return PLUS_FAIL;
+  }
+
+  LOG_INFO("Free-run replay of " << this->FreeRunSources.size() << " saved data source(s) started. Devices that process the replayed data:"
+           << (this->FreeRunConsumers.empty() ? std::string(" none, replay is paced by the recording timestamps") : consumerIds.str()));
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusDataCollector::StopFreeRunReplay()
+{
+  if (this->FreeRunThreadId < 0)
+  {
+    return;
+  }
+  this->FreeRunStopRequested = true;
+  this->FreeRunThreader->TerminateThread(this->FreeRunThreadId);
+  this->FreeRunThreadId = -1;
+  this->FreeRunReplayActive = false;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusDataCollector::IsFreeRunReplayActive() const
+{
+  return this->FreeRunReplayActive;
+}
+
+//----------------------------------------------------------------------------
+void* vtkPlusDataCollector::FreeRunReplayThread(vtkMultiThreader::ThreadInfo* data)
+{
+  vtkPlusDataCollector* self = (vtkPlusDataCollector*)(data->UserData);
+  self->RunFreeRunReplay();
+  return NULL;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusDataCollector::RunFreeRunReplay()
+{
+  const double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+  unsigned long long numberOfAddedFrames = 0;
+  double replayedTime = 0.0;
+  bool completed = false;
+
+  // Replay time of the first frame, for pacing the replay by the recording timestamps if there are no consumers
+  double firstFrameTime = std::numeric_limits<double>::max();
+  for (std::vector<vtkPlusSavedDataSource*>::iterator it = this->FreeRunSources.begin(); it != this->FreeRunSources.end(); ++it)
+  {
+    double frameTime = 0;
+    if ((*it)->GetFreeRunFrameTime(0, frameTime))
+    {
+      firstFrameTime = std::min(firstFrameTime, frameTime);
+    }
+  }
+
+  while (!this->FreeRunStopRequested)
+  {
+    // End of the next batch: no source may add more frames than its batch size.
+    // Tracker streams add one more frame after the end of the batch, so that the consumers can interpolate at any time in the batch.
+    bool framesLeft = false;
+    double batchEndTime = std::numeric_limits<double>::max();
+    for (std::vector<vtkPlusSavedDataSource*>::iterator it = this->FreeRunSources.begin(); it != this->FreeRunSources.end(); ++it)
+    {
+      double frameTime = 0;
+      if (!(*it)->GetFreeRunFrameTime(0, frameTime))
+      {
+        continue;
+      }
+      framesLeft = true;
+      int lastFrameOffset = std::max(0, (*it)->GetFreeRunBatchSize() - ((*it)->IsTrackerStream() ? 2 : 1));
+      if ((*it)->GetFreeRunFrameTime(lastFrameOffset, frameTime))
+      {
+        batchEndTime = std::min(batchEndTime, frameTime);
+      }
+    }
+    if (!framesLeft)
+    {
+      completed = true;
+      break;
+    }
+
+    // Consumers are not updated while the batch is added, so they see the frames of all sources up to the same time
+    int numberOfFramesInBatch = 0;
+    for (std::vector<vtkPlusDevice*>::iterator it = this->FreeRunConsumers.begin(); it != this->FreeRunConsumers.end(); ++it)
+    {
+      (*it)->UpdateMutex->Lock();
+    }
+    for (std::vector<vtkPlusSavedDataSource*>::iterator it = this->FreeRunSources.begin(); it != this->FreeRunSources.end(); ++it)
+    {
+      int numberOfAddedSourceFrames = 0;
+      (*it)->AddFreeRunFrames(batchEndTime, (*it)->GetFreeRunBatchSize(), (*it)->IsTrackerStream(), numberOfAddedSourceFrames);
+      numberOfFramesInBatch += numberOfAddedSourceFrames;
+      double lastAddedFrameTime = 0;
+      if ((*it)->GetFreeRunFrameTime(-1, lastAddedFrameTime))
+      {
+        replayedTime = std::max(replayedTime, lastAddedFrameTime);
+      }
+    }
+    for (std::vector<vtkPlusDevice*>::reverse_iterator it = this->FreeRunConsumers.rbegin(); it != this->FreeRunConsumers.rend(); ++it)
+    {
+      (*it)->UpdateMutex->Unlock();
+    }
+    numberOfAddedFrames += numberOfFramesInBatch;
+
+    if (numberOfFramesInBatch == 0)
+    {
+      LOG_ERROR("Free-run replay cannot proceed, no frames could be added at replay time " << std::fixed << batchEndTime);
+      break;
+    }
+
+    bool consumersRecording = false;
+    for (std::vector<vtkPlusDevice*>::iterator it = this->FreeRunConsumers.begin(); it != this->FreeRunConsumers.end(); ++it)
+    {
+      consumersRecording |= (*it)->IsRecording();
+    }
+    if (consumersRecording)
+    {
+      if (!this->WaitForFreeRunConsumers())
+      {
+        break;
+      }
+    }
+    else
+    {
+      // Nothing reads the buffers at a limited rate, so the next batch is added when the recording time of this batch has elapsed
+      if (!this->WaitForFreeRunSystemTime(startTime + replayedTime - firstFrameTime))
+      {
+        break;
+      }
+    }
+  }
+
+  LOG_INFO("Free-run replay " << (completed ? "completed" : "stopped") << ": " << numberOfAddedFrames << " frames, "
+           << std::fixed << std::setprecision(3) << replayedTime << " sec of recorded data replayed in "
+           << vtkIGSIOAccurateTimer::GetSystemTime() - startTime << " sec.");
+  this->FreeRunReplayActive = false;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusDataCollector::WaitForFreeRunConsumers()
+{
+  for (std::vector<vtkPlusDevice*>::iterator it = this->FreeRunConsumers.begin(); it != this->FreeRunConsumers.end(); ++it)
+  {
+    vtkPlusDevice* consumer = *it;
+    // The first completed update may have started before the input of the device was complete
+    // (if the device uses the output of another consumer), so wait for a second one, too
+    for (int i = 0; i < 2; ++i)
+    {
+      vtkMTimeType updateTime = consumer->UpdateTime.GetMTime();
+      while (consumer->UpdateTime.GetMTime() == updateTime && consumer->IsRecording())
+      {
+        if (this->FreeRunStopRequested)
+        {
+          return false;
+        }
+        vtkIGSIOAccurateTimer::Delay(0.001);
+      }
+    }
+  }
+  return !this->FreeRunStopRequested;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusDataCollector::WaitForFreeRunSystemTime(double systemTime)
+{
+  // Wait in short steps, so that stop requests are noticed
+  const double maxDelaySec = 0.01;
+  double remainingSec = systemTime - vtkIGSIOAccurateTimer::GetSystemTime();
+  while (remainingSec > 0)
+  {
+    if (this->FreeRunStopRequested)
+    {
+      return false;
+    }
+    vtkIGSIOAccurateTimer::Delay(std::min(remainingSec, maxDelaySec));
+    remainingSec = systemTime - vtkIGSIOAccurateTimer::GetSystemTime();
+  }
+  return !this->FreeRunStopRequested;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusDataCollector::LogDeviceTimings(const std::string& operationName, const DeviceTimingMap& timings, double totalDurationSec) const
+{
+  std::ostringstream report;
+  report << operationName << (this->ParallelDeviceConnect ? " (parallel)" : "") << " completed in "
+         << std::fixed << std::setprecision(3) << totalDurationSec << " sec.";
+  for (DeviceCollectionConstIterator it = Devices.begin(); it != Devices.end(); ++it)
+  {
+    DeviceTimingMap::const_iterator timingIt = timings.find((*it)->GetDeviceId());
+    if (timingIt != timings.end())
+    {
+      report << " " << (*it)->GetDeviceId() << ": " << timingIt->second.DurationSec << " sec.";
+    }
+  }
+  LOG_INFO(report.str());
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusDataCollector::GetDeviceConnectTiming(const std::string& deviceId, double& startTime, double& durationSec) const
+{
+  DeviceTimingMap::const_iterator timingIt = this->DeviceConnectTimings.find(deviceId);
+  if (timingIt == this->DeviceConnectTimings.end())
+  {
+    return PLUS_FAIL;
+  }
+  startTime = timingIt->second.StartTime;
+  durationSec = timingIt->second.DurationSec;
+  return PLUS_SUCCESS;
+}
+
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusDataCollector::Disconnect()
 {
   LOG_TRACE("vtkPlusDataCollector::Disconnect()");
 
+  // The replay thread adds frames to the devices, so it must be stopped first
+  this->StopFreeRunReplay();
+
   PlusStatus status = PLUS_SUCCESS;
 
   for (DeviceCollectionIterator it = Devices.begin(); it != Devices.end(); ++ it)
@@ -472,33 +1072,124 @@ bool vtkPlusDataCollector::GetConnected() const
 }
 
 //----------------------------------------------------------------------------
-PlusStatus vtkPlusDataCollector::DumpBuffersToDirectory(const char* aDirectory)
+PlusStatus vtkPlusDataCollector::DumpBuffersToDirectory(const char* aDirectory, bool useCompression /*= false*/, int maxNumberOfThreads /*= 0*/)
 {
-  LOG_TRACE("vtkPlusDataCollector::DumpBuffersToDirectory(" << aDirectory << ")");
+  LOG_TRACE("vtkPlusDataCollector::DumpBuffersToDirectory(" << (aDirectory ? aDirectory : "") << ")");
 
   // Assemble file names
   std::string dateAndTime = vtksys::SystemTools::GetCurrentDateTime("%Y%m%d_%H%M%S");
+  std::string outputDirectory = vtkPlusConfig::GetInstance()->GetOutputPath(aDirectory != NULL ? aDirectory : "");
 
+  BufferDumpTaskList taskList;
+  taskList.UseCompression = useCompression;
+  taskList.NextTaskIndex = 0;
+  taskList.NumberOfFinishedTasks = 0;
   for (DeviceCollectionIterator it = this->Devices.begin(); it != this->Devices.end(); ++it)
   {
     vtkPlusDevice* device = *it;
+    std::string fileNamePrefix = outputDirectory + "/BufferDump_" + device->GetDeviceId() + "_";
+    for (DataSourceContainerConstIterator sourceIt = device->GetVideoSourceIteratorBegin(); sourceIt != device->GetVideoSourceIteratorEnd(); ++sourceIt)
+    {
+      taskList.Tasks.emplace_back();
+      taskList.Tasks.back().Device = device;
+      taskList.Tasks.back().VideoSource = sourceIt->second;
+      taskList.Tasks.back().FileName = fileNamePrefix + sourceIt->second->GetId() + "_" + dateAndTime + ".nrrd";
+    }
+    if (device->GetNumberOfTools() > 0)
+    {
+      taskList.Tasks.emplace_back();
+      taskList.Tasks.back().Device = device;
+      taskList.Tasks.back().FileName = fileNamePrefix + "Tools_" + dateAndTime + ".nrrd";
+    }
+  }
+  if (taskList.Tasks.empty())
+  {
+    LOG_INFO("No buffers to dump");
+    return PLUS_SUCCESS;
+  }
 
-    std::string outputDeviceBufferSequenceFileName = vtkPlusConfig::GetInstance()->GetOutputPath(std::string("BufferDump_") + device->GetDeviceId() + "_" + dateAndTime + ".nrrd");
+  // Buffers are written in parallel (including compression), acquisition continues meanwhile
+  int numberOfThreads = (maxNumberOfThreads > 0 ? maxNumberOfThreads : vtkMultiThreader::GetGlobalDefaultNumberOfThreads());
+  numberOfThreads = std::max(1, std::min(numberOfThreads, static_cast<int>(taskList.Tasks.size())));
+  LOG_INFO("Dumping " << taskList.Tasks.size() << " buffers to " << outputDirectory << " using " << numberOfThreads << " threads");
 
-    LOG_INFO("Write device buffer to " << outputDeviceBufferSequenceFileName);
-    vtkPlusDataSource* aSource(NULL);
-    for (ChannelContainerIterator chanIt = device->GetOutputChannelsStart(); chanIt != device->GetOutputChannelsEnd(); ++chanIt)
+  const double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+  vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+  std::vector<int> threadIds;
+  for (int i = 0; i < numberOfThreads; ++i)
+  {
+    int threadId = threader->SpawnThread((vtkThreadFunctionType)&BufferDumpThread, &taskList);
+    if (threadId < 0)
     {
-      if ((*chanIt)->GetVideoSource(aSource) != PLUS_SUCCESS)
-      {
-        LOG_ERROR("Unable to retrieve the video source in the device.");
-        return PLUS_FAIL;
-      }
-      aSource->WriteToSequenceFile(outputDeviceBufferSequenceFileName.c_str(), false);
+      LOG_WARNING("Failed to create buffer dump thread.");
+      continue;
     }
+    threadIds.push_back(threadId);
+  }
+  if (threadIds.empty())
+  {
+    // write the buffers in this thread
+    vtkMultiThreader::ThreadInfo threadInfo;
+    threadInfo.UserData = &taskList;
+    BufferDumpThread(&threadInfo);
   }
 
-  return PLUS_SUCCESS;
+  // Report progress while the buffers are written
+  const double progressReportPeriodSec = 2.0;
+  double lastProgressReportTime = startTime;
+  while (taskList.NumberOfFinishedTasks < taskList.Tasks.size())
+  {
+    vtkIGSIOAccurateTimer::Delay(0.05);
+    double currentTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    if (currentTime - lastProgressReportTime < progressReportPeriodSec)
+    {
+      continue;
+    }
+    lastProgressReportTime = currentTime;
+    unsigned long long numberOfWrittenFrames = 0;
+    unsigned long long numberOfFramesToWrite = 0;
+    unsigned long long numberOfWrittenBytes = 0;
+    for (std::deque<BufferDumpTask>::const_iterator taskIt = taskList.Tasks.begin(); taskIt != taskList.Tasks.end(); ++taskIt)
+    {
+      numberOfWrittenFrames += taskIt->Writer->GetNumberOfFramesWritten();
+      numberOfFramesToWrite += taskIt->Writer->GetNumberOfFramesToWrite();
+      numberOfWrittenBytes += taskIt->Writer->GetNumberOfBytesWritten();
+    }
+    LOG_INFO("Dumping buffers: " << taskList.NumberOfFinishedTasks << "/" << taskList.Tasks.size() << " buffers, "
+             << numberOfWrittenFrames << "/" << numberOfFramesToWrite << " frames, " << std::fixed << std::setprecision(1)
+             << numberOfWrittenBytes / 1.0e6 << " MB (" << numberOfWrittenBytes / 1.0e6 / (currentTime - startTime) << " MB/s)");
+  }
+  for (std::vector<int>::iterator threadIt = threadIds.begin(); threadIt != threadIds.end(); ++threadIt)
+  {
+    threader->TerminateThread(*threadIt);
+  }
+
+  // Summary
+  const double durationSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTime;
+  PlusStatus status = PLUS_SUCCESS;
+  unsigned long long totalNumberOfFrames = 0;
+  unsigned long long totalNumberOfBytes = 0;
+  for (std::deque<BufferDumpTask>::const_iterator taskIt = taskList.Tasks.begin(); taskIt != taskList.Tasks.end(); ++taskIt)
+  {
+    if (taskIt->Status != PLUS_SUCCESS)
+    {
+      status = PLUS_FAIL;
+    }
+    totalNumberOfFrames += taskIt->Writer->GetNumberOfFramesWritten();
+    totalNumberOfBytes += taskIt->Writer->GetNumberOfBytesWritten();
+    std::ostringstream lostFrames;
+    if (taskIt->Writer->GetNumberOfLostFrames() > 0)
+    {
+      lostFrames << ", " << taskIt->Writer->GetNumberOfLostFrames() << " overwritten during the dump";
+    }
+    LOG_INFO("Buffer dump " << (taskIt->Status == PLUS_SUCCESS ? "written" : "FAILED") << ": " << taskIt->FileName
+             << " (" << taskIt->Writer->GetNumberOfFramesWritten() << " frames" << lostFrames.str() << ")");
+  }
+  LOG_INFO("Buffer dump completed in " << std::fixed << std::setprecision(3) << durationSec << " sec: " << totalNumberOfFrames << " frames, "
+           << std::setprecision(1) << totalNumberOfBytes / 1.0e6 << " MB of image data ("
+           << (durationSec > 0 ? totalNumberOfBytes / 1.0e6 / durationSec : 0.0) << " MB/s)");
+
+  return status;
 }
 
 //----------------------------------------------------------------------------
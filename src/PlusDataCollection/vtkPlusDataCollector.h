@@ -15,9 +15,15 @@ See License.txt for details.
 // VTK includes
 #include <vtkObject.h>
 
+// STL includes
+#include <atomic>
+#include <map>
+#include <vector>
+
 //class igsioTrackedFrame; 
 class vtkPlusChannel;
 class vtkPlusDeviceFactory;
+class vtkPlusSavedDataSource;
 //class vtkIGSIOTrackedFrameList;
 class vtkXMLDataElement;
 
@@ -27,6 +33,16 @@ class vtkXMLDataElement;
 
 Provides an interface for clients to connect to a device set, and request data to the currently active devices.
 
+Saved data sources with FreeRunEnabled are not paced by the wall clock. When the data collector is started, a replay
+thread adds their frames in batches, in the order of the original timestamps, so that all free-run sources stay
+synchronized. After each batch the thread waits until every device that uses the output of the free-run sources
+(directly or through other devices) has completed two updates, in the order of their dependencies. No frames are
+skipped if these devices process all the new items of their input buffers in each update. A batch contains at most
+half as many frames as the smallest output buffer of each source, therefore the replay speed is determined by the
+output buffer sizes and the acquisition rate and processing time of the consumer devices.
+If no such device is recording then there is nothing that would limit the replay speed, so the batches are added
+at the pace of the original timestamps instead, to avoid overwriting frames in the output buffers before they are read.
+
 \ingroup PlusLibDataCollection
 */
 class vtkPlusDataCollectionExport vtkPlusDataCollector : public vtkObject
@@ -68,7 +84,9 @@ public:
   PlusStatus Stop();
 
   /*!
-  Connect to device(s). Connection is needed for recording or single frame grabbing
+  Connect to device(s). Connection is needed for recording or single frame grabbing.
+  If ParallelDeviceConnect is enabled then devices are connected concurrently, each device
+  as soon as all the devices that provide its input channels are connected.
   */
   PlusStatus Connect();
 
@@ -113,11 +131,15 @@ public:
   DeviceCollectionConstIterator GetDeviceConstIteratorEnd() const;
 
   /*!
-    Have each device dump their buffers to disk
-    \param aDirectory directory to dump to
-    \param maxTimeLimitSec Maximum time spent in the function (in sec)
+    Have each device dump their buffers to disk. Each video buffer and the tool buffers of each device are written to
+    a separate file, by a pool of worker threads. Frames are copied from the buffers one at a time and written in small
+    chunks, so acquisition does not need to be stopped and memory usage does not grow with the buffer size.
+    Only the items that are in the buffers when the dump starts are written. Progress is logged periodically.
+    \param aDirectory directory to dump to (relative to the output directory), the output directory is used if NULL
+    \param useCompression compress the files (performed by the worker threads)
+    \param maxNumberOfThreads maximum number of worker threads, 0 means the number of CPU cores
   */
-  PlusStatus DumpBuffersToDirectory(const char* aDirectory);
+  PlusStatus DumpBuffersToDirectory(const char* aDirectory, bool useCompression = false, int maxNumberOfThreads = 0);
 
   /*!
     Get tracking data in a tracked frame list since time specified
@@ -154,13 +176,71 @@ public:
   /*! Get startup delay in sec to give some time to the buffers for proper initialization */
   vtkGetMacro(StartupDelaySec, double);
 
+  /*! Enable connecting and starting devices concurrently (only devices that do not depend on each other run at the same time) */
+  vtkSetMacro(ParallelDeviceConnect, bool);
+  vtkGetMacro(ParallelDeviceConnect, bool);
+  vtkBooleanMacro(ParallelDeviceConnect, bool);
+
+  /*!
+    Get the time when the last Connect call started connecting the device and how long it took
+    \param startTime System time (see vtkIGSIOAccurateTimer::GetSystemTime) when the connection was started
+  */
+  PlusStatus GetDeviceConnectTiming(const std::string& deviceId, double& startTime, double& durationSec) const;
+
+  /*! Returns true while saved data sources in free-run mode have frames left to replay (see vtkPlusSavedDataSource::FreeRunEnabled) */
+  bool IsFreeRunReplayActive() const;
+
 protected:
   vtkPlusDataCollector();
   virtual ~vtkPlusDataCollector();
 
+  enum DeviceOperationType
+  {
+    DEVICE_OPERATION_CONNECT,
+    DEVICE_OPERATION_START_RECORDING
+  };
+
+  struct DeviceTiming
+  {
+    DeviceTiming() : StartTime(0.0), DurationSec(0.0) {}
+    double StartTime;
+    double DurationSec;
+  };
+  typedef std::map<std::string, DeviceTiming> DeviceTimingMap;
+
+  /*! Connect or start all devices, serially in configuration order or in parallel (see ParallelDeviceConnect) */
+  PlusStatus ExecuteDeviceOperation(DeviceOperationType operation, DeviceTimingMap& timings);
+
+  /*! Find the devices that each device depends on (that provide its input channels). Fails if there is a circular dependency. */
+  PlusStatus GetDeviceDependencies(std::vector< std::vector<int> >& dependencies) const;
+
+  /*! Log the duration of the operation for each device */
+  void LogDeviceTimings(const std::string& operationName, const DeviceTimingMap& timings, double totalDurationSec) const;
+
+  /*! Find the free-run saved data sources and the devices that use their output, and start the replay thread */
+  PlusStatus StartFreeRunReplay();
+
+  /*! Stop the replay thread of the free-run saved data sources */
+  void StopFreeRunReplay();
+
+  static void* FreeRunReplayThread(vtkMultiThreader::ThreadInfo* data);
+  void RunFreeRunReplay();
+
+  /*! Wait until each consumer device has completed two updates. Returns false if the replay is stopped. */
+  bool WaitForFreeRunConsumers();
+
+  /*! Wait until the system time reaches the specified time. Returns false if the replay is stopped. */
+  bool WaitForFreeRunSystemTime(double systemTime);
+
   /*! The timestamp filtering methods require some time to initialize. Synchronization will ignore data that are acquired during startup delay. */
   double StartupDelaySec;
 
+  /*! If enabled then independent devices are connected and started concurrently */
+  bool ParallelDeviceConnect;
+
+  /*! Timing of the device connections in the last Connect call */
+  DeviceTimingMap DeviceConnectTimings;
+
   vtkSmartPointer<vtkPlusDeviceFactory> DeviceFactory;
 
   DeviceCollection Devices;
@@ -168,6 +248,17 @@ protected:
   bool Connected;
   bool Started;
 
+  /*! Saved data sources that are replayed by the free-run replay thread */
+  std::vector<vtkPlusSavedDataSource*> FreeRunSources;
+
+  /*! Devices that use the output of the free-run sources, each device is after its input devices */
+  std::vector<vtkPlusDevice*> FreeRunConsumers;
+
+  vtkSmartPointer<vtkMultiThreader> FreeRunThreader;
+  int FreeRunThreadId;
+  std::atomic<bool> FreeRunStopRequested;
+  std::atomic<bool> FreeRunReplayActive;
+
 private:
   vtkPlusDataCollector(const vtkPlusDataCollector&);
   void operator=(const vtkPlusDataCollector&);
@@ -579,6 +579,26 @@ PlusStatus vtkPlusDataSource::AddItem(void* imageDataPtr, const FrameSizeType& f
   return this->GetBuffer()->AddItem(imageDataPtr, frameSize, frameSizeInBytes, imageType, frameNumber, unfilteredTimestamp, filteredTimestamp, customFields);
 }
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusDataSource::ReserveItem(US_IMAGE_ORIENTATION usImageOrientation, const FrameSizeType& frameSizeInPx, igsioCommon::VTKScalarPixelType pixelType,
+    unsigned int numberOfScalarComponents, US_IMAGE_TYPE imageType, void*& frameDataPtr)
+{
+  return this->GetBuffer()->ReserveItem(usImageOrientation, frameSizeInPx, pixelType, numberOfScalarComponents, imageType,
+                                        this->ClipRectangleOrigin, this->ClipRectangleSize, frameDataPtr);
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusDataSource::CommitReservedItem(long frameNumber, double unfilteredTimestamp /*= UNDEFINED_TIMESTAMP*/, double filteredTimestamp /*= UNDEFINED_TIMESTAMP*/, const igsioFieldMapType* customFields /*= NULL*/)
+{
+  return this->GetBuffer()->CommitReservedItem(frameNumber, unfilteredTimestamp, filteredTimestamp, customFields);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusDataSource::CancelReservedItem()
+{
+  this->GetBuffer()->CancelReservedItem();
+}
+
 //-----------------------------------------------------------------------------
 US_IMAGE_TYPE vtkPlusDataSource::GetImageType()
 {
@@ -909,6 +929,12 @@ PlusStatus vtkPlusDataSource::WriteToSequenceFile(const char* filename, bool use
   return this->GetBuffer()->WriteToSequenceFile(filename, useCompression);
 }
 
+//-----------------------------------------------------------------------------
+PlusStatus vtkPlusDataSource::WriteToSequenceFile(vtkPlusSequenceStreamWriter* writer)
+{
+  return this->GetBuffer()->WriteToSequenceFile(writer);
+}
+
 //-----------------------------------------------------------------------------
 PlusStatus vtkPlusDataSource::DeepCopyBufferTo(vtkPlusBuffer& bufferToFill)
 {
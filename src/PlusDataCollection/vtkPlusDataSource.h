@@ -30,6 +30,7 @@
 */
 
 class vtkPlusBuffer;
+class vtkPlusSequenceStreamWriter;
 
 enum DataSourceType
 {
@@ -152,6 +153,9 @@ public:
   /*! Dump the current state of the video buffer to metafile */
   virtual PlusStatus WriteToSequenceFile(const char* filename, bool useCompression = false);
 
+  /*! Write the items that are currently in the buffer to an opened sequence file writer, see vtkPlusBuffer::WriteToSequenceFile */
+  virtual PlusStatus WriteToSequenceFile(vtkPlusSequenceStreamWriter* writer);
+
   /*! Get the table report of the timestamped buffer  */
   virtual PlusStatus GetTimeStampReportTable(vtkTable* timeStampReportTable);
 
@@ -253,6 +257,17 @@ public:
   */
   virtual PlusStatus AddItem(const igsioFieldMapType& customFields, long frameNumber, double unfilteredTimestamp = UNDEFINED_TIMESTAMP, double filteredTimestamp = UNDEFINED_TIMESTAMP);
 
+  /*!
+    Reserve the next frame of the buffer so that image data can be written into it directly, see vtkPlusBuffer::ReserveItem.
+    Fails if the clip rectangle or the image orientation requires the image to be modified before it is stored.
+  */
+  virtual PlusStatus ReserveItem(US_IMAGE_ORIENTATION usImageOrientation, const FrameSizeType& frameSizeInPx, igsioCommon::VTKScalarPixelType pixelType,
+                                 unsigned int numberOfScalarComponents, US_IMAGE_TYPE imageType, void*& frameDataPtr);
+  /*! Add the reserved frame to the buffer, see vtkPlusBuffer::CommitReservedItem */
+  virtual PlusStatus CommitReservedItem(long frameNumber, double unfilteredTimestamp = UNDEFINED_TIMESTAMP, double filteredTimestamp = UNDEFINED_TIMESTAMP, const igsioFieldMapType* customFields = NULL);
+  /*! Release the reserved frame without adding it to the buffer */
+  virtual void CancelReservedItem();
+
   /*!
   Add a matrix plus status to the list, with an exactly known timestamp value (e.g., provided by a high-precision hardware timer).
   If the timestamp is less than or equal to the previous timestamp, then nothing  will be done.
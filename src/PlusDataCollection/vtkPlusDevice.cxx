@@ -6,12 +6,13 @@ See License.txt for details.
 
 // Local includes
 #include "PlusConfigure.h"
+#include "PlusMetricsRegistry.h"
 #include "vtkPlusBuffer.h"
 #include "vtkPlusChannel.h"
 #include "vtkPlusDataSource.h"
 #include "vtkPlusDevice.h"
+#include "vtkPlusSequenceStreamWriter.h"
 #include "vtkIGSIORecursiveCriticalSection.h"
-#include "vtkPlusSequenceIO.h"
 #include "vtkIGSIOTrackedFrameList.h"
 
 // VTK includes
@@ -26,6 +27,8 @@ See License.txt for details.
 #include <vtksys/SystemTools.hxx>
 
 // STD includes
+#include <algorithm>
+#include <cmath>
 #include <set>
 
 // System includes
@@ -159,6 +162,15 @@ vtkPlusDevice::~vtkPlusDevice()
     Disconnect();
   }
 
+  // Capture timing histograms are owned by this device, they must not be published anymore
+  PlusMetricsRegistry::GetInstance()->UnregisterHistogram(&this->CaptureScheduler.GetUpdateDurationHistogram());
+  PlusMetricsRegistry::GetInstance()->UnregisterHistogram(&this->CaptureScheduler.GetWakeUpLatenessHistogram());
+  // Other metrics of this device (capture rate, overruns, device specific metrics) are not updated anymore
+  if (!this->DeviceId.empty())
+  {
+    PlusMetricsRegistry::GetInstance()->RemoveMetrics("device", this->DeviceId);
+  }
+
   for (ChannelContainerIterator it = this->OutputChannels.begin(); it != this->OutputChannels.end(); ++it)
   {
     (*it)->UnRegister(this);
@@ -610,6 +622,8 @@ void vtkPlusDevice::DeepCopy(const vtkPlusDevice& device)
   this->RequireImageOrientationInConfiguration = device.RequireImageOrientationInConfiguration;
   this->RequirePortNameInDeviceSetConfiguration = device.RequirePortNameInDeviceSetConfiguration;
   this->Parameters = device.Parameters;
+  this->CaptureScheduler.SetCpuAffinity(device.CaptureScheduler.GetCpuAffinity());
+  this->CaptureScheduler.SetRealTimePriority(device.CaptureScheduler.GetRealTimePriority());
   // Don't set data collector, because that will be done if the copied device is added to a data collector
 
   // VTK functions aren't const clean, this is necessary =/
@@ -687,6 +701,28 @@ bool vtkPlusDevice::IsRecording() const
   return (this->Recording != 0);
 }
 
+//----------------------------------------------------------------------------
+PlusCaptureScheduler& vtkPlusDevice::GetCaptureScheduler()
+{
+  return this->CaptureScheduler;
+}
+
+//----------------------------------------------------------------------------
+const PlusCaptureScheduler& vtkPlusDevice::GetCaptureScheduler() const
+{
+  return this->CaptureScheduler;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkPlusDevice::GetCaptureTimingReport() const
+{
+  if (!this->StartThreadForInternalUpdates)
+  {
+    return "Data capture thread is not used by this device";
+  }
+  return this->CaptureScheduler.GetStatisticsReport();
+}
+
 //----------------------------------------------------------------------------
 std::string vtkPlusDevice::GetDeviceId() const
 {
@@ -716,6 +752,29 @@ PlusStatus vtkPlusDevice::WriteToolsToSequenceFile(const std::string& filename,
 {
   LOCAL_LOG_TRACE("vtkPlusDevice::WriteToolsToSequenceFile: " << filename);
 
+  vtkSmartPointer<vtkPlusSequenceStreamWriter> writer = vtkSmartPointer<vtkPlusSequenceStreamWriter>::New();
+  if (writer->Open(filename, useCompression) != PLUS_SUCCESS)
+  {
+    LOCAL_LOG_ERROR("Failed to save tracked frames to sequence metafile!");
+    return PLUS_FAIL;
+  }
+  PlusStatus status = this->WriteToolsToSequenceFile(writer);
+  if (status != PLUS_SUCCESS && writer->GetNumberOfFramesWritten() == 0)
+  {
+    writer->Discard();
+    return PLUS_FAIL;
+  }
+  if (writer->Close() != PLUS_SUCCESS)
+  {
+    LOCAL_LOG_ERROR("Failed to save tracked frames to sequence metafile!");
+    return PLUS_FAIL;
+  }
+  return status;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusDevice::WriteToolsToSequenceFile(vtkPlusSequenceStreamWriter* writer)
+{
   if (this->GetNumberOfTools() == 0)
   {
     LOCAL_LOG_ERROR("Failed to write tracker to metafile - there are no active tools!");
@@ -732,29 +791,43 @@ PlusStatus vtkPlusDevice::WriteToolsToSequenceFile(const std::string& filename,
     }
   }
 
-  vtkSmartPointer<vtkIGSIOTrackedFrameList> trackedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
-
   PlusStatus status = PLUS_SUCCESS;
 
   // Get the first source
   vtkPlusDataSource* firstActiveTool = this->Tools.begin()->second;
 
+  // Only the items that are in the buffer now are written, items that are added meanwhile are ignored
+  const BufferItemUidType oldestUid = firstActiveTool->GetOldestItemUidInBuffer();
+  writer->SetNumberOfFramesToWrite(writer->GetNumberOfFramesToWrite() + std::max(0, numberOfItems));
+
+  unsigned long long numberOfLostFrames = 0;
   for (int i = 0 ; i < numberOfItems; i++)
   {
     // Create fake image
-    igsioTrackedFrame trackedFrame;
+    igsioTrackedFrame* trackedFrame = new igsioTrackedFrame;
     igsioVideoFrame videoFrame;
     FrameSizeType frameSize = {1, 1, 1};
     // Don't waste space, create a greyscale image
     videoFrame.AllocateFrame(frameSize, VTK_UNSIGNED_CHAR, 1);
-    trackedFrame.SetImageData(videoFrame);
+    trackedFrame->SetImageData(videoFrame);
 
     StreamBufferItem bufferItem;
-    BufferItemUidType uid = firstActiveTool->GetOldestItemUidInBuffer() + i;
+    BufferItemUidType uid = oldestUid + i;
 
-    if (firstActiveTool->GetStreamBufferItem(uid, &bufferItem) != ITEM_OK)
+    ItemStatus itemStatus = firstActiveTool->GetStreamBufferItem(uid, &bufferItem);
+    if (itemStatus != ITEM_OK)
     {
-      LOCAL_LOG_ERROR("Failed to get tracker buffer item with UID: " << uid);
+      if (itemStatus == ITEM_NOT_AVAILABLE_ANYMORE)
+      {
+        // acquisition is still running and the item has been overwritten since the write started
+        writer->AddLostFrame();
+        ++numberOfLostFrames;
+      }
+      else
+      {
+        LOCAL_LOG_ERROR("Failed to get tracker buffer item with UID: " << uid);
+      }
+      delete trackedFrame;
       continue;
     }
 
@@ -763,17 +836,17 @@ PlusStatus vtkPlusDevice::WriteToolsToSequenceFile(const std::string& filename,
     // Add main source timestamp
     std::ostringstream timestampFieldValue;
     timestampFieldValue << std::fixed << frameTimestamp;
-    trackedFrame.SetFrameField("Timestamp", timestampFieldValue.str());
+    trackedFrame->SetFrameField("Timestamp", timestampFieldValue.str());
 
     // Add main source unfiltered timestamp
     std::ostringstream unfilteredtimestampFieldValue;
     unfilteredtimestampFieldValue << std::fixed << bufferItem.GetUnfilteredTimestamp(firstActiveTool->GetLocalTimeOffsetSec());
-    trackedFrame.SetFrameField("UnfilteredTimestamp", unfilteredtimestampFieldValue.str());
+    trackedFrame->SetFrameField("UnfilteredTimestamp", unfilteredtimestampFieldValue.str());
 
     // Add main source frameNumber
     std::ostringstream frameNumberFieldValue;
     frameNumberFieldValue << std::fixed << bufferItem.GetIndex();
-    trackedFrame.SetFrameField("FrameNumber", frameNumberFieldValue.str());
+    trackedFrame->SetFrameField("FrameNumber", frameNumberFieldValue.str());
 
     // Add transforms
     for (DataSourceContainerConstIterator it = this->Tools.begin(); it != this->Tools.end(); ++it)
@@ -789,26 +862,28 @@ PlusStatus vtkPlusDevice::WriteToolsToSequenceFile(const std::string& filename,
       if (toolBufferItem.GetMatrix(toolMatrix) != PLUS_SUCCESS)
       {
         LOCAL_LOG_ERROR("Failed to get toolMatrix");
+        delete trackedFrame;
         return PLUS_FAIL;
       }
 
       igsioTransformName toolToTrackerTransform(it->second->GetId(), this->ToolReferenceFrameName);
-      trackedFrame.SetFrameTransform(toolToTrackerTransform, toolMatrix);
+      trackedFrame->SetFrameTransform(toolToTrackerTransform, toolMatrix);
 
       // Add source status
-      trackedFrame.SetFrameTransformStatus(toolToTrackerTransform, toolBufferItem.GetStatus());
+      trackedFrame->SetFrameTransformStatus(toolToTrackerTransform, toolBufferItem.GetStatus());
     }
 
-    // Add tracked frame to the list
-    // This is a debugging/test function, so the additional copying in AddTrackedFrame compared to TakeTrackedFrame is not relevant.
-    trackedFrameList->AddTrackedFrame(&trackedFrame);
+    // Add tracked frame to the file
+    if (writer->TakeTrackedFrame(trackedFrame) != PLUS_SUCCESS)
+    {
+      LOCAL_LOG_ERROR("Failed to write tracker buffer item with UID " << uid << " to sequence file " << writer->GetFileName());
+      return PLUS_FAIL;
+    }
   }
 
-  // Save tracked frames to metafile
-  if (vtkPlusSequenceIO::Write(filename, trackedFrameList, trackedFrameList->GetImageOrientation(), useCompression) != PLUS_SUCCESS)
+  if (numberOfLostFrames > 0)
   {
-    LOCAL_LOG_ERROR("Failed to save tracked frames to sequence metafile!");
-    return PLUS_FAIL;
+    LOCAL_LOG_WARNING(numberOfLostFrames << " tracker items were overwritten in the buffer before they could be written to " << writer->GetFileName());
   }
 
   return status;
@@ -1103,6 +1178,29 @@ PlusStatus vtkPlusDevice::ReadConfiguration(vtkXMLDataElement* rootXMLElement)
     LOCAL_LOG_DEBUG("Local time offset was not defined in device configuration");
   }
 
+  // Data capture thread placement
+  const char* captureCpuAffinity = deviceXMLElement->GetAttribute("CaptureCpuAffinity");
+  if (captureCpuAffinity != NULL)
+  {
+    std::vector<int> cpuIndices;
+    if (PlusCaptureScheduler::ParseCpuList(captureCpuAffinity, cpuIndices) != PLUS_SUCCESS)
+    {
+      LOCAL_LOG_ERROR("Invalid CaptureCpuAffinity attribute: \"" << captureCpuAffinity << "\". Expected a list of CPU indices, such as \"2,3\" or \"0-3\".");
+      return PLUS_FAIL;
+    }
+    this->CaptureScheduler.SetCpuAffinity(cpuIndices);
+  }
+  int captureThreadPriority = 0;
+  if (deviceXMLElement->GetScalarAttribute("CaptureThreadPriority", captureThreadPriority))
+  {
+    if (captureThreadPriority < 0)
+    {
+      LOCAL_LOG_ERROR("Invalid CaptureThreadPriority attribute: " << captureThreadPriority << ". Use 0 for default scheduling or a positive value for real-time priority.");
+      return PLUS_FAIL;
+    }
+    this->CaptureScheduler.SetRealTimePriority(captureThreadPriority);
+  }
+
   // Parameter reading
   XML_FIND_NESTED_ELEMENT_OPTIONAL(parametersElem, deviceXMLElement, vtkPlusDevice::PARAMETERS_XML_ELEMENT_TAG.c_str());
   if (parametersElem)
@@ -1201,6 +1299,15 @@ PlusStatus vtkPlusDevice::WriteConfiguration(vtkXMLDataElement* config)
     deviceDataElement->SetDoubleAttribute("LocalTimeOffsetSec", this->GetLocalTimeOffsetSec());
   }
 
+  if (!this->CaptureScheduler.GetCpuAffinity().empty())
+  {
+    deviceDataElement->SetAttribute("CaptureCpuAffinity", PlusCaptureScheduler::CpuListToString(this->CaptureScheduler.GetCpuAffinity()).c_str());
+  }
+  if (this->CaptureScheduler.GetRealTimePriority() > 0)
+  {
+    deviceDataElement->SetIntAttribute("CaptureThreadPriority", this->CaptureScheduler.GetRealTimePriority());
+  }
+
   // Parameters writing
   XML_FIND_NESTED_ELEMENT_CREATE_IF_MISSING(parameterList, deviceDataElement, PARAMETERS_XML_ELEMENT_TAG.c_str());
 
@@ -1336,6 +1443,7 @@ PlusStatus vtkPlusDevice::StopRecording()
     }
     this->ThreadId = -1;
     LOCAL_LOG_DEBUG("Internal update thread terminated");
+    LOCAL_LOG_DEBUG("Data capture timing:\n" << this->CaptureScheduler.GetStatisticsReport());
   }
 
   if (this->InternalStopRecording() != PLUS_SUCCESS)
@@ -1355,11 +1463,33 @@ void* vtkPlusDevice::vtkDataCaptureThread(vtkMultiThreader::ThreadInfo* data)
 {
   vtkPlusDevice* self = (vtkPlusDevice*)(data->UserData);
 
-  double rate = self->GetAcquisitionRate();
   double currtime[FRAME_RATE_AVERAGING] = {0};
   unsigned long updatecount = 0;
   self->ThreadAlive = true;
 
+  PlusCaptureScheduler& scheduler = self->CaptureScheduler;
+  scheduler.ConfigureCurrentThread(self->GetDeviceId());
+  scheduler.ResetStatistics();
+  // An invalid acquisition rate (e.g., 0) would result in an infinite period, keep the previous period instead
+  double acquisitionRate = self->GetAcquisitionRate();
+  if (acquisitionRate > 0 && std::isfinite(acquisitionRate))
+  {
+    scheduler.Start(1.0 / acquisitionRate);
+  }
+  else
+  {
+    LOG_WARNING(self->GetDeviceId() << ": invalid acquisition rate (" << acquisitionRate << " FPS), data capture period is " << scheduler.GetPeriodSec() << " sec");
+    scheduler.Start(scheduler.GetPeriodSec());
+  }
+
+  PlusMetricsRegistry* metrics = PlusMetricsRegistry::GetInstance();
+  PlusMetricsRegistry::LabelMap labels;
+  labels["device"] = self->GetDeviceId();
+  metrics->RegisterHistogram("plus_device_update_duration_seconds", labels, "Duration of InternalUpdate() calls in the data capture thread", &scheduler.GetUpdateDurationHistogram());
+  metrics->RegisterHistogram("plus_device_wakeup_lateness_seconds", labels, "Time between the capture deadline and the actual wake-up of the data capture thread", &scheduler.GetWakeUpLatenessHistogram());
+  PlusMetricsRegistry::Gauge* updateRateGauge = metrics->GetGauge("plus_device_internal_update_rate_hz", labels, "Measured rate of InternalUpdate() calls");
+  PlusMetricsRegistry::Gauge* overrunsGauge = metrics->GetGauge("plus_device_capture_overruns", labels, "Number of capture periods missed since recording started");
+
   while (self->IsRecording() && self->GetCorrectlyConfigured())
   {
     double newtime = vtkIGSIOAccurateTimer::GetSystemTime();
@@ -1369,6 +1499,10 @@ void* vtkPlusDevice::vtkDataCaptureThread(vtkMultiThreader::ThreadInfo* data)
     if (updatecount > FRAME_RATE_AVERAGING && difftime != 0)
     {
       self->InternalUpdateRate = (FRAME_RATE_AVERAGING / difftime);
+      if (updateRateGauge != NULL)
+      {
+        updateRateGauge->SetValue(self->InternalUpdateRate);
+      }
     }
 
     {
@@ -1379,14 +1513,22 @@ void* vtkPlusDevice::vtkDataCaptureThread(vtkMultiThreader::ThreadInfo* data)
         // recording has been stopped
         break;
       }
+      double updateStartTime = PlusCaptureScheduler::GetMonotonicTime();
       self->InternalUpdate();
+      scheduler.RecordUpdateDuration(PlusCaptureScheduler::GetMonotonicTime() - updateStartTime);
       self->UpdateTime.Modified();
     }
 
-    double delay = (newtime + 1.0 / rate - vtkIGSIOAccurateTimer::GetSystemTime());
-    if (delay > 0)
+    // Acquisition rate may be changed while recording
+    acquisitionRate = self->GetAcquisitionRate();
+    if (acquisitionRate > 0 && std::isfinite(acquisitionRate))
+    {
+      scheduler.SetPeriodSec(1.0 / acquisitionRate);
+    }
+    scheduler.WaitForNextDeadline();
+    if (overrunsGauge != NULL)
     {
-      vtkIGSIOAccurateTimer::Delay(delay);
+      overrunsGauge->SetValue(static_cast<double>(scheduler.GetNumberOfOverruns()));
     }
 
     updatecount++;
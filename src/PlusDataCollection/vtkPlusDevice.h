@@ -9,6 +9,7 @@ See License.txt for details.
 
 // Local includes
 #include "igsioCommon.h"
+#include "PlusCaptureScheduler.h"
 #include "PlusConfigure.h"
 #include "PlusStreamBufferItem.h"
 #include "vtkPlusChannel.h"
@@ -26,6 +27,7 @@ See License.txt for details.
 
 class vtkPlusBuffer;
 class vtkPlusDataCollector;
+class vtkPlusSequenceStreamWriter;
 class vtkPlusDataSource;
 class vtkPlusDevice;
 class vtkPlusHTMLGenerator;
@@ -156,6 +158,12 @@ public:
   /*! Dump the current state of the device to sequence file (with each tools and buffers) */
   virtual PlusStatus WriteToolsToSequenceFile(const std::string& filename, bool useCompression = false);
 
+  /*!
+    Write the items that are currently in the tool buffers to an opened sequence file writer.
+    Items are copied one at a time, so acquisition can continue while the file is written.
+  */
+  virtual PlusStatus WriteToolsToSequenceFile(vtkPlusSequenceStreamWriter* writer);
+
   /*! Make this device into a copy of another device. */
   void DeepCopy(const vtkPlusDevice& device);
 
@@ -297,6 +305,20 @@ public:
   /*! Get whether recording is underway */
   virtual bool IsRecording() const;
 
+  /*! Get whether InternalUpdate is called periodically from the data capture thread of the device while recording */
+  bool GetStartThreadForInternalUpdates() const;
+
+  /*!
+    Get the scheduler that paces the data capture thread. It provides live histograms of
+    InternalUpdate() duration and wake-up lateness, and holds the CPU affinity and real-time
+    priority settings (CaptureCpuAffinity and CaptureThreadPriority device attributes).
+  */
+  PlusCaptureScheduler& GetCaptureScheduler();
+  const PlusCaptureScheduler& GetCaptureScheduler() const;
+
+  /*! Get a human-readable summary of data capture thread timing statistics */
+  std::string GetCaptureTimingReport() const;
+
   /* Return the id of the device */
   virtual std::string GetDeviceId() const;
   // Set the device Id
@@ -516,7 +538,6 @@ protected:
   vtkSetMacro(CorrectlyConfigured, bool);
 
   vtkSetMacro(StartThreadForInternalUpdates, bool);
-  bool GetStartThreadForInternalUpdates() const;
 
   vtkSetMacro(RecordingStartTime, double);
   double GetRecordingStartTime() const;
@@ -541,6 +562,9 @@ protected:
   /*! Recording thread id */
   int ThreadId;
 
+  /*! Deadline scheduling, placement and timing statistics of the data capture thread */
+  PlusCaptureScheduler CaptureScheduler;
+
   ChannelContainer  OutputChannels;
   ChannelContainer  InputChannels;
 
@@ -77,6 +77,7 @@ See License.txt for details.
   #include "vtkPlusPhidgetSpatialTracker.h"
 #endif
 #include "vtkPlusFakeTracker.h"
+#include "vtkPlusFakeVideoSource.h"
 #include "vtkPlusChRoboticsTracker.h"
 #include "vtkPlusMicrochipTracker.h"
 #ifdef PLUS_USE_3dConnexion_TRACKER
@@ -273,6 +274,7 @@ vtkPlusDeviceFactory::vtkPlusDeviceFactory()
 #endif
 
   RegisterDevice("SavedDataSource", "vtkPlusSavedDataSource", (PointerToDevice)&vtkPlusSavedDataSource::New);
+  RegisterDevice("FakeVideo", "vtkPlusFakeVideoSource", (PointerToDevice)&vtkPlusFakeVideoSource::New);
   RegisterDevice("UsSimulator", "vtkPlusUsSimulatorVideoSource", (PointerToDevice)&vtkPlusUsSimulatorVideoSource::New);
   RegisterDevice("ImageProcessor", "vtkPlusImageProcessorVideoSource", (PointerToDevice)&vtkPlusImageProcessorVideoSource::New);
   RegisterDevice("GenericSerialDevice", "vtkPlusGenericSerialDevice", (PointerToDevice)&vtkPlusGenericSerialDevice::New);
@@ -99,6 +99,28 @@ PlusStatus vtkPlusTimestampedCircularBuffer::PrepareForNewItem(const double time
   return PLUS_SUCCESS;
 }
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusTimestampedCircularBuffer::ReserveNextItem(int& bufferIndex)
+{
+  igsioLockGuard< vtkPlusTimestampedCircularBuffer > bufferGuardedLock(this);
+
+  if (this->GetBufferSize() < 1)
+  {
+    LOG_ERROR("Cannot reserve item in an empty buffer");
+    return PLUS_FAIL;
+  }
+
+  // The item at the write pointer is the oldest one if the buffer is full.
+  // Readers compute the oldest valid UID from the number of items, so it is no longer accessible after this.
+  if (this->NumberOfItems >= this->GetBufferSize())
+  {
+    this->NumberOfItems = this->GetBufferSize() - 1;
+  }
+  bufferIndex = this->WritePointer;
+
+  return PLUS_SUCCESS;
+}
+
 //----------------------------------------------------------------------------
 // Sets the buffer size, and copies the maximum number of the most current old
 // frames and timestamps
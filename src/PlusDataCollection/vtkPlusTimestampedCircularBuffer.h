@@ -168,6 +168,13 @@ public:
 
   virtual PlusStatus PrepareForNewItem( const double timestamp, BufferItemUidType& newFrameUid, int& bufferIndex );
 
+  /*!
+    Get the index of the buffer item that the next PrepareForNewItem call will return and make that item inaccessible for readers,
+    so that it can be written without holding the buffer lock. If the buffer is full then the oldest item is discarded.
+    INTERNAL USE ONLY! Only the thread that adds items to the buffer may write the reserved item.
+  */
+  virtual PlusStatus ReserveNextItem( int& bufferIndex );
+
   /*!
     Create filtered and unfiltered timestamp for accurate timing of the buffer item.
     The timing may be inaccurate because the timestamp is attached to the item when Plus receives it
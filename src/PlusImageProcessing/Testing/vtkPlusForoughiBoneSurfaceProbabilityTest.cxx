@@ -0,0 +1,250 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+\file vtkPlusForoughiBoneSurfaceProbabilityTest.cxx
+\brief Compares the output of vtkPlusForoughiBoneSurfaceProbability to a direct implementation of the algorithm
+
+The reference computes the smoothing by a two dimensional convolution and the shadow value of each pixel by
+summing up all the weighted pixels below it, as described in the paper.
+*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusForoughiBoneSurfaceProbability.h"
+#include <vtkPlusSequenceIO.h>
+
+// VTK includes
+#include <vtkImageCast.h>
+#include <vtkImageData.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// IGSIO includes
+#include <igsioTrackedFrame.h>
+#include <vtkIGSIOTrackedFrameList.h>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  void Convolve(const std::vector<double>& input, const std::vector<double>& kernel, int kernelSize, int nx, int ny, std::vector<double>& output)
+  {
+    int r = kernelSize / 2;
+    output.assign(nx * ny, 0.0);
+    for (int y = 0; y < ny; ++y)
+    {
+      for (int x = 0; x < nx; ++x)
+      {
+        double sum = 0.0;
+        for (int ky = -r; ky <= r; ++ky)
+        {
+          for (int kx = -r; kx <= r; ++kx)
+          {
+            int ix = x - kx;
+            int iy = y - ky;
+            if (ix >= 0 && ix < nx && iy >= 0 && iy < ny)
+            {
+              sum += input[ix + iy * nx] * kernel[(kx + r) + (ky + r) * kernelSize];
+            }
+          }
+        }
+        output[x + y * nx] = sum;
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void Normalize(std::vector<double>& buffer, bool doInverse, double maxValue = 1.0)
+  {
+    double maxPixelValue = 0.0;
+    for (size_t i = 0; i < buffer.size(); ++i)
+    {
+      maxPixelValue = std::max(maxPixelValue, buffer[i]);
+    }
+    maxPixelValue /= maxValue;
+    for (size_t i = 0; i < buffer.size(); ++i)
+    {
+      buffer[i] = doInverse ? maxValue - buffer[i] / maxPixelValue : buffer[i] / maxPixelValue;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void ComputeReferenceBoneSurfaceProbability(vtkPlusForoughiBoneSurfaceProbability* filter, const std::vector<double>& input, int nx, int ny, std::vector<double>& output)
+  {
+    double smoothingSigma = filter->GetSmoothingSigma();
+    double shadowSigma = filter->GetShadowSigma();
+
+    int kernelSize = static_cast<int>(floor(smoothingSigma * 3)) * 2 + 1;
+    int r = kernelSize / 2;
+    std::vector<double> gaussianKernel(kernelSize * kernelSize);
+    for (int y = -r; y <= r; ++y)
+    {
+      for (int x = -r; x <= r; ++x)
+      {
+        gaussianKernel[(x + r) + (y + r) * kernelSize] = exp(-(x * x + y * y) / (2 * smoothingSigma * smoothingSigma));
+      }
+    }
+    double laplacianKernelValues[] = { 0, -1, 0, -1, 4, -1, 0, -1, 0 };
+    std::vector<double> laplacianKernel(laplacianKernelValues, laplacianKernelValues + 9);
+
+    std::vector<double> shadowModel(ny);
+    for (int i = 0; i < ny; ++i)
+    {
+      shadowModel[i] = (i < ny - 5) ? 1 - exp(-(i * i - 1) / (2 * shadowSigma * shadowSigma)) : 0.0;
+    }
+
+    std::vector<double> gaussian;
+    Convolve(input, gaussianKernel, kernelSize, nx, ny, gaussian);
+    Normalize(gaussian, false);
+    std::vector<double> laplacianOfGaussian;
+    Convolve(gaussian, laplacianKernel, 3, nx, ny, laplacianOfGaussian);
+
+    std::vector<double> reflectionNumber(nx * ny, 0.0);
+    std::vector<double> shadowValue(nx * ny, 0.0);
+    for (int y = 0; y < ny; ++y)
+    {
+      for (int x = 0; x < nx; ++x)
+      {
+        int pixelIdx = x + y * nx;
+        if (gaussian[pixelIdx] < filter->GetBoneThreshold() || pixelIdx <= filter->GetTransducerMargin() * nx)
+        {
+          continue;
+        }
+        double laplacian = 0.0;
+        if (!(x == nx - 1 || x == 0 || y == ny - 1 || y == 0) && laplacianOfGaussian[pixelIdx] > 0)
+        {
+          laplacian = laplacianOfGaussian[pixelIdx] / 0.005;
+        }
+        reflectionNumber[pixelIdx] = pow(gaussian[pixelIdx], filter->GetBlurredVSBLoG()) + laplacian;
+
+        double sumG = 0;
+        double sumGI = 0;
+        for (int i = y; i < ny; ++i)
+        {
+          sumG += shadowModel[i - y];
+          sumGI += shadowModel[i - y] * gaussian[x + i * nx];
+        }
+        shadowValue[pixelIdx] = sumGI / sumG;
+      }
+    }
+    Normalize(reflectionNumber, false);
+    Normalize(shadowValue, true);
+
+    output.resize(nx * ny);
+    for (int i = 0; i < nx * ny; ++i)
+    {
+      output[i] = pow(shadowValue[i], filter->GetShadowVSIntensity()) * reflectionNumber[i];
+    }
+    Normalize(output, false, 255);
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp = false;
+  std::string inputFileName;
+  int numberOfFramesToCompare = 3;
+  double tolerance = 1e-6;
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help");
+  args.AddArgument("--input-seq-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &inputFileName, "The filename for the input ultrasound sequence to process.");
+  args.AddArgument("--frames", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfFramesToCompare, "Number of frames to compare (default: 3)");
+  args.AddArgument("--tolerance", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &tolerance, "Maximum allowed pixel value difference (output range is 0-255, default: 1e-6)");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    LOG_ERROR("Problem parsing arguments");
+    LOG_INFO("Help: " << args.GetHelp());
+    exit(EXIT_FAILURE);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (printHelp)
+  {
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  if (inputFileName.empty())
+  {
+    LOG_ERROR("The argument --input-seq-file is required");
+    return EXIT_FAILURE;
+  }
+
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> trackedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  if (vtkPlusSequenceIO::Read(inputFileName, trackedFrameList) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to read sequence file: " << inputFileName);
+    return EXIT_FAILURE;
+  }
+
+  vtkSmartPointer<vtkImageCast> castToDouble = vtkSmartPointer<vtkImageCast>::New();
+  castToDouble->SetOutputScalarTypeToDouble();
+  vtkSmartPointer<vtkPlusForoughiBoneSurfaceProbability> boneSurfaceFilter = vtkSmartPointer<vtkPlusForoughiBoneSurfaceProbability>::New();
+  boneSurfaceFilter->SetInputConnection(castToDouble->GetOutputPort());
+
+  int numberOfFrames = std::min<int>(numberOfFramesToCompare, trackedFrameList->GetNumberOfTrackedFrames());
+  double maxDifference = 0.0;
+  double filterTimeSec = 0.0;
+  double referenceTimeSec = 0.0;
+  for (int frameIndex = 0; frameIndex < numberOfFrames; ++frameIndex)
+  {
+    castToDouble->SetInputData(trackedFrameList->GetTrackedFrame(frameIndex)->GetImageData()->GetImage());
+    castToDouble->Update();
+    vtkImageData* inputImage = castToDouble->GetOutput();
+    int* dims = inputImage->GetDimensions();
+    int nx = dims[0];
+    int ny = dims[1];
+    const double* inputPixels = static_cast<double*>(inputImage->GetScalarPointer());
+    std::vector<double> input(inputPixels, inputPixels + nx * ny);
+
+    double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+    boneSurfaceFilter->Update();
+    filterTimeSec += vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
+    const double* outputPixels = static_cast<double*>(boneSurfaceFilter->GetOutput()->GetScalarPointer());
+
+    std::vector<double> reference;
+    startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+    ComputeReferenceBoneSurfaceProbability(boneSurfaceFilter, input, nx, ny, reference);
+    referenceTimeSec += vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
+
+    for (int i = 0; i < nx * ny; ++i)
+    {
+      double difference = fabs(outputPixels[i] - reference[i]);
+      if (difference > maxDifference || difference != difference)
+      {
+        maxDifference = (difference != difference) ? VTK_DOUBLE_MAX : difference;
+      }
+    }
+  }
+
+  if (numberOfFrames == 0)
+  {
+    LOG_ERROR("No frames found in " << inputFileName);
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Average frame processing time: " << filterTimeSec / numberOfFrames * 1000.0 << " ms (reference implementation: "
+           << referenceTimeSec / numberOfFrames * 1000.0 << " ms)");
+  if (maxDifference > tolerance)
+  {
+    LOG_ERROR("Bone surface probability differs from the reference by " << maxDifference << " (tolerance: " << tolerance << ")");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,224 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+\file vtkPlusTrackedFrameProcessorBatchTest.cxx
+\brief Verifies that frame-parallel and streaming processing in vtkPlusTrackedFrameProcessor give the same result as serial processing
+
+A simple processor is run on a synthetic sequence one frame at a time, with multiple worker threads, and
+on a sequence file in chunks (vtkPlusTrackedFrameProcessor::ProcessSequenceFile). All outputs must be identical
+and in the same order as the input frames.
+*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusSequenceIO.h"
+#include "vtkPlusTrackedFrameProcessor.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// IGSIO includes
+#include <igsioTrackedFrame.h>
+#include <vtkIGSIOTrackedFrameList.h>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+  const int FRAME_SIZE_X = 64;
+  const int FRAME_SIZE_Y = 48;
+}
+
+//----------------------------------------------------------------------------
+/*! Test processor: each output pixel is the sum of the input pixel and its neighbors, modulo 256 */
+class vtkPlusTestTrackedFrameProcessor : public vtkPlusTrackedFrameProcessor
+{
+public:
+  static vtkPlusTestTrackedFrameProcessor* New();
+  vtkTypeMacro(vtkPlusTestTrackedFrameProcessor, vtkPlusTrackedFrameProcessor);
+
+  virtual const char* GetProcessorTypeName() { return "vtkPlusTestTrackedFrameProcessor"; };
+
+protected:
+  vtkPlusTestTrackedFrameProcessor() {}
+  virtual ~vtkPlusTestTrackedFrameProcessor() {}
+
+  virtual PlusStatus ProcessFrame(igsioTrackedFrame* inputFrame, igsioTrackedFrame* outputFrame)
+  {
+    vtkImageData* inputImage = inputFrame->GetImageData()->GetImage();
+    vtkImageData* outputImage = outputFrame->GetImageData()->GetImage();
+    int dims[3] = { 0, 0, 0 };
+    inputImage->GetDimensions(dims);
+    const unsigned char* inputPixels = static_cast<unsigned char*>(inputImage->GetScalarPointer());
+    unsigned char* outputPixels = static_cast<unsigned char*>(outputImage->GetScalarPointer());
+    for (int y = 0; y < dims[1]; ++y)
+    {
+      for (int x = 0; x < dims[0]; ++x)
+      {
+        int sum = 0;
+        for (int dy = -1; dy <= 1; ++dy)
+        {
+          for (int dx = -1; dx <= 1; ++dx)
+          {
+            int nx = std::min(std::max(x + dx, 0), dims[0] - 1);
+            int ny = std::min(std::max(y + dy, 0), dims[1] - 1);
+            sum += inputPixels[nx + ny * dims[0]];
+          }
+        }
+        outputPixels[x + y * dims[0]] = static_cast<unsigned char>(sum % 256);
+      }
+    }
+    return PLUS_SUCCESS;
+  }
+
+private:
+  vtkPlusTestTrackedFrameProcessor(const vtkPlusTestTrackedFrameProcessor&);  // Not implemented.
+  void operator=(const vtkPlusTestTrackedFrameProcessor&);  // Not implemented.
+};
+
+vtkStandardNewMacro(vtkPlusTestTrackedFrameProcessor);
+
+//----------------------------------------------------------------------------
+void CreateFrames(vtkIGSIOTrackedFrameList* frameList, int numberOfFrames)
+{
+  FrameSizeType frameSize = { FRAME_SIZE_X, FRAME_SIZE_Y, 1 };
+  for (int frameIndex = 0; frameIndex < numberOfFrames; ++frameIndex)
+  {
+    igsioTrackedFrame frame;
+    frame.GetImageData()->AllocateFrame(frameSize, VTK_UNSIGNED_CHAR, 1);
+    frame.GetImageData()->SetImageOrientation(US_IMG_ORIENT_MF);
+    frame.GetImageData()->SetImageType(US_IMG_BRIGHTNESS);
+    unsigned char* pixels = static_cast<unsigned char*>(frame.GetImageData()->GetScalarPointer());
+    for (int i = 0; i < FRAME_SIZE_X * FRAME_SIZE_Y; ++i)
+    {
+      pixels[i] = static_cast<unsigned char>((i * 7 + frameIndex * 13 + (i / FRAME_SIZE_X) * frameIndex) % 256);
+    }
+    frame.SetTimestamp(10.0 + frameIndex * 0.1);
+    frameList->AddTrackedFrame(&frame);
+  }
+}
+
+//----------------------------------------------------------------------------
+PlusStatus CompareFrames(vtkIGSIOTrackedFrameList* expectedFrames, vtkIGSIOTrackedFrameList* actualFrames, const std::string& description)
+{
+  if (expectedFrames->GetNumberOfTrackedFrames() != actualFrames->GetNumberOfTrackedFrames())
+  {
+    LOG_ERROR(description << ": number of frames differ (expected " << expectedFrames->GetNumberOfTrackedFrames() << ", actual " << actualFrames->GetNumberOfTrackedFrames() << ")");
+    return PLUS_FAIL;
+  }
+  for (unsigned int frameIndex = 0; frameIndex < expectedFrames->GetNumberOfTrackedFrames(); ++frameIndex)
+  {
+    igsioTrackedFrame* expectedFrame = expectedFrames->GetTrackedFrame(frameIndex);
+    igsioTrackedFrame* actualFrame = actualFrames->GetTrackedFrame(frameIndex);
+    if (fabs(expectedFrame->GetTimestamp() - actualFrame->GetTimestamp()) > 1e-6)
+    {
+      LOG_ERROR(description << ": frame " << frameIndex << " is out of order (timestamp expected " << expectedFrame->GetTimestamp() << ", actual " << actualFrame->GetTimestamp() << ")");
+      return PLUS_FAIL;
+    }
+    FrameSizeType expectedSize = expectedFrame->GetFrameSize();
+    FrameSizeType actualSize = actualFrame->GetFrameSize();
+    if (expectedSize[0] != actualSize[0] || expectedSize[1] != actualSize[1] || expectedSize[2] != actualSize[2]
+        || memcmp(expectedFrame->GetImageData()->GetScalarPointer(), actualFrame->GetImageData()->GetScalarPointer(), FRAME_SIZE_X * FRAME_SIZE_Y) != 0)
+    {
+      LOG_ERROR(description << ": image content of frame " << frameIndex << " differs");
+      return PLUS_FAIL;
+    }
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp = false;
+  int numberOfFrames = 37;
+  int numberOfWorkerThreads = 4;
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help");
+  args.AddArgument("--frames", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfFrames, "Number of frames in the test sequence (default: 37)");
+  args.AddArgument("--frame-threads", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfWorkerThreads, "Number of frames processed in parallel (default: 4)");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    LOG_ERROR("Problem parsing arguments");
+    LOG_INFO("Help: " << args.GetHelp());
+    exit(EXIT_FAILURE);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (printHelp)
+  {
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> inputFrames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  CreateFrames(inputFrames, numberOfFrames);
+
+  // Reference: frames processed one by one
+  vtkSmartPointer<vtkPlusTestTrackedFrameProcessor> serialProcessor = vtkSmartPointer<vtkPlusTestTrackedFrameProcessor>::New();
+  serialProcessor->SetInputFrames(inputFrames);
+  if (serialProcessor->Update() != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Serial processing failed");
+    return EXIT_FAILURE;
+  }
+
+  // Frames processed in parallel
+  vtkSmartPointer<vtkPlusTestTrackedFrameProcessor> parallelProcessor = vtkSmartPointer<vtkPlusTestTrackedFrameProcessor>::New();
+  parallelProcessor->SetNumberOfWorkerThreads(numberOfWorkerThreads);
+  parallelProcessor->SetInputFrames(inputFrames);
+  if (parallelProcessor->Update() != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Parallel processing failed");
+    return EXIT_FAILURE;
+  }
+  if (CompareFrames(serialProcessor->GetOutputFrames(), parallelProcessor->GetOutputFrames(), "Parallel processing") != PLUS_SUCCESS)
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Frames read, processed, and written in chunks
+  std::string inputFilePath = vtkPlusConfig::GetInstance()->GetOutputPath("vtkPlusTrackedFrameProcessorBatchTestInput.igs.mha");
+  std::string outputFilePath = vtkPlusConfig::GetInstance()->GetOutputPath("vtkPlusTrackedFrameProcessorBatchTestOutput.igs.mha");
+  if (vtkPlusSequenceIO::Write(inputFilePath, inputFrames, US_IMG_ORIENT_MF, false) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to write test input sequence: " << inputFilePath);
+    return EXIT_FAILURE;
+  }
+  vtkSmartPointer<vtkPlusTestTrackedFrameProcessor> streamingProcessor = vtkSmartPointer<vtkPlusTestTrackedFrameProcessor>::New();
+  streamingProcessor->SetNumberOfWorkerThreads(numberOfWorkerThreads);
+  streamingProcessor->SetMaxNumberOfFramesInMemory(10);
+  if (streamingProcessor->ProcessSequenceFile(inputFilePath, outputFilePath) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Streaming processing failed");
+    return EXIT_FAILURE;
+  }
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> streamingOutputFrames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  if (vtkPlusSequenceIO::Read(outputFilePath, streamingOutputFrames) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to read streaming processing output: " << outputFilePath);
+    return EXIT_FAILURE;
+  }
+  if (CompareFrames(serialProcessor->GetOutputFrames(), streamingOutputFrames, "Streaming processing") != PLUS_SUCCESS)
+  {
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully");
+  return EXIT_SUCCESS;
+}
@@ -12,12 +12,15 @@ See License.txt for details.
 #include "vtkImageData.h"
 #include "vtkMetaImageReader.h"
 #include "vtkMetaImageWriter.h"
-#include "vtkIGSIOSequenceIO.h"
+#include "vtkPlusSequenceIO.h"
 #include "vtkSmartPointer.h"
 #include "vtkIGSIOTrackedFrameList.h"
 #include "vtkXMLUtilities.h"
 #include "vtksys/CommandLineArguments.hxx"
 
+// STL includes
+#include <algorithm>
+
 //----------------------------------------------------------------------------
 int main(int argc, char** argv)
 {
@@ -26,6 +29,7 @@ int main(int argc, char** argv)
   std::string inputImgSeqFileName;
   std::string outputImgSeqFileName;
   std::string inputConfigFileName;
+  int numberOfThreads(0);
   int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
 
   vtksys::CommandLineArguments args;
@@ -33,6 +37,7 @@ int main(int argc, char** argv)
 
   args.AddArgument("--source-seq-file",vtksys::CommandLineArguments::EQUAL_ARGUMENT, &inputImgSeqFileName, "The ultrasound sequence to draw the scanlines on.");
   args.AddArgument("--output-seq-file",vtksys::CommandLineArguments::EQUAL_ARGUMENT, &outputImgSeqFileName, "The output ultrasound sequence with scanlines overlaid on the images.");
+  args.AddArgument("--threads", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfThreads, "Number of threads used for processing each frame (default: number of processors).");
   args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
   args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
 
@@ -61,7 +66,7 @@ int main(int argc, char** argv)
 
   // Read the image sequence
   vtkSmartPointer<vtkIGSIOTrackedFrameList> trackedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
-  if( vtkIGSIOSequenceIO::Read(inputImgSeqFileName, trackedFrameList) != PLUS_SUCCESS )
+  if( vtkPlusSequenceIO::Read(inputImgSeqFileName, trackedFrameList) != PLUS_SUCCESS )
   {
     LOG_ERROR("Unable to read sequence file: " << inputImgSeqFileName);
     exit(EXIT_FAILURE);
@@ -72,6 +77,10 @@ int main(int argc, char** argv)
 
   vtkSmartPointer<vtkPlusForoughiBoneSurfaceProbability> boneSurfaceFilter = vtkSmartPointer<vtkPlusForoughiBoneSurfaceProbability>::New();
   boneSurfaceFilter->SetInputConnection(castToDouble->GetOutputPort());
+  if (numberOfThreads > 0)
+  {
+    boneSurfaceFilter->SetNumberOfThreads(numberOfThreads);
+  }
   
   vtkSmartPointer<vtkImageCast> castToUnsignedChar = vtkSmartPointer<vtkImageCast>::New();
   castToUnsignedChar->SetOutputScalarTypeToUnsignedChar();
@@ -79,17 +88,28 @@ int main(int argc, char** argv)
 
   int numberOfFrames = trackedFrameList->GetNumberOfTrackedFrames();
   LOG_INFO("Processing "<<numberOfFrames<<" frames...");
+  double totalProcessingTimeSec = 0.0;
+  double maxProcessingTimeSec = 0.0;
   for (int frameIndex = 0; frameIndex < numberOfFrames; frameIndex++)
   {
-    TrackedFrame* frame = trackedFrameList->GetTrackedFrame(frameIndex);
+    igsioTrackedFrame* frame = trackedFrameList->GetTrackedFrame(frameIndex);
     vtkImageData* imageData = frame->GetImageData()->GetImage();
 
+    double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
     castToDouble->SetInputData(imageData);
     castToUnsignedChar->Update();
+    double processingTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
+    LOG_DEBUG("Frame " << frameIndex << " processed in " << processingTimeSec * 1000.0 << " ms");
+    totalProcessingTimeSec += processingTimeSec;
+    maxProcessingTimeSec = std::max(maxProcessingTimeSec, processingTimeSec);
 
     // Write back the processed output to the input trackedframelist
     frame->GetImageData()->DeepCopyFrom(castToUnsignedChar->GetOutput());
   }
+  if (numberOfFrames > 0)
+  {
+    LOG_INFO("Frame processing time: average " << totalProcessingTimeSec / numberOfFrames * 1000.0 << " ms, maximum " << maxProcessingTimeSec * 1000.0 << " ms");
+  }
 
   // Write the new TrackedFrameList to metafile
   LOG_INFO("Writing new sequence to file...");
@@ -102,7 +122,7 @@ int main(int argc, char** argv)
     }
     outputImgSeqFileName = inputImgSeqFileName + "-Bones.nrrd";
   }
-  if( vtkIGSIOSequenceIO::Write(outputImgSeqFileName, trackedFrameList) != PLUS_SUCCESS )
+  if( vtkPlusSequenceIO::Write(outputImgSeqFileName, trackedFrameList) != PLUS_SUCCESS )
   {
     LOG_ERROR("Failed to save output volume to " << outputImgSeqFileName); 
     return EXIT_FAILURE;
@@ -12,6 +12,41 @@
 #include "vtksys/CommandLineArguments.hxx"
 
 #include "string"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  /*! Returns the number of frames with different image contents */
+  int CompareOutputFrames(vtkIGSIOTrackedFrameList* expectedFrames, vtkIGSIOTrackedFrameList* actualFrames)
+  {
+    if (expectedFrames->GetNumberOfTrackedFrames() != actualFrames->GetNumberOfTrackedFrames())
+    {
+      LOG_ERROR("Number of output frames differ: " << expectedFrames->GetNumberOfTrackedFrames() << " vs. " << actualFrames->GetNumberOfTrackedFrames());
+      return std::max(expectedFrames->GetNumberOfTrackedFrames(), actualFrames->GetNumberOfTrackedFrames());
+    }
+    int numberOfDifferentFrames = 0;
+    for (unsigned int frameIndex = 0; frameIndex < expectedFrames->GetNumberOfTrackedFrames(); ++frameIndex)
+    {
+      vtkImageData* expectedImage = expectedFrames->GetTrackedFrame(frameIndex)->GetImageData()->GetImage();
+      vtkImageData* actualImage = actualFrames->GetTrackedFrame(frameIndex)->GetImageData()->GetImage();
+      int expectedDims[3] = { 0, 0, 0 };
+      int actualDims[3] = { 0, 0, 0 };
+      expectedImage->GetDimensions(expectedDims);
+      actualImage->GetDimensions(actualDims);
+      size_t imageSizeBytes = static_cast<size_t>(expectedImage->GetNumberOfPoints()) * expectedImage->GetScalarSize() * expectedImage->GetNumberOfScalarComponents();
+      if (!std::equal(expectedDims, expectedDims + 3, actualDims) || expectedImage->GetScalarType() != actualImage->GetScalarType()
+          || expectedImage->GetNumberOfScalarComponents() != actualImage->GetNumberOfScalarComponents()
+          || memcmp(expectedImage->GetScalarPointer(), actualImage->GetScalarPointer(), imageSizeBytes) != 0)
+      {
+        LOG_DEBUG("Output frame " << frameIndex << " differs");
+        numberOfDifferentFrames++;
+      }
+    }
+    return numberOfDifferentFrames;
+  }
+}
 
 int main(int argc, char **argv)
 {
@@ -22,6 +57,10 @@ int main(int argc, char **argv)
   std::string outputFileName;
   std::string configFileName;
   bool saveIntermediateResults = false;
+  bool benchmark = false;
+  int numberOfWorkerThreads = 1;
+  int maxNumberOfFramesInMemory = 50;
+  bool streaming = false;
   int verboseLevel=vtkPlusLogger::LOG_LEVEL_UNDEFINED;
 
   args.Initialize(argc, argv);
@@ -30,6 +69,10 @@ int main(int argc, char **argv)
   args.AddArgument("--config-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &configFileName, "The filename for input config file.");
   args.AddArgument("--output-seq-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &outputFileName, "The filename to write the processed sequence to.");
   args.AddArgument("--save-intermediate-images", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &saveIntermediateResults, "If intermediate images should be saved to output files");
+  args.AddArgument("--benchmark", vtksys::CommandLineArguments::NO_ARGUMENT, &benchmark, "Process the sequence with the VTK filter pipeline and with the fused processing, report frame rates and verify that the outputs are identical");
+  args.AddArgument("--frame-threads", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfWorkerThreads, "Number of frames processed in parallel (default: 1)");
+  args.AddArgument("--streaming", vtksys::CommandLineArguments::NO_ARGUMENT, &streaming, "Read, process, and write the sequence in chunks instead of loading the whole sequence into memory");
+  args.AddArgument("--max-frames-in-memory", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &maxNumberOfFramesInMemory, "Maximum number of input frames kept in memory in streaming mode (default: 50)");
   args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
 
   if (!args.Parse())
@@ -102,6 +145,27 @@ int main(int argc, char **argv)
     return PLUS_FAIL;
   }
 
+  if (streaming)
+  {
+    if (benchmark || saveIntermediateResults)
+    {
+      LOG_WARNING("Benchmarking and saving of intermediate images are not available in streaming mode");
+    }
+    vtkSmartPointer<vtkPlusTransverseProcessEnhancer> boneFilter = vtkSmartPointer<vtkPlusTransverseProcessEnhancer>::New();
+    boneFilter->ReadConfiguration(processorElement);
+    boneFilter->SetSaveIntermediateResults(false);
+    boneFilter->SetNumberOfWorkerThreads(numberOfWorkerThreads);
+    boneFilter->SetMaxNumberOfFramesInMemory(maxNumberOfFramesInMemory);
+    double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+    if (boneFilter->ProcessSequenceFile(inputFileName, outputFileName) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed processing sequence file " << inputFileName);
+      return EXIT_FAILURE;
+    }
+    LOG_INFO("Processing completed in " << vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec << " sec");
+    return EXIT_SUCCESS;
+  }
+
   // Read the input sequence.
 
   vtkSmartPointer<vtkIGSIOTrackedFrameList> trackedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
@@ -120,14 +184,59 @@ int main(int argc, char **argv)
   
   boneFilter->SetInputFrames(trackedFrameList);
   boneFilter->ReadConfiguration(processorElement);
+  boneFilter->SetNumberOfWorkerThreads(numberOfWorkerThreads);
+
+  vtkSmartPointer<vtkPlusTransverseProcessEnhancer> referenceFilter;
+  double referenceProcessingTimeSec = 0.0;
+  if (benchmark)
+  {
+    if (saveIntermediateResults)
+    {
+      LOG_WARNING("Intermediate images are not saved in benchmark mode");
+      saveIntermediateResults = false;
+    }
+    boneFilter->SetSaveIntermediateResults(false);
+    boneFilter->SetFusedProcessing(true);
+
+    // Process the sequence with the VTK filter pipeline, for reference
+    referenceFilter = vtkSmartPointer<vtkPlusTransverseProcessEnhancer>::New();
+    referenceFilter->SetInputFrames(trackedFrameList);
+    referenceFilter->ReadConfiguration(processorElement);
+    referenceFilter->SetSaveIntermediateResults(false);
+    referenceFilter->SetFusedProcessing(false);
+    double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+    if (referenceFilter->Update() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed processing frames with the VTK filter pipeline");
+      return EXIT_FAILURE;
+    }
+    referenceProcessingTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
+  }
 
+  double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
   PlusStatus filterStatus = boneFilter->Update();
+  double processingTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
   if (filterStatus != PlusStatus::PLUS_SUCCESS)
   {
     LOG_ERROR("Failed processing frames");
     return EXIT_FAILURE;
   }
 
+  if (benchmark && numberOfFrames > 0)
+  {
+    double referenceFps = numberOfFrames / std::max(referenceProcessingTimeSec, 1e-6);
+    double fusedFps = numberOfFrames / std::max(processingTimeSec, 1e-6);
+    LOG_INFO("VTK filter pipeline: " << referenceFps << " frames/sec");
+    LOG_INFO("Fused processing (" << boneFilter->GetNumberOfThreads() << " threads, " << boneFilter->GetNumberOfWorkerThreads() << " frames in parallel): " << fusedFps << " frames/sec");
+    LOG_INFO("Speedup: " << fusedFps / referenceFps);
+    int numberOfDifferentFrames = CompareOutputFrames(referenceFilter->GetOutputFrames(), boneFilter->GetOutputFrames());
+    if (numberOfDifferentFrames > 0)
+    {
+      LOG_ERROR("Fused processing output differs from the VTK filter pipeline output in " << numberOfDifferentFrames << " frames");
+      return EXIT_FAILURE;
+    }
+  }
+
   LOG_INFO("Writing output to file");
 
   if (saveIntermediateResults)
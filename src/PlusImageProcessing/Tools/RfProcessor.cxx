@@ -28,6 +28,7 @@ int main(int argc, char **argv)
   std::string outputImgFile;
   std::string operation="BRIGHTNESS_SCAN_CONVERT";
   bool useCompression(true);
+  bool benchmark(false);
 
   int verboseLevel=vtkPlusLogger::LOG_LEVEL_UNDEFINED;
 
@@ -40,6 +41,7 @@ int main(int argc, char **argv)
   args.AddArgument("--output-img-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &outputImgFile, "File name of the generated output brightness image");
   args.AddArgument("--use-compression", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &useCompression, "Use compression when outputting data");
   args.AddArgument("--operation", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &operation, "Processing operation to be applied on the input file (BRIGHTNESS_CONVERT, BRIGHTNESS_SCAN_CONVERT, default: BRIGHTNESS_SCAN_CONVERT");
+  args.AddArgument("--benchmark", vtksys::CommandLineArguments::NO_ARGUMENT, &benchmark, "Compute BRIGHTNESS_SCAN_CONVERT output both by the fused processing and by the separate brightness and scan conversion filters, report the processing times and fail if the results differ. The output file contains the result of the filters.");
   args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
 
 
@@ -139,6 +141,23 @@ int main(int argc, char **argv)
       exit(EXIT_FAILURE); 
     }
 
+    vtkSmartPointer<vtkPlusRfProcessor> fusedRfProcessor;
+    if (benchmark)
+    {
+      // the same processing parameters, but brightness and scan conversion is computed in one pass
+      fusedRfProcessor = vtkSmartPointer<vtkPlusRfProcessor>::New();
+      if ( fusedRfProcessor->ReadConfiguration(rfProcesingElement) != PLUS_SUCCESS )
+      {
+        LOG_ERROR("Failed to read conversion parameters from the configuration file"); 
+        exit(EXIT_FAILURE); 
+      }
+      fusedRfProcessor->FusedProcessingOn();
+      rfProcessor->FusedProcessingOff();
+    }
+    double referenceProcessingTimeSec = 0.0;
+    double fusedProcessingTimeSec = 0.0;
+    int numberOfMismatchingFrames = 0;
+
     // Process the frames
     for (unsigned int j = 0; j < frameList->GetNumberOfTrackedFrames(); j++)
     {
@@ -158,7 +177,30 @@ int main(int argc, char **argv)
       else if (STRCASECMP(operation.c_str(),"BRIGHTNESS_SCAN_CONVERT")==0)
       {
         // do brightness and scan conversion
+        vtkImageData* fusedBrightnessImage = NULL;
+        if (benchmark)
+        {
+          fusedRfProcessor->SetRfFrame(rfFrame->GetImageData()->GetImage(), rfFrame->GetImageData()->GetImageType());
+          double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+          fusedBrightnessImage = fusedRfProcessor->GetBrightnessScanConvertedImage();
+          fusedProcessingTimeSec += vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
+        }
+        double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
         vtkImageData* brightnessImage = rfProcessor->GetBrightnessScanConvertedImage();
+        referenceProcessingTimeSec += vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
+        if (benchmark)
+        {
+          int* dims = brightnessImage->GetDimensions();
+          int* fusedDims = fusedBrightnessImage->GetDimensions();
+          if (dims[0] != fusedDims[0] || dims[1] != fusedDims[1] || dims[2] != fusedDims[2]
+              || brightnessImage->GetScalarType() != fusedBrightnessImage->GetScalarType()
+              || memcmp(brightnessImage->GetScalarPointer(), fusedBrightnessImage->GetScalarPointer(),
+                        brightnessImage->GetNumberOfPoints() * brightnessImage->GetScalarSize() * brightnessImage->GetNumberOfScalarComponents()) != 0)
+          {
+            LOG_ERROR("Fused processing result differs from the brightness and scan conversion filter result in frame " << j);
+            numberOfMismatchingFrames++;
+          }
+        }
         // Update the pixel data in the frame
         rfFrame->GetImageData()->DeepCopyFrom(brightnessImage);    
         rfFrame->GetImageData()->SetImageOrientation(US_IMG_ORIENT_MF); 
@@ -171,6 +213,18 @@ int main(int argc, char **argv)
       }
     }
 
+    if (benchmark && frameList->GetNumberOfTrackedFrames() > 0)
+    {
+      double numberOfFrames = frameList->GetNumberOfTrackedFrames();
+      LOG_INFO("Brightness and scan conversion filters: " << std::fixed << std::setprecision(2) << numberOfFrames / referenceProcessingTimeSec << " fps, "
+               << "fused processing: " << numberOfFrames / fusedProcessingTimeSec << " fps, "
+               << "speedup: " << referenceProcessingTimeSec / fusedProcessingTimeSec);
+    }
+    if (numberOfMismatchingFrames > 0)
+    {
+      exit(EXIT_FAILURE);
+    }
+
     std::ostringstream ss;
     std::string path = vtksys::SystemTools::GetFilenamePath(outputImgFile);
     if( !path.empty() )
@@ -19,18 +19,45 @@ See License.txt for details.
 #include <vtkImageSobel2D.h>
 #include <vtkImageThreshold.h>
 #include <vtkObjectFactory.h>
+#include <vtkPointData.h>
 #include "vtkImageAlgorithm.h"
 
 #include <igsioTrackedFrame.h>
 #include <igsioVideoFrame.h>
 #include <vtkIGSIOTrackedFrameList.h>
 
-
+// STL includes
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkPlusBoneEnhancer);
 
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Copy image contents without reallocating the destination if it already has the right size
+  void CopyImageScalars(vtkImageData* source, vtkImageData* destination)
+  {
+    int* sourceExtent = source->GetExtent();
+    int* destinationExtent = destination->GetExtent();
+    if (source->GetPointData()->GetScalars() == NULL || destination->GetPointData()->GetScalars() == NULL
+        || !std::equal(sourceExtent, sourceExtent + 6, destinationExtent)
+        || source->GetScalarType() != destination->GetScalarType()
+        || source->GetNumberOfScalarComponents() != destination->GetNumberOfScalarComponents())
+    {
+      destination->DeepCopy(source);
+      return;
+    }
+    memcpy(destination->GetScalarPointer(), source->GetScalarPointer(),
+           source->GetNumberOfPoints() * source->GetScalarSize() * source->GetNumberOfScalarComponents());
+    destination->SetSpacing(source->GetSpacing());
+    destination->SetOrigin(source->GetOrigin());
+    destination->Modified();
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkPlusBoneEnhancer::vtkPlusBoneEnhancer()
 : ScanConverter(NULL),
@@ -59,7 +86,14 @@ vtkPlusBoneEnhancer::vtkPlusBoneEnhancer()
   ProcessedLinesImage(NULL),
   FirstFrame(true),
 
-  SaveIntermediateResults(false)
+  SaveIntermediateResults(false),
+
+  FusedProcessing(true),
+  NumberOfThreads(vtkMultiThreader::GetGlobalDefaultNumberOfThreads()),
+  CurrentFusedStep(STEP_FILL_LINES),
+  FusedStepInput(NULL),
+  FusedStepOutput(NULL),
+  FusedStepNumberOfThreads(1)
 {
 
   this->GaussianSmooth = vtkSmartPointer<vtkImageGaussianSmooth>::New();    // Used to smooth the image
@@ -104,6 +138,21 @@ vtkPlusBoneEnhancer::vtkPlusBoneEnhancer()
   this->LinesImage->SetExtent(0, 0, 0, 0, 0, 0);
   this->ProcessedLinesImage->SetExtent(0, 0, 0, 0, 0, 0);
 
+  this->WorkImage = vtkSmartPointer<vtkImageData>::New();
+  this->FanImage = vtkSmartPointer<vtkImageData>::New();
+  this->Threader = vtkSmartPointer<vtkMultiThreader>::New();
+
+  for (int i = 0; i < 6; ++i)
+  {
+    this->LineSampleOffsetsInputExtent[i] = 0;
+  }
+  for (int i = 0; i < 6; ++i)
+  {
+    this->GaussianKernelTableParameters[i] = -1;
+  }
+  this->FusedImageDimensions[0] = 0;
+  this->FusedImageDimensions[1] = 0;
+
   this->IntermediateImageMap.clear();
 }
 
@@ -119,12 +168,21 @@ vtkPlusBoneEnhancer::~vtkPlusBoneEnhancer()
 void vtkPlusBoneEnhancer::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "FusedProcessing: " << (this->FusedProcessing ? "true" : "false") << std::endl;
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << std::endl;
 }
 
 //----------------------------------------------------------------------------
-PlusStatus vtkPlusBoneEnhancer::ReadConfiguration(vtkSmartPointer<vtkXMLDataElement> processingElement)
+PlusStatus vtkPlusBoneEnhancer::ReadConfiguration(vtkXMLDataElement* processingElement)
 {
   XML_VERIFY_ELEMENT(processingElement, this->GetTagName());
+  if (this->Superclass::ReadConfiguration(processingElement) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+
+  XML_READ_BOOL_ATTRIBUTE_OPTIONAL(FusedProcessing, processingElement);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, NumberOfThreads, processingElement);
 
   //Read things in the ScanConversion tag
   vtkSmartPointer<vtkXMLDataElement> scanConversionElement = processingElement->FindNestedElementWithName("ScanConversion");
@@ -243,12 +301,15 @@ PlusStatus vtkPlusBoneEnhancer::ReadConfiguration(vtkSmartPointer<vtkXMLDataElem
   int rfImageExtent[6] = { 0, this->NumberOfSamplesPerScanLine - 1, 0, this->NumberOfScanLines - 1, 0, 0 };
   this->ScanConverter->SetInputImageExtent(rfImageExtent);
 
+  // Scan line geometry may have changed
+  this->LineSampleOffsets.clear();
+
   return PLUS_SUCCESS;
 }
 
 //----------------------------------------------------------------------------
 // Writes the parameters that were used to a config file
-PlusStatus vtkPlusBoneEnhancer::WriteConfiguration(vtkSmartPointer<vtkXMLDataElement> processingElement)
+PlusStatus vtkPlusBoneEnhancer::WriteConfiguration(vtkXMLDataElement* processingElement)
 {
   XML_VERIFY_ELEMENT(processingElement, this->GetTagName());
 
@@ -256,6 +317,7 @@ PlusStatus vtkPlusBoneEnhancer::WriteConfiguration(vtkSmartPointer<vtkXMLDataEle
   processingElement->SetAttribute("Type", this->GetProcessorTypeName());
   processingElement->SetIntAttribute("NumberOfScanLines", NumberOfScanLines);
   processingElement->SetIntAttribute("NumberOfSamplesPerScanLine", NumberOfSamplesPerScanLine);
+  XML_WRITE_BOOL_ATTRIBUTE(FusedProcessing, processingElement);
 
   XML_FIND_NESTED_ELEMENT_CREATE_IF_MISSING(scanConversionElement, processingElement, "ScanConversion");
   this->ScanConverter->WriteConfiguration(scanConversionElement);
@@ -286,6 +348,19 @@ PlusStatus vtkPlusBoneEnhancer::WriteConfiguration(vtkSmartPointer<vtkXMLDataEle
   return PLUS_SUCCESS;
 }
 
+//----------------------------------------------------------------------------
+vtkPlusTrackedFrameProcessor* vtkPlusBoneEnhancer::CreateWorkerProcessor()
+{
+  vtkPlusBoneEnhancer* worker = vtkPlusBoneEnhancer::SafeDownCast(this->Superclass::CreateWorkerProcessor());
+  if (worker == NULL)
+  {
+    return NULL;
+  }
+  // Frames are processed in parallel, use only this worker's share of the threads
+  worker->SetNumberOfThreads(std::max(1, this->NumberOfThreads / this->NumberOfWorkerThreads));
+  return worker;
+}
+
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusBoneEnhancer::ProcessImageExtents()
 {
@@ -303,10 +378,25 @@ PlusStatus vtkPlusBoneEnhancer::ProcessImageExtents()
   this->LinesImage->SetExtent(linesImageExtent);
   this->LinesImage->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
 
+  this->WorkImage->SetExtent(linesImageExtent);
+  this->WorkImage->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+
+  this->ProcessedLinesImage->SetExtent(linesImageExtent);
+  this->ProcessedLinesImage->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+
   //Set up variables related to image extents
   int dims[3] = { 0, 0, 0 };
   this->LinesImage->GetDimensions(dims);
 
+  // Buffers of the fused processing
+  this->FusedImageDimensions[0] = dims[0];
+  this->FusedImageDimensions[1] = dims[1];
+  this->FusedBufferA.resize(dims[0] * dims[1]);
+  this->FusedBufferB.resize(dims[0] * dims[1]);
+  this->IslandVisited.resize(dims[0] * dims[1]);
+  this->IslandPixels.resize(dims[0] * dims[1]);
+  this->LineSampleOffsets.clear();
+
   return PLUS_SUCCESS;
 }
 
@@ -319,6 +409,48 @@ void vtkPlusBoneEnhancer::FillLinesImage(vtkSmartPointer<vtkImageData> inputImag
   int lineLengthPx = linesImageExtent[1] - linesImageExtent[0] + 1;
   int numScanLines = linesImageExtent[3] - linesImageExtent[2] + 1;
 
+  if (this->FusedProcessing && inputImageData->GetScalarType() == VTK_UNSIGNED_CHAR && inputImageData->GetNumberOfScalarComponents() == 1
+      && lineLengthPx == this->FusedImageDimensions[0] && numScanLines == this->FusedImageDimensions[1])
+  {
+    // Sample positions only depend on the scan line geometry and the input image extent, so they are computed only once
+    int* inputExtent = inputImageData->GetExtent();
+    if (this->LineSampleOffsets.empty() || !std::equal(inputExtent, inputExtent + 6, this->LineSampleOffsetsInputExtent))
+    {
+      int inputDimX = inputExtent[1] - inputExtent[0] + 1;
+      this->LineSampleOffsets.resize(lineLengthPx * numScanLines);
+      for (int scanLine = 0; scanLine < numScanLines; ++scanLine)
+      {
+        double start[4] = { 0, 0, 0, 0 };
+        double end[4] = { 0, 0, 0, 0 };
+        ScanConverter->GetScanLineEndPoints(scanLine, start, end);
+
+        double directionVectorX = static_cast<double>(end[0] - start[0]) / (lineLengthPx - 1);
+        double directionVectorY = static_cast<double>(end[1] - start[1]) / (lineLengthPx - 1);
+        for (int pointIndex = 0; pointIndex < lineLengthPx; ++pointIndex)
+        {
+          int pixelCoordX = start[0] + directionVectorX * pointIndex;
+          int pixelCoordY = start[1] + directionVectorY * pointIndex;
+          if (pixelCoordX < inputExtent[0] || pixelCoordX > inputExtent[1]
+              || pixelCoordY < inputExtent[2] || pixelCoordY > inputExtent[3])
+          {
+            this->LineSampleOffsets[pointIndex + scanLine * lineLengthPx] = -1;
+          }
+          else
+          {
+            this->LineSampleOffsets[pointIndex + scanLine * lineLengthPx] = (pixelCoordX - inputExtent[0]) + (pixelCoordY - inputExtent[2]) * inputDimX;
+          }
+        }
+      }
+      std::copy(inputExtent, inputExtent + 6, this->LineSampleOffsetsInputExtent);
+    }
+
+    this->FusedStepInput = static_cast<unsigned char*>(inputImageData->GetScalarPointer());
+    this->FusedStepOutput = static_cast<unsigned char*>(this->LinesImage->GetScalarPointer());
+    this->ExecuteFusedStep(STEP_FILL_LINES);
+    this->LinesImage->Modified();
+    return;
+  }
+
   // For calculating pixel intensity mean and variance. Algorithm taken from:
   // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Online_algorithm
 
@@ -422,10 +554,11 @@ void vtkPlusBoneEnhancer::MarkShadowOutline(vtkSmartPointer<vtkImageData> inputI
     //When an image is detected, keep up to this many pixles after it
     keepInfoCounter = this->BoneOutlineDepthPx + this->BonePushBackPx;
     foundBone = false;
+    unsigned char* row = static_cast<unsigned char*>(inputImage->GetScalarPointer(0, y, 0));
 
     for (int x = dims[0] - 1; x >= 0; --x)
     {
-      vOutput = static_cast<unsigned char*>(inputImage->GetScalarPointer(x, y, 0));
+      vOutput = row + x;
 
       //If an image is detected
       if (*vOutput != 0)
@@ -550,6 +683,7 @@ void vtkPlusBoneEnhancer::ThresholdViaStdDeviation(vtkSmartPointer<vtkImageData>
 
   for (int y = dims[1] - 1; y >= 0; --y)
   {
+    unsigned char* row = static_cast<unsigned char*>(inputImage->GetScalarPointer(0, y, 0));
     max = 0;
 
     pixelSum = 0;
@@ -559,7 +693,7 @@ void vtkPlusBoneEnhancer::ThresholdViaStdDeviation(vtkSmartPointer<vtkImageData>
     //determine the average, sum, and max of the row
     for (int x = dims[0] - 1; x >= fatLayerToCut; --x)
     {
-      vInput = inputImage->GetScalarComponentAsFloat(x, y, 0, 0);
+      vInput = row[x];
       pixelSum += vInput;
       squearSum += vInput * vInput;
 
@@ -581,7 +715,7 @@ void vtkPlusBoneEnhancer::ThresholdViaStdDeviation(vtkSmartPointer<vtkImageData>
     {
       for (int x = dims[0] - 1; x >= 0; --x)
       {
-        vOutput = static_cast<unsigned char*>(inputImage->GetScalarPointer(x, y, 0));
+        vOutput = row + x;
         if (*vOutput < thresholdValue && *vOutput != 0)
         {
           *vOutput = 0;
@@ -638,13 +772,13 @@ void vtkPlusBoneEnhancer::LinearToFanImage(vtkSmartPointer<vtkImageData> inputIm
 {
 
   //Setup so that the image can be converted into a fan-image
-  this->ProcessedLinesImage->DeepCopy(inputImage);
+  CopyImageScalars(inputImage, this->ProcessedLinesImage);
   igsioVideoFrame* outputImage = outputFrame->GetImageData();
   this->ScanConverter->SetInputData(this->ProcessedLinesImage);
-  this->ScanConverter->SetOutput(inputImage);
+  this->ScanConverter->SetOutput(this->FanImage);
   this->ScanConverter->Update();
 
-  outputImage->DeepCopyFrom(inputImage);
+  outputImage->DeepCopyFrom(this->FanImage);
 }
 
 //----------------------------------------------------------------------------
@@ -660,8 +794,6 @@ vtkSmartPointer<vtkImageData> vtkPlusBoneEnhancer::UnprocessedFrameToLinearImage
   this->BoneAreasInfo.clear();
 
   igsioVideoFrame* inputImage = inputFrame->GetImageData();
-  //an image used to transport output between filters
-  vtkSmartPointer<vtkImageData> intermediateImage = vtkSmartPointer<vtkImageData>::New();
 
   //Convert the image to a readable non-fan image
   this->ScanConverter->SetInputData(inputImage->GetImage());
@@ -675,9 +807,10 @@ vtkSmartPointer<vtkImageData> vtkPlusBoneEnhancer::UnprocessedFrameToLinearImage
   {
     this->AddIntermediateImage("_01Lines_2FilterEnd", this->LinesImage);
   }
-  intermediateImage->DeepCopy(this->LinesImage);
+  //the work image is used to transport output between filters
+  CopyImageScalars(this->LinesImage, this->WorkImage);
 
-  return intermediateImage;
+  return this->WorkImage;
 }
 
 //----------------------------------------------------------------------------
@@ -685,6 +818,15 @@ vtkSmartPointer<vtkImageData> vtkPlusBoneEnhancer::UnprocessedFrameToLinearImage
 // bone areas using a white outline.
 void vtkPlusBoneEnhancer::RemoveNoise(vtkSmartPointer<vtkImageData> inputImage)
 {
+  int dims[3] = { 0, 0, 0 };
+  inputImage->GetDimensions(dims);
+  if (this->FusedProcessing && !this->SaveIntermediateResults
+      && inputImage->GetScalarType() == VTK_UNSIGNED_CHAR && inputImage->GetNumberOfScalarComponents() == 1
+      && dims[0] == this->FusedImageDimensions[0] && dims[1] == this->FusedImageDimensions[1] && dims[2] == 1)
+  {
+    this->RemoveNoiseFused(inputImage);
+    return;
+  }
 
   //Threashold the image based on the standard deviation of a pixel's columns
   this->ThresholdViaStdDeviation(inputImage);
@@ -758,6 +900,403 @@ void vtkPlusBoneEnhancer::RemoveNoise(vtkSmartPointer<vtkImageData> inputImage)
   inputImage->DeepCopy(this->BinaryImageForMorphology);
 }
 
+//----------------------------------------------------------------------------
+void vtkPlusBoneEnhancer::RemoveNoiseFused(vtkImageData* image)
+{
+  this->ThresholdViaStdDeviation(image);
+
+  this->ImageEroder->SetKernelSize(this->ErosionKernelSize[0], this->ErosionKernelSize[1], 1);
+  this->ImageDialator->SetKernelSize(this->DilationKernelSize[0], this->DilationKernelSize[1], 1);
+  this->UpdateFusedProcessingKernels();
+
+  unsigned char* bufferA = &this->FusedBufferA[0];
+  unsigned char* bufferB = &this->FusedBufferB[0];
+
+  // Gaussian smoothing, first along y then along x, as in vtkImageGaussianSmooth
+  this->FusedStepInput = static_cast<unsigned char*>(image->GetScalarPointer());
+  this->FusedStepOutput = bufferA;
+  this->ExecuteFusedStep(STEP_GAUSSIAN_SMOOTH_Y);
+  this->FusedStepInput = bufferA;
+  this->FusedStepOutput = bufferB;
+  this->ExecuteFusedStep(STEP_GAUSSIAN_SMOOTH_X);
+
+  // Sobel edge detection, edge magnitude approximation and binarization
+  this->FusedStepInput = bufferB;
+  this->FusedStepOutput = bufferA;
+  this->ExecuteFusedStep(STEP_EDGE_DETECTION_AND_BINARIZATION);
+
+  //Remove small clusters of pixels
+  this->RemoveIslandsFused(bufferA);
+
+  //Erode and dilate the image
+  this->FusedStepInput = bufferA;
+  this->FusedStepOutput = bufferB;
+  this->ExecuteFusedStep(STEP_EROSION);
+  this->FusedStepInput = bufferB;
+  this->FusedStepOutput = static_cast<unsigned char*>(this->BinaryImageForMorphology->GetScalarPointer());
+  this->ExecuteFusedStep(STEP_DILATION);
+  this->BinaryImageForMorphology->Modified();
+
+  //Detect each possible bone area, then subject it to various tests to confirm if it is valid
+  this->MarkShadowOutline(this->BinaryImageForMorphology);
+
+  CopyImageScalars(this->BinaryImageForMorphology, image);
+
+  this->FusedStepInput = NULL;
+  this->FusedStepOutput = NULL;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusBoneEnhancer::UpdateFusedProcessingKernels()
+{
+  double* standardDeviations = this->GaussianSmooth->GetStandardDeviations();
+  double* radiusFactors = this->GaussianSmooth->GetRadiusFactors();
+  double parameters[6] = { static_cast<double>(this->FusedImageDimensions[0]), static_cast<double>(this->FusedImageDimensions[1]),
+                           standardDeviations[0], standardDeviations[1], radiusFactors[0], radiusFactors[1]
+                         };
+  if (!std::equal(parameters, parameters + 6, this->GaussianKernelTableParameters))
+  {
+    this->ComputeClippedGaussianKernelTable(this->FusedImageDimensions[0], standardDeviations[0], radiusFactors[0], this->GaussianKernelX);
+    this->ComputeClippedGaussianKernelTable(this->FusedImageDimensions[1], standardDeviations[1], radiusFactors[1], this->GaussianKernelY);
+    std::copy(parameters, parameters + 6, this->GaussianKernelTableParameters);
+  }
+
+  this->ComputeMorphologyOffsets(this->ImageEroder, this->ErosionOffsets);
+  this->ComputeMorphologyOffsets(this->ImageDialator, this->DilationOffsets);
+}
+
+//----------------------------------------------------------------------------
+// Same kernel as vtkImageGaussianSmooth::ComputeKernel, clipped at the image boundary and renormalized
+void vtkPlusBoneEnhancer::ComputeClippedGaussianKernelTable(int size, double standardDeviation, double radiusFactor, ClippedKernelTable& table)
+{
+  int radius = static_cast<int>(standardDeviation * radiusFactor);
+  table.FirstInputIndex.resize(size);
+  table.WeightsOffset.resize(size);
+  table.KernelSize.resize(size);
+  table.Weights.clear();
+  for (int index = 0; index < size; ++index)
+  {
+    int kernelMin = std::max(-radius, -index);
+    int kernelMax = std::min(radius, size - 1 - index);
+    table.FirstInputIndex[index] = index + kernelMin;
+    table.WeightsOffset[index] = static_cast<int>(table.Weights.size());
+    table.KernelSize[index] = kernelMax - kernelMin + 1;
+
+    if (standardDeviation == 0.0)
+    {
+      table.Weights.push_back(1.0);
+      continue;
+    }
+    double sum = 0.0;
+    for (int x = kernelMin; x <= kernelMax; ++x)
+    {
+      double weight = exp(-(static_cast<double>(x * x)) / (standardDeviation * standardDeviation * 2.0));
+      table.Weights.push_back(weight);
+      sum += weight;
+    }
+    for (int x = kernelMin; x <= kernelMax; ++x)
+    {
+      table.Weights[table.WeightsOffset[index] + x - kernelMin] /= sum;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+// Elements of the ellipsoid kernel mask of vtkImageDilateErode3D that are in the image plane
+void vtkPlusBoneEnhancer::ComputeMorphologyOffsets(vtkImageDilateErode3D* filter, std::vector<int>& offsets)
+{
+  int* kernelSize = filter->GetKernelSize();
+  double center[3] = { 0, 0, 0 };
+  double radius[3] = { 0, 0, 0 };
+  for (int i = 0; i < 3; ++i)
+  {
+    center[i] = (kernelSize[i] - 1) * 0.5;
+    radius[i] = kernelSize[i] * 0.5;
+  }
+
+  // Only the middle slice of the kernel is used, as the image is two dimensional
+  double s[3] = { 0, 0, 0 };
+  double t = kernelSize[2] / 2 - center[2];
+  s[2] = (radius[2] != 0.0) ? (t / radius[2]) * (t / radius[2]) : (t == 0.0 ? 0.0 : VTK_DOUBLE_MAX);
+
+  offsets.clear();
+  for (int ky = 0; ky < kernelSize[1]; ++ky)
+  {
+    t = ky - center[1];
+    s[1] = (radius[1] != 0.0) ? (t / radius[1]) * (t / radius[1]) : (t == 0.0 ? 0.0 : VTK_DOUBLE_MAX);
+    for (int kx = 0; kx < kernelSize[0]; ++kx)
+    {
+      t = kx - center[0];
+      s[0] = (radius[0] != 0.0) ? (t / radius[0]) * (t / radius[0]) : (t == 0.0 ? 0.0 : VTK_DOUBLE_MAX);
+      if (s[0] + s[1] + s[2] <= 1.0)
+      {
+        offsets.push_back(kx - kernelSize[0] / 2);
+        offsets.push_back(ky - kernelSize[1] / 2);
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusBoneEnhancer::RemoveIslandsFused(unsigned char* image)
+{
+  const int nx = this->FusedImageDimensions[0];
+  const int ny = this->FusedImageDimensions[1];
+  const int areaThreshold = this->IslandRemover->GetAreaThreshold();
+  if (areaThreshold <= 1)
+  {
+    // All islands have at least one pixel, nothing to remove
+    return;
+  }
+  const unsigned char islandValue = static_cast<unsigned char>(this->IslandRemover->GetIslandValue());
+  const unsigned char replaceValue = static_cast<unsigned char>(this->IslandRemover->GetReplaceValue());
+  const int numberOfNeighbors = this->IslandRemover->GetSquareNeighborhood() ? 8 : 4;
+  const int neighborOffsets[8][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 }, { -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 } };
+
+  unsigned char* visited = &this->IslandVisited[0];
+  int* islandPixels = &this->IslandPixels[0];
+  memset(visited, 0, nx * ny);
+  for (int pixelIndex = 0; pixelIndex < nx * ny; ++pixelIndex)
+  {
+    if (image[pixelIndex] != islandValue || visited[pixelIndex])
+    {
+      continue;
+    }
+
+    // Collect all pixels of the island (breadth-first)
+    int islandSize = 0;
+    islandPixels[islandSize++] = pixelIndex;
+    visited[pixelIndex] = 1;
+    for (int i = 0; i < islandSize; ++i)
+    {
+      int x = islandPixels[i] % nx;
+      int y = islandPixels[i] / nx;
+      for (int n = 0; n < numberOfNeighbors; ++n)
+      {
+        int neighborX = x + neighborOffsets[n][0];
+        int neighborY = y + neighborOffsets[n][1];
+        if (neighborX < 0 || neighborX >= nx || neighborY < 0 || neighborY >= ny)
+        {
+          continue;
+        }
+        int neighborIndex = neighborX + neighborY * nx;
+        if (!visited[neighborIndex] && image[neighborIndex] == islandValue)
+        {
+          visited[neighborIndex] = 1;
+          islandPixels[islandSize++] = neighborIndex;
+        }
+      }
+    }
+
+    if (islandSize < areaThreshold)
+    {
+      for (int i = 0; i < islandSize; ++i)
+      {
+        image[islandPixels[i]] = replaceValue;
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusBoneEnhancer::ExecuteFusedStep(FusedProcessingStep step)
+{
+  const int numberOfRows = this->FusedImageDimensions[1];
+  this->CurrentFusedStep = step;
+  int numberOfThreads = this->NumberOfThreads;
+  if (this->ActiveWorkers.size() > 1)
+  {
+    // Frames are processed in parallel, use only this worker's share of the threads
+    numberOfThreads /= static_cast<int>(this->ActiveWorkers.size());
+  }
+  this->FusedStepNumberOfThreads = std::max(1, std::min(numberOfThreads, numberOfRows));
+  if (step == STEP_GAUSSIAN_SMOOTH_Y)
+  {
+    this->GaussianAccumulators.resize(this->FusedStepNumberOfThreads * this->FusedImageDimensions[0]);
+  }
+
+  if (this->FusedStepNumberOfThreads == 1)
+  {
+    this->ExecuteFusedStepOnRows(step, 0, numberOfRows, 0);
+    return;
+  }
+
+  this->Threader->SetNumberOfThreads(this->FusedStepNumberOfThreads);
+  this->Threader->SetSingleMethod(&vtkPlusBoneEnhancer::ExecuteFusedStepThread, this);
+  this->Threader->SingleMethodExecute();
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkPlusBoneEnhancer::ExecuteFusedStepThread(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  vtkPlusBoneEnhancer* self = static_cast<vtkPlusBoneEnhancer*>(threadInfo->UserData);
+
+  int numberOfRows = self->FusedImageDimensions[1];
+  int yStart = numberOfRows * threadInfo->ThreadID / threadInfo->NumberOfThreads;
+  int yEnd = numberOfRows * (threadInfo->ThreadID + 1) / threadInfo->NumberOfThreads;
+  self->ExecuteFusedStepOnRows(self->CurrentFusedStep, yStart, yEnd, threadInfo->ThreadID);
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+// Each step computes the output rows [yStart, yEnd). The rounding of intermediate values is the same
+// as in the corresponding VTK filters, so that the output is identical to the VTK filter pipeline.
+void vtkPlusBoneEnhancer::ExecuteFusedStepOnRows(FusedProcessingStep step, int yStart, int yEnd, int threadIndex)
+{
+  const int nx = this->FusedImageDimensions[0];
+  const int ny = this->FusedImageDimensions[1];
+  const unsigned char* input = this->FusedStepInput;
+  unsigned char* output = this->FusedStepOutput;
+
+  switch (step)
+  {
+    case STEP_FILL_LINES:
+    {
+      const int* sampleOffsets = &this->LineSampleOffsets[0];
+      for (int i = yStart * nx; i < yEnd * nx; ++i)
+      {
+        output[i] = (sampleOffsets[i] < 0) ? 0 : input[sampleOffsets[i]];
+      }
+      break;
+    }
+    case STEP_GAUSSIAN_SMOOTH_Y:
+    {
+      double* accumulator = &this->GaussianAccumulators[threadIndex * nx];
+      for (int y = yStart; y < yEnd; ++y)
+      {
+        std::fill(accumulator, accumulator + nx, 0.0);
+        const int kernelSize = this->GaussianKernelY.KernelSize[y];
+        const double* weights = &this->GaussianKernelY.Weights[this->GaussianKernelY.WeightsOffset[y]];
+        const unsigned char* inputRow = input + this->GaussianKernelY.FirstInputIndex[y] * nx;
+        for (int k = 0; k < kernelSize; ++k, inputRow += nx)
+        {
+          const double weight = weights[k];
+          for (int x = 0; x < nx; ++x)
+          {
+            accumulator[x] += weight * static_cast<double>(inputRow[x]);
+          }
+        }
+        unsigned char* outputRow = output + y * nx;
+        for (int x = 0; x < nx; ++x)
+        {
+          outputRow[x] = static_cast<unsigned char>(accumulator[x]);
+        }
+      }
+      break;
+    }
+    case STEP_GAUSSIAN_SMOOTH_X:
+    {
+      for (int y = yStart; y < yEnd; ++y)
+      {
+        const unsigned char* inputRow = input + y * nx;
+        unsigned char* outputRow = output + y * nx;
+        for (int x = 0; x < nx; ++x)
+        {
+          const int kernelSize = this->GaussianKernelX.KernelSize[x];
+          const double* weights = &this->GaussianKernelX.Weights[this->GaussianKernelX.WeightsOffset[x]];
+          const unsigned char* inputPixel = inputRow + this->GaussianKernelX.FirstInputIndex[x];
+          double sum = 0.0;
+          for (int k = 0; k < kernelSize; ++k)
+          {
+            sum += weights[k] * static_cast<double>(inputPixel[k]);
+          }
+          outputRow[x] = static_cast<unsigned char>(sum);
+        }
+      }
+      break;
+    }
+    case STEP_EDGE_DETECTION_AND_BINARIZATION:
+    {
+      // Sobel gradient as in vtkImageSobel2D (neighbors outside of the image are replaced by the center pixel)
+      double* spacing = this->LinesImage->GetSpacing();
+      const double r0 = 0.125 / spacing[0];
+      const double r1 = 0.125 / spacing[1];
+      // Thresholds are clamped to the scalar range and cast to the scalar type, as in vtkImageThreshold
+      const unsigned char lowerThreshold = static_cast<unsigned char>(std::max(0.0, std::min(255.0, this->ImageBinarizer->GetLowerThreshold())));
+      const unsigned char upperThreshold = static_cast<unsigned char>(std::max(0.0, std::min(255.0, this->ImageBinarizer->GetUpperThreshold())));
+      const bool replaceIn = this->ImageBinarizer->GetReplaceIn() != 0;
+      const bool replaceOut = this->ImageBinarizer->GetReplaceOut() != 0;
+      const unsigned char inValue = static_cast<unsigned char>(this->ImageBinarizer->GetInValue());
+      const unsigned char outValue = static_cast<unsigned char>(this->ImageBinarizer->GetOutValue());
+      for (int y = yStart; y < yEnd; ++y)
+      {
+        const int yMin = (y <= 0) ? 0 : -nx;
+        const int yMax = (y >= ny - 1) ? 0 : nx;
+        for (int x = 0; x < nx; ++x)
+        {
+          const int xMin = (x <= 0) ? 0 : -1;
+          const int xMax = (x >= nx - 1) ? 0 : 1;
+          const unsigned char* center = input + x + y * nx;
+
+          const unsigned char* left = center + xMin;
+          const unsigned char* right = center + xMax;
+          double sum = 2.0 * (*right - *left);
+          sum += static_cast<double>(right[yMin] + right[yMax] - left[yMin] - left[yMax]);
+          const float gradientX = static_cast<float>(sum * r0);
+
+          left = center + yMin;
+          right = center + yMax;
+          sum = 2.0 * (*right - *left);
+          sum += static_cast<double>(right[xMin] + right[xMax] - left[xMin] - left[xMax]);
+          const float gradientY = static_cast<float>(sum * r1);
+
+          // Same approximation of the gradient magnitude as in VectorImageToUchar
+          unsigned char edgeDetectorOutput0 = static_cast<unsigned char>(static_cast<int>(gradientX));
+          unsigned char edgeDetectorOutput1 = static_cast<unsigned char>(static_cast<int>(gradientY));
+          float magnitude = (float)(edgeDetectorOutput0 + edgeDetectorOutput1) / (float)2;
+          unsigned char edge = static_cast<unsigned char>(std::max(0, std::min(255, (int)magnitude)));
+
+          if (edge >= lowerThreshold && edge <= upperThreshold)
+          {
+            output[x + y * nx] = replaceIn ? inValue : edge;
+          }
+          else
+          {
+            output[x + y * nx] = replaceOut ? outValue : edge;
+          }
+        }
+      }
+      break;
+    }
+    case STEP_EROSION:
+    case STEP_DILATION:
+    {
+      // Same as vtkImageDilateErode3D: a pixel with erode value is changed to dilate value
+      // if there is a pixel with dilate value under the kernel mask
+      vtkImageDilateErode3D* filter = (step == STEP_EROSION) ? this->ImageEroder.GetPointer() : this->ImageDialator.GetPointer();
+      const std::vector<int>& offsets = (step == STEP_EROSION) ? this->ErosionOffsets : this->DilationOffsets;
+      const unsigned char erodeValue = static_cast<unsigned char>(filter->GetErodeValue());
+      const unsigned char dilateValue = static_cast<unsigned char>(filter->GetDilateValue());
+      const int numberOfOffsets = static_cast<int>(offsets.size() / 2);
+      for (int y = yStart; y < yEnd; ++y)
+      {
+        for (int x = 0; x < nx; ++x)
+        {
+          unsigned char value = input[x + y * nx];
+          if (value == erodeValue)
+          {
+            for (int i = 0; i < numberOfOffsets; ++i)
+            {
+              int neighborX = x + offsets[2 * i];
+              int neighborY = y + offsets[2 * i + 1];
+              if (neighborX >= 0 && neighborX < nx && neighborY >= 0 && neighborY < ny
+                  && input[neighborX + neighborY * nx] == dilateValue)
+              {
+                value = dilateValue;
+                break;
+              }
+            }
+          }
+          output[x + y * nx] = value;
+        }
+      }
+      break;
+    }
+  }
+}
+
 
 //----------------------------------------------------------------------------
 /*
@@ -13,9 +13,13 @@ See License.txt for details.
 #include "vtkImageAlgorithm.h"
 
 // VTK includes
+#include <vtkMultiThreader.h>
 #include <vtkSmartPointer.h>
 #include <vtkSetGet.h>
 
+// STL includes
+#include <vector>
+
 class vtkImageData;
 class vtkImageThreshold;
 class vtkImageGaussianSmooth;
@@ -27,6 +31,11 @@ class vtkPlusUsScanConvert;
 /*!
 \class vtkPlusBoneEnhancer
 \brief Localize bone surfaces in ultrasound images
+
+The noise removal steps (Gaussian smoothing, edge detection, binarization, island removal, erosion and dilation)
+are computed either by a pipeline of VTK filters or by fused kernels that work on preallocated buffers and process
+image rows in parallel (see FusedProcessing). The fused kernels compute exactly the same output as the VTK filters.
+
 \ingroup PlusLibImageProcessingAlgo
 */
 class vtkPlusImageProcessingExport vtkPlusBoneEnhancer : public vtkPlusTrackedFrameProcessor
@@ -40,10 +49,13 @@ public:
   virtual PlusStatus ProcessFrame(igsioTrackedFrame* inputFrame, igsioTrackedFrame* outputFrame);
 
   /*! Read configuration from xml data */
-  virtual PlusStatus ReadConfiguration(vtkSmartPointer<vtkXMLDataElement> processingElement);
+  virtual PlusStatus ReadConfiguration(vtkXMLDataElement* processingElement);
 
   /*! Write configuration to xml data */
-  virtual PlusStatus WriteConfiguration(vtkSmartPointer<vtkXMLDataElement> processingElement);
+  virtual PlusStatus WriteConfiguration(vtkXMLDataElement* processingElement);
+
+  /*! Frames can be processed in parallel unless intermediate results are saved */
+  virtual bool IsFrameParallelProcessingSupported() { return !this->SaveIntermediateResults; };
 
   /*! Get the Type attribute of the configuration element */
   virtual const char* GetProcessorTypeName() { return "vtkPlusBoneEnhancer"; };
@@ -87,6 +99,21 @@ public:
   vtkSetVector2Macro(DilationKernelSize, int);
   vtkGetVector2Macro(DilationKernelSize, int);
 
+  /*!
+    If enabled (default) then the noise removal steps are computed by fused, multithreaded kernels.
+    The VTK filter pipeline is used if disabled or if intermediate results are saved.
+  */
+  vtkSetMacro(FusedProcessing, bool);
+  vtkGetMacro(FusedProcessing, bool);
+  vtkBooleanMacro(FusedProcessing, bool);
+
+  /*!
+    Number of threads used by the fused processing. Default is the number of processors.
+    If frames are processed in parallel (see NumberOfWorkerThreads) then the threads are shared between the workers.
+  */
+  vtkSetClampMacro(NumberOfThreads, int, 1, VTK_MAX_THREADS);
+  vtkGetMacro(NumberOfThreads, int);
+
   void ThresholdViaStdDeviation(vtkSmartPointer<vtkImageData> inputImage);
 
   vtkImageData* GetProcessedLinesImage() { return (this->ProcessedLinesImage); }
@@ -117,6 +144,49 @@ protected:
 
   virtual PlusStatus ProcessImageExtents();
 
+  /*! Worker processors get their share of the fused processing threads */
+  virtual vtkPlusTrackedFrameProcessor* CreateWorkerProcessor();
+
+  /*! Processing steps of the fused pipeline. Each step processes all image rows before the next step can start. */
+  enum FusedProcessingStep
+  {
+    STEP_FILL_LINES,
+    STEP_GAUSSIAN_SMOOTH_Y,
+    STEP_GAUSSIAN_SMOOTH_X,
+    STEP_EDGE_DETECTION_AND_BINARIZATION,
+    STEP_EROSION,
+    STEP_DILATION
+  };
+
+  /*!
+    Gaussian kernel for each position along an image axis. Kernels are clipped and renormalized
+    at the image boundary, as in vtkImageGaussianSmooth.
+  */
+  struct ClippedKernelTable
+  {
+    std::vector<int> FirstInputIndex;
+    std::vector<int> WeightsOffset;
+    std::vector<int> KernelSize;
+    std::vector<double> Weights;
+  };
+
+  /*! Remove noise using the fused kernels. Same result as the VTK filter pipeline in RemoveNoise. */
+  void RemoveNoiseFused(vtkImageData* image);
+
+  /*! Update kernel tables of the fused processing if parameters or image size changed */
+  void UpdateFusedProcessingKernels();
+
+  void ComputeClippedGaussianKernelTable(int size, double standardDeviation, double radiusFactor, ClippedKernelTable& table);
+  void ComputeMorphologyOffsets(vtkImageDilateErode3D* filter, std::vector<int>& offsets);
+
+  /*! Replace connected components that are smaller than the island area threshold, as in vtkImageIslandRemoval2D */
+  void RemoveIslandsFused(unsigned char* image);
+
+  /*! Execute a processing step, the image rows are split between the threads */
+  void ExecuteFusedStep(FusedProcessingStep step);
+  void ExecuteFusedStepOnRows(FusedProcessingStep step, int yStart, int yEnd, int threadIndex);
+  static VTK_THREAD_RETURN_TYPE ExecuteFusedStepThread(void* arg);
+
 protected:
   vtkSmartPointer<vtkPlusUsScanConvert>     ScanConverter;
   vtkSmartPointer<vtkImageGaussianSmooth>   GaussianSmooth; // Trying to incorporate existing GaussianSmooth vtkThreadedAlgorithm class
@@ -165,6 +235,43 @@ protected:
   std::vector<std::map<std::string, int> > BoneAreasInfo;
   bool FirstFrame;
 
+  bool FusedProcessing;
+  int NumberOfThreads;
+  vtkSmartPointer<vtkMultiThreader> Threader;
+
+  /*! Linear image that is processed (returned by UnprocessedFrameToLinearImage) */
+  vtkSmartPointer<vtkImageData> WorkImage;
+  /*! Scan converted output image */
+  vtkSmartPointer<vtkImageData> FanImage;
+
+  /*! Input image pixel offset for each pixel of the lines image (-1 if the sample is outside the input image) */
+  std::vector<int> LineSampleOffsets;
+  int LineSampleOffsetsInputExtent[6];
+
+  ClippedKernelTable GaussianKernelX;
+  ClippedKernelTable GaussianKernelY;
+  /*! Image size, standard deviations and radius factors that were used for computing the Gaussian kernel tables */
+  double GaussianKernelTableParameters[6];
+  /*! Pixel offsets of the erosion and dilation kernels (x and y offset for each kernel element) */
+  std::vector<int> ErosionOffsets;
+  std::vector<int> DilationOffsets;
+
+  /*! Ping-pong buffers of the fused processing steps */
+  std::vector<unsigned char> FusedBufferA;
+  std::vector<unsigned char> FusedBufferB;
+  /*! One row of accumulators for each thread */
+  std::vector<double> GaussianAccumulators;
+  std::vector<unsigned char> IslandVisited;
+  std::vector<int> IslandPixels;
+
+  /*! Size of the lines image, all fused processing steps work on images of this size */
+  int FusedImageDimensions[2];
+  /*! Input and output of the current fused processing step */
+  FusedProcessingStep CurrentFusedStep;
+  const unsigned char* FusedStepInput;
+  unsigned char* FusedStepOutput;
+  int FusedStepNumberOfThreads;
+
 private:
   vtkPlusBoneEnhancer(const vtkPlusBoneEnhancer&);  // Not implemented.
   void operator=(const vtkPlusBoneEnhancer&);  // Not implemented.
@@ -9,31 +9,39 @@ See License.txt for details.
 #include "vtkPlusForoughiBoneSurfaceProbability.h"
 
 // VTK includes
-#include "vtkImageCast.h"
-#include <vtkIntArray.h>
-#include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkImageData.h>
-#include <vtkDoubleArray.h>
-#include <vtkTimerLog.h>
 
 // STD includes
-#include <cassert>
+#include <algorithm>
+#include <cmath>
 
-// Other includes
-#include "mkl.h"
-#ifdef NDEBUG
-  #include <omp.h>
-#endif
+vtkStandardNewMacro(vtkPlusForoughiBoneSurfaceProbability);
 
-#define MKL_FREE_IF_NULL(var) \
-  if (var != NULL) \
-  { \
-    mkl_free(var); \
-    var = NULL; \
-  }
+const double vtkPlusForoughiBoneSurfaceProbability::ShadowGaussianTruncationThreshold = 1e-12;
 
-vtkStandardNewMacro(vtkPlusForoughiBoneSurfaceProbability);
+namespace
+{
+  //----------------------------------------------------------------------------
+  inline double IntegerPower(double base, int exponent)
+  {
+    if (exponent < 0)
+    {
+      return 1.0 / IntegerPower(base, -exponent);
+    }
+    double result = 1.0;
+    while (exponent > 0)
+    {
+      if (exponent & 1)
+      {
+        result *= base;
+      }
+      base *= base;
+      exponent >>= 1;
+    }
+    return result;
+  }
+}
 
 //----------------------------------------------------------------------------
 vtkPlusForoughiBoneSurfaceProbability::vtkPlusForoughiBoneSurfaceProbability()
@@ -44,30 +52,48 @@ vtkPlusForoughiBoneSurfaceProbability::vtkPlusForoughiBoneSurfaceProbability()
   this->ShadowVSIntensity = 5;
   this->SmoothingSigma = 5.0;
   this->TransducerMargin = 60;
+  this->NumberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
 
   this->KernelUpdateRequested = true;
 
-  this->GaussianKernelSize = 0;
   this->FrameSize[0] = 0;
   this->FrameSize[1] = 0;
   this->FrameSize[2] = 1;
 
-  this->MklGaussianBuffer = NULL;
-  this->MklLaplacianOfGaussianBuffer = NULL;
-  this->MklGaussianBufferTemp = NULL;
-  this->MklLaplacianOfGaussianBufferTemp = NULL;
-  this->MklReflectionNumberBuffer = NULL;
-  this->MklShadowValueBuffer = NULL;
-  this->MklShadowModel = NULL;
-  this->MklGaussianKernel = NULL;
-  this->MklLaplacianKernel = NULL;
+  this->InputSlice = NULL;
+  this->OutputSlice = NULL;
+  this->CurrentStep = STEP_GAUSSIAN_ROWS;
+
+  this->Threader = vtkSmartPointer<vtkMultiThreader>::New();
 }
 
 //----------------------------------------------------------------------------
 vtkPlusForoughiBoneSurfaceProbability::~vtkPlusForoughiBoneSurfaceProbability()
 {
-  DeleteKernels();
-  // mkl_free_buffers();
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusForoughiBoneSurfaceProbability::SetShadowSigma(double shadowSigma)
+{
+  if (this->ShadowSigma == shadowSigma)
+  {
+    return;
+  }
+  this->ShadowSigma = shadowSigma;
+  this->KernelUpdateRequested = true;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusForoughiBoneSurfaceProbability::SetSmoothingSigma(double smoothingSigma)
+{
+  if (this->SmoothingSigma == smoothingSigma)
+  {
+    return;
+  }
+  this->SmoothingSigma = smoothingSigma;
+  this->KernelUpdateRequested = true;
+  this->Modified();
 }
 
 //----------------------------------------------------------------------------
@@ -83,6 +109,12 @@ void vtkPlusForoughiBoneSurfaceProbability::SimpleExecute(vtkImageData* input, v
   output->AllocateScalars(input->GetScalarType(), input->GetNumberOfScalarComponents());
 #endif
 
+  if (input->GetScalarType() != VTK_DOUBLE || input->GetNumberOfScalarComponents() != 1)
+  {
+    LOG_ERROR("vtkPlusForoughiBoneSurfaceProbability requires single-component double input image");
+    return;
+  }
+
   int* inputExtent = input->GetExtent();
   if ((inputExtent[1] - inputExtent[0] + 1) != this->FrameSize[0] || (inputExtent[3] - inputExtent[2] + 1) != this->FrameSize[1])
   {
@@ -97,227 +129,262 @@ void vtkPlusForoughiBoneSurfaceProbability::SimpleExecute(vtkImageData* input, v
     this->KernelUpdateRequested = false;
   }
 
-  int* dims = input->GetDimensions();
-  unsigned int nx = this->FrameSize[0];
-  unsigned int ny = this->FrameSize[1];
-  unsigned int sliceSize = this->FrameSize[0] * this->FrameSize[1];
-
-  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  int sliceSize = static_cast<int>(this->FrameSize[0] * this->FrameSize[1]);
 
   // Loop through each slice
-  for (unsigned int sliceIdx = inputExtent[4]; sliceIdx <= inputExtent[5]; ++sliceIdx)
+  for (int sliceIdx = inputExtent[4]; sliceIdx <= inputExtent[5]; ++sliceIdx)
   {
-    LOG_INFO("---------------");
-    // Index of slice in buffer
-    double* inputSlicePtr = static_cast<double*>(input->GetScalarPointer(0, 0, sliceIdx));
-    double* outputSlicePtr = static_cast<double*>(output->GetScalarPointer(0, 0, sliceIdx));
+    this->InputSlice = static_cast<double*>(input->GetScalarPointer(inputExtent[0], inputExtent[2], sliceIdx));
+    this->OutputSlice = static_cast<double*>(output->GetScalarPointer(inputExtent[0], inputExtent[2], sliceIdx));
 
-    // If slice has not all zero pixels...
-    //if (GetMaxPixelValue(inputSlicePtr, sliceSize) > 0) // this is expensive and always true (except error cases)
-    {
-      // Convolve with Gaussian kernel and normalize result between zero and one
-      timer->StartTimer();
-      Conv2(inputSlicePtr, this->MklGaussianKernel, this->MklGaussianBufferTemp, this->MklGaussianBuffer, static_cast<int>(this->FrameSize[0]), static_cast<int>(this->FrameSize[1]), this->GaussianKernelSize, this->GaussianKernelSize);
-      timer->StopTimer();
-      LOG_INFO("Conv2 1: " << timer->GetElapsedTime());
-
-      timer->StartTimer();
-      Normalize(this->MklGaussianBuffer, sliceSize, false);
-      timer->StopTimer();
-      LOG_INFO("Normalize 1: " << timer->GetElapsedTime());
-
-      // Convolve blurred image with Laplacian kernel
-      timer->StartTimer();
-      Conv2(this->MklGaussianBuffer, this->MklLaplacianKernel, this->MklLaplacianOfGaussianBufferTemp, this->MklLaplacianOfGaussianBuffer, static_cast<int>(this->FrameSize[0]), static_cast<int>(this->FrameSize[1]), 3, 3);
-      timer->StopTimer();
-      LOG_INFO("Conv2 2: " << timer->GetElapsedTime());
-
-      // Main loop calculating reflection number and shadow value
-      timer->StartTimer();
-      double sumG = 0;
-      double sumGI = 0;
-      double sumHist = 0;
-      int i, pixelIdx, x, y;
-#ifdef NDEBUG
-      #pragma omp parallel for reduction(+:sumG,sumGI, sumHist), private(i, x, pixelIdx)
-#endif
-      for (y = 0; y < ny; ++y)
-      {
-        for (x = 0; x < nx; ++x)
-        {
-          pixelIdx = x + y * nx;
+    // Convolve with Gaussian kernel (separable, rows then columns) and normalize result between zero and one
+    ExecuteStep(STEP_GAUSSIAN_ROWS);
+    ExecuteStep(STEP_GAUSSIAN_COLUMNS);
+    Normalize(&this->GaussianBuffer[0], sliceSize, false);
 
-          // Only include pixels with intensity value larger than a specified threshold
-          if (this->MklGaussianBuffer[pixelIdx] >= this->BoneThreshold && pixelIdx > this->TransducerMargin * nx)
-          {
-            // Set outermost border pixels to zero and exclude negative pixels
-            if ((x == nx - 1 || x == 0 || y == ny - 1 || y == 0) || this->MklLaplacianOfGaussianBuffer[pixelIdx] <= 0)
-            {
-              this->MklLaplacianOfGaussianBuffer[pixelIdx] = 0.0;
-            }
-            else
-            {
-              // Divide by small number to increase image intensity (What! :)
-              this->MklLaplacianOfGaussianBuffer[pixelIdx] = this->MklLaplacianOfGaussianBuffer[pixelIdx] / 0.005;
-            }
+    // Convolve blurred image with Laplacian kernel
+    ExecuteStep(STEP_LAPLACIAN);
 
-            // Calculate reflection number
-            this->MklReflectionNumberBuffer[pixelIdx] = pow(this->MklGaussianBuffer[pixelIdx], this->BlurredVSBLoG) + this->MklLaplacianOfGaussianBuffer[pixelIdx];
+    // Calculate reflection number and shadow value
+    ExecuteStep(STEP_REFLECTION_AND_SHADOW);
 
-            // Calculate shadow value
-            sumG = 0;
-            sumGI = 0;
-            for (i = y; i < ny; ++i)
-            {
-              sumG += this->MklShadowModel[i - y];
-              sumGI += this->MklShadowModel[i - y] * this->MklGaussianBuffer[x + i * nx];
-            }
-            this->MklShadowValueBuffer[pixelIdx] = sumGI / sumG;
-          }
-          else
-          {
-            this->MklReflectionNumberBuffer[pixelIdx] = 0.0;
-            this->MklShadowValueBuffer[pixelIdx] = 0.0;
-          }
-        }
-      }
+    // Normalize both reflection numbers and shadow values
+    Normalize(&this->ReflectionNumberBuffer[0], sliceSize, false);
+    Normalize(&this->ShadowValueBuffer[0], sliceSize, true);
 
-      timer->StopTimer();
-      LOG_INFO("Main processing: " << timer->GetElapsedTime());
-
-      // Normalize both reflection numbers and shadow values
-      timer->StartTimer();
-      Normalize(this->MklReflectionNumberBuffer, sliceSize, false);
-      Normalize(this->MklShadowValueBuffer, sliceSize, true);
-      timer->StopTimer();
-      LOG_INFO("Normalize 2x: " << timer->GetElapsedTime());
-
-      // Calculate BSP
-      timer->StartTimer();
-      vdPowx(sliceSize, this->MklShadowValueBuffer, this->ShadowVSIntensity, this->MklShadowValueBuffer);
-      vdMul(sliceSize, this->MklShadowValueBuffer, this->MklReflectionNumberBuffer, outputSlicePtr);
-      timer->StopTimer();
-      LOG_INFO("Non-linear transform: " << timer->GetElapsedTime());
-
-      // Normalize BSP
-      timer->StartTimer();
-      Normalize(outputSlicePtr, sliceSize, false, 255);
-      timer->StopTimer();
-      LOG_INFO("Normalize 3: " << timer->GetElapsedTime());
-    }
+    // Calculate BSP
+    ExecuteStep(STEP_BONE_SURFACE_PROBABILITY);
+
+    // Normalize BSP
+    Normalize(this->OutputSlice, sliceSize, false, 255);
   }
+
+  this->InputSlice = NULL;
+  this->OutputSlice = NULL;
 }
 
 //-----------------------------------------------------------------------------
 void vtkPlusForoughiBoneSurfaceProbability::UpdateKernels()
 {
-  DeleteKernels();
-
-  this->GaussianKernelSize = floor(this->SmoothingSigma * 3) * 2 + 1;
+  int nx = static_cast<int>(this->FrameSize[0]);
+  int ny = static_cast<int>(this->FrameSize[1]);
 
-  // Allocating memory for matrices aligned on 64-byte boundary for better performance
-  this->MklGaussianBuffer = (double*)mkl_malloc(this->FrameSize[0] * this->FrameSize[1] * sizeof(double), 64);
-  this->MklLaplacianOfGaussianBuffer = (double*)mkl_malloc(this->FrameSize[0] * this->FrameSize[1] * sizeof(double), 64);
-  this->MklGaussianBufferTemp = (double*)mkl_malloc((this->FrameSize[0] + GaussianKernelSize - 1) * (this->FrameSize[1]  + GaussianKernelSize - 1) * sizeof(double), 64);
-  this->MklLaplacianOfGaussianBufferTemp = (double*)mkl_malloc((this->FrameSize[0] + 2) * (this->FrameSize[1]  + 2) * sizeof(double), 64);
-  this->MklReflectionNumberBuffer = (double*)mkl_malloc(this->FrameSize[0] * this->FrameSize[1] * sizeof(double), 64);
-  this->MklShadowValueBuffer = (double*)mkl_malloc(this->FrameSize[0] * this->FrameSize[1] * sizeof(double), 64);
-  this->MklShadowModel = (double*)mkl_malloc(this->FrameSize[1] * sizeof(double), 64);
-  this->MklGaussianKernel = (double*)mkl_malloc(GaussianKernelSize * GaussianKernelSize * sizeof(double), 64);
-  this->MklLaplacianKernel = (double*)mkl_malloc(3 * 3 * sizeof(double), 64);
+  this->GaussianBuffer.resize(nx * ny);
+  this->GaussianBufferTemp.resize(nx * ny);
+  this->LaplacianOfGaussianBuffer.resize(nx * ny);
+  this->ReflectionNumberBuffer.resize(nx * ny);
+  this->ShadowValueBuffer.resize(nx * ny);
+  this->GaussianColumnSumBuffer.assign(nx * (ny + 1), 0.0);
 
   // Calculate shadow model
-  for (int i = 0; i < this->FrameSize[1]; ++i)
+  this->ShadowModel.resize(ny);
+  this->ShadowModelSum.resize(ny);
+  this->ShadowModelGaussian.clear();
+  double shadowModelSum = 0.0;
+  double shadowModelGaussianMax = exp(1 / (2 * this->ShadowSigma * this->ShadowSigma));
+  bool shadowModelGaussianTruncated = false;
+  for (int i = 0; i < ny; ++i)
   {
-    if (i < this->FrameSize[1] - 5)
+    if (i < ny - 5)
     {
-      this->MklShadowModel[i] = 1 - exp(- (i * i - 1) / (2 * this->ShadowSigma * this->ShadowSigma));
+      double gaussian = exp(- (i * i - 1) / (2 * this->ShadowSigma * this->ShadowSigma));
+      this->ShadowModel[i] = 1 - gaussian;
+      if (!shadowModelGaussianTruncated && gaussian >= ShadowGaussianTruncationThreshold * shadowModelGaussianMax)
+      {
+        this->ShadowModelGaussian.push_back(gaussian);
+      }
+      else
+      {
+        shadowModelGaussianTruncated = true;
+      }
     }
     else
     {
-      this->MklShadowModel[i] = 0.0;
+      this->ShadowModel[i] = 0.0;
     }
+    shadowModelSum += this->ShadowModel[i];
+    this->ShadowModelSum[i] = shadowModelSum;
   }
 
   // Calculate Gaussian kernel
-  int idx = 0;
-  int intervall = (GaussianKernelSize - 1) / 2;
-  for (double x = -intervall; x <= intervall; ++x)
+  int halfKernelSize = static_cast<int>(floor(this->SmoothingSigma * 3));
+  this->GaussianKernel.resize(2 * halfKernelSize + 1);
+  for (int x = -halfKernelSize; x <= halfKernelSize; ++x)
   {
-    for (double y = -intervall; y <= intervall; ++y)
-    {
-      this->MklGaussianKernel [idx] = exp(-((x * x) / (2 * this->SmoothingSigma * this->SmoothingSigma) + (y * y) / (2 * this->SmoothingSigma * this->SmoothingSigma)));
-      ++idx;
-    }
+    this->GaussianKernel[x + halfKernelSize] = exp(-(x * x) / (2 * this->SmoothingSigma * this->SmoothingSigma));
   }
-
-  // Calculate Laplacian kernel
-  this->MklLaplacianKernel[0] = 0;
-  this->MklLaplacianKernel[1] = -1;
-  this->MklLaplacianKernel[2] = 0;
-  this->MklLaplacianKernel[3] = -1;
-  this->MklLaplacianKernel[4] = 4;
-  this->MklLaplacianKernel[5] = -1;
-  this->MklLaplacianKernel[6] = 0;
-  this->MklLaplacianKernel[7] = -1;
-  this->MklLaplacianKernel[8] = 0;
 }
 
 //-----------------------------------------------------------------------------
-void vtkPlusForoughiBoneSurfaceProbability::DeleteKernels()
+void vtkPlusForoughiBoneSurfaceProbability::ExecuteStep(ProcessingStep step)
 {
-  // Free memory
-  MKL_FREE_IF_NULL(this->MklGaussianBuffer);
-  MKL_FREE_IF_NULL(this->MklLaplacianOfGaussianBuffer);
-  MKL_FREE_IF_NULL(this->MklGaussianBufferTemp);
-  MKL_FREE_IF_NULL(this->MklLaplacianOfGaussianBufferTemp);
-  MKL_FREE_IF_NULL(this->MklReflectionNumberBuffer);
-  MKL_FREE_IF_NULL(this->MklShadowValueBuffer);
-  MKL_FREE_IF_NULL(this->MklShadowModel);
-  MKL_FREE_IF_NULL(this->MklGaussianKernel);
-  MKL_FREE_IF_NULL(this->MklLaplacianKernel);
+  int nx = static_cast<int>(this->FrameSize[0]);
+  int numberOfThreads = std::min(this->NumberOfThreads, nx);
+  if (numberOfThreads <= 1)
+  {
+    ExecuteStepOnColumns(step, 0, nx);
+    return;
+  }
+
+  this->CurrentStep = step;
+  this->Threader->SetNumberOfThreads(numberOfThreads);
+  this->Threader->SetSingleMethod(&vtkPlusForoughiBoneSurfaceProbability::ExecuteStepThread, this);
+  this->Threader->SingleMethodExecute();
 }
 
 //-----------------------------------------------------------------------------
-// Performs a 2D convolution using Intel MKL defined by the kernel buffer.
-void vtkPlusForoughiBoneSurfaceProbability::Conv2(const double* inputBuffer, const double* kernelBuffer, double* tempBuffer, double* outputBuffer, int nx, int ny, int kx, int ky)
+VTK_THREAD_RETURN_TYPE vtkPlusForoughiBoneSurfaceProbability::ExecuteStepThread(void* arg)
 {
-  int inputShape[] = {nx, ny};
-  int kernelShape[] = {kx, ky};
-  int resultShape[] = {nx + kx - 1, ny + ky - 1};
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  vtkPlusForoughiBoneSurfaceProbability* self = static_cast<vtkPlusForoughiBoneSurfaceProbability*>(threadInfo->UserData);
 
-  VSLConvTaskPtr task;
-  int status = vsldConvNewTask(&task, VSL_CONV_MODE_AUTO, 2, inputShape, kernelShape, resultShape);
+  int nx = static_cast<int>(self->FrameSize[0]);
+  int xStart = nx * threadInfo->ThreadID / threadInfo->NumberOfThreads;
+  int xEnd = nx * (threadInfo->ThreadID + 1) / threadInfo->NumberOfThreads;
+  self->ExecuteStepOnColumns(self->CurrentStep, xStart, xEnd);
 
-  status = vsldConvExec(task, inputBuffer, NULL, kernelBuffer, NULL, tempBuffer, NULL);
-  vslConvDeleteTask(&task);
-
-  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
-  timer->StartTimer();
-  ResizeMatrix(tempBuffer, outputBuffer, kx, ky, nx + kx - 1, ny + ky - 1);
-  timer->StopTimer();
-  LOG_INFO("Resizematrix: " << timer->GetElapsedTime());
+  return VTK_THREAD_RETURN_VALUE;
 }
 
 //-----------------------------------------------------------------------------
-void vtkPlusForoughiBoneSurfaceProbability::ResizeMatrix(const double* inputBuffer, double* outputBuffer, int xClipping, int yClipping, int xInputSize, int yInputSize)
+void vtkPlusForoughiBoneSurfaceProbability::ExecuteStepOnColumns(ProcessingStep step, int xStart, int xEnd)
 {
-  int xStart = (xClipping + 2 - 1) / 2 - 1;
-  int yStart = (yClipping + 2 - 1) / 2 - 1;
-  int xStop = xInputSize - xStart;
-  int yStop = yInputSize - yStart;
-
-  int idx = 0;
-  for (int y = 0; y < yInputSize; ++y)
+  const int nx = static_cast<int>(this->FrameSize[0]);
+  const int ny = static_cast<int>(this->FrameSize[1]);
+  const int halfKernelSize = static_cast<int>(this->GaussianKernel.size() / 2);
+  const double* gaussianKernel = &this->GaussianKernel[halfKernelSize];
+  double* gaussian = &this->GaussianBuffer[0];
+  double* gaussianTemp = &this->GaussianBufferTemp[0];
+  double* laplacianOfGaussian = &this->LaplacianOfGaussianBuffer[0];
+  double* reflectionNumber = &this->ReflectionNumberBuffer[0];
+  double* shadowValue = &this->ShadowValueBuffer[0];
+  double* columnSum = &this->GaussianColumnSumBuffer[0];
+
+  switch (step)
   {
-    for (int x = 0; x < xInputSize; ++x)
+    case STEP_GAUSSIAN_ROWS:
+      for (int y = 0; y < ny; ++y)
+      {
+        const double* inputRow = this->InputSlice + y * nx;
+        for (int x = xStart; x < xEnd; ++x)
+        {
+          int kStart = std::max(-halfKernelSize, x - nx + 1);
+          int kEnd = std::min(halfKernelSize, x);
+          double sum = 0.0;
+          for (int k = kStart; k <= kEnd; ++k)
+          {
+            sum += inputRow[x - k] * gaussianKernel[k];
+          }
+          gaussianTemp[x + y * nx] = sum;
+        }
+      }
+      break;
+
+    case STEP_GAUSSIAN_COLUMNS:
+      for (int y = 0; y < ny; ++y)
+      {
+        int kStart = std::max(-halfKernelSize, y - ny + 1);
+        int kEnd = std::min(halfKernelSize, y);
+        for (int x = xStart; x < xEnd; ++x)
+        {
+          gaussian[x + y * nx] = 0.0;
+        }
+        for (int k = kStart; k <= kEnd; ++k)
+        {
+          const double* tempRow = gaussianTemp + (y - k) * nx;
+          for (int x = xStart; x < xEnd; ++x)
+          {
+            gaussian[x + y * nx] += tempRow[x] * gaussianKernel[k];
+          }
+        }
+      }
+      break;
+
+    case STEP_LAPLACIAN:
+      for (int y = 0; y < ny; ++y)
+      {
+        for (int x = xStart; x < xEnd; ++x)
+        {
+          int pixelIdx = x + y * nx;
+          double value = 4 * gaussian[pixelIdx];
+          value -= (x > 0 ? gaussian[pixelIdx - 1] : 0.0);
+          value -= (x < nx - 1 ? gaussian[pixelIdx + 1] : 0.0);
+          value -= (y > 0 ? gaussian[pixelIdx - nx] : 0.0);
+          value -= (y < ny - 1 ? gaussian[pixelIdx + nx] : 0.0);
+          laplacianOfGaussian[pixelIdx] = value;
+        }
+      }
+      break;
+
+    case STEP_REFLECTION_AND_SHADOW:
     {
-      if (x >= xStart && x < xStop && y >= yStart && y < yStop)
+      // Sum of blurred intensities from each pixel to the bottom of the column (the last row is all zero)
+      for (int y = ny - 1; y >= 0; --y)
+      {
+        for (int x = xStart; x < xEnd; ++x)
+        {
+          columnSum[x + y * nx] = gaussian[x + y * nx] + columnSum[x + (y + 1) * nx];
+        }
+      }
+
+      const int shadowModelGaussianSize = static_cast<int>(this->ShadowModelGaussian.size());
+      const double* shadowModelGaussian = this->ShadowModelGaussian.empty() ? NULL : &this->ShadowModelGaussian[0];
+      for (int y = 0; y < ny; ++y)
       {
-        outputBuffer[idx] = inputBuffer[x + y * xInputSize];
-        ++idx;
+        // Shadow model is non-zero for distances 0..shadowModelEnd
+        int shadowModelEnd = std::min(ny - 1 - y, ny - 6);
+        int shadowModelGaussianEnd = std::min(shadowModelEnd, shadowModelGaussianSize - 1);
+        double sumG = this->ShadowModelSum[ny - 1 - y];
+        for (int x = xStart; x < xEnd; ++x)
+        {
+          int pixelIdx = x + y * nx;
+
+          // Only include pixels with intensity value larger than a specified threshold
+          if (gaussian[pixelIdx] >= this->BoneThreshold && pixelIdx > this->TransducerMargin * nx)
+          {
+            // Set outermost border pixels to zero and exclude negative pixels
+            double laplacian = 0.0;
+            if (!(x == nx - 1 || x == 0 || y == ny - 1 || y == 0) && laplacianOfGaussian[pixelIdx] > 0)
+            {
+              // Divide by small number to increase image intensity
+              laplacian = laplacianOfGaussian[pixelIdx] / 0.005;
+            }
+
+            // Calculate reflection number
+            reflectionNumber[pixelIdx] = IntegerPower(gaussian[pixelIdx], this->BlurredVSBLoG) + laplacian;
+
+            // Calculate shadow value: sum of (1 - Gaussian) weighted intensities below the pixel
+            double sumGI = 0.0;
+            if (shadowModelEnd >= 0)
+            {
+              sumGI = columnSum[pixelIdx] - columnSum[pixelIdx + (shadowModelEnd + 1) * nx];
+              for (int i = 0; i <= shadowModelGaussianEnd; ++i)
+              {
+                sumGI -= shadowModelGaussian[i] * gaussian[pixelIdx + i * nx];
+              }
+            }
+            shadowValue[pixelIdx] = sumGI / sumG;
+          }
+          else
+          {
+            reflectionNumber[pixelIdx] = 0.0;
+            shadowValue[pixelIdx] = 0.0;
+          }
+        }
       }
+      break;
     }
+
+    case STEP_BONE_SURFACE_PROBABILITY:
+      for (int y = 0; y < ny; ++y)
+      {
+        for (int x = xStart; x < xEnd; ++x)
+        {
+          int pixelIdx = x + y * nx;
+          this->OutputSlice[pixelIdx] = IntegerPower(shadowValue[pixelIdx], this->ShadowVSIntensity) * reflectionNumber[pixelIdx];
+        }
+      }
+      break;
   }
 }
 
@@ -353,4 +420,4 @@ void vtkPlusForoughiBoneSurfaceProbability::Normalize(double* buffer, int size,
   {
     buffer[i] = maxValue - buffer[i] / maxPixelValue;
   }
-}
\ No newline at end of file
+}
@@ -18,20 +18,24 @@ Foroughi, P., et al. (2007) Ultrasound bone segmentation using dynamic programmi
 
 Implemented (with some modifications) by Mikael Brudfors, March 2014.
 
-The *Intel MKL* code uses double data at this moment, therefore input and output must be double scalar type image.
+Input and output must be double scalar type image.
 
-The module uses *OpenMP* and *Intel MKL*. A free trial of *Intel MKL* can be downloaded from here:
-
-[https://software.intel.com/en-us/intel-mkl/try-buy](https://software.intel.com/en-us/intel-mkl/try-buy)
+The shadow value of a pixel is the weighted mean of the blurred intensities below it. The weighting function
+is one minus a Gaussian, therefore the weighted sum is computed as a column sum minus a short Gaussian-weighted
+sum (the Gaussian is truncated where it drops below ShadowGaussianTruncationThreshold), which makes the
+computation time independent of the image depth. Columns are processed in parallel (see NumberOfThreads).
 
 \ingroup PlusLibImageProcessingAlgo
 */
 
 #include "vtkPlusImageProcessingExport.h"
 
+#include "vtkMultiThreader.h"
 #include "vtkSimpleImageToImageFilter.h"
 #include "vtkSmartPointer.h"
 
+#include <vector>
+
 class vtkPlusImageProcessingExport vtkPlusForoughiBoneSurfaceProbability : public vtkSimpleImageToImageFilter
 {
 public:
@@ -47,7 +51,7 @@ public:
   vtkGetMacro(BoneThreshold, double);
 
   /*! Standard deviation of the Gaussian weighting function which models the transition of high intensity pixels close to bone surface to the dark pixels deeper under the bone. */
-  vtkSetMacro(ShadowSigma, double);
+  virtual void SetShadowSigma(double shadowSigma);
   vtkGetMacro(ShadowSigma, double);
 
   /* Controls the ratio between the shadow map and the reflection number. */
@@ -55,23 +59,41 @@ public:
   vtkGetMacro(ShadowVSIntensity, int);
 
   /*! Defines the size of the Gaussian kernel used for blurring. */
-  vtkSetMacro(SmoothingSigma, double);
+  virtual void SetSmoothingSigma(double smoothingSigma);
   vtkGetMacro(SmoothingSigma, double);
 
   /*! Defines the number of rows to exclude from the top part of the image (close to the transducer head). */
   vtkSetMacro(TransducerMargin, int);
   vtkGetMacro(TransducerMargin, int);
 
+  /*! Number of threads used for processing image columns. Default is the number of processors. */
+  vtkSetClampMacro(NumberOfThreads, int, 1, VTK_MAX_THREADS);
+  vtkGetMacro(NumberOfThreads, int);
+
 protected:
   vtkPlusForoughiBoneSurfaceProbability();
   virtual ~vtkPlusForoughiBoneSurfaceProbability();
 
+  /*! Processing steps that are executed on all image columns before the next step can start */
+  enum ProcessingStep
+  {
+    STEP_GAUSSIAN_ROWS,
+    STEP_GAUSSIAN_COLUMNS,
+    STEP_LAPLACIAN,
+    STEP_REFLECTION_AND_SHADOW,
+    STEP_BONE_SURFACE_PROBABILITY
+  };
+
   void UpdateKernels();
-  void DeleteKernels();
 
-  void Foroughi2007(double* inputBuffer, double* outputBuffer, double smoothingSigma, int transducerMargin, double shadowSigma, double boneThreshold, int blurredVSBLoG, int shadowVSIntensity, int nx, int ny, int nz);
-  void Conv2(const double* inputBuffer, const double* kernelBuffer, double* tempBuffer, double* outputBuffer, int nx, int ny, int kx, int ky);
-  void ResizeMatrix(const double* inputBuffer, double* outputBuffer, int xClipping, int yClipping, int xInputSize, int yInputSize);
+  /*! Execute a processing step on the current slice, the columns are split between the threads */
+  void ExecuteStep(ProcessingStep step);
+
+  /*! Execute a processing step on the columns [xStart, xEnd) of the current slice */
+  void ExecuteStepOnColumns(ProcessingStep step, int xStart, int xEnd);
+
+  static VTK_THREAD_RETURN_TYPE ExecuteStepThread(void* arg);
+
   double GetMaxPixelValue(const double* buffer, int size);
   void Normalize(double* buffer, int size, bool doInverse, double maxValue = 1.0);
 
@@ -83,25 +105,42 @@ protected:
   int ShadowVSIntensity;
   double SmoothingSigma;
   int TransducerMargin;
+  int NumberOfThreads;
+
+  /*! Gaussian weights smaller than this (relative to the largest weight) are ignored when computing the shadow value */
+  static const double ShadowGaussianTruncationThreshold;
 
   bool KernelUpdateRequested;
 
-  int GaussianKernelSize;
   FrameSizeType FrameSize;
 
-  double* MklGaussianBuffer;
-  double* MklLaplacianOfGaussianBuffer;
-  double* MklGaussianBufferTemp;
-  double* MklLaplacianOfGaussianBufferTemp;
-  double* MklReflectionNumberBuffer;
-  double* MklShadowValueBuffer;
-  double* MklShadowModel;
-  double* MklGaussianKernel;
-  double* MklLaplacianKernel;
+  /*! Slice that is currently processed */
+  const double* InputSlice;
+  double* OutputSlice;
+  ProcessingStep CurrentStep;
+
+  std::vector<double> GaussianBuffer;
+  std::vector<double> GaussianBufferTemp;
+  std::vector<double> LaplacianOfGaussianBuffer;
+  std::vector<double> ReflectionNumberBuffer;
+  std::vector<double> ShadowValueBuffer;
+  /*! Sum of the blurred intensities from each pixel to the bottom of the column */
+  std::vector<double> GaussianColumnSumBuffer;
+
+  /*! One dimensional Gaussian kernel, the two dimensional smoothing kernel is its outer product */
+  std::vector<double> GaussianKernel;
+  /*! Shadow weighting function (one minus a Gaussian), as a function of the distance below the pixel */
+  std::vector<double> ShadowModel;
+  /*! Cumulative sum of ShadowModel */
+  std::vector<double> ShadowModelSum;
+  /*! The Gaussian part of ShadowModel (ShadowModel = 1 - ShadowModelGaussian), truncated */
+  std::vector<double> ShadowModelGaussian;
+
+  vtkSmartPointer<vtkMultiThreader> Threader;
 
 private:
   vtkPlusForoughiBoneSurfaceProbability(const vtkPlusForoughiBoneSurfaceProbability&);  // Not implemented.
   void operator=(const vtkPlusForoughiBoneSurfaceProbability&);  // Not implemented.
 };
 
-#endif
\ No newline at end of file
+#endif
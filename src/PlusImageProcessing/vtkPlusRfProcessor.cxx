@@ -12,6 +12,15 @@ See License.txt for details.
 #include "vtkPlusUsScanConvertLinear.h"
 #include "vtkPlusUsScanConvertCurvilinear.h"
 #include "vtkImageData.h"
+#include "vtkPointData.h"
+
+#include <algorithm>
+
+namespace
+{
+  /*! Number of scanlines processed together by the fused processing. The brightness values of a tile should fit into the cache. */
+  const int FUSED_PROCESSING_TILE_NUMBER_OF_LINES = 16;
+}
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkPlusRfProcessor);
@@ -24,6 +33,14 @@ vtkPlusRfProcessor::vtkPlusRfProcessor()
 {
   this->RfToBrightnessConverter=vtkPlusRfToBrightnessConvert::New();
   this->ScanConverter=NULL;  
+  this->FusedProcessing=false;
+  this->NumberOfThreads=vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  this->Threader=vtkSmartPointer<vtkMultiThreader>::New();
+  this->FusedOutputImage=vtkSmartPointer<vtkImageData>::New();
+  this->FusedInputImage=NULL;
+  this->FusedNumberOfLines=0;
+  this->FusedNumberOfSamplesPerLine=0;
+  this->FusedProcessingFailed=false;
 }
 
 //----------------------------------------------------------------------------
@@ -38,6 +55,8 @@ vtkPlusRfProcessor::~vtkPlusRfProcessor()
 void vtkPlusRfProcessor::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os,indent);
+  os << indent << "FusedProcessing: " << (this->FusedProcessing ? "true" : "false") << std::endl;
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << std::endl;
 }
 
 //-----------------------------------------------------------------------------
@@ -63,6 +82,15 @@ vtkImageData* vtkPlusRfProcessor::GetBrightnessScanConvertedImage()
     LOG_ERROR("Scan converter is not defined, skipping scan conversion");
     return GetBrightnessConvertedImage();
   }
+  if (this->FusedProcessing)
+  {
+    vtkImageData* fusedOutputImage = this->ComputeBrightnessScanConvertedImageFused();
+    if (fusedOutputImage != NULL)
+    {
+      return fusedOutputImage;
+    }
+    // fused processing is not available for this input, use the filters
+  }
   this->ScanConverter->Update();
   return this->ScanConverter->GetOutput();
 }
@@ -94,6 +122,9 @@ PlusStatus vtkPlusRfProcessor::ReadConfiguration(vtkXMLDataElement* rfProcessing
 
   PlusStatus status=PLUS_SUCCESS;
 
+  XML_READ_BOOL_ATTRIBUTE_OPTIONAL(FusedProcessing, rfProcessingElement);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, NumberOfThreads, rfProcessingElement);
+
   vtkXMLDataElement* brightnessConversionElement = rfProcessingElement->FindNestedElementWithName("RfToBrightnessConversion"); 
   if (brightnessConversionElement)
   {
@@ -168,6 +199,8 @@ PlusStatus vtkPlusRfProcessor::WriteConfiguration(vtkXMLDataElement* rfElement)
 
   PlusStatus status(PLUS_SUCCESS);
 
+  XML_WRITE_BOOL_ATTRIBUTE(FusedProcessing, rfElement);
+
   if ( this->RfToBrightnessConverter->WriteConfiguration(brightnessConversionElement) != PLUS_SUCCESS )
   {
     status = PLUS_FAIL;
@@ -195,3 +228,134 @@ const char* vtkPlusRfProcessor::GetRfProcessorTagName()
 {
   return vtkPlusRfProcessor::RF_PROCESSOR_TAG_NAME;
 }
+
+//-----------------------------------------------------------------------------
+vtkImageData* vtkPlusRfProcessor::ComputeBrightnessScanConvertedImageFused()
+{
+  vtkPlusUsScanConvertCurvilinear* scanConverter = vtkPlusUsScanConvertCurvilinear::SafeDownCast(this->ScanConverter);
+  vtkImageData* inputImage = vtkImageData::SafeDownCast(this->RfToBrightnessConverter->GetInput());
+  if (scanConverter == NULL || inputImage == NULL)
+  {
+    // Linear scan conversion is performed by vtkImageReslice, it is not implemented in the fused processing
+    return NULL;
+  }
+
+  int inputImageExtent[6] = {0, -1, 0, -1, 0, -1};
+  inputImage->GetExtent(inputImageExtent);
+  int brightnessImageExtent[6] = {0, -1, 0, -1, 0, -1};
+  if (inputImageExtent[5] > inputImageExtent[4]
+      || this->RfToBrightnessConverter->GetBrightnessImageExtent(inputImageExtent, brightnessImageExtent) != PLUS_SUCCESS)
+  {
+    return NULL;
+  }
+  this->FusedNumberOfSamplesPerLine = brightnessImageExtent[1] - brightnessImageExtent[0] + 1;
+  this->FusedNumberOfLines = brightnessImageExtent[3] - brightnessImageExtent[2] + 1;
+  if (this->FusedNumberOfSamplesPerLine < 1 || this->FusedNumberOfLines < 1)
+  {
+    return NULL;
+  }
+  if (scanConverter->UpdateScanLineInterpolatedPointArray(brightnessImageExtent) != PLUS_SUCCESS)
+  {
+    return NULL;
+  }
+
+  // Pixels that are not covered by the scanlines are zero
+  int* outputImageExtent = scanConverter->GetOutputImageExtent();
+  int currentOutputImageExtent[6] = {0, -1, 0, -1, 0, -1};
+  this->FusedOutputImage->GetExtent(currentOutputImageExtent);
+  if (!std::equal(currentOutputImageExtent, currentOutputImageExtent + 6, outputImageExtent)
+      || this->FusedOutputImage->GetScalarType() != VTK_UNSIGNED_CHAR
+      || this->FusedOutputImage->GetPointData()->GetScalars() == NULL)
+  {
+    this->FusedOutputImage->SetExtent(outputImageExtent);
+    this->FusedOutputImage->SetSpacing(1.0, 1.0, 1.0);
+    this->FusedOutputImage->SetOrigin(0.0, 0.0, 0.0);
+    this->FusedOutputImage->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  }
+  memset(this->FusedOutputImage->GetScalarPointer(), 0, this->FusedOutputImage->GetNumberOfPoints());
+
+  // Coefficients must be computed before the threads start using them
+  this->RfToBrightnessConverter->UpdateHilbertTransformCoeffs();
+
+  this->FusedInputImage = inputImage;
+  this->FusedProcessingFailed = false;
+  int numberOfThreads = std::max(1, std::min(this->NumberOfThreads, this->FusedNumberOfLines));
+  this->FusedTileBuffers.resize(numberOfThreads);
+  this->FusedWorkBuffers.resize(numberOfThreads);
+  if (numberOfThreads == 1)
+  {
+    this->ExecuteFusedProcessingOnLines(0, this->FusedNumberOfLines, 0);
+  }
+  else
+  {
+    this->Threader->SetNumberOfThreads(numberOfThreads);
+    this->Threader->SetSingleMethod(&vtkPlusRfProcessor::ExecuteFusedProcessingThread, this);
+    this->Threader->SingleMethodExecute();
+  }
+  this->FusedInputImage = NULL;
+
+  if (this->FusedProcessingFailed)
+  {
+    LOG_ERROR("Fused brightness and scan conversion failed, using the brightness and scan conversion filters");
+    return NULL;
+  }
+  this->FusedOutputImage->Modified();
+  return this->FusedOutputImage;
+}
+
+//-----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkPlusRfProcessor::ExecuteFusedProcessingThread(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  vtkPlusRfProcessor* self = static_cast<vtkPlusRfProcessor*>(threadInfo->UserData);
+  int numberOfLines = self->FusedNumberOfLines;
+  int firstLine = numberOfLines * threadInfo->ThreadID / threadInfo->NumberOfThreads;
+  int lastLine = numberOfLines * (threadInfo->ThreadID + 1) / threadInfo->NumberOfThreads;
+  self->ExecuteFusedProcessingOnLines(firstLine, lastLine, threadInfo->ThreadID);
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusRfProcessor::ExecuteFusedProcessingOnLines(int firstLine, int lastLine, int threadId)
+{
+  vtkPlusUsScanConvertCurvilinear* scanConverter = static_cast<vtkPlusUsScanConvertCurvilinear*>(this->ScanConverter);
+  const std::vector<vtkPlusUsScanConvertCurvilinear::InterpolatedPoint>& points = scanConverter->GetScanLineInterpolatedPointArray();
+  const std::vector<int>& lineOffsets = scanConverter->GetScanLineInterpolatedPointOffsets();
+  const int numberOfSamples = this->FusedNumberOfSamplesPerLine;
+  unsigned char* image = static_cast<unsigned char*>(this->FusedOutputImage->GetScalarPointer());
+
+  std::vector<unsigned char>& tileBuffer = this->FusedTileBuffers[threadId];
+  tileBuffer.resize((FUSED_PROCESSING_TILE_NUMBER_OF_LINES + 1) * numberOfSamples);
+
+  for (int tileFirstLine = firstLine; tileFirstLine < lastLine; tileFirstLine += FUSED_PROCESSING_TILE_NUMBER_OF_LINES)
+  {
+    int tileAfterLastLine = std::min(tileFirstLine + FUSED_PROCESSING_TILE_NUMBER_OF_LINES, lastLine);
+    if (lineOffsets[tileFirstLine] == lineOffsets[tileAfterLastLine])
+    {
+      // no output pixel is computed from this tile
+      continue;
+    }
+
+    // Points of the last scanline of the tile use the next scanline as well
+    int tileLastComputedLine = std::min(tileAfterLastLine, this->FusedNumberOfLines - 1);
+    if (this->RfToBrightnessConverter->ComputeBrightnessLines(this->FusedInputImage, tileFirstLine, tileLastComputedLine, &tileBuffer[0], this->FusedWorkBuffers[threadId]) != PLUS_SUCCESS)
+    {
+      this->FusedProcessingFailed = true;
+      return;
+    }
+
+    // Same computation as in vtkPlusUsScanConvertCurvilinear, but the envelope data is read from the tile
+    const unsigned char* envelopeData = &tileBuffer[0] - tileFirstLine * numberOfSamples;
+    std::vector<vtkPlusUsScanConvertCurvilinear::InterpolatedPoint>::const_iterator afterLastPoint = points.begin() + lineOffsets[tileAfterLastLine];
+    for (std::vector<vtkPlusUsScanConvertCurvilinear::InterpolatedPoint>::const_iterator it = points.begin() + lineOffsets[tileFirstLine]; it != afterLastPoint; ++it)
+    {
+      const unsigned char* env_pointer = envelopeData + it->inputPixelIndex;
+      image[it->outputPixelIndex] =
+        it->weightCoefficients[0] * env_pointer[0] // (+0, +0)
+        + it->weightCoefficients[1] * env_pointer[1] // (+1, +0)
+        + it->weightCoefficients[2] * env_pointer[numberOfSamples] // (+0, +1)
+        + it->weightCoefficients[3] * env_pointer[numberOfSamples + 1] // (+1, +1)
+        + 0.5; // for rounding
+    }
+  }
+}
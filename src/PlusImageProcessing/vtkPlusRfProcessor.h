@@ -9,6 +9,11 @@
 
 #include "vtkPlusImageProcessingExport.h"
 
+#include <vtkMultiThreader.h>
+#include <vtkSmartPointer.h>
+
+#include <vector>
+
 class vtkPlusRfToBrightnessConvert;
 class vtkPlusUsScanConvert;
 class vtkImageData;
@@ -16,6 +21,12 @@ class vtkImageData;
 /*!
   \class vtkPlusRfProcessor 
   \brief Convenience class to combine multiple algorithms to compute a displayable B-mode frame from RF data
+
+  By default brightness conversion and scan conversion are performed by two separate VTK filters, with a full intermediate
+  brightness image between them. If FusedProcessing is enabled (and the transducer geometry is curvilinear) then worker threads
+  compute the brightness values of a few scanlines at a time and immediately resample them into the scan converted image, so the
+  intermediate image is never created. The result is the same as the result of the two filters.
+
   \ingroup PlusLibImageProcessingAlgo
 */ 
 class vtkPlusImageProcessingExport vtkPlusRfProcessor : public vtkObject
@@ -53,6 +64,18 @@ public:
 
   static const char* GetRfProcessorTagName();
 
+  /*!
+    If enabled then brightness and scan conversion is computed in one pass, without creating the intermediate brightness image.
+    Only supported for curvilinear transducer geometry, otherwise the filters are used. Default is disabled.
+  */
+  vtkSetMacro(FusedProcessing, bool);
+  vtkGetMacro(FusedProcessing, bool);
+  vtkBooleanMacro(FusedProcessing, bool);
+
+  /*! Number of threads used by the fused processing. Default is the number of processors. */
+  vtkSetClampMacro(NumberOfThreads, int, 1, VTK_MAX_THREADS);
+  vtkGetMacro(NumberOfThreads, int);
+
 protected:
   vtkPlusRfProcessor();
   virtual ~vtkPlusRfProcessor(); 
@@ -63,6 +86,35 @@ protected:
   std::vector<vtkPlusUsScanConvert*> AvailableScanConverters;  
 
   static const char* RF_PROCESSOR_TAG_NAME;
+
+  /*!
+    Compute the brightness and scan converted image in one pass.
+    Returns NULL if the fused processing is not supported for the current input and scan converter.
+  */
+  vtkImageData* ComputeBrightnessScanConvertedImageFused();
+
+  /*! Compute brightness values for scanlines [firstLine, lastLine) in tiles and resample them into the output image */
+  void ExecuteFusedProcessingOnLines(int firstLine, int lastLine, int threadId);
+
+  static VTK_THREAD_RETURN_TYPE ExecuteFusedProcessingThread(void* arg);
+
+  bool FusedProcessing;
+  int NumberOfThreads;
+
+  vtkSmartPointer<vtkMultiThreader> Threader;
+
+  /*! Output of the fused processing */
+  vtkSmartPointer<vtkImageData> FusedOutputImage;
+
+  /*! Input image and brightness image size of the frame that is currently processed */
+  vtkImageData* FusedInputImage;
+  int FusedNumberOfLines;
+  int FusedNumberOfSamplesPerLine;
+  bool FusedProcessingFailed;
+
+  /*! Brightness lines of the current tile and working buffer of the brightness conversion, for each thread */
+  std::vector<std::vector<unsigned char> > FusedTileBuffers;
+  std::vector<std::vector<unsigned char> > FusedWorkBuffers;
 }; 
 
 #endif
@@ -46,11 +46,32 @@ int vtkPlusRfToBrightnessConvert::RequestInformation(vtkInformation*,
       
   int inExt[6]={0};
   inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), inExt);
-  
-  // Set the output extent to be the same as the input extent by default
+
   int outExt[6]={0};
-  inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), outExt);
-  
+  if (this->GetBrightnessImageExtent(inExt, outExt)!=PLUS_SUCCESS)
+  {
+    vtkErrorMacro("Unknown RF image type: " << this->ImageType);
+    return 0;
+  }
+
+  // Set the updated output image size
+  outInfo->Set(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(),outExt,6);
+
+  // Output is B-mode image, the pixel type is always unsigned 8-bit integer
+  vtkDataObject::SetPointDataActiveScalarInfo(outInfo, VTK_UNSIGNED_CHAR, -1);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusRfToBrightnessConvert::GetBrightnessImageExtent(const int rfImageExtent[6], int brightnessImageExtent[6])
+{
+  // Set the output extent to be the same as the input extent by default
+  for (int i=0; i<6; i++)
+  {
+    brightnessImageExtent[i]=rfImageExtent[i];
+  }
+
   // Update the output image extent depending on the RF encoding type
   switch (this->ImageType)
   {
@@ -64,9 +85,9 @@ int vtkPlusRfToBrightnessConvert::RequestInformation(vtkInformation*,
       // RF data: IIIIII..., QQQQQQ....
       // B-mode data: BBBBBB
       // => number of rows in the output image is half of the rows in the input image
-      int numberOfBmodeRows=(inExt[3]-inExt[2]+1)/2;
-      outExt[2] = inExt[2]/2;
-      outExt[3] = outExt[2] + numberOfBmodeRows - 1;
+      int numberOfBmodeRows=(rfImageExtent[3]-rfImageExtent[2]+1)/2;
+      brightnessImageExtent[2] = rfImageExtent[2]/2;
+      brightnessImageExtent[3] = brightnessImageExtent[2] + numberOfBmodeRows - 1;
     }
     break;
   case US_IMG_RF_REAL:
@@ -82,23 +103,130 @@ int vtkPlusRfToBrightnessConvert::RequestInformation(vtkInformation*,
       // RF data: IQIQIQ....., IQIQIQ.....
       // B-mode data: BBB..., BBB...
       // => number of columns in the output image is half of the columns in the input image
-      int numberOfBmodeColumns=(inExt[1]-inExt[0]+1)/2;
-      outExt[0] = inExt[0]/2;
-      outExt[1] = outExt[0] + numberOfBmodeColumns - 1;
+      int numberOfBmodeColumns=(rfImageExtent[1]-rfImageExtent[0]+1)/2;
+      brightnessImageExtent[0] = rfImageExtent[0]/2;
+      brightnessImageExtent[1] = brightnessImageExtent[0] + numberOfBmodeColumns - 1;
     }
     break;
   default:
-    vtkErrorMacro("Unknown RF image type: " << this->ImageType);
-    return 0;
-    }
+    return PLUS_FAIL;
+  }
+  return PLUS_SUCCESS;
+}
 
-  // Set the updated output image size
-  outInfo->Set(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(),outExt,6);
+//----------------------------------------------------------------------------
+void vtkPlusRfToBrightnessConvert::UpdateHilbertTransformCoeffs()
+{
+  this->ComputeHilbertTransformCoeffs();
+}
 
-  // Output is B-mode image, the pixel type is always unsigned 8-bit integer
-  vtkDataObject::SetPointDataActiveScalarInfo(outInfo, VTK_UNSIGNED_CHAR, -1);
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusRfToBrightnessConvert::ComputeBrightnessLines(vtkImageData* rfImage, int firstLine, int lastLine, unsigned char* brightnessLines, std::vector<unsigned char>& workBuffer)
+{
+  if (rfImage==NULL || rfImage->GetNumberOfScalarComponents()!=1)
+  {
+    LOG_ERROR("vtkPlusRfToBrightnessConvert::ComputeBrightnessLines failed: expecting a single component RF image");
+    return PLUS_FAIL;
+  }
+  switch (rfImage->GetScalarType())
+  {
+  case VTK_SHORT:
+    return ComputeBrightnessLinesForScalarType<short>(rfImage, firstLine, lastLine, brightnessLines, workBuffer);
+  case VTK_INT:
+    return ComputeBrightnessLinesForScalarType<int>(rfImage, firstLine, lastLine, brightnessLines, workBuffer);
+  case VTK_UNSIGNED_CHAR:
+    return ComputeBrightnessLinesForScalarType<unsigned char>(rfImage, firstLine, lastLine, brightnessLines, workBuffer);
+  default:
+    LOG_ERROR("vtkPlusRfToBrightnessConvert::ComputeBrightnessLines failed: unsupported pixel type "<<rfImage->GetScalarTypeAsString());
+    return PLUS_FAIL;
+  }
+}
 
-  return 1;
+//----------------------------------------------------------------------------
+template<typename ScalarType>
+PlusStatus vtkPlusRfToBrightnessConvert::ComputeBrightnessLinesForScalarType(vtkImageData* rfImage, int firstLine, int lastLine, unsigned char* brightnessLines, std::vector<unsigned char>& workBuffer)
+{
+  int rfImageExtent[6]={0};
+  rfImage->GetExtent(rfImageExtent);
+  int brightnessImageExtent[6]={0};
+  if (this->GetBrightnessImageExtent(rfImageExtent, brightnessImageExtent)!=PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unsupported image type for brightness conversion: "<<igsioVideoFrame::GetStringFromUsImageType(this->ImageType));
+    return PLUS_FAIL;
+  }
+  if (rfImageExtent[5]>rfImageExtent[4])
+  {
+    LOG_ERROR("vtkPlusRfToBrightnessConvert::ComputeBrightnessLines failed: only single-slice RF images are supported");
+    return PLUS_FAIL;
+  }
+  if (firstLine<0 || lastLine>brightnessImageExtent[3]-brightnessImageExtent[2])
+  {
+    LOG_ERROR("vtkPlusRfToBrightnessConvert::ComputeBrightnessLines failed: invalid line range "<<firstLine<<"-"<<lastLine);
+    return PLUS_FAIL;
+  }
+
+  const int numberOfRfSamplesInScanline=rfImageExtent[1]-rfImageExtent[0]+1;
+  const int numberOfBmodeSamplesInScanline=brightnessImageExtent[1]-brightnessImageExtent[0]+1;
+  ScalarType* rfPixels=static_cast<ScalarType*>(rfImage->GetScalarPointer());
+  unsigned char* outPtr=brightnessLines;
+
+  if (this->ImageType==US_IMG_BRIGHTNESS)
+  {
+    if (rfImage->GetScalarType()!=VTK_UNSIGNED_CHAR)
+    {
+      LOG_ERROR("vtkPlusRfToBrightnessConvert::ComputeBrightnessLines failed: brightness image pixel type must be unsigned char");
+      return PLUS_FAIL;
+    }
+    for (int line=firstLine; line<=lastLine; ++line)
+    {
+      memcpy(outPtr, rfPixels+line*numberOfRfSamplesInScanline, numberOfRfSamplesInScanline);
+      outPtr += numberOfBmodeSamplesInScanline;
+    }
+    return PLUS_SUCCESS;
+  }
+
+  // Temporary buffer to hold Hilbert transform results
+  workBuffer.resize((numberOfRfSamplesInScanline + 1) * sizeof(ScalarType));
+  ScalarType* hilbertTransformBuffer = reinterpret_cast<ScalarType*>(&workBuffer[0]);
+
+  PlusStatus status=PLUS_SUCCESS;
+  for (int line=firstLine; line<=lastLine; ++line)
+  {
+    switch (this->ImageType)
+    {
+    case US_IMG_RF_I_LINE_Q_LINE:
+      {
+        // RF data: IIIIIII..., QQQQQQ...., IIIIIII..., QQQQQQ....
+        ScalarType *originalSignal=rfPixels+(2*line)*numberOfRfSamplesInScanline;
+        ScalarType *phaseShiftedSignal=originalSignal+numberOfRfSamplesInScanline;
+        ComputeAmplitudeILineQLine(outPtr, originalSignal, phaseShiftedSignal, numberOfRfSamplesInScanline);
+      }
+      break;
+    case US_IMG_RF_REAL:
+      {
+        // RF data: IIIII..., IIIII...
+        ScalarType *inPtr=rfPixels+line*numberOfRfSamplesInScanline;
+        if (ComputeHilbertTransform(hilbertTransformBuffer, inPtr, numberOfRfSamplesInScanline)!=PLUS_SUCCESS)
+        {
+          status=PLUS_FAIL;
+        }
+        ComputeAmplitudeILineQLine(outPtr, inPtr, hilbertTransformBuffer, numberOfRfSamplesInScanline);
+      }
+      break;
+    case US_IMG_RF_IQ_LINE:
+      {
+        // RF data: IQIQIQ....., IQIQIQIQ.....
+        // Use the same number of samples as the filter: two samples for each brightness pixel
+        ComputeAmplitudeIqLine(outPtr, rfPixels+line*numberOfRfSamplesInScanline, 2*numberOfBmodeSamplesInScanline);
+      }
+      break;
+    default:
+      LOG_ERROR("Unsupported image type for brightness conversion: "<<igsioVideoFrame::GetStringFromUsImageType(this->ImageType));
+      return PLUS_FAIL;
+    }
+    outPtr += numberOfBmodeSamplesInScanline;
+  }
+  return status;
 }
 
 //----------------------------------------------------------------------------
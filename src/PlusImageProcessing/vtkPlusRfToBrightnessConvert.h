@@ -56,6 +56,23 @@ public:
   vtkSetMacro(BrightnessScale, double);
   vtkGetMacro(BrightnessScale, double);
 
+  /*! Get the extent of the brightness image that is computed from an RF image of the specified extent (depends on ImageType) */
+  PlusStatus GetBrightnessImageExtent(const int rfImageExtent[6], int brightnessImageExtent[6]);
+
+  /*!
+    Compute the Hilbert transform coefficients for the current NumberOfHilbertFilterCoeffs.
+    Must be called before ComputeBrightnessLines is called from multiple threads.
+  */
+  void UpdateHilbertTransformCoeffs();
+
+  /*!
+    Compute the brightness values of scanlines [firstLine, lastLine] of an RF image, without running the VTK pipeline.
+    The result is the same as rows [firstLine, lastLine] of the filter output. Lines are written one after the other
+    into brightnessLines (number of samples per line is the brightness image width). The method can be called
+    from multiple threads at the same time, with a separate workBuffer for each thread.
+  */
+  PlusStatus ComputeBrightnessLines(vtkImageData* rfImage, int firstLine, int lastLine, unsigned char* brightnessLines, std::vector<unsigned char>& workBuffer);
+
 protected:
   vtkPlusRfToBrightnessConvert();
   ~vtkPlusRfToBrightnessConvert();
@@ -77,6 +94,10 @@ protected:
   template<typename ScalarType>
   void ThreadedLineByLineHilbertTransform(int inExt[6], int outExt[6], vtkImageData ***inData, vtkImageData **outData, int threadId);
 
+  /*! Essentially, a templated version of ComputeBrightnessLines */
+  template<typename ScalarType>
+  PlusStatus ComputeBrightnessLinesForScalarType(vtkImageData* rfImage, int firstLine, int lastLine, unsigned char* brightnessLines, std::vector<unsigned char>& workBuffer);
+
   /*! Compute the Hilbert transform (90 deg phase shift) of a signal */
   template<typename ScalarType>
   PlusStatus ComputeHilbertTransform(ScalarType *hilbertTransformOutput, ScalarType *input, int npt);
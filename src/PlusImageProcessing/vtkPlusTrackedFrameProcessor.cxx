@@ -9,8 +9,12 @@ See License.txt for details.
 #include "vtkPlusTrackedFrameProcessor.h"
 #include "vtkIGSIOTrackedFrameList.h"
 #include "vtkIGSIOTransformRepository.h"
+#include "vtkPlusSequenceStreamReader.h"
+#include "vtkPlusSequenceStreamWriter.h"
 #include "igsioCommon.h"
 
+#include <vtkXMLDataElement.h>
+
 //----------------------------------------------------------------------------
 vtkCxxSetObjectMacro( vtkPlusTrackedFrameProcessor, InputFrames, vtkIGSIOTrackedFrameList );
 vtkCxxSetObjectMacro( vtkPlusTrackedFrameProcessor, TransformRepository, vtkIGSIOTransformRepository );
@@ -22,6 +26,10 @@ vtkPlusTrackedFrameProcessor::vtkPlusTrackedFrameProcessor()
   this->InputFrames = NULL;
   this->TransformRepository = NULL;
   this->OutputFrames = vtkIGSIOTrackedFrameList::New();
+  this->NumberOfWorkerThreads = 1;
+  this->MaxNumberOfFramesInMemory = 50;
+  this->NextFrameIndex = 0;
+  this->FrameThreader = vtkSmartPointer<vtkMultiThreader>::New();
 }
 
 //----------------------------------------------------------------------------
@@ -37,12 +45,16 @@ vtkPlusTrackedFrameProcessor::~vtkPlusTrackedFrameProcessor()
 void vtkPlusTrackedFrameProcessor::PrintSelf( ostream& os, vtkIndent indent )
 {
   this->Superclass::PrintSelf( os, indent );
+  os << indent << "NumberOfWorkerThreads: " << this->NumberOfWorkerThreads << std::endl;
+  os << indent << "MaxNumberOfFramesInMemory: " << this->MaxNumberOfFramesInMemory << std::endl;
 }
 
 //-----------------------------------------------------------------------------
 PlusStatus vtkPlusTrackedFrameProcessor::ReadConfiguration( vtkXMLDataElement* processingElement )
 {
   XML_VERIFY_ELEMENT( processingElement, this->GetTagName() );
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL( int, NumberOfWorkerThreads, processingElement );
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL( int, MaxNumberOfFramesInMemory, processingElement );
   return PLUS_SUCCESS;
 }
 
@@ -63,31 +75,223 @@ PlusStatus vtkPlusTrackedFrameProcessor::Update()
     // nothing to do
     return PLUS_SUCCESS;
   }
+
+  std::vector<vtkSmartPointer<vtkPlusTrackedFrameProcessor> > workers;
+  if ( this->CreateWorkerProcessors( workers ) != PLUS_SUCCESS )
+  {
+    return PLUS_FAIL;
+  }
+  return this->ProcessInputFrames( workers );
+}
+
+//-----------------------------------------------------------------------------
+vtkPlusTrackedFrameProcessor* vtkPlusTrackedFrameProcessor::CreateWorkerProcessor()
+{
+  vtkPlusTrackedFrameProcessor* worker = this->NewInstance();
+
+  vtkSmartPointer<vtkXMLDataElement> processingElement = vtkSmartPointer<vtkXMLDataElement>::New();
+  processingElement->SetName( this->GetTagName() );
+  if ( this->WriteConfiguration( processingElement ) != PLUS_SUCCESS || worker->ReadConfiguration( processingElement ) != PLUS_SUCCESS )
+  {
+    LOG_ERROR( "Failed to copy configuration of " << this->GetProcessorTypeName() << " to worker processor" );
+    worker->Delete();
+    return NULL;
+  }
+  worker->SetNumberOfWorkerThreads( 1 );
+
+  if ( this->TransformRepository != NULL )
+  {
+    // Each worker updates the transforms from its own frames, therefore the repository cannot be shared
+    vtkSmartPointer<vtkIGSIOTransformRepository> transformRepository = vtkSmartPointer<vtkIGSIOTransformRepository>::New();
+    transformRepository->DeepCopy( this->TransformRepository, true );
+    worker->SetTransformRepository( transformRepository );
+  }
+
+  return worker;
+}
+
+//-----------------------------------------------------------------------------
+PlusStatus vtkPlusTrackedFrameProcessor::CreateWorkerProcessors( std::vector<vtkSmartPointer<vtkPlusTrackedFrameProcessor> >& workers )
+{
+  workers.clear();
+  workers.push_back( this );
+  if ( this->NumberOfWorkerThreads <= 1 )
+  {
+    return PLUS_SUCCESS;
+  }
+  if ( !this->IsFrameParallelProcessingSupported() )
+  {
+    LOG_DEBUG( this->GetProcessorTypeName() << " does not support parallel processing of frames in its current configuration, frames are processed one by one" );
+    return PLUS_SUCCESS;
+  }
+  for ( int workerIndex = 1; workerIndex < this->NumberOfWorkerThreads; ++workerIndex )
+  {
+    vtkPlusTrackedFrameProcessor* worker = this->CreateWorkerProcessor();
+    if ( worker == NULL )
+    {
+      workers.clear();
+      return PLUS_FAIL;
+    }
+    workers.push_back( vtkSmartPointer<vtkPlusTrackedFrameProcessor>::Take( worker ) );
+  }
+  return PLUS_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+PlusStatus vtkPlusTrackedFrameProcessor::ProcessInputFrames( std::vector<vtkSmartPointer<vtkPlusTrackedFrameProcessor> >& workers )
+{
+  this->OutputFrames->Clear();
+  if ( this->InputFrames == NULL || this->InputFrames->GetNumberOfTrackedFrames() == 0 )
+  {
+    return PLUS_SUCCESS;
+  }
+  unsigned int numberOfFrames = this->InputFrames->GetNumberOfTrackedFrames();
+
+  // Create a clone of each input frame in the output buffer, so that the output frames are in the same order as the input frames
+  // regardless of which worker processes them
+  // TODO: not very efficient that we copy the image data as well, we could just instantiate an empty output frame
+  for ( unsigned int frameIndex = 0; frameIndex < numberOfFrames; frameIndex++ )
+  {
+    this->OutputFrames->AddTrackedFrame( this->InputFrames->GetTrackedFrame( frameIndex ) );
+  }
+
+  this->ActiveWorkers.clear();
+  for ( std::vector<vtkSmartPointer<vtkPlusTrackedFrameProcessor> >::iterator workerIt = workers.begin(); workerIt != workers.end(); ++workerIt )
+  {
+    this->ActiveWorkers.push_back( *workerIt );
+  }
+  this->FrameProcessingResults.assign( numberOfFrames, FRAME_PROCESSING_SUCCESS );
+  this->NextFrameIndex = 0;
+
+  int numberOfThreads = std::min<int>( this->ActiveWorkers.size(), numberOfFrames );
+  if ( numberOfThreads <= 1 )
+  {
+    this->ProcessInputFramesWithWorker( 0 );
+  }
+  else
+  {
+    this->FrameThreader->SetNumberOfThreads( numberOfThreads );
+    this->FrameThreader->SetSingleMethod( &vtkPlusTrackedFrameProcessor::ProcessInputFramesThread, this );
+    this->FrameThreader->SingleMethodExecute();
+  }
+  this->ActiveWorkers.clear();
+
+  // Frames that could not be processed because of missing transforms are not included in the output
   PlusStatus status = PLUS_SUCCESS;
-  for ( unsigned int frameIndex = 0; frameIndex < this->InputFrames->GetNumberOfTrackedFrames(); frameIndex++ )
+  for ( int frameIndex = numberOfFrames - 1; frameIndex >= 0; frameIndex-- )
   {
+    if ( this->FrameProcessingResults[frameIndex] == FRAME_TRANSFORMS_INVALID )
+    {
+      this->OutputFrames->RemoveTrackedFrameRange( frameIndex, frameIndex );
+    }
+    if ( this->FrameProcessingResults[frameIndex] != FRAME_PROCESSING_SUCCESS )
+    {
+      status = PLUS_FAIL;
+    }
+  }
+
+  return status;
+}
+
+//-----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkPlusTrackedFrameProcessor::ProcessInputFramesThread( void* arg )
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>( arg );
+  vtkPlusTrackedFrameProcessor* self = static_cast<vtkPlusTrackedFrameProcessor*>( threadInfo->UserData );
+  self->ProcessInputFramesWithWorker( threadInfo->ThreadID );
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//-----------------------------------------------------------------------------
+void vtkPlusTrackedFrameProcessor::ProcessInputFramesWithWorker( int workerIndex )
+{
+  vtkPlusTrackedFrameProcessor* worker = this->ActiveWorkers[workerIndex];
+  unsigned int numberOfFrames = this->InputFrames->GetNumberOfTrackedFrames();
+  while ( true )
+  {
+    unsigned int frameIndex = 0;
+    {
+      igsioLockGuard<vtkIGSIOSimpleRecursiveCriticalSection> nextFrameIndexGuard( &this->NextFrameIndexMutex );
+      if ( this->NextFrameIndex >= numberOfFrames )
+      {
+        return;
+      }
+      frameIndex = this->NextFrameIndex++;
+    }
+
     igsioTrackedFrame* inputFrame = this->InputFrames->GetTrackedFrame( frameIndex );
+    igsioTrackedFrame* outputFrame = this->OutputFrames->GetTrackedFrame( frameIndex );
 
     // Update the transform repository with the tracking information in the frame.
     // After this we can query any transform from the repository.
-    if ( this->TransformRepository && this->TransformRepository->SetTransforms( *inputFrame ) != PLUS_SUCCESS )
+    if ( worker->TransformRepository && worker->TransformRepository->SetTransforms( *inputFrame ) != PLUS_SUCCESS )
     {
       LOG_ERROR( "Failed to set repository transforms from tracked frame!" );
-      status = PLUS_FAIL;
+      this->FrameProcessingResults[frameIndex] = FRAME_TRANSFORMS_INVALID;
       continue;
     }
- 
-    // Create a clone of the input frame in the output buffer
-    // TODO: not very efficient that we copy the image data as well, we could just instantiate an empty output frame
-    this->OutputFrames->AddTrackedFrame( inputFrame );
-    igsioTrackedFrame* outputFrame = this->OutputFrames->GetTrackedFrame( this->OutputFrames->GetNumberOfTrackedFrames() - 1 ); // the last frame that just has been added
 
     // Do the actual processing
-    if ( this->ProcessFrame( inputFrame, outputFrame ) != PLUS_SUCCESS )
+    if ( worker->ProcessFrame( inputFrame, outputFrame ) != PLUS_SUCCESS )
     {
+      this->FrameProcessingResults[frameIndex] = FRAME_PROCESSING_FAILED;
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+PlusStatus vtkPlusTrackedFrameProcessor::ProcessSequenceFile( const std::string& inputFileName, const std::string& outputFileName, bool useCompression /*=false*/ )
+{
+  vtkSmartPointer<vtkPlusSequenceStreamReader> reader = vtkSmartPointer<vtkPlusSequenceStreamReader>::New();
+  if ( reader->Open( inputFileName ) != PLUS_SUCCESS )
+  {
+    LOG_ERROR( "Failed to open input sequence file: " << inputFileName );
+    return PLUS_FAIL;
+  }
+  vtkSmartPointer<vtkPlusSequenceStreamWriter> writer = vtkSmartPointer<vtkPlusSequenceStreamWriter>::New();
+  if ( writer->Open( outputFileName, useCompression ) != PLUS_SUCCESS )
+  {
+    LOG_ERROR( "Failed to create output sequence file: " << outputFileName );
+    return PLUS_FAIL;
+  }
+
+  // Workers are created once and reused for all chunks
+  std::vector<vtkSmartPointer<vtkPlusTrackedFrameProcessor> > workers;
+  if ( this->CreateWorkerProcessors( workers ) != PLUS_SUCCESS )
+  {
+    return PLUS_FAIL;
+  }
+
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> inputFrames = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  this->SetInputFrames( inputFrames );
+  PlusStatus status = PLUS_SUCCESS;
+  while ( !reader->IsEndOfSequence() )
+  {
+    inputFrames->Clear();
+    if ( reader->ReadNextFrames( inputFrames, this->MaxNumberOfFramesInMemory ) != PLUS_SUCCESS )
+    {
+      LOG_ERROR( "Failed to read frames from " << inputFileName << " (after frame " << reader->GetNumberOfFramesRead() << ")" );
+      status = PLUS_FAIL;
+      break;
+    }
+    if ( this->ProcessInputFrames( workers ) != PLUS_SUCCESS )
+    {
+      status = PLUS_FAIL;
+    }
+    if ( writer->WriteFrames( this->OutputFrames ) != PLUS_SUCCESS )
+    {
+      LOG_ERROR( "Failed to write processed frames to " << outputFileName );
       status = PLUS_FAIL;
+      break;
     }
+    LOG_DEBUG( "Processed " << reader->GetNumberOfFramesRead() << " / " << reader->GetNumberOfFrames() << " frames" );
   }
 
+  if ( writer->Close() != PLUS_SUCCESS )
+  {
+    status = PLUS_FAIL;
+  }
+  inputFrames->Clear();
+  this->OutputFrames->Clear();
   return status;
-}
\ No newline at end of file
+}
@@ -9,6 +9,11 @@
 
 #include "vtkPlusImageProcessingExport.h"
 
+#include <vtkMultiThreader.h>
+#include <vtkSmartPointer.h>
+
+#include <vector>
+
 //class igsioTrackedFrame; 
 //class vtkIGSIOTrackedFrameList;
 //class vtkIGSIOTransformRepository;
@@ -16,6 +21,12 @@
 /*!
   \class vtkPlusTrackedFrameProcessor 
   \brief Simple interface class to allow running various algorithms that process tracked frame lists
+
+  If NumberOfWorkerThreads is larger than one then the frames are processed in parallel by clones of the processor
+  (see CreateWorkerProcessor). Output frames are in the same order as the input frames. ProcessSequenceFile reads,
+  processes and writes a sequence file in chunks of MaxNumberOfFramesInMemory frames, so that long sequences can be
+  processed without loading the whole sequence into memory.
+
   \ingroup PlusLibImageProcessingAlgo
 */ 
 class vtkPlusImageProcessingExport vtkPlusTrackedFrameProcessor : public vtkObject
@@ -43,6 +54,30 @@ public:
   /*! Get the processed output data. Perform processing if needed. */
   vtkGetObjectMacro(OutputFrames, vtkIGSIOTrackedFrameList);
 
+  /*!
+    Read frames from the input file, process them, and write the results to the output file. At most MaxNumberOfFramesInMemory
+    input frames are kept in memory at a time (all frames are read at once if the input file format does not support reading
+    frames one by one, see vtkPlusSequenceStreamReader). InputFrames and OutputFrames are used as working buffers.
+  */
+  virtual PlusStatus ProcessSequenceFile(const std::string& inputFileName, const std::string& outputFileName, bool useCompression = false);
+
+  /*!
+    Number of frames processed in parallel. Each additional thread uses a clone of this processor and of the transform repository.
+    Default is 1 (frames are processed one by one in the calling thread).
+  */
+  vtkSetClampMacro(NumberOfWorkerThreads, int, 1, VTK_MAX_THREADS);
+  vtkGetMacro(NumberOfWorkerThreads, int);
+
+  /*! Maximum number of input frames that ProcessSequenceFile keeps in memory. Default is 50. */
+  vtkSetClampMacro(MaxNumberOfFramesInMemory, int, 1, VTK_INT_MAX);
+  vtkGetMacro(MaxNumberOfFramesInMemory, int);
+
+  /*!
+    Returns true if frames can be processed in parallel by clones of this processor. Processors that accumulate information
+    from multiple frames must return false.
+  */
+  virtual bool IsFrameParallelProcessingSupported() { return true; };
+
   /*! Read configuration from xml data */
   virtual PlusStatus ReadConfiguration(vtkXMLDataElement* processingElement); 
 
@@ -65,9 +100,45 @@ protected:
   */
   virtual PlusStatus ProcessFrame(igsioTrackedFrame* inputFrame, igsioTrackedFrame* outputFrame) = 0;
 
+  /*!
+    Create a processor that can process frames in a separate worker thread. The default implementation creates a new instance
+    of the same class, copies the configuration through WriteConfiguration/ReadConfiguration, and gives it a copy of the transform repository.
+    The caller is responsible for deleting the returned object.
+  */
+  virtual vtkPlusTrackedFrameProcessor* CreateWorkerProcessor();
+
+  /*! Create worker processors for the current NumberOfWorkerThreads. The first worker is this object. */
+  PlusStatus CreateWorkerProcessors(std::vector<vtkSmartPointer<vtkPlusTrackedFrameProcessor> >& workers);
+
+  /*! Process all input frames using the provided worker processors */
+  PlusStatus ProcessInputFrames(std::vector<vtkSmartPointer<vtkPlusTrackedFrameProcessor> >& workers);
+
+  /*! Process input frames until there are no more frames left, using the worker with the specified index */
+  void ProcessInputFramesWithWorker(int workerIndex);
+
+  static VTK_THREAD_RETURN_TYPE ProcessInputFramesThread(void* arg);
+
   vtkIGSIOTrackedFrameList* InputFrames;
   vtkIGSIOTransformRepository *TransformRepository;
   vtkIGSIOTrackedFrameList* OutputFrames;
+
+  int NumberOfWorkerThreads;
+  int MaxNumberOfFramesInMemory;
+
+  /*! Result of processing each frame */
+  enum FrameProcessingResult
+  {
+    FRAME_PROCESSING_SUCCESS,
+    FRAME_PROCESSING_FAILED,
+    FRAME_TRANSFORMS_INVALID
+  };
+
+  /*! Processing state shared between worker threads */
+  std::vector<vtkPlusTrackedFrameProcessor*> ActiveWorkers;
+  std::vector<FrameProcessingResult> FrameProcessingResults;
+  unsigned int NextFrameIndex;
+  vtkIGSIOSimpleRecursiveCriticalSection NextFrameIndexMutex;
+  vtkSmartPointer<vtkMultiThreader> FrameThreader;
 }; 
 
 #endif
@@ -43,6 +43,7 @@ vtkPlusUsScanConvertCurvilinear::vtkPlusUsScanConvertCurvilinear()
   this->ThetaStartDeg = -30.0;
   this->ThetaStopDeg = 30.0;
   this->OutputIntensityScaling = 1.0;
+  this->ScanLineInterpolatedPointArrayValid = false;
 
   // Values that are used for computing the InterpolatedPointArray
   this->InterpInputImageExtent[0] = 0;
@@ -140,6 +141,7 @@ void vtkPlusUsScanConvertCurvilinear::ComputeInterpolatedPointArray(
   // Compute the interpolated point array now
 
   this->InterpolatedPointArray.clear();
+  this->ScanLineInterpolatedPointArrayValid = false;
 
   int numberOfSamples = inputImageExtent[1] - inputImageExtent[0] + 1;
   int numberOfLines = inputImageExtent[3] - inputImageExtent[2] + 1;
@@ -201,6 +203,45 @@ void vtkPlusUsScanConvertCurvilinear::ComputeInterpolatedPointArray(
 
 }
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusUsScanConvertCurvilinear::UpdateScanLineInterpolatedPointArray( int inputImageExtent[6] )
+{
+  ComputeInterpolatedPointArray( inputImageExtent, this->RadiusStartMm, this->RadiusStopMm, this->ThetaStartDeg, this->ThetaStopDeg,
+                                 this->OutputImageExtent, this->OutputImageSpacing, this->TransducerCenterPixel, this->OutputIntensityScaling );
+  if ( this->ScanLineInterpolatedPointArrayValid )
+  {
+    return PLUS_SUCCESS;
+  }
+
+  int numberOfSamples = inputImageExtent[1] - inputImageExtent[0] + 1;
+  int numberOfLines = inputImageExtent[3] - inputImageExtent[2] + 1;
+  if ( numberOfSamples < 1 || numberOfLines < 1 )
+  {
+    LOG_ERROR( "vtkPlusUsScanConvertCurvilinear::UpdateScanLineInterpolatedPointArray failed: invalid input image extent" );
+    return PLUS_FAIL;
+  }
+
+  // Sort the points by scanline (counting sort, keeps the original order within a scanline)
+  this->ScanLineInterpolatedPointOffsets.assign( numberOfLines + 1, 0 );
+  for ( std::vector<InterpolatedPoint>::const_iterator it = this->InterpolatedPointArray.begin(); it != this->InterpolatedPointArray.end(); ++it )
+  {
+    this->ScanLineInterpolatedPointOffsets[it->inputPixelIndex / numberOfSamples + 1]++;
+  }
+  for ( int line = 0; line < numberOfLines; line++ )
+  {
+    this->ScanLineInterpolatedPointOffsets[line + 1] += this->ScanLineInterpolatedPointOffsets[line];
+  }
+  this->ScanLineInterpolatedPointArray.resize( this->InterpolatedPointArray.size() );
+  std::vector<int> nextPointIndex( this->ScanLineInterpolatedPointOffsets.begin(), this->ScanLineInterpolatedPointOffsets.end() - 1 );
+  for ( std::vector<InterpolatedPoint>::const_iterator it = this->InterpolatedPointArray.begin(); it != this->InterpolatedPointArray.end(); ++it )
+  {
+    this->ScanLineInterpolatedPointArray[nextPointIndex[it->inputPixelIndex / numberOfSamples]++] = *it;
+  }
+
+  this->ScanLineInterpolatedPointArrayValid = true;
+  return PLUS_SUCCESS;
+}
+
 //----------------------------------------------------------------------------
 // Computes any global image information associated with regions.
 int vtkPlusUsScanConvertCurvilinear::RequestInformation ( vtkInformation* vtkNotUsed( request ), vtkInformationVector** inputVector, vtkInformationVector* outputVector )
@@ -52,6 +52,26 @@ public:
     return this->InterpolatedPointArray;
   };
 
+  /*!
+    Update the interpolation table for the specified input (brightness) image extent and group the interpolated points
+    by scanline, for algorithms that compute the input image scanline by scanline. Points whose first input pixel is
+    in scanline i are stored in the ScanLineInterpolatedPointArray elements [ScanLineInterpolatedPointOffsets[i], ScanLineInterpolatedPointOffsets[i+1]).
+    Points of scanline i use input pixels from scanlines i and i+1.
+  */
+  PlusStatus UpdateScanLineInterpolatedPointArray(int inputImageExtent[6]);
+
+  /*! Get the interpolated points grouped by scanline. UpdateScanLineInterpolatedPointArray must be called before. */
+  const std::vector<InterpolatedPoint>& GetScanLineInterpolatedPointArray()
+  {
+    return this->ScanLineInterpolatedPointArray;
+  };
+
+  /*! Get the index of the first interpolated point of each scanline. UpdateScanLineInterpolatedPointArray must be called before. */
+  const std::vector<int>& GetScanLineInterpolatedPointOffsets()
+  {
+    return this->ScanLineInterpolatedPointOffsets;
+  };
+
   /*! Initialize the parameters used in reconstruction. These are for the cases when video source can obtain them from the hardware */
   vtkSetMacro(RadiusStartMm, double);
   vtkGetMacro(RadiusStartMm, double);
@@ -112,6 +132,11 @@ protected:
   /*! Each element of this array defines the computation of a pixel in the output (scan converted) image.  */
   std::vector<InterpolatedPoint> InterpolatedPointArray;
 
+  /*! InterpolatedPointArray grouped by scanline, computed on demand by UpdateScanLineInterpolatedPointArray */
+  std::vector<InterpolatedPoint> ScanLineInterpolatedPointArray;
+  std::vector<int> ScanLineInterpolatedPointOffsets;
+  bool ScanLineInterpolatedPointArrayValid;
+
   int InterpInputImageExtent[6];
   double InterpRadiusStartMm;
   double InterpRadiusStopMm;
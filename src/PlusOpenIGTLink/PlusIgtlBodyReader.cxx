@@ -0,0 +1,240 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+// Local includes
+#include "PlusIgtlBodyReader.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+
+// IGTL includes
+#include <igtlImageMessage.h>
+#include <igtl_util.h>
+
+// OpenIGTLinkIO includes
+#include <igtlioImageConverter.h>
+
+// STL includes
+#include <algorithm>
+
+namespace
+{
+  /*! Size of the buffer that is used for computing the CRC of skipped body bytes */
+  const igtlUint64 SKIP_BUFFER_SIZE = 65536;
+}
+
+//----------------------------------------------------------------------------
+PlusIgtlBodyReader::PlusIgtlBodyReader(igtl::Socket* socket, const igtl_header& packedHeader, int headerVersion, bool crcCheck)
+  : Socket(socket)
+  , HeaderVersion(headerVersion)
+  , CrcCheck(crcCheck)
+  , BodySize(0)
+  , ExpectedCrc(0)
+  , Crc(0)
+  , BodyBytesRead(0)
+  , ContentSize(0)
+  , ContentBytesRead(0)
+{
+  igtl_header header = packedHeader;
+  igtl_header_convert_byte_order(&header); // network to host
+  this->BodySize = header.body_size;
+  this->ExpectedCrc = header.crc;
+  this->ContentSize = this->BodySize;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusIgtlBodyReader::Start()
+{
+  if (this->Socket == NULL)
+  {
+    LOG_ERROR("Unable to read IGTL message body - socket is NULL");
+    return PLUS_FAIL;
+  }
+  this->ContentSize = this->BodySize;
+  if (this->HeaderVersion < IGTL_HEADER_VERSION_2)
+  {
+    return PLUS_SUCCESS;
+  }
+
+  // Version 2 messages: extended header, content, metadata header, metadata
+  igtl_extended_header extendedHeader;
+  if (this->BodySize < IGTL_EXTENDED_HEADER_SIZE || this->ReceiveBody(&extendedHeader, IGTL_EXTENDED_HEADER_SIZE) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to read IGTL message extended header");
+    return PLUS_FAIL;
+  }
+  igtl_extended_header_convert_byte_order(&extendedHeader);
+  igtlUint64 nonContentSize = static_cast<igtlUint64>(extendedHeader.extended_header_size) + extendedHeader.meta_data_header_size + extendedHeader.meta_data_size;
+  if (extendedHeader.extended_header_size < IGTL_EXTENDED_HEADER_SIZE || nonContentSize > this->BodySize)
+  {
+    LOG_ERROR("Invalid IGTL message extended header (extended header size: " << extendedHeader.extended_header_size
+              << ", metadata size: " << extendedHeader.meta_data_header_size + extendedHeader.meta_data_size << ", body size: " << this->BodySize << ")");
+    return PLUS_FAIL;
+  }
+
+  // Skip the part of the extended header that this version does not know about
+  unsigned char unknownExtendedHeader[256];
+  igtlUint64 unknownExtendedHeaderSize = extendedHeader.extended_header_size - IGTL_EXTENDED_HEADER_SIZE;
+  while (unknownExtendedHeaderSize > 0)
+  {
+    igtlUint64 chunkSize = std::min<igtlUint64>(unknownExtendedHeaderSize, sizeof(unknownExtendedHeader));
+    if (this->ReceiveBody(unknownExtendedHeader, chunkSize) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to read IGTL message extended header");
+      return PLUS_FAIL;
+    }
+    unknownExtendedHeaderSize -= chunkSize;
+  }
+
+  this->ContentSize = this->BodySize - nonContentSize;
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusIgtlBodyReader::Read(void* data, igtlUint64 size)
+{
+  if (size > this->GetRemainingContentSize())
+  {
+    LOG_ERROR("Unable to read " << size << " bytes from IGTL message content, only " << this->GetRemainingContentSize() << " bytes are left");
+    return PLUS_FAIL;
+  }
+  if (this->ReceiveBody(data, size) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+  this->ContentBytesRead += size;
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusIgtlBodyReader::Finish()
+{
+  igtlUint64 remainingBodySize = this->BodySize - this->BodyBytesRead;
+  if (!this->CrcCheck)
+  {
+    if (remainingBodySize > 0 && this->Socket->Skip(remainingBodySize, 1) <= 0)
+    {
+      LOG_ERROR("Failed to skip the rest of the IGTL message body");
+      return PLUS_FAIL;
+    }
+    this->BodyBytesRead = this->BodySize;
+    return PLUS_SUCCESS;
+  }
+
+  // Skipped bytes have to be received into a buffer to compute the CRC
+  if (remainingBodySize > 0)
+  {
+    std::vector<unsigned char> skipBuffer(static_cast<size_t>(std::min(remainingBodySize, SKIP_BUFFER_SIZE)));
+    while (remainingBodySize > 0)
+    {
+      igtlUint64 chunkSize = std::min<igtlUint64>(remainingBodySize, skipBuffer.size());
+      if (this->ReceiveBody(&skipBuffer[0], chunkSize) != PLUS_SUCCESS)
+      {
+        return PLUS_FAIL;
+      }
+      remainingBodySize -= chunkSize;
+    }
+  }
+
+  if (this->Crc != this->ExpectedCrc)
+  {
+    LOG_ERROR("IGTL message CRC check failed");
+    return PLUS_FAIL;
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusIgtlBodyReader::ReceiveBody(void* data, igtlUint64 size)
+{
+  if (size == 0)
+  {
+    return PLUS_SUCCESS;
+  }
+  if (this->BodyBytesRead + size > this->BodySize)
+  {
+    LOG_ERROR("Unable to read past the end of the IGTL message body");
+    return PLUS_FAIL;
+  }
+  int numOfBytesReceived = this->Socket->Receive(data, size);
+  if (numOfBytesReceived <= 0 || static_cast<igtlUint64>(numOfBytesReceived) != size)
+  {
+    LOG_ERROR("Failed to receive IGTL message body (received " << numOfBytesReceived << " of " << size << " bytes)");
+    return PLUS_FAIL;
+  }
+  if (this->CrcCheck)
+  {
+    this->Crc = igtl_crc64(static_cast<unsigned char*>(data), size, this->Crc);
+  }
+  this->BodyBytesRead += size;
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusIgtlBodyReader::ReadImageHeader(igtl_image_header& imageHeader)
+{
+  if (this->Read(&imageHeader, IGTL_IMAGE_HEADER_SIZE) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to read IMAGE message header");
+    return PLUS_FAIL;
+  }
+  igtl_image_convert_byte_order(&imageHeader);
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusIgtlBodyReader::ReadTrackingDataElements(std::vector<igtl_tdata_element>& elements)
+{
+  igtlUint64 numberOfElements = this->GetRemainingContentSize() / IGTL_TDATA_ELEMENT_SIZE;
+  elements.resize(static_cast<size_t>(numberOfElements));
+  if (numberOfElements == 0)
+  {
+    return PLUS_SUCCESS;
+  }
+  if (this->Read(&elements[0], numberOfElements * IGTL_TDATA_ELEMENT_SIZE) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to read TDATA message elements");
+    return PLUS_FAIL;
+  }
+  igtl_tdata_convert_byte_order(&elements[0], static_cast<int>(numberOfElements));
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusIgtlBodyReader::GetImageToReferenceMatrix(igtl_image_header& imageHeader, vtkMatrix4x4* imageToReferenceMatrix)
+{
+  float spacing[3] = { 0 };
+  float origin[3] = { 0 };
+  float normI[3] = { 0 };
+  float normJ[3] = { 0 };
+  float normK[3] = { 0 };
+  igtl_image_get_matrix(spacing, origin, normI, normJ, normK, &imageHeader);
+
+  // Use the same conversion as for unpacked image messages, the message does not need any pixel data for that
+  igtl::ImageMessage::Pointer imgMsg = igtl::ImageMessage::New();
+  imgMsg->SetDimensions(imageHeader.size[0], imageHeader.size[1], imageHeader.size[2]);
+  imgMsg->SetSpacing(spacing);
+  igtl::Matrix4x4 matrix;
+  igtl::IdentityMatrix(matrix);
+  for (int i = 0; i < 3; ++i)
+  {
+    matrix[i][0] = normI[i];
+    matrix[i][1] = normJ[i];
+    matrix[i][2] = normK[i];
+    matrix[i][3] = origin[i];
+  }
+  imgMsg->SetMatrix(matrix);
+
+  vtkSmartPointer<vtkMatrix4x4> vtkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (igtlioImageConverter::IGTLImageToVTKTransform(imgMsg, vtkMatrix) != 1)
+  {
+    LOG_ERROR("Failed to get IJKToRAS transform from image message header");
+    return PLUS_FAIL;
+  }
+  imageToReferenceMatrix->DeepCopy(vtkMatrix);
+  return PLUS_SUCCESS;
+}
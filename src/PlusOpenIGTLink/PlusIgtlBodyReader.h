@@ -0,0 +1,90 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __PlusIgtlBodyReader_h
+#define __PlusIgtlBodyReader_h
+
+#include "vtkPlusOpenIGTLinkExport.h"
+
+// Local includes
+#include "PlusConfigure.h"
+
+// IGTL includes
+#include <igtlSocket.h>
+#include <igtl_header.h>
+#include <igtl_image.h>
+#include <igtl_tdata.h>
+
+// STL includes
+#include <vector>
+
+class vtkMatrix4x4;
+
+/*!
+  \class PlusIgtlBodyReader
+  \brief Reads the body of an IGTL message from a socket directly into caller provided memory
+
+  igtl::MessageBase receives the complete message body into its own buffer, from where the content has to be
+  copied once more. This reader receives the content section of the body (without extended header and metadata)
+  piece by piece, into any memory location (e.g., directly into the frame of a video buffer).
+  The CRC of the body is computed while the data is received and verified when the body is finished.
+
+  Usage: create the reader after the header is received, call Start, read the content using Read (or the
+  message specific helpers), then call Finish to skip the unread part of the body and verify the CRC.
+  The socket must not be used by anyone else until Finish returns.
+
+  \ingroup PlusLibOpenIGTLink
+*/
+class vtkPlusOpenIGTLinkExport PlusIgtlBodyReader
+{
+public:
+  /*!
+    \param packedHeader Received IGTL header, in network byte order (as received, before the header message is unpacked)
+    \param headerVersion Header version of the message (IGTL_HEADER_VERSION_1 or IGTL_HEADER_VERSION_2)
+    \param crcCheck If true then the CRC of the body is verified in Finish
+  */
+  PlusIgtlBodyReader(igtl::Socket* socket, const igtl_header& packedHeader, int headerVersion, bool crcCheck);
+
+  /*! Read the extended header (if the message has one) and determine the size of the content */
+  PlusStatus Start();
+
+  /*! Size of the message content (body without extended header and metadata). Valid after Start. */
+  igtlUint64 GetContentSize() const { return this->ContentSize; }
+
+  /*! Number of content bytes that have not been read yet */
+  igtlUint64 GetRemainingContentSize() const { return this->ContentSize - this->ContentBytesRead; }
+
+  /*! Receive the next size bytes of the content into data */
+  PlusStatus Read(void* data, igtlUint64 size);
+
+  /*! Skip the rest of the body (unread content and metadata) and verify the CRC */
+  PlusStatus Finish();
+
+  /*! Read the IMAGE message header and convert it to host byte order */
+  PlusStatus ReadImageHeader(igtl_image_header& imageHeader);
+
+  /*! Read all the TDATA elements of the content and convert them to host byte order. The vector is reused to avoid reallocation. */
+  PlusStatus ReadTrackingDataElements(std::vector<igtl_tdata_element>& elements);
+
+  /*! Get the image to reference transform (IJKToRAS) of an IMAGE message header (in host byte order) */
+  static PlusStatus GetImageToReferenceMatrix(igtl_image_header& imageHeader, vtkMatrix4x4* imageToReferenceMatrix);
+
+protected:
+  /*! Receive bytes of the body and update the CRC */
+  PlusStatus ReceiveBody(void* data, igtlUint64 size);
+
+  igtl::Socket* Socket;
+  int HeaderVersion;
+  bool CrcCheck;
+  igtlUint64 BodySize;
+  igtlUint64 ExpectedCrc;
+  igtlUint64 Crc;
+  igtlUint64 BodyBytesRead;
+  igtlUint64 ContentSize;
+  igtlUint64 ContentBytesRead;
+};
+
+#endif //__PlusIgtlBodyReader_h
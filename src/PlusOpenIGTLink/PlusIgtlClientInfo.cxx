@@ -16,10 +16,28 @@ PlusIgtlClientInfo::PlusIgtlClientInfo()
   , TDATAResolution(0)
   , TDATARequested(false)
   , LastTDATASentTimeStamp(-1)
+  , TrackedFrameBinaryFields(false)
 {
 
 }
 
+//----------------------------------------------------------------------------
+std::map<std::string, std::string> PlusIgtlClientInfo::EncodingParameters::GetCodecParameters() const
+{
+  std::map<std::string, std::string> parameters;
+  parameters["losslessEncoding"] = this->Lossless ? "1" : "0";
+  if (!this->Lossless)
+  {
+    parameters["rateControl"] = this->RateControl;
+    parameters["minimumKeyFrameDistance"] = igsioCommon::ToString(this->MinKeyframeDistance);
+    parameters["maximumKeyFrameDistance"] = igsioCommon::ToString(this->MaxKeyframeDistance);
+    parameters["encodingSpeed"] = igsioCommon::ToString(this->Speed);
+    parameters["bitRate"] = igsioCommon::ToString(this->TargetBitrate);
+    parameters["deadlineMode"] = this->DeadlineMode;
+  }
+  return parameters;
+}
+
 //----------------------------------------------------------------------------
 PlusStatus PlusIgtlClientInfo::SetClientInfoFromXmlData(const char* strXmlData)
 {
@@ -65,6 +83,17 @@ PlusStatus PlusIgtlClientInfo::SetClientInfoFromXmlData(vtkXMLDataElement* xmlda
     xmldata->SetIntAttribute("TDATAResolution", resolution);
   }
 
+  std::string trackedFrameFieldEncoding;
+  XML_READ_STRING_ATTRIBUTE_NONMEMBER_OPTIONAL(TrackedFrameFieldEncoding, trackedFrameFieldEncoding, xmldata);
+  if (igsioCommon::IsEqualInsensitive(trackedFrameFieldEncoding, "BINARY"))
+  {
+    clientInfo.SetTrackedFrameBinaryFields(true);
+  }
+  else if (!trackedFrameFieldEncoding.empty() && !igsioCommon::IsEqualInsensitive(trackedFrameFieldEncoding, "XML"))
+  {
+    LOG_WARNING("Unknown TrackedFrameFieldEncoding: " << trackedFrameFieldEncoding << ". Valid values: XML, BINARY. XML encoding will be used.");
+  }
+
   // Get message types
   vtkXMLDataElement* messageTypes = xmldata->FindNestedElementWithName("MessageTypes");
   if (messageTypes != NULL)
@@ -239,6 +268,10 @@ void PlusIgtlClientInfo::GetClientInfoInXmlData(std::string& strXmlData)
   xmldata->SetName("ClientInfo");
   xmldata->SetAttribute("TDATARequested", (this->GetTDATARequested() ? "TRUE" : "FALSE"));
   xmldata->SetIntAttribute("TDATAResolution", this->GetTDATAResolution());
+  if (this->GetTrackedFrameBinaryFields())
+  {
+    xmldata->SetAttribute("TrackedFrameFieldEncoding", "BINARY");
+  }
 
   vtkSmartPointer<vtkXMLDataElement> messageTypes = vtkSmartPointer<vtkXMLDataElement>::New();
   messageTypes->SetName("MessageTypes");
@@ -329,6 +362,7 @@ void PlusIgtlClientInfo::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "TDATARequested: " << (this->GetTDATARequested() ? "TRUE" : "FALSE") << ". ";
   os << indent << "LastTDATASentTimeStamp: " << this->GetLastTDATASentTimeStamp() << ". ";
   os << indent << "TDATAResolution: " << this->GetTDATAResolution() << ". ";
+  os << indent << "TrackedFrameFieldEncoding: " << (this->GetTrackedFrameBinaryFields() ? "BINARY" : "XML") << ". ";
 
   os << ". Transforms: ";
   if (!this->TransformNames.empty())
@@ -433,3 +467,15 @@ void PlusIgtlClientInfo::SetLastTDATASentTimeStamp(double val)
 {
   this->LastTDATASentTimeStamp = val;
 }
+
+//----------------------------------------------------------------------------
+bool PlusIgtlClientInfo::GetTrackedFrameBinaryFields() const
+{
+  return this->TrackedFrameBinaryFields;
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlClientInfo::SetTrackedFrameBinaryFields(bool val)
+{
+  this->TrackedFrameBinaryFields = val;
+}
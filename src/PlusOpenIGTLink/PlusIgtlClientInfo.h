@@ -14,10 +14,14 @@
 // IGSIO includes
 #include <vtkIGSIOFrameConverter.h>
 
+// OpenIGTLink includes
+#include "vtkPlusIgtlSharedVideoEncoder.h"
+
 // IGTL includes
 #include <igtlClientSocket.h>
 
 // STL includes
+#include <map>
 #include <string>
 #include <vector>
 
@@ -57,6 +61,8 @@ public:
       , TargetBitrate(-1)
     {
     }
+    /*! Encoder parameters in the format expected by vtkIGSIOFrameConverter */
+    std::map<std::string, std::string> GetCodecParameters() const;
   };
 
   /*! Helper struct for storing image stream and embedded transform frame names
@@ -89,8 +95,11 @@ public:
     EncodingParameters EncodeVideoParameters;
     /*! Class for decoding and encoding frames */
     vtkSmartPointer<vtkIGSIOFrameConverter> FrameConverter;
+    /*! Encoder session shared with the other clients that receive the same encoding. If set then FrameConverter is not used. */
+    vtkSmartPointer<vtkPlusIgtlSharedVideoEncoder> SharedEncoder;
     VideoStream()
       : FrameConverter(nullptr)
+      , SharedEncoder(nullptr)
     {
     };
   };
@@ -130,6 +139,14 @@ public:
   /*! timestamp of the last sent TDATA message. */
   void SetLastTDATASentTimeStamp(double val);
 
+  /*!
+    If true then the client can decode the binary frame field section of TRACKEDFRAME messages.
+    Set by the TrackedFrameFieldEncoding="BINARY" ClientInfo attribute. Default is XML encoding, which all clients can decode.
+  */
+  bool GetTrackedFrameBinaryFields() const;
+  /*! If true then the client can decode the binary frame field section of TRACKEDFRAME messages */
+  void SetTrackedFrameBinaryFields(bool val);
+
   /*! Message types that client expects from the server */
   std::vector<std::string> IgtlMessageTypes;
 
@@ -150,6 +167,7 @@ protected:
   bool    TDATARequested;
   double  LastTDATASentTimeStamp;
   int     TDATAResolution;
+  bool    TrackedFrameBinaryFields;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,199 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+// Local includes
+#include "PlusIgtlGatherMessage.h"
+
+// IGTL includes
+#include <igtl_header.h>
+#include <igtl_util.h>
+
+// System includes
+#if defined(_WIN32)
+  #include <winsock2.h>
+#else
+  #include <errno.h>
+  #include <string.h>
+  #include <sys/socket.h>
+  #include <sys/uio.h>
+#endif
+
+namespace
+{
+  /*!
+    igtl::Socket does not expose its socket descriptor. A pointer to the protected member, obtained
+    through a derived class, can be legally applied to any igtl::Socket instance.
+  */
+  class SocketDescriptorAccess : public igtl::Socket
+  {
+  public:
+    static int GetSocketDescriptor(igtl::Socket* socket)
+    {
+      return socket->*(&SocketDescriptorAccess::m_SocketDescriptor);
+    }
+  };
+}
+
+//----------------------------------------------------------------------------
+int PlusIgtlGatherMessage::Send(igtl::Socket* socket, igtl::MessageBase* message, igtlUint64* sentBytes/*=NULL*/)
+{
+  if (socket == NULL || message == NULL)
+  {
+    return 0;
+  }
+
+  SegmentList segments;
+  PlusIgtlGatherMessage* gatherMessage = dynamic_cast<PlusIgtlGatherMessage*>(message);
+  if (gatherMessage == NULL || !gatherMessage->GetGatherSegments(segments))
+  {
+    if (sentBytes != NULL)
+    {
+      *sentBytes = message->GetBufferSize();
+    }
+    return socket->Send(message->GetBufferPointer(), message->GetBufferSize());
+  }
+
+  if (sentBytes != NULL)
+  {
+    *sentBytes = 0;
+    for (SegmentList::const_iterator it = segments.begin(); it != segments.end(); ++it)
+    {
+      *sentBytes += it->Size;
+    }
+  }
+  return SendSegments(socket, segments);
+}
+
+//----------------------------------------------------------------------------
+int PlusIgtlGatherMessage::SendSegments(igtl::Socket* socket, const SegmentList& segments)
+{
+  if (socket == NULL || !socket->GetConnected())
+  {
+    return 0;
+  }
+  int socketDescriptor = SocketDescriptorAccess::GetSocketDescriptor(socket);
+  if (socketDescriptor < 0)
+  {
+    return 0;
+  }
+
+#if defined(_WIN32)
+  std::vector<WSABUF> buffers;
+  for (SegmentList::const_iterator it = segments.begin(); it != segments.end(); ++it)
+  {
+    if (it->Size == 0)
+    {
+      continue;
+    }
+    WSABUF buffer;
+    buffer.buf = static_cast<CHAR*>(const_cast<void*>(it->Data));
+    buffer.len = static_cast<ULONG>(it->Size);
+    buffers.push_back(buffer);
+  }
+
+  size_t first = 0;
+  while (first < buffers.size())
+  {
+    DWORD sent = 0;
+    if (WSASend(static_cast<SOCKET>(socketDescriptor), &buffers[first], static_cast<DWORD>(buffers.size() - first), &sent, 0, NULL, NULL) != 0)
+    {
+      if (WSAGetLastError() == WSAENOBUFS)
+      {
+        // Same as igtl::Socket::Send: system is out of buffer space, retry
+        Sleep(1);
+        continue;
+      }
+      return 0;
+    }
+    // Skip the buffers that have been completely sent and adjust the partially sent one
+    while (first < buffers.size() && sent >= buffers[first].len)
+    {
+      sent -= buffers[first].len;
+      ++first;
+    }
+    if (first < buffers.size())
+    {
+      buffers[first].buf += sent;
+      buffers[first].len -= sent;
+    }
+  }
+#else
+  std::vector<struct iovec> buffers;
+  for (SegmentList::const_iterator it = segments.begin(); it != segments.end(); ++it)
+  {
+    if (it->Size == 0)
+    {
+      continue;
+    }
+    struct iovec buffer;
+    buffer.iov_base = const_cast<void*>(it->Data);
+    buffer.iov_len = it->Size;
+    buffers.push_back(buffer);
+  }
+
+  int flags = 0;
+#if defined(MSG_NOSIGNAL)
+  // Do not raise SIGPIPE if the client has disconnected (igtl::Socket::Send uses the same flag)
+  flags = MSG_NOSIGNAL;
+#endif
+
+  size_t first = 0;
+  while (first < buffers.size())
+  {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &buffers[first];
+    msg.msg_iovlen = buffers.size() - first;
+    ssize_t sent = sendmsg(socketDescriptor, &msg, flags);
+    if (sent < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return 0;
+    }
+    // Skip the buffers that have been completely sent and adjust the partially sent one
+    size_t remaining = static_cast<size_t>(sent);
+    while (first < buffers.size() && remaining >= buffers[first].iov_len)
+    {
+      remaining -= buffers[first].iov_len;
+      ++first;
+    }
+    if (first < buffers.size())
+    {
+      buffers[first].iov_base = static_cast<char*>(buffers[first].iov_base) + remaining;
+      buffers[first].iov_len -= remaining;
+    }
+  }
+#endif
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+void PlusIgtlGatherMessage::SpliceData(igtl::MessageBase* packedMessage, size_t insertOffset, const void* data, size_t dataSize, SegmentList& segments)
+{
+  unsigned char* buffer = static_cast<unsigned char*>(packedMessage->GetBufferPointer());
+  size_t bufferSize = packedMessage->GetBufferSize();
+
+  // The CRC is computed incrementally over the segments, in the same order as they are sent.
+  // Body size and CRC only depend on the packed buffer and the data, so the header can be updated repeatedly.
+  igtl_uint64 crc = igtl_crc64(buffer + IGTL_HEADER_SIZE, insertOffset - IGTL_HEADER_SIZE, 0);
+  crc = igtl_crc64(static_cast<unsigned char*>(const_cast<void*>(data)), dataSize, crc);
+  crc = igtl_crc64(buffer + insertOffset, bufferSize - insertOffset, crc);
+
+  igtl_header* header = reinterpret_cast<igtl_header*>(buffer);
+  igtl_header_convert_byte_order(header); // network to host
+  header->body_size = bufferSize - IGTL_HEADER_SIZE + dataSize;
+  header->crc = crc;
+  igtl_header_convert_byte_order(header); // host to network
+
+  segments.clear();
+  segments.push_back(Segment(buffer, insertOffset));
+  segments.push_back(Segment(data, dataSize));
+  segments.push_back(Segment(buffer + insertOffset, bufferSize - insertOffset));
+}
@@ -0,0 +1,74 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __PlusIgtlGatherMessage_h
+#define __PlusIgtlGatherMessage_h
+
+#include "vtkPlusOpenIGTLinkExport.h"
+
+// Local includes
+#include "PlusConfigure.h"
+
+// IGTL includes
+#include <igtlMessageBase.h>
+#include <igtlSocket.h>
+
+// STL includes
+#include <vector>
+
+/*!
+  \class PlusIgtlGatherMessage
+  \brief Interface of IGTL messages that can be sent without copying their bulk data into the message buffer
+
+  A gather-enabled message is packed without its bulk (pixel) data: the message buffer only contains
+  the IGTL header, message specific headers and metadata. The bulk data is referenced in place and
+  inserted into the byte stream at send time using a single gather write (sendmsg on POSIX, WSASend on Windows).
+  The IGTL header body size and CRC are updated to describe the complete message, so receivers cannot
+  tell the difference from a message that was packed into a contiguous buffer.
+
+  \ingroup PlusLibOpenIGTLink
+*/
+class vtkPlusOpenIGTLinkExport PlusIgtlGatherMessage
+{
+public:
+  struct Segment
+  {
+    Segment(const void* data, size_t size) : Data(data), Size(size) {}
+    const void* Data;
+    size_t Size;
+  };
+  typedef std::vector<Segment> SegmentList;
+
+  virtual ~PlusIgtlGatherMessage() {}
+
+  /*!
+    Get the memory segments that make up the complete message, in the order they have to be sent.
+    Must be called after the message is packed. Returns false if bulk data is not referenced
+    (the message buffer contains the complete message and can be sent as is).
+  */
+  virtual bool GetGatherSegments(SegmentList& segments) = 0;
+
+  /*!
+    Send a message. Gather-enabled messages are sent with a single gather write, all other messages are sent from their buffer.
+    \param sentBytes Optional output, number of bytes sent
+    \return Nonzero on success, 0 on failure (same as igtl::Socket::Send)
+  */
+  static int Send(igtl::Socket* socket, igtl::MessageBase* message, igtlUint64* sentBytes = NULL);
+
+  /*! Send memory segments as one contiguous byte stream. Returns nonzero on success, 0 on failure. */
+  static int SendSegments(igtl::Socket* socket, const SegmentList& segments);
+
+protected:
+  /*!
+    Insert data into a packed message without copying it.
+    The IGTL header of the packed message is updated in place to contain the body size and CRC of the complete message.
+    \param packedMessage Message that was packed without the inserted data
+    \param insertOffset Position in the packed message buffer (from the start of the IGTL header) where the data is inserted
+  */
+  static void SpliceData(igtl::MessageBase* packedMessage, size_t insertOffset, const void* data, size_t dataSize, SegmentList& segments);
+};
+
+#endif //__PlusIgtlGatherMessage_h
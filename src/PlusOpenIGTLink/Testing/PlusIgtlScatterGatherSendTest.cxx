@@ -0,0 +1,334 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file PlusIgtlScatterGatherSendTest.cxx
+  \brief Loopback throughput benchmark of sending 4D volume frames as IMAGE and TRACKEDFRAME messages, packed vs. gather write
+
+  A series of volumes is sent through a loopback socket to a receiver thread, which unpacks
+  each message with CRC check and verifies the pixel data of the first frame of each run.
+*/
+
+// Local includes
+#include "PlusConfigure.h"
+#include "PlusIgtlGatherMessage.h"
+#include "igtlPlusImageMessage.h"
+#include "igtlPlusTrackedFrameMessage.h"
+#include "vtkPlusIgtlMessageCommon.h"
+
+// IGSIO includes
+#include <igsioTrackedFrame.h>
+#include <vtkIGSIOAccurateTimer.h>
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkMultiThreader.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// OpenIGTLink includes
+#include <igtlClientSocket.h>
+#include <igtlImageMessage.h>
+#include <igtlMessageHeader.h>
+#include <igtlServerSocket.h>
+
+// STL includes
+#include <cstring>
+
+namespace
+{
+  const int SOCKET_TIMEOUT_MSEC = 5000;
+
+  struct ReceiverData
+  {
+    igtl::ClientSocket::Pointer Socket;
+    int NumberOfMessagesToReceive;
+    int NumberOfReceivedMessages;
+    int NumberOfErrors;
+    igtlUint64 NumberOfReceivedBytes;
+    const unsigned char* ExpectedPixels;
+    size_t ExpectedPixelsSize;
+  };
+
+  //----------------------------------------------------------------------------
+  void CreateVolumeFrame(igsioTrackedFrame& trackedFrame, unsigned int volumeSize)
+  {
+    FrameSizeType frameSize = { volumeSize, volumeSize, volumeSize };
+    trackedFrame.GetImageData()->AllocateFrame(frameSize, VTK_UNSIGNED_CHAR, 1);
+    unsigned char* pixels = static_cast<unsigned char*>(trackedFrame.GetImageData()->GetScalarPointer());
+    size_t numberOfPixels = static_cast<size_t>(volumeSize) * volumeSize * volumeSize;
+    for (size_t i = 0; i < numberOfPixels; ++i)
+    {
+      pixels[i] = static_cast<unsigned char>(i % 251);
+    }
+    trackedFrame.SetTimestamp(0);
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus ReceiveMessage(ReceiverData* data, bool verifyPixels)
+  {
+    igtl::MessageHeader::Pointer headerMsg = igtl::MessageHeader::New();
+    headerMsg->InitBuffer();
+    if (data->Socket->Receive(headerMsg->GetBufferPointer(), headerMsg->GetBufferSize()) != headerMsg->GetBufferSize())
+    {
+      LOG_ERROR("Failed to receive message header");
+      return PLUS_FAIL;
+    }
+    headerMsg->Unpack();
+
+    igtl::MessageBase::Pointer bodyMsg;
+    if (strcmp(headerMsg->GetDeviceType(), "IMAGE") == 0)
+    {
+      bodyMsg = igtl::ImageMessage::New();
+    }
+    else if (strcmp(headerMsg->GetDeviceType(), "TRACKEDFRAME") == 0)
+    {
+      bodyMsg = igtl::PlusTrackedFrameMessage::New();
+    }
+    else
+    {
+      LOG_ERROR("Unexpected message type: " << headerMsg->GetDeviceType());
+      return PLUS_FAIL;
+    }
+    bodyMsg->SetMessageHeader(headerMsg);
+    bodyMsg->AllocateBuffer();
+    if (data->Socket->Receive(bodyMsg->GetBufferBodyPointer(), bodyMsg->GetBufferBodySize()) != bodyMsg->GetBufferBodySize())
+    {
+      LOG_ERROR("Failed to receive message body");
+      return PLUS_FAIL;
+    }
+    data->NumberOfReceivedBytes += headerMsg->GetBufferSize() + bodyMsg->GetBufferBodySize();
+
+    int c = bodyMsg->Unpack(1);
+    if (!(c & igtl::MessageHeader::UNPACK_BODY))
+    {
+      LOG_ERROR("Failed to unpack " << headerMsg->GetDeviceType() << " message (CRC mismatch or invalid content)");
+      return PLUS_FAIL;
+    }
+
+    if (!verifyPixels)
+    {
+      return PLUS_SUCCESS;
+    }
+
+    const void* receivedPixels = NULL;
+    size_t receivedPixelsSize = 0;
+    igsioTrackedFrame receivedFrame;
+    igtl::ImageMessage* imageMsg = dynamic_cast<igtl::ImageMessage*>(bodyMsg.GetPointer());
+    igtl::PlusTrackedFrameMessage* trackedFrameMsg = dynamic_cast<igtl::PlusTrackedFrameMessage*>(bodyMsg.GetPointer());
+    if (imageMsg != NULL)
+    {
+      receivedPixels = imageMsg->GetScalarPointer();
+      receivedPixelsSize = imageMsg->GetImageSize();
+    }
+    else if (trackedFrameMsg != NULL)
+    {
+      receivedFrame = trackedFrameMsg->GetTrackedFrame();
+      receivedPixels = receivedFrame.GetImageData()->GetScalarPointer();
+      receivedPixelsSize = receivedFrame.GetImageData()->GetFrameSizeInBytes();
+    }
+    if (receivedPixels == NULL || receivedPixelsSize != data->ExpectedPixelsSize || memcmp(receivedPixels, data->ExpectedPixels, receivedPixelsSize) != 0)
+    {
+      LOG_ERROR("Received pixel data does not match the sent pixel data (" << headerMsg->GetDeviceType() << ")");
+      return PLUS_FAIL;
+    }
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  void* ReceiverThread(vtkMultiThreader::ThreadInfo* threadInfo)
+  {
+    ReceiverData* data = static_cast<ReceiverData*>(threadInfo->UserData);
+    while (data->NumberOfReceivedMessages < data->NumberOfMessagesToReceive)
+    {
+      if (ReceiveMessage(data, data->NumberOfReceivedMessages == 0) != PLUS_SUCCESS)
+      {
+        data->NumberOfErrors++;
+        break;
+      }
+      data->NumberOfReceivedMessages++;
+    }
+    return NULL;
+  }
+
+  //----------------------------------------------------------------------------
+  igtl::MessageBase::Pointer PackVolume(igsioTrackedFrame& trackedFrame, const std::string& messageType, bool gather)
+  {
+    vtkSmartPointer<vtkMatrix4x4> identity = vtkSmartPointer<vtkMatrix4x4>::New();
+    if (messageType == "IMAGE")
+    {
+      igtl::ImageMessage::Pointer imageMessage = gather ? igtl::PlusImageMessage::New().GetPointer() : igtl::ImageMessage::New().GetPointer();
+      imageMessage->SetDeviceName("Volume");
+      if (vtkPlusIgtlMessageCommon::PackImageMessage(imageMessage, trackedFrame, *identity) != PLUS_SUCCESS)
+      {
+        return NULL;
+      }
+      return imageMessage.GetPointer();
+    }
+
+    igtl::PlusTrackedFrameMessage::Pointer trackedFrameMessage = igtl::PlusTrackedFrameMessage::New();
+    trackedFrameMessage->SetDeviceName("Volume");
+    trackedFrameMessage->SetGatherImageData(gather);
+    std::vector<igsioTransformName> requestedTransforms;
+    if (trackedFrameMessage->SetTrackedFrame(trackedFrame, requestedTransforms) != PLUS_SUCCESS)
+    {
+      return NULL;
+    }
+    trackedFrameMessage->SetEmbeddedImageTransform(identity);
+    trackedFrameMessage->Pack();
+    return trackedFrameMessage.GetPointer();
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus RunBenchmark(igsioTrackedFrame& trackedFrame, const std::string& messageType, bool gather, int numberOfFrames, int port)
+  {
+    std::string description = messageType + (gather ? ", gather write" : ", packed");
+
+    igtl::ServerSocket::Pointer serverSocket = igtl::ServerSocket::New();
+    if (serverSocket->CreateServer(port) < 0)
+    {
+      LOG_ERROR(description << ": cannot create server socket on port " << port);
+      return PLUS_FAIL;
+    }
+
+    ReceiverData receiverData;
+    receiverData.Socket = igtl::ClientSocket::New();
+    receiverData.NumberOfMessagesToReceive = numberOfFrames;
+    receiverData.NumberOfReceivedMessages = 0;
+    receiverData.NumberOfErrors = 0;
+    receiverData.NumberOfReceivedBytes = 0;
+    receiverData.ExpectedPixels = static_cast<const unsigned char*>(trackedFrame.GetImageData()->GetScalarPointer());
+    receiverData.ExpectedPixelsSize = trackedFrame.GetImageData()->GetFrameSizeInBytes();
+    if (receiverData.Socket->ConnectToServer("127.0.0.1", port) != 0)
+    {
+      LOG_ERROR(description << ": cannot connect to server on port " << port);
+      serverSocket->CloseSocket();
+      return PLUS_FAIL;
+    }
+    igtl::ClientSocket::Pointer senderSocket = serverSocket->WaitForConnection(SOCKET_TIMEOUT_MSEC);
+    if (senderSocket.IsNull())
+    {
+      LOG_ERROR(description << ": client connection was not accepted");
+      receiverData.Socket->CloseSocket();
+      serverSocket->CloseSocket();
+      return PLUS_FAIL;
+    }
+
+    vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+    int receiverThreadId = threader->SpawnThread((vtkThreadFunctionType)&ReceiverThread, &receiverData);
+
+    int numberOfErrors = 0;
+    igtlUint64 numberOfSentBytes = 0;
+    double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    for (int frameIndex = 0; frameIndex < numberOfFrames; ++frameIndex)
+    {
+      // Each volume of the 4D sequence is packed and sent the same way as in the server
+      trackedFrame.SetTimestamp(frameIndex * 0.05);
+      igtl::MessageBase::Pointer message = PackVolume(trackedFrame, messageType, gather);
+      igtlUint64 sentBytes = 0;
+      if (message.IsNull() || PlusIgtlGatherMessage::Send(senderSocket, message, &sentBytes) == 0)
+      {
+        LOG_ERROR(description << ": failed to send frame " << frameIndex);
+        numberOfErrors++;
+        break;
+      }
+      numberOfSentBytes += sentBytes;
+    }
+    if (numberOfErrors > 0)
+    {
+      // Unblock the receiver
+      senderSocket->CloseSocket();
+    }
+    threader->TerminateThread(receiverThreadId);
+    double elapsedTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTime;
+
+    senderSocket->CloseSocket();
+    receiverData.Socket->CloseSocket();
+    serverSocket->CloseSocket();
+
+    numberOfErrors += receiverData.NumberOfErrors;
+    if (numberOfErrors == 0 && (receiverData.NumberOfReceivedMessages != numberOfFrames || receiverData.NumberOfReceivedBytes != numberOfSentBytes))
+    {
+      LOG_ERROR(description << ": received " << receiverData.NumberOfReceivedMessages << " messages (" << receiverData.NumberOfReceivedBytes
+                << " bytes), expected " << numberOfFrames << " messages (" << numberOfSentBytes << " bytes)");
+      numberOfErrors++;
+    }
+    if (numberOfErrors > 0)
+    {
+      return PLUS_FAIL;
+    }
+
+    LOG_INFO(description << ": " << numberOfFrames << " frames, " << numberOfSentBytes / numberOfFrames << " bytes/frame"
+             << ", " << numberOfFrames / elapsedTimeSec << " frames/s"
+             << ", " << numberOfSentBytes / elapsedTimeSec / (1024.0 * 1024.0) << " MB/s");
+    return PLUS_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  bool printHelp(false);
+  int numberOfFrames(50);
+  int volumeSize(128);
+  int port(18950);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--frames", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfFrames, "Number of volume frames to send in each run (default: 50)");
+  args.AddArgument("--volume-size", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &volumeSize, "Size of the cubic volume along each axis, in voxels (default: 128)");
+  args.AddArgument("--port", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &port, "Loopback port used for the test (default: 18950)");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (printHelp)
+  {
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  if (numberOfFrames < 1 || volumeSize < 1)
+  {
+    LOG_ERROR("Number of frames and volume size must be positive");
+    exit(EXIT_FAILURE);
+  }
+
+  igsioTrackedFrame volumeFrame;
+  CreateVolumeFrame(volumeFrame, volumeSize);
+
+  int numberOfErrors = 0;
+  const char* messageTypes[] = { "IMAGE", "TRACKEDFRAME" };
+  for (int typeIndex = 0; typeIndex < 2; ++typeIndex)
+  {
+    for (int gather = 0; gather < 2; ++gather)
+    {
+      if (RunBenchmark(volumeFrame, messageTypes[typeIndex], gather != 0, numberOfFrames, port) != PLUS_SUCCESS)
+      {
+        numberOfErrors++;
+      }
+    }
+  }
+
+  if (numberOfErrors > 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully");
+  return EXIT_SUCCESS;
+}
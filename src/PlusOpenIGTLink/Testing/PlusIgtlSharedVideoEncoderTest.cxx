@@ -0,0 +1,421 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file PlusIgtlSharedVideoEncoderTest.cxx
+  \brief Loopback benchmark of sending encoded video to a fleet of clients, per-client encoders vs. shared encoder
+
+  A sequence of frames is sent as VIDEO messages through loopback sockets to a number of clients. In the first run
+  each client has its own encoder (as vtkPlusOpenIGTLinkServer does without SharedVideoEncoding), in the second run all clients
+  share one vtkPlusIgtlSharedVideoEncoder. One client starts receiving in the middle of the sequence. Each receiver
+  verifies that the messages can be unpacked and that its stream starts with a key frame.
+  CPU time of the process is reported per client per frame.
+*/
+
+// Local includes
+#include "PlusConfigure.h"
+#include "PlusIgtlClientInfo.h"
+#include "vtkPlusIgtlMessageCommon.h"
+#include "vtkPlusIgtlSharedVideoEncoder.h"
+
+// IGSIO includes
+#include <igsioTrackedFrame.h>
+#include <vtkIGSIOAccurateTimer.h>
+#include <vtkIGSIOFrameConverter.h>
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkMultiThreader.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// OpenIGTLink includes
+#include <igtlClientSocket.h>
+#include <igtlCodecCommonClasses.h>
+#include <igtlMessageHeader.h>
+#include <igtlServerSocket.h>
+#include <igtlVideoMessage.h>
+
+// STL includes
+#include <cstring>
+#include <ctime>
+
+namespace
+{
+  const int SOCKET_TIMEOUT_MSEC = 5000;
+
+  struct ReceiverData
+  {
+    igtl::ClientSocket::Pointer Socket;
+    int NumberOfReceivedMessages;
+    int NumberOfKeyFrames;
+    bool FirstFrameIsKeyFrame;
+    int NumberOfErrors;
+  };
+
+  struct SenderData
+  {
+    igtl::ClientSocket::Pointer Socket;
+    vtkSmartPointer<vtkIGSIOFrameConverter> FrameConverter;
+    int FirstFrameIndex;
+    int NumberOfSentMessages;
+  };
+
+  //----------------------------------------------------------------------------
+  void CreateFrames(std::vector<igsioTrackedFrame>& trackedFrames, unsigned int width, unsigned int height)
+  {
+    FrameSizeType frameSize = { width, height, 1 };
+    for (unsigned int frameIndex = 0; frameIndex < trackedFrames.size(); ++frameIndex)
+    {
+      // Moving gradient, so that consecutive frames are different but predictable
+      trackedFrames[frameIndex].GetImageData()->AllocateFrame(frameSize, VTK_UNSIGNED_CHAR, 1);
+      unsigned char* pixels = static_cast<unsigned char*>(trackedFrames[frameIndex].GetImageData()->GetScalarPointer());
+      for (unsigned int y = 0; y < height; ++y)
+      {
+        for (unsigned int x = 0; x < width; ++x)
+        {
+          pixels[y * width + x] = static_cast<unsigned char>((x + y + 4 * frameIndex) % 256);
+        }
+      }
+      trackedFrames[frameIndex].SetTimestamp(frameIndex * 0.05);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  bool IsKeyFrame(int frameType)
+  {
+    // Frame type of single component frames is shifted by 8 bits
+    return frameType == FrameTypeKey || frameType == (FrameTypeKey << 8);
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Returns 1 if a message is received, 0 if the connection is closed, -1 on error */
+  int ReceiveVideoMessage(ReceiverData* data)
+  {
+    igtl::MessageHeader::Pointer headerMsg = igtl::MessageHeader::New();
+    headerMsg->InitBuffer();
+    int receivedBytes = data->Socket->Receive(headerMsg->GetBufferPointer(), headerMsg->GetBufferSize());
+    if (receivedBytes == 0)
+    {
+      return 0;
+    }
+    if (receivedBytes != headerMsg->GetBufferSize())
+    {
+      LOG_ERROR("Failed to receive message header");
+      return -1;
+    }
+    headerMsg->Unpack();
+    if (strcmp(headerMsg->GetDeviceType(), "VIDEO") != 0)
+    {
+      LOG_ERROR("Unexpected message type: " << headerMsg->GetDeviceType());
+      return -1;
+    }
+
+    igtl::VideoMessage::Pointer videoMsg = igtl::VideoMessage::New();
+    videoMsg->SetMessageHeader(headerMsg);
+    videoMsg->AllocateBuffer();
+    if (data->Socket->Receive(videoMsg->GetBufferBodyPointer(), videoMsg->GetBufferBodySize()) != videoMsg->GetBufferBodySize())
+    {
+      LOG_ERROR("Failed to receive message body");
+      return -1;
+    }
+    int c = videoMsg->Unpack(1);
+    if (!(c & igtl::MessageHeader::UNPACK_BODY))
+    {
+      LOG_ERROR("Failed to unpack VIDEO message (CRC mismatch or invalid content)");
+      return -1;
+    }
+
+    bool keyFrame = IsKeyFrame(videoMsg->GetFrameType());
+    if (data->NumberOfReceivedMessages == 0)
+    {
+      data->FirstFrameIsKeyFrame = keyFrame;
+    }
+    if (keyFrame)
+    {
+      data->NumberOfKeyFrames++;
+    }
+    return 1;
+  }
+
+  //----------------------------------------------------------------------------
+  void* ReceiverThread(vtkMultiThreader::ThreadInfo* threadInfo)
+  {
+    ReceiverData* data = static_cast<ReceiverData*>(threadInfo->UserData);
+    while (true)
+    {
+      int result = ReceiveVideoMessage(data);
+      if (result < 0)
+      {
+        data->NumberOfErrors++;
+      }
+      if (result <= 0)
+      {
+        break;
+      }
+      data->NumberOfReceivedMessages++;
+    }
+    return NULL;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus SendVideoMessage(SenderData& sender, igtl::VideoMessage::Pointer videoMessage)
+  {
+    if (sender.Socket->Send(videoMessage->GetBufferPointer(), videoMessage->GetBufferSize()) == 0)
+    {
+      LOG_ERROR("Failed to send VIDEO message");
+      return PLUS_FAIL;
+    }
+    sender.NumberOfSentMessages++;
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus RunBenchmark(std::vector<igsioTrackedFrame>& trackedFrames, const PlusIgtlClientInfo::EncodingParameters& encodingParameters,
+                          int numberOfClients, bool shared, int port)
+  {
+    std::string description = shared ? "Shared encoder" : "Per-client encoders";
+    int numberOfFrames = static_cast<int>(trackedFrames.size());
+    std::map<std::string, std::string> codecParameters = encodingParameters.GetCodecParameters();
+
+    igtl::ServerSocket::Pointer serverSocket = igtl::ServerSocket::New();
+    if (serverSocket->CreateServer(port) < 0)
+    {
+      LOG_ERROR(description << ": cannot create server socket on port " << port);
+      return PLUS_FAIL;
+    }
+
+    // Connect the client fleet. The last client starts receiving in the middle of the sequence.
+    std::vector<ReceiverData> receivers(numberOfClients);
+    std::vector<SenderData> senders(numberOfClients);
+    int numberOfErrors = 0;
+    for (int clientIndex = 0; clientIndex < numberOfClients; ++clientIndex)
+    {
+      receivers[clientIndex].Socket = igtl::ClientSocket::New();
+      receivers[clientIndex].NumberOfReceivedMessages = 0;
+      receivers[clientIndex].NumberOfKeyFrames = 0;
+      receivers[clientIndex].FirstFrameIsKeyFrame = false;
+      receivers[clientIndex].NumberOfErrors = 0;
+      if (receivers[clientIndex].Socket->ConnectToServer("127.0.0.1", port) != 0)
+      {
+        LOG_ERROR(description << ": cannot connect client " << clientIndex << " to server on port " << port);
+        numberOfErrors++;
+        break;
+      }
+      senders[clientIndex].Socket = serverSocket->WaitForConnection(SOCKET_TIMEOUT_MSEC);
+      if (senders[clientIndex].Socket.IsNull())
+      {
+        LOG_ERROR(description << ": connection of client " << clientIndex << " was not accepted");
+        numberOfErrors++;
+        break;
+      }
+      senders[clientIndex].FirstFrameIndex = (clientIndex == numberOfClients - 1 && numberOfClients > 1) ? numberOfFrames / 2 + 1 : 0;
+      senders[clientIndex].NumberOfSentMessages = 0;
+      if (!shared)
+      {
+        // Independent encoder for each client, the encoded frames are not cached in the tracked frame
+        senders[clientIndex].FrameConverter = vtkSmartPointer<vtkIGSIOFrameConverter>::New();
+      }
+    }
+    if (numberOfErrors > 0)
+    {
+      for (int clientIndex = 0; clientIndex < numberOfClients; ++clientIndex)
+      {
+        if (senders[clientIndex].Socket.IsNotNull())
+        {
+          senders[clientIndex].Socket->CloseSocket();
+        }
+        receivers[clientIndex].Socket->CloseSocket();
+      }
+      serverSocket->CloseSocket();
+      return PLUS_FAIL;
+    }
+
+    vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+    std::vector<int> receiverThreadIds;
+    for (int clientIndex = 0; clientIndex < numberOfClients; ++clientIndex)
+    {
+      receiverThreadIds.push_back(threader->SpawnThread((vtkThreadFunctionType)&ReceiverThread, &receivers[clientIndex]));
+    }
+
+    vtkSmartPointer<vtkPlusIgtlSharedVideoEncoder> sharedEncoder = vtkSmartPointer<vtkPlusIgtlSharedVideoEncoder>::New();
+    sharedEncoder->SetEncoding(encodingParameters.FourCC, codecParameters);
+    vtkSmartPointer<vtkMatrix4x4> identity = vtkSmartPointer<vtkMatrix4x4>::New();
+
+    int numberOfClientFrames = 0;
+    std::clock_t startCpuTime = std::clock();
+    double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    for (int frameIndex = 0; frameIndex < numberOfFrames && numberOfErrors == 0; ++frameIndex)
+    {
+      igsioTrackedFrame& trackedFrame = trackedFrames[frameIndex];
+      vtkSmartPointer<vtkStreamingVolumeFrame> encodedFrame;
+      if (shared)
+      {
+        encodedFrame = sharedEncoder->GetEncodedFrame(trackedFrame);
+        if (!encodedFrame)
+        {
+          LOG_ERROR(description << ": failed to encode frame " << frameIndex);
+          numberOfErrors++;
+          break;
+        }
+      }
+      for (int clientIndex = 0; clientIndex < numberOfClients && numberOfErrors == 0; ++clientIndex)
+      {
+        SenderData& sender = senders[clientIndex];
+        if (frameIndex < sender.FirstFrameIndex)
+        {
+          continue;
+        }
+        numberOfClientFrames++;
+        if (!shared)
+        {
+          igtl::VideoMessage::Pointer videoMessage = igtl::VideoMessage::New();
+          videoMessage->SetDeviceName("Image_Reference");
+          if (vtkPlusIgtlMessageCommon::PackVideoMessage(videoMessage, trackedFrame, *identity, sender.FrameConverter, encodingParameters.FourCC, codecParameters) != PLUS_SUCCESS
+              || SendVideoMessage(sender, videoMessage) != PLUS_SUCCESS)
+          {
+            numberOfErrors++;
+          }
+          continue;
+        }
+        std::vector<vtkSmartPointer<vtkStreamingVolumeFrame> > framesToSend;
+        sharedEncoder->GetFramesToSend(clientIndex, encodedFrame, framesToSend);
+        for (std::vector<vtkSmartPointer<vtkStreamingVolumeFrame> >::iterator frameIt = framesToSend.begin(); frameIt != framesToSend.end(); ++frameIt)
+        {
+          igtl::VideoMessage::Pointer videoMessage = igtl::VideoMessage::New();
+          videoMessage->SetDeviceName("Image_Reference");
+          if (vtkPlusIgtlMessageCommon::PackVideoMessage(videoMessage, trackedFrame, *identity, *frameIt) != PLUS_SUCCESS
+              || SendVideoMessage(sender, videoMessage) != PLUS_SUCCESS)
+          {
+            numberOfErrors++;
+            break;
+          }
+        }
+      }
+    }
+    sharedEncoder->ReleaseTrackedFrames();
+
+    // Closing the sockets stops the receivers
+    for (int clientIndex = 0; clientIndex < numberOfClients; ++clientIndex)
+    {
+      senders[clientIndex].Socket->CloseSocket();
+    }
+    for (std::vector<int>::iterator threadIdIt = receiverThreadIds.begin(); threadIdIt != receiverThreadIds.end(); ++threadIdIt)
+    {
+      threader->TerminateThread(*threadIdIt);
+    }
+    double elapsedTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTime;
+    double cpuTimeSec = static_cast<double>(std::clock() - startCpuTime) / CLOCKS_PER_SEC;
+    for (int clientIndex = 0; clientIndex < numberOfClients; ++clientIndex)
+    {
+      receivers[clientIndex].Socket->CloseSocket();
+    }
+    serverSocket->CloseSocket();
+
+    int numberOfKeyFrames = 0;
+    for (int clientIndex = 0; clientIndex < numberOfClients; ++clientIndex)
+    {
+      const ReceiverData& receiver = receivers[clientIndex];
+      numberOfErrors += receiver.NumberOfErrors;
+      numberOfKeyFrames += receiver.NumberOfKeyFrames;
+      if (receiver.NumberOfReceivedMessages != senders[clientIndex].NumberOfSentMessages)
+      {
+        LOG_ERROR(description << ": client " << clientIndex << " received " << receiver.NumberOfReceivedMessages << " messages, expected " << senders[clientIndex].NumberOfSentMessages);
+        numberOfErrors++;
+      }
+      if (receiver.NumberOfReceivedMessages == 0 || !receiver.FirstFrameIsKeyFrame)
+      {
+        LOG_ERROR(description << ": stream of client " << clientIndex << " does not start with a key frame");
+        numberOfErrors++;
+      }
+    }
+    if (shared && sharedEncoder->GetNumberOfEncodedFrames() != static_cast<unsigned long>(numberOfFrames))
+    {
+      LOG_ERROR(description << ": " << sharedEncoder->GetNumberOfEncodedFrames() << " frames were encoded, expected " << numberOfFrames);
+      numberOfErrors++;
+    }
+    if (numberOfErrors > 0)
+    {
+      return PLUS_FAIL;
+    }
+
+    LOG_INFO(description << ": " << numberOfClients << " clients, " << numberOfFrames << " frames"
+             << ", CPU time: " << cpuTimeSec * 1000.0 / numberOfClientFrames << " ms/client/frame"
+             << ", wall time: " << elapsedTimeSec * 1000.0 / numberOfFrames << " ms/frame"
+             << ", key frames received: " << numberOfKeyFrames);
+    return PLUS_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  bool printHelp(false);
+  int numberOfFrames(60);
+  int numberOfClients(4);
+  int frameWidth(320);
+  int frameHeight(240);
+  int maxKeyframeDistance(20);
+  int port(18951);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--frames", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfFrames, "Number of frames to send in each run (default: 60)");
+  args.AddArgument("--clients", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfClients, "Number of loopback clients (default: 4)");
+  args.AddArgument("--frame-width", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &frameWidth, "Frame width in pixels (default: 320)");
+  args.AddArgument("--frame-height", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &frameHeight, "Frame height in pixels (default: 240)");
+  args.AddArgument("--max-keyframe-distance", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &maxKeyframeDistance, "Maximum number of frames between key frames (default: 20)");
+  args.AddArgument("--port", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &port, "Loopback port used for the test (default: 18951)");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (printHelp)
+  {
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  if (numberOfFrames < 2 || numberOfClients < 1 || frameWidth < 1 || frameHeight < 1)
+  {
+    LOG_ERROR("Number of frames must be at least 2, number of clients and frame size must be positive");
+    exit(EXIT_FAILURE);
+  }
+
+  std::vector<igsioTrackedFrame> trackedFrames(numberOfFrames);
+  CreateFrames(trackedFrames, frameWidth, frameHeight);
+
+  PlusIgtlClientInfo::EncodingParameters encodingParameters;
+  encodingParameters.MaxKeyframeDistance = maxKeyframeDistance;
+
+  int numberOfErrors = 0;
+  for (int shared = 0; shared < 2; ++shared)
+  {
+    if (RunBenchmark(trackedFrames, encodingParameters, numberOfClients, shared != 0, port) != PLUS_SUCCESS)
+    {
+      numberOfErrors++;
+    }
+  }
+
+  if (numberOfErrors > 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,288 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file PlusTrackedFrameMessageTest.cxx
+  \brief Round-trip test and pack/unpack benchmark of TRACKEDFRAME messages with XML and binary frame field encoding
+*/
+
+// Local includes
+#include "PlusConfigure.h"
+#include "igtlPlusTrackedFrameMessage.h"
+
+// IGSIO includes
+#include <igsioTrackedFrame.h>
+#include <vtkIGSIOAccurateTimer.h>
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkPoints.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+  const double MATRIX_TOLERANCE = 1e-6;
+
+  //----------------------------------------------------------------------------
+  void CreateTestFrame(igsioTrackedFrame& trackedFrame, unsigned int imageWidth, unsigned int imageHeight, int numberOfTransforms)
+  {
+    FrameSizeType frameSize = { imageWidth, imageHeight, 1 };
+    trackedFrame.GetImageData()->AllocateFrame(frameSize, VTK_UNSIGNED_CHAR, 1);
+    unsigned char* pixels = static_cast<unsigned char*>(trackedFrame.GetImageData()->GetScalarPointer());
+    for (unsigned int i = 0; i < imageWidth * imageHeight; ++i)
+    {
+      pixels[i] = static_cast<unsigned char>(i % 251);
+    }
+    trackedFrame.SetTimestamp(1234.5678);
+
+    for (int t = 0; t < numberOfTransforms; ++t)
+    {
+      vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+      for (int i = 0; i < 3; ++i)
+      {
+        for (int j = 0; j < 4; ++j)
+        {
+          matrix->SetElement(i, j, 1.0 / (3 + t + i * 4 + j) - 0.1234567891234 * j);
+        }
+      }
+      igsioTransformName transformName(std::string("Tool") + igsioCommon::ToString<int>(t), "Tracker");
+      trackedFrame.SetFrameTransform(transformName, matrix);
+      trackedFrame.SetFrameTransformStatus(transformName, (t % 2 == 0) ? TOOL_OK : TOOL_OUT_OF_VIEW);
+    }
+
+    trackedFrame.SetFrameField("Depth", "55");
+    trackedFrame.SetFrameField("Description", "Frame field with special characters: <>&\"'");
+
+    vtkSmartPointer<vtkPoints> fiducialPoints = vtkSmartPointer<vtkPoints>::New();
+    fiducialPoints->InsertNextPoint(10.5, 20.25, 0);
+    fiducialPoints->InsertNextPoint(30.125, 40.0625, 0);
+    trackedFrame.SetFiducialPointsCoordinatePx(fiducialPoints);
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus PackFrame(igsioTrackedFrame& trackedFrame, igtl::PlusTrackedFrameMessage::FieldEncodingType encoding, igtl::PlusTrackedFrameMessage::Pointer& message)
+  {
+    message = igtl::PlusTrackedFrameMessage::New();
+    message->SetFieldEncoding(encoding);
+    std::vector<igsioTransformName> requestedTransforms;
+    if (message->SetTrackedFrame(trackedFrame, requestedTransforms) != PLUS_SUCCESS)
+    {
+      return PLUS_FAIL;
+    }
+    vtkSmartPointer<vtkMatrix4x4> identity = vtkSmartPointer<vtkMatrix4x4>::New();
+    message->SetEmbeddedImageTransform(identity);
+    message->Pack();
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus UnpackFrame(igtl::PlusTrackedFrameMessage::Pointer sentMessage, igtl::PlusTrackedFrameMessage::Pointer& receivedMessage)
+  {
+    // Simulate receiving the message from a socket: header first, then the body
+    igtl::MessageHeader::Pointer header = igtl::MessageHeader::New();
+    header->InitBuffer();
+    memcpy(header->GetBufferPointer(), sentMessage->GetBufferPointer(), header->GetBufferSize());
+    header->Unpack();
+
+    receivedMessage = igtl::PlusTrackedFrameMessage::New();
+    receivedMessage->SetMessageHeader(header);
+    receivedMessage->AllocateBuffer();
+    memcpy(receivedMessage->GetBufferBodyPointer(), sentMessage->GetBufferBodyPointer(), receivedMessage->GetBufferBodySize());
+    int c = receivedMessage->Unpack(1);
+    if (!(c & igtl::MessageHeader::UNPACK_BODY))
+    {
+      return PLUS_FAIL;
+    }
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus CompareFrames(igsioTrackedFrame& expected, igsioTrackedFrame& actual)
+  {
+    int numberOfErrors = 0;
+
+    if (expected.GetImageData()->GetFrameSizeInBytes() != actual.GetImageData()->GetFrameSizeInBytes()
+        || memcmp(expected.GetImageData()->GetScalarPointer(), actual.GetImageData()->GetScalarPointer(), expected.GetImageData()->GetFrameSizeInBytes()) != 0)
+    {
+      LOG_ERROR("Image data mismatch");
+      numberOfErrors++;
+    }
+
+    std::vector<igsioTransformName> transformNames;
+    expected.GetFrameTransformNameList(transformNames);
+    for (std::vector<igsioTransformName>::iterator it = transformNames.begin(); it != transformNames.end(); ++it)
+    {
+      std::string transformNameStr;
+      it->GetTransformName(transformNameStr);
+      vtkSmartPointer<vtkMatrix4x4> expectedMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+      vtkSmartPointer<vtkMatrix4x4> actualMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+      ToolStatus expectedStatus(TOOL_INVALID);
+      ToolStatus actualStatus(TOOL_INVALID);
+      expected.GetFrameTransform(*it, expectedMatrix);
+      expected.GetFrameTransformStatus(*it, expectedStatus);
+      if (actual.GetFrameTransform(*it, actualMatrix) != PLUS_SUCCESS || actual.GetFrameTransformStatus(*it, actualStatus) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Transform is missing from the received frame: " << transformNameStr);
+        numberOfErrors++;
+        continue;
+      }
+      if (expectedStatus != actualStatus)
+      {
+        LOG_ERROR("Transform status mismatch: " << transformNameStr);
+        numberOfErrors++;
+      }
+      for (int i = 0; i < 4; ++i)
+      {
+        for (int j = 0; j < 4; ++j)
+        {
+          if (fabs(expectedMatrix->GetElement(i, j) - actualMatrix->GetElement(i, j)) > MATRIX_TOLERANCE)
+          {
+            LOG_ERROR("Transform matrix mismatch: " << transformNameStr << "(" << i << "," << j << ")");
+            numberOfErrors++;
+          }
+        }
+      }
+    }
+
+    const char* fieldNames[] = { "Depth", "Description" };
+    for (int i = 0; i < 2; ++i)
+    {
+      if (expected.GetFrameField(fieldNames[i]) != actual.GetFrameField(fieldNames[i]))
+      {
+        LOG_ERROR("Frame field mismatch: " << fieldNames[i] << " expected: " << expected.GetFrameField(fieldNames[i]) << " actual: " << actual.GetFrameField(fieldNames[i]));
+        numberOfErrors++;
+      }
+    }
+
+    if (actual.GetFiducialPointsCoordinatePx() == NULL
+        || actual.GetFiducialPointsCoordinatePx()->GetNumberOfPoints() != expected.GetFiducialPointsCoordinatePx()->GetNumberOfPoints())
+    {
+      LOG_ERROR("Fiducial points mismatch");
+      numberOfErrors++;
+    }
+
+    return numberOfErrors == 0 ? PLUS_SUCCESS : PLUS_FAIL;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus RunBenchmark(igsioTrackedFrame& trackedFrame, igtl::PlusTrackedFrameMessage::FieldEncodingType encoding, int numberOfIterations, const std::string& description)
+  {
+    igtl::PlusTrackedFrameMessage::Pointer sentMessage;
+    igtl::PlusTrackedFrameMessage::Pointer receivedMessage;
+
+    // Verify the round trip before measuring
+    if (PackFrame(trackedFrame, encoding, sentMessage) != PLUS_SUCCESS || UnpackFrame(sentMessage, receivedMessage) != PLUS_SUCCESS)
+    {
+      LOG_ERROR(description << ": failed to pack/unpack tracked frame message");
+      return PLUS_FAIL;
+    }
+    if (receivedMessage->GetFieldEncoding() != encoding)
+    {
+      LOG_ERROR(description << ": field encoding was not detected correctly");
+      return PLUS_FAIL;
+    }
+    igsioTrackedFrame receivedFrame = receivedMessage->GetTrackedFrame();
+    if (CompareFrames(trackedFrame, receivedFrame) != PLUS_SUCCESS)
+    {
+      LOG_ERROR(description << ": received tracked frame does not match the sent tracked frame");
+      return PLUS_FAIL;
+    }
+    igsioTrackedFrame setFrame = sentMessage->GetTrackedFrame();
+    if (CompareFrames(trackedFrame, setFrame) != PLUS_SUCCESS || setFrame.GetTimestamp() != trackedFrame.GetTimestamp())
+    {
+      LOG_ERROR(description << ": tracked frame of the sent message does not match the frame that was set");
+      return PLUS_FAIL;
+    }
+
+    double packTimeSec = 0;
+    double unpackTimeSec = 0;
+    for (int i = 0; i < numberOfIterations; ++i)
+    {
+      double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+      PackFrame(trackedFrame, encoding, sentMessage);
+      double packedTime = vtkIGSIOAccurateTimer::GetSystemTime();
+      UnpackFrame(sentMessage, receivedMessage);
+      double unpackedTime = vtkIGSIOAccurateTimer::GetSystemTime();
+      packTimeSec += packedTime - startTime;
+      unpackTimeSec += unpackedTime - packedTime;
+    }
+
+    LOG_INFO(description << ": message size: " << sentMessage->GetBufferSize() << " bytes"
+             << ", pack: " << packTimeSec / numberOfIterations * 1e6 << " us"
+             << ", unpack: " << unpackTimeSec / numberOfIterations * 1e6 << " us");
+    return PLUS_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  bool printHelp(false);
+  int numberOfIterations(200);
+  int numberOfTransforms(10);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--iterations", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfIterations, "Number of pack/unpack iterations for the benchmark (default: 200)");
+  args.AddArgument("--transforms", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfTransforms, "Number of transforms in each frame (default: 10)");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (printHelp)
+  {
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  int numberOfErrors = 0;
+
+  igsioTrackedFrame smallFrame;
+  CreateTestFrame(smallFrame, 64, 64, numberOfTransforms);
+  igsioTrackedFrame largeFrame;
+  CreateTestFrame(largeFrame, 640, 480, numberOfTransforms);
+
+  if (RunBenchmark(smallFrame, igtl::PlusTrackedFrameMessage::FIELD_ENCODING_XML, numberOfIterations, "64x64 frame, XML fields") != PLUS_SUCCESS)
+  {
+    numberOfErrors++;
+  }
+  if (RunBenchmark(smallFrame, igtl::PlusTrackedFrameMessage::FIELD_ENCODING_BINARY, numberOfIterations, "64x64 frame, binary fields") != PLUS_SUCCESS)
+  {
+    numberOfErrors++;
+  }
+  if (RunBenchmark(largeFrame, igtl::PlusTrackedFrameMessage::FIELD_ENCODING_XML, numberOfIterations, "640x480 frame, XML fields") != PLUS_SUCCESS)
+  {
+    numberOfErrors++;
+  }
+  if (RunBenchmark(largeFrame, igtl::PlusTrackedFrameMessage::FIELD_ENCODING_BINARY, numberOfIterations, "640x480 frame, binary fields") != PLUS_SUCCESS)
+  {
+    numberOfErrors++;
+  }
+
+  if (numberOfErrors > 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,59 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "igtlPlusImageMessage.h"
+#include "igtl_image.h"
+
+namespace igtl
+{
+  //----------------------------------------------------------------------------
+  PlusImageMessage::PlusImageMessage()
+    : ImageMessage()
+  {
+  }
+
+  //----------------------------------------------------------------------------
+  PlusImageMessage::~PlusImageMessage()
+  {
+  }
+
+  //----------------------------------------------------------------------------
+  void PlusImageMessage::SetSourceImage(vtkImageData* image)
+  {
+    this->m_SourceImage = image;
+  }
+
+  //----------------------------------------------------------------------------
+  vtkImageData* PlusImageMessage::GetSourceImage()
+  {
+    return this->m_SourceImage;
+  }
+
+  //----------------------------------------------------------------------------
+  int PlusImageMessage::CalculateContentBufferSize()
+  {
+    if (this->m_SourceImage == NULL)
+    {
+      return ImageMessage::CalculateContentBufferSize();
+    }
+    // Scalars are not stored in the message buffer
+    return IGTL_IMAGE_HEADER_SIZE;
+  }
+
+  //----------------------------------------------------------------------------
+  bool PlusImageMessage::GetGatherSegments(SegmentList& segments)
+  {
+    if (this->m_SourceImage == NULL)
+    {
+      return false;
+    }
+    // Scalars would follow the image header in a contiguously packed message
+    size_t scalarOffset = (this->m_Content - this->m_Buffer) + IGTL_IMAGE_HEADER_SIZE;
+    SpliceData(this, scalarOffset, this->m_SourceImage->GetScalarPointer(), this->GetSubVolumeImageSize(), segments);
+    return true;
+  }
+}
@@ -0,0 +1,58 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __igtlPlusImageMessage_h
+#define __igtlPlusImageMessage_h
+
+#include "vtkPlusOpenIGTLinkExport.h"
+
+#include "PlusIgtlGatherMessage.h"
+#include "igtlImageMessage.h"
+#include "vtkImageData.h"
+#include "vtkSmartPointer.h"
+
+namespace igtl
+{
+  /*!
+    \class PlusImageMessage
+    \brief IMAGE message that references the image scalars in place instead of copying them into the message buffer
+
+    The message is identical to igtl::ImageMessage on the wire. If a source image is set, then the message
+    buffer only contains the headers and metadata, and the scalars of the source image are inserted
+    at send time (see PlusIgtlGatherMessage::Send). Only used for sending, received IMAGE messages
+    are always igtl::ImageMessage.
+
+    \ingroup PlusLibOpenIGTLink
+  */
+  class vtkPlusOpenIGTLinkExport PlusImageMessage: public igtl::ImageMessage, public PlusIgtlGatherMessage
+  {
+  public:
+    igtlTypeMacro(igtl::PlusImageMessage, igtl::ImageMessage);
+    igtlNewMacro(igtl::PlusImageMessage);
+
+  public:
+    /*!
+      Set the image that contains the scalars to send. Must be called before AllocateScalars().
+      The image must be contiguous and its size must match the subvolume size of the message.
+      The scalars must not be written through GetScalarPointer() when a source image is set.
+    */
+    void SetSourceImage(vtkImageData* image);
+    vtkImageData* GetSourceImage();
+
+    /*! Get the segments of the packed message, with the scalars referenced from the source image */
+    virtual bool GetGatherSegments(SegmentList& segments);
+
+  protected:
+    virtual int CalculateContentBufferSize();
+
+    PlusImageMessage();
+    ~PlusImageMessage();
+
+    vtkSmartPointer<vtkImageData> m_SourceImage;
+  };
+}
+
+#endif
@@ -9,12 +9,198 @@ See License.txt for details.
 #include "vtkImageData.h"
 #include "vtkMatrix4x4.h"
 #include "vtkPlusIgtlMessageFactory.h"
+#include "vtkPoints.h"
+
+namespace
+{
+  /*
+    Binary frame field section layout (all values are big-endian):
+      char[4]   magic "PTFB"
+      uint16    version
+      uint32    number of records
+      records:  uint8 record type, uint32 payload size in bytes, payload
+        RECORD_FRAME_FIELD: uint32 flags, uint16 name length, name, uint32 value length, value
+        RECORD_TRANSFORM:   uint16 name length, name, uint16 status, 16 x float64 matrix elements (row-major)
+        RECORD_FIDUCIALS:   uint32 number of points, 3 x float64 per point
+    Records of unknown type are skipped, so new record types can be added without changing the version.
+  */
+  const char BINARY_FIELDS_MAGIC[4] = { 'P', 'T', 'F', 'B' };
+  const igtl_uint16 BINARY_FIELDS_VERSION = 1;
+
+  enum BinaryFieldRecordType
+  {
+    RECORD_FRAME_FIELD = 1,
+    RECORD_TRANSFORM = 2,
+    RECORD_FIDUCIALS = 3
+  };
+
+  //----------------------------------------------------------------------------
+  class BinaryFieldWriter
+  {
+  public:
+    explicit BinaryFieldWriter(std::string& buffer) : Buffer(buffer) {}
+
+    void WriteUInt8(igtl_uint8 value)
+    {
+      this->Buffer.push_back(static_cast<char>(value));
+    }
+    void WriteUInt16(igtl_uint16 value)
+    {
+      if (igtl_is_little_endian())
+      {
+        value = BYTE_SWAP_INT16(value);
+      }
+      this->Buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    void WriteUInt32(igtl_uint32 value)
+    {
+      if (igtl_is_little_endian())
+      {
+        value = BYTE_SWAP_INT32(value);
+      }
+      this->Buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    void WriteDouble(igtl_float64 value)
+    {
+      igtl_uint64 bits;
+      memcpy(&bits, &value, sizeof(bits));
+      if (igtl_is_little_endian())
+      {
+        bits = BYTE_SWAP_INT64(bits);
+      }
+      this->Buffer.append(reinterpret_cast<const char*>(&bits), sizeof(bits));
+    }
+    void WriteBytes(const char* data, size_t size)
+    {
+      this->Buffer.append(data, size);
+    }
+
+    /*! Write record type and a placeholder for the payload size. Returns the position of the size. */
+    size_t BeginRecord(BinaryFieldRecordType type)
+    {
+      this->WriteUInt8(static_cast<igtl_uint8>(type));
+      size_t sizePosition = this->Buffer.size();
+      this->WriteUInt32(0);
+      return sizePosition;
+    }
+    void EndRecord(size_t sizePosition)
+    {
+      igtl_uint32 payloadSize = static_cast<igtl_uint32>(this->Buffer.size() - sizePosition - sizeof(igtl_uint32));
+      if (igtl_is_little_endian())
+      {
+        payloadSize = BYTE_SWAP_INT32(payloadSize);
+      }
+      memcpy(&this->Buffer[sizePosition], &payloadSize, sizeof(payloadSize));
+    }
+
+  protected:
+    std::string& Buffer;
+  };
+
+  //----------------------------------------------------------------------------
+  class BinaryFieldReader
+  {
+  public:
+    BinaryFieldReader(const unsigned char* data, size_t size) : Data(data), Size(size), Position(0) {}
+
+    bool ReadUInt8(igtl_uint8& value)
+    {
+      if (this->Remaining() < sizeof(value))
+      {
+        return false;
+      }
+      value = this->Data[this->Position++];
+      return true;
+    }
+    bool ReadUInt16(igtl_uint16& value)
+    {
+      if (!this->ReadRaw(&value, sizeof(value)))
+      {
+        return false;
+      }
+      if (igtl_is_little_endian())
+      {
+        value = BYTE_SWAP_INT16(value);
+      }
+      return true;
+    }
+    bool ReadUInt32(igtl_uint32& value)
+    {
+      if (!this->ReadRaw(&value, sizeof(value)))
+      {
+        return false;
+      }
+      if (igtl_is_little_endian())
+      {
+        value = BYTE_SWAP_INT32(value);
+      }
+      return true;
+    }
+    bool ReadDouble(igtl_float64& value)
+    {
+      igtl_uint64 bits;
+      if (!this->ReadRaw(&bits, sizeof(bits)))
+      {
+        return false;
+      }
+      if (igtl_is_little_endian())
+      {
+        bits = BYTE_SWAP_INT64(bits);
+      }
+      memcpy(&value, &bits, sizeof(value));
+      return true;
+    }
+    bool ReadString(size_t length, std::string& value)
+    {
+      if (this->Remaining() < length)
+      {
+        return false;
+      }
+      value.assign(reinterpret_cast<const char*>(this->Data + this->Position), length);
+      this->Position += length;
+      return true;
+    }
+    bool Skip(size_t length)
+    {
+      if (this->Remaining() < length)
+      {
+        return false;
+      }
+      this->Position += length;
+      return true;
+    }
+    size_t Remaining() const
+    {
+      return this->Size - this->Position;
+    }
+
+  protected:
+    bool ReadRaw(void* value, size_t size)
+    {
+      if (this->Remaining() < size)
+      {
+        return false;
+      }
+      memcpy(value, this->Data + this->Position, size);
+      this->Position += size;
+      return true;
+    }
+
+    const unsigned char* Data;
+    size_t Size;
+    size_t Position;
+  };
+}
 
 namespace igtl
 {
   //----------------------------------------------------------------------------
   PlusTrackedFrameMessage::PlusTrackedFrameMessage()
     : MessageBase()
+    , m_FieldEncoding(FIELD_ENCODING_XML)
+    , m_GatherImageData(false)
+    , m_SourceImageModifiedTime(0)
+    , m_SourceTimestamp(0.0)
   {
     this->m_SendMessageType = "TRACKEDFRAME";
   }
@@ -48,17 +234,26 @@ namespace igtl
   }
 
   //----------------------------------------------------------------------------
-  PlusStatus PlusTrackedFrameMessage::SetTrackedFrame(const igsioTrackedFrame& trackedFrame, const std::vector<igsioTransformName>& requestedTransforms)
+  PlusStatus PlusTrackedFrameMessage::SetTrackedFrame(const igsioTrackedFrame& constTrackedFrame, const std::vector<igsioTransformName>& requestedTransforms)
   {
-    this->m_TrackedFrame = trackedFrame;
+    // Getters of igsioTrackedFrame are not const-qualified, the frame is not modified here
+    igsioTrackedFrame& trackedFrame = const_cast<igsioTrackedFrame&>(constTrackedFrame);
 
-    if (this->m_TrackedFrame.GetTrackedFrameInXmlData(this->m_TrackedFrameXmlData, requestedTransforms) != PLUS_SUCCESS)
+    if (this->m_FieldEncoding == FIELD_ENCODING_BINARY)
+    {
+      if (this->EncodeBinaryFields(trackedFrame, requestedTransforms) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to pack Plus TrackedFrame message - unable to encode tracked frame fields.");
+        return PLUS_FAIL;
+      }
+    }
+    else if (trackedFrame.GetTrackedFrameInXmlData(this->m_TrackedFrameFieldData, requestedTransforms) != PLUS_SUCCESS)
     {
       LOG_ERROR("Failed to pack Plus TrackedFrame message - unable to get tracked frame in xml data.");
       return PLUS_FAIL;
     }
 
-    FrameSizeType frameSize = this->m_TrackedFrame.GetFrameSize();
+    FrameSizeType frameSize = trackedFrame.GetFrameSize();
     if (frameSize[0] > static_cast<unsigned int>(std::numeric_limits<igtl_uint16>::max()) ||
         frameSize[1] > static_cast<unsigned int>(std::numeric_limits<igtl_uint16>::max()) ||
         frameSize[2] > static_cast<unsigned int>(std::numeric_limits<igtl_uint16>::max()))
@@ -70,19 +265,37 @@ namespace igtl
     this->m_MessageHeader.m_FrameSize[0] = frameSize[0];
     this->m_MessageHeader.m_FrameSize[1] = frameSize[1];
     this->m_MessageHeader.m_FrameSize[2] = frameSize[2];
-    this->m_MessageHeader.m_XmlDataSizeInBytes = this->m_TrackedFrameXmlData.size();
-    this->m_MessageHeader.m_ScalarType = PlusCommon::GetIGTLScalarPixelTypeFromVTK(this->m_TrackedFrame.GetImageData()->GetVTKScalarPixelType());
+    this->m_MessageHeader.m_XmlDataSizeInBytes = this->m_TrackedFrameFieldData.size();
+    this->m_MessageHeader.m_ScalarType = PlusCommon::GetIGTLScalarPixelTypeFromVTK(trackedFrame.GetImageData()->GetVTKScalarPixelType());
 
     unsigned int numberOfScalarComponents(1);
-    if (m_TrackedFrame.GetImageData()->GetNumberOfScalarComponents(numberOfScalarComponents) == PLUS_FAIL)
+    if (trackedFrame.GetImageData()->GetNumberOfScalarComponents(numberOfScalarComponents) == PLUS_FAIL)
     {
       LOG_ERROR("Unable to retrieve number of scalar components.");
       return PLUS_FAIL;
     }
     this->m_MessageHeader.m_NumberOfComponents = numberOfScalarComponents;
-    this->m_MessageHeader.m_ImageType = m_TrackedFrame.GetImageData()->GetImageType();
-    this->m_MessageHeader.m_ImageDataSizeInBytes = this->m_TrackedFrame.GetImageData()->GetFrameSizeInBytes();
-    this->m_MessageHeader.m_ImageOrientation = (igtl_uint16)this->m_TrackedFrame.GetImageData()->GetImageOrientation();
+    this->m_MessageHeader.m_ImageType = trackedFrame.GetImageData()->GetImageType();
+    this->m_MessageHeader.m_ImageDataSizeInBytes = trackedFrame.GetImageData()->GetFrameSizeInBytes();
+    this->m_MessageHeader.m_ImageOrientation = (igtl_uint16)trackedFrame.GetImageData()->GetImageOrientation();
+
+    // Keep a reference to the image instead of a deep copy of the whole frame, pixels are copied once, directly into the message buffer
+    this->m_SourceImage = trackedFrame.GetImageData()->GetImage();
+    this->m_SourceImageModifiedTime = (this->m_SourceImage != NULL ? this->m_SourceImage->GetMTime() : 0);
+    this->m_SourceTimestamp = trackedFrame.GetTimestamp();
+
+    // Keep all the other (small) parts of the frame, so that GetTrackedFrame can return the frame that was set
+    this->m_TrackedFrame = igsioTrackedFrame();
+    this->m_TrackedFrame.SetTimestamp(trackedFrame.GetTimestamp());
+    igsioFieldMapType frameFields = trackedFrame.GetFrameFields();
+    for (igsioFieldMapType::const_iterator fieldIt = frameFields.begin(); fieldIt != frameFields.end(); ++fieldIt)
+    {
+      this->m_TrackedFrame.SetFrameField(fieldIt->first, fieldIt->second.second, fieldIt->second.first);
+    }
+    if (trackedFrame.GetFiducialPointsCoordinatePx() != NULL)
+    {
+      this->m_TrackedFrame.SetFiducialPointsCoordinatePx(trackedFrame.GetFiducialPointsCoordinatePx());
+    }
 
     return PLUS_SUCCESS;
   }
@@ -90,7 +303,62 @@ namespace igtl
   //----------------------------------------------------------------------------
   igsioTrackedFrame PlusTrackedFrameMessage::GetTrackedFrame()
   {
-    return this->m_TrackedFrame;
+    igsioTrackedFrame trackedFrame(this->m_TrackedFrame);
+    if (this->m_SourceImage != NULL)
+    {
+      // Frame to be sent, its image is only referenced by the message
+      trackedFrame.GetImageData()->DeepCopyFrom(this->m_SourceImage);
+      trackedFrame.GetImageData()->SetImageType((US_IMAGE_TYPE)this->m_MessageHeader.m_ImageType);
+      trackedFrame.GetImageData()->SetImageOrientation((US_IMAGE_ORIENTATION)this->m_MessageHeader.m_ImageOrientation);
+    }
+    return trackedFrame;
+  }
+
+  //----------------------------------------------------------------------------
+  bool PlusTrackedFrameMessage::IsSourceImageModified() const
+  {
+    return this->m_SourceImage != NULL && this->m_SourceImage->GetMTime() != this->m_SourceImageModifiedTime;
+  }
+
+  //----------------------------------------------------------------------------
+  void PlusTrackedFrameMessage::SetFieldEncoding(FieldEncodingType encoding)
+  {
+    this->m_FieldEncoding = encoding;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusTrackedFrameMessage::FieldEncodingType PlusTrackedFrameMessage::GetFieldEncoding() const
+  {
+    return this->m_FieldEncoding;
+  }
+
+  //----------------------------------------------------------------------------
+  void PlusTrackedFrameMessage::SetGatherImageData(bool enable)
+  {
+    this->m_GatherImageData = enable;
+  }
+
+  //----------------------------------------------------------------------------
+  bool PlusTrackedFrameMessage::GetGatherImageData() const
+  {
+    return this->m_GatherImageData;
+  }
+
+  //----------------------------------------------------------------------------
+  bool PlusTrackedFrameMessage::GetGatherSegments(SegmentList& segments)
+  {
+    if (!this->m_GatherImageData || this->m_MessageHeader.m_ImageDataSizeInBytes == 0 || this->m_SourceImage == NULL)
+    {
+      return false;
+    }
+    if (this->IsSourceImageModified())
+    {
+      LOG_ERROR("Image of the tracked frame was modified after it was set in the Plus TrackedFrame message, the sent image may be inconsistent with the frame fields");
+    }
+    // Image data would follow the frame field section in a contiguously packed message
+    size_t imageDataOffset = (this->m_Content - this->m_Buffer) + this->m_MessageHeader.GetMessageHeaderSize() + this->m_MessageHeader.m_XmlDataSizeInBytes;
+    SpliceData(this, imageDataOffset, this->m_SourceImage->GetScalarPointer(), this->m_MessageHeader.m_ImageDataSizeInBytes, segments);
+    return true;
   }
 
   //----------------------------------------------------------------------------
@@ -124,14 +392,21 @@ namespace igtl
   //----------------------------------------------------------------------------
   int PlusTrackedFrameMessage::CalculateContentBufferSize()
   {
+    int imageDataSize = (this->m_GatherImageData && this->m_SourceImage != NULL) ? 0 : this->m_MessageHeader.m_ImageDataSizeInBytes;
     return this->m_MessageHeader.GetMessageHeaderSize()
-           + this->m_MessageHeader.m_ImageDataSizeInBytes
+           + imageDataSize
            + this->m_MessageHeader.m_XmlDataSizeInBytes;
   }
 
   //----------------------------------------------------------------------------
   int PlusTrackedFrameMessage::PackContent()
   {
+    if (this->IsSourceImageModified())
+    {
+      LOG_ERROR("Failed to pack Plus TrackedFrame message - image of the tracked frame was modified after it was set in the message.");
+      return 0;
+    }
+
     AllocateBuffer();
 
     // Copy header
@@ -147,18 +422,20 @@ namespace igtl
     header->m_ImageOrientation = this->m_MessageHeader.m_ImageOrientation;
     memcpy(header->m_EmbeddedImageTransform, this->m_MessageHeader.m_EmbeddedImageTransform, sizeof(igtl::Matrix4x4));
 
-    // Copy xml data
-    char* xmlData = (char*)(this->m_Content + header->GetMessageHeaderSize());
-    strncpy(xmlData, this->m_TrackedFrameXmlData.c_str(), this->m_TrackedFrameXmlData.size());
-    header->m_XmlDataSizeInBytes = this->m_MessageHeader.m_XmlDataSizeInBytes;
+    // Copy frame field data (xml or binary)
+    char* fieldData = (char*)(this->m_Content + header->GetMessageHeaderSize());
+    memcpy(fieldData, this->m_TrackedFrameFieldData.data(), this->m_TrackedFrameFieldData.size());
 
-    // Copy image data
-    void* imageData = (void*)(this->m_Content + header->GetMessageHeaderSize() + header->m_XmlDataSizeInBytes);
-    memcpy(imageData, this->m_TrackedFrame.GetImageData()->GetScalarPointer(), this->m_TrackedFrame.GetImageData()->GetFrameSizeInBytes());
+    // Copy image data directly from the source image (when gathering, it is inserted at send time instead)
+    void* imageData = (void*)(this->m_Content + header->GetMessageHeaderSize() + this->m_MessageHeader.m_XmlDataSizeInBytes);
+    if (this->m_MessageHeader.m_ImageDataSizeInBytes > 0 && this->m_SourceImage != NULL && !this->m_GatherImageData)
+    {
+      memcpy(imageData, this->m_SourceImage->GetScalarPointer(), this->m_MessageHeader.m_ImageDataSizeInBytes);
+    }
 
     // Set timestamp
     igtl::TimeStamp::Pointer timestamp = igtl::TimeStamp::New();
-    timestamp->SetTime(this->m_TrackedFrame.GetTimestamp());
+    timestamp->SetTime(this->m_SourceTimestamp);
     this->SetTimeStamp(timestamp);
 
     // Convert header endian
@@ -187,13 +464,30 @@ namespace igtl
     this->m_MessageHeader.m_ImageOrientation = header->m_ImageOrientation;
     memcpy(this->m_MessageHeader.m_EmbeddedImageTransform, header->m_EmbeddedImageTransform, sizeof(igtl::Matrix4x4));
 
-    // Copy xml data
-    char* xmlData = (char*)(this->m_Content + header->GetMessageHeaderSize());
-    this->m_TrackedFrameXmlData.assign(xmlData, header->m_XmlDataSizeInBytes);
-    if (this->m_TrackedFrame.SetTrackedFrameFromXmlData(this->m_TrackedFrameXmlData) != PLUS_SUCCESS)
+    // The received image is stored in m_TrackedFrame
+    this->m_SourceImage = NULL;
+
+    // Parse frame field data, the encoding is detected from the content
+    const unsigned char* fieldData = this->m_Content + header->GetMessageHeaderSize();
+    if (IsBinaryFieldSection(fieldData, header->m_XmlDataSizeInBytes))
     {
-      LOG_ERROR("Failed to set tracked frame data from xml received in Plus TrackedFrame message");
-      return 0;
+      this->m_FieldEncoding = FIELD_ENCODING_BINARY;
+      this->m_TrackedFrameFieldData.clear();
+      if (this->DecodeBinaryFields(fieldData, header->m_XmlDataSizeInBytes) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to set tracked frame data from binary fields received in Plus TrackedFrame message");
+        return 0;
+      }
+    }
+    else
+    {
+      this->m_FieldEncoding = FIELD_ENCODING_XML;
+      this->m_TrackedFrameFieldData.assign(reinterpret_cast<const char*>(fieldData), header->m_XmlDataSizeInBytes);
+      if (this->m_TrackedFrame.SetTrackedFrameFromXmlData(this->m_TrackedFrameFieldData) != PLUS_SUCCESS)
+      {
+        LOG_ERROR("Failed to set tracked frame data from xml received in Plus TrackedFrame message");
+        return 0;
+      }
     }
 
     // Copy image data
@@ -218,4 +512,218 @@ namespace igtl
 
     return 1;
   }
-}
\ No newline at end of file
+
+  //----------------------------------------------------------------------------
+  bool PlusTrackedFrameMessage::IsBinaryFieldSection(const unsigned char* data, size_t size)
+  {
+    // XML data always starts with '<', so the magic number cannot be mistaken for XML
+    return size >= sizeof(BINARY_FIELDS_MAGIC) && memcmp(data, BINARY_FIELDS_MAGIC, sizeof(BINARY_FIELDS_MAGIC)) == 0;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus PlusTrackedFrameMessage::EncodeBinaryFields(igsioTrackedFrame& trackedFrame, const std::vector<igsioTransformName>& requestedTransforms)
+  {
+    this->m_TrackedFrameFieldData.clear();
+    BinaryFieldWriter writer(this->m_TrackedFrameFieldData);
+
+    std::vector<igsioTransformName> transformNames(requestedTransforms);
+    if (transformNames.empty())
+    {
+      trackedFrame.GetFrameTransformNameList(transformNames);
+    }
+    vtkPoints* fiducialPoints = trackedFrame.GetFiducialPointsCoordinatePx();
+    bool hasFiducialPoints = (fiducialPoints != NULL && fiducialPoints->GetNumberOfPoints() > 0);
+
+    // Transforms are written as transform records, the string form of transform fields is not sent
+    igsioFieldMapType frameFields = trackedFrame.GetFrameFields();
+    std::vector<igsioFieldMapType::const_iterator> stringFields;
+    for (igsioFieldMapType::const_iterator fieldIt = frameFields.begin(); fieldIt != frameFields.end(); ++fieldIt)
+    {
+      if (igsioTrackedFrame::IsTransform(fieldIt->first) || igsioTrackedFrame::IsTransformStatus(fieldIt->first))
+      {
+        continue;
+      }
+      stringFields.push_back(fieldIt);
+    }
+
+    writer.WriteBytes(BINARY_FIELDS_MAGIC, sizeof(BINARY_FIELDS_MAGIC));
+    writer.WriteUInt16(BINARY_FIELDS_VERSION);
+    writer.WriteUInt32(static_cast<igtl_uint32>(stringFields.size() + transformNames.size() + (hasFiducialPoints ? 1 : 0)));
+
+    for (std::vector<igsioFieldMapType::const_iterator>::const_iterator it = stringFields.begin(); it != stringFields.end(); ++it)
+    {
+      const std::string& name = (*it)->first;
+      const std::string& value = (*it)->second.second;
+      if (name.size() > std::numeric_limits<igtl_uint16>::max())
+      {
+        LOG_ERROR("Frame field name is too long to be sent: " << name.substr(0, 64) << "...");
+        return PLUS_FAIL;
+      }
+      size_t recordStart = writer.BeginRecord(RECORD_FRAME_FIELD);
+      writer.WriteUInt32(static_cast<igtl_uint32>((*it)->second.first));
+      writer.WriteUInt16(static_cast<igtl_uint16>(name.size()));
+      writer.WriteBytes(name.data(), name.size());
+      writer.WriteUInt32(static_cast<igtl_uint32>(value.size()));
+      writer.WriteBytes(value.data(), value.size());
+      writer.EndRecord(recordStart);
+    }
+
+    vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    for (std::vector<igsioTransformName>::const_iterator it = transformNames.begin(); it != transformNames.end(); ++it)
+    {
+      std::string name;
+      if (it->GetTransformName(name) != PLUS_SUCCESS || name.size() > std::numeric_limits<igtl_uint16>::max())
+      {
+        LOG_ERROR("Invalid transform name, cannot encode tracked frame fields");
+        return PLUS_FAIL;
+      }
+      ToolStatus status(TOOL_INVALID);
+      matrix->Identity();
+      if (trackedFrame.GetFrameTransform(*it, matrix) != PLUS_SUCCESS || trackedFrame.GetFrameTransformStatus(*it, status) != PLUS_SUCCESS)
+      {
+        // Requested but not available in this frame, send it as invalid (same as the XML encoding)
+        status = TOOL_INVALID;
+      }
+      size_t recordStart = writer.BeginRecord(RECORD_TRANSFORM);
+      writer.WriteUInt16(static_cast<igtl_uint16>(name.size()));
+      writer.WriteBytes(name.data(), name.size());
+      writer.WriteUInt16(static_cast<igtl_uint16>(status));
+      for (int i = 0; i < 4; ++i)
+      {
+        for (int j = 0; j < 4; ++j)
+        {
+          writer.WriteDouble(matrix->GetElement(i, j));
+        }
+      }
+      writer.EndRecord(recordStart);
+    }
+
+    if (hasFiducialPoints)
+    {
+      size_t recordStart = writer.BeginRecord(RECORD_FIDUCIALS);
+      writer.WriteUInt32(static_cast<igtl_uint32>(fiducialPoints->GetNumberOfPoints()));
+      for (vtkIdType pointIndex = 0; pointIndex < fiducialPoints->GetNumberOfPoints(); ++pointIndex)
+      {
+        double* point = fiducialPoints->GetPoint(pointIndex);
+        writer.WriteDouble(point[0]);
+        writer.WriteDouble(point[1]);
+        writer.WriteDouble(point[2]);
+      }
+      writer.EndRecord(recordStart);
+    }
+
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus PlusTrackedFrameMessage::DecodeBinaryFields(const unsigned char* data, size_t size)
+  {
+    // Start from an empty frame, the message object may be reused for receiving multiple frames
+    this->m_TrackedFrame = igsioTrackedFrame();
+
+    BinaryFieldReader reader(data, size);
+    igtl_uint16 version(0);
+    igtl_uint32 numberOfRecords(0);
+    if (!reader.Skip(sizeof(BINARY_FIELDS_MAGIC)) || !reader.ReadUInt16(version) || !reader.ReadUInt32(numberOfRecords))
+    {
+      LOG_ERROR("Binary tracked frame field section is truncated");
+      return PLUS_FAIL;
+    }
+    if (version > BINARY_FIELDS_VERSION)
+    {
+      LOG_ERROR("Binary tracked frame field section version " << version << " is not supported (supported version: " << BINARY_FIELDS_VERSION << ")");
+      return PLUS_FAIL;
+    }
+
+    vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    for (igtl_uint32 recordIndex = 0; recordIndex < numberOfRecords; ++recordIndex)
+    {
+      igtl_uint8 recordType(0);
+      igtl_uint32 payloadSize(0);
+      if (!reader.ReadUInt8(recordType) || !reader.ReadUInt32(payloadSize) || reader.Remaining() < payloadSize)
+      {
+        LOG_ERROR("Binary tracked frame field section is truncated (record " << recordIndex << " of " << numberOfRecords << ")");
+        return PLUS_FAIL;
+      }
+      size_t remainingAfterRecord = reader.Remaining() - payloadSize;
+
+      bool valid = true;
+      switch (recordType)
+      {
+        case RECORD_FRAME_FIELD:
+        {
+          igtl_uint32 flags(0);
+          igtl_uint16 nameLength(0);
+          igtl_uint32 valueLength(0);
+          std::string name;
+          std::string value;
+          valid = reader.ReadUInt32(flags) && reader.ReadUInt16(nameLength) && reader.ReadString(nameLength, name)
+                  && reader.ReadUInt32(valueLength) && reader.ReadString(valueLength, value);
+          if (valid)
+          {
+            this->m_TrackedFrame.SetFrameField(name, value, static_cast<igsioFrameFieldFlags>(flags));
+          }
+          break;
+        }
+        case RECORD_TRANSFORM:
+        {
+          igtl_uint16 nameLength(0);
+          igtl_uint16 status(0);
+          std::string name;
+          valid = reader.ReadUInt16(nameLength) && reader.ReadString(nameLength, name) && reader.ReadUInt16(status);
+          for (int i = 0; valid && i < 4; ++i)
+          {
+            for (int j = 0; valid && j < 4; ++j)
+            {
+              igtl_float64 element(0);
+              valid = reader.ReadDouble(element);
+              matrix->SetElement(i, j, element);
+            }
+          }
+          igsioTransformName transformName;
+          if (valid && transformName.SetTransformName(name) == PLUS_SUCCESS)
+          {
+            this->m_TrackedFrame.SetFrameTransform(transformName, matrix);
+            this->m_TrackedFrame.SetFrameTransformStatus(transformName, static_cast<ToolStatus>(status));
+          }
+          else if (valid)
+          {
+            LOG_WARNING("Invalid transform name received in binary tracked frame fields: " << name);
+          }
+          break;
+        }
+        case RECORD_FIDUCIALS:
+        {
+          igtl_uint32 numberOfPoints(0);
+          valid = reader.ReadUInt32(numberOfPoints) && reader.Remaining() >= numberOfPoints * 3 * sizeof(igtl_float64);
+          if (valid)
+          {
+            vtkSmartPointer<vtkPoints> fiducialPoints = vtkSmartPointer<vtkPoints>::New();
+            fiducialPoints->SetNumberOfPoints(numberOfPoints);
+            for (igtl_uint32 pointIndex = 0; valid && pointIndex < numberOfPoints; ++pointIndex)
+            {
+              igtl_float64 point[3] = { 0, 0, 0 };
+              valid = reader.ReadDouble(point[0]) && reader.ReadDouble(point[1]) && reader.ReadDouble(point[2]);
+              fiducialPoints->SetPoint(pointIndex, point);
+            }
+            this->m_TrackedFrame.SetFiducialPointsCoordinatePx(fiducialPoints);
+          }
+          break;
+        }
+        default:
+          // Record type introduced by a newer sender, skip it
+          break;
+      }
+
+      if (!valid || reader.Remaining() < remainingAfterRecord)
+      {
+        LOG_ERROR("Invalid record (type " << static_cast<int>(recordType) << ") in binary tracked frame field section");
+        return PLUS_FAIL;
+      }
+      // Skip any trailing bytes of the record that this version does not interpret
+      reader.Skip(reader.Remaining() - remainingAfterRecord);
+    }
+
+    return PLUS_SUCCESS;
+  }
+}
@@ -9,6 +9,7 @@
 
 #include "vtkPlusOpenIGTLinkExport.h"
 
+#include "PlusIgtlGatherMessage.h"
 #include "igsioTrackedFrame.h"
 #include "igtl_types.h"
 #include "igtl_win32header.h"
@@ -16,9 +17,11 @@
 #include "igtlObject.h"
 #include "igtl_header.h"
 #include "igtl_util.h"
+#include "vtkImageData.h"
 #include "vtkMatrix4x4.h"
 #include "vtkSmartPointer.h"
 #include <string>
+#include <vector>
 
 namespace igtl
 {
@@ -28,24 +31,67 @@ namespace igtl
   /*!
     \class PlusTrackedFrameMessage
     \brief IGTL message helper class for tracked frame messages
+
+    The message content is a fixed size header, followed by the frame field section
+    (timestamp, frame fields, transforms, fiducial points) and the raw image data.
+
+    The frame field section is either an XML string (default, understood by all receivers)
+    or a versioned binary section (FIELD_ENCODING_BINARY) that stores transforms as raw doubles,
+    which is much cheaper to produce and parse. The binary section starts with a magic number,
+    therefore the receiver detects the encoding automatically. The sender must only use binary
+    encoding if the receiver requested it (see PlusIgtlClientInfo::GetTrackedFrameBinaryFields).
+
+    If gathering of image data is enabled then the image is not copied into the message buffer,
+    the message must be sent with PlusIgtlGatherMessage::Send.
+
     \ingroup PlusLibOpenIGTLink
   */
-  class vtkPlusOpenIGTLinkExport PlusTrackedFrameMessage: public MessageBase
+  class vtkPlusOpenIGTLinkExport PlusTrackedFrameMessage: public MessageBase, public PlusIgtlGatherMessage
   {
   public:
     igtlTypeMacro(igtl::PlusTrackedFrameMessage, igtl::MessageBase);
     igtlNewMacro(igtl::PlusTrackedFrameMessage);
 
   public:
+    enum FieldEncodingType
+    {
+      FIELD_ENCODING_XML,
+      FIELD_ENCODING_BINARY
+    };
+
     /*! Override clone so that we use the plus igtl factory */
     virtual igtl::MessageBase::Pointer Clone();
 
-    /*! Set Plus TrackedFrame */
+    /*!
+      Set Plus TrackedFrame to be packed. Frame fields are serialized immediately using the current field encoding.
+      The image is not copied: the message keeps a reference to the vtkImageData of the frame and its pixels are
+      written into the message buffer by Pack() (or sent directly by PlusIgtlGatherMessage::Send if gathering is enabled).
+      Therefore the image content must not be changed until the message is packed (sent, if gathering is enabled).
+      Modification of the image after this call is detected by Pack() and reported as an error.
+    */
     PlusStatus SetTrackedFrame(const igsioTrackedFrame& trackedFrame, const std::vector<igsioTransformName>& requestedTransforms);
 
-    /*! Get Plus TrackedFrame */
+    /*!
+      Get Plus TrackedFrame: the frame that was set by SetTrackedFrame or the received frame after the message is unpacked.
+      The image of a frame set by SetTrackedFrame is only copied when this method is called.
+    */
     igsioTrackedFrame GetTrackedFrame();
 
+    /*! Set encoding of the frame field section. Must be called before SetTrackedFrame. */
+    void SetFieldEncoding(FieldEncodingType encoding);
+    /*! Encoding of the frame field section. After unpacking it is the encoding of the received message. */
+    FieldEncodingType GetFieldEncoding() const;
+
+    /*!
+      If enabled then Pack() does not copy the image data into the message buffer, but the image is
+      referenced in place and inserted at send time. Must be called before Pack().
+    */
+    void SetGatherImageData(bool enable);
+    bool GetGatherImageData() const;
+
+    /*! Get the segments of the packed message, with the image data referenced from the source image */
+    virtual bool GetGatherSegments(SegmentList& segments);
+
     /*! Set the embedded transform of the underlying image */
     PlusStatus SetEmbeddedImageTransform(vtkSmartPointer<vtkMatrix4x4> matrix);
 
@@ -110,7 +156,7 @@ namespace igtl
       igtl_uint16     m_ImageType;              /* image type */
       igtl_uint16     m_FrameSize[3];           /* entire image volume size */
       igtl_uint32     m_ImageDataSizeInBytes;   /* size of the image, in bytes */
-      igtl_uint32     m_XmlDataSizeInBytes;     /* size of the xml data, in bytes */
+      igtl_uint32     m_XmlDataSizeInBytes;     /* size of the frame field section (xml or binary), in bytes */
       igtl_uint16     m_ImageOrientation;       /* orientation of the image */
       igtl::Matrix4x4 m_EmbeddedImageTransform; /* matrix representing the IJK to world transformation */
     };
@@ -119,11 +165,33 @@ namespace igtl
     virtual int  PackContent();
     virtual int  UnpackContent();
 
+    /*!
+      Serialize frame fields, requested transforms and fiducial points into m_TrackedFrameFieldData.
+      The timestamp is not part of the binary section, it is sent in the OpenIGTLink message header.
+    */
+    PlusStatus EncodeBinaryFields(igsioTrackedFrame& trackedFrame, const std::vector<igsioTransformName>& requestedTransforms);
+    /*! Returns true if the referenced source image was modified since SetTrackedFrame */
+    bool IsSourceImageModified() const;
+    /*! Set m_TrackedFrame fields from a binary field section. Returns PLUS_FAIL if the section is malformed. */
+    PlusStatus DecodeBinaryFields(const unsigned char* data, size_t size);
+    /*! Returns true if the field section starts with the binary field section magic number */
+    static bool IsBinaryFieldSection(const unsigned char* data, size_t size);
+
     PlusTrackedFrameMessage();
     ~PlusTrackedFrameMessage();
 
+    /*! Received tracked frame, or the tracked frame to be sent without its image data */
     igsioTrackedFrame m_TrackedFrame;
-    std::string m_TrackedFrameXmlData;
+    /*! Serialized frame field section (XML text or binary) */
+    std::string m_TrackedFrameFieldData;
+    FieldEncodingType m_FieldEncoding;
+    bool m_GatherImageData;
+
+    /*! Image of the tracked frame to be sent, referenced by SetTrackedFrame and copied into the message buffer by PackContent */
+    vtkSmartPointer<vtkImageData> m_SourceImage;
+    /*! Modification time of m_SourceImage when it was set, to detect changes before the pixels are sent */
+    vtkMTimeType m_SourceImageModifiedTime;
+    double m_SourceTimestamp;
 
     TrackedFrameHeader m_MessageHeader;
   };
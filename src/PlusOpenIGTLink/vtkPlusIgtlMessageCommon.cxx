@@ -273,12 +273,23 @@ PlusStatus vtkPlusIgtlMessageCommon::PackImageMessage(igtl::ImageMessage::Pointe
   imageMessage->SetScalarType(scalarType);
   imageMessage->SetEndian(igtl_is_little_endian() ? igtl::ImageMessage::ENDIAN_LITTLE : igtl::ImageMessage::ENDIAN_BIG);
   imageMessage->SetSubVolume(subSizePixels, subOffset);
-  imageMessage->AllocateScalars();
 
-  unsigned char* igtlImagePointer = (unsigned char*)(imageMessage->GetScalarPointer());
-  unsigned char* vtkImagePointer = (unsigned char*)(frameImage->GetScalarPointer());
+  igtl::PlusImageMessage* gatherImageMessage = dynamic_cast<igtl::PlusImageMessage*>(imageMessage.GetPointer());
+  if (gatherImageMessage != NULL)
+  {
+    // Scalars are sent directly from the frame image, without copying them into the message
+    gatherImageMessage->SetSourceImage(frameImage);
+    imageMessage->AllocateScalars();
+  }
+  else
+  {
+    imageMessage->AllocateScalars();
 
-  memcpy(igtlImagePointer, vtkImagePointer, imageMessage->GetImageSize());
+    unsigned char* igtlImagePointer = (unsigned char*)(imageMessage->GetScalarPointer());
+    unsigned char* vtkImagePointer = (unsigned char*)(frameImage->GetScalarPointer());
+
+    memcpy(igtlImagePointer, vtkImagePointer, imageMessage->GetImageSize());
+  }
 
   // Convert VTK transform to IGTL transform.
   if (igtlioImageConverter::VTKTransformToIGTLImage(matrix, imageSizePixels, imageSpacingMm, imageOriginMm, imageMessage) != 1)
@@ -353,6 +364,83 @@ PlusStatus vtkPlusIgtlMessageCommon::PackImageMessage(igtl::ImageMessage::Pointe
 
 }
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusIgtlMessageCommon::PackImageMessage(igtl::ImageMessage::Pointer imageMessage,
+    vtkImageData* subVolume,
+    const int volumeExtent[6],
+    const vtkMatrix4x4& volumeToReferenceTransform,
+    double timestamp)
+{
+  if (imageMessage.IsNull())
+  {
+    LOG_ERROR("Failed to pack image message - input image message is NULL");
+    return PLUS_FAIL;
+  }
+  if (subVolume == NULL)
+  {
+    LOG_ERROR("Failed to pack image message - input image is NULL");
+    return PLUS_FAIL;
+  }
+
+  int subExtent[6] = { 0, -1, 0, -1, 0, -1 };
+  subVolume->GetExtent(subExtent);
+  int volumeSizePixels[3] = { 0 };
+  int subSizePixels[3] = { 0 };
+  int subOffset[3] = { 0 };
+  for (int i = 0; i < 3; ++i)
+  {
+    if (subExtent[i * 2] < volumeExtent[i * 2] || subExtent[i * 2 + 1] > volumeExtent[i * 2 + 1])
+    {
+      LOG_ERROR("Failed to pack image message - sub-volume extent is outside the volume extent");
+      return PLUS_FAIL;
+    }
+    volumeSizePixels[i] = volumeExtent[i * 2 + 1] - volumeExtent[i * 2] + 1;
+    subSizePixels[i] = subExtent[i * 2 + 1] - subExtent[i * 2] + 1;
+    subOffset[i] = subExtent[i * 2] - volumeExtent[i * 2];
+  }
+  imageMessage->SetDimensions(volumeSizePixels);
+  imageMessage->SetSubVolume(subSizePixels, subOffset);
+
+  double volumeSpacingMm[3] = { 0 };
+  subVolume->GetSpacing(volumeSpacingMm);
+  float spacingFloat[3] = { 0 };
+  for (int i = 0; i < 3; ++i)
+  {
+    spacingFloat[i] = (float)volumeSpacingMm[i];
+  }
+  imageMessage->SetSpacing(spacingFloat);
+
+  // Position of the first voxel of the volume (the image origin is the position of the voxel at index 0)
+  double volumeOriginMm[3] = { 0 };
+  subVolume->GetOrigin(volumeOriginMm);
+  for (int i = 0; i < 3; ++i)
+  {
+    volumeOriginMm[i] += volumeExtent[i * 2] * volumeSpacingMm[i];
+  }
+
+  imageMessage->SetNumComponents(subVolume->GetNumberOfScalarComponents());
+  imageMessage->SetScalarType(PlusCommon::GetIGTLScalarPixelTypeFromVTK(subVolume->GetScalarType()));
+  imageMessage->SetEndian(igtl_is_little_endian() ? igtl::ImageMessage::ENDIAN_LITTLE : igtl::ImageMessage::ENDIAN_BIG);
+  imageMessage->AllocateScalars();
+
+  // The scalars of the sub-volume are contiguous, in the same order as in the message
+  memcpy(imageMessage->GetScalarPointer(), subVolume->GetScalarPointer(), imageMessage->GetSubVolumeImageSize());
+
+  if (igtlioImageConverter::VTKTransformToIGTLImage(volumeToReferenceTransform, volumeSizePixels, volumeSpacingMm, volumeOriginMm, imageMessage) != 1)
+  {
+    LOG_ERROR("Failed to pack image message - unable to compute IJKToRAS transform");
+    return PLUS_FAIL;
+  }
+
+  igtl::TimeStamp::Pointer igtlTime = igtl::TimeStamp::New();
+  igtlTime->SetTime(timestamp);
+  imageMessage->SetTimeStamp(igtlTime);
+
+  imageMessage->Pack();
+
+  return PLUS_SUCCESS;
+}
+
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusIgtlMessageCommon::UnpackImageMessage(igtl::MessageHeader::Pointer headerMsg,
     igtl::Socket* socket,
@@ -523,10 +611,31 @@ PlusStatus vtkPlusIgtlMessageCommon::PackVideoMessage(igtl::VideoMessage::Pointe
     return PLUS_FAIL;
   }
 
+  return vtkPlusIgtlMessageCommon::PackVideoMessage(videoMessage, trackedFrame, matrix, frame);
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusIgtlMessageCommon::PackVideoMessage(igtl::VideoMessage::Pointer videoMessage,
+    igsioTrackedFrame& trackedFrame,
+    vtkMatrix4x4& matrix,
+    vtkStreamingVolumeFrame* frame)
+{
+  if (videoMessage.IsNull())
+  {
+    LOG_ERROR("Failed to pack video message - input video message is NULL");
+    return PLUS_FAIL;
+  }
+
+  if (frame == NULL)
+  {
+    LOG_ERROR("Failed to pack video message - encoded frame is NULL");
+    return PLUS_FAIL;
+  }
+
   vtkSmartPointer<vtkUnsignedCharArray> frameData = frame->GetFrameData();
   int frameType = frame->GetFrameType();
   unsigned int frameSize = frameData->GetSize() * frameData->GetElementComponentSize();
-  codecFourCC = frame->GetCodecFourCC();
+  std::string codecFourCC = frame->GetCodecFourCC();
   int endian = (igtl_is_little_endian() == 1 ? IGTL_VIDEO_ENDIAN_LITTLE : IGTL_VIDEO_ENDIAN_BIG);
   int dimensions[3] = { 0, 0, 0 };
   frame->GetDimensions(dimensions);
@@ -18,6 +18,7 @@ See License.txt for details.
 #include <igtlImageMessage.h>
 #include <igtlImageMetaMessage.h>
 #include <igtlMessageBase.h>
+#include <igtlPlusImageMessage.h>
 #include <igtlPlusTrackedFrameMessage.h>
 #include <igtlPlusUsMessage.h>
 #include <igtlPolyDataMessage.h>
@@ -36,6 +37,7 @@ class vtkXMLDataElement;
 class vtkPolyData;
 //class vtkIGSIOTransformRepository;
 class vtkIGSIOFrameConverter;
+class vtkStreamingVolumeFrame;
 
 /*!
 \class vtkPlusIgtlMessageCommon
@@ -64,12 +66,22 @@ public:
   /*! Unpack US message to tracked frame */
   static PlusStatus UnpackUsMessage(igtl::MessageHeader::Pointer headerMsg, igtl::Socket* socket, igsioTrackedFrame& trackedFrame, int crccheck);
 
-  /*! Pack image message from tracked frame */
+  /*!
+    Pack image message from tracked frame.
+    If the message is an igtl::PlusImageMessage then the image scalars are referenced in place instead of copied,
+    and the message must be sent with PlusIgtlGatherMessage::Send.
+  */
   static PlusStatus PackImageMessage(igtl::ImageMessage::Pointer imageMessage, igsioTrackedFrame& trackedFrame, const vtkMatrix4x4& imageToReferenceTransform, vtkIGSIOFrameConverter* frameConverter = NULL);
 
   /*! Pack image message from vtkImageData volume */
   static PlusStatus PackImageMessage(igtl::ImageMessage::Pointer imageMessage, vtkImageData* image, const vtkMatrix4x4& imageToReferenceTransform, double timestamp);
 
+  /*!
+    Pack image message from a part of a volume. The message contains the geometry of the whole volume and the voxels of the part.
+    The part must have the origin and spacing of the volume and its extent must be inside the volume extent.
+  */
+  static PlusStatus PackImageMessage(igtl::ImageMessage::Pointer imageMessage, vtkImageData* subVolume, const int volumeExtent[6], const vtkMatrix4x4& volumeToReferenceTransform, double timestamp);
+
   /*! Unpack image message to tracked frame */
   static PlusStatus UnpackImageMessage(igtl::MessageHeader::Pointer headerMsg, igtl::Socket* socket, igsioTrackedFrame& trackedFrame, const igsioTransformName& embeddedTransformName, int crccheck);
 
@@ -79,6 +91,9 @@ public:
 #if defined(OpenIGTLink_ENABLE_VIDEOSTREAMING)
   /*! Pack video message from tracked frame */
   static PlusStatus PackVideoMessage(igtl::VideoMessage::Pointer imageMessage, igsioTrackedFrame& trackedFrame, vtkMatrix4x4& imageToReferenceTransform, vtkIGSIOFrameConverter* frameConverter = NULL, std::string codecFourCC = "", std::map<std::string, std::string> parameters = std::map<std::string, std::string>());
+
+  /*! Pack video message from a frame that is already encoded */
+  static PlusStatus PackVideoMessage(igtl::VideoMessage::Pointer videoMessage, igsioTrackedFrame& trackedFrame, vtkMatrix4x4& imageToReferenceTransform, vtkStreamingVolumeFrame* encodedFrame);
 #endif
 
   /*! Pack transform message from tracked frame */
@@ -24,6 +24,7 @@ See License.txt for details.
 #include "igtlCommandMessage.h"
 #include "igtlImageMessage.h"
 #include "igtlPlusClientInfoMessage.h"
+#include "igtlPlusImageMessage.h"
 #include "igtlPlusTrackedFrameMessage.h"
 #include "igtlPlusUsMessage.h"
 #include "igtlPositionMessage.h"
@@ -50,6 +51,7 @@ vtkStandardNewMacro(vtkPlusIgtlMessageFactory);
 //----------------------------------------------------------------------------
 vtkPlusIgtlMessageFactory::vtkPlusIgtlMessageFactory()
   : IgtlFactory(igtl::MessageFactory::New())
+  , ScatterGatherEnabled(false)
 {
   this->IgtlFactory->AddMessageType("CLIENTINFO", (PointerToMessageBaseNew)&igtl::PlusClientInfoMessage::New);
   this->IgtlFactory->AddMessageType("TRACKEDFRAME", (PointerToMessageBaseNew)&igtl::PlusTrackedFrameMessage::New);
@@ -66,6 +68,7 @@ vtkPlusIgtlMessageFactory::~vtkPlusIgtlMessageFactory()
 void vtkPlusIgtlMessageFactory::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "ScatterGatherEnabled: " << (this->ScatterGatherEnabled ? "TRUE" : "FALSE") << std::endl;
   this->PrintAvailableMessageTypes(os, indent);
 }
 
@@ -267,6 +270,8 @@ int vtkPlusIgtlMessageFactory::PackTrackedFrameMessage(igtl::MessageBase::Pointe
 {
   int numberOfErrors(0);
   igtl::PlusTrackedFrameMessage::Pointer trackedFrameMessage = dynamic_cast<igtl::PlusTrackedFrameMessage*>(igtlMessage->Clone().GetPointer());
+  trackedFrameMessage->SetGatherImageData(this->ScatterGatherEnabled);
+  trackedFrameMessage->SetFieldEncoding(clientInfo.GetTrackedFrameBinaryFields() ? igtl::PlusTrackedFrameMessage::FIELD_ENCODING_BINARY : igtl::PlusTrackedFrameMessage::FIELD_ENCODING_XML);
 
   for (auto nameIter = clientInfo.TransformNames.begin(); nameIter != clientInfo.TransformNames.end(); ++nameIter)
   {
@@ -425,7 +430,18 @@ int vtkPlusIgtlMessageFactory::PackImageMessage(const PlusIgtlClientInfo& client
 
     std::string deviceName = imageTransformName.From() + std::string("_") + imageTransformName.To();
 
-    igtl::ImageMessage::Pointer imageMessage = dynamic_cast<igtl::ImageMessage*>(igtlMessage->Clone().GetPointer());
+    igtl::ImageMessage::Pointer imageMessage;
+    if (this->ScatterGatherEnabled)
+    {
+      // Image scalars will be sent directly from the tracked frame
+      igtl::PlusImageMessage::Pointer gatherImageMessage = igtl::PlusImageMessage::New();
+      gatherImageMessage->SetHeaderVersion(igtlMessage->GetHeaderVersion());
+      imageMessage = gatherImageMessage.GetPointer();
+    }
+    else
+    {
+      imageMessage = dynamic_cast<igtl::ImageMessage*>(igtlMessage->Clone().GetPointer());
+    }
     if (trackedFrame.IsFrameFieldDefined(igsioTrackedFrame::FIELD_FRIENDLY_DEVICE_NAME))
     {
       // Allow overriding of device name with something human readable
@@ -505,18 +521,35 @@ int vtkPlusIgtlMessageFactory::PackVideoMessage(const PlusIgtlClientInfo& client
     }
     videoMessage = igtl::VideoMessage::New();
     videoMessage->SetDeviceName(deviceName.c_str());
-    std::map<std::string, std::string> parameters;
-    parameters["losslessEncoding"] = videoStream.EncodeVideoParameters.Lossless ? "1" : "0";
-    if (!videoStream.EncodeVideoParameters.Lossless)
+
+    if (videoStream.SharedEncoder)
     {
-      parameters["rateControl"] = videoStream.EncodeVideoParameters.RateControl;
-      parameters["minimumKeyFrameDistance"] = igsioCommon::ToString(videoStream.EncodeVideoParameters.MinKeyframeDistance);
-      parameters["maximumKeyFrameDistance"] = igsioCommon::ToString(videoStream.EncodeVideoParameters.MaxKeyframeDistance);
-      parameters["encodingSpeed"] = igsioCommon::ToString(videoStream.EncodeVideoParameters.Speed);
-      parameters["bitRate"] = igsioCommon::ToString(videoStream.EncodeVideoParameters.TargetBitrate);
-      parameters["deadlineMode"] = videoStream.EncodeVideoParameters.DeadlineMode;
+      // The frame is encoded only once for all clients, this client may need the frames since the last key frame
+      vtkSmartPointer<vtkStreamingVolumeFrame> encodedFrame = videoStream.SharedEncoder->GetEncodedFrame(trackedFrame);
+      if (!encodedFrame)
+      {
+        LOG_ERROR("Failed to create " << messageType << " message - unable to encode frame");
+        numberOfErrors++;
+        continue;
+      }
+      std::vector<vtkSmartPointer<vtkStreamingVolumeFrame> > framesToSend;
+      videoStream.SharedEncoder->GetFramesToSend(clientId, encodedFrame, framesToSend);
+      for (std::vector<vtkSmartPointer<vtkStreamingVolumeFrame> >::iterator frameIt = framesToSend.begin(); frameIt != framesToSend.end(); ++frameIt)
+      {
+        igtl::VideoMessage::Pointer sharedVideoMessage = igtl::VideoMessage::New();
+        sharedVideoMessage->SetDeviceName(deviceName.c_str());
+        if (vtkPlusIgtlMessageCommon::PackVideoMessage(sharedVideoMessage, trackedFrame, *matrix, *frameIt) != PLUS_SUCCESS)
+        {
+          LOG_ERROR("Failed to create " << messageType << " message - unable to pack video message");
+          numberOfErrors++;
+          break;
+        }
+        igtlMessages.push_back(sharedVideoMessage.GetPointer());
+      }
+      continue;
     }
 
+    std::map<std::string, std::string> parameters = videoStream.EncodeVideoParameters.GetCodecParameters();
     if (vtkPlusIgtlMessageCommon::PackVideoMessage(videoMessage, trackedFrame, *matrix, videoStream.FrameConverter, videoStream.EncodeVideoParameters.FourCC, parameters) != PLUS_SUCCESS)
     {
       LOG_ERROR("Failed to create " << messageType << " message - unable to pack image message");
@@ -80,11 +80,20 @@ public:
   PlusStatus PackMessages(int clientId, const PlusIgtlClientInfo& clientInfo, std::vector<igtl::MessageBase::Pointer>& igtMessages, igsioTrackedFrame& trackedFrame,
                           bool packValidTransformsOnly, vtkIGSIOTransformRepository* transformRepository = NULL);
 
+  /*!
+    If enabled, image data of IMAGE and TRACKEDFRAME messages is not copied into the message buffer but referenced in place.
+    Such messages must be sent with PlusIgtlGatherMessage::Send. Disabled by default.
+  */
+  vtkSetMacro(ScatterGatherEnabled, bool);
+  vtkGetMacro(ScatterGatherEnabled, bool);
+  vtkBooleanMacro(ScatterGatherEnabled, bool);
+
 protected:
   vtkPlusIgtlMessageFactory();
   virtual ~vtkPlusIgtlMessageFactory();
 
   igtl::MessageFactory::Pointer IgtlFactory;
+  bool ScatterGatherEnabled;
 
 protected:
   int PackImageMessage(const PlusIgtlClientInfo& clientInfo, vtkIGSIOTransformRepository& transformRepository, const std::string& messageType,
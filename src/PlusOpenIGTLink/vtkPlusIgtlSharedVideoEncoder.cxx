@@ -0,0 +1,252 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+// Local includes
+#include "PlusConfigure.h"
+#include "igsioTrackedFrame.h"
+#include "igsioVideoFrame.h"
+#include "vtkPlusIgtlSharedVideoEncoder.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+
+// STL includes
+#include <algorithm>
+
+//----------------------------------------------------------------------------
+
+vtkStandardNewMacro(vtkPlusIgtlSharedVideoEncoder);
+
+//----------------------------------------------------------------------------
+vtkPlusIgtlSharedVideoEncoder::vtkPlusIgtlSharedVideoEncoder()
+  : MaximumNumberOfCachedFrames(120)
+  , FrameConverter(vtkSmartPointer<vtkIGSIOFrameConverter>::New())
+  , KeyFrameRequested(false)
+  , NumberOfEncodedFrames(0)
+{
+}
+
+//----------------------------------------------------------------------------
+vtkPlusIgtlSharedVideoEncoder::~vtkPlusIgtlSharedVideoEncoder()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusIgtlSharedVideoEncoder::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "CodecFourCC: " << this->CodecFourCC << std::endl;
+  for (std::map<std::string, std::string>::const_iterator parameterIt = this->CodecParameters.begin(); parameterIt != this->CodecParameters.end(); ++parameterIt)
+  {
+    os << indent << "  " << parameterIt->first << ": " << parameterIt->second << std::endl;
+  }
+  os << indent << "MaximumNumberOfCachedFrames: " << this->MaximumNumberOfCachedFrames << std::endl;
+  std::lock_guard<std::mutex> stateLock(this->StateMutex);
+  os << indent << "NumberOfEncodedFrames: " << this->NumberOfEncodedFrames << std::endl;
+  os << indent << "NumberOfReceivingClients: " << this->ReceivingClientIds.size() << std::endl;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusIgtlSharedVideoEncoder::SetEncoding(const std::string& codecFourCC, const std::map<std::string, std::string>& codecParameters)
+{
+  this->CodecFourCC = codecFourCC;
+  this->CodecParameters = codecParameters;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusIgtlSharedVideoEncoder::IsEncoding(const std::string& codecFourCC, const std::map<std::string, std::string>& codecParameters) const
+{
+  return this->CodecFourCC == codecFourCC && this->CodecParameters == codecParameters;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkPlusIgtlSharedVideoEncoder::GetCodecFourCC() const
+{
+  return this->CodecFourCC;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusIgtlSharedVideoEncoder::QueueFrame(igsioTrackedFrame* trackedFrame)
+{
+  igsioVideoFrame* videoFrame = trackedFrame->GetImageData();
+  std::lock_guard<std::mutex> stateLock(this->StateMutex);
+  if (this->PendingFrames.find(videoFrame) != this->PendingFrames.end() || this->EncodedFrames.find(videoFrame) != this->EncodedFrames.end())
+  {
+    // already queued or encoded
+    return;
+  }
+  this->QueuedFrames.push_back(trackedFrame);
+  this->PendingFrames.insert(videoFrame);
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusIgtlSharedVideoEncoder::EncodeNextQueuedFrame()
+{
+  std::lock_guard<std::mutex> encoderLock(this->EncoderMutex);
+  igsioTrackedFrame* trackedFrame = NULL;
+  {
+    std::lock_guard<std::mutex> stateLock(this->StateMutex);
+    if (this->QueuedFrames.empty())
+    {
+      return false;
+    }
+    trackedFrame = this->QueuedFrames.front();
+    this->QueuedFrames.pop_front();
+  }
+  this->EncodeFrame(*trackedFrame);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkStreamingVolumeFrame> vtkPlusIgtlSharedVideoEncoder::GetEncodedFrame(igsioTrackedFrame& trackedFrame)
+{
+  igsioVideoFrame* videoFrame = trackedFrame.GetImageData();
+  {
+    std::unique_lock<std::mutex> stateLock(this->StateMutex);
+    while (this->PendingFrames.find(videoFrame) != this->PendingFrames.end())
+    {
+      // the frame is encoded by the worker thread
+      this->EncodedCondition.wait(stateLock);
+    }
+    std::map<igsioVideoFrame*, vtkSmartPointer<vtkStreamingVolumeFrame> >::iterator encodedFrameIt = this->EncodedFrames.find(videoFrame);
+    if (encodedFrameIt != this->EncodedFrames.end())
+    {
+      return encodedFrameIt->second;
+    }
+  }
+
+  // The frame was not queued, encode it now
+  std::lock_guard<std::mutex> encoderLock(this->EncoderMutex);
+  {
+    // another thread may have encoded it while we were waiting for the encoder
+    std::lock_guard<std::mutex> stateLock(this->StateMutex);
+    std::map<igsioVideoFrame*, vtkSmartPointer<vtkStreamingVolumeFrame> >::iterator encodedFrameIt = this->EncodedFrames.find(videoFrame);
+    if (encodedFrameIt != this->EncodedFrames.end())
+    {
+      return encodedFrameIt->second;
+    }
+  }
+  return this->EncodeFrame(trackedFrame);
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkStreamingVolumeFrame> vtkPlusIgtlSharedVideoEncoder::EncodeFrame(igsioTrackedFrame& trackedFrame)
+{
+  igsioVideoFrame* videoFrame = trackedFrame.GetImageData();
+  vtkSmartPointer<vtkStreamingVolumeFrame> encodedFrame;
+#if defined(OpenIGTLink_ENABLE_VIDEOSTREAMING)
+  if (videoFrame->IsImageValid())
+  {
+    bool requestKeyFrame = false;
+    {
+      std::lock_guard<std::mutex> stateLock(this->StateMutex);
+      requestKeyFrame = this->KeyFrameRequested;
+      this->KeyFrameRequested = false;
+    }
+    if (requestKeyFrame)
+    {
+      this->FrameConverter->RequestKeyFrameOn();
+    }
+    encodedFrame = this->FrameConverter->GetEncodedFrame(videoFrame, this->CodecFourCC, this->CodecParameters);
+    if (!encodedFrame)
+    {
+      LOG_ERROR("Failed to encode frame with codec " << this->CodecFourCC);
+    }
+  }
+  else
+  {
+    LOG_WARNING("Unable to encode frame - image data is NOT valid!");
+  }
+#else
+  LOG_ERROR("Failed to encode frame with codec " << this->CodecFourCC << " - video streaming is not enabled in OpenIGTLink");
+#endif
+
+  std::lock_guard<std::mutex> stateLock(this->StateMutex);
+  this->EncodedFrames[videoFrame] = encodedFrame;
+  this->PendingFrames.erase(videoFrame);
+  if (encodedFrame)
+  {
+    this->NumberOfEncodedFrames++;
+    this->CachedFrames.push_back(encodedFrame);
+    while (static_cast<int>(this->CachedFrames.size()) > std::max(this->MaximumNumberOfCachedFrames, 1))
+    {
+      this->CachedFrames.pop_front();
+    }
+  }
+  this->EncodedCondition.notify_all();
+  return encodedFrame;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusIgtlSharedVideoEncoder::GetFramesToSend(int clientId, vtkStreamingVolumeFrame* encodedFrame, std::vector<vtkSmartPointer<vtkStreamingVolumeFrame> >& framesToSend)
+{
+  framesToSend.clear();
+  if (encodedFrame == NULL)
+  {
+    return;
+  }
+
+  std::lock_guard<std::mutex> stateLock(this->StateMutex);
+  if (this->ReceivingClientIds.find(clientId) != this->ReceivingClientIds.end()
+      || encodedFrame->GetFrameType() == vtkStreamingVolumeFrame::IFrame)
+  {
+    this->ReceivingClientIds.insert(clientId);
+    framesToSend.push_back(encodedFrame);
+    return;
+  }
+
+  // The client starts receiving in the middle of a group of pictures: send the frames since the last key frame
+  int lastFrameIndex = static_cast<int>(this->CachedFrames.size()) - 1;
+  while (lastFrameIndex >= 0 && this->CachedFrames[lastFrameIndex].GetPointer() != encodedFrame)
+  {
+    --lastFrameIndex;
+  }
+  for (int keyFrameIndex = lastFrameIndex; keyFrameIndex >= 0; --keyFrameIndex)
+  {
+    if (this->CachedFrames[keyFrameIndex]->GetFrameType() == vtkStreamingVolumeFrame::IFrame)
+    {
+      framesToSend.assign(this->CachedFrames.begin() + keyFrameIndex, this->CachedFrames.begin() + lastFrameIndex + 1);
+      break;
+    }
+  }
+  if (framesToSend.empty())
+  {
+    // Client has to wait for the next key frame
+    LOG_DEBUG("Cached frames of " << this->CodecFourCC << " stream do not start with a key frame, key frame is requested for client " << clientId);
+    this->KeyFrameRequested = true;
+    return;
+  }
+  LOG_DEBUG("Client " << clientId << " starts receiving " << this->CodecFourCC << " stream with " << framesToSend.size() << " cached frames");
+  this->ReceivingClientIds.insert(clientId);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusIgtlSharedVideoEncoder::RemoveClient(int clientId)
+{
+  std::lock_guard<std::mutex> stateLock(this->StateMutex);
+  this->ReceivingClientIds.erase(clientId);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusIgtlSharedVideoEncoder::ReleaseTrackedFrames()
+{
+  std::lock_guard<std::mutex> stateLock(this->StateMutex);
+  if (!this->PendingFrames.empty())
+  {
+    LOG_ERROR("Tracked frames are released while " << this->PendingFrames.size() << " frames are waiting for encoding");
+    this->QueuedFrames.clear();
+    this->PendingFrames.clear();
+    this->EncodedCondition.notify_all();
+  }
+  this->EncodedFrames.clear();
+}
+
+//----------------------------------------------------------------------------
+unsigned long vtkPlusIgtlSharedVideoEncoder::GetNumberOfEncodedFrames()
+{
+  std::lock_guard<std::mutex> stateLock(this->StateMutex);
+  return this->NumberOfEncodedFrames;
+}
@@ -0,0 +1,135 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __vtkPlusIgtlSharedVideoEncoder_h
+#define __vtkPlusIgtlSharedVideoEncoder_h
+
+// Local includes
+#include "PlusConfigure.h"
+#include "vtkPlusOpenIGTLinkExport.h"
+
+// IGSIO includes
+#include <vtkIGSIOFrameConverter.h>
+#include <vtkStreamingVolumeFrame.h>
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STL includes
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+class igsioTrackedFrame;
+class igsioVideoFrame;
+
+/*!
+  \class vtkPlusIgtlSharedVideoEncoder
+  \brief Video encoder session that is shared by all clients that receive a video stream with the same encoding
+
+  Each frame is encoded only once, regardless of the number of clients that receive it. Frames can be queued for encoding
+  (QueueFrame) and encoded on a worker thread (EncodeNextQueuedFrame) ahead of sending. GetEncodedFrame waits until
+  a queued frame is encoded and encodes frames that were not queued immediately.
+
+  Clients that start receiving the stream in the middle of a group of pictures get the cached frames since the most
+  recent key frame, so that they can start decoding without forcing a key frame on the other clients. A new key frame is
+  only requested if the cached frames do not reach back to a key frame (see MaximumNumberOfCachedFrames).
+
+  \ingroup PlusLibOpenIGTLink
+*/
+class vtkPlusOpenIGTLinkExport vtkPlusIgtlSharedVideoEncoder : public vtkObject
+{
+public:
+  static vtkPlusIgtlSharedVideoEncoder* New();
+  vtkTypeMacro(vtkPlusIgtlSharedVideoEncoder, vtkObject);
+  virtual void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /*! Set the codec and its parameters. Must be set before the first frame is encoded. */
+  void SetEncoding(const std::string& codecFourCC, const std::map<std::string, std::string>& codecParameters);
+
+  /*! Returns true if the encoder uses the specified codec and parameters */
+  bool IsEncoding(const std::string& codecFourCC, const std::map<std::string, std::string>& codecParameters) const;
+
+  /*! Codec of the encoded frames */
+  std::string GetCodecFourCC() const;
+
+  /*! Maximum number of most recent encoded frames that are kept for clients that start receiving the stream */
+  vtkSetMacro(MaximumNumberOfCachedFrames, int);
+  vtkGetMacro(MaximumNumberOfCachedFrames, int);
+
+  /*! Add a frame to the encoding queue. The tracked frame must be valid until ReleaseTrackedFrames is called. Can be called from any thread. */
+  void QueueFrame(igsioTrackedFrame* trackedFrame);
+
+  /*! Encode the oldest frame of the encoding queue. Returns false if the queue was empty. Can be called from any thread. */
+  bool EncodeNextQueuedFrame();
+
+  /*!
+    Get the encoded frame of a tracked frame. If the frame is queued then waits until it is encoded,
+    if the frame has not been encoded yet then it is encoded now. Returns NULL if encoding failed. Can be called from any thread.
+  */
+  vtkSmartPointer<vtkStreamingVolumeFrame> GetEncodedFrame(igsioTrackedFrame& trackedFrame);
+
+  /*!
+    Get the frames that have to be sent to a client so that it can decode the encoded frame.
+    If the client already receives the stream then it is just the encoded frame. If the client has just started receiving the
+    stream then it is the cached frames from the most recent key frame up to the encoded frame. If the client cannot start
+    decoding at this frame then the list is empty and a key frame is requested.
+  */
+  void GetFramesToSend(int clientId, vtkStreamingVolumeFrame* encodedFrame, std::vector<vtkSmartPointer<vtkStreamingVolumeFrame> >& framesToSend);
+
+  /*! Forget that a client has received the stream (e.g., because it has disconnected) */
+  void RemoveClient(int clientId);
+
+  /*! Forget the encoded frames of the tracked frames. Must be called when the encoding queue is empty, before the tracked frames are deleted. */
+  void ReleaseTrackedFrames();
+
+  /*! Total number of frames encoded by this encoder */
+  unsigned long GetNumberOfEncodedFrames();
+
+protected:
+  vtkPlusIgtlSharedVideoEncoder();
+  virtual ~vtkPlusIgtlSharedVideoEncoder();
+
+  /*! Encode a frame and store the result. EncoderMutex must be locked. */
+  vtkSmartPointer<vtkStreamingVolumeFrame> EncodeFrame(igsioTrackedFrame& trackedFrame);
+
+  std::string CodecFourCC;
+  std::map<std::string, std::string> CodecParameters;
+  int MaximumNumberOfCachedFrames;
+
+  /*! Encoder instance. Protected by EncoderMutex, as frames must be encoded one at a time and in order. */
+  vtkSmartPointer<vtkIGSIOFrameConverter> FrameConverter;
+  std::mutex EncoderMutex;
+
+  /*! Protects all the members below. EncodedCondition is notified when a frame is encoded. */
+  std::mutex StateMutex;
+  std::condition_variable EncodedCondition;
+
+  /*! Frames waiting for encoding, in the order they were queued */
+  std::deque<igsioTrackedFrame*> QueuedFrames;
+  /*! Frames that are queued or being encoded */
+  std::set<igsioVideoFrame*> PendingFrames;
+  /*! Encoded frames of the tracked frames, until ReleaseTrackedFrames is called. NULL if encoding failed. */
+  std::map<igsioVideoFrame*, vtkSmartPointer<vtkStreamingVolumeFrame> > EncodedFrames;
+  /*! Most recent encoded frames, oldest first */
+  std::deque<vtkSmartPointer<vtkStreamingVolumeFrame> > CachedFrames;
+  /*! Clients that have received the stream from a key frame */
+  std::set<int> ReceivingClientIds;
+  /*! If true then the next frame is encoded as key frame */
+  bool KeyFrameRequested;
+  unsigned long NumberOfEncodedFrames;
+
+private:
+  vtkPlusIgtlSharedVideoEncoder(const vtkPlusIgtlSharedVideoEncoder&);
+  void operator=(const vtkPlusIgtlSharedVideoEncoder&);
+};
+
+#endif
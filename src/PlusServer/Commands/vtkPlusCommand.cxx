@@ -14,6 +14,8 @@
 
 const std::string vtkPlusCommand::DEVICE_NAME_COMMAND = "CMD";
 const std::string vtkPlusCommand::DEVICE_NAME_REPLY = "ACK";
+const std::string vtkPlusCommand::GLOBAL_EXECUTION_KEY = "Global";
+const std::string vtkPlusCommand::TRANSFORM_REPOSITORY_EXECUTION_KEY = "TransformRepository";
 
 //----------------------------------------------------------------------------
 vtkPlusCommand::vtkPlusCommand()
@@ -35,6 +37,24 @@ void vtkPlusCommand::PrintSelf(ostream& os, vtkIndent indent)
   this->Superclass::PrintSelf(os, indent);
 }
 
+//----------------------------------------------------------------------------
+std::string vtkPlusCommand::GetExecutionKey()
+{
+  return GLOBAL_EXECUTION_KEY;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusCommand::IsFastCommand()
+{
+  return false;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkPlusCommand::GetDeviceExecutionKey(const std::string& deviceId)
+{
+  return std::string("Device:") + deviceId;
+}
+
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusCommand::ReadConfiguration(vtkXMLDataElement* aConfig)
 {
@@ -33,6 +33,10 @@ class vtkPlusServerExport vtkPlusCommand : public vtkObject
 public:
   static const std::string DEVICE_NAME_COMMAND;
   static const std::string DEVICE_NAME_REPLY;
+  /*! Execution key of commands that are executed one at a time, in the order they were received */
+  static const std::string GLOBAL_EXECUTION_KEY;
+  /*! Execution key of commands that access the transform repository */
+  static const std::string TRANSFORM_REPOSITORY_EXECUTION_KEY;
 
   virtual vtkPlusCommand* Clone() = 0;
 
@@ -44,6 +48,20 @@ public:
   */
   virtual PlusStatus Execute() = 0;
 
+  /*!
+    Commands that have the same execution key are executed one at a time, in the order they were received.
+    Commands with different keys may be executed concurrently. Commands that have an empty key can be executed
+    at any time. By default GLOBAL_EXECUTION_KEY is returned, so commands that do not override this method
+    are not executed concurrently with each other. Called after ReadConfiguration.
+  */
+  virtual std::string GetExecutionKey();
+
+  /*!
+    Returns true if the command completes quickly (it does not wait for devices or perform lengthy processing).
+    Fast commands can be executed by the fast lane of the command processor, so they are not delayed by slow commands.
+  */
+  virtual bool IsFastCommand();
+
   /*! Read command parameters from XML */
   virtual PlusStatus ReadConfiguration(vtkXMLDataElement* aConfig);
 
@@ -129,6 +147,9 @@ public:
   static std::string GetPrefixFromCommandDeviceName(const std::string& deviceName);
 
 protected:
+  /*! Execution key for commands that access a device, so that commands for the same device are executed in order */
+  static std::string GetDeviceExecutionKey(const std::string& deviceId);
+
   /*! Convenience function for getting a pointer to the data collector */
   virtual vtkPlusDataCollector* GetDataCollector();
 
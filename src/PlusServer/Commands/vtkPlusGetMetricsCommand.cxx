@@ -0,0 +1,132 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "PlusMetricsRegistry.h"
+#include "vtkPlusGetMetricsCommand.h"
+
+vtkStandardNewMacro(vtkPlusGetMetricsCommand);
+
+namespace
+{
+  static const std::string GET_METRICS_CMD = "GetMetrics";
+  static const std::string FORMAT_TEXT = "Text";
+  static const std::string FORMAT_JSON = "Json";
+  static const std::string FORMAT_PROMETHEUS = "Prometheus";
+}
+
+//----------------------------------------------------------------------------
+vtkPlusGetMetricsCommand::vtkPlusGetMetricsCommand()
+  : Format(FORMAT_TEXT)
+{
+  // It handles only one command, set its name by default
+  this->SetName(GET_METRICS_CMD);
+}
+
+//----------------------------------------------------------------------------
+vtkPlusGetMetricsCommand::~vtkPlusGetMetricsCommand()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusGetMetricsCommand::SetNameToGetMetrics()
+{
+  this->SetName(GET_METRICS_CMD);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusGetMetricsCommand::GetCommandNames(std::list<std::string>& cmdNames)
+{
+  cmdNames.clear();
+  cmdNames.push_back(GET_METRICS_CMD);
+}
+
+//----------------------------------------------------------------------------
+std::string vtkPlusGetMetricsCommand::GetDescription(const std::string& commandName)
+{
+  std::string desc;
+  if (commandName.empty() || igsioCommon::IsEqualInsensitive(commandName, GET_METRICS_CMD))
+  {
+    desc += GET_METRICS_CMD;
+    desc += ": Get runtime performance metrics (buffers, devices, channels, OpenIGTLink clients). Attributes: Format: Text (default), Json, or Prometheus.";
+  }
+  return desc;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusGetMetricsCommand::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "Format: " << this->Format << std::endl;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusGetMetricsCommand::ReadConfiguration(vtkXMLDataElement* aConfig)
+{
+  if (vtkPlusCommand::ReadConfiguration(aConfig) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+  XML_READ_STRING_ATTRIBUTE_OPTIONAL(Format, aConfig);
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusGetMetricsCommand::WriteConfiguration(vtkXMLDataElement* aConfig)
+{
+  if (vtkPlusCommand::WriteConfiguration(aConfig) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+  XML_WRITE_STRING_ATTRIBUTE(Format, aConfig);
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusGetMetricsCommand::Execute()
+{
+  LOG_DEBUG("vtkPlusGetMetricsCommand::Execute: " << this->Format);
+
+  PlusMetricsRegistry* metrics = PlusMetricsRegistry::GetInstance();
+  std::string metricsString;
+  if (this->Format.empty() || igsioCommon::IsEqualInsensitive(this->Format, FORMAT_TEXT))
+  {
+    metricsString = metrics->GetMetricsAsText();
+  }
+  else if (igsioCommon::IsEqualInsensitive(this->Format, FORMAT_JSON))
+  {
+    metricsString = metrics->GetMetricsAsJson();
+  }
+  else if (igsioCommon::IsEqualInsensitive(this->Format, FORMAT_PROMETHEUS))
+  {
+    metricsString = metrics->GetMetricsAsPrometheus();
+  }
+  else
+  {
+    this->QueueCommandResponse(PLUS_FAIL, "Command failed. See error message.", "GetMetrics failed: unknown format '" + this->Format
+                               + "'. Valid formats: " + FORMAT_TEXT + ", " + FORMAT_JSON + ", " + FORMAT_PROMETHEUS + ".");
+    return PLUS_FAIL;
+  }
+
+  if (!this->RespondWithCommandMessage)
+  {
+    this->QueueCommandResponse(PLUS_SUCCESS, metricsString);
+  }
+  else
+  {
+    igtl::MessageBase::MetaDataMap parameters;
+    parameters["Format"] = std::pair<IANA_ENCODING_TYPE, std::string>(IANA_TYPE_US_ASCII, this->Format);
+    parameters["Metrics"] = std::pair<IANA_ENCODING_TYPE, std::string>(IANA_TYPE_US_ASCII, metricsString);
+    this->QueueCommandResponse(PLUS_SUCCESS, "GetMetrics command successful.", "", &parameters);
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkPlusGetMetricsCommand::GetExecutionKey()
+{
+  return "";
+}
@@ -0,0 +1,68 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __vtkPlusGetMetricsCommand_h
+#define __vtkPlusGetMetricsCommand_h
+
+#include "vtkPlusServerExport.h"
+
+#include "vtkPlusCommand.h"
+
+/*!
+  \class vtkPlusGetMetricsCommand
+  \brief This command returns the current runtime performance metrics (see PlusMetricsRegistry)
+
+  The optional Format attribute selects the output format: Text (default), Json, or Prometheus.
+
+  \ingroup PlusLibPlusServer
+ */
+class vtkPlusServerExport vtkPlusGetMetricsCommand : public vtkPlusCommand
+{
+public:
+
+  static vtkPlusGetMetricsCommand* New();
+  vtkTypeMacro(vtkPlusGetMetricsCommand, vtkPlusCommand);
+  virtual void PrintSelf(ostream& os, vtkIndent indent);
+  virtual vtkPlusCommand* Clone() { return New(); }
+
+  /*! Executes the command  */
+  virtual PlusStatus Execute();
+
+  /*! Read command parameters from XML */
+  virtual PlusStatus ReadConfiguration(vtkXMLDataElement* aConfig);
+
+  /*! Write command parameters to XML */
+  virtual PlusStatus WriteConfiguration(vtkXMLDataElement* aConfig);
+
+  /*! Get all the command names that this class can execute */
+  virtual void GetCommandNames(std::list<std::string>& cmdNames);
+
+  /*! Gets the description for the specified command name. */
+  virtual std::string GetDescription(const std::string& commandName);
+
+  /*! Independent of other commands, so it can be executed at any time */
+  virtual std::string GetExecutionKey();
+
+  virtual bool IsFastCommand() { return true; }
+
+  /*! Output format: Text, Json, or Prometheus */
+  vtkGetStdStringMacro(Format);
+  vtkSetStdStringMacro(Format);
+
+  void SetNameToGetMetrics();
+
+protected:
+  vtkPlusGetMetricsCommand();
+  virtual ~vtkPlusGetMetricsCommand();
+
+  std::string Format;
+
+private:
+  vtkPlusGetMetricsCommand(const vtkPlusGetMetricsCommand&);
+  void operator=(const vtkPlusGetMetricsCommand&);
+};
+
+#endif
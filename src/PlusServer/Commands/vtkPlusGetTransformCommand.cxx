@@ -148,4 +148,10 @@ PlusStatus vtkPlusGetTransformCommand::Execute()
     this->QueueCommandResponse(PLUS_SUCCESS, baseMessageString + " Command successful.", "", &parameters);
   }
   return PLUS_SUCCESS;
-}
\ No newline at end of file
+}
+
+//----------------------------------------------------------------------------
+std::string vtkPlusGetTransformCommand::GetExecutionKey()
+{
+  return TRANSFORM_REPOSITORY_EXECUTION_KEY;
+}
@@ -40,6 +40,11 @@ public:
   /*! Gets the description for the specified command name. */
   virtual std::string GetDescription(const std::string& commandName);
 
+  /*! Commands of this type are executed in order with other commands that use the same transform repository */
+  virtual std::string GetExecutionKey();
+
+  virtual bool IsFastCommand() { return true; }
+
   vtkGetStdStringMacro(TransformName);
   vtkSetStdStringMacro(TransformName);
 
@@ -314,3 +314,17 @@ vtkPlusUsDevice* vtkPlusGetUsParameterCommand::GetUsDevice()
   }
   return usDevice;
 }
+
+//----------------------------------------------------------------------------
+std::string vtkPlusGetUsParameterCommand::GetExecutionKey()
+{
+  // Resolve the device the same way as Execute does, so that commands that use the default device
+  // are ordered with commands that specify the same device by its id
+  vtkPlusUsDevice* usDevice = this->GetUsDevice();
+  if (usDevice == NULL)
+  {
+    // Execute will fail, use the global key to keep the usual ordering of the error response
+    return GLOBAL_EXECUTION_KEY;
+  }
+  return GetDeviceExecutionKey(usDevice->GetDeviceId());
+}
@@ -16,6 +16,8 @@ See License.txt for details.
 #include "vtkPlusVolumeReconstructor.h"
 #include "vtkPlusVirtualVolumeReconstructor.h"
 #include <limits>
+#include <sstream>
+#include <vector>
 
 namespace
 {
@@ -26,6 +28,9 @@ namespace
   static const std::string RESUME_LIVE_RECONSTRUCTION_CMD = "ResumeVolumeReconstruction";
   static const std::string STOP_LIVE_RECONSTRUCTION_CMD = "StopVolumeReconstruction";
   static const std::string GET_LIVE_RECONSTRUCTION_SNAPSHOT_CMD = "GetVolumeReconstructionSnapshot";
+  static const std::string GET_LIVE_RECONSTRUCTION_UPDATE_CMD = "GetVolumeReconstructionUpdate";
+  // Maximum time to wait for pasting the frames that have been sampled before the live reconstruction is stopped
+  static const double QUEUED_FRAMES_TIMEOUT_SEC = 10.0;
 }
 
 vtkStandardNewMacro(vtkPlusReconstructVolumeCommand);
@@ -78,6 +83,10 @@ void vtkPlusReconstructVolumeCommand::SetNameToGetSnapshot()
 {
   SetName(GET_LIVE_RECONSTRUCTION_SNAPSHOT_CMD);
 }
+void vtkPlusReconstructVolumeCommand::SetNameToGetUpdate()
+{
+  SetName(GET_LIVE_RECONSTRUCTION_UPDATE_CMD);
+}
 
 //----------------------------------------------------------------------------
 void vtkPlusReconstructVolumeCommand::PrintSelf(ostream& os, vtkIndent indent)
@@ -95,6 +104,7 @@ void vtkPlusReconstructVolumeCommand::GetCommandNames(std::list<std::string>& cm
   cmdNames.push_back(RESUME_LIVE_RECONSTRUCTION_CMD);
   cmdNames.push_back(STOP_LIVE_RECONSTRUCTION_CMD);
   cmdNames.push_back(GET_LIVE_RECONSTRUCTION_SNAPSHOT_CMD);
+  cmdNames.push_back(GET_LIVE_RECONSTRUCTION_UPDATE_CMD);
 }
 
 //----------------------------------------------------------------------------
@@ -131,6 +141,11 @@ std::string vtkPlusReconstructVolumeCommand::GetDescription(const std::string& c
     desc += GET_LIVE_RECONSTRUCTION_SNAPSHOT_CMD;
     desc += ": Request a snapshot of the live reconstruction result. Attributes: VolumeReconstructorDeviceId: ID of the volume reconstructor device. OutputVolFilename: name of the output volume file name (optional). OutputVolDeviceName: name of the OpenIGTLink device for the IMAGE message (optional). ApplyHoleFilling: if FALSE then holes will not be filled (optional, default: TRUE).";
   }
+  if (commandName.empty() || igsioCommon::IsEqualInsensitive(commandName, GET_LIVE_RECONSTRUCTION_UPDATE_CMD))
+  {
+    desc += GET_LIVE_RECONSTRUCTION_UPDATE_CMD;
+    desc += ": Request the parts of the live reconstruction result that have changed since the previous update. The parts are sent as sub-volume IMAGE messages, the whole volume is sent in the first update and periodically. Attributes: VolumeReconstructorDeviceId: ID of the volume reconstructor device. OutputVolDeviceName: name of the OpenIGTLink device for the IMAGE messages. ApplyHoleFilling: if FALSE then holes will not be filled (optional, default: TRUE).";
+  }
 
   return desc;
 }
@@ -306,6 +321,8 @@ PlusStatus vtkPlusReconstructVolumeCommand::Execute()
 
     LOG_INFO("Volume reconstruction from live frames stopping, device: " << reconstructorDeviceId);
     reconstructorDevice->SetEnableReconstruction(false);
+    // The volume is sent with the frames that could be pasted in time, the rest is discarded by the reset below
+    reconstructorDevice->WaitForQueuedFrames(QUEUED_FRAMES_TIMEOUT_SEC);
     vtkSmartPointer<vtkImageData> volumeToSend = vtkSmartPointer<vtkImageData>::New();
     std::string errorMessage;
     if (reconstructorDevice->GetReconstructedVolume(volumeToSend, errorMessage) != PLUS_SUCCESS)
@@ -359,6 +376,33 @@ PlusStatus vtkPlusReconstructVolumeCommand::Execute()
     return PLUS_SUCCESS;
   }
 
+  else if (igsioCommon::IsEqualInsensitive(this->Name, GET_LIVE_RECONSTRUCTION_UPDATE_CMD))
+  {
+    LOG_DEBUG("Volume reconstruction from live frames update request, device: " << reconstructorDeviceId);
+    if (outputVolDeviceName.empty())
+    {
+      this->QueueCommandResponse(PLUS_FAIL, "Command failed. See error message.", baseMessage + " Reconstruction update request failed: OutputVolDeviceName is not specified.");
+      return PLUS_FAIL;
+    }
+    std::vector< vtkSmartPointer<vtkImageData> > volumeBricks;
+    int volumeExtent[6] = { 0, -1, 0, -1, 0, -1 };
+    bool isKeyframe = false;
+    std::string errorMessage;
+    if (reconstructorDevice->GetReconstructedVolumeUpdate(volumeBricks, volumeExtent, isKeyframe, errorMessage, this->ApplyHoleFilling) != PLUS_SUCCESS)
+    {
+      this->QueueCommandResponse(PLUS_FAIL, "Command failed. See error message.", baseMessage + " Reconstruction update request failed: " + errorMessage);
+      return PLUS_FAIL;
+    }
+    for (std::vector< vtkSmartPointer<vtkImageData> >::iterator brickIt = volumeBricks.begin(); brickIt != volumeBricks.end(); ++brickIt)
+    {
+      this->QueueImageResponse(*brickIt, outputVolDeviceName, volumeExtent);
+    }
+    std::ostringstream statusMessage;
+    statusMessage << " " << (isKeyframe ? "whole volume" : "modified parts of the volume") << " sent as: " << outputVolDeviceName << " (" << volumeBricks.size() << " image(s))";
+    this->QueueCommandResponse(PLUS_SUCCESS, "Command succeeded.", baseMessage + statusMessage.str());
+    return PLUS_SUCCESS;
+  }
+
   this->QueueCommandResponse(PLUS_FAIL, "Command failed. See error message.", baseMessage + "Unknown command name: " + this->Name + ".");
   return PLUS_FAIL;
 }
@@ -385,25 +429,35 @@ PlusStatus vtkPlusReconstructVolumeCommand::ProcessImageReply(vtkImageData* volu
   if (!outputVolDeviceName.empty())
   {
     // send the reconstructed volume with the reply
-    LOG_DEBUG("Send image to client through OpenIGTLink");
-    vtkSmartPointer<vtkPlusCommandImageResponse> imageResponse = vtkSmartPointer<vtkPlusCommandImageResponse>::New();
-    imageResponse->SetClientId(this->ClientId);
-    imageResponse->SetImageName(outputVolDeviceName);
-    imageResponse->SetImageData(volumeToSend);
-    vtkSmartPointer<vtkMatrix4x4> volumeToReferenceTransform = vtkSmartPointer<vtkMatrix4x4>::New();
-    imageResponse->SetImageToReferenceTransform(volumeToReferenceTransform);
-    volumeToReferenceTransform->Identity(); // we leave it as identity, as the volume coordinate system is, the same as the reference coordinate system (we may extend this later so that the client can request the volume in any coordinate system)
     LOG_INFO("Send reconstructed volume to client through OpenIGTLink");
+    this->QueueImageResponse(volumeToSend, outputVolDeviceName, NULL);
     if (!resultMessage.empty())
     {
       resultMessage += ", ";
     }
     resultMessage += std::string("image sent as: ") + outputVolDeviceName;
-    this->CommandResponseQueue.push_back(imageResponse);
   }
   return status;
 }
 
+//----------------------------------------------------------------------------
+void vtkPlusReconstructVolumeCommand::QueueImageResponse(vtkImageData* imageToSend, const std::string& outputVolDeviceName, const int* volumeExtent)
+{
+  LOG_DEBUG("Send image to client through OpenIGTLink");
+  vtkSmartPointer<vtkPlusCommandImageResponse> imageResponse = vtkSmartPointer<vtkPlusCommandImageResponse>::New();
+  imageResponse->SetClientId(this->ClientId);
+  imageResponse->SetImageName(outputVolDeviceName);
+  imageResponse->SetImageData(imageToSend);
+  vtkSmartPointer<vtkMatrix4x4> volumeToReferenceTransform = vtkSmartPointer<vtkMatrix4x4>::New();
+  imageResponse->SetImageToReferenceTransform(volumeToReferenceTransform);
+  volumeToReferenceTransform->Identity(); // we leave it as identity, as the volume coordinate system is, the same as the reference coordinate system (we may extend this later so that the client can request the volume in any coordinate system)
+  if (volumeExtent != NULL)
+  {
+    imageResponse->SetVolumeExtent(volumeExtent[0], volumeExtent[1], volumeExtent[2], volumeExtent[3], volumeExtent[4], volumeExtent[5]);
+  }
+  this->CommandResponseQueue.push_back(imageResponse);
+}
+
 //----------------------------------------------------------------------------
 vtkPlusVirtualVolumeReconstructor* vtkPlusReconstructVolumeCommand::GetVolumeReconstructorDevice()
 {
@@ -452,3 +506,17 @@ vtkPlusVirtualVolumeReconstructor* vtkPlusReconstructVolumeCommand::GetVolumeRec
   }
   return reconstructorDevice;
 }
+
+//----------------------------------------------------------------------------
+std::string vtkPlusReconstructVolumeCommand::GetExecutionKey()
+{
+  // Resolve the device the same way as Execute does, so that commands that use the default device
+  // are ordered with commands that specify the same device by its id
+  vtkPlusVirtualVolumeReconstructor* reconstructorDevice = this->GetVolumeReconstructorDevice();
+  if (reconstructorDevice == NULL)
+  {
+    // Execute will fail, use the global key to keep the usual ordering of the error response
+    return GLOBAL_EXECUTION_KEY;
+  }
+  return GetDeviceExecutionKey(reconstructorDevice->GetDeviceId());
+}
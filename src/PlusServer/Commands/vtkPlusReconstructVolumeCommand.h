@@ -44,6 +44,9 @@ public:
   /*! Gets the description for the specified command name. */
   virtual std::string GetDescription(const std::string& commandName);
 
+  /*! Commands of this type are executed in order with other commands that use the same device */
+  virtual std::string GetExecutionKey();
+
   /*! File name of the sequence file that contains the image frames */
   vtkGetStdStringMacro(InputSeqFilename);
   vtkSetStdStringMacro(InputSeqFilename);
@@ -93,11 +96,15 @@ public:
   void SetNameToSuspend();
   void SetNameToResume();
   void SetNameToGetSnapshot();
+  void SetNameToGetUpdate();
 
 protected:
   /*! Saves image to disk (if requested) and prepare sending image as a response (if requested) */
   PlusStatus ProcessImageReply(vtkImageData* volumeToSend, const std::string& outputVolFilename, const std::string& outputVolDeviceName, std::string& resultMessage);
 
+  /*! Prepare sending image as a response. If volumeExtent is specified then the image is sent as a sub-volume of a volume with that extent. */
+  void QueueImageResponse(vtkImageData* imageToSend, const std::string& outputVolDeviceName, const int* volumeExtent);
+
   vtkPlusVirtualVolumeReconstructor* GetVolumeReconstructorDevice();
 
   vtkPlusReconstructVolumeCommand();
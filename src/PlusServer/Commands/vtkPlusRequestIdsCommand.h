@@ -34,6 +34,8 @@ public:
   /*! Gets the description for the specified command name. */
   virtual std::string GetDescription(const std::string& commandName);
 
+  virtual bool IsFastCommand() { return true; }
+
   void SetNameToRequestChannelIds();
   void SetNameToRequestDeviceIds();
   void SetNameToRequestInputDeviceIds();
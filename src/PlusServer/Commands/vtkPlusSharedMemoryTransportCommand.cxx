@@ -0,0 +1,150 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusCommandProcessor.h"
+#include "vtkPlusOpenIGTLinkServer.h"
+#include "vtkPlusSharedMemoryTransportCommand.h"
+
+vtkStandardNewMacro(vtkPlusSharedMemoryTransportCommand);
+
+namespace
+{
+  static const std::string START_CMD = "StartSharedMemoryTransport";
+  static const std::string STOP_CMD = "StopSharedMemoryTransport";
+}
+
+//----------------------------------------------------------------------------
+vtkPlusSharedMemoryTransportCommand::vtkPlusSharedMemoryTransportCommand()
+  : NumberOfSlots(0)
+  , SlotSize(0)
+{
+}
+
+//----------------------------------------------------------------------------
+vtkPlusSharedMemoryTransportCommand::~vtkPlusSharedMemoryTransportCommand()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusSharedMemoryTransportCommand::SetNameToStart() { SetName(START_CMD); }
+void vtkPlusSharedMemoryTransportCommand::SetNameToStop() { SetName(STOP_CMD); }
+
+//----------------------------------------------------------------------------
+void vtkPlusSharedMemoryTransportCommand::GetCommandNames(std::list<std::string>& cmdNames)
+{
+  cmdNames.clear();
+  cmdNames.push_back(START_CMD);
+  cmdNames.push_back(STOP_CMD);
+}
+
+//----------------------------------------------------------------------------
+std::string vtkPlusSharedMemoryTransportCommand::GetDescription(const std::string& commandName)
+{
+  std::string desc;
+  if (commandName.empty() || igsioCommon::IsEqualInsensitive(commandName, START_CMD))
+  {
+    desc += START_CMD;
+    desc += ": Receive tracked frames through a shared memory ring instead of the socket (client must run on the same host as the server). Attributes: NumberOfSlots: number of frames in the ring (optional). SlotSize: maximum frame size in bytes (optional, computed from the current frame size by default).";
+  }
+  if (commandName.empty() || igsioCommon::IsEqualInsensitive(commandName, STOP_CMD))
+  {
+    desc += STOP_CMD;
+    desc += ": Remove the shared memory ring of the client and send tracked frames through the socket again.";
+  }
+  return desc;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusSharedMemoryTransportCommand::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfSlots: " << this->NumberOfSlots << std::endl;
+  os << indent << "SlotSize: " << this->SlotSize << std::endl;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSharedMemoryTransportCommand::ReadConfiguration(vtkXMLDataElement* aConfig)
+{
+  if (vtkPlusCommand::ReadConfiguration(aConfig) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, NumberOfSlots, aConfig);
+  const char* slotSizeStr = aConfig->GetAttribute("SlotSize");
+  if (slotSizeStr != NULL && igsioCommon::StringToNumber<unsigned long long>(slotSizeStr, this->SlotSize) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Invalid SlotSize attribute value: " << slotSizeStr);
+    return PLUS_FAIL;
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSharedMemoryTransportCommand::WriteConfiguration(vtkXMLDataElement* aConfig)
+{
+  if (vtkPlusCommand::WriteConfiguration(aConfig) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+  if (this->NumberOfSlots > 0)
+  {
+    aConfig->SetIntAttribute("NumberOfSlots", this->NumberOfSlots);
+  }
+  if (this->SlotSize > 0)
+  {
+    aConfig->SetAttribute("SlotSize", igsioCommon::ToString<unsigned long long>(this->SlotSize).c_str());
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusSharedMemoryTransportCommand::Execute()
+{
+  LOG_DEBUG("vtkPlusSharedMemoryTransportCommand::Execute: " << this->Name);
+
+  vtkPlusOpenIGTLinkServer* server = (this->CommandProcessor != NULL ? this->CommandProcessor->GetPlusServer() : NULL);
+  if (server == NULL)
+  {
+    this->QueueCommandResponse(PLUS_FAIL, "Command failed. See error message.", "No server is available.");
+    return PLUS_FAIL;
+  }
+
+  if (igsioCommon::IsEqualInsensitive(this->Name, STOP_CMD))
+  {
+    if (server->StopSharedMemoryTransport(this->ClientId) != PLUS_SUCCESS)
+    {
+      this->QueueCommandResponse(PLUS_FAIL, "Command failed. See error message.", "Shared memory transport is not active for this client.");
+      return PLUS_FAIL;
+    }
+    this->QueueCommandResponse(PLUS_SUCCESS, "Shared memory transport stopped.");
+    return PLUS_SUCCESS;
+  }
+
+  std::string segmentName;
+  unsigned int numberOfSlots = (this->NumberOfSlots > 0 ? static_cast<unsigned int>(this->NumberOfSlots) : 0);
+  igtlUint64 slotSize = this->SlotSize;
+  if (server->StartSharedMemoryTransport(this->ClientId, numberOfSlots, slotSize, segmentName) != PLUS_SUCCESS)
+  {
+    this->QueueCommandResponse(PLUS_FAIL, "Command failed. See error message.", "Failed to create shared memory ring. Shared memory transport may be disabled on the server.");
+    return PLUS_FAIL;
+  }
+
+  if (!this->RespondWithCommandMessage)
+  {
+    // Legacy clients only receive a string, which is the segment name
+    this->QueueCommandResponse(PLUS_SUCCESS, segmentName);
+  }
+  else
+  {
+    igtl::MessageBase::MetaDataMap parameters;
+    parameters["SegmentName"] = std::pair<IANA_ENCODING_TYPE, std::string>(IANA_TYPE_US_ASCII, segmentName);
+    parameters["NumberOfSlots"] = std::pair<IANA_ENCODING_TYPE, std::string>(IANA_TYPE_US_ASCII, igsioCommon::ToString<unsigned int>(numberOfSlots));
+    parameters["SlotSize"] = std::pair<IANA_ENCODING_TYPE, std::string>(IANA_TYPE_US_ASCII, igsioCommon::ToString<igtlUint64>(slotSize));
+    this->QueueCommandResponse(PLUS_SUCCESS, "Shared memory transport started.", "", &parameters);
+  }
+  return PLUS_SUCCESS;
+}
@@ -0,0 +1,73 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __vtkPlusSharedMemoryTransportCommand_h
+#define __vtkPlusSharedMemoryTransportCommand_h
+
+#include "vtkPlusServerExport.h"
+
+#include "vtkPlusCommand.h"
+
+/*!
+  \class vtkPlusSharedMemoryTransportCommand
+  \brief This command switches the data transfer of a client between the OpenIGTLink socket and a shared memory ring
+
+  StartSharedMemoryTransport creates a shared memory ring (see PlusSharedMemoryFrameRing) for the client that sent the command.
+  From then on the server publishes each tracked frame as a TRACKEDFRAME message into the ring instead of sending
+  data messages through the socket. The socket remains connected and is used for commands, replies and keep-alive messages.
+  The reply contains the SegmentName, NumberOfSlots and SlotSize of the created ring.
+  StopSharedMemoryTransport removes the ring and the server resumes sending data messages through the socket.
+
+  \ingroup PlusLibPlusServer
+ */
+class vtkPlusServerExport vtkPlusSharedMemoryTransportCommand : public vtkPlusCommand
+{
+public:
+
+  static vtkPlusSharedMemoryTransportCommand* New();
+  vtkTypeMacro(vtkPlusSharedMemoryTransportCommand, vtkPlusCommand);
+  virtual void PrintSelf(ostream& os, vtkIndent indent);
+  virtual vtkPlusCommand* Clone() { return New(); }
+
+  /*! Executes the command  */
+  virtual PlusStatus Execute();
+
+  /*! Read command parameters from XML */
+  virtual PlusStatus ReadConfiguration(vtkXMLDataElement* aConfig);
+
+  /*! Write command parameters to XML */
+  virtual PlusStatus WriteConfiguration(vtkXMLDataElement* aConfig);
+
+  /*! Get all the command names that this class can execute */
+  virtual void GetCommandNames(std::list<std::string>& cmdNames);
+
+  /*! Gets the description for the specified command name. */
+  virtual std::string GetDescription(const std::string& commandName);
+
+  /*! Number of frame slots in the ring. 0 means the server default is used. */
+  vtkGetMacro(NumberOfSlots, int);
+  vtkSetMacro(NumberOfSlots, int);
+
+  /*! Maximum size of a frame in bytes. 0 means the server computes it from the current frame size. */
+  vtkGetMacro(SlotSize, unsigned long long);
+  vtkSetMacro(SlotSize, unsigned long long);
+
+  void SetNameToStart();
+  void SetNameToStop();
+
+protected:
+  vtkPlusSharedMemoryTransportCommand();
+  virtual ~vtkPlusSharedMemoryTransportCommand();
+
+  int NumberOfSlots;
+  unsigned long long SlotSize;
+
+private:
+  vtkPlusSharedMemoryTransportCommand(const vtkPlusSharedMemoryTransportCommand&);
+  void operator=(const vtkPlusSharedMemoryTransportCommand&);
+};
+
+#endif
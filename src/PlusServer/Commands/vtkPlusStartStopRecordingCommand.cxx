@@ -374,4 +374,15 @@ PlusStatus vtkPlusStartStopRecordingCommand::Execute()
 
   this->QueueCommandResponse(PLUS_FAIL, "Command failed. See error message.", responseMessageBase + "Unknown command: " + this->Name);
   return PLUS_FAIL;
-}
\ No newline at end of file
+}
+
+//----------------------------------------------------------------------------
+std::string vtkPlusStartStopRecordingCommand::GetExecutionKey()
+{
+  if (this->CaptureDeviceId.empty())
+  {
+    // The capture device may be created, which modifies the device list
+    return GLOBAL_EXECUTION_KEY;
+  }
+  return GetDeviceExecutionKey(this->CaptureDeviceId);
+}
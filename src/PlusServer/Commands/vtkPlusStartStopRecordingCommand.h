@@ -43,6 +43,9 @@ public:
   /*! Gets the description for the specified command name. */
   virtual std::string GetDescription(const std::string& commandName);
 
+  /*! Commands of this type are executed in order with other commands that use the same device */
+  virtual std::string GetExecutionKey();
+
   vtkGetStdStringMacro(OutputFilename);
   vtkSetStdStringMacro(OutputFilename);
 
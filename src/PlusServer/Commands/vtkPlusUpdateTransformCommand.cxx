@@ -165,3 +165,9 @@ void vtkPlusUpdateTransformCommand::SetTransformValue(double* matrixElements)
   matrix->DeepCopy(matrixElements);
   this->SetTransformValue(matrix);
 }
+
+//----------------------------------------------------------------------------
+std::string vtkPlusUpdateTransformCommand::GetExecutionKey()
+{
+  return TRANSFORM_REPOSITORY_EXECUTION_KEY;
+}
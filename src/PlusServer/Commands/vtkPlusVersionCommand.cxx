@@ -69,3 +69,9 @@ PlusStatus vtkPlusVersionCommand::Execute()
   this->QueueCommandResponse(PLUS_SUCCESS, "Success.", "", &metadata);
   return PLUS_SUCCESS;
 }
+
+//----------------------------------------------------------------------------
+std::string vtkPlusVersionCommand::GetExecutionKey()
+{
+  return "";
+}
@@ -33,6 +33,11 @@ public:
   /*! Gets the description for the specified command name. */
   virtual std::string GetDescription(const std::string& commandName);
 
+  /*! Independent of other commands, so it can be executed at any time */
+  virtual std::string GetExecutionKey();
+
+  virtual bool IsFastCommand() { return true; }
+
   void SetNameToVersion();
 
 protected:
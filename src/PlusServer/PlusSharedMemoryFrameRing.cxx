@@ -0,0 +1,484 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+// Local includes
+#include "PlusSharedMemoryFrameRing.h"
+
+// IGSIO includes
+#include <vtkIGSIOAccurateTimer.h>
+
+// STL includes
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <sstream>
+
+// System includes
+#if defined(_WIN32)
+  #include <windows.h>
+#else
+  #include <errno.h>
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace
+{
+  const char SEGMENT_MAGIC[8] = { 'P', 'L', 'U', 'S', 'S', 'H', 'M', '\0' };
+  const igtlUint32 SEGMENT_VERSION = 1;
+  // Headers and slots are aligned to cache lines to avoid false sharing between the writer and readers
+  const igtlUint64 CACHE_LINE_SIZE = 64;
+
+  igtlUint64 AlignToCacheLine(igtlUint64 size)
+  {
+    return (size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+  }
+}
+
+//----------------------------------------------------------------------------
+// Layout of the shared memory: SegmentHeader, then NumberOfSlots times (SlotHeader + slot data)
+// Only fixed-size types are used so that processes built with different compilers can share the segment.
+struct PlusSharedMemoryFrameRing::SegmentHeader
+{
+  char Magic[8];
+  igtlUint32 Version;
+  igtlUint32 NumberOfSlots;
+  igtlUint64 SlotSize;
+  igtlUint64 SlotStride;
+  std::atomic<igtlUint64> NumberOfWrittenFrames;
+};
+
+struct PlusSharedMemoryFrameRing::SlotHeader
+{
+  /*! Sequence lock: odd while the slot is being written */
+  std::atomic<igtlUint64> Sequence;
+  igtlUint64 FrameIndex;
+  igtlUint64 DataSize;
+  double Timestamp;
+};
+
+//----------------------------------------------------------------------------
+PlusSharedMemoryFrameRing::PlusSharedMemoryFrameRing()
+  : Writer(false)
+  , MappedMemory(NULL)
+  , MappedSize(0)
+  , Header(NULL)
+  , SlotStride(0)
+  , NumberOfDroppedFrames(0)
+  , LastDroppedFrameSize(0)
+  , DroppedFramesCounter(NULL)
+#if defined(_WIN32)
+  , MappingHandle(NULL)
+#else
+  , FileDescriptor(-1)
+#endif
+{
+}
+
+//----------------------------------------------------------------------------
+PlusSharedMemoryFrameRing::~PlusSharedMemoryFrameRing()
+{
+  this->Close();
+}
+
+//----------------------------------------------------------------------------
+std::string PlusSharedMemoryFrameRing::GetPlatformSegmentName(const std::string& name)
+{
+#if defined(_WIN32)
+  return "Local\\" + name;
+#else
+  return "/" + name;
+#endif
+}
+
+//----------------------------------------------------------------------------
+std::string PlusSharedMemoryFrameRing::GenerateSegmentName(const std::string& prefix, int id)
+{
+  std::ostringstream name;
+#if defined(_WIN32)
+  name << prefix << GetCurrentProcessId() << "_" << id;
+#else
+  name << prefix << getpid() << "_" << id;
+#endif
+  return name.str();
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusSharedMemoryFrameRing::Create(const std::string& name, unsigned int numberOfSlots, igtlUint64 slotSize)
+{
+  if (name.empty() || numberOfSlots < 2 || slotSize == 0)
+  {
+    LOG_ERROR("Invalid shared memory ring parameters: name='" << name << "', number of slots: " << numberOfSlots << ", slot size: " << slotSize);
+    return PLUS_FAIL;
+  }
+  if (!std::atomic<igtlUint64>().is_lock_free())
+  {
+    LOG_ERROR("Shared memory ring is not supported on this platform: 64-bit atomic operations are not lock-free");
+    return PLUS_FAIL;
+  }
+
+  this->Close();
+
+  igtlUint64 headerSize = AlignToCacheLine(sizeof(SegmentHeader));
+  igtlUint64 slotStride = AlignToCacheLine(sizeof(SlotHeader)) + AlignToCacheLine(slotSize);
+  if (this->MapSegment(name, headerSize + slotStride * numberOfSlots, true) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+
+  // The mapped memory is zero-initialized, construct the header and slot headers in place
+  this->Header = new (this->MappedMemory) SegmentHeader;
+  memcpy(this->Header->Magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+  this->Header->Version = SEGMENT_VERSION;
+  this->Header->NumberOfSlots = numberOfSlots;
+  this->Header->SlotSize = slotSize;
+  this->Header->SlotStride = slotStride;
+  this->Header->NumberOfWrittenFrames.store(0, std::memory_order_relaxed);
+  this->SlotStride = slotStride;
+  for (unsigned int slotIndex = 0; slotIndex < numberOfSlots; ++slotIndex)
+  {
+    SlotHeader* slot = new (static_cast<char*>(this->MappedMemory) + headerSize + slotStride * slotIndex) SlotHeader;
+    slot->Sequence.store(0, std::memory_order_relaxed);
+    slot->FrameIndex = 0;
+    slot->DataSize = 0;
+    slot->Timestamp = 0;
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+
+  this->NumberOfDroppedFrames = 0;
+  this->LastDroppedFrameSize = 0;
+  PlusMetricsRegistry::LabelMap labels;
+  labels["segment"] = name;
+  this->DroppedFramesCounter = PlusMetricsRegistry::GetInstance()->GetCounter("plus_shared_memory_dropped_frames_total", labels,
+                               "Number of frames that were not published in the shared memory ring because they did not fit into a slot");
+
+  LOG_DEBUG("Shared memory ring created: " << name << " (" << numberOfSlots << " slots, " << slotSize << " bytes/slot)");
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusSharedMemoryFrameRing::Open(const std::string& name)
+{
+  this->Close();
+
+  if (this->MapSegment(name, 0, false) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+
+  SegmentHeader* header = static_cast<SegmentHeader*>(this->MappedMemory);
+  if (this->MappedSize < sizeof(SegmentHeader)
+      || memcmp(header->Magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0
+      || header->Version != SEGMENT_VERSION
+      || header->NumberOfSlots < 2
+      || AlignToCacheLine(sizeof(SegmentHeader)) + header->SlotStride * header->NumberOfSlots > this->MappedSize)
+  {
+    LOG_ERROR("Shared memory segment " << name << " is not a valid frame ring");
+    this->Close();
+    return PLUS_FAIL;
+  }
+  this->Header = header;
+  this->SlotStride = header->SlotStride;
+
+  LOG_DEBUG("Shared memory ring opened: " << name << " (" << header->NumberOfSlots << " slots, " << header->SlotSize << " bytes/slot)");
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusSharedMemoryFrameRing::MapSegment(const std::string& name, igtlUint64 segmentSize, bool create)
+{
+  std::string platformName = GetPlatformSegmentName(name);
+#if defined(_WIN32)
+  HANDLE mapping = NULL;
+  if (create)
+  {
+    mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                 static_cast<DWORD>(segmentSize >> 32), static_cast<DWORD>(segmentSize & 0xFFFFFFFF), platformName.c_str());
+  }
+  else
+  {
+    mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, platformName.c_str());
+  }
+  if (mapping == NULL)
+  {
+    LOG_ERROR("Failed to " << (create ? "create" : "open") << " shared memory segment " << platformName << " (error code: " << GetLastError() << ")");
+    return PLUS_FAIL;
+  }
+  void* memory = MapViewOfFile(mapping, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, create ? static_cast<SIZE_T>(segmentSize) : 0);
+  if (memory == NULL)
+  {
+    LOG_ERROR("Failed to map shared memory segment " << platformName << " (error code: " << GetLastError() << ")");
+    CloseHandle(mapping);
+    return PLUS_FAIL;
+  }
+  if (!create)
+  {
+    MEMORY_BASIC_INFORMATION info;
+    VirtualQuery(memory, &info, sizeof(info));
+    segmentSize = info.RegionSize;
+  }
+  this->MappingHandle = mapping;
+#else
+  int fd = -1;
+  if (create)
+  {
+    fd = shm_open(platformName.c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd < 0 && errno == EEXIST)
+    {
+      // Left behind by a process that did not exit cleanly
+      LOG_WARNING("Replacing stale shared memory segment " << platformName);
+      shm_unlink(platformName.c_str());
+      fd = shm_open(platformName.c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+    }
+    if (fd >= 0 && ftruncate(fd, static_cast<off_t>(segmentSize)) != 0)
+    {
+      LOG_ERROR("Failed to set the size of shared memory segment " << platformName << " to " << segmentSize << " bytes: " << strerror(errno));
+      close(fd);
+      shm_unlink(platformName.c_str());
+      return PLUS_FAIL;
+    }
+  }
+  else
+  {
+    fd = shm_open(platformName.c_str(), O_RDONLY, 0);
+    struct stat fileInfo;
+    if (fd >= 0 && fstat(fd, &fileInfo) == 0)
+    {
+      segmentSize = static_cast<igtlUint64>(fileInfo.st_size);
+    }
+  }
+  if (fd < 0)
+  {
+    LOG_ERROR("Failed to " << (create ? "create" : "open") << " shared memory segment " << platformName << ": " << strerror(errno));
+    return PLUS_FAIL;
+  }
+  void* memory = segmentSize > 0 ? mmap(NULL, segmentSize, create ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  if (memory == MAP_FAILED)
+  {
+    LOG_ERROR("Failed to map shared memory segment " << platformName << ": " << strerror(errno));
+    close(fd);
+    if (create)
+    {
+      shm_unlink(platformName.c_str());
+    }
+    return PLUS_FAIL;
+  }
+  this->FileDescriptor = fd;
+#endif
+
+  this->Name = name;
+  this->Writer = create;
+  this->MappedMemory = memory;
+  this->MappedSize = segmentSize;
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void PlusSharedMemoryFrameRing::Close()
+{
+  if (this->MappedMemory == NULL)
+  {
+    return;
+  }
+
+#if defined(_WIN32)
+  // The segment is removed by the system when the last handle is closed
+  UnmapViewOfFile(this->MappedMemory);
+  CloseHandle(static_cast<HANDLE>(this->MappingHandle));
+  this->MappingHandle = NULL;
+#else
+  munmap(this->MappedMemory, this->MappedSize);
+  close(this->FileDescriptor);
+  this->FileDescriptor = -1;
+  if (this->Writer)
+  {
+    // Readers that have the segment mapped can still access it until they close it
+    shm_unlink(GetPlatformSegmentName(this->Name).c_str());
+  }
+#endif
+
+  if (this->Writer)
+  {
+    PlusMetricsRegistry::GetInstance()->RemoveMetrics("segment", this->Name);
+    this->DroppedFramesCounter = NULL;
+  }
+
+  this->MappedMemory = NULL;
+  this->MappedSize = 0;
+  this->Header = NULL;
+  this->SlotStride = 0;
+  this->Writer = false;
+  this->Name.clear();
+}
+
+//----------------------------------------------------------------------------
+bool PlusSharedMemoryFrameRing::IsOpen() const
+{
+  return this->Header != NULL;
+}
+
+//----------------------------------------------------------------------------
+bool PlusSharedMemoryFrameRing::IsWriter() const
+{
+  return this->Writer;
+}
+
+//----------------------------------------------------------------------------
+std::string PlusSharedMemoryFrameRing::GetName() const
+{
+  return this->Name;
+}
+
+//----------------------------------------------------------------------------
+unsigned int PlusSharedMemoryFrameRing::GetNumberOfSlots() const
+{
+  return this->Header != NULL ? this->Header->NumberOfSlots : 0;
+}
+
+//----------------------------------------------------------------------------
+igtlUint64 PlusSharedMemoryFrameRing::GetSlotSize() const
+{
+  return this->Header != NULL ? this->Header->SlotSize : 0;
+}
+
+//----------------------------------------------------------------------------
+PlusSharedMemoryFrameRing::SlotHeader* PlusSharedMemoryFrameRing::GetSlotHeader(unsigned int slotIndex) const
+{
+  return reinterpret_cast<SlotHeader*>(static_cast<char*>(this->MappedMemory) + AlignToCacheLine(sizeof(SegmentHeader)) + this->SlotStride * slotIndex);
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusSharedMemoryFrameRing::WriteMessage(igtl::MessageBase* packedMessage)
+{
+  if (packedMessage == NULL)
+  {
+    return PLUS_FAIL;
+  }
+  PlusIgtlGatherMessage::SegmentList segments;
+  PlusIgtlGatherMessage* gatherMessage = dynamic_cast<PlusIgtlGatherMessage*>(packedMessage);
+  if (gatherMessage == NULL || !gatherMessage->GetGatherSegments(segments))
+  {
+    segments.clear();
+    segments.push_back(PlusIgtlGatherMessage::Segment(packedMessage->GetBufferPointer(), packedMessage->GetBufferSize()));
+  }
+  return this->WriteFrame(segments);
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusSharedMemoryFrameRing::WriteFrame(const PlusIgtlGatherMessage::SegmentList& segments)
+{
+  if (this->Header == NULL || !this->Writer)
+  {
+    LOG_ERROR("Shared memory ring is not open for writing");
+    return PLUS_FAIL;
+  }
+
+  igtlUint64 frameSize = 0;
+  for (PlusIgtlGatherMessage::SegmentList::const_iterator it = segments.begin(); it != segments.end(); ++it)
+  {
+    frameSize += it->Size;
+  }
+  if (frameSize > this->Header->SlotSize)
+  {
+    // Frames are written at the acquisition rate and usually have the same size, so the error is only logged when the size changes
+    ++this->NumberOfDroppedFrames;
+    if (this->DroppedFramesCounter != NULL)
+    {
+      this->DroppedFramesCounter->Increment();
+    }
+    if (frameSize != this->LastDroppedFrameSize)
+    {
+      LOG_ERROR("Frame does not fit into shared memory ring " << this->Name << " (frame size: " << frameSize << " bytes, slot size: " << this->Header->SlotSize
+                << " bytes). Frames of this size are dropped, only the number of dropped frames is updated from now on.");
+      this->LastDroppedFrameSize = frameSize;
+    }
+    return PLUS_FAIL;
+  }
+
+  // Only this process writes, so the frame counter can be read without synchronization
+  igtlUint64 frameIndex = this->Header->NumberOfWrittenFrames.load(std::memory_order_relaxed);
+  SlotHeader* slot = this->GetSlotHeader(static_cast<unsigned int>(frameIndex % this->Header->NumberOfSlots));
+  unsigned char* slotData = reinterpret_cast<unsigned char*>(slot) + AlignToCacheLine(sizeof(SlotHeader));
+
+  // Sequence lock write: odd sequence number while the slot content is modified
+  igtlUint64 sequence = slot->Sequence.load(std::memory_order_relaxed);
+  slot->Sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->FrameIndex = frameIndex;
+  slot->DataSize = frameSize;
+  slot->Timestamp = vtkIGSIOAccurateTimer::GetSystemTime();
+  for (PlusIgtlGatherMessage::SegmentList::const_iterator it = segments.begin(); it != segments.end(); ++it)
+  {
+    memcpy(slotData, it->Data, it->Size);
+    slotData += it->Size;
+  }
+
+  slot->Sequence.store(sequence + 2, std::memory_order_release);
+  this->Header->NumberOfWrittenFrames.store(frameIndex + 1, std::memory_order_release);
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+igtlUint64 PlusSharedMemoryFrameRing::GetNumberOfDroppedFrames() const
+{
+  return this->NumberOfDroppedFrames;
+}
+
+//----------------------------------------------------------------------------
+igtlUint64 PlusSharedMemoryFrameRing::GetNumberOfWrittenFrames() const
+{
+  if (this->Header == NULL)
+  {
+    return 0;
+  }
+  return this->Header->NumberOfWrittenFrames.load(std::memory_order_acquire);
+}
+
+//----------------------------------------------------------------------------
+PlusStatus PlusSharedMemoryFrameRing::BeginRead(igtlUint64 frameIndex, FrameView& view) const
+{
+  if (this->Header == NULL || frameIndex >= this->GetNumberOfWrittenFrames())
+  {
+    return PLUS_FAIL;
+  }
+
+  unsigned int slotIndex = static_cast<unsigned int>(frameIndex % this->Header->NumberOfSlots);
+  const SlotHeader* slot = this->GetSlotHeader(slotIndex);
+  igtlUint64 sequence = slot->Sequence.load(std::memory_order_acquire);
+  if (sequence & 1)
+  {
+    // Slot is being written
+    return PLUS_FAIL;
+  }
+
+  view.FrameIndex = slot->FrameIndex;
+  view.Timestamp = slot->Timestamp;
+  view.Size = static_cast<size_t>(slot->DataSize);
+  view.Data = reinterpret_cast<const unsigned char*>(slot) + AlignToCacheLine(sizeof(SlotHeader));
+  view.SlotIndex = slotIndex;
+  view.Sequence = sequence;
+
+  // A torn read of the slot header cannot be detected until EndRead, so validate it now to never return an out-of-bounds view
+  if (view.FrameIndex != frameIndex || view.Size > this->Header->SlotSize || !this->EndRead(view))
+  {
+    return PLUS_FAIL;
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+bool PlusSharedMemoryFrameRing::EndRead(const FrameView& view) const
+{
+  if (this->Header == NULL)
+  {
+    return false;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return this->GetSlotHeader(view.SlotIndex)->Sequence.load(std::memory_order_relaxed) == view.Sequence;
+}
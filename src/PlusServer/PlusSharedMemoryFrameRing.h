@@ -0,0 +1,142 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __PlusSharedMemoryFrameRing_h
+#define __PlusSharedMemoryFrameRing_h
+
+#include "vtkPlusServerExport.h"
+
+// Local includes
+#include "PlusConfigure.h"
+#include "PlusIgtlGatherMessage.h"
+#include "PlusMetricsRegistry.h"
+
+// IGTL includes
+#include <igtlMessageBase.h>
+
+// STL includes
+#include <string>
+
+/*!
+  \class PlusSharedMemoryFrameRing
+  \brief Ring of frame slots in a named shared memory segment, for transferring frames to clients on the same host
+
+  The writer (PlusServer) creates the segment and publishes each frame as a packed IGTL message (typically TRACKEDFRAME,
+  which contains the image, transforms and frame fields) into the next slot of the ring. Readers (clients on the same host)
+  open the segment read-only and can access the frames in place, without any copy or serialization through a socket.
+
+  Each slot is protected by a sequence lock: the writer makes the sequence number odd while it writes the slot and even
+  when it is done, readers never block the writer. A reader accesses a frame between BeginRead and EndRead and must discard
+  everything it read if EndRead returns false (the slot was overwritten in the meantime). Frames are not overwritten until
+  the writer has published NumberOfSlots newer frames, so a reader that keeps up with the writer never has to retry.
+
+  POSIX shared memory (shm_open) is used on Linux and macOS, named file mapping on Windows.
+  The segment is only accessible by the user who created it and it is removed when the writer closes it.
+
+  \ingroup PlusLibPlusServer
+*/
+class vtkPlusServerExport PlusSharedMemoryFrameRing
+{
+public:
+  /*! Location of a frame in the shared memory, valid between BeginRead and EndRead */
+  struct FrameView
+  {
+    FrameView() : FrameIndex(0), Timestamp(0), Data(NULL), Size(0), SlotIndex(0), Sequence(0) {}
+    igtlUint64 FrameIndex;
+    /*! Time when the frame was published (system time of the writer process, see vtkIGSIOAccurateTimer::GetSystemTime) */
+    double Timestamp;
+    const void* Data;
+    size_t Size;
+    unsigned int SlotIndex;
+    igtlUint64 Sequence;
+  };
+
+  PlusSharedMemoryFrameRing();
+  virtual ~PlusSharedMemoryFrameRing();
+
+  /*!
+    Create a new segment for writing. An existing segment with the same name (left behind by a crashed process) is replaced.
+    \param name Segment name, it must be short (max. 30 characters on macOS) and should not contain slashes
+    \param slotSize Maximum size of a frame in bytes
+  */
+  PlusStatus Create(const std::string& name, unsigned int numberOfSlots, igtlUint64 slotSize);
+
+  /*! Open an existing segment for reading */
+  PlusStatus Open(const std::string& name);
+
+  /*! Unmap the segment. If the segment was created by this object then it is removed. */
+  void Close();
+
+  /*! Generate a segment name that is unique on the host: prefix, process ID and the specified ID */
+  static std::string GenerateSegmentName(const std::string& prefix, int id);
+
+  bool IsOpen() const;
+  bool IsWriter() const;
+
+  std::string GetName() const;
+  unsigned int GetNumberOfSlots() const;
+  igtlUint64 GetSlotSize() const;
+
+  /*!
+    Publish a packed message in the next slot. Gather-enabled messages (see PlusIgtlGatherMessage) are copied
+    directly from their segments, so the image data is only copied once (from the tracked frame into the shared memory).
+  */
+  PlusStatus WriteMessage(igtl::MessageBase* packedMessage);
+
+  /*!
+    Publish a frame that consists of the concatenation of the segments in the next slot.
+    A frame that is larger than the slot size is dropped. The error is logged once for each frame size, the dropped frames
+    are counted (see GetNumberOfDroppedFrames and the plus_shared_memory_dropped_frames_total metric).
+  */
+  PlusStatus WriteFrame(const PlusIgtlGatherMessage::SegmentList& segments);
+
+  /*! Number of frames that were not published because they did not fit into a slot, since the segment was created */
+  igtlUint64 GetNumberOfDroppedFrames() const;
+
+  /*! Number of frames published since the segment was created. The index of the most recent frame is GetNumberOfWrittenFrames()-1. */
+  igtlUint64 GetNumberOfWrittenFrames() const;
+
+  /*!
+    Start accessing a frame in place. Fails if the frame has not been published yet, it is being written, or it has been overwritten.
+    Data that is read through the view is only valid if EndRead returns true.
+  */
+  PlusStatus BeginRead(igtlUint64 frameIndex, FrameView& view) const;
+
+  /*! Returns true if the frame was not modified by the writer since BeginRead */
+  bool EndRead(const FrameView& view) const;
+
+protected:
+  struct SegmentHeader;
+  struct SlotHeader;
+
+  PlusStatus MapSegment(const std::string& name, igtlUint64 segmentSize, bool create);
+  SlotHeader* GetSlotHeader(unsigned int slotIndex) const;
+  static std::string GetPlatformSegmentName(const std::string& name);
+
+  std::string Name;
+  bool Writer;
+  void* MappedMemory;
+  igtlUint64 MappedSize;
+  SegmentHeader* Header;
+  igtlUint64 SlotStride;
+
+  igtlUint64 NumberOfDroppedFrames;
+  /*! Size of the last dropped frame, an error is only logged if the size of a dropped frame is different */
+  igtlUint64 LastDroppedFrameSize;
+  PlusMetricsRegistry::Counter* DroppedFramesCounter;
+
+#if defined(_WIN32)
+  void* MappingHandle;
+#else
+  int FileDescriptor;
+#endif
+
+private:
+  PlusSharedMemoryFrameRing(const PlusSharedMemoryFrameRing&);  // Not implemented.
+  void operator=(const PlusSharedMemoryFrameRing&);  // Not implemented.
+};
+
+#endif //__PlusSharedMemoryFrameRing_h
@@ -0,0 +1,405 @@
+/*=Plus=header=begin======================================================
+Program: Plus
+Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file PlusSharedMemoryTransportTest.cxx
+  \brief Latency and throughput benchmark of the shared memory frame ring compared to loopback TCP
+
+  Tracked frames are packed as TRACKEDFRAME messages (same as in PlusServer) and transferred from a sender thread
+  to the main thread, one frame at a time. Latency is measured from the start of packing to the end of unpacking.
+*/
+
+// Local includes
+#include "PlusConfigure.h"
+#include "PlusIgtlGatherMessage.h"
+#include "PlusSharedMemoryFrameRing.h"
+#include "igtlPlusTrackedFrameMessage.h"
+
+// IGSIO includes
+#include <igsioTrackedFrame.h>
+#include <vtkIGSIOAccurateTimer.h>
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkMultiThreader.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// OpenIGTLink includes
+#include <igtlClientSocket.h>
+#include <igtlMessageHeader.h>
+#include <igtlServerSocket.h>
+#include <igtl_header.h>
+
+// STL includes
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace
+{
+  const int SOCKET_TIMEOUT_MSEC = 5000;
+  const double RECEIVE_TIMEOUT_SEC = 5.0;
+
+  enum TransportType
+  {
+    TRANSPORT_TCP,
+    TRANSPORT_SHARED_MEMORY
+  };
+
+  struct SenderData
+  {
+    TransportType Transport;
+    igsioTrackedFrame* TrackedFrame;
+    int NumberOfFrames;
+    igtl::ClientSocket::Pointer Socket;
+    PlusSharedMemoryFrameRing* Ring;
+    /*! Number of frames received by the main thread, the next frame is sent when the previous one is received */
+    std::atomic<int> NumberOfReceivedFrames;
+    std::atomic<int> NumberOfErrors;
+  };
+
+  struct Statistics
+  {
+    Statistics() : NumberOfFrames(0), NumberOfBytes(0), SumLatencySec(0), MaxLatencySec(0) {}
+    int NumberOfFrames;
+    igtlUint64 NumberOfBytes;
+    double SumLatencySec;
+    double MaxLatencySec;
+  };
+
+  //----------------------------------------------------------------------------
+  void CreateFrame(igsioTrackedFrame& trackedFrame, unsigned int width, unsigned int height, unsigned int depth)
+  {
+    FrameSizeType frameSize = { width, height, depth };
+    trackedFrame.GetImageData()->AllocateFrame(frameSize, VTK_UNSIGNED_CHAR, 1);
+    unsigned char* pixels = static_cast<unsigned char*>(trackedFrame.GetImageData()->GetScalarPointer());
+    size_t numberOfPixels = static_cast<size_t>(width) * height * depth;
+    for (size_t i = 0; i < numberOfPixels; ++i)
+    {
+      pixels[i] = static_cast<unsigned char>(i % 251);
+    }
+    for (int t = 0; t < 5; ++t)
+    {
+      vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+      matrix->SetElement(0, 3, t * 10.0);
+      igsioTransformName transformName(std::string("Tool") + igsioCommon::ToString<int>(t), "Tracker");
+      trackedFrame.SetFrameTransform(transformName, matrix);
+      trackedFrame.SetFrameTransformStatus(transformName, TOOL_OK);
+    }
+    trackedFrame.SetFrameField("Depth", "55");
+  }
+
+  //----------------------------------------------------------------------------
+  igtl::PlusTrackedFrameMessage::Pointer PackFrame(igsioTrackedFrame& trackedFrame)
+  {
+    igtl::PlusTrackedFrameMessage::Pointer message = igtl::PlusTrackedFrameMessage::New();
+    message->SetDeviceName("Frame");
+    message->SetFieldEncoding(igtl::PlusTrackedFrameMessage::FIELD_ENCODING_BINARY);
+    message->SetGatherImageData(true);
+    std::vector<igsioTransformName> transformNames;
+    trackedFrame.GetFrameTransformNameList(transformNames);
+    if (message->SetTrackedFrame(trackedFrame, transformNames) != PLUS_SUCCESS)
+    {
+      return NULL;
+    }
+    vtkSmartPointer<vtkMatrix4x4> identity = vtkSmartPointer<vtkMatrix4x4>::New();
+    message->SetEmbeddedImageTransform(identity);
+    message->Pack();
+    return message;
+  }
+
+  //----------------------------------------------------------------------------
+  void* SenderThread(vtkMultiThreader::ThreadInfo* threadInfo)
+  {
+    SenderData* data = static_cast<SenderData*>(threadInfo->UserData);
+    for (int frameIndex = 0; frameIndex < data->NumberOfFrames; ++frameIndex)
+    {
+      // Wait until the previous frame is received, so that latency does not include queueing
+      double waitStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
+      while (data->NumberOfReceivedFrames.load() < frameIndex)
+      {
+        if (data->NumberOfErrors.load() > 0 || vtkIGSIOAccurateTimer::GetSystemTime() - waitStartTime > RECEIVE_TIMEOUT_SEC)
+        {
+          return NULL;
+        }
+      }
+
+      // The frame timestamp is used for measuring the latency
+      data->TrackedFrame->SetTimestamp(vtkIGSIOAccurateTimer::GetSystemTime());
+      igtl::PlusTrackedFrameMessage::Pointer message = PackFrame(*data->TrackedFrame);
+      bool success = false;
+      if (message.IsNotNull())
+      {
+        if (data->Transport == TRANSPORT_TCP)
+        {
+          success = (PlusIgtlGatherMessage::Send(data->Socket, message) != 0);
+        }
+        else
+        {
+          success = (data->Ring->WriteMessage(message) == PLUS_SUCCESS);
+        }
+      }
+      if (!success)
+      {
+        LOG_ERROR("Failed to send frame " << frameIndex);
+        data->NumberOfErrors++;
+        return NULL;
+      }
+    }
+    return NULL;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus ReceiveFromSocket(igtl::ClientSocket* socket, igsioTrackedFrame& trackedFrame, igtlUint64& numberOfBytes)
+  {
+    igtl::MessageHeader::Pointer headerMsg = igtl::MessageHeader::New();
+    headerMsg->InitBuffer();
+    if (socket->Receive(headerMsg->GetBufferPointer(), headerMsg->GetBufferSize()) != headerMsg->GetBufferSize())
+    {
+      return PLUS_FAIL;
+    }
+    headerMsg->Unpack();
+    igtl::PlusTrackedFrameMessage::Pointer trackedFrameMsg = igtl::PlusTrackedFrameMessage::New();
+    trackedFrameMsg->SetMessageHeader(headerMsg);
+    trackedFrameMsg->AllocateBuffer();
+    if (socket->Receive(trackedFrameMsg->GetBufferBodyPointer(), trackedFrameMsg->GetBufferBodySize()) != trackedFrameMsg->GetBufferBodySize())
+    {
+      return PLUS_FAIL;
+    }
+    // CRC is not checked, the same as for the shared memory transport
+    if (!(trackedFrameMsg->Unpack(0) & igtl::MessageHeader::UNPACK_BODY))
+    {
+      return PLUS_FAIL;
+    }
+    trackedFrame = trackedFrameMsg->GetTrackedFrame();
+    numberOfBytes = trackedFrameMsg->GetBufferSize();
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus ReceiveFromRing(PlusSharedMemoryFrameRing& ring, igtlUint64 frameIndex, igsioTrackedFrame& trackedFrame, igtlUint64& numberOfBytes)
+  {
+    double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    while (ring.GetNumberOfWrittenFrames() <= frameIndex)
+    {
+      if (vtkIGSIOAccurateTimer::GetSystemTime() - startTime > RECEIVE_TIMEOUT_SEC)
+      {
+        return PLUS_FAIL;
+      }
+    }
+
+    // Same as vtkPlusOpenIGTLinkClient::ReadSharedMemoryFrame
+    PlusSharedMemoryFrameRing::FrameView view;
+    if (ring.BeginRead(frameIndex, view) != PLUS_SUCCESS || view.Size < IGTL_HEADER_SIZE)
+    {
+      return PLUS_FAIL;
+    }
+    igtl::MessageHeader::Pointer headerMsg = igtl::MessageHeader::New();
+    headerMsg->InitBuffer();
+    memcpy(headerMsg->GetBufferPointer(), view.Data, headerMsg->GetBufferSize());
+    headerMsg->Unpack();
+    igtl::PlusTrackedFrameMessage::Pointer trackedFrameMsg = igtl::PlusTrackedFrameMessage::New();
+    trackedFrameMsg->SetMessageHeader(headerMsg);
+    trackedFrameMsg->AllocateBuffer();
+    if (trackedFrameMsg->GetBufferSize() != view.Size)
+    {
+      return PLUS_FAIL;
+    }
+    memcpy(trackedFrameMsg->GetBufferBodyPointer(), static_cast<const unsigned char*>(view.Data) + headerMsg->GetBufferSize(), trackedFrameMsg->GetBufferBodySize());
+    if (!ring.EndRead(view))
+    {
+      LOG_ERROR("Frame " << frameIndex << " was overwritten while reading");
+      return PLUS_FAIL;
+    }
+    if (!(trackedFrameMsg->Unpack(0) & igtl::MessageHeader::UNPACK_BODY))
+    {
+      return PLUS_FAIL;
+    }
+    trackedFrame = trackedFrameMsg->GetTrackedFrame();
+    numberOfBytes = view.Size;
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus RunBenchmark(TransportType transport, igsioTrackedFrame& trackedFrame, int numberOfFrames, int port, const std::string& description)
+  {
+    SenderData senderData;
+    senderData.Transport = transport;
+    senderData.TrackedFrame = &trackedFrame;
+    senderData.NumberOfFrames = numberOfFrames;
+    senderData.Ring = NULL;
+    senderData.NumberOfReceivedFrames = 0;
+    senderData.NumberOfErrors = 0;
+
+    igtl::ServerSocket::Pointer serverSocket;
+    igtl::ClientSocket::Pointer receiverSocket;
+    PlusSharedMemoryFrameRing writerRing;
+    PlusSharedMemoryFrameRing readerRing;
+    if (transport == TRANSPORT_TCP)
+    {
+      serverSocket = igtl::ServerSocket::New();
+      receiverSocket = igtl::ClientSocket::New();
+      if (serverSocket->CreateServer(port) < 0 || receiverSocket->ConnectToServer("127.0.0.1", port) != 0)
+      {
+        LOG_ERROR(description << ": cannot create loopback connection on port " << port);
+        return PLUS_FAIL;
+      }
+      senderData.Socket = serverSocket->WaitForConnection(SOCKET_TIMEOUT_MSEC);
+      if (senderData.Socket.IsNull())
+      {
+        LOG_ERROR(description << ": client connection was not accepted");
+        return PLUS_FAIL;
+      }
+    }
+    else
+    {
+      // Room for the image and the message headers, transforms and fields
+      igtlUint64 slotSize = trackedFrame.GetImageData()->GetFrameSizeInBytes() + 1024 * 1024;
+      std::string segmentName = PlusSharedMemoryFrameRing::GenerateSegmentName("PlusTest", port);
+      if (writerRing.Create(segmentName, 4, slotSize) != PLUS_SUCCESS || readerRing.Open(segmentName) != PLUS_SUCCESS)
+      {
+        LOG_ERROR(description << ": cannot create shared memory ring");
+        return PLUS_FAIL;
+      }
+      senderData.Ring = &writerRing;
+    }
+
+    vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+    int senderThreadId = threader->SpawnThread((vtkThreadFunctionType)&SenderThread, &senderData);
+
+    Statistics statistics;
+    double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    for (int frameIndex = 0; frameIndex < numberOfFrames; ++frameIndex)
+    {
+      igsioTrackedFrame receivedFrame;
+      igtlUint64 numberOfBytes = 0;
+      PlusStatus status = (transport == TRANSPORT_TCP)
+                          ? ReceiveFromSocket(receiverSocket, receivedFrame, numberOfBytes)
+                          : ReceiveFromRing(readerRing, frameIndex, receivedFrame, numberOfBytes);
+      if (status != PLUS_SUCCESS)
+      {
+        LOG_ERROR(description << ": failed to receive frame " << frameIndex);
+        senderData.NumberOfErrors++;
+        break;
+      }
+      double latencySec = vtkIGSIOAccurateTimer::GetSystemTime() - receivedFrame.GetTimestamp();
+      if (frameIndex == 0
+          && (receivedFrame.GetImageData()->GetFrameSizeInBytes() != trackedFrame.GetImageData()->GetFrameSizeInBytes()
+              || memcmp(receivedFrame.GetImageData()->GetScalarPointer(), trackedFrame.GetImageData()->GetScalarPointer(), trackedFrame.GetImageData()->GetFrameSizeInBytes()) != 0
+              || receivedFrame.GetFrameField("Depth") != "55"))
+      {
+        LOG_ERROR(description << ": received frame does not match the sent frame");
+        senderData.NumberOfErrors++;
+        break;
+      }
+      statistics.NumberOfFrames++;
+      statistics.NumberOfBytes += numberOfBytes;
+      statistics.SumLatencySec += latencySec;
+      statistics.MaxLatencySec = std::max(statistics.MaxLatencySec, latencySec);
+      senderData.NumberOfReceivedFrames++;
+    }
+    double elapsedTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTime;
+
+    if (senderData.NumberOfErrors.load() > 0 && senderData.Socket.IsNotNull())
+    {
+      // Unblock the sender
+      senderData.Socket->CloseSocket();
+    }
+    threader->TerminateThread(senderThreadId);
+
+    if (transport == TRANSPORT_TCP)
+    {
+      senderData.Socket->CloseSocket();
+      receiverSocket->CloseSocket();
+      serverSocket->CloseSocket();
+    }
+    readerRing.Close();
+    writerRing.Close();
+
+    if (senderData.NumberOfErrors.load() > 0 || statistics.NumberOfFrames != numberOfFrames)
+    {
+      return PLUS_FAIL;
+    }
+
+    LOG_INFO(description << ": " << statistics.NumberOfBytes / statistics.NumberOfFrames << " bytes/frame"
+             << ", latency mean: " << statistics.SumLatencySec / statistics.NumberOfFrames * 1000.0 << " ms"
+             << ", max: " << statistics.MaxLatencySec * 1000.0 << " ms"
+             << ", " << statistics.NumberOfFrames / elapsedTimeSec << " frames/s"
+             << ", " << statistics.NumberOfBytes / elapsedTimeSec / (1024.0 * 1024.0) << " MB/s");
+    return PLUS_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  bool printHelp(false);
+  int numberOfFrames(100);
+  int port(18951);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--frames", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfFrames, "Number of frames to transfer in each run (default: 100)");
+  args.AddArgument("--port", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &port, "Loopback port used for the TCP runs (default: 18951)");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (printHelp)
+  {
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  if (numberOfFrames < 1)
+  {
+    LOG_ERROR("Number of frames must be positive");
+    exit(EXIT_FAILURE);
+  }
+
+  igsioTrackedFrame imageFrame;
+  CreateFrame(imageFrame, 640, 480, 1);
+  igsioTrackedFrame volumeFrame;
+  CreateFrame(volumeFrame, 128, 128, 128);
+
+  int numberOfErrors = 0;
+  if (RunBenchmark(TRANSPORT_TCP, imageFrame, numberOfFrames, port, "640x480 image, loopback TCP") != PLUS_SUCCESS)
+  {
+    numberOfErrors++;
+  }
+  if (RunBenchmark(TRANSPORT_SHARED_MEMORY, imageFrame, numberOfFrames, port, "640x480 image, shared memory") != PLUS_SUCCESS)
+  {
+    numberOfErrors++;
+  }
+  if (RunBenchmark(TRANSPORT_TCP, volumeFrame, numberOfFrames, port, "128x128x128 volume, loopback TCP") != PLUS_SUCCESS)
+  {
+    numberOfErrors++;
+  }
+  if (RunBenchmark(TRANSPORT_SHARED_MEMORY, volumeFrame, numberOfFrames, port, "128x128x128 volume, shared memory") != PLUS_SUCCESS)
+  {
+    numberOfErrors++;
+  }
+
+  if (numberOfErrors > 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully");
+  return EXIT_SUCCESS;
+}
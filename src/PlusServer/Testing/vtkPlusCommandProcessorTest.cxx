@@ -0,0 +1,324 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file vtkPlusCommandProcessorTest.cxx
+  \brief Tests concurrent command execution by vtkPlusCommandProcessor worker threads
+
+  Commands with the same execution key must be executed in order, one at a time. Commands with different
+  keys must not wait for each other, and fast commands must not wait for slow commands even if all
+  the worker threads are busy.
+
+  "Slow" commands block on a gate that the test opens explicitly, and the order of execution is recorded
+  with sequence numbers, so the results do not depend on timing or on the load of the machine.
+*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusCommand.h"
+#include "vtkPlusCommandProcessor.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+namespace
+{
+  /*! Timeout of waiting for an expected event. Only reached if the test fails. */
+  const double EVENT_TIMEOUT_SEC = 30.0;
+
+  struct ExecutionRecord
+  {
+    ExecutionRecord() : StartSequence(-1), EndSequence(-1) {}
+    int StartSequence;
+    int EndSequence;
+  };
+
+  std::mutex ExecutionLogMutex;
+  std::condition_variable ExecutionLogCondition;
+  std::map<std::string, ExecutionRecord> ExecutionLog;
+  std::set<std::string> OpenGates;
+  int NextSequence = 0;
+
+  //----------------------------------------------------------------------------
+  void OpenGate(const std::string& gate)
+  {
+    {
+      std::lock_guard<std::mutex> lock(ExecutionLogMutex);
+      OpenGates.insert(gate);
+    }
+    ExecutionLogCondition.notify_all();
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Wait until the command has started (or completed, if waitForCompletion is true) */
+  bool WaitForCommand(const std::string& tag, bool waitForCompletion)
+  {
+    std::unique_lock<std::mutex> lock(ExecutionLogMutex);
+    bool reached = ExecutionLogCondition.wait_for(lock, std::chrono::duration<double>(EVENT_TIMEOUT_SEC), [&]
+    {
+      std::map<std::string, ExecutionRecord>::iterator it = ExecutionLog.find(tag);
+      return it != ExecutionLog.end() && (waitForCompletion ? it->second.EndSequence : it->second.StartSequence) >= 0;
+    });
+    if (!reached)
+    {
+      LOG_ERROR("Command " << tag << " was not " << (waitForCompletion ? "completed" : "started"));
+    }
+    return reached;
+  }
+
+  //----------------------------------------------------------------------------
+  bool IsStarted(const std::string& tag)
+  {
+    std::lock_guard<std::mutex> lock(ExecutionLogMutex);
+    return ExecutionLog.count(tag) > 0;
+  }
+}
+
+//----------------------------------------------------------------------------
+/*! Command that records when it was executed. If a gate is specified then it blocks until the gate is opened. */
+class vtkPlusTestGateCommand : public vtkPlusCommand
+{
+public:
+  static vtkPlusTestGateCommand* New();
+  vtkTypeMacro(vtkPlusTestGateCommand, vtkPlusCommand);
+  virtual vtkPlusCommand* Clone() { return New(); }
+
+  virtual PlusStatus Execute()
+  {
+    std::unique_lock<std::mutex> lock(ExecutionLogMutex);
+    ExecutionLog[this->Tag].StartSequence = NextSequence++;
+    ExecutionLogCondition.notify_all();
+    if (!this->Gate.empty())
+    {
+      if (!ExecutionLogCondition.wait_for(lock, std::chrono::duration<double>(EVENT_TIMEOUT_SEC), [&] { return OpenGates.count(this->Gate) > 0; }))
+      {
+        LOG_ERROR("Gate " << this->Gate << " was not opened for command " << this->Tag);
+      }
+    }
+    ExecutionLog[this->Tag].EndSequence = NextSequence++;
+    ExecutionLogCondition.notify_all();
+    lock.unlock();
+
+    this->QueueCommandResponse(PLUS_SUCCESS, this->Tag);
+    return PLUS_SUCCESS;
+  }
+
+  virtual PlusStatus ReadConfiguration(vtkXMLDataElement* aConfig)
+  {
+    if (vtkPlusCommand::ReadConfiguration(aConfig) != PLUS_SUCCESS)
+    {
+      return PLUS_FAIL;
+    }
+    XML_READ_STRING_ATTRIBUTE_OPTIONAL(Tag, aConfig);
+    XML_READ_STRING_ATTRIBUTE_OPTIONAL(ExecutionKey, aConfig);
+    XML_READ_STRING_ATTRIBUTE_OPTIONAL(Gate, aConfig);
+    XML_READ_BOOL_ATTRIBUTE_OPTIONAL(Fast, aConfig);
+    return PLUS_SUCCESS;
+  }
+
+  virtual void GetCommandNames(std::list<std::string>& cmdNames)
+  {
+    cmdNames.clear();
+    cmdNames.push_back("TestGate");
+  }
+
+  virtual std::string GetDescription(const std::string& commandName) { return "TestGate: wait until Gate is opened by the test"; }
+
+  virtual std::string GetExecutionKey() { return this->ExecutionKey; }
+  virtual bool IsFastCommand() { return this->Fast; }
+
+  vtkSetStdStringMacro(Tag);
+  vtkSetStdStringMacro(ExecutionKey);
+  vtkSetStdStringMacro(Gate);
+  vtkSetMacro(Fast, bool);
+
+protected:
+  vtkPlusTestGateCommand() : Fast(false) {}
+
+  std::string Tag;
+  std::string ExecutionKey;
+  std::string Gate;
+  bool Fast;
+};
+
+vtkStandardNewMacro(vtkPlusTestGateCommand);
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  PlusStatus QueueGateCommand(vtkPlusCommandProcessor* processor, const std::string& tag, const std::string& executionKey, const std::string& gate, bool fast)
+  {
+    std::ostringstream commandStr;
+    commandStr << "<Command Name=\"TestGate\" Tag=\"" << tag << "\" ExecutionKey=\"" << executionKey
+               << "\" Gate=\"" << gate << "\" Fast=\"" << (fast ? "TRUE" : "FALSE") << "\" />";
+    static uint32_t uid = 0;
+    return processor->QueueCommand(true, 1, "TestGate", commandStr.str(), "CMD_" + tag, ++uid, igtl::MessageBase::MetaDataMap());
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus WaitForResponses(vtkPlusCommandProcessor* processor, unsigned int numberOfResponses)
+  {
+    PlusCommandResponseList responses;
+    double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+    while (responses.size() < numberOfResponses)
+    {
+      processor->PopCommandResponses(responses);
+      if (vtkIGSIOAccurateTimer::GetSystemTime() - startTime > EVENT_TIMEOUT_SEC)
+      {
+        LOG_ERROR("Received " << responses.size() << " command responses, expected " << numberOfResponses);
+        return PLUS_FAIL;
+      }
+      vtkIGSIOAccurateTimer::Delay(0.01);
+    }
+    return PLUS_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Returns true if command 'first' completed before command 'second' started */
+  bool ExecutedBefore(const std::string& first, const std::string& second)
+  {
+    std::lock_guard<std::mutex> lock(ExecutionLogMutex);
+    if (ExecutionLog.count(first) == 0 || ExecutionLog.count(second) == 0)
+    {
+      LOG_ERROR("Command " << (ExecutionLog.count(first) == 0 ? first : second) << " was not executed");
+      return false;
+    }
+    return ExecutionLog[first].EndSequence < ExecutionLog[second].StartSequence;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp(false);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (printHelp)
+  {
+    std::cout << "\nHelp:" << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  int numberOfErrors = 0;
+
+  vtkSmartPointer<vtkPlusCommandProcessor> processor = vtkSmartPointer<vtkPlusCommandProcessor>::New();
+  processor->RegisterPlusCommand(vtkSmartPointer<vtkPlusTestGateCommand>::New());
+  processor->SetNumberOfWorkerThreads(2);
+  if (processor->Start() != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to start command processor");
+    return EXIT_FAILURE;
+  }
+
+  // Commands for the same device are executed in order, other devices are not blocked
+  LOG_INFO("Testing execution keys...");
+  QueueGateCommand(processor, "A1", "DeviceA", "GateA", false);
+  QueueGateCommand(processor, "A2", "DeviceA", "", false);
+  QueueGateCommand(processor, "B1", "DeviceB", "", false);
+  QueueGateCommand(processor, "B2", "DeviceB", "", false);
+  // A1 is blocked until GateA is opened, B1 and B2 must complete meanwhile
+  if (!WaitForCommand("A1", false) || !WaitForCommand("B2", true))
+  {
+    LOG_ERROR("Commands for DeviceB were blocked by a slow command for DeviceA");
+    numberOfErrors++;
+  }
+  if (IsStarted("A2"))
+  {
+    LOG_ERROR("Command A2 was started while A1 with the same execution key was still running");
+    numberOfErrors++;
+  }
+  OpenGate("GateA");
+  if (WaitForResponses(processor, 4) != PLUS_SUCCESS)
+  {
+    numberOfErrors++;
+  }
+  else
+  {
+    if (!ExecutedBefore("A1", "A2"))
+    {
+      LOG_ERROR("Commands with the same execution key were not executed in order (A1, A2)");
+      numberOfErrors++;
+    }
+    if (!ExecutedBefore("B1", "B2"))
+    {
+      LOG_ERROR("Commands with the same execution key were not executed in order (B1, B2)");
+      numberOfErrors++;
+    }
+  }
+
+  // Fast commands are executed even if all the workers are busy
+  LOG_INFO("Testing fast lane...");
+  QueueGateCommand(processor, "C1", "DeviceC", "GateCD", false);
+  QueueGateCommand(processor, "D1", "DeviceD", "GateCD", false);
+  // Both workers are busy once C1 and D1 have started
+  if (!WaitForCommand("C1", false) || !WaitForCommand("D1", false))
+  {
+    numberOfErrors++;
+  }
+  QueueGateCommand(processor, "E1", "DeviceE", "", false);
+  QueueGateCommand(processor, "F1", "", "", true);
+  if (!WaitForCommand("F1", true))
+  {
+    LOG_ERROR("Fast command was blocked by slow commands");
+    numberOfErrors++;
+  }
+  if (IsStarted("E1"))
+  {
+    LOG_ERROR("Slow command was expected to wait for a free worker");
+    numberOfErrors++;
+  }
+  OpenGate("GateCD");
+  if (WaitForResponses(processor, 4) != PLUS_SUCCESS)
+  {
+    numberOfErrors++;
+  }
+
+  processor->Stop();
+
+  // Without worker threads the commands are executed by ExecuteCommands, in the order they were queued
+  LOG_INFO("Testing execution from the main thread...");
+  QueueGateCommand(processor, "G1", "DeviceG", "", false);
+  QueueGateCommand(processor, "H1", "", "", true);
+  int numberOfExecutedCommands = processor->ExecuteCommands();
+  if (numberOfExecutedCommands != 2 || !ExecutedBefore("G1", "H1"))
+  {
+    LOG_ERROR("Main thread command execution failed (executed " << numberOfExecutedCommands << " commands)");
+    numberOfErrors++;
+  }
+
+  if (numberOfErrors > 0)
+  {
+    LOG_ERROR("Test failed with " << numberOfErrors << " errors");
+    return EXIT_FAILURE;
+  }
+
+  LOG_INFO("Test completed successfully");
+  return EXIT_SUCCESS;
+}
@@ -267,6 +267,24 @@ PlusStatus ExecuteGetSnapshotReconstruction(vtkPlusOpenIGTLinkClient* client, co
   return client->SendCommand(cmd);
 }
 
+//----------------------------------------------------------------------------
+PlusStatus ExecuteGetUpdateReconstruction(vtkPlusOpenIGTLinkClient* client, const std::string& deviceId, const std::string& outputImageName, int commandId)
+{
+  vtkSmartPointer<vtkPlusReconstructVolumeCommand> cmd = vtkSmartPointer<vtkPlusReconstructVolumeCommand>::New();
+  cmd->SetNameToGetUpdate();
+  cmd->SetId(commandId);
+  if (!deviceId.empty())
+  {
+    cmd->SetVolumeReconstructorDeviceId(deviceId.c_str());
+  }
+  if (!outputImageName.empty())
+  {
+    cmd->SetOutputVolDeviceName(outputImageName.c_str());
+  }
+  PrintCommand(cmd);
+  return client->SendCommand(cmd);
+}
+
 //----------------------------------------------------------------------------
 PlusStatus ExecuteStopReconstruction(vtkPlusOpenIGTLinkClient* client, const std::string& deviceId, const std::string& outputFilename, const std::string& outputImageName, int commandId)
 {
@@ -776,7 +794,7 @@ int main(int argc, char** argv)
   args.AddArgument("--host", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &serverHost, "Host name of the OpenIGTLink server (default: 127.0.0.1)");
   args.AddArgument("--port", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &serverPort, "Port address of the OpenIGTLink server (default: 18944)");
   args.AddArgument("--command", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &command,
-                   "Command name to be executed on the server (START_ACQUISITION, STOP_ACQUISITION, SUSPEND_ACQUISITION, RESUME_ACQUISITION, RECONSTRUCT, START_RECONSTRUCTION, SUSPEND_RECONSTRUCTION, RESUME_RECONSTRUCTION, STOP_RECONSTRUCTION, GET_RECONSTRUCTION_SNAPSHOT, GET_CHANNEL_IDS, GET_DEVICE_IDS, GET_EXAM_DATA, SAVE_RAW_DATA, SEND_TEXT, UPDATE_TRANSFORM, GET_TRANSFORM, GET_POINT)");
+                   "Command name to be executed on the server (START_ACQUISITION, STOP_ACQUISITION, SUSPEND_ACQUISITION, RESUME_ACQUISITION, RECONSTRUCT, START_RECONSTRUCTION, SUSPEND_RECONSTRUCTION, RESUME_RECONSTRUCTION, STOP_RECONSTRUCTION, GET_RECONSTRUCTION_SNAPSHOT, GET_RECONSTRUCTION_UPDATE, GET_CHANNEL_IDS, GET_DEVICE_IDS, GET_EXAM_DATA, SAVE_RAW_DATA, SEND_TEXT, UPDATE_TRANSFORM, GET_TRANSFORM, GET_POINT)");
   args.AddArgument("--command-id", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &commandId, "Command ID to send to the server.");
   args.AddArgument("--server-igtl-version", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &serverHeaderVersion, "The version of IGTL used by the server. Remove this parameter when querying is dynamic.");
   args.AddArgument("--device", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &deviceId, "ID of the controlled device (optional, default: first VirtualStreamCapture or VirtualVolumeReconstructor device). In case of GET_DEVICE_IDS it is not an ID but a device type.");
@@ -887,6 +905,10 @@ int main(int argc, char** argv)
     {
       commandExecutionStatus = ExecuteGetSnapshotReconstruction(client, deviceId, outputFilename, outputImageName, commandId);
     }
+    else if (igsioCommon::IsEqualInsensitive(command, "GET_RECONSTRUCTION_UPDATE"))
+    {
+      commandExecutionStatus = ExecuteGetUpdateReconstruction(client, deviceId, outputImageName, commandId);
+    }
     else if (igsioCommon::IsEqualInsensitive(command, "STOP_RECONSTRUCTION"))
     {
       commandExecutionStatus = ExecuteStopReconstruction(client, deviceId, outputFilename, outputImageName, commandId);
@@ -6,6 +6,7 @@ See License.txt for details.
 
 // Local includes
 #include "PlusConfigure.h"
+#include "PlusMetricsRegistry.h"
 #include "vtkIGSIORecursiveCriticalSection.h"
 #include "vtkPlusCommandProcessor.h"
 
@@ -23,6 +24,7 @@ See License.txt for details.
   #include "vtkPlusConoProbeLinkCommand.h"
 #endif
 #include "vtkPlusAddRecordingDeviceCommand.h"
+#include "vtkPlusGetMetricsCommand.h"
 #include "vtkPlusGetPolydataCommand.h"
 #include "vtkPlusGetTransformCommand.h"
 #include "vtkPlusGetUsParameterCommand.h"
@@ -30,6 +32,7 @@ See License.txt for details.
 #include "vtkPlusSaveConfigCommand.h"
 #include "vtkPlusSendTextCommand.h"
 #include "vtkPlusSetUsParameterCommand.h"
+#include "vtkPlusSharedMemoryTransportCommand.h"
 #include "vtkPlusStartStopRecordingCommand.h"
 #include "vtkPlusUpdateTransformCommand.h"
 #include "vtkPlusVersionCommand.h"
@@ -50,13 +53,14 @@ vtkPlusCommandProcessor::vtkPlusCommandProcessor()
   : PlusServer(NULL)
   , Threader(vtkSmartPointer<vtkMultiThreader>::New())
   , Mutex(vtkSmartPointer<vtkIGSIORecursiveCriticalSection>::New())
-  , CommandExecutionActive(std::make_pair(false, false))
-  , CommandExecutionThreadId(-1)
+  , CommandExecutionActive(false)
+  , NumberOfWorkerThreads(4)
 {
   // Register default commands
   RegisterPlusCommand(vtkSmartPointer<vtkPlusGetImageCommand>::New());
   RegisterPlusCommand(vtkSmartPointer<vtkPlusGetPolydataCommand>::New());
   RegisterPlusCommand(vtkSmartPointer<vtkPlusGetTransformCommand>::New());
+  RegisterPlusCommand(vtkSmartPointer<vtkPlusGetMetricsCommand>::New());
   RegisterPlusCommand(vtkSmartPointer<vtkPlusReconstructVolumeCommand>::New());
   RegisterPlusCommand(vtkSmartPointer<vtkPlusRequestIdsCommand>::New());
   RegisterPlusCommand(vtkSmartPointer<vtkPlusSaveConfigCommand>::New());
@@ -67,6 +71,7 @@ vtkPlusCommandProcessor::vtkPlusCommandProcessor()
   RegisterPlusCommand(vtkSmartPointer<vtkPlusSetUsParameterCommand>::New());
   RegisterPlusCommand(vtkSmartPointer<vtkPlusGetUsParameterCommand>::New());
   RegisterPlusCommand(vtkSmartPointer<vtkPlusAddRecordingDeviceCommand>::New());
+  RegisterPlusCommand(vtkSmartPointer<vtkPlusSharedMemoryTransportCommand>::New());
 #ifdef PLUS_USE_STEALTHLINK
   RegisterPlusCommand(vtkSmartPointer<vtkPlusStealthLinkCommand>::New());
 #endif
@@ -81,6 +86,7 @@ vtkPlusCommandProcessor::vtkPlusCommandProcessor()
 //----------------------------------------------------------------------------
 vtkPlusCommandProcessor::~vtkPlusCommandProcessor()
 {
+  this->Stop();
   SetPlusServer(NULL);
 }
 
@@ -98,30 +104,60 @@ void vtkPlusCommandProcessor::PrintSelf(ostream& os, vtkIndent indent)
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusCommandProcessor::Start()
 {
-  if (this->CommandExecutionThreadId < 0)
+  if (!this->CommandExecutionThreadIds.empty())
   {
-    this->CommandExecutionActive.first = true;
-    this->CommandExecutionThreadId = this->Threader->SpawnThread((vtkThreadFunctionType)&CommandExecutionThread, this);
+    return PLUS_SUCCESS;
   }
+
+  {
+    std::lock_guard<std::mutex> queueLock(this->QueueMutex);
+    this->CommandExecutionActive = true;
+  }
+  for (int i = 0; i < this->NumberOfWorkerThreads; ++i)
+  {
+    int threadId = this->Threader->SpawnThread((vtkThreadFunctionType)&CommandExecutionThread, this);
+    if (threadId < 0)
+    {
+      LOG_ERROR("Failed to start command execution thread");
+      this->Stop();
+      return PLUS_FAIL;
+    }
+    this->CommandExecutionThreadIds.push_back(threadId);
+  }
+  int fastThreadId = this->Threader->SpawnThread((vtkThreadFunctionType)&FastCommandExecutionThread, this);
+  if (fastThreadId < 0)
+  {
+    LOG_ERROR("Failed to start fast command execution thread");
+    this->Stop();
+    return PLUS_FAIL;
+  }
+  this->CommandExecutionThreadIds.push_back(fastThreadId);
+
+  LOG_DEBUG("Command execution started with " << this->NumberOfWorkerThreads << " worker threads and a fast lane thread");
   return PLUS_SUCCESS;
 }
 
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusCommandProcessor::Stop()
 {
-  // Stop the command execution thread
-  if (this->CommandExecutionThreadId >= 0)
   {
-    this->CommandExecutionActive.first = false;
-    while (this->CommandExecutionActive.second)
-    {
-      // Wait until the thread stops
-      vtkIGSIOAccurateTimer::Delay(0.2);
-    }
-    this->CommandExecutionThreadId = -1;
+    std::lock_guard<std::mutex> queueLock(this->QueueMutex);
+    this->CommandExecutionActive = false;
+  }
+  if (this->CommandExecutionThreadIds.empty())
+  {
+    return PLUS_SUCCESS;
+  }
+  this->QueueCondition.notify_all();
+
+  // Wait until the threads complete the commands that they are executing
+  for (std::vector<int>::iterator it = this->CommandExecutionThreadIds.begin(); it != this->CommandExecutionThreadIds.end(); ++it)
+  {
+    this->Threader->TerminateThread(*it);
   }
+  this->CommandExecutionThreadIds.clear();
 
-  LOG_DEBUG("Command execution thread stopped");
+  LOG_DEBUG("Command execution threads stopped");
 
   return PLUS_SUCCESS;
 }
@@ -130,63 +166,162 @@ PlusStatus vtkPlusCommandProcessor::Stop()
 void* vtkPlusCommandProcessor::CommandExecutionThread(vtkMultiThreader::ThreadInfo* data)
 {
   vtkPlusCommandProcessor* self = (vtkPlusCommandProcessor*)(data->UserData);
+  self->RunCommandExecutionLoop(false);
+  return NULL;
+}
 
-  self->CommandExecutionActive.second = true;
+//----------------------------------------------------------------------------
+void* vtkPlusCommandProcessor::FastCommandExecutionThread(vtkMultiThreader::ThreadInfo* data)
+{
+  vtkPlusCommandProcessor* self = (vtkPlusCommandProcessor*)(data->UserData);
+  self->RunCommandExecutionLoop(true);
+  return NULL;
+}
 
-  // Execute commands until a stop is requested
-  while (self->CommandExecutionActive.first)
+//----------------------------------------------------------------------------
+void vtkPlusCommandProcessor::RunCommandExecutionLoop(bool fastCommandsOnly)
+{
+  while (true)
   {
-    self->ExecuteCommands();
-    // no commands in the queue, wait a bit before checking again
-    const double commandQueuePollIntervalSec = 0.010;
-#ifdef _WIN32
-    Sleep(commandQueuePollIntervalSec * 1000);
-#else
-    usleep(commandQueuePollIntervalSec * 1000000);
-#endif
+    QueuedCommand command;
+    {
+      std::unique_lock<std::mutex> queueLock(this->QueueMutex);
+      // Sleep until a command can be executed or a stop is requested
+      while (this->CommandExecutionActive && !this->TakeNextCommand(fastCommandsOnly, command))
+      {
+        this->QueueCondition.wait(queueLock);
+      }
+      if (!this->CommandExecutionActive)
+      {
+        return;
+      }
+    }
+    this->ExecuteQueuedCommand(command);
   }
-
-  // Close thread
-  self->CommandExecutionThreadId = -1;
-  self->CommandExecutionActive.second = false;
-  return NULL;
 }
 
 //----------------------------------------------------------------------------
 int vtkPlusCommandProcessor::ExecuteCommands()
 {
+  if (this->IsRunning())
+  {
+    // Commands are executed by the worker threads
+    return 0;
+  }
+
   // Implemented in a while loop to not block the mutex during command execution, only during management of the queue.
   int numberOfExecutedCommands(0);
   while (1)
   {
-    vtkSmartPointer<vtkPlusCommand> cmd; // next command to be processed
+    QueuedCommand command; // next command to be processed
     {
-      igsioLockGuard<vtkIGSIORecursiveCriticalSection> updateMutexGuardedLock(this->Mutex);
-      if (this->CommandQueue.empty())
+      std::lock_guard<std::mutex> queueLock(this->QueueMutex);
+      if (!this->TakeNextCommand(false, command))
       {
         return numberOfExecutedCommands;
       }
-      cmd = this->CommandQueue.front();
-      this->CommandQueue.pop_front();
     }
 
-    LOG_DEBUG("Executing command");
-    if (cmd->Execute() != PLUS_SUCCESS)
+    this->ExecuteQueuedCommand(command);
+    numberOfExecutedCommands++;
+  }
+
+  // we never actually reach this point
+  return numberOfExecutedCommands;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusCommandProcessor::AddCommandToQueue(vtkPlusCommand* cmd)
+{
+  QueuedCommand command;
+  command.Command = cmd;
+  command.ExecutionKey = cmd->GetExecutionKey();
+  command.Fast = cmd->IsFastCommand();
+  command.QueueTime = PlusMetricsRegistry::GetMonotonicTime();
+  {
+    std::lock_guard<std::mutex> queueLock(this->QueueMutex);
+    this->CommandQueue.push_back(command);
+  }
+  // Notify all threads, as the fast lane thread may not be able to execute the command
+  this->QueueCondition.notify_all();
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusCommandProcessor::TakeNextCommand(bool fastCommandsOnly, QueuedCommand& command)
+{
+  // Keys of the commands that are skipped: later commands with the same key must wait for them
+  std::set<std::string> skippedExecutionKeys;
+  for (std::list<QueuedCommand>::iterator it = this->CommandQueue.begin(); it != this->CommandQueue.end(); ++it)
+  {
+    const std::string& key = it->ExecutionKey;
+    bool keyAvailable = key.empty() || (this->ActiveExecutionKeys.count(key) == 0 && skippedExecutionKeys.count(key) == 0);
+    if (keyAvailable && (it->Fast || !fastCommandsOnly))
     {
-      LOG_ERROR("Command execution failed");
+      command = *it;
+      this->CommandQueue.erase(it);
+      if (!key.empty())
+      {
+        this->ActiveExecutionKeys.insert(key);
+      }
+      return true;
     }
-
-    // move the response objects from the command to the processor's queue
+    if (!key.empty())
     {
-      igsioLockGuard<vtkIGSIORecursiveCriticalSection> updateMutexGuardedLock(this->Mutex);
-      cmd->PopCommandResponses(this->CommandResponseQueue);
+      skippedExecutionKeys.insert(key);
     }
+  }
+  return false;
+}
 
-    numberOfExecutedCommands++;
+//----------------------------------------------------------------------------
+void vtkPlusCommandProcessor::ExecuteQueuedCommand(QueuedCommand& command)
+{
+  vtkPlusCommand* cmd = command.Command;
+
+  PlusMetricsRegistry::LabelMap labels;
+  labels["command"] = cmd->GetName();
+  PlusMetricsRegistry* metrics = PlusMetricsRegistry::GetInstance();
+  double executionStartTime = PlusMetricsRegistry::GetMonotonicTime();
+  PlusLatencyHistogram* queueWaitHistogram = metrics->GetHistogram("plus_command_queue_wait_seconds", labels, "Time commands spent in the queue before execution");
+  if (queueWaitHistogram != NULL)
+  {
+    queueWaitHistogram->RecordValue(executionStartTime - command.QueueTime);
   }
 
-  // we never actually reach this point
-  return numberOfExecutedCommands;
+  LOG_DEBUG("Executing command " << cmd->GetName());
+  if (cmd->Execute() != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Command execution failed");
+  }
+
+  PlusLatencyHistogram* executionHistogram = metrics->GetHistogram("plus_command_execution_seconds", labels, "Time spent with command execution");
+  if (executionHistogram != NULL)
+  {
+    executionHistogram->RecordValue(PlusMetricsRegistry::GetMonotonicTime() - executionStartTime);
+  }
+
+  // move the response objects from the command to the processor's queue
+  {
+    igsioLockGuard<vtkIGSIORecursiveCriticalSection> updateMutexGuardedLock(this->Mutex);
+    cmd->PopCommandResponses(this->CommandResponseQueue);
+  }
+
+  // Allow execution of the next command with the same key
+  if (!command.ExecutionKey.empty())
+  {
+    {
+      std::lock_guard<std::mutex> queueLock(this->QueueMutex);
+      this->ActiveExecutionKeys.erase(command.ExecutionKey);
+    }
+    this->QueueCondition.notify_all();
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkPlusCommandProcessor::GetNumberOfQueuedCommands()
+{
+  std::lock_guard<std::mutex> queueLock(this->QueueMutex);
+  return static_cast<int>(this->CommandQueue.size());
 }
 
 //----------------------------------------------------------------------------
@@ -285,8 +420,7 @@ PlusStatus vtkPlusCommandProcessor::QueueCommand(bool respondUsingIGTLCommand, u
   cmd->SetRespondWithCommandMessage(respondUsingIGTLCommand);
 
   // Add command to the execution queue
-  igsioLockGuard<vtkIGSIORecursiveCriticalSection> updateMutexGuardedLock(this->Mutex);
-  this->CommandQueue.push_back(cmd);
+  this->AddCommandToQueue(cmd);
 
   return PLUS_SUCCESS;
 }
@@ -343,11 +477,8 @@ PlusStatus vtkPlusCommandProcessor::QueueGetImageMetaData(unsigned int clientId,
   cmdGetImage->SetDeviceName(deviceName.c_str());
   cmdGetImage->SetNameToGetImageMeta();
   cmdGetImage->SetImageId(deviceName.c_str());
-  {
-    // Add command to the execution queue
-    igsioLockGuard<vtkIGSIORecursiveCriticalSection> updateMutexGuardedLock(this->Mutex);
-    this->CommandQueue.push_back(cmdGetImage);
-  }
+  // Add command to the execution queue
+  this->AddCommandToQueue(cmdGetImage);
   return PLUS_SUCCESS;
 }
 
@@ -360,11 +491,8 @@ PlusStatus vtkPlusCommandProcessor::QueueGetImage(unsigned int clientId, const s
   cmdGetImage->SetDeviceName(deviceName.c_str());
   cmdGetImage->SetNameToGetImage();
   cmdGetImage->SetImageId(deviceName.c_str());
-  {
-    // Add command to the execution queue
-    igsioLockGuard<vtkIGSIORecursiveCriticalSection> updateMutexGuardedLock(this->Mutex);
-    this->CommandQueue.push_back(cmdGetImage);
-  }
+  // Add command to the execution queue
+  this->AddCommandToQueue(cmdGetImage);
   return PLUS_SUCCESS;
 }
 
@@ -381,6 +509,7 @@ void vtkPlusCommandProcessor::PopCommandResponses(PlusCommandResponseList& respo
 //------------------------------------------------------------------------------
 bool vtkPlusCommandProcessor::IsRunning()
 {
-  return this->CommandExecutionActive.second;
+  std::lock_guard<std::mutex> queueLock(this->QueueMutex);
+  return this->CommandExecutionActive;
 }
 
@@ -14,6 +14,11 @@
 #include "vtkPlusCommand.h"
 #include "vtkPlusCommandResponse.h"
 #include "vtkPlusOpenIGTLinkServer.h"
+
+// STL includes
+#include <condition_variable>
+#include <mutex>
+#include <set>
 #include <string>
 
 class vtkImageData;
@@ -23,9 +28,15 @@ class vtkMatrix4x4;
   \class vtkPlusCommandProcessor
   \brief Creates a PlusCommand from a string.
   If the commands are to be executed on the main thread then call ExecuteCommands() periodically from the main thread.
-  If the commands are to be executed on a separate thread (to allow background processing, but maybe requiring more synchronization) call Start() to start an internal processing thread.
-  Probably one of the processing models would be enough, but at this point it's not clear which one is better.
-  TODO: keep only one method and remove the other approach completely once the processing model decision is finalized.
+  If the commands are to be executed on separate threads (to allow background processing, but requiring more synchronization) call Start() to start
+  a pool of worker threads.
+
+  Worker threads execute commands concurrently, but commands that have the same execution key (see vtkPlusCommand::GetExecutionKey)
+  are always executed one at a time, in the order they were queued. Commands that are cheap to execute (see vtkPlusCommand::IsFastCommand)
+  are also executed by a dedicated fast lane thread, so that they are not delayed by long-running commands occupying all the workers.
+
+  Time spent by commands in the queue and with execution is recorded per command name in the plus_command_queue_wait_seconds
+  and plus_command_execution_seconds histograms of PlusMetricsRegistry.
   \ingroup PlusLibPlusServer
 */
 class vtkPlusServerExport vtkPlusCommandProcessor : public vtkObject
@@ -36,20 +47,28 @@ public:
   virtual void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
 
   /*!
-    Execute all commands in the queue from the current thread (useful if commands should be executed from the main thread)
+    Execute all commands in the queue from the current thread (useful if commands should be executed from the main thread).
+    Does nothing if the worker threads are running.
     \return Number of executed commands
   */
   int ExecuteCommands();
 
-  /*! Start thread for processing the commands in the queue. Must be called from the main thread. */
+  /*! Start worker threads for processing the commands in the queue. Must be called from the main thread. */
   virtual PlusStatus Start();
 
-  /*! Stop command processing. Must be called from the main thread. */
+  /*! Stop command processing. Commands that are being executed are completed, queued commands remain in the queue. Must be called from the main thread. */
   virtual PlusStatus Stop();
 
-  /*! Returns true if the command processing thread is running. Can be called from any thread. */
+  /*! Returns true if the command processing threads are running. Can be called from any thread. */
   virtual bool IsRunning();
 
+  /*! Set the number of worker threads that execute any command (in addition to the fast lane thread). Must be called before Start(). */
+  vtkSetClampMacro(NumberOfWorkerThreads, int, 1, 32);
+  vtkGetMacro(NumberOfWorkerThreads, int);
+
+  /*! Number of commands waiting for execution. Can be called from any thread. */
+  int GetNumberOfQueuedCommands();
+
   /*!
     Register custom command. Must be called from the main thread.
     \param cmd It should point to a valid vtkPlusCommand instance. The caller can delete the cmd object after the call.
@@ -94,9 +113,36 @@ public:
 protected:
   vtkPlusCommand* CreatePlusCommand(const std::string& commandName, const std::string& commandStr, const igtl::MessageBase::MetaDataMap& metaData);
 
-  /*! Thread for client connection handling */
+  /*! Worker thread for command execution */
   static void* CommandExecutionThread(vtkMultiThreader::ThreadInfo* data);
 
+  /*! Worker thread that only executes fast commands */
+  static void* FastCommandExecutionThread(vtkMultiThreader::ThreadInfo* data);
+
+  /*! Execute commands until Stop() is requested */
+  void RunCommandExecutionLoop(bool fastCommandsOnly);
+
+  struct QueuedCommand
+  {
+    QueuedCommand() : Fast(false), QueueTime(0.0) {}
+    vtkSmartPointer<vtkPlusCommand> Command;
+    std::string ExecutionKey;
+    bool Fast;
+    double QueueTime;
+  };
+
+  /*! Add a command to the queue and wake up the workers */
+  void AddCommandToQueue(vtkPlusCommand* cmd);
+
+  /*!
+    Remove the first command from the queue that can be executed now: no command with the same execution key is being executed
+    or is queued before it. Its execution key becomes active. Must be called with QueueMutex locked.
+  */
+  bool TakeNextCommand(bool fastCommandsOnly, QueuedCommand& command);
+
+  /*! Execute a command taken by TakeNextCommand, queue its responses, and release its execution key */
+  void ExecuteQueuedCommand(QueuedCommand& command);
+
   vtkPlusCommandProcessor();
   virtual ~vtkPlusCommandProcessor();
 
@@ -110,23 +156,27 @@ private:
   /*! Mutex instance for safe data access */
   vtkSmartPointer<vtkIGSIORecursiveCriticalSection> Mutex;
 
-  // Active flag for threads (first: request, second: respond )
-  std::pair<bool, bool> CommandExecutionActive;
+  /*! Set to request the worker threads to stop. Protected by QueueMutex. */
+  bool CommandExecutionActive;
 
-  // Thread identifier
-  int CommandExecutionThreadId;
+  /*! Identifiers of the running worker threads (including the fast lane) */
+  std::vector<int> CommandExecutionThreadIds;
+
+  int NumberOfWorkerThreads;
 
   /*! Map command names and the New() static methods of vtkPlusCommand classes */
   std::map<std::string, vtkPlusCommand*> RegisteredCommands;
 
-  /*!
-    This queue contains all the active commands.
-    After a command's execute method is called it may still remain active (remain in the queue),
-    until it signals that it is completed.
-  */
-  //std::list<vtkPlusCommand*> CommandQueue;
-  typedef std::list< vtkSmartPointer<vtkPlusCommand> > PlusCommandList;
-  PlusCommandList CommandQueue;
+  /*! Commands waiting for execution, in the order they were received. Protected by QueueMutex. */
+  std::list<QueuedCommand> CommandQueue;
+
+  /*! Execution keys of the commands that are being executed. Protected by QueueMutex. */
+  std::set<std::string> ActiveExecutionKeys;
+
+  /*! Protects the command queue. Workers wait on QueueCondition for new commands or for execution keys to be released. */
+  std::mutex QueueMutex;
+  std::condition_variable QueueCondition;
+
   PlusCommandResponseList CommandResponseQueue;
 
   vtkPlusCommandProcessor(const vtkPlusCommandProcessor&);  // Not implemented.
@@ -132,11 +132,24 @@ public:
   vtkGetMacro(ImageData, vtkImageData*);
   vtkSetObjectMacro(ImageToReferenceTransform, vtkMatrix4x4);
   vtkGetMacro(ImageToReferenceTransform, vtkMatrix4x4*);
+  /*! If set then the image is sent as a sub-volume of a volume with this extent (the image has the origin and spacing of the volume) */
+  vtkSetVector6Macro(VolumeExtent, int);
+  vtkGetVector6Macro(VolumeExtent, int);
+  /*! Returns true if the image is a part of a larger volume */
+  bool IsSubVolume() const
+  {
+    return this->VolumeExtent[1] >= this->VolumeExtent[0] && this->VolumeExtent[3] >= this->VolumeExtent[2] && this->VolumeExtent[5] >= this->VolumeExtent[4];
+  }
 protected:
   vtkPlusCommandImageResponse()
     : ImageData(NULL)
     , ImageToReferenceTransform(NULL)
   {
+    for (int i = 0; i < 3; ++i)
+    {
+      this->VolumeExtent[i * 2] = 0;
+      this->VolumeExtent[i * 2 + 1] = -1;
+    }
   }
   virtual ~vtkPlusCommandImageResponse()
   {
@@ -146,6 +159,7 @@ protected:
   std::string ImageName;
   vtkImageData* ImageData;
   vtkMatrix4x4* ImageToReferenceTransform;
+  int VolumeExtent[6];
 private:
   // We have pointers in this class, so make sure we don't try to accidentally copy it
   vtkPlusCommandImageResponse(const vtkPlusCommandImageResponse&);
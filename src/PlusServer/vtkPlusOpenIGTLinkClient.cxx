@@ -5,15 +5,19 @@ See License.txt for details.
 =========================================================Plus=header=end*/
 
 #include "PlusConfigure.h"
+#include "PlusSharedMemoryFrameRing.h"
+#include "igsioTrackedFrame.h"
 #include "igtlCommandMessage.h"
 #include "igtlCommon.h"
 #include "igtlMessageHeader.h"
 #include "igtlOSUtil.h"
+#include "igtlPlusTrackedFrameMessage.h"
 #include "igtlServerSocket.h"
 #include "vtkMultiThreader.h"
 #include "vtkPlusCommand.h"
 #include "vtkPlusIgtlMessageCommon.h"
 #include "vtkPlusOpenIGTLinkClient.h"
+#include "vtkPlusSharedMemoryTransportCommand.h"
 #include "vtkIGSIORecursiveCriticalSection.h"
 #include "vtkXMLUtilities.h"
 
@@ -35,6 +39,8 @@ vtkPlusOpenIGTLinkClient::vtkPlusOpenIGTLinkClient()
   , ServerPort(-1)
   , ServerHost("")
   , ServerIGTLVersion(IGTL_HEADER_VERSION_1)
+  , NextSharedMemoryFrameIndex(0)
+  , NumberOfSkippedSharedMemoryFrames(0)
 {
 
 }
@@ -82,6 +88,8 @@ PlusStatus vtkPlusOpenIGTLinkClient::Connect(double timeoutSec/*=-1*/)
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusOpenIGTLinkClient::Disconnect()
 {
+  this->SharedMemoryRing.reset();
+
   {
     igsioLockGuard<vtkIGSIORecursiveCriticalSection> socketGuard(this->SocketMutex);
     this->ClientSocket->CloseSocket();
@@ -301,6 +309,184 @@ PlusStatus vtkPlusOpenIGTLinkClient::ReceiveReply(PlusStatus& result, int32_t& o
   return PLUS_FAIL;
 }
 
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusOpenIGTLinkClient::StartSharedMemoryTransport(int numberOfSlots/*=0*/, double timeoutSec/*=5.0*/)
+{
+  vtkSmartPointer<vtkPlusSharedMemoryTransportCommand> command = vtkSmartPointer<vtkPlusSharedMemoryTransportCommand>::New();
+  command->SetNameToStart();
+  command->SetNumberOfSlots(numberOfSlots);
+  if (this->SendCommand(command) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+
+  PlusStatus result = PLUS_FAIL;
+  int32_t commandId = 0;
+  std::string errorString;
+  std::string content;
+  igtl::MessageBase::MetaDataMap parameters;
+  std::string commandName;
+  if (this->ReceiveReply(result, commandId, errorString, content, parameters, commandName, timeoutSec) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("No reply received from the server to " << command->GetName() << " command");
+    return PLUS_FAIL;
+  }
+  if (result != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Server failed to start shared memory transport: " << errorString);
+    return PLUS_FAIL;
+  }
+
+  // Legacy servers reply with the segment name as string
+  std::string segmentName = content;
+  igtl::MessageBase::MetaDataMap::iterator segmentNameIt = parameters.find("SegmentName");
+  if (segmentNameIt != parameters.end())
+  {
+    segmentName = segmentNameIt->second.second;
+  }
+
+  std::shared_ptr<PlusSharedMemoryFrameRing> ring = std::make_shared<PlusSharedMemoryFrameRing>();
+  if (ring->Open(segmentName) != PLUS_SUCCESS)
+  {
+    // Most likely the server runs on a different host, switch back to the socket
+    LOG_ERROR("Failed to open shared memory segment " << segmentName << ". Shared memory transport requires the client to run on the same host as the server.");
+    this->StopSharedMemoryTransport(timeoutSec);
+    return PLUS_FAIL;
+  }
+
+  this->SharedMemoryRing = ring;
+  this->NextSharedMemoryFrameIndex = ring->GetNumberOfWrittenFrames();
+  this->NumberOfSkippedSharedMemoryFrames = 0;
+  LOG_DEBUG("Shared memory transport started: " << segmentName);
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusOpenIGTLinkClient::StopSharedMemoryTransport(double timeoutSec/*=5.0*/)
+{
+  this->SharedMemoryRing.reset();
+
+  vtkSmartPointer<vtkPlusSharedMemoryTransportCommand> command = vtkSmartPointer<vtkPlusSharedMemoryTransportCommand>::New();
+  command->SetNameToStop();
+  if (this->SendCommand(command) != PLUS_SUCCESS)
+  {
+    return PLUS_FAIL;
+  }
+
+  PlusStatus result = PLUS_FAIL;
+  int32_t commandId = 0;
+  std::string errorString;
+  std::string content;
+  igtl::MessageBase::MetaDataMap parameters;
+  std::string commandName;
+  if (this->ReceiveReply(result, commandId, errorString, content, parameters, commandName, timeoutSec) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("No reply received from the server to " << command->GetName() << " command");
+    return PLUS_FAIL;
+  }
+  return result;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusOpenIGTLinkClient::IsSharedMemoryTransportActive() const
+{
+  return this->SharedMemoryRing && this->SharedMemoryRing->IsOpen();
+}
+
+//----------------------------------------------------------------------------
+igtlUint64 vtkPlusOpenIGTLinkClient::GetNumberOfSkippedSharedMemoryFrames() const
+{
+  return this->NumberOfSkippedSharedMemoryFrames;
+}
+
+//----------------------------------------------------------------------------
+PlusSharedMemoryFrameRing* vtkPlusOpenIGTLinkClient::GetSharedMemoryRing()
+{
+  return this->SharedMemoryRing.get();
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusOpenIGTLinkClient::ReceiveSharedMemoryFrame(igsioTrackedFrame& trackedFrame, double timeoutSec/*=0*/)
+{
+  if (!this->IsSharedMemoryTransportActive())
+  {
+    LOG_ERROR("Shared memory transport is not active");
+    return PLUS_FAIL;
+  }
+
+  const igtlUint64 numberOfSlots = this->SharedMemoryRing->GetNumberOfSlots();
+  double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+  while (true)
+  {
+    igtlUint64 numberOfWrittenFrames = this->SharedMemoryRing->GetNumberOfWrittenFrames();
+    if (numberOfWrittenFrames > this->NextSharedMemoryFrameIndex)
+    {
+      // The slot after the most recent frame may be being overwritten, skip to the oldest frame that is safe to read
+      igtlUint64 oldestReadableFrameIndex = (numberOfWrittenFrames > numberOfSlots - 1 ? numberOfWrittenFrames - (numberOfSlots - 1) : 0);
+      if (this->NextSharedMemoryFrameIndex < oldestReadableFrameIndex)
+      {
+        this->NumberOfSkippedSharedMemoryFrames += oldestReadableFrameIndex - this->NextSharedMemoryFrameIndex;
+        this->NextSharedMemoryFrameIndex = oldestReadableFrameIndex;
+      }
+      igtlUint64 frameIndex = this->NextSharedMemoryFrameIndex++;
+      if (this->ReadSharedMemoryFrame(frameIndex, trackedFrame) == PLUS_SUCCESS)
+      {
+        return PLUS_SUCCESS;
+      }
+      // The frame was overwritten while reading it
+      this->NumberOfSkippedSharedMemoryFrames++;
+      continue;
+    }
+    if (vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec >= timeoutSec)
+    {
+      return PLUS_FAIL;
+    }
+    vtkIGSIOAccurateTimer::Delay(0.001);
+  }
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusOpenIGTLinkClient::ReadSharedMemoryFrame(igtlUint64 frameIndex, igsioTrackedFrame& trackedFrame)
+{
+  PlusSharedMemoryFrameRing::FrameView view;
+  if (this->SharedMemoryRing->BeginRead(frameIndex, view) != PLUS_SUCCESS || view.Size < IGTL_HEADER_SIZE)
+  {
+    return PLUS_FAIL;
+  }
+
+  igtl::MessageHeader::Pointer headerMsg = this->IgtlMessageFactory->CreateHeaderMessage(IGTL_HEADER_VERSION_1);
+  memcpy(headerMsg->GetBufferPointer(), view.Data, headerMsg->GetBufferSize());
+  if (!this->SharedMemoryRing->EndRead(view))
+  {
+    return PLUS_FAIL;
+  }
+  headerMsg->Unpack();
+  if (strcmp(headerMsg->GetDeviceType(), "TRACKEDFRAME") != 0 || headerMsg->GetBufferSize() + headerMsg->GetBodySizeToRead() != view.Size)
+  {
+    LOG_ERROR("Invalid frame in shared memory ring (message type: " << headerMsg->GetDeviceType() << ")");
+    return PLUS_FAIL;
+  }
+
+  igtl::PlusTrackedFrameMessage::Pointer trackedFrameMsg = igtl::PlusTrackedFrameMessage::New();
+  trackedFrameMsg->SetMessageHeader(headerMsg);
+  trackedFrameMsg->AllocateBuffer();
+  memcpy(trackedFrameMsg->GetBufferBodyPointer(), static_cast<const unsigned char*>(view.Data) + headerMsg->GetBufferSize(), trackedFrameMsg->GetBufferBodySize());
+  if (!this->SharedMemoryRing->EndRead(view))
+  {
+    return PLUS_FAIL;
+  }
+
+  // The sequence lock guarantees that the copy is consistent, CRC check is not needed
+  int c = trackedFrameMsg->Unpack(0);
+  if (!(c & igtl::MessageHeader::UNPACK_BODY))
+  {
+    LOG_ERROR("Failed to unpack tracked frame from shared memory ring");
+    return PLUS_FAIL;
+  }
+  trackedFrame = trackedFrameMsg->GetTrackedFrame();
+  return PLUS_SUCCESS;
+}
+
 //----------------------------------------------------------------------------
 void vtkPlusOpenIGTLinkClient::PrintSelf(ostream& os, vtkIndent indent)
 {
@@ -24,10 +24,13 @@
 
 // STL includes
 #include <deque>
+#include <memory>
 #include <string>
 
+class igsioTrackedFrame;
 class vtkMultiThreader;
 class vtkIGSIORecursiveCriticalSection;
+class PlusSharedMemoryFrameRing;
 
 /*!
   \class vtkPlusOpenIGTLinkClient
@@ -74,6 +77,35 @@ public:
                           std::string& outCommandName,
                           double timeoutSec = 0);
 
+  /*!
+    Request the server to publish tracked frames through shared memory instead of the socket.
+    Only works if the client runs on the same host as the server and the server has SharedMemoryTransportEnabled.
+    The socket remains connected and it is still used for commands.
+    \param numberOfSlots Number of frames in the ring. If 0 then the server default is used.
+  */
+  PlusStatus StartSharedMemoryTransport(int numberOfSlots = 0, double timeoutSec = 5.0);
+
+  /*! Request the server to send tracked frames through the socket again */
+  PlusStatus StopSharedMemoryTransport(double timeoutSec = 5.0);
+
+  bool IsSharedMemoryTransportActive() const;
+
+  /*!
+    Get the next tracked frame from the shared memory ring. If the client falls behind the server by more than
+    the size of the ring, then the oldest frames are skipped.
+    \param timeoutSec Maximum time to wait for a new frame
+  */
+  PlusStatus ReceiveSharedMemoryFrame(igsioTrackedFrame& trackedFrame, double timeoutSec = 0);
+
+  /*! Number of frames that were skipped because ReceiveSharedMemoryFrame was not called frequently enough */
+  igtlUint64 GetNumberOfSkippedSharedMemoryFrames() const;
+
+  /*!
+    Shared memory ring for accessing the published frames (packed TRACKEDFRAME messages) in place, without copying them.
+    NULL if the shared memory transport is not active.
+  */
+  PlusSharedMemoryFrameRing* GetSharedMemoryRing();
+
   void Lock();
   void Unlock();
 
@@ -100,6 +132,9 @@ protected:
   /*! Thread for receiving control data from clients */
   static void* DataReceiverThread(vtkMultiThreader::ThreadInfo* data);
 
+  /*! Copy a frame from the shared memory ring and unpack it. Fails if the frame is overwritten while it is copied. */
+  PlusStatus ReadSharedMemoryFrame(igtlUint64 frameIndex, igsioTrackedFrame& trackedFrame);
+
 protected:
   /*! igtl Factory for message sending */
   vtkSmartPointer<vtkPlusIgtlMessageFactory>        IgtlMessageFactory;
@@ -127,6 +162,10 @@ protected:
   // IGTL protocol version of the server
   int                                               ServerIGTLVersion;
 
+  std::shared_ptr<PlusSharedMemoryFrameRing>        SharedMemoryRing;
+  igtlUint64                                        NextSharedMemoryFrameIndex;
+  igtlUint64                                        NumberOfSkippedSharedMemoryFrames;
+
   static const float                                CLIENT_SOCKET_TIMEOUT_SEC;
 
 private:
@@ -8,6 +8,8 @@ See License.txt for details.
 #include "PlusConfigure.h"
 #include "PlusCommon.h"
 #include "PlusConfigure.h"
+#include "PlusIgtlGatherMessage.h"
+#include "PlusSharedMemoryFrameRing.h"
 #include "igsioTrackedFrame.h"
 #include "vtkPlusChannel.h"
 #include "vtkPlusCommand.h"
@@ -103,11 +105,23 @@ vtkPlusOpenIGTLinkServer::vtkPlusOpenIGTLinkServer()
   , MessageResponseQueueMutex(vtkSmartPointer<vtkIGSIORecursiveCriticalSection>::New())
   , BroadcastChannel(NULL)
   , LogWarningOnNoDataAvailable(true)
+  , ScatterGatherSendEnabled(true)
+  , SharedMemoryTransportEnabled(false)
+  , SharedMemoryNumberOfSlots(4)
+  , CommandExecutionThreads(0)
+  , SharedVideoEncoding(true)
+  , NumberOfPendingVideoEncodingJobs(0)
+  , VideoEncodingActive(false)
+  , VideoEncoderThreadId(-1)
   , KeepAliveIntervalSec(CLIENT_SOCKET_TIMEOUT_SEC / 2.0)
   , GracePeriodLogLevel(vtkPlusLogger::LOG_LEVEL_DEBUG)
   , MissingInputGracePeriodSec(0.0)
   , BroadcastStartTime(0.0)
   , NewClientConnected(false)
+  , MetricsUpdatePeriodSec(1.0)
+  , LastMetricsUpdateTime(0.0)
+  , ConnectedClientsGauge(NULL)
+  , MessageResponseQueueDepthGauge(NULL)
 {
 
 }
@@ -145,6 +159,7 @@ PlusStatus vtkPlusOpenIGTLinkServer::QueueMessageResponseForClient(int clientId,
 
   igsioLockGuard<vtkIGSIORecursiveCriticalSection> mutexGuardedLock(this->MessageResponseQueueMutex);
   this->MessageResponseQueue[clientId].push_back(message);
+  this->UpdateMessageResponseQueueMetrics();
 
   return PLUS_SUCCESS;
 }
@@ -164,6 +179,12 @@ PlusStatus vtkPlusOpenIGTLinkServer::StartOpenIGTLinkService()
     return PLUS_FAIL;
   }
 
+  PlusMetricsRegistry::LabelMap labels;
+  labels["server"] = igsioCommon::ToString<int>(this->ListeningPort);
+  this->ConnectedClientsGauge = PlusMetricsRegistry::GetInstance()->GetGauge("plus_igtl_connected_clients", labels, "Number of connected OpenIGTLink clients");
+  this->MessageResponseQueueDepthGauge = PlusMetricsRegistry::GetInstance()->GetGauge("plus_igtl_message_response_queue_depth", labels, "Number of message replies waiting to be sent to clients");
+  this->LastMetricsUpdateTime = vtkIGSIOAccurateTimer::GetSystemTime();
+
   if (this->ConnectionReceiverThreadId < 0)
   {
     this->ConnectionActive.Request = true;
@@ -192,6 +213,21 @@ PlusStatus vtkPlusOpenIGTLinkServer::StartOpenIGTLinkService()
   LOG_DEBUG(ss.str());
 
   this->PlusCommandProcessor->SetPlusServer(this);
+  if (this->CommandExecutionThreads > 0)
+  {
+    this->PlusCommandProcessor->SetNumberOfWorkerThreads(this->CommandExecutionThreads);
+    if (this->PlusCommandProcessor->Start() != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Unable to start command execution threads.");
+      return PLUS_FAIL;
+    }
+  }
+
+  if (this->SharedVideoEncoding && this->StartVideoEncoding() != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to start video encoding thread.");
+    return PLUS_FAIL;
+  }
 
   this->BroadcastStartTime = vtkIGSIOAccurateTimer::GetSystemTime();
 
@@ -201,6 +237,9 @@ PlusStatus vtkPlusOpenIGTLinkServer::StartOpenIGTLinkService()
 //----------------------------------------------------------------------------
 PlusStatus vtkPlusOpenIGTLinkServer::StopOpenIGTLinkService()
 {
+  // Complete the commands that are being executed (no-op if commands are executed by the main thread)
+  this->PlusCommandProcessor->Stop();
+
   // Stop connection receiver thread
   if (this->ConnectionReceiverThreadId >= 0)
   {
@@ -229,6 +268,9 @@ PlusStatus vtkPlusOpenIGTLinkServer::StopOpenIGTLinkService()
     DisconnectClient(*it);
   }
 
+  // Frames that are queued for encoding are encoded before the thread stops, later frames are encoded when they are sent
+  this->StopVideoEncoding();
+
   LOG_INFO("Plus OpenIGTLink server stopped.");
 
   return PLUS_SUCCESS;
@@ -270,6 +312,8 @@ void* vtkPlusOpenIGTLinkServer::ConnectionReceiverThread(vtkMultiThreader::Threa
       client->ClientSocket->SetSendTimeout(self->DefaultClientSendTimeoutSec * 1000);
       client->ClientInfo = self->DefaultClientInfo;
       client->Server = self;
+      self->RegisterClientMetrics(*client);
+      self->AssignSharedVideoEncoders(*client);
 
       // Setup vtkIGSIOFrameConverters for each stream
       for (std::vector<PlusIgtlClientInfo::ImageStream>::iterator imageStreamIterator = client->ClientInfo.ImageStreams.begin();
@@ -378,6 +422,8 @@ void* vtkPlusOpenIGTLinkServer::DataSenderThread(vtkMultiThreader::ThreadInfo* d
   double elapsedTimeSinceLastPacketSentSec = 0;
   while (self->ConnectionActive.Request && self->DataSenderActive.Request)
   {
+    self->UpdateMetrics();
+
     bool clientsConnected = false;
     {
       igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(self->IgtlClientsMutex);
@@ -480,6 +526,9 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendLatestFramesToClients(vtkPlusOpenIGTLin
     return PLUS_FAIL;
   }
 
+  // Video frames are encoded on the video encoder thread while the preceding frames are sent
+  self.QueueFramesForVideoEncoding(trackedFrameList);
+
   for (unsigned int i = 0; i < trackedFrameList->GetNumberOfTrackedFrames(); ++i)
   {
     // Send tracked frame
@@ -487,6 +536,9 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendLatestFramesToClients(vtkPlusOpenIGTLin
     elapsedTimeSinceLastPacketSentSec = 0;
   }
 
+  // The encoders must not refer to the frames after the list is deleted
+  self.WaitForVideoEncoding();
+
   // Compute time spent with processing one frame in this round
   double computationTimeMs = (vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec) * 1000.0;
 
@@ -508,12 +560,14 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendMessageResponses(vtkPlusOpenIGTLinkServ
     {
       igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(self.IgtlClientsMutex);
       igtl::ClientSocket::Pointer clientSocket = NULL;
+      ClientData* client = NULL;
 
       for (std::list<ClientData>::iterator clientIterator = self.IgtlClients.begin(); clientIterator != self.IgtlClients.end(); ++clientIterator)
       {
         if (clientIterator->ClientId == it->first)
         {
           clientSocket = clientIterator->ClientSocket;
+          client = &(*clientIterator);
           break;
         }
       }
@@ -525,10 +579,14 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendMessageResponses(vtkPlusOpenIGTLinkServ
 
       for (std::vector<igtl::MessageBase::Pointer>::iterator messageIt = it->second.begin(); messageIt != it->second.end(); ++messageIt)
       {
-        clientSocket->Send((*messageIt)->GetBufferPointer(), (*messageIt)->GetBufferSize());
+        if (clientSocket->Send((*messageIt)->GetBufferPointer(), (*messageIt)->GetBufferSize()) != 0)
+        {
+          RecordBytesSent(*client, (*messageIt)->GetBufferSize());
+        }
       }
     }
     self.MessageResponseQueue.clear();
+    self.UpdateMessageResponseQueueMetrics();
   }
 
   return PLUS_SUCCESS;
@@ -555,11 +613,13 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendCommandResponses(vtkPlusOpenIGTLinkServ
       LOG_DEBUG("Send command reply to client " << (*responseIt)->GetClientId() << ": " << igtlResponseMessage->GetDeviceName());
       igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(self.IgtlClientsMutex);
       igtl::ClientSocket::Pointer clientSocket = NULL;
+      ClientData* client = NULL;
       for (std::list<ClientData>::iterator clientIterator = self.IgtlClients.begin(); clientIterator != self.IgtlClients.end(); ++clientIterator)
       {
         if (clientIterator->ClientId == (*responseIt)->GetClientId())
         {
           clientSocket = clientIterator->ClientSocket;
+          client = &(*clientIterator);
           break;
         }
       }
@@ -569,7 +629,10 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendCommandResponses(vtkPlusOpenIGTLinkServ
         LOG_WARNING("Message reply cannot be sent to client " << (*responseIt)->GetClientId() << ", probably client has been disconnected");
         continue;
       }
-      clientSocket->Send(igtlResponseMessage->GetBufferPointer(), igtlResponseMessage->GetBufferSize());
+      if (clientSocket->Send(igtlResponseMessage->GetBufferPointer(), igtlResponseMessage->GetBufferSize()) != 0)
+      {
+        RecordBytesSent(*client, igtlResponseMessage->GetBufferSize());
+      }
     }
   }
 
@@ -636,7 +699,17 @@ void* vtkPlusOpenIGTLinkServer::DataReceiverThread(vtkMultiThreader::ThreadInfo*
       {
         // Message received from client, need to lock to modify client info
         igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(self->IgtlClientsMutex);
+        for (std::vector<PlusIgtlClientInfo::VideoStream>::iterator videoStreamIterator = client->ClientInfo.VideoStreams.begin();
+             videoStreamIterator != client->ClientInfo.VideoStreams.end(); ++videoStreamIterator)
+        {
+          if (videoStreamIterator->SharedEncoder)
+          {
+            videoStreamIterator->SharedEncoder->RemoveClient(clientId);
+          }
+        }
         client->ClientInfo = clientInfoMsg->GetClientInfo();
+        self->AssignSharedVideoEncoders(*client);
+        self->RemoveUnusedSharedVideoEncoders();
         LOG_DEBUG("Client info message received from client " << clientId);
       }
     }
@@ -1059,12 +1132,34 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendTrackedFrame(igsioTrackedFrame& tracked
       std::vector<igtl::MessageBase::Pointer> igtlMessages;
       std::vector<igtl::MessageBase::Pointer>::iterator igtlMessageIterator;
 
+      if (clientIterator->SharedMemoryRing)
+      {
+        // The client receives data through shared memory: publish the frame (image, transforms and fields) as a single TRACKEDFRAME message
+        PlusIgtlClientInfo sharedMemoryClientInfo = clientIterator->ClientInfo;
+        sharedMemoryClientInfo.IgtlMessageTypes.clear();
+        sharedMemoryClientInfo.IgtlMessageTypes.push_back("TRACKEDFRAME");
+        sharedMemoryClientInfo.SetTrackedFrameBinaryFields(true);
+        if (this->IgtlMessageFactory->PackMessages(clientIterator->ClientId, sharedMemoryClientInfo, igtlMessages, trackedFrame, this->SendValidTransformsOnly, this->TransformRepository) != PLUS_SUCCESS)
+        {
+          LOG_WARNING("Failed to pack tracked frame message for shared memory transport");
+        }
+        for (igtlMessageIterator = igtlMessages.begin(); igtlMessageIterator != igtlMessages.end(); ++igtlMessageIterator)
+        {
+          if ((*igtlMessageIterator).IsNotNull() && clientIterator->SharedMemoryRing->WriteMessage(*igtlMessageIterator) != PLUS_SUCCESS)
+          {
+            numberOfErrors++;
+          }
+        }
+        continue;
+      }
+
       if (this->IgtlMessageFactory->PackMessages(clientIterator->ClientId, clientIterator->ClientInfo, igtlMessages, trackedFrame, this->SendValidTransformsOnly, this->TransformRepository) != PLUS_SUCCESS)
       {
         LOG_WARNING("Failed to pack all IGT messages");
       }
 
       // Send all messages to a client
+      PlusMetricsRegistry::ScopedTimer sendTimer(clientIterator->SendLatencyHistogram);
       for (igtlMessageIterator = igtlMessages.begin(); igtlMessageIterator != igtlMessages.end(); ++igtlMessageIterator)
       {
         igtl::MessageBase::Pointer igtlMessage = (*igtlMessageIterator);
@@ -1073,8 +1168,10 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendTrackedFrame(igsioTrackedFrame& tracked
           continue;
         }
 
+        // Gather-enabled messages are sent with the image data referenced in place (no copy into the message buffer)
         int retValue = 0;
-        RETRY_UNTIL_TRUE((retValue = clientSocket->Send(igtlMessage->GetBufferPointer(), igtlMessage->GetBufferSize())) != 0, this->NumberOfRetryAttempts, this->DelayBetweenRetryAttemptsSec);
+        igtlUint64 sentBytes = 0;
+        RETRY_UNTIL_TRUE((retValue = PlusIgtlGatherMessage::Send(clientSocket, igtlMessage, &sentBytes)) != 0, this->NumberOfRetryAttempts, this->DelayBetweenRetryAttemptsSec);
         if (retValue == 0)
         {
           disconnectedClientIds.push_back(clientIterator->ClientId);
@@ -1084,6 +1181,7 @@ PlusStatus vtkPlusOpenIGTLinkServer::SendTrackedFrame(igsioTrackedFrame& tracked
                    << "  Timestamp: " << std::fixed << ts->GetTimeStamp() << ").");
           break;
         }
+        RecordBytesSent(*clientIterator, sentBytes);
 
         // Update the TDATA timestamp, even if TDATA isn't sent (cheaper than checking for existing TDATA message type)
         clientIterator->ClientInfo.SetLastTDATASentTimeStamp(trackedFrame.GetTimestamp());
@@ -1177,14 +1275,204 @@ void vtkPlusOpenIGTLinkServer::DisconnectClient(int clientId)
 #endif
         clientIterator->ClientSocket->CloseSocket();
       }
+      for (std::vector<PlusIgtlClientInfo::VideoStream>::iterator videoStreamIterator = clientIterator->ClientInfo.VideoStreams.begin();
+           videoStreamIterator != clientIterator->ClientInfo.VideoStreams.end(); ++videoStreamIterator)
+      {
+        if (videoStreamIterator->SharedEncoder)
+        {
+          videoStreamIterator->SharedEncoder->RemoveClient(clientId);
+        }
+      }
       this->IgtlClients.erase(clientIterator);
       break;
     }
+    this->RemoveUnusedSharedVideoEncoders();
+    // Metrics of the client are not used anymore (the client has been removed from the list while it was locked)
+    PlusMetricsRegistry::GetInstance()->RemoveMetrics("client", igsioCommon::ToString<int>(clientId));
+    if (this->ConnectedClientsGauge != NULL)
+    {
+      this->ConnectedClientsGauge->SetValue(this->IgtlClients.size());
+    }
   }
 
   LOG_INFO("Client disconnected (" <<  address << ":" << port << "). Number of connected clients: " << GetNumberOfConnectedClients());
 }
 
+//----------------------------------------------------------------------------
+void vtkPlusOpenIGTLinkServer::AssignSharedVideoEncoders(ClientData& client)
+{
+  if (!this->SharedVideoEncoding)
+  {
+    return;
+  }
+  for (std::vector<PlusIgtlClientInfo::VideoStream>::iterator videoStreamIterator = client.ClientInfo.VideoStreams.begin();
+       videoStreamIterator != client.ClientInfo.VideoStreams.end(); ++videoStreamIterator)
+  {
+    // All video streams contain the image of the broadcast channel, therefore only the encoding makes streams different
+    std::string codecFourCC = videoStreamIterator->EncodeVideoParameters.FourCC;
+    std::map<std::string, std::string> codecParameters = videoStreamIterator->EncodeVideoParameters.GetCodecParameters();
+    videoStreamIterator->SharedEncoder = NULL;
+    for (std::vector<vtkSmartPointer<vtkPlusIgtlSharedVideoEncoder> >::iterator encoderIt = this->SharedVideoEncoders.begin(); encoderIt != this->SharedVideoEncoders.end(); ++encoderIt)
+    {
+      if ((*encoderIt)->IsEncoding(codecFourCC, codecParameters))
+      {
+        videoStreamIterator->SharedEncoder = *encoderIt;
+        break;
+      }
+    }
+    if (!videoStreamIterator->SharedEncoder)
+    {
+      vtkSmartPointer<vtkPlusIgtlSharedVideoEncoder> encoder = vtkSmartPointer<vtkPlusIgtlSharedVideoEncoder>::New();
+      encoder->SetEncoding(codecFourCC, codecParameters);
+      this->SharedVideoEncoders.push_back(encoder);
+      videoStreamIterator->SharedEncoder = encoder;
+      LOG_DEBUG("Shared " << codecFourCC << " video encoder created for client " << client.ClientId << ". Number of shared video encoders: " << this->SharedVideoEncoders.size());
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusOpenIGTLinkServer::RemoveUnusedSharedVideoEncoders()
+{
+  std::vector<vtkSmartPointer<vtkPlusIgtlSharedVideoEncoder> >::iterator encoderIt = this->SharedVideoEncoders.begin();
+  while (encoderIt != this->SharedVideoEncoders.end())
+  {
+    // If only this list refers to the encoder then no client uses it. The video encoder thread may still hold a reference, that's safe.
+    if ((*encoderIt)->GetReferenceCount() == 1)
+    {
+      encoderIt = this->SharedVideoEncoders.erase(encoderIt);
+    }
+    else
+    {
+      ++encoderIt;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusOpenIGTLinkServer::StartVideoEncoding()
+{
+  if (this->VideoEncoderThreadId >= 0)
+  {
+    return PLUS_SUCCESS;
+  }
+  {
+    std::lock_guard<std::mutex> videoEncodingLock(this->VideoEncodingMutex);
+    this->VideoEncodingActive = true;
+  }
+  this->VideoEncoderThreadId = this->Threader->SpawnThread((vtkThreadFunctionType)&VideoEncoderThread, this);
+  if (this->VideoEncoderThreadId < 0)
+  {
+    std::lock_guard<std::mutex> videoEncodingLock(this->VideoEncodingMutex);
+    this->VideoEncodingActive = false;
+    return PLUS_FAIL;
+  }
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusOpenIGTLinkServer::StopVideoEncoding()
+{
+  if (this->VideoEncoderThreadId < 0)
+  {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> videoEncodingLock(this->VideoEncodingMutex);
+    this->VideoEncodingActive = false;
+  }
+  this->VideoEncodingCondition.notify_all();
+
+  // Wait until the thread encodes the queued frames
+  this->Threader->TerminateThread(this->VideoEncoderThreadId);
+  this->VideoEncoderThreadId = -1;
+  LOG_DEBUG("VideoEncoderThread stopped");
+}
+
+//----------------------------------------------------------------------------
+void* vtkPlusOpenIGTLinkServer::VideoEncoderThread(vtkMultiThreader::ThreadInfo* data)
+{
+  vtkPlusOpenIGTLinkServer* self = (vtkPlusOpenIGTLinkServer*)(data->UserData);
+  while (true)
+  {
+    vtkSmartPointer<vtkPlusIgtlSharedVideoEncoder> encoder;
+    {
+      std::unique_lock<std::mutex> videoEncodingLock(self->VideoEncodingMutex);
+      while (self->VideoEncodingActive && self->VideoEncodingJobs.empty())
+      {
+        self->VideoEncodingCondition.wait(videoEncodingLock);
+      }
+      if (self->VideoEncodingJobs.empty())
+      {
+        // stop is requested and all queued frames are encoded
+        return NULL;
+      }
+      encoder = self->VideoEncodingJobs.front();
+      self->VideoEncodingJobs.pop_front();
+    }
+
+    // The data sender thread waits for each frame separately, so it can send a frame while the next one is encoded
+    while (encoder->EncodeNextQueuedFrame())
+    {
+    }
+
+    {
+      std::lock_guard<std::mutex> videoEncodingLock(self->VideoEncodingMutex);
+      self->NumberOfPendingVideoEncodingJobs--;
+    }
+    self->VideoEncodingCondition.notify_all();
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusOpenIGTLinkServer::QueueFramesForVideoEncoding(vtkIGSIOTrackedFrameList* trackedFrameList)
+{
+  std::vector<vtkSmartPointer<vtkPlusIgtlSharedVideoEncoder> > encoders;
+  {
+    igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(this->IgtlClientsMutex);
+    encoders = this->SharedVideoEncoders;
+  }
+  if (encoders.empty())
+  {
+    return;
+  }
+
+  std::lock_guard<std::mutex> videoEncodingLock(this->VideoEncodingMutex);
+  if (!this->VideoEncodingActive)
+  {
+    // Frames will be encoded by the data sender thread when they are sent
+    return;
+  }
+  for (std::vector<vtkSmartPointer<vtkPlusIgtlSharedVideoEncoder> >::iterator encoderIt = encoders.begin(); encoderIt != encoders.end(); ++encoderIt)
+  {
+    for (unsigned int i = 0; i < trackedFrameList->GetNumberOfTrackedFrames(); ++i)
+    {
+      (*encoderIt)->QueueFrame(trackedFrameList->GetTrackedFrame(i));
+    }
+    this->VideoEncodingJobs.push_back(*encoderIt);
+    this->NumberOfPendingVideoEncodingJobs++;
+  }
+  this->VideoEncodingCondition.notify_all();
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusOpenIGTLinkServer::WaitForVideoEncoding()
+{
+  {
+    std::unique_lock<std::mutex> videoEncodingLock(this->VideoEncodingMutex);
+    while (this->NumberOfPendingVideoEncodingJobs > 0)
+    {
+      this->VideoEncodingCondition.wait(videoEncodingLock);
+    }
+  }
+
+  igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(this->IgtlClientsMutex);
+  for (std::vector<vtkSmartPointer<vtkPlusIgtlSharedVideoEncoder> >::iterator encoderIt = this->SharedVideoEncoders.begin(); encoderIt != this->SharedVideoEncoders.end(); ++encoderIt)
+  {
+    (*encoderIt)->ReleaseTrackedFrames();
+  }
+}
+
 //----------------------------------------------------------------------------
 void vtkPlusOpenIGTLinkServer::KeepAlive()
 {
@@ -1215,6 +1503,10 @@ void vtkPlusOpenIGTLinkServer::KeepAlive()
         LOG_DEBUG("Client disconnected - could not send " << replyMsg->GetMessageType() << " message to client (device name: " << replyMsg->GetDeviceName()
                   << "  Timestamp: " << std::fixed <<  ts->GetTimeStamp() << ").");
       }
+      else
+      {
+        RecordBytesSent(*clientIterator, replyMsg->GetPackSize());
+      }
     } // clientIterator
   } // unlock client list
 
@@ -1249,6 +1541,160 @@ PlusStatus vtkPlusOpenIGTLinkServer::GetClientInfo(unsigned int clientId, PlusIg
   return PLUS_FAIL;
 }
 
+//------------------------------------------------------------------------------
+PlusStatus vtkPlusOpenIGTLinkServer::StartSharedMemoryTransport(int clientId, unsigned int& numberOfSlots, igtlUint64& slotSize, std::string& outSegmentName)
+{
+  if (!this->SharedMemoryTransportEnabled)
+  {
+    LOG_ERROR("Shared memory transport is requested by client " << clientId << " but it is disabled. Set SharedMemoryTransportEnabled=\"TRUE\" in the PlusOpenIGTLinkServer element to enable it.");
+    return PLUS_FAIL;
+  }
+
+  if (numberOfSlots == 0)
+  {
+    numberOfSlots = static_cast<unsigned int>(std::max(this->SharedMemoryNumberOfSlots, 2));
+  }
+  if (slotSize == 0)
+  {
+    // Room for the current image and the message headers, transforms and fields
+    const igtlUint64 metadataSize = 1024 * 1024;
+    slotSize = metadataSize;
+    igsioTrackedFrame currentFrame;
+    if (this->BroadcastChannel != NULL && this->BroadcastChannel->GetTrackedFrame(currentFrame) == PLUS_SUCCESS && currentFrame.GetImageData()->IsImageValid())
+    {
+      slotSize += currentFrame.GetImageData()->GetFrameSizeInBytes();
+    }
+  }
+
+  std::shared_ptr<PlusSharedMemoryFrameRing> ring = std::make_shared<PlusSharedMemoryFrameRing>();
+  std::string segmentName = PlusSharedMemoryFrameRing::GenerateSegmentName("PlusServer", clientId);
+  if (ring->Create(segmentName, numberOfSlots, slotSize) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to create shared memory ring for client " << clientId);
+    return PLUS_FAIL;
+  }
+
+  {
+    igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(this->IgtlClientsMutex);
+    std::list<ClientData>::iterator clientIterator = this->IgtlClients.begin();
+    for (; clientIterator != this->IgtlClients.end(); ++clientIterator)
+    {
+      if (clientIterator->ClientId == clientId)
+      {
+        break;
+      }
+    }
+    if (clientIterator == this->IgtlClients.end())
+    {
+      LOG_ERROR("Cannot start shared memory transport: client " << clientId << " is not connected");
+      return PLUS_FAIL;
+    }
+    // Replaces (and removes) the previous ring of the client, if any
+    clientIterator->SharedMemoryRing = ring;
+  }
+
+  outSegmentName = segmentName;
+  LOG_INFO("Client " << clientId << " receives tracked frames through shared memory: " << segmentName << " (" << numberOfSlots << " slots, " << slotSize << " bytes/slot)");
+  return PLUS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+PlusStatus vtkPlusOpenIGTLinkServer::StopSharedMemoryTransport(int clientId)
+{
+  std::shared_ptr<PlusSharedMemoryFrameRing> ring;
+  {
+    igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(this->IgtlClientsMutex);
+    for (std::list<ClientData>::iterator clientIterator = this->IgtlClients.begin(); clientIterator != this->IgtlClients.end(); ++clientIterator)
+    {
+      if (clientIterator->ClientId == clientId)
+      {
+        ring.swap(clientIterator->SharedMemoryRing);
+        break;
+      }
+    }
+  }
+  if (!ring)
+  {
+    return PLUS_FAIL;
+  }
+  LOG_INFO("Client " << clientId << " stopped receiving tracked frames through shared memory");
+  return PLUS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+void vtkPlusOpenIGTLinkServer::RegisterClientMetrics(ClientData& client)
+{
+  PlusMetricsRegistry* metrics = PlusMetricsRegistry::GetInstance();
+  PlusMetricsRegistry::LabelMap labels;
+  labels["server"] = igsioCommon::ToString<int>(this->ListeningPort);
+  labels["client"] = igsioCommon::ToString<int>(client.ClientId);
+  client.BytesSentCounter = metrics->GetCounter("plus_igtl_client_sent_bytes_total", labels, "Number of bytes sent to the OpenIGTLink client");
+  client.SendRateGauge = metrics->GetGauge("plus_igtl_client_send_rate_bytes_per_second", labels, "Data rate of sending to the OpenIGTLink client");
+  client.SendLatencyHistogram = metrics->GetHistogram("plus_igtl_client_frame_send_seconds", labels, "Time needed to send all messages of a tracked frame to the OpenIGTLink client");
+  client.LastBytesSentSample = 0;
+  if (this->ConnectedClientsGauge != NULL)
+  {
+    this->ConnectedClientsGauge->SetValue(this->IgtlClients.size());
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkPlusOpenIGTLinkServer::RecordBytesSent(ClientData& client, igtlUint64 numberOfBytes)
+{
+  if (client.BytesSentCounter != NULL && numberOfBytes > 0)
+  {
+    client.BytesSentCounter->Increment(numberOfBytes);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkPlusOpenIGTLinkServer::UpdateMessageResponseQueueMetrics()
+{
+  if (this->MessageResponseQueueDepthGauge == NULL)
+  {
+    return;
+  }
+  size_t numberOfMessages = 0;
+  for (ClientIdToMessageListMap::iterator it = this->MessageResponseQueue.begin(); it != this->MessageResponseQueue.end(); ++it)
+  {
+    numberOfMessages += it->second.size();
+  }
+  this->MessageResponseQueueDepthGauge->SetValue(numberOfMessages);
+}
+
+//------------------------------------------------------------------------------
+void vtkPlusOpenIGTLinkServer::UpdateMetrics()
+{
+  double now = vtkIGSIOAccurateTimer::GetSystemTime();
+  double elapsedTimeSec = now - this->LastMetricsUpdateTime;
+  if (elapsedTimeSec < this->MetricsUpdatePeriodSec || elapsedTimeSec <= 0)
+  {
+    return;
+  }
+  this->LastMetricsUpdateTime = now;
+
+  {
+    igsioLockGuard<vtkIGSIORecursiveCriticalSection> igtlClientsMutexGuardedLock(this->IgtlClientsMutex);
+    for (std::list<ClientData>::iterator clientIterator = this->IgtlClients.begin(); clientIterator != this->IgtlClients.end(); ++clientIterator)
+    {
+      if (clientIterator->BytesSentCounter == NULL)
+      {
+        continue;
+      }
+      unsigned long long bytesSent = clientIterator->BytesSentCounter->GetValue();
+      clientIterator->SendRateGauge->SetValue((bytesSent - clientIterator->LastBytesSentSample) / elapsedTimeSec);
+      clientIterator->LastBytesSentSample = bytesSent;
+    }
+  }
+
+  if (!this->MetricsFile.empty() && PlusMetricsRegistry::GetInstance()->WritePrometheusFile(this->MetricsFile) != PLUS_SUCCESS)
+  {
+    // Do not flood the log with the same error every period
+    LOG_WARNING("Writing of metrics file is disabled: " << this->MetricsFile);
+    this->MetricsFile.clear();
+  }
+}
+
 //------------------------------------------------------------------------------
 PlusStatus vtkPlusOpenIGTLinkServer::ReadConfiguration(vtkXMLDataElement* serverElement, const std::string& aFilename)
 {
@@ -1272,6 +1718,18 @@ PlusStatus vtkPlusOpenIGTLinkServer::ReadConfiguration(vtkXMLDataElement* server
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(SendValidTransformsOnly, serverElement);
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(IgtlMessageCrcCheckEnabled, serverElement);
   XML_READ_BOOL_ATTRIBUTE_OPTIONAL(LogWarningOnNoDataAvailable, serverElement);
+  XML_READ_BOOL_ATTRIBUTE_OPTIONAL(ScatterGatherSendEnabled, serverElement);
+  this->IgtlMessageFactory->SetScatterGatherEnabled(this->ScatterGatherSendEnabled);
+  XML_READ_BOOL_ATTRIBUTE_OPTIONAL(SharedMemoryTransportEnabled, serverElement);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, SharedMemoryNumberOfSlots, serverElement);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(int, CommandExecutionThreads, serverElement);
+  XML_READ_BOOL_ATTRIBUTE_OPTIONAL(SharedVideoEncoding, serverElement);
+  XML_READ_STRING_ATTRIBUTE_OPTIONAL(MetricsFile, serverElement);
+  XML_READ_SCALAR_ATTRIBUTE_OPTIONAL(double, MetricsUpdatePeriodSec, serverElement);
+  if (!this->MetricsFile.empty() && !vtksys::SystemTools::FileIsFullPath(this->MetricsFile))
+  {
+    this->MetricsFile = vtkPlusConfig::GetInstance()->GetOutputPath(this->MetricsFile);
+  }
 
   this->DefaultClientInfo.IgtlMessageTypes.clear();
   this->DefaultClientInfo.TransformNames.clear();
@@ -1399,7 +1857,16 @@ igtl::MessageBase::Pointer vtkPlusOpenIGTLinkServer::CreateIgtlMessageFromComman
     igtl::ImageMessage::Pointer igtlMessage = dynamic_cast<igtl::ImageMessage*>(this->IgtlMessageFactory->CreateSendMessage("IMAGE", replyHeaderVersion).GetPointer());
     igtlMessage->SetDeviceName(imageName.c_str());
 
-    if (vtkPlusIgtlMessageCommon::PackImageMessage(igtlMessage, imageData, *imageToReferenceTransform, vtkIGSIOAccurateTimer::GetSystemTime()) != PLUS_SUCCESS)
+    PlusStatus packStatus = PLUS_FAIL;
+    if (imageResponse->IsSubVolume())
+    {
+      packStatus = vtkPlusIgtlMessageCommon::PackImageMessage(igtlMessage, imageData, imageResponse->GetVolumeExtent(), *imageToReferenceTransform, vtkIGSIOAccurateTimer::GetSystemTime());
+    }
+    else
+    {
+      packStatus = vtkPlusIgtlMessageCommon::PackImageMessage(igtlMessage, imageData, *imageToReferenceTransform, vtkIGSIOAccurateTimer::GetSystemTime());
+    }
+    if (packStatus != PLUS_SUCCESS)
     {
       LOG_ERROR("Failed to create image mesage from command response");
       return NULL;
@@ -10,6 +10,7 @@
 // Local includes
 #include "vtkPlusServerExport.h"
 #include "PlusIgtlClientInfo.h"
+#include "PlusMetricsRegistry.h"
 #include "vtkPlusDataCollector.h"
 #include "vtkPlusIgtlMessageFactory.h"
 #include "vtkIGSIOTransformRepository.h"
@@ -20,7 +21,10 @@
 #include <vtkSmartPointer.h>
 
 // STL includes
+#include <condition_variable>
 #include <deque>
+#include <memory>
+#include <mutex>
 
 // OS includes
 #if (_MSC_VER == 1500)
@@ -39,6 +43,8 @@ class vtkPlusCommandProcessor;
 class vtkPlusCommandResponse;
 class vtkIGSIORecursiveCriticalSection;
 //class vtkIGSIOTransformRepository;
+class vtkIGSIOTrackedFrameList;
+class PlusSharedMemoryFrameRing;
 
 struct ClientData
 {
@@ -48,6 +54,10 @@ struct ClientData
     , DataReceiverActive(std::make_pair(false, false))
     , DataReceiverThreadId(-1)
     , Server(NULL)
+    , BytesSentCounter(NULL)
+    , SendRateGauge(NULL)
+    , SendLatencyHistogram(NULL)
+    , LastBytesSentSample(0)
   {
   }
 
@@ -68,6 +78,15 @@ struct ClientData
   PlusIgtlClientInfo ClientInfo;
 
   vtkPlusOpenIGTLinkServer* Server;
+
+  /// Runtime metrics of the client (owned by PlusMetricsRegistry, removed when the client disconnects)
+  PlusMetricsRegistry::Counter* BytesSentCounter;
+  PlusMetricsRegistry::Gauge* SendRateGauge;
+  PlusLatencyHistogram* SendLatencyHistogram;
+  unsigned long long LastBytesSentSample;
+
+  /// If set then tracked frames are published in this shared memory ring instead of sent through the socket
+  std::shared_ptr<PlusSharedMemoryFrameRing> SharedMemoryRing;
 };
 
 /*!
@@ -142,6 +161,18 @@ public:
     */
   virtual PlusStatus GetClientInfo(unsigned int clientId, PlusIgtlClientInfo& outClientInfo) const;
 
+  /*!
+    Publish tracked frames to a client through a shared memory ring instead of the socket.
+    The client socket remains connected for commands, replies and keep-alive messages.
+    \param numberOfSlots Number of frames in the ring. If 0 then SharedMemoryNumberOfSlots is used. Set to the actual value on return.
+    \param slotSize Maximum frame size in bytes. If 0 then it is computed from the current frame size. Set to the actual value on return.
+    \param outSegmentName Name of the created shared memory segment that the client can open
+  */
+  PlusStatus StartSharedMemoryTransport(int clientId, unsigned int& numberOfSlots, igtlUint64& slotSize, std::string& outSegmentName);
+
+  /*! Remove the shared memory ring of a client and resume sending data through the socket */
+  PlusStatus StopSharedMemoryTransport(int clientId);
+
   /*! Start server */
   PlusStatus StartOpenIGTLinkService();
 
@@ -153,8 +184,17 @@ public:
   vtkGetMacro(IGTLProtocolVersion, int);
   vtkGetMacro(IGTLHeaderVersion, int);
 
+  /*! File where runtime metrics are periodically written in Prometheus text format. Empty means metrics are not written to file. */
+  vtkGetStdStringMacro(MetricsFile);
+  vtkSetStdStringMacro(MetricsFile);
+
+  /*! Period of updating computed metrics (client send rates) and writing the metrics file */
+  vtkSetMacro(MetricsUpdatePeriodSec, double);
+  vtkGetMacroConst(MetricsUpdatePeriodSec, double);
+
   /*!
-    Execute all commands in the queue from the current thread (useful if commands should be executed from the main thread)
+    Execute all commands in the queue from the current thread (useful if commands should be executed from the main thread).
+    Does nothing if commands are executed by worker threads (see CommandExecutionThreads).
     \return Number of executed commands
   */
   int ProcessPendingCommands();
@@ -175,6 +215,27 @@ protected:
   /*! Attempt to send any unsent frames to clients, if unsuccessful, accumulate an elapsed time */
   static PlusStatus SendLatestFramesToClients(vtkPlusOpenIGTLinkServer& self, double& elapsedTimeSinceLastPacketSentSec);
 
+  /*! Thread for encoding video frames ahead of sending them to clients */
+  static void* VideoEncoderThread(vtkMultiThreader::ThreadInfo* data);
+
+  /*! Start the video encoder thread */
+  PlusStatus StartVideoEncoding();
+
+  /*! Encode the frames that are already queued and stop the video encoder thread */
+  void StopVideoEncoding();
+
+  /*! Queue the frames for encoding in all shared video encoders. Frames must not be deleted before WaitForVideoEncoding returns. */
+  void QueueFramesForVideoEncoding(vtkIGSIOTrackedFrameList* trackedFrameList);
+
+  /*! Wait until all queued frames are encoded and release them from the shared video encoders */
+  void WaitForVideoEncoding();
+
+  /*! Assign a shared video encoder to each video stream of the client. Client list must be locked. */
+  void AssignSharedVideoEncoders(ClientData& client);
+
+  /*! Remove the shared video encoders that are not used by any client. Client list must be locked. */
+  void RemoveUnusedSharedVideoEncoders();
+
   /*! Process the message replies queue and send messages */
   static PlusStatus SendMessageResponses(vtkPlusOpenIGTLinkServer& self);
 
@@ -196,6 +257,18 @@ protected:
   /*! Stops client's data receiving thread, closes the socket, and removes the client from the client list */
   void DisconnectClient(int clientId);
 
+  /*! Publish the metrics of a newly connected client. Client list must be locked. */
+  void RegisterClientMetrics(ClientData& client);
+
+  /*! Update the number of bytes sent to the client. Client list must be locked. */
+  static void RecordBytesSent(ClientData& client, igtlUint64 numberOfBytes);
+
+  /*! Update the response queue depth gauge. Message response queue must be locked. */
+  void UpdateMessageResponseQueueMetrics();
+
+  /*! Update client send rates and write the metrics file if the update period has elapsed */
+  void UpdateMetrics();
+
   /*! Set IGTL CRC check flag (0: disabled, 1: enabled) */
   vtkSetMacro(IgtlMessageCrcCheckEnabled, bool);
   /*! Get IGTL CRC check flag (0: disabled, 1: enabled) */
@@ -204,6 +277,35 @@ protected:
   vtkSetMacro(LogWarningOnNoDataAvailable, bool);
   vtkGetMacroConst(LogWarningOnNoDataAvailable, bool);
 
+  /*!
+    If enabled then image data of IMAGE and TRACKEDFRAME messages is not copied into the message buffer,
+    but it is sent directly from the tracked frame using a gather write. Enabled by default.
+  */
+  vtkSetMacro(ScatterGatherSendEnabled, bool);
+  vtkGetMacroConst(ScatterGatherSendEnabled, bool);
+
+  /*! If enabled then clients on the same host can request to receive tracked frames through shared memory. Disabled by default. */
+  vtkSetMacro(SharedMemoryTransportEnabled, bool);
+  vtkGetMacroConst(SharedMemoryTransportEnabled, bool);
+
+  /*! Default number of frames in the shared memory ring of a client */
+  vtkSetMacro(SharedMemoryNumberOfSlots, int);
+  vtkGetMacroConst(SharedMemoryNumberOfSlots, int);
+
+  /*!
+    Number of worker threads that execute commands. If 0 (default) then commands are executed
+    by the application's main thread by calling ProcessPendingCommands.
+  */
+  vtkSetMacro(CommandExecutionThreads, int);
+  vtkGetMacroConst(CommandExecutionThreads, int);
+
+  /*!
+    If enabled then clients that request video streams with the same encoding parameters share an encoder,
+    so that each frame is encoded only once, on a dedicated thread. Enabled by default.
+  */
+  vtkSetMacro(SharedVideoEncoding, bool);
+  vtkGetMacroConst(SharedVideoEncoding, bool);
+
   vtkSetMacro(MaxNumberOfIgtlMessagesToSend, int);
   vtkGetMacroConst(MaxNumberOfIgtlMessagesToSend, int);
 
@@ -320,6 +422,28 @@ private:
 
   bool LogWarningOnNoDataAvailable;
 
+  bool ScatterGatherSendEnabled;
+
+  bool SharedMemoryTransportEnabled;
+  int SharedMemoryNumberOfSlots;
+
+  int CommandExecutionThreads;
+
+  bool SharedVideoEncoding;
+
+  /*! Encoders that are shared between video streams of clients. Protected by IgtlClientsMutex. */
+  std::vector<vtkSmartPointer<vtkPlusIgtlSharedVideoEncoder> > SharedVideoEncoders;
+
+  /*! Encoders that have queued frames, waiting for the video encoder thread */
+  std::deque<vtkSmartPointer<vtkPlusIgtlSharedVideoEncoder> > VideoEncodingJobs;
+  /*! Number of encoders that are queued or being processed by the video encoder thread */
+  int NumberOfPendingVideoEncodingJobs;
+  bool VideoEncodingActive;
+  int VideoEncoderThreadId;
+  /*! Protects the video encoding job queue. VideoEncodingCondition is notified when a job is queued or completed. */
+  std::mutex VideoEncodingMutex;
+  std::condition_variable VideoEncodingCondition;
+
   double KeepAliveIntervalSec;
 
   std::string ConfigFilename;
@@ -334,6 +458,12 @@ private:
   static const float CLIENT_SOCKET_TIMEOUT_SEC;
 
   bool NewClientConnected;
+
+  std::string MetricsFile;
+  double MetricsUpdatePeriodSec;
+  double LastMetricsUpdateTime;
+  PlusMetricsRegistry::Gauge* ConnectedClientsGauge;
+  PlusMetricsRegistry::Gauge* MessageResponseQueueDepthGauge;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,287 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file CompareVolumesBenchmark.cxx
+  \brief Measures the number of compared voxels per second of vtkPlusCompareVolumes on synthetic volumes
+
+  The comparison is performed with a single thread and with the requested number of threads and the
+  resulting statistics are checked to be identical. Optionally the statistics are also verified against
+  values computed from the sorted list of all differences.
+*/
+
+#include "PlusConfigure.h"
+#include "vtkPlusCompareVolumes.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkMultiThreader.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  vtkSmartPointer<vtkImageData> CreateVolume(int size)
+  {
+    vtkSmartPointer<vtkImageData> volume = vtkSmartPointer<vtkImageData>::New();
+    volume->SetExtent(0, size - 1, 0, size - 1, 0, size - 1);
+    volume->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    return volume;
+  }
+
+  //----------------------------------------------------------------------------
+  double MeasureComparison(vtkPlusCompareVolumes* comparer, int numberOfThreads)
+  {
+    comparer->SetNumberOfThreads(numberOfThreads);
+    comparer->Modified();
+    double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+    comparer->Update();
+    return vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
+  }
+
+  //----------------------------------------------------------------------------
+  void GetStatistics(vtkPlusCompareVolumes* comparer, std::vector<double>& statistics)
+  {
+    statistics.clear();
+    statistics.push_back(comparer->GetNumberVoxelsVisible());
+    statistics.push_back(comparer->GetNumberOfHoles());
+    statistics.push_back(comparer->GetNumberOfFilledHoles());
+    statistics.push_back(comparer->GetTrueMean());
+    statistics.push_back(comparer->GetTrueStdev());
+    statistics.push_back(comparer->GetTrueMinimum());
+    statistics.push_back(comparer->GetTrueMaximum());
+    statistics.push_back(comparer->GetTrueMedian());
+    statistics.push_back(comparer->GetTrue5thPercentile());
+    statistics.push_back(comparer->GetTrue95thPercentile());
+    statistics.push_back(comparer->GetAbsoluteMean());
+    statistics.push_back(comparer->GetAbsoluteStdev());
+    statistics.push_back(comparer->GetAbsoluteMinimum());
+    statistics.push_back(comparer->GetAbsoluteMaximum());
+    statistics.push_back(comparer->GetAbsoluteMedian());
+    statistics.push_back(comparer->GetAbsolute5thPercentile());
+    statistics.push_back(comparer->GetAbsolute95thPercentile());
+    statistics.push_back(comparer->GetRMS());
+    statistics.push_back(comparer->GetAbsoluteMeanWithHoles());
+  }
+
+  //----------------------------------------------------------------------------
+  double GetPercentileFromSortedValues(const std::vector<double>& sortedValues, double percentile)
+  {
+    int count = sortedValues.size();
+    double rank = (count - 1) * percentile;
+    double fraction = fmod(rank, 1.0);
+    int rankFloor = std::max(static_cast<int>(floor(rank)), 0);
+    int rankCeil = std::min(static_cast<int>(ceil(rank)), count - 1);
+    return sortedValues[rankFloor] * (1 - fraction) + sortedValues[rankCeil] * fraction;
+  }
+
+  //----------------------------------------------------------------------------
+  // Computes the statistics by storing and sorting all differences, in the same order as GetStatistics
+  void ComputeReferenceStatistics(vtkImageData* gt, vtkImageData* gtAlpha, vtkImageData* test, vtkImageData* testAlpha, vtkImageData* slicesAlpha, std::vector<double>& statistics)
+  {
+    unsigned char* gtPtr = static_cast<unsigned char*>(gt->GetScalarPointer());
+    unsigned char* gtAlphaPtr = static_cast<unsigned char*>(gtAlpha->GetScalarPointer());
+    unsigned char* testPtr = static_cast<unsigned char*>(test->GetScalarPointer());
+    unsigned char* testAlphaPtr = static_cast<unsigned char*>(testAlpha->GetScalarPointer());
+    unsigned char* slicesAlphaPtr = static_cast<unsigned char*>(slicesAlpha->GetScalarPointer());
+
+    std::vector<double> trueDifferences;
+    std::vector<double> absoluteDifferences;
+    int countVisibleVoxels = 0;
+    int countHoles = 0;
+    double absoluteSumWithHoles = 0.0;
+    vtkIdType numberOfVoxels = gt->GetNumberOfPoints();
+    for (vtkIdType i = 0; i < numberOfVoxels; i++)
+    {
+      if (gtAlphaPtr[i] == 0)
+      {
+        continue;
+      }
+      countVisibleVoxels++;
+      if (slicesAlphaPtr[i] != 0)
+      {
+        continue;
+      }
+      countHoles++;
+      double difference = (double)gtPtr[i] - testPtr[i];
+      absoluteSumWithHoles += fabs(difference);
+      if (testAlphaPtr[i] != 0)
+      {
+        trueDifferences.push_back(difference);
+        absoluteDifferences.push_back(fabs(difference));
+      }
+    }
+
+    int count = trueDifferences.size();
+    double trueMean = 0.0;
+    double absoluteMean = 0.0;
+    double rms = 0.0;
+    for (int i = 0; i < count; i++)
+    {
+      trueMean += trueDifferences[i];
+      absoluteMean += absoluteDifferences[i];
+      rms += trueDifferences[i] * trueDifferences[i];
+    }
+    trueMean /= std::max(count, 1);
+    absoluteMean /= std::max(count, 1);
+    rms = sqrt(rms / std::max(count, 1));
+    double trueStdev = 0.0;
+    double absoluteStdev = 0.0;
+    for (int i = 0; i < count; i++)
+    {
+      trueStdev += (trueDifferences[i] - trueMean) * (trueDifferences[i] - trueMean);
+      absoluteStdev += (absoluteDifferences[i] - absoluteMean) * (absoluteDifferences[i] - absoluteMean);
+    }
+    trueStdev = sqrt(trueStdev / std::max(count, 1));
+    absoluteStdev = sqrt(absoluteStdev / std::max(count, 1));
+    std::sort(trueDifferences.begin(), trueDifferences.end());
+    std::sort(absoluteDifferences.begin(), absoluteDifferences.end());
+
+    statistics.clear();
+    statistics.push_back(countVisibleVoxels);
+    statistics.push_back(countHoles);
+    statistics.push_back(count);
+    statistics.push_back(trueMean);
+    statistics.push_back(trueStdev);
+    statistics.push_back(count > 0 ? trueDifferences.front() : 0.0);
+    statistics.push_back(count > 0 ? trueDifferences.back() : 0.0);
+    statistics.push_back(count > 0 ? GetPercentileFromSortedValues(trueDifferences, 0.5) : 0.0);
+    statistics.push_back(count > 0 ? GetPercentileFromSortedValues(trueDifferences, 0.05) : 0.0);
+    statistics.push_back(count > 0 ? GetPercentileFromSortedValues(trueDifferences, 0.95) : 0.0);
+    statistics.push_back(absoluteMean);
+    statistics.push_back(absoluteStdev);
+    statistics.push_back(count > 0 ? absoluteDifferences.front() : 0.0);
+    statistics.push_back(count > 0 ? absoluteDifferences.back() : 0.0);
+    statistics.push_back(count > 0 ? GetPercentileFromSortedValues(absoluteDifferences, 0.5) : 0.0);
+    statistics.push_back(count > 0 ? GetPercentileFromSortedValues(absoluteDifferences, 0.05) : 0.0);
+    statistics.push_back(count > 0 ? GetPercentileFromSortedValues(absoluteDifferences, 0.95) : 0.0);
+    statistics.push_back(rms);
+    statistics.push_back(countHoles > 0 ? absoluteSumWithHoles / countHoles : 0.0);
+  }
+
+  //----------------------------------------------------------------------------
+  bool AreStatisticsEqual(const std::vector<double>& statistics1, const std::vector<double>& statistics2)
+  {
+    const double tolerance = 1e-6;
+    for (unsigned int i = 0; i < statistics1.size(); i++)
+    {
+      if (fabs(statistics1[i] - statistics2[i]) > tolerance * std::max(1.0, fabs(statistics1[i])))
+      {
+        LOG_ERROR("Statistics value " << i << " mismatch: " << statistics1[i] << " != " << statistics2[i]);
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp = false;
+  int volumeSize = 256;
+  double holeRatio = 0.3;
+  int numberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  bool verify = false;
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help");
+  args.AddArgument("--size", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &volumeSize, "Number of voxels along each axis of the synthetic volumes (default: 256)");
+  args.AddArgument("--hole-ratio", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &holeRatio, "Ratio of visible voxels that are holes (default: 0.3)");
+  args.AddArgument("--threads", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfThreads, "Number of threads for the parallel comparison (default: number of processors)");
+  args.AddArgument("--verify", vtksys::CommandLineArguments::NO_ARGUMENT, &verify, "Verify the statistics against values computed from all sorted differences");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  if (volumeSize < 1 || numberOfThreads < 1)
+  {
+    LOG_ERROR("Volume size and number of threads must be positive");
+    exit(EXIT_FAILURE);
+  }
+
+  // Synthetic volumes: the test volume is the ground truth with noise, holes are filled in most cases
+  vtkSmartPointer<vtkImageData> gt = CreateVolume(volumeSize);
+  vtkSmartPointer<vtkImageData> gtAlpha = CreateVolume(volumeSize);
+  vtkSmartPointer<vtkImageData> test = CreateVolume(volumeSize);
+  vtkSmartPointer<vtkImageData> testAlpha = CreateVolume(volumeSize);
+  vtkSmartPointer<vtkImageData> slicesAlpha = CreateVolume(volumeSize);
+  unsigned char* gtPtr = static_cast<unsigned char*>(gt->GetScalarPointer());
+  unsigned char* gtAlphaPtr = static_cast<unsigned char*>(gtAlpha->GetScalarPointer());
+  unsigned char* testPtr = static_cast<unsigned char*>(test->GetScalarPointer());
+  unsigned char* testAlphaPtr = static_cast<unsigned char*>(testAlpha->GetScalarPointer());
+  unsigned char* slicesAlphaPtr = static_cast<unsigned char*>(slicesAlpha->GetScalarPointer());
+  vtkIdType numberOfVoxels = gt->GetNumberOfPoints();
+  vtkMath::RandomSeed(1234);
+  for (vtkIdType i = 0; i < numberOfVoxels; i++)
+  {
+    gtPtr[i] = static_cast<unsigned char>(vtkMath::Random(0, 255));
+    testPtr[i] = static_cast<unsigned char>(std::min(std::max(gtPtr[i] + vtkMath::Gaussian(0, 20), 0.0), 255.0));
+    gtAlphaPtr[i] = (vtkMath::Random() < 0.9) ? 255 : 0;
+    slicesAlphaPtr[i] = (vtkMath::Random() < holeRatio) ? 0 : 255;
+    testAlphaPtr[i] = (vtkMath::Random() < 0.9) ? 255 : 0;
+  }
+
+  vtkSmartPointer<vtkPlusCompareVolumes> comparer = vtkSmartPointer<vtkPlusCompareVolumes>::New();
+  comparer->SetInputGT(gt);
+  comparer->SetInputGTAlpha(gtAlpha);
+  comparer->SetInputTest(test);
+  comparer->SetInputTestAlpha(testAlpha);
+  comparer->SetInputSliceAlpha(slicesAlpha);
+
+  std::vector<double> singleThreadStatistics;
+  double singleThreadTimeSec = MeasureComparison(comparer, 1);
+  GetStatistics(comparer, singleThreadStatistics);
+
+  std::vector<double> multiThreadStatistics;
+  double multiThreadTimeSec = MeasureComparison(comparer, numberOfThreads);
+  GetStatistics(comparer, multiThreadStatistics);
+
+  LOG_INFO("Volume size: " << volumeSize << "^3, visible voxels: " << comparer->GetNumberVoxelsVisible() << ", holes: " << comparer->GetNumberOfHoles() << ", filled holes: " << comparer->GetNumberOfFilledHoles());
+  LOG_INFO("1 thread: " << numberOfVoxels / singleThreadTimeSec << " voxels/sec");
+  LOG_INFO(numberOfThreads << " threads: " << numberOfVoxels / multiThreadTimeSec << " voxels/sec (speedup: " << singleThreadTimeSec / multiThreadTimeSec << ")");
+
+  if (!AreStatisticsEqual(singleThreadStatistics, multiThreadStatistics))
+  {
+    LOG_ERROR("Single and multi-threaded comparison results are different");
+    exit(EXIT_FAILURE);
+  }
+
+  if (verify)
+  {
+    std::vector<double> referenceStatistics;
+    ComputeReferenceStatistics(gt, gtAlpha, test, testAlpha, slicesAlpha, referenceStatistics);
+    if (!AreStatisticsEqual(referenceStatistics, multiThreadStatistics))
+    {
+      LOG_ERROR("Comparison results are different from the reference statistics");
+      exit(EXIT_FAILURE);
+    }
+    LOG_INFO("Statistics match the reference values computed from all sorted differences");
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,319 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file LiveVolumeUpdateBenchmark.cxx
+  \brief Measures the size and latency of live volume reconstruction updates on a recorded sweep
+
+  The frames of the sequence file are pasted into the volume in the order of their timestamps and a live update
+  is prepared whenever the update period elapses in the sequence time. Each update contains the modified bricks
+  of the volume or, in the first update, periodically, and when most of the volume is modified, the whole volume.
+  The number of bytes in the updates is compared to the number of bytes that would be sent if the whole volume
+  was sent in each update (as with the GetVolumeReconstructionSnapshot command).
+
+  Latency of an update is the time from the acquisition of the oldest frame in the update (in sequence time)
+  until the update is prepared (waiting for the update period plus the measured preparation time).
+*/
+
+#include "PlusConfigure.h"
+#include "igsioTrackedFrame.h"
+#include "vtkIGSIOSequenceIO.h"
+#include "vtkIGSIOTrackedFrameList.h"
+#include "vtkIGSIOTransformRepository.h"
+#include "vtkPlusVolumeReconstructor.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkSmartPointer.h>
+#include <vtkXMLDataElement.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+// STL includes
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace
+{
+  // If more of the volume is modified then the whole volume is sent (same as in vtkPlusVirtualVolumeReconstructor)
+  const double MAX_MODIFIED_VOLUME_FRACTION = 0.5;
+
+  struct UpdateStatistics
+  {
+    UpdateStatistics()
+      : NumberOfUpdates(0)
+      , NumberOfKeyframes(0)
+      , NumberOfBricks(0)
+      , NumberOfSentBytes(0)
+      , NumberOfSnapshotBytes(0)
+      , TotalPreparationTimeSec(0)
+      , MaxPreparationTimeSec(0)
+      , NumberOfLatencyMeasurements(0)
+      , TotalLatencySec(0)
+      , MaxLatencySec(0)
+    {
+    }
+    int NumberOfUpdates;
+    int NumberOfKeyframes;
+    unsigned long long NumberOfBricks;
+    unsigned long long NumberOfSentBytes;
+    unsigned long long NumberOfSnapshotBytes;
+    double TotalPreparationTimeSec;
+    double MaxPreparationTimeSec;
+    int NumberOfLatencyMeasurements;
+    double TotalLatencySec;
+    double MaxLatencySec;
+  };
+
+  //----------------------------------------------------------------------------
+  unsigned long long GetImageSizeInBytes(vtkImageData* image)
+  {
+    return static_cast<unsigned long long>(image->GetNumberOfPoints()) * image->GetScalarSize() * image->GetNumberOfScalarComponents();
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus PrepareUpdate(vtkPlusVolumeReconstructor* reconstructor, double updateTime, double keyframePeriodSec, double& lastKeyframeTime, UpdateStatistics& statistics)
+  {
+    double startTimeSec = vtkIGSIOAccurateTimer::GetSystemTime();
+
+    vtkSmartPointer<vtkImageData> volume = vtkSmartPointer<vtkImageData>::New();
+    if (reconstructor->ExtractGrayLevels(volume) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Extracting gray levels failed");
+      return PLUS_FAIL;
+    }
+    std::vector< std::array<int, 6> > modifiedBrickExtents;
+    double oldestModificationTimestamp = UNDEFINED_TIMESTAMP;
+    bool isKeyframe = !reconstructor->GetModifiedBrickExtents(volume, modifiedBrickExtents, oldestModificationTimestamp);
+    if (statistics.NumberOfUpdates == 0 || updateTime - lastKeyframeTime >= keyframePeriodSec)
+    {
+      isKeyframe = true;
+    }
+
+    unsigned long long numberOfModifiedVoxels = 0;
+    for (std::vector< std::array<int, 6> >::const_iterator brickIt = modifiedBrickExtents.begin(); brickIt != modifiedBrickExtents.end(); ++brickIt)
+    {
+      numberOfModifiedVoxels += static_cast<unsigned long long>((*brickIt)[1] - (*brickIt)[0] + 1) * ((*brickIt)[3] - (*brickIt)[2] + 1) * ((*brickIt)[5] - (*brickIt)[4] + 1);
+    }
+    if (numberOfModifiedVoxels > MAX_MODIFIED_VOLUME_FRACTION * volume->GetNumberOfPoints())
+    {
+      isKeyframe = true;
+    }
+
+    unsigned long long numberOfBytes = 0;
+    if (isKeyframe)
+    {
+      numberOfBytes = GetImageSizeInBytes(volume);
+      lastKeyframeTime = updateTime;
+      statistics.NumberOfKeyframes++;
+    }
+    else
+    {
+      vtkSmartPointer<vtkImageData> brick = vtkSmartPointer<vtkImageData>::New();
+      for (std::vector< std::array<int, 6> >::const_iterator brickIt = modifiedBrickExtents.begin(); brickIt != modifiedBrickExtents.end(); ++brickIt)
+      {
+        if (vtkPlusVolumeReconstructor::ExtractBrick(volume, brickIt->data(), brick) != PLUS_SUCCESS)
+        {
+          return PLUS_FAIL;
+        }
+        numberOfBytes += GetImageSizeInBytes(brick);
+      }
+      statistics.NumberOfBricks += modifiedBrickExtents.size();
+    }
+
+    double preparationTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTimeSec;
+    statistics.NumberOfUpdates++;
+    statistics.NumberOfSentBytes += numberOfBytes;
+    statistics.NumberOfSnapshotBytes += GetImageSizeInBytes(volume);
+    statistics.TotalPreparationTimeSec += preparationTimeSec;
+    statistics.MaxPreparationTimeSec = std::max(statistics.MaxPreparationTimeSec, preparationTimeSec);
+    if (oldestModificationTimestamp != UNDEFINED_TIMESTAMP)
+    {
+      double latencySec = updateTime - oldestModificationTimestamp + preparationTimeSec;
+      statistics.NumberOfLatencyMeasurements++;
+      statistics.TotalLatencySec += latencySec;
+      statistics.MaxLatencySec = std::max(statistics.MaxLatencySec, latencySec);
+    }
+
+    LOG_DEBUG("Update " << statistics.NumberOfUpdates << ": " << (isKeyframe ? "keyframe" : "modified bricks")
+              << ", " << (isKeyframe ? 1 : modifiedBrickExtents.size()) << " image(s), " << numberOfBytes << " bytes, prepared in " << preparationTimeSec << " sec");
+    return PLUS_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  bool printHelp(false);
+  std::string inputImgSeqFileName;
+  std::string inputConfigFileName;
+  std::string inputImageToReferenceTransformName;
+  double updatePeriodSec(0.25);
+  double keyframePeriodSec(10.0);
+  int brickSize(32);
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments cmdargs;
+  cmdargs.Initialize(argc, argv);
+
+  cmdargs.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help.");
+  cmdargs.AddArgument("--source-seq-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &inputImgSeqFileName, "Input sequence file filename (.mha/.nrrd)");
+  cmdargs.AddArgument("--config-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &inputConfigFileName, "Input configuration file name (.xml)");
+  cmdargs.AddArgument("--image-to-reference-transform", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &inputImageToReferenceTransformName, "Name of the transform to define the image slice pose relative to the reference coordinate system (optional, overrides the configuration file)");
+  cmdargs.AddArgument("--update-period-sec", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &updatePeriodSec, "Time between live updates, in sequence time (default: 0.25)");
+  cmdargs.AddArgument("--keyframe-period-sec", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &keyframePeriodSec, "Maximum time between updates that contain the whole volume, in sequence time (default: 10)");
+  cmdargs.AddArgument("--brick-size", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &brickSize, "Size of the bricks in voxels along each axis (default: 32)");
+  cmdargs.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!cmdargs.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << cmdargs.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (printHelp)
+  {
+    std::cout << cmdargs.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (inputConfigFileName.empty() || inputImgSeqFileName.empty())
+  {
+    LOG_ERROR("--config-file and --source-seq-file arguments are required");
+    std::cout << "Help: " << cmdargs.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (updatePeriodSec <= 0)
+  {
+    LOG_ERROR("--update-period-sec must be positive");
+    exit(EXIT_FAILURE);
+  }
+
+  vtkSmartPointer<vtkXMLDataElement> configRootElement = vtkSmartPointer<vtkXMLDataElement>::New();
+  if (PlusXmlUtils::ReadDeviceSetConfigurationFromFile(configRootElement, inputConfigFileName.c_str()) == PLUS_FAIL)
+  {
+    LOG_ERROR("Unable to read configuration from file " << inputConfigFileName);
+    exit(EXIT_FAILURE);
+  }
+
+  vtkSmartPointer<vtkPlusVolumeReconstructor> reconstructor = vtkSmartPointer<vtkPlusVolumeReconstructor>::New();
+  if (reconstructor->ReadConfiguration(configRootElement) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to read configuration from " << inputConfigFileName);
+    exit(EXIT_FAILURE);
+  }
+  reconstructor->SetModifiedBrickSize(brickSize);
+
+  vtkSmartPointer<vtkIGSIOTransformRepository> transformRepository = vtkSmartPointer<vtkIGSIOTransformRepository>::New();
+  if (configRootElement->FindNestedElementWithName("CoordinateDefinitions") != NULL)
+  {
+    if (transformRepository->ReadConfiguration(configRootElement) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to read transforms from CoordinateDefinitions");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (!inputImageToReferenceTransformName.empty())
+  {
+    igsioTransformName imageToReferenceTransformName;
+    if (imageToReferenceTransformName.SetTransformName(inputImageToReferenceTransformName.c_str()) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Invalid image to reference transform name: " << inputImageToReferenceTransformName);
+      exit(EXIT_FAILURE);
+    }
+    reconstructor->SetImageCoordinateFrame(imageToReferenceTransformName.From());
+    reconstructor->SetReferenceCoordinateFrame(imageToReferenceTransformName.To());
+  }
+
+  vtkSmartPointer<vtkIGSIOTrackedFrameList> trackedFrameList = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+  if (vtkIGSIOSequenceIO::Read(inputImgSeqFileName, trackedFrameList) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Unable to load input sequence file " << inputImgSeqFileName);
+    exit(EXIT_FAILURE);
+  }
+  const int numberOfFrames = trackedFrameList->GetNumberOfTrackedFrames();
+  if (numberOfFrames < 1)
+  {
+    LOG_ERROR("Input sequence file does not contain any frames: " << inputImgSeqFileName);
+    exit(EXIT_FAILURE);
+  }
+
+  std::string errorDetail;
+  if (reconstructor->SetOutputExtentFromFrameList(trackedFrameList, transformRepository, errorDetail) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to set output extent of volume: " << errorDetail);
+    exit(EXIT_FAILURE);
+  }
+
+  UpdateStatistics statistics;
+  double lastKeyframeTime = 0;
+  double nextUpdateTime = trackedFrameList->GetTrackedFrame(0)->GetTimestamp() + updatePeriodSec;
+  bool updatePending = false;
+  for (int frameIndex = 0; frameIndex < numberOfFrames; frameIndex += reconstructor->GetSkipInterval())
+  {
+    igsioTrackedFrame* frame = trackedFrameList->GetTrackedFrame(frameIndex);
+    if (updatePending && frame->GetTimestamp() >= nextUpdateTime)
+    {
+      // The update is prepared before this frame is acquired
+      if (PrepareUpdate(reconstructor, nextUpdateTime, keyframePeriodSec, lastKeyframeTime, statistics) != PLUS_SUCCESS)
+      {
+        exit(EXIT_FAILURE);
+      }
+      updatePending = false;
+    }
+    while (nextUpdateTime <= frame->GetTimestamp())
+    {
+      nextUpdateTime += updatePeriodSec;
+    }
+
+    if (transformRepository->SetTransforms(*frame) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to update transform repository with frame #" << frameIndex);
+      continue;
+    }
+    bool insertedIntoVolume = false;
+    if (reconstructor->AddTrackedFrame(frame, transformRepository, &insertedIntoVolume) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to add tracked frame to volume with frame #" << frameIndex);
+      continue;
+    }
+    if (insertedIntoVolume)
+    {
+      reconstructor->AddModifiedRegion(frame, transformRepository);
+      updatePending = true;
+    }
+  }
+  if (updatePending)
+  {
+    if (PrepareUpdate(reconstructor, nextUpdateTime, keyframePeriodSec, lastKeyframeTime, statistics) != PLUS_SUCCESS)
+    {
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (statistics.NumberOfUpdates == 0)
+  {
+    LOG_ERROR("No frames were inserted into the volume");
+    exit(EXIT_FAILURE);
+  }
+
+  LOG_INFO("Number of updates: " << statistics.NumberOfUpdates << " (" << statistics.NumberOfKeyframes << " keyframes, "
+           << statistics.NumberOfBricks << " bricks of " << brickSize << " voxels)");
+  LOG_INFO("Sent data: " << statistics.NumberOfSentBytes / 1e6 << " MB, sending the whole volume in each update: "
+           << statistics.NumberOfSnapshotBytes / 1e6 << " MB (" << 100.0 * statistics.NumberOfSentBytes / std::max(statistics.NumberOfSnapshotBytes, 1ULL) << "%)");
+  LOG_INFO("Update preparation time: mean " << statistics.TotalPreparationTimeSec / statistics.NumberOfUpdates << " sec, max " << statistics.MaxPreparationTimeSec << " sec");
+  if (statistics.NumberOfLatencyMeasurements > 0)
+  {
+    LOG_INFO("Latency from frame acquisition to update: mean " << statistics.TotalLatencySec / statistics.NumberOfLatencyMeasurements
+             << " sec, max " << statistics.MaxLatencySec << " sec");
+  }
+
+  return EXIT_SUCCESS;
+}
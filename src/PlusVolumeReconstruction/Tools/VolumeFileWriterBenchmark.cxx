@@ -0,0 +1,274 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+/*!
+  \file VolumeFileWriterBenchmark.cxx
+  \brief Measures the write speed and memory usage of saving a large synthetic reconstructed volume
+
+  The volume is written either by vtkPlusVolumeFileWriter (STREAMING method) or by copying it into a tracked frame
+  list and writing it as a sequence file (SEQUENCE method, which is how volumes were saved before). The peak memory
+  usage of the process is monotonic, so each method has to be measured in a separate run of the program.
+  Optionally the written file is read back and compared to the volume. vtkNrrdReader cannot decode gzip encoding,
+  so .nrrd files can only be verified if they are written uncompressed.
+*/
+
+#include "PlusConfigure.h"
+#include "igsioTrackedFrame.h"
+#include "vtkIGSIOTrackedFrameList.h"
+#include "vtkPlusSequenceIO.h"
+#include "vtkPlusVolumeFileWriter.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMetaImageReader.h>
+#include <vtkMultiThreader.h>
+#include <vtkNrrdReader.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/CommandLineArguments.hxx>
+#include <vtksys/SystemTools.hxx>
+
+// OS includes
+#ifdef _WIN32
+  #include <windows.h>
+  #include <psapi.h>
+  #pragma comment(lib, "psapi.lib")
+#else
+  #include <sys/resource.h>
+#endif
+
+// STL includes
+#include <cstring>
+#include <iomanip>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  /*! Peak resident memory of the process in bytes (0 if not available) */
+  unsigned long long GetPeakMemoryUsageBytes()
+  {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+      return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+      return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<unsigned long long>(usage.ru_maxrss);
+#else
+    return static_cast<unsigned long long>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Volume that looks like a reconstruction: smooth gray levels with speckle inside, empty background outside */
+  vtkSmartPointer<vtkImageData> CreateVolume(int size)
+  {
+    vtkSmartPointer<vtkImageData> volume = vtkSmartPointer<vtkImageData>::New();
+    volume->SetExtent(0, size - 1, 0, size - 1, 0, size - 1);
+    volume->SetSpacing(0.5, 0.5, 0.5);
+    volume->SetOrigin(-10.0, 20.0, 30.0);
+    volume->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    unsigned char* voxels = static_cast<unsigned char*>(volume->GetScalarPointer());
+    unsigned int randomState = 1234;
+    const double radius = size * 0.45;
+    for (int z = 0; z < size; ++z)
+    {
+      for (int y = 0; y < size; ++y)
+      {
+        for (int x = 0; x < size; ++x, ++voxels)
+        {
+          double dx = x - size / 2.0;
+          double dy = y - size / 2.0;
+          if (dx * dx + dy * dy > radius * radius)
+          {
+            *voxels = 0;
+            continue;
+          }
+          randomState = randomState * 1103515245 + 12345;
+          *voxels = static_cast<unsigned char>((x + 2 * y + z) % 128 + ((randomState >> 16) & 0x3f));
+        }
+      }
+    }
+    return volume;
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Write the volume as a single-frame sequence file, as volumes were saved before vtkPlusVolumeFileWriter */
+  PlusStatus WriteSequence(vtkImageData* volume, const std::string& filename, bool useCompression)
+  {
+    int dims[3] = { 0, 0, 0 };
+    volume->GetDimensions(dims);
+    FrameSizeType frameSize = { static_cast<unsigned int>(dims[0]), static_cast<unsigned int>(dims[1]), static_cast<unsigned int>(dims[2]) };
+    vtkSmartPointer<vtkIGSIOTrackedFrameList> list = vtkSmartPointer<vtkIGSIOTrackedFrameList>::New();
+    igsioTrackedFrame frame;
+    igsioVideoFrame image;
+    image.AllocateFrame(frameSize, volume->GetScalarType(), volume->GetNumberOfScalarComponents());
+    image.GetImage()->DeepCopy(volume);
+    image.SetImageOrientation(US_IMG_ORIENT_MFA);
+    image.SetImageType(US_IMG_BRIGHTNESS);
+    frame.SetImageData(image);
+    list->AddTrackedFrame(&frame);
+    return vtkPlusSequenceIO::Write(filename, list, US_IMG_ORIENT_MF, useCompression);
+  }
+
+  //----------------------------------------------------------------------------
+  PlusStatus VerifyFile(vtkImageData* volume, const std::string& filename)
+  {
+    std::string filePath = vtkPlusConfig::GetInstance()->GetOutputPath(filename);
+    vtkSmartPointer<vtkImageReader2> reader;
+    if (STRCASECMP(vtksys::SystemTools::GetFilenameLastExtension(filename).c_str(), ".nrrd") == 0)
+    {
+      reader = vtkSmartPointer<vtkNrrdReader>::New();
+    }
+    else
+    {
+      reader = vtkSmartPointer<vtkMetaImageReader>::New();
+    }
+    reader->SetFileName(filePath.c_str());
+    reader->Update();
+    vtkImageData* readVolume = reader->GetOutput();
+    int dims[3] = { 0, 0, 0 };
+    int readDims[3] = { 0, 0, 0 };
+    volume->GetDimensions(dims);
+    readVolume->GetDimensions(readDims);
+    if (dims[0] != readDims[0] || dims[1] != readDims[1] || dims[2] != readDims[2] || readVolume->GetScalarType() != volume->GetScalarType())
+    {
+      LOG_ERROR("Volume read from " << filePath << " has different size or type than the written volume");
+      return PLUS_FAIL;
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+      if (fabs(readVolume->GetSpacing()[i] - volume->GetSpacing()[i]) > 1e-6 || fabs(readVolume->GetOrigin()[i] - volume->GetOrigin()[i]) > 1e-6)
+      {
+        LOG_ERROR("Volume read from " << filePath << " has different geometry than the written volume");
+        return PLUS_FAIL;
+      }
+    }
+    size_t numberOfBytes = static_cast<size_t>(volume->GetNumberOfPoints()) * volume->GetScalarSize() * volume->GetNumberOfScalarComponents();
+    if (memcmp(volume->GetScalarPointer(), readVolume->GetScalarPointer(), numberOfBytes) != 0)
+    {
+      LOG_ERROR("Voxels read from " << filePath << " are different from the written voxels");
+      return PLUS_FAIL;
+    }
+    return PLUS_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  bool printHelp = false;
+  int volumeSize = 512;
+  std::string method = "STREAMING";
+  std::string outputFileName = "VolumeFileWriterBenchmark.mha";
+  int numberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  double slabSizeMb = 4.0;
+  bool disableCompression = false;
+  bool verify = false;
+  int verboseLevel = vtkPlusLogger::LOG_LEVEL_UNDEFINED;
+
+  vtksys::CommandLineArguments args;
+  args.Initialize(argc, argv);
+  args.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT, &printHelp, "Print this help");
+  args.AddArgument("--size", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &volumeSize, "Number of voxels along each axis of the synthetic volume (default: 512)");
+  args.AddArgument("--method", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &method, "Writing method: STREAMING (vtkPlusVolumeFileWriter) or SEQUENCE (single-frame sequence file) (default: STREAMING)");
+  args.AddArgument("--output-file", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &outputFileName, "Output file name (.mha or .nrrd), relative to the output directory (default: VolumeFileWriterBenchmark.mha)");
+  args.AddArgument("--threads", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &numberOfThreads, "Number of compression threads of the STREAMING method (default: number of processors)");
+  args.AddArgument("--slab-size-mb", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &slabSizeMb, "Size of the slabs that are compressed at once by the STREAMING method, in MB (default: 4)");
+  args.AddArgument("--disable-compression", vtksys::CommandLineArguments::NO_ARGUMENT, &disableCompression, "Write the voxels uncompressed");
+  args.AddArgument("--verify", vtksys::CommandLineArguments::NO_ARGUMENT, &verify, "Read back the written file and compare it to the volume (STREAMING method, .mha or uncompressed .nrrd files only)");
+  args.AddArgument("--verbose", vtksys::CommandLineArguments::EQUAL_ARGUMENT, &verboseLevel, "Verbose level (1=error only, 2=warning, 3=info, 4=debug, 5=trace)");
+
+  if (!args.Parse())
+  {
+    std::cerr << "Problem parsing arguments" << std::endl;
+    std::cout << "Help: " << args.GetHelp() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  vtkPlusLogger::Instance()->SetLogLevel(verboseLevel);
+
+  if (printHelp)
+  {
+    std::cout << args.GetHelp() << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  const bool streaming = (STRCASECMP(method.c_str(), "STREAMING") == 0);
+  if (!streaming && STRCASECMP(method.c_str(), "SEQUENCE") != 0)
+  {
+    LOG_ERROR("Invalid method: " << method << ". Valid methods: STREAMING, SEQUENCE");
+    exit(EXIT_FAILURE);
+  }
+  if (volumeSize < 1 || numberOfThreads < 1 || slabSizeMb <= 0)
+  {
+    LOG_ERROR("Volume size, number of threads, and slab size must be positive");
+    exit(EXIT_FAILURE);
+  }
+
+  vtkSmartPointer<vtkImageData> volume = CreateVolume(volumeSize);
+  const double volumeSizeMb = volume->GetNumberOfPoints() * volume->GetScalarSize() / 1.0e6;
+  const unsigned long long peakMemoryBeforeWriteBytes = GetPeakMemoryUsageBytes();
+
+  double startTime = vtkIGSIOAccurateTimer::GetSystemTime();
+  PlusStatus status = PLUS_FAIL;
+  if (streaming)
+  {
+    vtkSmartPointer<vtkPlusVolumeFileWriter> writer = vtkSmartPointer<vtkPlusVolumeFileWriter>::New();
+    writer->SetUseCompression(!disableCompression);
+    writer->SetNumberOfThreads(numberOfThreads);
+    writer->SetSlabSizeBytes(static_cast<int>(slabSizeMb * 1024 * 1024));
+    status = writer->Write(volume, outputFileName);
+  }
+  else
+  {
+    status = WriteSequence(volume, outputFileName, !disableCompression);
+  }
+  const double writeTimeSec = vtkIGSIOAccurateTimer::GetSystemTime() - startTime;
+  const unsigned long long peakMemoryAfterWriteBytes = GetPeakMemoryUsageBytes();
+
+  if (status != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to write volume to " << outputFileName);
+    exit(EXIT_FAILURE);
+  }
+
+  std::string filePath = vtkPlusConfig::GetInstance()->GetOutputPath(outputFileName);
+  const double fileSizeMb = vtksys::SystemTools::FileLength(filePath) / 1.0e6;
+  LOG_INFO("Method: " << (streaming ? "STREAMING" : "SEQUENCE") << (disableCompression ? ", uncompressed" : ", compressed")
+           << (streaming ? ", " + igsioCommon::ToString<int>(numberOfThreads) + " threads" : std::string()));
+  LOG_INFO(std::fixed << std::setprecision(1) << "Volume: " << volumeSize << "^3 voxels, " << volumeSizeMb << " MB, file: " << fileSizeMb << " MB");
+  LOG_INFO(std::fixed << std::setprecision(3) << "Write time: " << writeTimeSec << " sec, "
+           << std::setprecision(1) << (writeTimeSec > 0 ? volumeSizeMb / writeTimeSec : 0.0) << " MB/s (uncompressed volume size per second)");
+  LOG_INFO(std::fixed << std::setprecision(1) << "Peak memory: " << peakMemoryBeforeWriteBytes / 1.0e6 << " MB before writing, "
+           << peakMemoryAfterWriteBytes / 1.0e6 << " MB after writing (increase: " << (peakMemoryAfterWriteBytes - peakMemoryBeforeWriteBytes) / 1.0e6 << " MB)");
+
+  if (verify)
+  {
+    std::string extension = vtksys::SystemTools::GetFilenameLastExtension(outputFileName);
+    const bool verifiableFormat = STRCASECMP(extension.c_str(), ".mha") == 0 || (STRCASECMP(extension.c_str(), ".nrrd") == 0 && disableCompression);
+    if (!streaming || !verifiableFormat)
+    {
+      LOG_ERROR("Verification is only available for .mha and uncompressed .nrrd files written by the STREAMING method");
+      exit(EXIT_FAILURE);
+    }
+    if (VerifyFile(volume, outputFileName) != PLUS_SUCCESS)
+    {
+      exit(EXIT_FAILURE);
+    }
+    LOG_INFO("Volume read back from the file is identical to the written volume");
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -25,17 +25,23 @@
 #include "vtkInformationVector.h"
 #include "vtkObjectFactory.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
-#include <vector>
-#include <list>
+#include <algorithm>
 
 static const int INPUT_GROUND_TRUTH_VOLUME = 0;
 static const int INPUT_GROUND_TRUTH_VOLUME_ALPHA = 1;
 static const int INPUT_TEST_VOLUME = 2;
 static const int INPUT_TEST_VOLUME_ALPHA = 3;
 static const int INPUT_SLICES_VOLUME_ALPHA = 4;
+static const int NUMBER_OF_INPUTS = 5;
 
+static const int OUTPUT_TRUE_DIFF_VOLUME = 0;
 static const int OUTPUT_ABS_DIFF_VOLUME = 1;
 
+// True differences of -255..255 are counted in bins 0..510
+static const int TRUE_HISTOGRAM_SIZE = 511;
+static const int TRUE_HISTOGRAM_OFFSET = 255;
+static const int ABSOLUTE_HISTOGRAM_SIZE = 256;
+
 vtkStandardNewMacro( vtkPlusCompareVolumes );
 
 //----------------------------------------------------------------------------
@@ -101,7 +107,7 @@ int* vtkPlusCompareVolumes::GetAbsoluteHistogramWithHolesPtr()
 //----------------------------------------------------------------------------
 void vtkPlusCompareVolumes::incTrueHistogramAtIndex( int value )
 {
-  int index = value + 256;
+  int index = value + TRUE_HISTOGRAM_OFFSET;
   TrueHistogram[index]++;
 }
 
@@ -122,7 +128,7 @@ void vtkPlusCompareVolumes::incAbsoluteHistogramWithHolesAtIndex( int value )
 //----------------------------------------------------------------------------
 void vtkPlusCompareVolumes::resetTrueHistogram()
 {
-  for ( int i = 0; i < 511; i++ )
+  for ( int i = 0; i < TRUE_HISTOGRAM_SIZE; i++ )
   {
     TrueHistogram[i] = 0;
   }
@@ -150,9 +156,60 @@ vtkPlusCompareVolumes::vtkPlusCompareVolumes()
 {
   this->SetNumberOfInputPorts( 5 );
   this->SetNumberOfOutputPorts( 2 );
-  this->SetNumberOfThreads( 1 ); // TODO: Remove when vtkPlusCompareVolumesExecute is made thread-safe (e.g., simultaneous access to member variables are protected by locking)
 }
 
+//----------------------------------------------------------------------------
+vtkPlusCompareVolumes::DifferenceAccumulator::DifferenceAccumulator()
+  : NumberOfVisibleVoxels( 0 )
+  , NumberOfHoles( 0 )
+  , NumberOfFilledHoles( 0 )
+  , SumOfTrueDifferences( 0.0 )
+  , SumOfSquaredDifferences( 0.0 )
+  , SumOfAbsoluteDifferences( 0.0 )
+  , SumOfAbsoluteDifferencesInHoles( 0.0 )
+  , TrueMinimum( VTK_DOUBLE_MAX )
+  , TrueMaximum( -VTK_DOUBLE_MAX )
+  , AbsoluteMinimum( VTK_DOUBLE_MAX )
+  , AbsoluteMaximum( -VTK_DOUBLE_MAX )
+{
+  std::fill( this->TrueHistogram, this->TrueHistogram + TRUE_HISTOGRAM_SIZE, 0 );
+  std::fill( this->AbsoluteHistogram, this->AbsoluteHistogram + ABSOLUTE_HISTOGRAM_SIZE, 0 );
+  std::fill( this->AbsoluteHistogramWithHoles, this->AbsoluteHistogramWithHoles + ABSOLUTE_HISTOGRAM_SIZE, 0 );
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusCompareVolumes::DifferenceAccumulator::Add( const DifferenceAccumulator& other )
+{
+  this->NumberOfVisibleVoxels += other.NumberOfVisibleVoxels;
+  this->NumberOfHoles += other.NumberOfHoles;
+  this->NumberOfFilledHoles += other.NumberOfFilledHoles;
+  this->SumOfTrueDifferences += other.SumOfTrueDifferences;
+  this->SumOfSquaredDifferences += other.SumOfSquaredDifferences;
+  this->SumOfAbsoluteDifferences += other.SumOfAbsoluteDifferences;
+  this->SumOfAbsoluteDifferencesInHoles += other.SumOfAbsoluteDifferencesInHoles;
+  this->TrueMinimum = std::min( this->TrueMinimum, other.TrueMinimum );
+  this->TrueMaximum = std::max( this->TrueMaximum, other.TrueMaximum );
+  this->AbsoluteMinimum = std::min( this->AbsoluteMinimum, other.AbsoluteMinimum );
+  this->AbsoluteMaximum = std::max( this->AbsoluteMaximum, other.AbsoluteMaximum );
+  for ( int i = 0; i < TRUE_HISTOGRAM_SIZE; i++ )
+  {
+    this->TrueHistogram[i] += other.TrueHistogram[i];
+  }
+  for ( int i = 0; i < ABSOLUTE_HISTOGRAM_SIZE; i++ )
+  {
+    this->AbsoluteHistogram[i] += other.AbsoluteHistogram[i];
+    this->AbsoluteHistogramWithHoles[i] += other.AbsoluteHistogramWithHoles[i];
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusCompareVolumes::MergeAccumulator( const DifferenceAccumulator& accumulator )
+{
+  igsioLockGuard<vtkIGSIOSimpleRecursiveCriticalSection> accumulatorGuard( &this->VolumeAccumulatorMutex );
+  this->VolumeAccumulator.Add( accumulator );
+}
+
+//----------------------------------------------------------------------------
 int vtkPlusCompareVolumes::RequestInformation (
   vtkInformation*        vtkNotUsed( request ),
   vtkInformationVector** vtkNotUsed( inputVector ),
@@ -166,318 +223,253 @@ int vtkPlusCompareVolumes::RequestInformation (
   return 1;
 }
 
-
-template <class T>
-void vtkPlusCompareVolumesExecute( vtkPlusCompareVolumes* self,
-                                   vtkImageData* inData,
-                                   vtkImageData* outData,
-                                   T* gtPtr,
-                                   T* gtAlphaPtr,
-                                   T* testPtr,
-                                   T* testAlphaPtr,
-                                   T* slicesAlphaPtr,
-                                   double* outPtrTru,
-                                   double* outPtrAbs,
-                                   int outExt[6],
-                                   int id )
+namespace
 {
-
-  vtkIdType inOffsets[3] = {0}; //x,y,z
-  inData->GetIncrements( inOffsets[0], inOffsets[1], inOffsets[2] );
-
-  vtkIdType outOffsets[3] = {0}; //x,y,z
-  outData->GetIncrements( outOffsets[0], outOffsets[1], outOffsets[2] );
-
-  int xtemp( 0 ), ytemp( 0 ), ztemp( 0 ); // indices for each of the axes
-  self->resetTrueHistogram(); // count inside the class variables
-  self->resetAbsoluteHistogramWithHoles();
-  self->resetAbsoluteHistogram();
-  std::vector<double> trueDifferences; // store all differences here
-  std::vector<double> absoluteDifferences;
-
-  // same as absolute difference, but in hole voxels -
-  // this can be added to find the absolute error when
-  // we consider holes to be part of the image (and
-  // choose to not ignore them in the error computation)
-  // note these are not put into the histogram
-  std::vector<double> absoluteDifferencesInAllHoles;
-
-  int countVisibleVoxels( 0 );
-  int countFilledHoles( 0 );
-  int countHoles( 0 );
-
-  // iterate through all voxels
-  for ( ztemp = 0; ztemp <= outExt[5] - outExt[4]; ztemp++ )
+  //----------------------------------------------------------------------------
+  // Returns the value at the specified rank (0 = smallest) of the values counted in the histogram
+  double GetSortedValueFromHistogram( const int* histogram, int numberOfBins, int firstBinValue, vtkIdType rank )
   {
-    for ( ytemp = 0; ytemp <= outExt[3] - outExt[2]; ytemp++ )
+    vtkIdType cumulativeCount = 0;
+    for ( int bin = 0; bin < numberOfBins; bin++ )
     {
-      for ( xtemp = 0; xtemp <= outExt[1] - outExt[0]; xtemp++ )
+      cumulativeCount += histogram[bin];
+      if ( cumulativeCount > rank )
       {
-        int inIndex  =  inOffsets[0] * xtemp + inOffsets[1] * ytemp + inOffsets[2] * ztemp;
-        int outIndex = outOffsets[0] * xtemp + outOffsets[1] * ytemp + outOffsets[2] * ztemp;
-        if ( gtAlphaPtr[inIndex] != 0 )
-        {
-          countVisibleVoxels++;
-          if ( slicesAlphaPtr[inIndex] == 0 )
-          {
-            countHoles++;
-            double difference = ( double )gtPtr[inIndex] - testPtr[inIndex];
-            self->incAbsoluteHistogramWithHolesAtIndex( igsioMath::Round( fabs( difference ) ) );
-            absoluteDifferencesInAllHoles.push_back( fabs( difference ) );
-            if ( testAlphaPtr[inIndex] != 0 )
-            {
-              countFilledHoles++;
-              trueDifferences.push_back( difference );
-              self->incTrueHistogramAtIndex( igsioMath::Round( difference ) );
-              outPtrTru[outIndex] = difference; // cast to double to minimize precision loss
-              absoluteDifferences.push_back( fabs( difference ) );
-              self->incAbsoluteHistogramAtIndex( igsioMath::Round( fabs( difference ) ) );
-              outPtrAbs[outIndex] = fabs( difference );
-            }
-          }
-          else // not a hole, but these may still be different
-          {
-            //double difference = (double)gtPtr[inIndex] - testPtr[inIndex]; // cast to double to minimize precision loss
-            outPtrTru[outIndex] = 0.0; //difference;
-            outPtrAbs[outIndex] = 0.0; //abs(difference);
-          } // end slicesAlphaPtr check
-        }
-        else
-        {
-          outPtrTru[outIndex] = 0.0;
-          outPtrAbs[outIndex] = 0.0;
-        } // end gtAlphaPtr check
-      } // end x loop
-    } // end y loop
-  } // end z loop
-
-  double absoluteMeanWithHoles( 0.0 ); // include holes in this computation
-  // on this iteration, add only holes
-  for ( unsigned int i = 0; i < absoluteDifferencesInAllHoles.size(); i++ )
-  {
-    absoluteMeanWithHoles += absoluteDifferencesInAllHoles[i];
+        return firstBinValue + bin;
+      }
+    }
+    return firstBinValue + numberOfBins - 1;
   }
 
-  // mean calculations
-  double trueMean( 0.0 );
-  double absoluteMean( 0.0 ); // do not include holes in this computation
-  double rms( 0.0 );
-  for ( int i = 0; i < countFilledHoles; i++ )
+  //----------------------------------------------------------------------------
+  // Percentile with linear interpolation between the neighboring ranks, same as when computed from sorted values
+  double GetPercentileFromHistogram( const int* histogram, int numberOfBins, int firstBinValue, vtkIdType numberOfValues,
+                                     double percentile, double minimumValue, double maximumValue )
   {
-    trueMean += trueDifferences[i];
-    absoluteMean += absoluteDifferences[i];
-    rms += trueDifferences[i] * trueDifferences[i];
+    double rank = ( numberOfValues - 1 ) * percentile;
+    double fraction = fmod( rank, 1.0 );
+    vtkIdType rankFloor = std::max<vtkIdType>( static_cast<vtkIdType>( floor( rank ) ), 0 );
+    vtkIdType rankCeil = std::min<vtkIdType>( static_cast<vtkIdType>( ceil( rank ) ), numberOfValues - 1 );
+    double valueFloor = GetSortedValueFromHistogram( histogram, numberOfBins, firstBinValue, rankFloor );
+    double valueCeil = GetSortedValueFromHistogram( histogram, numberOfBins, firstBinValue, rankCeil );
+    double value = valueFloor * ( 1 - fraction ) + valueCeil * fraction;
+    // binned values of non-integer or out of range differences may be outside of the real range
+    return std::min( std::max( value, minimumValue ), maximumValue );
   }
+}
 
-  // divide by the number of filled holes
-  if ( countFilledHoles != 0 )
-  {
-    trueMean /= countFilledHoles;
-    absoluteMean /= countFilledHoles;
-    rms = sqrt( rms / countFilledHoles );
-  }
-  else
-  {
-    trueMean = 0;
-    absoluteMean = 0;
-    rms = 0;
-  }
+//----------------------------------------------------------------------------
+int vtkPlusCompareVolumes::RequestData( vtkInformation* request, vtkInformationVector** inputVector, vtkInformationVector* outputVector )
+{
+  this->VolumeAccumulator = DifferenceAccumulator();
 
-  // divide by the total number of holes
-  if ( countHoles != 0 )
-  {
-    absoluteMeanWithHoles /= countHoles;
-  }
-  else
-  {
-    absoluteMeanWithHoles = 0;
-  }
+  int result = this->Superclass::RequestData( request, inputVector, outputVector );
 
-  // stdev calculations
-  double trueStdev = 0.0;
-  double absoluteStdev = 0.0;
-  for ( int i = 0; i < countFilledHoles; i++ )
-  {
-    trueStdev += pow( ( trueDifferences[i] - trueMean ), 2 );
-    absoluteStdev += pow( ( absoluteDifferences[i] - absoluteMean ), 2 );
-  }
-  if ( countFilledHoles != 0 )
-  {
-    trueStdev = sqrt( trueStdev / countFilledHoles );
-    absoluteStdev = sqrt( absoluteStdev / countFilledHoles );
-  }
-  else
+  const DifferenceAccumulator& acc = this->VolumeAccumulator;
+  std::copy( acc.TrueHistogram, acc.TrueHistogram + TRUE_HISTOGRAM_SIZE, this->TrueHistogram );
+  std::copy( acc.AbsoluteHistogram, acc.AbsoluteHistogram + ABSOLUTE_HISTOGRAM_SIZE, this->AbsoluteHistogram );
+  std::copy( acc.AbsoluteHistogramWithHoles, acc.AbsoluteHistogramWithHoles + ABSOLUTE_HISTOGRAM_SIZE, this->AbsoluteHistogramWithHoles );
+
+  this->SetNumberOfHoles( acc.NumberOfHoles );
+  this->SetNumberVoxelsVisible( acc.NumberOfVisibleVoxels );
+  this->SetNumberOfFilledHoles( acc.NumberOfFilledHoles );
+
+  // the absolute mean with holes includes every hole, the rest of the statistics only the filled holes
+  this->SetAbsoluteMeanWithHoles( acc.NumberOfHoles > 0 ? acc.SumOfAbsoluteDifferencesInHoles / acc.NumberOfHoles : 0.0 );
+
+  if ( acc.NumberOfFilledHoles == 0 )
   {
-    trueStdev = 0;
-    absoluteStdev = 0;
+    this->SetTrueMean( 0.0 );
+    this->SetTrueStdev( 0.0 );
+    this->SetTrueMedian( 0.0 );
+    this->SetTrueMinimum( 0.0 );
+    this->SetTrueMaximum( 0.0 );
+    this->SetTrue5thPercentile( 0.0 );
+    this->SetTrue95thPercentile( 0.0 );
+    this->SetAbsoluteMean( 0.0 );
+    this->SetAbsoluteStdev( 0.0 );
+    this->SetAbsoluteMedian( 0.0 );
+    this->SetAbsoluteMinimum( 0.0 );
+    this->SetAbsoluteMaximum( 0.0 );
+    this->SetAbsolute5thPercentile( 0.0 );
+    this->SetAbsolute95thPercentile( 0.0 );
+    this->SetRMS( 0.0 );
+    return result;
   }
 
-  // need to sort, temporarily store in a list, sort, then assign back to vector <== THIS IS SLOW SLOW SLOW, as in about half a minute for this alone, so TODO: Make this faster
-  std::list<double> trueDifferencesList;
-  std::list<double> absoluteDifferencesList;
-  for ( int i = 0; i < countFilledHoles; i++ )
+  vtkIdType count = acc.NumberOfFilledHoles;
+  double trueMean = acc.SumOfTrueDifferences / count;
+  double absoluteMean = acc.SumOfAbsoluteDifferences / count;
+  double meanOfSquares = acc.SumOfSquaredDifferences / count;
+
+  this->SetTrueMean( trueMean );
+  this->SetAbsoluteMean( absoluteMean );
+  this->SetRMS( sqrt( meanOfSquares ) );
+  // squared true and absolute differences are the same, only the means are different
+  this->SetTrueStdev( sqrt( std::max( meanOfSquares - trueMean * trueMean, 0.0 ) ) );
+  this->SetAbsoluteStdev( sqrt( std::max( meanOfSquares - absoluteMean * absoluteMean, 0.0 ) ) );
+
+  this->SetTrueMinimum( acc.TrueMinimum );
+  this->SetTrueMaximum( acc.TrueMaximum );
+  this->SetAbsoluteMinimum( acc.AbsoluteMinimum );
+  this->SetAbsoluteMaximum( acc.AbsoluteMaximum );
+
+  this->SetTrueMedian( GetPercentileFromHistogram( acc.TrueHistogram, TRUE_HISTOGRAM_SIZE, -TRUE_HISTOGRAM_OFFSET, count, 0.5, acc.TrueMinimum, acc.TrueMaximum ) );
+  this->SetTrue5thPercentile( GetPercentileFromHistogram( acc.TrueHistogram, TRUE_HISTOGRAM_SIZE, -TRUE_HISTOGRAM_OFFSET, count, 0.05, acc.TrueMinimum, acc.TrueMaximum ) );
+  this->SetTrue95thPercentile( GetPercentileFromHistogram( acc.TrueHistogram, TRUE_HISTOGRAM_SIZE, -TRUE_HISTOGRAM_OFFSET, count, 0.95, acc.TrueMinimum, acc.TrueMaximum ) );
+  this->SetAbsoluteMedian( GetPercentileFromHistogram( acc.AbsoluteHistogram, ABSOLUTE_HISTOGRAM_SIZE, 0, count, 0.5, acc.AbsoluteMinimum, acc.AbsoluteMaximum ) );
+  this->SetAbsolute5thPercentile( GetPercentileFromHistogram( acc.AbsoluteHistogram, ABSOLUTE_HISTOGRAM_SIZE, 0, count, 0.05, acc.AbsoluteMinimum, acc.AbsoluteMaximum ) );
+  this->SetAbsolute95thPercentile( GetPercentileFromHistogram( acc.AbsoluteHistogram, ABSOLUTE_HISTOGRAM_SIZE, 0, count, 0.95, acc.AbsoluteMinimum, acc.AbsoluteMaximum ) );
+
+  return result;
+}
+
+//----------------------------------------------------------------------------
+// Compares one piece of the volumes. Each row is processed in two passes: the first one computes the difference
+// images and counts the voxels without branching so that the compiler can vectorize it, the second one updates
+// the sums and histograms and only runs on rows that contain holes.
+template <class T>
+void vtkPlusCompareVolumesExecute( vtkImageData* gtData,
+                                   vtkImageData* gtAlphaData,
+                                   vtkImageData* testData,
+                                   vtkImageData* testAlphaData,
+                                   vtkImageData* slicesAlphaData,
+                                   vtkImageData* outDataTru,
+                                   vtkImageData* outDataAbs,
+                                   int outExt[6],
+                                   T*,
+                                   vtkPlusCompareVolumes::DifferenceAccumulator& acc )
+{
+  vtkImageData* inDatas[NUMBER_OF_INPUTS] = { gtData, gtAlphaData, testData, testAlphaData, slicesAlphaData };
+  T* inPtrs[NUMBER_OF_INPUTS] = {0};
+  vtkIdType inIncrements[NUMBER_OF_INPUTS][3] = {{0}};
+  for ( int i = 0; i < NUMBER_OF_INPUTS; i++ )
   {
-    trueDifferencesList.push_front( trueDifferences.back() );
-    trueDifferences.pop_back();
-    absoluteDifferencesList.push_front( absoluteDifferences.back() );
-    absoluteDifferences.pop_back();
+    inPtrs[i] = static_cast<T*>( inDatas[i]->GetScalarPointerForExtent( outExt ) );
+    inDatas[i]->GetIncrements( inIncrements[i] );
   }
-  trueDifferencesList.sort();
-  absoluteDifferencesList.sort();
-  for ( int i = 0; i < countFilledHoles; i++ )
+  double* outPtrTru = static_cast<double*>( outDataTru->GetScalarPointerForExtent( outExt ) );
+  double* outPtrAbs = static_cast<double*>( outDataAbs->GetScalarPointerForExtent( outExt ) );
+  vtkIdType outIncrementsTru[3] = {0};
+  vtkIdType outIncrementsAbs[3] = {0};
+  outDataTru->GetIncrements( outIncrementsTru );
+  outDataAbs->GetIncrements( outIncrementsAbs );
+
+  const int rowLength = outExt[1] - outExt[0] + 1;
+  for ( int z = 0; z <= outExt[5] - outExt[4]; z++ )
   {
-    trueDifferences.push_back( trueDifferencesList.front() );
-    trueDifferencesList.pop_front();
-    absoluteDifferences.push_back( absoluteDifferencesList.front() );
-    absoluteDifferencesList.pop_front();
-  }
-
-  double true5thPercentile( 0.0 );
-  double true95thPercentile( 0.0 );
-  double absolute5thPercentile( 0.0 );
-  double absolute95thPercentile( 0.0 );
-  double absoluteMedian( 0.0 );
-  double trueMedian( 0.0 );
-  double trueMinimum( 0.0 );
-  double trueMaximum( 0.0 );
-  double absoluteMinimum( 0.0 );
-  double absoluteMaximum( 0.0 );
-
-  if ( countFilledHoles != 0 )
-  {
-    trueMinimum = trueDifferences[0];
-    trueMaximum = trueDifferences[countFilledHoles - 1];
-    absoluteMinimum = absoluteDifferences[0];
-    absoluteMaximum = absoluteDifferences[countFilledHoles - 1];
-
-    // old median calculation
-    //double trueMedian = (countFilledHoles%2==0)?(trueDifferences[countFilledHoles/2]+trueDifferences[(countFilledHoles/2)-1])/2.0:trueDifferences[(countFilledHoles-1)/2];
-    //double absoluteMedian = (countFilledHoles%2==0)?(absoluteDifferences[countFilledHoles/2]+absoluteDifferences[(countFilledHoles/2)-1])/2.0:absoluteDifferences[(countFilledHoles-1)/2];
-
-    double medianRank = ( countFilledHoles - 1 ) * 0.5;
-    double medianFraction = fmod( medianRank, 1.0 );
-    int medianFloor = ( int )floor( medianRank );
-    if ( medianFloor < 0 )
-    {
-      medianFloor = 0;
-    }
-    int medianCeil = ( int )ceil( medianRank );
-    if ( medianCeil > ( countFilledHoles - 1 ) )
+    for ( int y = 0; y <= outExt[3] - outExt[2]; y++ )
     {
-      medianCeil = ( countFilledHoles - 1 );
-    }
-    trueMedian = trueDifferences[medianFloor] * ( 1 - medianFraction ) + trueDifferences[medianCeil] * medianFraction;
-    absoluteMedian = absoluteDifferences[medianFloor] * ( 1 - medianFraction ) + absoluteDifferences[medianCeil] * medianFraction;
+      const T* gtRow = inPtrs[INPUT_GROUND_TRUTH_VOLUME] + y * inIncrements[INPUT_GROUND_TRUTH_VOLUME][1] + z * inIncrements[INPUT_GROUND_TRUTH_VOLUME][2];
+      const T* gtAlphaRow = inPtrs[INPUT_GROUND_TRUTH_VOLUME_ALPHA] + y * inIncrements[INPUT_GROUND_TRUTH_VOLUME_ALPHA][1] + z * inIncrements[INPUT_GROUND_TRUTH_VOLUME_ALPHA][2];
+      const T* testRow = inPtrs[INPUT_TEST_VOLUME] + y * inIncrements[INPUT_TEST_VOLUME][1] + z * inIncrements[INPUT_TEST_VOLUME][2];
+      const T* testAlphaRow = inPtrs[INPUT_TEST_VOLUME_ALPHA] + y * inIncrements[INPUT_TEST_VOLUME_ALPHA][1] + z * inIncrements[INPUT_TEST_VOLUME_ALPHA][2];
+      const T* slicesAlphaRow = inPtrs[INPUT_SLICES_VOLUME_ALPHA] + y * inIncrements[INPUT_SLICES_VOLUME_ALPHA][1] + z * inIncrements[INPUT_SLICES_VOLUME_ALPHA][2];
+      double* outRowTru = outPtrTru + y * outIncrementsTru[1] + z * outIncrementsTru[2];
+      double* outRowAbs = outPtrAbs + y * outIncrementsAbs[1] + z * outIncrementsAbs[2];
+
+      vtkIdType rowVisibleVoxels = 0;
+      vtkIdType rowHoles = 0;
+      for ( int x = 0; x < rowLength; x++ )
+      {
+        const bool visible = ( gtAlphaRow[x] != 0 );
+        const bool hole = visible && ( slicesAlphaRow[x] == 0 );
+        const bool filledHole = hole && ( testAlphaRow[x] != 0 );
+        const double difference = static_cast<double>( gtRow[x] ) - static_cast<double>( testRow[x] ); // cast to double to minimize precision loss
+        outRowTru[x] = filledHole ? difference : 0.0;
+        outRowAbs[x] = filledHole ? fabs( difference ) : 0.0;
+        rowVisibleVoxels += visible;
+        rowHoles += hole;
+      }
+      acc.NumberOfVisibleVoxels += rowVisibleVoxels;
+      if ( rowHoles == 0 )
+      {
+        continue;
+      }
+      acc.NumberOfHoles += rowHoles;
 
-    double percentile5rank = ( countFilledHoles - 1 ) * 0.05;
-    double percentile5fraction = fmod( percentile5rank, 1.0 );
-    int percentile5floor = ( int )floor( percentile5rank );
-    if ( percentile5floor < 0 )
-    {
-      percentile5floor = 0;
-    }
-    int percentile5ceil = ( int )ceil( percentile5rank );
-    if ( percentile5ceil > ( countFilledHoles - 1 ) )
-    {
-      percentile5ceil = ( countFilledHoles - 1 );
-    }
-    true5thPercentile = trueDifferences[percentile5floor] * ( 1 - percentile5fraction ) + trueDifferences[percentile5ceil] * percentile5fraction;
-    absolute5thPercentile = absoluteDifferences[percentile5floor] * ( 1 - percentile5fraction ) + absoluteDifferences[percentile5ceil] * percentile5fraction;
+      for ( int x = 0; x < rowLength; x++ )
+      {
+        if ( gtAlphaRow[x] == 0 || slicesAlphaRow[x] != 0 )
+        {
+          continue;
+        }
+        const double difference = static_cast<double>( gtRow[x] ) - static_cast<double>( testRow[x] );
+        const double absoluteDifference = fabs( difference );
+        const int absoluteBin = std::min( static_cast<int>( igsioMath::Round( absoluteDifference ) ), ABSOLUTE_HISTOGRAM_SIZE - 1 );
 
-    double percentile95rank = ( countFilledHoles - 1 ) * 0.95;
-    double percentile95fraction = fmod( percentile95rank, 1.0 );
-    int percentile95floor = ( int )floor( percentile95rank );
-    if ( percentile95floor < 0 )
-    {
-      percentile95floor = 0;
-    }
-    int percentile95ceil = ( int )ceil( percentile95rank );
-    if ( percentile95ceil > ( countFilledHoles - 1 ) )
-    {
-      percentile95ceil = ( countFilledHoles - 1 );
+        // same as absolute difference, but in hole voxels - this can be added to find the absolute error when
+        // we consider holes to be part of the image (and choose to not ignore them in the error computation)
+        acc.SumOfAbsoluteDifferencesInHoles += absoluteDifference;
+        acc.AbsoluteHistogramWithHoles[absoluteBin]++;
+
+        if ( testAlphaRow[x] == 0 )
+        {
+          continue;
+        }
+        acc.NumberOfFilledHoles++;
+        acc.SumOfTrueDifferences += difference;
+        acc.SumOfSquaredDifferences += difference * difference;
+        acc.SumOfAbsoluteDifferences += absoluteDifference;
+        acc.TrueMinimum = std::min( acc.TrueMinimum, difference );
+        acc.TrueMaximum = std::max( acc.TrueMaximum, difference );
+        acc.AbsoluteMinimum = std::min( acc.AbsoluteMinimum, absoluteDifference );
+        acc.AbsoluteMaximum = std::max( acc.AbsoluteMaximum, absoluteDifference );
+        const int trueBin = std::min( std::max( static_cast<int>( igsioMath::Round( difference ) ) + TRUE_HISTOGRAM_OFFSET, 0 ), TRUE_HISTOGRAM_SIZE - 1 );
+        acc.TrueHistogram[trueBin]++;
+        acc.AbsoluteHistogram[absoluteBin]++;
+      }
     }
-    true95thPercentile = trueDifferences[percentile95floor] * ( 1 - percentile95fraction ) + trueDifferences[percentile95ceil] * percentile95fraction;
-    absolute95thPercentile = absoluteDifferences[percentile95floor] * ( 1 - percentile95fraction ) + absoluteDifferences[percentile95ceil] * percentile95fraction;
   }
-
-  self->SetNumberOfHoles( countHoles );
-  self->SetNumberVoxelsVisible( countVisibleVoxels );
-  self->SetNumberOfFilledHoles( countFilledHoles );
-
-  self->SetTrue95thPercentile( true95thPercentile );
-  self->SetTrue5thPercentile( true5thPercentile );
-  self->SetTrueMaximum( trueMaximum );
-  self->SetTrueMinimum( trueMinimum );
-  self->SetTrueMedian( trueMedian );
-  self->SetTrueStdev( trueStdev );
-  self->SetTrueMean( trueMean );
-
-  self->SetAbsolute95thPercentile( absolute95thPercentile );
-  self->SetAbsolute5thPercentile( absolute5thPercentile );
-  self->SetAbsoluteMaximum( absoluteMaximum );
-  self->SetAbsoluteMinimum( absoluteMinimum );
-  self->SetAbsoluteMedian( absoluteMedian );
-  self->SetAbsoluteStdev( absoluteStdev );
-  self->SetAbsoluteMean( absoluteMean );
-
-  self->SetAbsoluteMeanWithHoles( absoluteMeanWithHoles );
-
-  self->SetRMS( rms );
 }
 
+//----------------------------------------------------------------------------
 void vtkPlusCompareVolumes::ThreadedRequestData (
   vtkInformation* vtkNotUsed( request ),
   vtkInformationVector** vtkNotUsed( inputVector ),
   vtkInformationVector* vtkNotUsed( outputVector ),
   vtkImageData** *inData,
   vtkImageData** outData,
-  int outExt[6], int threadId )
+  int outExt[6], int vtkNotUsed( threadId ) )
 {
-  if ( inData[INPUT_GROUND_TRUTH_VOLUME][0] == NULL
-       || inData[INPUT_GROUND_TRUTH_VOLUME_ALPHA][0] == NULL
-       || inData[INPUT_TEST_VOLUME][0] == NULL
-       || inData[INPUT_TEST_VOLUME_ALPHA][0] == NULL
-       || inData[INPUT_SLICES_VOLUME_ALPHA][0] == NULL )
+  for ( int i = 0; i < NUMBER_OF_INPUTS; i++ )
   {
-    vtkErrorMacro( << "Input must be specified." );
-    return;
-  }
-
-  // this filter expects that all inputs are the same type as output.
-  if ( inData[INPUT_GROUND_TRUTH_VOLUME_ALPHA][0]->GetScalarType() != inData[INPUT_GROUND_TRUTH_VOLUME][0]->GetScalarType()
-       || inData[INPUT_TEST_VOLUME][0]->GetScalarType() != inData[INPUT_GROUND_TRUTH_VOLUME][0]->GetScalarType()
-       || inData[INPUT_TEST_VOLUME_ALPHA][0]->GetScalarType() != inData[INPUT_GROUND_TRUTH_VOLUME][0]->GetScalarType()
-       || inData[INPUT_SLICES_VOLUME_ALPHA][0]->GetScalarType() != inData[INPUT_GROUND_TRUTH_VOLUME][0]->GetScalarType() )
-  {
-    vtkErrorMacro( << "Execute: input ScalarTypes must match ScalarType "
-                   << inData[INPUT_GROUND_TRUTH_VOLUME][0]->GetScalarType() );
-    return;
+    if ( inData[i][0] == NULL )
+    {
+      vtkErrorMacro( << "Input must be specified." );
+      return;
+    }
+    // this filter expects that all inputs are the same type as output.
+    if ( inData[i][0]->GetScalarType() != inData[INPUT_GROUND_TRUTH_VOLUME][0]->GetScalarType() )
+    {
+      vtkErrorMacro( << "Execute: input ScalarTypes must match ScalarType "
+                     << inData[INPUT_GROUND_TRUTH_VOLUME][0]->GetScalarType() );
+      return;
+    }
+    if ( inData[i][0]->GetNumberOfScalarComponents() != 1 )
+    {
+      vtkErrorMacro( << "Execute: inputs must have a single scalar component" );
+      return;
+    }
   }
 
+  // partial results of this piece are merged into the results of the whole volume at the end
+  DifferenceAccumulator acc;
   vtkImageData* gtVolData = inData[INPUT_GROUND_TRUTH_VOLUME][0];
-  void* gtPtr = gtVolData->GetScalarPointer();
-  void* gtAlphaPtr = inData[INPUT_GROUND_TRUTH_VOLUME_ALPHA][0]->GetScalarPointer();
-  void* testPtr = inData[INPUT_TEST_VOLUME][0]->GetScalarPointer();
-  void* testAlphaPtr = inData[INPUT_TEST_VOLUME_ALPHA][0]->GetScalarPointer();
-  void* slicesAlphaPtr = inData[INPUT_SLICES_VOLUME_ALPHA][0]->GetScalarPointer();
-
-  vtkImageData* outVolDataTru = inData[INPUT_GROUND_TRUTH_VOLUME][0];
-  double* outPtrTru = static_cast< double* >( outVolDataTru->GetScalarPointer() );
-  double* outPtrAbs = static_cast< double* >( outData[OUTPUT_ABS_DIFF_VOLUME]->GetScalarPointer() );
-
   switch ( gtVolData->GetScalarType() )
   {
     vtkTemplateMacro(
-      vtkPlusCompareVolumesExecute( this, gtVolData, outVolDataTru,
-                                    static_cast<VTK_TT*>( gtPtr ),   static_cast<VTK_TT*>( gtAlphaPtr ),
-                                    static_cast<VTK_TT*>( testPtr ), static_cast<VTK_TT*>( testAlphaPtr ),
-                                    static_cast<VTK_TT*>( slicesAlphaPtr ),
-                                    outPtrTru, outPtrAbs, outExt, threadId )
+      vtkPlusCompareVolumesExecute( gtVolData, inData[INPUT_GROUND_TRUTH_VOLUME_ALPHA][0],
+                                    inData[INPUT_TEST_VOLUME][0], inData[INPUT_TEST_VOLUME_ALPHA][0],
+                                    inData[INPUT_SLICES_VOLUME_ALPHA][0],
+                                    outData[OUTPUT_TRUE_DIFF_VOLUME], outData[OUTPUT_ABS_DIFF_VOLUME],
+                                    outExt, static_cast<VTK_TT*>( NULL ), acc )
     );
   default:
     vtkErrorMacro( << "Execute: Unknown ScalarType" );
     return;
   }
+  this->MergeAccumulator( acc );
 }
 
 int vtkPlusCompareVolumes::FillInputPortInformation( int port, vtkInformation* info )
@@ -19,13 +19,17 @@
 //   - A ground truth alpha image: This is used together with the slices alpha image to identify hole voxels
 //   - A reconstructed "test" image
 //   - A slices alpha image: The alpha channel if the slices are only pasted into the volume without hole filling
+// The volumes are processed in parallel pieces. Each piece accumulates its own counts, sums and histograms,
+// which are merged when all pieces are done. Median and percentiles are computed from the merged histograms,
+// so the individual differences are not stored. For unsigned char volumes all differences are integers and
+// the histogram-based statistics are exact, for other scalar types the differences are rounded into the
+// [-255, 255] histogram range.
 
 #ifndef __vtkPlusCompareVolumes_h
 #define __vtkPlusCompareVolumes_h
 
 #include "PlusConfigure.h"
 #include "vtkThreadedImageAlgorithm.h"
-#include <vector>
 
 class vtkPlusCompareVolumes : public vtkThreadedImageAlgorithm
 {
@@ -100,6 +104,8 @@ public:
   vtkGetMacro(AbsoluteMeanWithHoles,double);
   vtkSetMacro(AbsoluteMeanWithHoles,double);
 
+  // Description:
+  // Histogram of the true differences in filled holes. Bin i contains the number of differences of i-255.
   int* GetTrueHistogramPtr();
   int* GetAbsoluteHistogramPtr();
   int* GetAbsoluteHistogramWithHolesPtr();
@@ -110,10 +116,37 @@ public:
   void resetAbsoluteHistogram();
   void resetAbsoluteHistogramWithHoles();
 
+  // Description:
+  // Partial results of a piece of the volume
+  struct DifferenceAccumulator
+  {
+    DifferenceAccumulator();
+    void Add(const DifferenceAccumulator& other);
+
+    vtkIdType NumberOfVisibleVoxels;
+    vtkIdType NumberOfHoles;
+    vtkIdType NumberOfFilledHoles;
+    double SumOfTrueDifferences;
+    double SumOfSquaredDifferences;
+    double SumOfAbsoluteDifferences;
+    double SumOfAbsoluteDifferencesInHoles;
+    double TrueMinimum;
+    double TrueMaximum;
+    double AbsoluteMinimum;
+    double AbsoluteMaximum;
+    int TrueHistogram[511];
+    int AbsoluteHistogram[256];
+    int AbsoluteHistogramWithHoles[256];
+  };
+
 protected:
   vtkPlusCompareVolumes();
   ~vtkPlusCompareVolumes() {};
 
+  // Description:
+  // Add the partial results of a piece to the results of the whole volume
+  void MergeAccumulator(const DifferenceAccumulator& accumulator);
+
   double RMS;
   double TrueMean,     TrueStdev,     TrueMedian,     TrueMinimum,     TrueMaximum,     True95thPercentile,     True5thPercentile;
   double AbsoluteMean, AbsoluteStdev, AbsoluteMedian, AbsoluteMinimum, AbsoluteMaximum, Absolute95thPercentile, Absolute5thPercentile;
@@ -125,8 +158,15 @@ protected:
   int NumberOfFilledHoles;
   int NumberVoxelsVisible;
 
+  DifferenceAccumulator VolumeAccumulator;
+  vtkIGSIOSimpleRecursiveCriticalSection VolumeAccumulatorMutex;
+
   virtual int RequestInformation (vtkInformation *, vtkInformationVector**, vtkInformationVector *);
 
+  // Description:
+  // Runs the threaded comparison of the pieces then computes the statistics from the merged results
+  virtual int RequestData(vtkInformation *, vtkInformationVector**, vtkInformationVector *);
+
   void ThreadedRequestData (vtkInformation* request,
                             vtkInformationVector** inputVector,
                             vtkInformationVector* outputVector,
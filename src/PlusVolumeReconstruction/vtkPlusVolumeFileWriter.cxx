@@ -0,0 +1,480 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+// Local includes
+#include "PlusConfigure.h"
+#include "vtkPlusVolumeFileWriter.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMultiThreader.h>
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtk_zlib.h>
+#include <vtksys/SystemTools.hxx>
+
+// STL includes
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+vtkStandardNewMacro(vtkPlusVolumeFileWriter);
+
+namespace
+{
+  const int DEFAULT_SLAB_SIZE_BYTES = 4 * 1024 * 1024;
+
+  // Characters reserved in the MetaImage header for the compressed data size, which is only known after the voxels are written
+  const int COMPRESSED_DATA_SIZE_FIELD_WIDTH = 20;
+
+  // Size of the deflate window. The end of the previous slab is used as dictionary, so splitting into slabs barely affects the compression ratio.
+  const unsigned long long DEFLATE_DICTIONARY_SIZE = 32768;
+
+#ifdef VTK_WORDS_BIGENDIAN
+  const bool BIG_ENDIAN_HOST = true;
+#else
+  const bool BIG_ENDIAN_HOST = false;
+#endif
+
+  //----------------------------------------------------------------------------
+  bool GetScalarTypeNames(int vtkScalarType, std::string& metaImageType, std::string& nrrdType)
+  {
+    switch (vtkScalarType)
+    {
+      case VTK_CHAR:
+      case VTK_SIGNED_CHAR:
+        metaImageType = "MET_CHAR";
+        nrrdType = "signed char";
+        return true;
+      case VTK_UNSIGNED_CHAR:
+        metaImageType = "MET_UCHAR";
+        nrrdType = "unsigned char";
+        return true;
+      case VTK_SHORT:
+        metaImageType = "MET_SHORT";
+        nrrdType = "short";
+        return true;
+      case VTK_UNSIGNED_SHORT:
+        metaImageType = "MET_USHORT";
+        nrrdType = "unsigned short";
+        return true;
+      case VTK_INT:
+        metaImageType = "MET_INT";
+        nrrdType = "int";
+        return true;
+      case VTK_UNSIGNED_INT:
+        metaImageType = "MET_UINT";
+        nrrdType = "unsigned int";
+        return true;
+      case VTK_FLOAT:
+        metaImageType = "MET_FLOAT";
+        nrrdType = "float";
+        return true;
+      case VTK_DOUBLE:
+        metaImageType = "MET_DOUBLE";
+        nrrdType = "double";
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /*! Voxel data that is compressed in slabs by multiple threads and written to the file in order */
+  struct SlabCompressionJob
+  {
+    const unsigned char* Voxels;
+    unsigned long long NumberOfVoxelBytes;
+    unsigned long long SlabSizeBytes;
+    size_t NumberOfSlabs;
+    int CompressionLevel;
+    /*! CRC-32 checksum for gzip format, Adler-32 for zlib format */
+    bool GzipFormat;
+    std::ostream* File;
+
+    std::atomic<size_t> NextSlabToCompress;
+
+    std::mutex WriteMutex;
+    std::condition_variable WriteCondition;
+    /*! Index of the slab that is written next. Protected by WriteMutex. */
+    size_t NextSlabToWrite;
+    /*! Checksum of the slabs that are already written. Protected by WriteMutex. */
+    uLong Checksum;
+    /*! Protected by WriteMutex */
+    unsigned long long NumberOfCompressedBytes;
+    /*! Protected by WriteMutex */
+    bool Failed;
+  };
+
+  //----------------------------------------------------------------------------
+  /*!
+    Compress a slab into raw deflate data. All slabs except the last one end with a sync flush,
+    which makes them byte-aligned, so the compressed slabs can be concatenated into a single deflate stream.
+  */
+  bool CompressSlab(const SlabCompressionJob& job, size_t slabIndex, std::vector<unsigned char>& compressedSlab, uLong& slabChecksum, uInt& slabLength)
+  {
+    const unsigned long long slabStart = slabIndex * job.SlabSizeBytes;
+    const bool lastSlab = (slabIndex + 1 == job.NumberOfSlabs);
+    slabLength = static_cast<uInt>(std::min(job.SlabSizeBytes, job.NumberOfVoxelBytes - slabStart));
+    const Bytef* slabVoxels = job.Voxels + slabStart;
+    slabChecksum = job.GzipFormat ? crc32(0L, slabVoxels, slabLength) : adler32(1L, slabVoxels, slabLength);
+
+    z_stream zStream;
+    memset(&zStream, 0, sizeof(z_stream));
+    if (deflateInit2(&zStream, job.CompressionLevel, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+      return false;
+    }
+    if (slabStart > 0)
+    {
+      uInt dictionarySize = static_cast<uInt>(std::min(DEFLATE_DICTIONARY_SIZE, slabStart));
+      deflateSetDictionary(&zStream, slabVoxels - dictionarySize, dictionarySize);
+    }
+
+    // The buffer is reused for the next slab, so it is only allocated a few times
+    compressedSlab.resize(deflateBound(&zStream, slabLength) + 16);
+    zStream.next_in = const_cast<Bytef*>(slabVoxels);
+    zStream.avail_in = slabLength;
+    zStream.next_out = &compressedSlab[0];
+    zStream.avail_out = static_cast<uInt>(compressedSlab.size());
+    const int flush = lastSlab ? Z_FINISH : Z_SYNC_FLUSH;
+    bool success = true;
+    while (true)
+    {
+      int result = deflate(&zStream, flush);
+      if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+      {
+        success = false;
+        break;
+      }
+      if (result == Z_STREAM_END || (!lastSlab && zStream.avail_in == 0 && zStream.avail_out > 0))
+      {
+        break;
+      }
+      // Output buffer is full
+      size_t compressedSize = compressedSlab.size() - zStream.avail_out;
+      compressedSlab.resize(compressedSlab.size() * 2);
+      zStream.next_out = &compressedSlab[compressedSize];
+      zStream.avail_out = static_cast<uInt>(compressedSlab.size() - compressedSize);
+    }
+    compressedSlab.resize(compressedSlab.size() - zStream.avail_out);
+    deflateEnd(&zStream);
+    return success;
+  }
+
+  //----------------------------------------------------------------------------
+  void* SlabCompressionThread(vtkMultiThreader::ThreadInfo* threadInfo)
+  {
+    SlabCompressionJob* job = static_cast<SlabCompressionJob*>(threadInfo->UserData);
+    std::vector<unsigned char> compressedSlab;
+    for (size_t slabIndex = job->NextSlabToCompress++; slabIndex < job->NumberOfSlabs; slabIndex = job->NextSlabToCompress++)
+    {
+      uLong slabChecksum = 0;
+      uInt slabLength = 0;
+      bool compressed = CompressSlab(*job, slabIndex, compressedSlab, slabChecksum, slabLength);
+
+      std::unique_lock<std::mutex> writeLock(job->WriteMutex);
+      while (job->NextSlabToWrite != slabIndex)
+      {
+        job->WriteCondition.wait(writeLock);
+      }
+      if (!compressed && !job->Failed)
+      {
+        LOG_ERROR("Failed to compress volume slab " << slabIndex);
+        job->Failed = true;
+      }
+      if (!job->Failed)
+      {
+        job->File->write(reinterpret_cast<const char*>(compressedSlab.data()), compressedSlab.size());
+        if (!job->File->good())
+        {
+          LOG_ERROR("Failed to write volume slab " << slabIndex);
+          job->Failed = true;
+        }
+        job->Checksum = job->GzipFormat ? crc32_combine(job->Checksum, slabChecksum, slabLength) : adler32_combine(job->Checksum, slabChecksum, slabLength);
+        job->NumberOfCompressedBytes += compressedSlab.size();
+      }
+      ++job->NextSlabToWrite;
+      writeLock.unlock();
+      job->WriteCondition.notify_all();
+    }
+    return NULL;
+  }
+
+  //----------------------------------------------------------------------------
+  void WriteUInt32(std::ostream& file, uLong value, bool bigEndian)
+  {
+    unsigned char bytes[4];
+    for (int i = 0; i < 4; ++i)
+    {
+      int shift = bigEndian ? (3 - i) * 8 : i * 8;
+      bytes[i] = static_cast<unsigned char>((value >> shift) & 0xff);
+    }
+    file.write(reinterpret_cast<const char*>(bytes), 4);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkPlusVolumeFileWriter::vtkPlusVolumeFileWriter()
+  : UseCompression(true)
+  , CompressionLevel(Z_DEFAULT_COMPRESSION)
+  , NumberOfThreads(vtkMultiThreader::GetGlobalDefaultNumberOfThreads())
+  , SlabSizeBytes(DEFAULT_SLAB_SIZE_BYTES)
+  , NumberOfWrittenBytes(0)
+{
+}
+
+//----------------------------------------------------------------------------
+vtkPlusVolumeFileWriter::~vtkPlusVolumeFileWriter()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusVolumeFileWriter::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "UseCompression: " << (this->UseCompression ? "true" : "false") << std::endl;
+  os << indent << "CompressionLevel: " << this->CompressionLevel << std::endl;
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << std::endl;
+  os << indent << "SlabSizeBytes: " << this->SlabSizeBytes << std::endl;
+  os << indent << "NumberOfWrittenBytes: " << this->NumberOfWrittenBytes << std::endl;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusVolumeFileWriter::CanWriteFile(const std::string& filename)
+{
+  std::string extension = vtksys::SystemTools::LowerCase(vtksys::SystemTools::GetFilenameLastExtension(filename));
+  return extension == ".mha" || extension == ".nrrd";
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusVolumeFileWriter::Write(vtkImageData* volume, const std::string& filename)
+{
+  this->NumberOfWrittenBytes = 0;
+
+  if (volume == NULL || volume->GetScalarPointer() == NULL)
+  {
+    LOG_ERROR("vtkPlusVolumeFileWriter::Write: invalid input volume");
+    return PLUS_FAIL;
+  }
+  std::string metaImageType;
+  std::string nrrdType;
+  if (!GetScalarTypeNames(volume->GetScalarType(), metaImageType, nrrdType))
+  {
+    LOG_ERROR("vtkPlusVolumeFileWriter::Write: unsupported voxel type: " << volume->GetScalarTypeAsString());
+    return PLUS_FAIL;
+  }
+  if (!CanWriteFile(filename))
+  {
+    LOG_ERROR("vtkPlusVolumeFileWriter::Write: unsupported file format: " << filename << ". Supported formats: .mha, .nrrd");
+    return PLUS_FAIL;
+  }
+  const bool nrrdFormat = (vtksys::SystemTools::LowerCase(vtksys::SystemTools::GetFilenameLastExtension(filename)) == ".nrrd");
+
+  int dims[3] = { 0, 0, 0 };
+  int extent[6] = { 0, -1, 0, -1, 0, -1 };
+  double spacing[3] = { 1.0, 1.0, 1.0 };
+  double origin[3] = { 0.0, 0.0, 0.0 };
+  volume->GetDimensions(dims);
+  volume->GetExtent(extent);
+  volume->GetSpacing(spacing);
+  volume->GetOrigin(origin);
+  // Position of the first voxel
+  double offset[3] = { 0.0, 0.0, 0.0 };
+  for (int i = 0; i < 3; ++i)
+  {
+    offset[i] = origin[i] + extent[i * 2] * spacing[i];
+  }
+  const int numberOfComponents = volume->GetNumberOfScalarComponents();
+  const unsigned long long numberOfVoxelBytes = static_cast<unsigned long long>(dims[0]) * dims[1] * dims[2] * numberOfComponents * volume->GetScalarSize();
+  if (numberOfVoxelBytes == 0)
+  {
+    LOG_ERROR("vtkPlusVolumeFileWriter::Write: input volume is empty");
+    return PLUS_FAIL;
+  }
+
+  std::ostringstream header;
+  header << std::setprecision(12);
+  std::streamoff compressedDataSizePosition = -1;
+  if (nrrdFormat)
+  {
+    header << "NRRD0004" << std::endl
+           << "# Complete NRRD file format specification at:" << std::endl
+           << "# http://teem.sourceforge.net/nrrd/format.html" << std::endl
+           << "type: " << nrrdType << std::endl
+           << "dimension: " << (numberOfComponents > 1 ? 4 : 3) << std::endl
+           << "space dimension: 3" << std::endl
+           << "sizes: ";
+    if (numberOfComponents > 1)
+    {
+      header << numberOfComponents << " ";
+    }
+    header << dims[0] << " " << dims[1] << " " << dims[2] << std::endl
+           << "space directions: " << (numberOfComponents > 1 ? "none " : "")
+           << "(" << spacing[0] << ",0,0) (0," << spacing[1] << ",0) (0,0," << spacing[2] << ")" << std::endl
+           << "kinds: " << (numberOfComponents > 1 ? "vector " : "") << "domain domain domain" << std::endl
+           << "endian: " << (BIG_ENDIAN_HOST ? "big" : "little") << std::endl
+           << "encoding: " << (this->UseCompression ? "gzip" : "raw") << std::endl
+           << "space origin: (" << offset[0] << "," << offset[1] << "," << offset[2] << ")" << std::endl
+           << std::endl;
+  }
+  else
+  {
+    header << "ObjectType = Image" << std::endl
+           << "NDims = 3" << std::endl
+           << "BinaryData = True" << std::endl
+           << "BinaryDataByteOrderMSB = " << (BIG_ENDIAN_HOST ? "True" : "False") << std::endl
+           << "CompressedData = " << (this->UseCompression ? "True" : "False") << std::endl;
+    if (this->UseCompression)
+    {
+      header << "CompressedDataSize = ";
+      compressedDataSizePosition = header.tellp();
+      header << std::string(COMPRESSED_DATA_SIZE_FIELD_WIDTH, ' ') << std::endl;
+    }
+    header << "TransformMatrix = 1 0 0 0 1 0 0 0 1" << std::endl
+           << "Offset = " << offset[0] << " " << offset[1] << " " << offset[2] << std::endl
+           << "CenterOfRotation = 0 0 0" << std::endl
+           << "AnatomicalOrientation = RAI" << std::endl
+           << "ElementSpacing = " << spacing[0] << " " << spacing[1] << " " << spacing[2] << std::endl
+           << "DimSize = " << dims[0] << " " << dims[1] << " " << dims[2] << std::endl;
+    if (numberOfComponents > 1)
+    {
+      header << "ElementNumberOfChannels = " << numberOfComponents << std::endl;
+    }
+    header << "ElementType = " << metaImageType << std::endl
+           << "ElementDataFile = LOCAL" << std::endl;
+  }
+
+  std::string filePath = vtkPlusConfig::GetInstance()->GetOutputPath(filename);
+  std::ofstream file(filePath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+  {
+    LOG_ERROR("Failed to open volume file for writing: " << filePath);
+    return PLUS_FAIL;
+  }
+  const std::string headerString = header.str();
+  file.write(headerString.c_str(), headerString.size());
+
+  unsigned long long numberOfWrittenVoxelBytes = 0;
+  if (this->WriteVoxels(file, static_cast<const unsigned char*>(volume->GetScalarPointer()), numberOfVoxelBytes, nrrdFormat, numberOfWrittenVoxelBytes) != PLUS_SUCCESS)
+  {
+    LOG_ERROR("Failed to write voxel data to volume file: " << filePath);
+    return PLUS_FAIL;
+  }
+
+  if (compressedDataSizePosition >= 0)
+  {
+    file.seekp(compressedDataSizePosition);
+    file << std::left << std::setw(COMPRESSED_DATA_SIZE_FIELD_WIDTH) << numberOfWrittenVoxelBytes;
+  }
+  file.close();
+  if (file.fail())
+  {
+    LOG_ERROR("Failed to write volume file: " << filePath);
+    return PLUS_FAIL;
+  }
+
+  this->NumberOfWrittenBytes = headerString.size() + numberOfWrittenVoxelBytes;
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusVolumeFileWriter::WriteVoxels(std::ostream& file, const unsigned char* voxels, unsigned long long numberOfVoxelBytes, bool gzipFormat, unsigned long long& numberOfWrittenBytes)
+{
+  numberOfWrittenBytes = 0;
+  const unsigned long long slabSizeBytes = static_cast<unsigned long long>(std::max(this->SlabSizeBytes, 1));
+
+  if (!this->UseCompression)
+  {
+    // Written directly from the volume, in slabs to keep the size of write requests reasonable
+    for (unsigned long long slabStart = 0; slabStart < numberOfVoxelBytes; slabStart += slabSizeBytes)
+    {
+      file.write(reinterpret_cast<const char*>(voxels + slabStart), std::min(slabSizeBytes, numberOfVoxelBytes - slabStart));
+      if (!file.good())
+      {
+        return PLUS_FAIL;
+      }
+    }
+    numberOfWrittenBytes = numberOfVoxelBytes;
+    return PLUS_SUCCESS;
+  }
+
+  // Header of the compressed stream: zlib (deflate, 32K window, default compression) or gzip (deflate, no file name, unknown OS)
+  const unsigned char zlibHeader[2] = { 0x78, 0x9c };
+  const unsigned char gzipHeader[10] = { 0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff };
+  if (gzipFormat)
+  {
+    file.write(reinterpret_cast<const char*>(gzipHeader), sizeof(gzipHeader));
+    numberOfWrittenBytes += sizeof(gzipHeader);
+  }
+  else
+  {
+    file.write(reinterpret_cast<const char*>(zlibHeader), sizeof(zlibHeader));
+    numberOfWrittenBytes += sizeof(zlibHeader);
+  }
+
+  SlabCompressionJob job;
+  job.Voxels = voxels;
+  job.NumberOfVoxelBytes = numberOfVoxelBytes;
+  job.SlabSizeBytes = slabSizeBytes;
+  job.NumberOfSlabs = static_cast<size_t>((numberOfVoxelBytes + slabSizeBytes - 1) / slabSizeBytes);
+  job.CompressionLevel = this->CompressionLevel;
+  job.GzipFormat = gzipFormat;
+  job.File = &file;
+  job.NextSlabToCompress = 0;
+  job.NextSlabToWrite = 0;
+  job.Checksum = gzipFormat ? crc32(0L, Z_NULL, 0) : adler32(0L, Z_NULL, 0);
+  job.NumberOfCompressedBytes = 0;
+  job.Failed = false;
+
+  // The calling thread compresses slabs, too
+  int numberOfThreads = std::max(1, std::min(this->NumberOfThreads, static_cast<int>(std::min<size_t>(job.NumberOfSlabs, VTK_MAX_THREADS))));
+  vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+  std::vector<int> threadIds;
+  for (int i = 1; i < numberOfThreads; ++i)
+  {
+    int threadId = threader->SpawnThread((vtkThreadFunctionType)&SlabCompressionThread, &job);
+    if (threadId < 0)
+    {
+      LOG_WARNING("Failed to create volume compression thread.");
+      break;
+    }
+    threadIds.push_back(threadId);
+  }
+  vtkMultiThreader::ThreadInfo threadInfo;
+  threadInfo.UserData = &job;
+  SlabCompressionThread(&threadInfo);
+  for (std::vector<int>::iterator threadIt = threadIds.begin(); threadIt != threadIds.end(); ++threadIt)
+  {
+    threader->TerminateThread(*threadIt);
+  }
+
+  if (job.Failed)
+  {
+    return PLUS_FAIL;
+  }
+  numberOfWrittenBytes += job.NumberOfCompressedBytes;
+
+  // Trailer of the compressed stream
+  if (gzipFormat)
+  {
+    WriteUInt32(file, job.Checksum, false);
+    WriteUInt32(file, static_cast<uLong>(numberOfVoxelBytes & 0xffffffffULL), false);
+    numberOfWrittenBytes += 8;
+  }
+  else
+  {
+    WriteUInt32(file, job.Checksum, true);
+    numberOfWrittenBytes += 4;
+  }
+  return file.good() ? PLUS_SUCCESS : PLUS_FAIL;
+}
@@ -0,0 +1,84 @@
+/*=Plus=header=begin======================================================
+  Program: Plus
+  Copyright (c) Laboratory for Percutaneous Surgery. All rights reserved.
+  See License.txt for details.
+=========================================================Plus=header=end*/
+
+#ifndef __vtkPlusVolumeFileWriter_h
+#define __vtkPlusVolumeFileWriter_h
+
+#include "PlusConfigure.h"
+#include "vtkPlusVolumeReconstructionExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+class vtkImageData;
+
+/*!
+  \class vtkPlusVolumeFileWriter
+  \brief Writes a volume into a MetaImage (.mha) or NRRD (.nrrd) file directly from the voxel array of the image
+
+  The voxels are written in slabs (consecutive parts of the voxel array of SlabSizeBytes size), without copying
+  the volume. If compression is enabled then the slabs are compressed in parallel by NumberOfThreads threads and
+  written to the file in order, as a single zlib (MetaImage) or gzip (NRRD) stream that any reader can decompress.
+  Each thread compresses one slab at a time, so the memory needed in addition to the volume is about
+  NumberOfThreads slabs.
+
+  The written file is a plain 3D image with the origin and spacing of the volume (not a sequence file).
+
+  \ingroup PlusLibVolumeReconstruction
+*/
+class vtkPlusVolumeReconstructionExport vtkPlusVolumeFileWriter : public vtkObject
+{
+public:
+  static vtkPlusVolumeFileWriter* New();
+  vtkTypeMacro(vtkPlusVolumeFileWriter, vtkObject);
+  virtual void PrintSelf(ostream& os, vtkIndent indent) override;
+
+  /*! Returns true if the file can be written by this class (based on the file extension) */
+  static bool CanWriteFile(const std::string& filename);
+
+  /*! Write the volume to file. Relative paths are relative to the output directory. */
+  PlusStatus Write(vtkImageData* volume, const std::string& filename);
+
+  /*! Compress the voxel data (default: true) */
+  vtkSetMacro(UseCompression, bool);
+  vtkGetMacro(UseCompression, bool);
+  vtkBooleanMacro(UseCompression, bool);
+
+  /*! zlib compression level (0-9, -1 for the zlib default) */
+  vtkSetMacro(CompressionLevel, int);
+  vtkGetMacro(CompressionLevel, int);
+
+  /*! Number of threads that compress the slabs (default: number of processors) */
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
+  /*! Size of the parts of the voxel array that are compressed and written at once */
+  vtkSetMacro(SlabSizeBytes, int);
+  vtkGetMacro(SlabSizeBytes, int);
+
+  /*! Size of the written file (header and voxel data) in bytes, after the last Write */
+  vtkGetMacro(NumberOfWrittenBytes, unsigned long long);
+
+protected:
+  vtkPlusVolumeFileWriter();
+  virtual ~vtkPlusVolumeFileWriter();
+
+  /*! Append the voxel data to the file, compressed if requested. numberOfWrittenBytes is set to the size of the data in the file. */
+  PlusStatus WriteVoxels(std::ostream& file, const unsigned char* voxels, unsigned long long numberOfVoxelBytes, bool gzipFormat, unsigned long long& numberOfWrittenBytes);
+
+protected:
+  bool UseCompression;
+  int CompressionLevel;
+  int NumberOfThreads;
+  int SlabSizeBytes;
+  unsigned long long NumberOfWrittenBytes;
+
+private:
+  vtkPlusVolumeFileWriter(const vtkPlusVolumeFileWriter&);  // Not implemented.
+  void operator=(const vtkPlusVolumeFileWriter&);  // Not implemented.
+};
+
+#endif
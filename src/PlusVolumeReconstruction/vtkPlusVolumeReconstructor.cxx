@@ -7,17 +7,43 @@
 // Local includes
 #include "PlusConfigure.h"
 #include "vtkPlusSequenceIO.h"
+#include "vtkPlusVolumeFileWriter.h"
 #include "vtkPlusVolumeReconstructor.h"
 
+// IGSIO includes
+#include <igsioTrackedFrame.h>
+#include <vtkIGSIOTransformRepository.h>
+
 // VTK includes
+#include <vtkImageData.h>
 #include <vtkImageFlip.h>
+#include <vtkMatrix4x4.h>
 #include <vtkObjectFactory.h>
 #include <vtkPNGReader.h>
 
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
 vtkStandardNewMacro(vtkPlusVolumeReconstructor);
 
+namespace
+{
+  const int DEFAULT_MODIFIED_BRICK_SIZE = 32;
+
+  // If the modified regions are not retrieved then after this many frames the whole volume is considered as modified
+  const size_t MAX_NUMBER_OF_MODIFIED_REGIONS = 10000;
+
+  // The interpolation kernel may write voxels next to the frame bounding box
+  const int MODIFIED_REGION_MARGIN_VOXELS = 1;
+}
+
 //----------------------------------------------------------------------------
 vtkPlusVolumeReconstructor::vtkPlusVolumeReconstructor()
+  : ModifiedBrickSize(DEFAULT_MODIFIED_BRICK_SIZE)
+  , ModifiedRegionsOverflow(false)
 {
 }
 
@@ -64,6 +90,20 @@ PlusStatus vtkPlusVolumeReconstructor::SaveReconstructedVolumeToFile(vtkImageDat
     return PLUS_FAIL;
   }
 
+  if (useCompression && vtkPlusVolumeFileWriter::CanWriteFile(filename))
+  {
+    // Compressed in parallel and written directly from the volume, without copying it into a frame list.
+    // Uncompressed files are still written as sequence files, which keeps them identical to the regression test baselines.
+    vtkSmartPointer<vtkPlusVolumeFileWriter> writer = vtkSmartPointer<vtkPlusVolumeFileWriter>::New();
+    writer->SetUseCompression(true);
+    if (writer->Write(volumeToSave, filename) != PLUS_SUCCESS)
+    {
+      LOG_ERROR("Failed to save reconstructed volume to file: " << filename);
+      return PLUS_FAIL;
+    }
+    return PLUS_SUCCESS;
+  }
+
   int dims[3];
   volumeToSave->GetDimensions(dims);
   FrameSizeType frameSize = { static_cast<unsigned int>(dims[0]), static_cast<unsigned int>(dims[1]), static_cast<unsigned int>(dims[2]) };
@@ -124,3 +164,226 @@ PlusStatus vtkPlusVolumeReconstructor::UpdateImportanceMask()
   }
   return PLUS_SUCCESS;
 }
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusVolumeReconstructor::AddModifiedRegion(igsioTrackedFrame* frame, vtkIGSIOTransformRepository* transformRepository)
+{
+  if (frame == NULL || transformRepository == NULL)
+  {
+    LOG_ERROR("vtkPlusVolumeReconstructor::AddModifiedRegion: invalid input frame or transform repository");
+    return PLUS_FAIL;
+  }
+  if (this->ModifiedRegionsOverflow)
+  {
+    // The whole volume is already considered as modified
+    return PLUS_SUCCESS;
+  }
+  if (this->ModifiedRegions.size() >= MAX_NUMBER_OF_MODIFIED_REGIONS)
+  {
+    LOG_DEBUG("Modified regions of the reconstructed volume have not been retrieved for " << this->ModifiedRegions.size() << " frames, the whole volume is considered as modified");
+    this->ModifiedRegions.clear();
+    this->ModifiedRegionsOverflow = true;
+    return PLUS_SUCCESS;
+  }
+
+  igsioTransformName imageToReferenceTransformName(this->GetImageCoordinateFrame(), this->GetReferenceCoordinateFrame());
+  vtkSmartPointer<vtkMatrix4x4> imageToReferenceTransformMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (transformRepository->GetTransform(imageToReferenceTransformName, imageToReferenceTransformMatrix) != PLUS_SUCCESS)
+  {
+    std::string strTransformName;
+    imageToReferenceTransformName.GetTransformName(strTransformName);
+    LOG_ERROR("Unable to compute the modified region of the reconstructed volume, transform is not available: " << strTransformName);
+    return PLUS_FAIL;
+  }
+
+  // Pixel index range of the pasted part of the frame, extended by half a pixel to include the full area of the boundary pixels
+  FrameSizeType frameSize = frame->GetFrameSize();
+  double pixelRange[3][2] =
+  {
+    { -0.5, frameSize[0] - 0.5 },
+    { -0.5, frameSize[1] - 0.5 },
+    { -0.5, std::max<unsigned int>(frameSize[2], 1) - 0.5 }
+  };
+  int* clipRectangleOrigin = this->GetClipRectangleOrigin();
+  int* clipRectangleSize = this->GetClipRectangleSize();
+  if (clipRectangleOrigin != NULL && clipRectangleSize != NULL && clipRectangleSize[0] > 0 && clipRectangleSize[1] > 0)
+  {
+    for (int axis = 0; axis < 2; ++axis)
+    {
+      pixelRange[axis][0] = std::max(pixelRange[axis][0], clipRectangleOrigin[axis] - 0.5);
+      pixelRange[axis][1] = std::min(pixelRange[axis][1], clipRectangleOrigin[axis] + clipRectangleSize[axis] - 0.5);
+    }
+  }
+
+  ModifiedRegion region;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    region.BoundsMm[axis * 2] = std::numeric_limits<double>::max();
+    region.BoundsMm[axis * 2 + 1] = -std::numeric_limits<double>::max();
+  }
+  for (int cornerIndex = 0; cornerIndex < 8; ++cornerIndex)
+  {
+    double corner_Image[4] = { pixelRange[0][cornerIndex & 1], pixelRange[1][(cornerIndex >> 1) & 1], pixelRange[2][(cornerIndex >> 2) & 1], 1.0 };
+    double corner_Reference[4] = { 0, 0, 0, 1 };
+    imageToReferenceTransformMatrix->MultiplyPoint(corner_Image, corner_Reference);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      region.BoundsMm[axis * 2] = std::min(region.BoundsMm[axis * 2], corner_Reference[axis]);
+      region.BoundsMm[axis * 2 + 1] = std::max(region.BoundsMm[axis * 2 + 1], corner_Reference[axis]);
+    }
+  }
+  region.Timestamp = frame->GetTimestamp();
+  this->ModifiedRegions.push_back(region);
+
+  return PLUS_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlusVolumeReconstructor::ClearModifiedRegions()
+{
+  this->ModifiedRegions.clear();
+  this->ModifiedRegionsOverflow = false;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlusVolumeReconstructor::GetModifiedBrickExtents(vtkImageData* volume, std::vector< std::array<int, 6> >& modifiedBrickExtents, double& oldestModificationTimestamp)
+{
+  modifiedBrickExtents.clear();
+  oldestModificationTimestamp = UNDEFINED_TIMESTAMP;
+  if (volume == NULL)
+  {
+    LOG_ERROR("vtkPlusVolumeReconstructor::GetModifiedBrickExtents: invalid input volume");
+    return false;
+  }
+  if (this->ModifiedRegionsOverflow)
+  {
+    this->ClearModifiedRegions();
+    return false;
+  }
+
+  int extent[6] = { 0, -1, 0, -1, 0, -1 };
+  volume->GetExtent(extent);
+  double origin[3] = { 0, 0, 0 };
+  volume->GetOrigin(origin);
+  double spacing[3] = { 1, 1, 1 };
+  volume->GetSpacing(spacing);
+  const int brickSize = std::max(1, this->ModifiedBrickSize);
+
+  int numberOfBricks[3] = { 0, 0, 0 };
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    numberOfBricks[axis] = (extent[axis * 2 + 1] - extent[axis * 2] + brickSize) / brickSize;
+    if (numberOfBricks[axis] <= 0 || spacing[axis] == 0)
+    {
+      // Empty volume
+      this->ClearModifiedRegions();
+      return true;
+    }
+  }
+
+  std::vector<bool> isBrickModified(numberOfBricks[0] * numberOfBricks[1] * numberOfBricks[2], false);
+  for (std::vector<ModifiedRegion>::const_iterator regionIt = this->ModifiedRegions.begin(); regionIt != this->ModifiedRegions.end(); ++regionIt)
+  {
+    int brickRange[3][2] = { { 0, -1 }, { 0, -1 }, { 0, -1 } };
+    bool regionIsInVolume = true;
+    for (int axis = 0; axis < 3 && regionIsInVolume; ++axis)
+    {
+      double firstVoxel = (regionIt->BoundsMm[axis * 2] - origin[axis]) / spacing[axis];
+      double lastVoxel = (regionIt->BoundsMm[axis * 2 + 1] - origin[axis]) / spacing[axis];
+      if (firstVoxel > lastVoxel)
+      {
+        // negative spacing
+        std::swap(firstVoxel, lastVoxel);
+      }
+      firstVoxel = std::max(std::floor(firstVoxel) - MODIFIED_REGION_MARGIN_VOXELS, static_cast<double>(extent[axis * 2]));
+      lastVoxel = std::min(std::ceil(lastVoxel) + MODIFIED_REGION_MARGIN_VOXELS, static_cast<double>(extent[axis * 2 + 1]));
+      if (firstVoxel > lastVoxel)
+      {
+        regionIsInVolume = false;
+        break;
+      }
+      brickRange[axis][0] = (static_cast<int>(firstVoxel) - extent[axis * 2]) / brickSize;
+      brickRange[axis][1] = (static_cast<int>(lastVoxel) - extent[axis * 2]) / brickSize;
+    }
+    if (!regionIsInVolume)
+    {
+      continue;
+    }
+    if (oldestModificationTimestamp == UNDEFINED_TIMESTAMP || regionIt->Timestamp < oldestModificationTimestamp)
+    {
+      oldestModificationTimestamp = regionIt->Timestamp;
+    }
+    for (int k = brickRange[2][0]; k <= brickRange[2][1]; ++k)
+    {
+      for (int j = brickRange[1][0]; j <= brickRange[1][1]; ++j)
+      {
+        for (int i = brickRange[0][0]; i <= brickRange[0][1]; ++i)
+        {
+          isBrickModified[(k * numberOfBricks[1] + j) * numberOfBricks[0] + i] = true;
+        }
+      }
+    }
+  }
+  this->ClearModifiedRegions();
+
+  for (int k = 0; k < numberOfBricks[2]; ++k)
+  {
+    for (int j = 0; j < numberOfBricks[1]; ++j)
+    {
+      for (int i = 0; i < numberOfBricks[0]; ++i)
+      {
+        if (!isBrickModified[(k * numberOfBricks[1] + j) * numberOfBricks[0] + i])
+        {
+          continue;
+        }
+        std::array<int, 6> brickExtent;
+        int brickIndex[3] = { i, j, k };
+        for (int axis = 0; axis < 3; ++axis)
+        {
+          brickExtent[axis * 2] = extent[axis * 2] + brickIndex[axis] * brickSize;
+          brickExtent[axis * 2 + 1] = std::min(brickExtent[axis * 2] + brickSize - 1, extent[axis * 2 + 1]);
+        }
+        modifiedBrickExtents.push_back(brickExtent);
+      }
+    }
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+PlusStatus vtkPlusVolumeReconstructor::ExtractBrick(vtkImageData* volume, const int brickExtent[6], vtkImageData* brick)
+{
+  if (volume == NULL || brick == NULL)
+  {
+    LOG_ERROR("vtkPlusVolumeReconstructor::ExtractBrick: invalid input or output image");
+    return PLUS_FAIL;
+  }
+  int volumeExtent[6] = { 0, -1, 0, -1, 0, -1 };
+  volume->GetExtent(volumeExtent);
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    if (brickExtent[axis * 2] > brickExtent[axis * 2 + 1] || brickExtent[axis * 2] < volumeExtent[axis * 2] || brickExtent[axis * 2 + 1] > volumeExtent[axis * 2 + 1])
+    {
+      LOG_ERROR("vtkPlusVolumeReconstructor::ExtractBrick: brick extent is outside the volume extent");
+      return PLUS_FAIL;
+    }
+  }
+
+  brick->SetOrigin(volume->GetOrigin());
+  brick->SetSpacing(volume->GetSpacing());
+  brick->SetExtent(brickExtent[0], brickExtent[1], brickExtent[2], brickExtent[3], brickExtent[4], brickExtent[5]);
+  brick->AllocateScalars(volume->GetScalarType(), volume->GetNumberOfScalarComponents());
+
+  // Rows of the brick are contiguous in the volume, so they are copied at once
+  const size_t rowSizeBytes = static_cast<size_t>(brickExtent[1] - brickExtent[0] + 1) * volume->GetScalarSize() * volume->GetNumberOfScalarComponents();
+  for (int k = brickExtent[4]; k <= brickExtent[5]; ++k)
+  {
+    for (int j = brickExtent[2]; j <= brickExtent[3]; ++j)
+    {
+      memcpy(brick->GetScalarPointer(brickExtent[0], j, k), volume->GetScalarPointer(brickExtent[0], j, k), rowSizeBytes);
+    }
+  }
+
+  return PLUS_SUCCESS;
+}
@@ -14,6 +14,13 @@
 #include <igsioCommon.h>
 #include <vtkIGSIOVolumeReconstructor.h>
 
+// STL includes
+#include <array>
+#include <vector>
+
+class igsioTrackedFrame;
+class vtkIGSIOTransformRepository;
+
 /*!
   \class vtkPlusVolumeReconstructor
   \brief Reconstructs a volume from tracked frames
@@ -36,6 +43,13 @@
   If no reference DRB is used then use Identity ReferenceToTracker transforms, and so
   Reference will be the same as Tracker. So we can still refer to the output system as Reference.
 
+  The class can keep track of the parts of the volume that have been modified since they were last
+  retrieved, so that clients of a live reconstruction only need to receive the modified parts.
+  The volume is divided into cubic bricks (ModifiedBrickSize voxels along each axis) and a brick is
+  reported as modified if it intersects the bounding box of a frame that has been pasted into the volume.
+  Pasting is performed by the IGSIO reconstructor, therefore the modified region is computed from the
+  clip rectangle and pose of the frame, which may include a few unmodified voxels but never misses any.
+
   \sa vtkPlusPasteSliceIntoVolume
   \ingroup PlusLibVolumeReconstruction
 */
@@ -60,6 +74,7 @@ public:
 
   /*!
     Save reconstructed volume to file
+    Compressed .mha and .nrrd files are written by vtkPlusVolumeFileWriter, directly from the volume and compressed in parallel.
     \param volumeToSave Reconstructed volume to be saved
     \param filename Path and filename of the output file
     \useCompression True if compression is turned on (default), false otherwise
@@ -67,10 +82,54 @@ public:
   static PlusStatus SaveReconstructedVolumeToFile(vtkImageData* volumeToSave, const std::string& filename, bool useCompression = true);
   static PlusStatus SaveReconstructedVolumeToMetafile(vtkImageData* volumeToSave, const std::string& filename, bool useCompression = true) { return vtkPlusVolumeReconstructor::SaveReconstructedVolumeToFile(volumeToSave, filename, useCompression); }
 
+  /*!
+    Record the region of the volume that may have been modified by pasting a frame.
+    Call it after the frame has been inserted into the volume by AddTrackedFrame, with the same transform repository.
+  */
+  PlusStatus AddModifiedRegion(igsioTrackedFrame* frame, vtkIGSIOTransformRepository* transformRepository);
+
+  /*! Forget all the recorded modified regions (e.g., when the volume is cleared or sent to the client completely) */
+  void ClearModifiedRegions();
+
+  /*!
+    Get the bricks of the volume that intersect the regions that have been modified since the last call
+    and clear the list of modified regions.
+    \param volume Reconstructed volume, it defines the voxel grid of the bricks
+    \param modifiedBrickExtents Voxel extent of each modified brick, bricks at the boundary of the volume are clipped to the volume extent
+    \param oldestModificationTimestamp Timestamp of the earliest frame that modified the returned bricks (UNDEFINED_TIMESTAMP if no bricks are modified)
+    \return False if the modified regions could not be tracked (e.g., too many regions were recorded),
+      in this case the whole volume has to be considered as modified
+  */
+  bool GetModifiedBrickExtents(vtkImageData* volume, std::vector< std::array<int, 6> >& modifiedBrickExtents, double& oldestModificationTimestamp);
+
+  /*! Size of the bricks (in voxels along each axis) that are used for tracking the modified parts of the volume */
+  vtkSetMacro(ModifiedBrickSize, int);
+  /*! Size of the bricks (in voxels along each axis) that are used for tracking the modified parts of the volume */
+  vtkGetMacro(ModifiedBrickSize, int);
+
+  /*! Copy a part of a volume into a new image. The brick keeps the origin and spacing of the volume, its extent is the requested extent. */
+  static PlusStatus ExtractBrick(vtkImageData* volume, const int brickExtent[6], vtkImageData* brick);
+
 protected:
   vtkPlusVolumeReconstructor();
   virtual ~vtkPlusVolumeReconstructor();
 
+  /*! Bounding box of a frame that was pasted into the volume, in the Reference coordinate system */
+  struct ModifiedRegion
+  {
+    double BoundsMm[6];
+    double Timestamp;
+  };
+
+  /*! Size of the bricks (in voxels along each axis) that are used for tracking the modified parts of the volume */
+  int ModifiedBrickSize;
+
+  /*! Regions modified since the last call of GetModifiedBrickExtents */
+  std::vector<ModifiedRegion> ModifiedRegions;
+
+  /*! More regions were modified than what can be tracked, the whole volume has to be considered as modified */
+  bool ModifiedRegionsOverflow;
+
 private:
   vtkPlusVolumeReconstructor(const vtkPlusVolumeReconstructor&);  // Not implemented.
   void operator=(const vtkPlusVolumeReconstructor&);  // Not implemented.